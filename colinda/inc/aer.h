@@ -23,8 +23,18 @@ extern "C" {
 #include "core/QueueHookable.h"
 */
 
-#define MAX_AER_TUPLES 56
-//#define MAX_AER_TUPLES 255
+/**
+ * The capacity of a buffer that is not resized, see resizeAER. Capacities are a power of two,
+ * so an index wraps around with a mask. One slot is always kept free, to tell a full buffer
+ * from an empty one.
+ */
+#ifndef MAX_AER_TUPLES
+#define MAX_AER_TUPLES 64
+#endif
+
+#if (MAX_AER_TUPLES & (MAX_AER_TUPLES - 1))
+#error "MAX_AER_TUPLES should be a power of two"
+#endif
 
 /**
  * A tuple of an address and an event. AER means Address Event Representation. The
@@ -44,10 +54,17 @@ union AER {
 	int32_t data;
 };
 
+/**
+ * A circular buffer of AER tuples. The tuples are in the fixed array of the buffer itself,
+ * unless the buffer is resized, then in an allocated array of another capacity. A resized
+ * buffer should be freed with freeAER.
+ */
 struct AERBuffer {
-	union AER aer[MAX_AER_TUPLES];
-	uint8_t head;
-	uint8_t tail;
+	union AER *aer;
+	uint16_t mask;
+	uint16_t head;
+	uint16_t tail;
+	union AER fixed[MAX_AER_TUPLES];
 };
 
 #ifdef __cplusplus
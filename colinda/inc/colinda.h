@@ -6,9 +6,19 @@ extern "C" {
 #endif 
 	
 #include <inttypes.h>
+#include <context.h>
 	
+struct AERBuffer;
+struct TcpipMessage;
+
+/**
+ * The buffers for the spikes from the sensors and to the actuators are kept for the lifetime
+ * of the controller. LINDA_AER_CAPACITY gives them another capacity than MAX_AER_TUPLES.
+ */
 struct ColindaRuntime {
 	struct SyncThreads *sync;
+	struct AERBuffer *spikes_in;
+	struct AERBuffer *spikes_out;
 };
 	
 /**
@@ -18,11 +28,16 @@ struct ColindaRuntime {
  * something in user space and use only a subset of the colinda functionality. The pointer to the dna 
  * buffer can be used to reuse the same buffer to load a genome that is actually much bigger. So, this
  * saves some space on the device. The id is used in the simulator mode to send messages to the Linda
- * engine. It might or might not be necessary in the real setting.
+ * engine. It might or might not be necessary in the real setting. The dedicated monks only handle
+ * sensor data and network traffic, so development of a new network never delays the control loop.
  */
+//! The amount of parts of a genome that can be ahead of the next one, at most 32
+#define COLINDA_GENOME_WINDOW		16
+
 struct ColindaConfig {
 	uint8_t monk_count;
 	uint8_t task_count;
+	uint8_t dedicated_monk_count;
 	void *(*boot)(void*);
 	
 	int16_t dna_buffer_ptr;
@@ -30,7 +45,71 @@ struct ColindaConfig {
 	uint8_t id;
 };
 
-struct ColindaConfig *clconf;
+/**
+ * A genome that is multicast is assembled here, from parts that come in any order, possibly
+ * before the Elinda engine announced which genome this robot gets. It is identified by its
+ * hash, so one assembly serves every robot that gets the same genome. The bitmap has a bit
+ * raised for every part that is still missing. Wanted is set when the genome is announced
+ * for this robot and not developed yet.
+ */
+struct GenomeAssembly {
+	uint32_t hash;
+	uint16_t size;
+	uint16_t part_count;
+	uint16_t missing_count;
+	uint8_t wanted;
+	uint8_t repairs;
+	unsigned int used;
+	uint8_t *content;
+	uint8_t *missing;
+};
+
+/**
+ * The genome that is received last, as the base for a genome that is sent as a delta. It
+ * is only valid when it is received entirely, then its hash is set.
+ */
+struct GenomeCache {
+	uint8_t *content;
+	uint16_t size;
+	uint16_t capacity;
+	uint32_t hash;
+	uint8_t valid;
+};
+
+/**
+ * The parts of a genome that is sent to this robot alone can come in any order, up to
+ * COLINDA_GENOME_WINDOW parts after the next one the genes are extracted from, which is
+ * dna_part_ptr in ColindaConfig. Those parts are kept, with a bit raised in received for
+ * each of them, the lowest bit for the next part, until the parts before them are there.
+ * The parts are extracted in buffer, after the codons that are left of the previous part,
+ * so it is 8 codons larger than a part.
+ */
+struct GenomeWindow {
+	uint8_t part_count;
+	uint32_t received;
+	struct TcpipMessage *parts[COLINDA_GENOME_WINDOW];
+	uint8_t *buffer;
+};
+
+/**
+ * The parts of a network that is developed by the Elinda engine, see netframe.h, are put
+ * together in frame, with a bit raised in received for every part that is there. Parts of
+ * another frame make it start anew.
+ */
+struct NetworkAssembly {
+	uint32_t hash;
+	uint32_t size;
+	uint16_t part_count;
+	uint16_t part_received;
+	uint8_t *received;
+	uint8_t *frame;
+};
+
+//! The amount of multicast genomes that are assembled or kept at once
+#define COLINDA_ASSEMBLY_COUNT		8
+//! How long to wait for missing parts before they are asked for again, in microseconds
+#define COLINDA_REPAIR_DELAY		20000
+#define COLINDA_REPAIR_TRIALS		10
 
 struct ColindaRuntime *clruntime;
 
@@ -0,0 +1,109 @@
+/**
+ * @file context.h
+ * @brief The state of one controller, to host more of them in one process
+ * @author Anne C. van Rossum
+ *
+ * All routines of the developmental engine and the network operate on the state of a
+ * ColindaContext: the genome, the extracted genes, the grid, the embryogeny, the network and
+ * the state of the run loop, and the neuron routines on its "n", see neuron.h. The routines
+ * below are given the context. developNeuralNetworkIn, runNeuralNetworkIn, updateGridIn and
+ * applyEmbryogenesisIn are where that is done, developNeuralNetwork etc. are thin wrappers
+ * over them with the context of the process, the one of the robot itself. The others enter
+ * the context for one call.
+ *
+ * The routines that they call find the context through clctx, a pointer of every thread,
+ * which is the context of the process, unless the thread entered or switched to another.
+ * Entering a context makes it the one of the thread, leaving it goes back to the one from
+ * before. A task does not inherit the context of the thread that dispatched it, so what is
+ * dispatched carries its context with it, like the tiles of a grid do, see updateGridTiles.
+ *
+ * So the contexts are independent, and many controllers can develop and run at the same time
+ * in a process, each on its own monk. A context should be used by one thread at a time, next
+ * to the tasks it dispatches itself. The robots docked to the grid, see dockGrid, are of the
+ * process and not of a context.
+ */
+
+#ifndef CONTEXT_H_
+#define CONTEXT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+
+struct AERBuffer;
+
+struct ColindaContext {
+	//! The neuron the neuron routines operate on
+	struct Neuron *n;
+	//! The neuron the cellular encoding operations navigate, next to the current port
+	struct Neuron *np;
+	struct NN *nn;
+	struct CompiledNetwork *cn;
+	struct GridCell *gc;
+	struct Space *s;
+	struct Embryogeny *e;
+	//! The gene that is updated, the scheduling of the genes is up to the consumer side
+	struct Gene *g;
+	//! The genome, received over one of the input ports, or made by the evolution
+	struct Genome *dna;
+	//! The valid genes on the "dna", each denoted by a marker
+	struct ExtractedGenome *eg;
+	struct GenomeConfig *gconf;
+	struct ColindaConfig *clconf;
+	struct Region *region;
+	uint16_t *distribution;
+	uint8_t running_state;
+	//! The context the thread was in before it entered this one
+	struct ColindaContext *outer;
+};
+
+/**
+ * The context of the thread, see above.
+ */
+extern __thread struct ColindaContext *clctx;
+
+/**
+ * The context of the process, which holds nothing as the process starts.
+ */
+extern struct ColindaContext processContext;
+
+struct ColindaContext *newColindaContext(uint8_t id);
+
+void freeColindaContext(struct ColindaContext *context);
+
+void enterColindaContext(struct ColindaContext *context);
+
+void leaveColindaContext(struct ColindaContext *context);
+
+/**
+ * Makes the context the one of the thread, and returns the one it was in, to switch back to
+ * after the call. Unlike entering, a thread can switch to the context it is in already.
+ */
+struct ColindaContext *switchColindaContext(struct ColindaContext *context);
+
+void extractGenesIn(struct ColindaContext *context, const uint8_t *genome, uint16_t size);
+
+void developNeuralNetworkIn(struct ColindaContext *context);
+
+void developCachedNeuralNetworkIn(struct ColindaContext *context, uint32_t hash, uint32_t size);
+
+uint8_t runNeuralNetworkIn(struct ColindaContext *context, struct AERBuffer *in,
+		struct AERBuffer *out);
+
+uint8_t stepEmbryologyIn(struct ColindaContext *context);
+
+void updateGridIn(struct ColindaContext *context);
+
+uint16_t applyEmbryogenesisIn(struct ColindaContext *context);
+
+uint16_t getTopologyIn(struct ColindaContext *context, uint8_t *topology, uint16_t size);
+
+uint8_t *getNetworkFrameIn(struct ColindaContext *context, uint32_t *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*CONTEXT_H_*/
@@ -0,0 +1,78 @@
+/**
+ * @file controlloop.h
+ * @brief A thread of its own for the path from the sensors to the actuators
+ * @author Anne C. van Rossum
+ *
+ * Normally every sensor message is a task on the abbey, and it waits for a monk like any other
+ * task. With the control loop started, the sensor values are put in a queue instead, without
+ * a lock, and a thread of its own takes them out one frame after the other: it generates the
+ * spikes, runs the network a fixed amount of ticks, reads out the spikes and emits the values
+ * for the actuators itself. The thread asks for SCHED_FIFO, and runs with the normal policy
+ * if it is not allowed to.
+ *
+ * The loop owns the buffers it is started with and the network while it runs: no task should
+ * run the network in the meantime. A frame that does not fit in the queue is dropped, the
+ * loop is behind already.
+ *
+ * For every frame the latency from the moment it is queued until its actuator values are
+ * emitted is recorded, with a deadline miss when it is above the deadline, and the jitter,
+ * the difference with the latency of the frame before. The time of every tick of the network
+ * is recorded as well. The histograms are the log-linear ones of the abbey, see AbbeyStats.
+ */
+
+#ifndef CONTROLLOOP_H_
+#define CONTROLLOOP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+#include <linda/abbey.h>
+
+//! The most sensor values in a frame
+#define CONTROL_FRAME_SIZE		64
+//! The amount of frames in the queue, a power of two
+#define CONTROL_QUEUE_SIZE		16
+//! The priority of the thread under SCHED_FIFO
+#define CONTROL_LOOP_PRIORITY	50
+
+struct AERBuffer;
+
+struct ControlLoopStats {
+	unsigned long frames;
+	unsigned long dropped;
+	unsigned long misses;
+	unsigned long ticks;
+	unsigned long long deadline_ns;
+	unsigned long long latency_ns_total;
+	unsigned int latency_histogram[ABBEY_STATS_BUCKETS];
+	unsigned int jitter_histogram[ABBEY_STATS_BUCKETS];
+	unsigned int tick_histogram[ABBEY_STATS_BUCKETS];
+};
+
+/**
+ * Starts the thread, which runs the network the given amount of ticks per frame, with the
+ * given buffers, and calls emit with the values for the actuators. Returns 0 on success.
+ */
+int startControlLoop(uint8_t ticks, unsigned long deadline_us, struct AERBuffer *in,
+		struct AERBuffer *out, void (*emit)(int16_t *output));
+
+void stopControlLoop();
+
+uint8_t controlLoopRunning();
+
+/**
+ * Queues a frame of sensor values, from any thread. Returns 0 if it is dropped.
+ */
+uint8_t pushSensorFrame(const uint8_t *values, uint8_t size);
+
+void controlLoopStats(struct ControlLoopStats *stats);
+
+void controlLoopStatsDump();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*CONTROLLOOP_H_*/
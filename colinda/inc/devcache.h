@@ -0,0 +1,44 @@
+/**
+ * @file devcache.h
+ * @brief A cache of developed networks, by the genome they are developed from
+ * @author Anne C. van Rossum
+ *
+ * Development is deterministic, given the genome and the parameters of the genome, the grid
+ * and the embryogeny. Many robots in a generation get the same genome, because the survivors
+ * of the selection are cloned, and developing it again and again takes much longer than
+ * building the network that came out. So the network is kept as a blob: the neurons with
+ * their cells, types and state, the synapses with their weights and delays, and the order of
+ * the ports of every neuron. The key is a hash over the hash of the genome and all those
+ * parameters, which are kept in the blob as well, to tell a collision of the key.
+ *
+ * The blobs are kept in memory up to DEVCACHE_CAPACITY bytes, the least recently used ones
+ * are dropped first. LINDA_DEVCACHE_SIZE can give another capacity. If LINDA_DEVCACHE names
+ * a directory, every blob is written there too, and a blob that is not in memory is looked
+ * for there, so clones are also found over runs. The blobs are in the byte order of the
+ * machine, a directory should not be shared between different architectures.
+ */
+
+#ifndef DEVCACHE_H_
+#define DEVCACHE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+
+#define DEVCACHE_CAPACITY		(256 * 1024)
+
+uint32_t developmentKey(uint32_t genomeHash, uint32_t genomeSize);
+
+uint8_t restoreDevelopment(uint32_t key);
+
+void storeDevelopment(uint32_t key);
+
+void freeDevelopments();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*DEVCACHE_H_*/
@@ -27,17 +27,29 @@ extern "C" {
 #endif 
 
 #include <inttypes.h>
+#include <context.h>
+
+#define EMBRYOGENY_STEP_BUDGET		1000
+#define EMBRYOGENY_STABLE_STEPS		10
 
 	/**
 	 * What kind of changes to the NN do we want to implement? Neurons may be duplicated to nearby
 	 * positions, or they might be randomly removed, or they may have some lifetime, or they may
 	 * grow into certain directions with higher concentrations. How to write it such that for example
 	 * columnar architectures may emerge?
+	 * 
+	 * Development takes at most step_budget steps. It stops earlier when for stable_steps steps in
+	 * a row no morphological change is applied, while the concentrations do not change or alternate
+	 * between two states. The step and the amount of such stable steps so far are in step and stable.
 	 */
 	struct Embryogeny {
 		void *start;
 		uint8_t default_delay;
 		float default_weight;
+		uint16_t step_budget;
+		uint8_t stable_steps;
+		uint16_t step;
+		uint8_t stable;
 	};
 
 	/**
@@ -49,8 +61,6 @@ extern "C" {
 		struct Port *current_port;
 	};
 
-	struct Embryogeny *e;
-
 	void init_embryology();
 	
 	void start_embryology();
@@ -59,15 +69,11 @@ extern "C" {
 	
 	void applyMorphologicalChange(uint8_t index);
 
+	uint8_t stepEmbryology();
+
 #ifdef WITH_PRINT_DISTRIBUTION
 	void printDistribution(uint8_t verbosity);
 #endif
-	
-	/**
-	 * Iterate all the cells and apply the cellular encoding operations. For that we need to pointers,
-	 * one that navigates the neuron space, one that navigates the synapse space. 
-	 */
-	struct Neuron *np;
 
 #ifdef WITH_TEST
 	uint16_t countNeurons();
@@ -0,0 +1,83 @@
+/**
+ * @file encoding.h
+ * @brief Encoding of sensor values into spikes
+ * @author Anne C. van Rossum
+ *
+ * Every sensor value, a channel, is encoded into spikes on the input cells of the grid, one
+ * cell per channel, row by row over the columns of the encoder, or over those of the grid if
+ * it has no columns of its own. A table gives the strength of every value of a sensor. The
+ * default table is the one of the infrared sensors of the e-puck, a small value is an obstacle
+ * nearby, and a strong stimulus. There are three codings:
+ *   # rate: a channel spikes as many times as its strength, spread evenly over the window;
+ *   # latency: every channel that has a strength at all spikes once, the strongest first, one
+ *     tick after the other, the rank order coding of Thorpe (see filter.c);
+ *   # population: a channel has population cells next to each other, every one of them stands
+ *     for a range of strengths, the cell of the range of the strength of the value spikes.
+ *
+ * The time stamp of a spike is in ticks of SPIKE_TICK_NS nanoseconds, of the monotonic clock,
+ * or of a tick counter that is given by the caller.
+ */
+
+#ifndef ENCODING_H_
+#define ENCODING_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define SPIKE_RATE				0
+#define SPIKE_LATENCY			1
+#define SPIKE_POPULATION		2
+
+//! The duration of a tick of the time stamps, one millisecond
+#define SPIKE_TICK_NS			1000000ULL
+//! The tuples that are written in the buffer at once
+#define SPIKE_BULK				64
+
+struct AERBuffer;
+
+struct SpikeEncoder {
+	uint8_t coding;
+	uint8_t columns;
+	uint8_t population;
+	uint8_t window;
+	uint8_t max_strength;
+	uint8_t strength[256];
+};
+
+/**
+ * An encoder with the table of the infrared sensors and the given coding.
+ */
+struct SpikeEncoder *newSpikeEncoder(uint8_t coding);
+
+/**
+ * Encodes size values at the given tick into the buffer. Returns the amount of values that
+ * are encoded entirely, the rest did not fit in the buffer.
+ */
+uint16_t encodeSpikes(struct SpikeEncoder *encoder, const uint8_t *input, uint16_t size,
+		uint16_t tick, struct AERBuffer *aerbuffer);
+
+/**
+ * The encoder generateSpikes uses, for all controllers in the process. LINDA_SPIKE_CODING
+ * chooses its coding, "rate", "latency" or "population".
+ */
+struct SpikeEncoder *getSpikeEncoder();
+
+/**
+ * Replaces the encoder generateSpikes uses, the encoder is taken over.
+ */
+void setSpikeEncoder(struct SpikeEncoder *encoder);
+
+/**
+ * The tick of the monotonic clock, or a counter that goes up on every call on a robot
+ * without one.
+ */
+uint16_t getSpikeTick();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*ENCODING_H_*/
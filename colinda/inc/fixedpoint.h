@@ -0,0 +1,92 @@
+/**
+ * @file fixedpoint.h
+ * @brief The numbers the compiled network runs on, floats or fixed-point
+ * @author Anne C. van Rossum
+ *
+ * On a microcontroller without a floating-point unit every float operation is a call into a
+ * software library. With WITH_FIXED_POINT the compiled network, see CompiledNetwork, keeps
+ * the state of its neurons and their inputs in Q16.16, 16 bits for the integral part and 16
+ * for the fraction, and the weights of its synapses in Q8.8, which halves them. All sums are
+ * saturated, so a value that overflows sticks to the largest or the smallest value instead
+ * of wrapping around. Development, the neurons themselves and the pointer form of the network
+ * remain in floats, they are converted once when the network is compiled.
+ *
+ * Without WITH_FIXED_POINT the types below are just floats.
+ */
+
+#ifndef FIXEDPOINT_H_
+#define FIXEDPOINT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <lindaconfig.h>
+#include <stdint.h>
+
+#ifdef WITH_FIXED_POINT
+
+typedef int32_t neural_t;
+typedef int16_t synaptic_t;
+
+#define FIXED_SHIFT			16
+#define FIXED_ONE			((int32_t)1 << FIXED_SHIFT)
+#define SYNAPTIC_SHIFT		8
+
+/**
+ * A constant in Q16.16, rounded to the nearest. With a constant argument the compiler does
+ * the arithmetic, no floats are left in the code.
+ */
+#define FIXED(x)			((neural_t)((x) * 65536.0 + (((x) >= 0) ? 0.5 : -0.5)))
+
+static inline neural_t saturateFixed(int64_t x) {
+	if (x > INT32_MAX) return INT32_MAX;
+	if (x < INT32_MIN) return INT32_MIN;
+	return (neural_t)x;
+}
+
+static inline neural_t addFixed(neural_t x, neural_t y) {
+	return saturateFixed((int64_t)x + y);
+}
+
+static inline neural_t mulFixed(neural_t x, neural_t y) {
+	return saturateFixed(((int64_t)x * y) >> FIXED_SHIFT);
+}
+
+/**
+ * A synaptic weight in Q8.8 as an input in Q16.16.
+ */
+static inline neural_t fromSynaptic(synaptic_t w) {
+	return (neural_t)w * (1 << (FIXED_SHIFT - SYNAPTIC_SHIFT));
+}
+
+static inline neural_t toFixed(float x) {
+	float f = x * 65536.0f;
+	if (f >= 2147483647.0f) return INT32_MAX;
+	if (f <= -2147483648.0f) return INT32_MIN;
+	return (neural_t)(f + ((f >= 0) ? 0.5f : -0.5f));
+}
+
+static inline synaptic_t toSynaptic(float x) {
+	float f = x * 256.0f;
+	if (f >= 32767.0f) return INT16_MAX;
+	if (f <= -32768.0f) return INT16_MIN;
+	return (synaptic_t)(f + ((f >= 0) ? 0.5f : -0.5f));
+}
+
+static inline float fromFixed(neural_t x) {
+	return x / 65536.0f;
+}
+
+#else
+
+typedef float neural_t;
+typedef float synaptic_t;
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*FIXEDPOINT_H_*/
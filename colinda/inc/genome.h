@@ -24,8 +24,7 @@ extern "C" {
 #endif 
 
 #include <stdint.h>
-
-	struct Product;
+#include <context.h>
 
 #ifdef MODULE_GRID
 #include <grid.h>
@@ -47,13 +46,6 @@ extern "C" {
 		uint8_t id[3];
 	};
 
-	struct Product {
-		uint8_t id[3];
-		uint8_t concentration;
-		uint8_t new_concentration;
-		struct Product *next;
-	};
-
 	/**
 	 * Contains only an array of characters, the default content of the Genome struct. This is
 	 * supposed to be allocated in one block with calloc, so individual codons can be retrieved
@@ -121,40 +113,50 @@ extern "C" {
 		struct Gene *next;
 	};
 
-	struct ExtractedGenome {
-		struct Gene *genes;
-		uint16_t gene_count;
-	};
-
 	/**
-	 * Three parameters are updated outside of this file, so the entire scheduling, the interaction between
-	 * the genes, etc. is upto the consumer side.
+	 * The genes that are extracted from one buffer, with their codons, are allocated at once, in
+	 * one block after this header. The blocks are freed by freeGenes, not the genes one by one.
 	 */
-	struct Gene *g;
+	struct GeneBlock {
+		struct GeneBlock *next;
+		struct Gene *genes;
+		union CodonGene *codons;
+	};
 
 	/**
-	 * The Genome is labelled "dna" and is filled on the robot by listening to one of it's input ports,
-	 * or in the simulator, by using dna of previous generations and applying mutational operators.  
+	 * A transcribed gene, compiled to what it does in the cell it codes for: if the concentration
+	 * of product_in lies between low and high (both exclusive), amount is added to the
+	 * concentration of product_out, else if it lies between 0 and 10 (exclusive), amount is
+	 * subtracted.
 	 */
-	struct Genome *dna;
+	struct GeneRule {
+		uint16_t cell;
+		uint8_t product_in;
+		uint8_t product_out;
+		uint8_t low;
+		uint8_t high;
+		int8_t amount;
+	};
 
 	/**
-	 * The extracted genome is a subset of genes on the "dna", where a valid gene is denoted by a
-	 * certain marker or id.
+	 * The genes are compiled to a table of rule_count rules by transcribeGenes, ordered by cell.
+	 * The rules of one cell are in the order of the genes, because a rule may regulate the
+	 * product_in of a rule after it. Every development of the extracted genome uses the same
+	 * table, until the genes are freed.
 	 */
-	struct ExtractedGenome *eg;
-
-	struct GenomeConfig *gconf;
+	struct ExtractedGenome {
+		struct Gene *genes;
+		struct GeneBlock *blocks;
+		uint16_t gene_count;
+		struct GeneRule *rules;
+		uint16_t rule_count;
+	};
 
 	void configGenome();
 
 	void freeGenome();
 	
-	void precalculateChangeConcentration(struct Product *p, int8_t amount);
-	
-	void changeConcentration(struct Product *p, int8_t amount);
-	
-	void updateConcentration();
+	void changeConcentration(uint8_t *c, int8_t amount);
 
 #ifdef WITH_TEST
 	void extractGenes(uint16_t genomeSize);
@@ -168,7 +170,9 @@ extern "C" {
 	
 	void transcribeGenes();
 
-	struct Product *getProduct(struct ProductId *id);
+	void compileGenes();
+
+	uint8_t *getConcentration(struct ProductId *id);
 	
 	void receiveNewGenome();
 	
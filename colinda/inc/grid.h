@@ -22,6 +22,8 @@
 extern "C" {
 #endif 
 	
+#include <context.h>
+
 struct GridCell;
 struct GridConnection;
 
@@ -35,14 +37,14 @@ struct GridContainer {
 
 /**
  * To be able to quickly iterate through the cells in a grid, they are organized in a linked list
- * besides being organized by connections between the cells.
+ * besides being organized by connections between the cells. The list is a view on the array of
+ * cells in the Space, row by row, so next is also the cell with the next index.
  */
 struct GridCell {
-	struct Product *products;
 	struct GridConnection *connections;
 	struct GridCell *next;
 	struct Neuron *neuron;
-	struct Position *position;
+	struct Position position;
 };
 
 /**
@@ -57,39 +59,128 @@ struct GridConnection {
 	struct GridConnection *next;
 };
 
+/**
+ * The rows from first_row up to last_row, that are updated together when the grid is updated
+ * in parallel, on a monk that takes on the context the grid is of.
+ */
+struct GridTile {
+	uint8_t first_row;
+	uint8_t last_row;
+	struct ColindaContext *context;
+};
+
+//! The sides of the grid, the opposite of a side is the side xor 1
+#define GRID_NORTH		0
+#define GRID_SOUTH		1
+#define GRID_EAST		2
+#define GRID_WEST		3
+#define GRID_SIDES		4
+#define GRID_OPPOSITE(side)	((side) ^ 1)
+
+/**
+ * A side of the grid on which another robot is docked, with robot its id, or -1 if there
+ * is none. The cells along the side count the remote cell across as a neighbour. Outgoing
+ * accumulates the parts they give to it, per product, until the halo is exchanged. The
+ * incoming halos are double buffered by the parity of the exchange, and exchange is the
+ * number of the exchange received in such a buffer plus one, 0 if it is empty.
+ */
+struct GridBorder {
+	int16_t robot;
+	uint16_t length;
+	uint8_t *outgoing;
+	uint8_t *incoming[2];
+	volatile uint16_t exchange[2];
+};
+
 /**
  * Space is subdivided into a grid of cells, even though this might be tempting to define as
  * a double array, a linked list is used, so that it is easier to migrate to another tessalation
  * of the space, to a 3D space, to implement dynamics in the amount of grid cells, or to adjust
  * granularity with respect to resources at designtime or runtime. 
+ * 
+ * Underneath the list the cells are one array of rows * columns cells, row by row, so a cell is
+ * found by its index, and its neighbours by adding or subtracting one or a row. The connections
+ * between the cells are allocated in one array too, in links.
+ * 
+ * The concentrations of the gene products are not stored in the cells, but in one plane of
+ * rows * columns concentrations per product, [product][row][column], so diffusion is a stencil
+ * over a plane. The new_concentrations planes are the second buffer for diffusion. For the
+ * stencil every cell has its amount of neighbours, and a mask that is 0xFF if it has a
+ * neighbour east or west. Every product has a diffusion plane, padded by a row on both sides,
+ * for the parts that cells give to their neighbours. With more than one tile, the rows are
+ * divided over the tiles, which are updated in parallel in two phases. The history
+ * keeps the concentrations of the previous two steps, the previous one is the half given by last.
+ *
+ * The borders are the sides of the grid, remote is the amount of them on which a robot is
+ * docked. Every halo_interval steps the halos are exchanged with those robots, halo_step
+ * counts the steps of diffusion.
  */
 struct Space {
 	struct GridCell *gridcells;
+	struct GridConnection *links;
 	uint8_t rows;
 	uint8_t columns;
 	uint8_t decay_step; //Bongard 0.005 on 1.0 scale = 1/200, so on a 255 scale: decay of 1
-	uint8_t diffuse_ratio;
+	uint8_t diffuse_ratio; //should be 4 or more
 	uint8_t concentration_threshold;
 	uint8_t concentration_default;
+	uint8_t product_count;
+	uint8_t *concentrations;
+	uint8_t *new_concentrations;
+	uint8_t *neighbours, *east, *west;
+	uint8_t *diffusion;
+	uint8_t *history;
+	uint8_t last;
+	uint8_t tile_count;
+	uint8_t tile_phase;
+	struct GridTile *tiles;
+	struct GridBorder borders[GRID_SIDES];
+	uint8_t remote;
+	uint8_t halo_interval;
+	uint16_t halo_step;
 };
 
-struct GridCell *gc; 
-
-struct Space *s;
+/**
+ * Set by the engine to send the parts given over a side to the robot docked on it, packed
+ * per product, as the given exchange. Nothing is sent when it is not set.
+ */
+extern void (*sendGridHalo)(uint8_t side, uint8_t robot, uint16_t exchange,
+		uint8_t *parts, uint16_t size);
 
 struct GridCell *getGridCell(uint8_t x, uint8_t y);
 
+struct GridCell *getGridCellByIndex(uint16_t i);
+
+uint16_t getGridCellIndex(struct GridCell *lgc);
+
+uint16_t getTopology(uint8_t *topology, uint16_t size);
+
+uint8_t *getConcentrationPlane(uint8_t product_id);
+
 void configGrid();
 
+void dockGrid(uint8_t side, int16_t robot);
+
+uint8_t receiveGridHalo(uint8_t side, uint8_t robot, uint16_t exchange, const uint8_t *parts,
+		uint16_t size);
+
 void initGrid();
 
 void freeGrid();
 
 void initConcentrations();
 
+/**
+ * Updates the grid of the process, see updateGridIn in context.h.
+ */
 void updateGrid();
 
-void applyEmbryogenesis();
+uint32_t trackConcentrations(uint8_t *cycle);
+
+/**
+ * Applies the changes the grid of the process codes for, see applyEmbryogenesisIn.
+ */
+uint16_t applyEmbryogenesis();
 
 #ifdef WITH_CONSOLE
 void printGridToStr();
@@ -36,6 +36,12 @@ extern "C" {
 #define WITH_GUI 				0
 #define WITH_TEST				1
 #define WITH_PRINT_DISTRIBUTION  1
+#define WITH_NEURON_VECTORS		1 //update neurons in vectors of NEURON_LANES, if gcc can
+#define WITH_GENE_VECTORS		1 //scan the genome for start codons in vectors, if gcc can
+#define WITH_SPIKE_EVENTS		1 //deliver spikes through a ring of delay slots
+//#define WITH_FIXED_POINT		1 //run the compiled network in fixed-point, see fixedpoint.h
+//#define WITH_NETWORK_CHECK		1 //run the pointer form next to the compiled network
+#define WITH_RECORDER			1 //record development when LINDA_RECORD is set, see recorder.h
 	
 //#if WITH_CONSOLE == 0
 //#undef WITH_CONSOLE
@@ -61,6 +67,30 @@ extern "C" {
 #undef WITH_GUI
 #endif
 	
+#if WITH_NEURON_VECTORS == 0
+#undef WITH_NEURON_VECTORS
+#endif
+
+#if WITH_GENE_VECTORS == 0
+#undef WITH_GENE_VECTORS
+#endif
+
+#if WITH_SPIKE_EVENTS == 0
+#undef WITH_SPIKE_EVENTS
+#endif
+
+#if (WITH_RECORDER == 0) || defined(WITH_SYMBRICATOR)
+#undef WITH_RECORDER
+#endif
+
+#ifdef WITH_FIXED_POINT
+#undef WITH_NEURON_VECTORS
+#endif
+
+#ifndef NEURON_LANES
+#define NEURON_LANES			8
+#endif
+
 #if WITH_PRINT_DISTRIBUTION == 0
 #undef WITH_PRINT_DISTRIBUTION
 #endif
@@ -12,16 +12,19 @@
  * possible to have a "Neuron" datatype that can be very simple to very complex.   
  * 
  * @section conventions Conventions
- * - The most important design methodology: There are global variables used to make it possible for 
+ * - The most important design methodology: There are entity pointers used to make it possible for 
  * an iterator in another file to switch the current entities worked upon. This reduces the amount 
- * of function parameters considerably. So, instead of calling "update(neuron)", the parameter "n" 
- * will be set to for example the next neuron by "n = n->next" and just calling "update()".
- * - The names of those global variables are always as brief as possible. There is no "with" 
+ * of function parameters considerably. So, instead of calling "update(neuron)", the pointer "n" 
+ * will be set to for example the next neuron by "clctx->n = clctx->n->next" and just calling
+ * "update()". The pointers are in the context of the thread, clctx, see inc/context.h, so more
+ * controllers can develop and run in one process at the same time.
+ * - The names of those entity pointers are always as brief as possible. There is no "with" 
  * keyword in C, as in Pascal or even VB. Hence, a long name will all make all functions 
  * ridicuously verbose.
  * - The names of local variables will contain l is prefix, and also be as short as possible. So, 
  * a function might iterate through a list of neurons by using "ln = ln->next" and when real neuron
- * operators are called it sets "n = ln" and evokes for example "update()" like described above.     
+ * operators are called it sets "clctx->n = ln" and evokes for example "update()" like described
+ * above.     
  * - No "typedefs" are used, this means a little more typing of "union" and "struct" keywords. On a
  * change from union to struct, refactoring may take a while. However, the syntax with the keywords
  * is easier to highlight in most editors. And there are no lists of typedefs everywhere.
@@ -0,0 +1,64 @@
+/**
+ * @file netframe.h
+ * @brief A developed network as a frame that can be sent to a robot
+ * @author Anne C. van Rossum
+ *
+ * Developing a genome takes up to EMBRYOGENY_STEP_BUDGET steps of the gene regulatory network,
+ * with many allocations, which on the robot is the slowest part of a trial. The network that
+ * comes out does not change anymore, so it can just as well be developed by the Elinda engine,
+ * and be sent as a frame that the robot builds into its grid, after which it is compiled as
+ * any developed network, see finalizeNeuralNetwork. Genes are not extracted and there is no
+ * embryogeny. With LINDA_PRECOMPILE set Elinda sends frames, see elinda/inc/batch.h, else the
+ * robot gets the genome and develops it itself.
+ *
+ * A frame is in network byte order, the floats as their bits, so it can go from a PC to any
+ * robot: a header with a magic number, the rows and columns of the grid, the amount of neurons
+ * and the amount of synapses, then every neuron with its cell, type, spike history,
+ * Izhikevich state and input current, and the amount of its synapses, and then the synapses,
+ * neuron after neuron, as compressed sparse rows: the number of the post-synaptic neuron, the
+ * delay and the weight. A frame only fits a grid of the same size.
+ *
+ * @date_created    Oct 14, 2026
+ * @date_modified   Oct 14, 2026
+ * @author          Anne C. van Rossum
+ * @project         Replicator
+ * @company         Almende B.V.
+ * @license         open-source, GNU Lesser General Public License
+ */
+
+#ifndef NETFRAME_H_
+#define NETFRAME_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+
+#define NETFRAME_MAGIC		0x4C4E4631 //"LNF1"
+#define NETFRAME_HEADER		12
+#define NETFRAME_NEURON		35
+#define NETFRAME_SYNAPSE	7
+
+/**
+ * The size of the frame of the network that is developed now.
+ */
+uint32_t networkFrameSize();
+
+/**
+ * Writes the network that is developed now as a frame, which should hold networkFrameSize
+ * bytes. Must be called right after the development, before the network runs.
+ */
+void writeNetworkFrame(uint8_t *frame);
+
+/**
+ * Builds the network in the frame into the grid, which should not have neurons yet. Returns
+ * 0 if the frame is damaged or does not fit the grid, then the grid is left without neurons.
+ */
+uint8_t readNetworkFrame(const uint8_t *frame, uint32_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*NETFRAME_H_*/
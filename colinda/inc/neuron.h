@@ -33,6 +33,8 @@ extern "C" {
 	
 #include <stdint.h>
 #include <lindaconfig.h>
+#include <fixedpoint.h>
+#include <context.h>
 	
 /****************************************************************************************************
  *  		Declarations 
@@ -77,6 +79,16 @@ extern "C" {
 #define NEURONTYPE_INHIB_IND_SPIKING	0x90
 #define NEURONTYPE_INHIB_IND_BURSTING	0x98
 	
+/**
+ * The state and the parameters of many neurons as separate arrays, for the routines that update
+ * a range of them at once, see updateNeuronArrays. The neurons do not have to be in a network,
+ * and the arrays are not tied to the Neuron structs, the caller keeps them apart. With
+ * WITH_FIXED_POINT they are in Q16.16.
+ */
+struct IzhikevichArrays {
+	neural_t *v; neural_t *u; neural_t *a; neural_t *b; neural_t *c; neural_t *d;
+};
+
 /****************************************************************************************************
  *  		Modules 
  ***************************************************************************************************/
@@ -151,7 +163,10 @@ struct Neuron {
  *  		Entity pointers 
  ***************************************************************************************************/
 
-struct Neuron *n;
+/**
+ * The methods below operate on clctx->n, the neuron of the context of the thread, see
+ * context.h.
+ */
 
 /****************************************************************************************************
  *  		Methods 
@@ -161,6 +176,10 @@ BOOL fired();
 void update(float I);
 void init_neuron();
 
+void updateNeuronArrays(struct IzhikevichArrays *z, uint16_t from, uint16_t to, uint8_t type,
+		neural_t *I, uint16_t *spikes);
+void fireNeuronArrays(struct IzhikevichArrays *z, uint16_t from, uint16_t to, uint16_t *spikes);
+
 void next_type();
 void next_sign();
 
@@ -0,0 +1,89 @@
+/**
+ * @file recorder.h
+ * @brief A binary record of the development of the networks, to render it afterwards
+ * @author Anne C. van Rossum
+ *
+ * Drawing the concentrations with gnuplot, see drawAllConcentrations, or printing them, costs
+ * far more than the development itself, so it can not be on for a run. The recorder only
+ * copies what a step of development leaves behind into a file, and renders nothing. If
+ * LINDA_RECORD names a directory, every process writes development-<pid>.lrec there, which
+ * tlinda/src/renderRecord.c turns into images or an animation. LINDA_RECORD_INTERVAL records
+ * only every so many steps, the first and the last step are always recorded.
+ *
+ * The file is in network byte order, like a network frame, see netframe.h. It starts with
+ * RECORDER_MAGIC and is followed by records, each with its length as four bytes, which does
+ * not count those and the type, and then the type as one byte:
+ *  - RECORD_DEVELOPMENT, a development starts: the id of the robot, the rows and columns of
+ *    the grid, the amount of products, of which the first ones are phenotypic, the amount of
+ *    phenotypic products and the concentration threshold.
+ *  - RECORD_STEP, a step of development: the step, the flags, the amount of neurons and every
+ *    neuron as its cell and type, the amount of morphological operations since the step
+ *    before and every operation as the cell it was applied in and its index, see
+ *    applyMorphologicalChange, and at last the concentration planes of all products,
+ *    [product][row][column] as in the Space.
+ *  - RECORD_TOPOLOGY, a development is done: the last step and the amount of synapses and
+ *    every synapse as the cells of its neurons, its weight as the bits of a float and its
+ *    delay. A synapse to no neuron has NO_CELL as post-synaptic cell.
+ *
+ * The planes are written as they are, which costs little more than a copy. With
+ * LINDA_RECORD_PACK set, the file is about half as large: then a step has RECORD_DELTA in its
+ * flags, except the first one, and its planes are the exclusive or with the planes of the step
+ * recorded before, packed by eight bytes: a mask with a bit for every byte that is not zero,
+ * the lowest for the first byte, followed by those bytes. That takes about as long as a step
+ * of a small grid. A network that comes from the development cache, see devcache.h, or from a
+ * frame is not developed, and not recorded either.
+ */
+
+#ifndef RECORDER_H_
+#define RECORDER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+
+#define RECORDER_MAGIC			0x4C524331 //"LRC1"
+
+#define RECORD_DEVELOPMENT		1
+#define RECORD_STEP				2
+#define RECORD_TOPOLOGY			3
+
+#define RECORD_DELTA			0x01
+
+#define NO_CELL					0xFFFF
+
+/**
+ * Set while the thread records a development, the record routines below should only be called
+ * then. One development at a time is recorded, the others wait in recordDevelopment.
+ */
+extern __thread uint8_t developmentRecording;
+
+/**
+ * Starts the record of a development, which opens the file the first time, if LINDA_RECORD
+ * is set. Must be called after the grid and the embryogeny are started.
+ */
+void recordDevelopment();
+
+/**
+ * Notes a morphological operation that is applied to the neuron in np, before it is applied.
+ */
+void recordOperation(uint8_t index);
+
+/**
+ * Records the step that is just done, if it is at the interval, or if last is set.
+ */
+void recordStep(uint8_t last);
+
+/**
+ * Records the network that is developed, and ends the record of the development.
+ */
+void recordTopology();
+
+void stopRecorder();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*RECORDER_H_*/
@@ -0,0 +1,85 @@
+/**
+ * @file region.h
+ * @brief The memory of the neurons, synapses and ports of one development
+ * @author Anne C. van Rossum
+ *
+ * A development allocates thousands of small objects, neurons with their spike histories,
+ * synapses and ports, and frees them all at once when the next genome is developed. Instead
+ * of allocating and freeing them one by one, they come from a region: blocks of memory in
+ * which they are put one after the other. An object that is removed during development,
+ * by removeSynapse or removeNeuron, goes on a free list of its kind, and the next object of
+ * that kind is taken from that list first. The whole network is freed by regionReset, which
+ * frees nothing but starts at the beginning of the first block again, so the blocks are
+ * reused by the next development.
+ *
+ * On the robot the region is one static block of REGION_STATIC_SIZE bytes, so there is only
+ * one controller, and when it is full regionAlloc returns NULL. Otherwise a new block of
+ * REGION_BLOCK_SIZE bytes is added.
+ *
+ * The region is that of the controller, see ColindaContext. After regionReset, pointers to
+ * the objects of the region should not be used anymore.
+ */
+
+#ifndef REGION_H_
+#define REGION_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+#include <context.h>
+
+#define REGION_NEURON			0
+#define REGION_HISTORY			1
+#define REGION_SYNAPSE			2
+#define REGION_PORT				3
+#define REGION_KINDS			4
+
+#ifndef REGION_BLOCK_SIZE
+#define REGION_BLOCK_SIZE		(16 * 1024)
+#endif
+
+#ifndef REGION_STATIC_SIZE
+#define REGION_STATIC_SIZE		(8 * 1024)
+#endif
+
+struct RegionBlock {
+	struct RegionBlock *next;
+	uint32_t size;
+	uint8_t *data;
+};
+
+struct Region {
+	struct RegionBlock *blocks;
+	struct RegionBlock *current;
+	uint32_t used;
+	void *free_list[REGION_KINDS];
+};
+
+/**
+ * An object of the given kind and size, from the free list of that kind or else from the
+ * block. The size should be the same for every object of a kind.
+ */
+void *regionAlloc(uint8_t kind, uint16_t size);
+
+/**
+ * Puts an object that is not used anymore on the free list of its kind.
+ */
+void regionFree(uint8_t kind, void *object);
+
+/**
+ * Frees all objects at once, the blocks are kept.
+ */
+void regionReset();
+
+/**
+ * Frees the blocks as well.
+ */
+void freeRegion();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*REGION_H_*/
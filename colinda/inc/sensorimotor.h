@@ -38,22 +38,74 @@ extern "C" {
 #define true 1
 #endif
 
+//! The channels of the actuator message, the least a motor map has
+#define MOTOR_CHANNELS		2
+#define MOTOR_MAP_ENTRIES	64
+#define MOTOR_UNMAPPED		0xFF
+
+	/**
+	 * Maps the cells of output neurons to the channels of the actuators. Every cell, row by
+	 * row, has the channel its spikes go to, or MOTOR_UNMAPPED, and the gain every spike adds
+	 * to it. Every channel starts at its offset.
+	 */
+	struct MotorMap {
+		uint8_t columns;
+		uint8_t rows;
+		uint8_t channel_count;
+		uint8_t *channels;
+		int16_t *gains;
+		int16_t *offsets;
+	};
+
 	void initAER(struct AERBuffer *aerbuffer);
 
+	bool resizeAER(struct AERBuffer *aerbuffer, uint16_t capacity);
+
+	void freeAER(struct AERBuffer *aerbuffer);
+
 	bool pushAER(struct AERBuffer *aerbuffer, union AER *aertuple);
 
+	uint16_t pushAERs(struct AERBuffer *aerbuffer, const union AER *aertuples, uint16_t count);
+
 	union AER *popAER(struct AERBuffer *aerbuffer);
 
+	uint16_t popAERs(struct AERBuffer *aerbuffer, union AER *aertuples, uint16_t count);
+
 	uint8_t isEmptyAER(struct AERBuffer *aerbuffer);
 
+	uint16_t sizeAER(struct AERBuffer *aerbuffer);
+
 	void emptyAERBuffer(struct AERBuffer *aerbuffer);
 
+	/**
+	 * Develops the network of the process, see developNeuralNetworkIn in context.h.
+	 */
 	void developNeuralNetwork();
 
+	void developCachedNeuralNetwork(uint32_t hash, uint32_t size);
+
+	uint8_t installNeuralNetwork(const uint8_t *frame, uint32_t size);
+
 	uint8_t generateSpikes(uint8_t *input, uint8_t inputbuf_size, struct AERBuffer *aerbuffer);
 
+	/**
+	 * Runs the network of the process, see runNeuralNetworkIn in context.h.
+	 */
 	uint8_t runNeuralNetwork(struct AERBuffer *in, struct AERBuffer *out);
 
+	struct MotorMap *newMotorMap(uint8_t columns, uint8_t rows, uint8_t channel_count,
+			int16_t offset);
+
+	void mapMotorCell(struct MotorMap *map, uint8_t x, uint8_t y, uint8_t channel, int16_t gain);
+
+	void freeMotorMap(struct MotorMap *map);
+
+	struct MotorMap *getMotorMap();
+
+	void setMotorMap(struct MotorMap *map);
+
+	void readSpikes(struct AERBuffer *b, struct MotorMap *map, int16_t *output);
+
 	void interpretSpikes(struct AERBuffer *b, int16_t *output);
 
 	uint8_t count_spikes(struct AERBuffer *b, uint8_t x, uint8_t y);
@@ -32,6 +32,24 @@ extern "C" {
 #define LINDA_TOPOLOGY_REQ		20
 #define LINDA_SET_COLOR_VALUE	21
 #define LINDA_CLEAR_GRID		22
+#define LINDA_GENOME_BCAST_MSG	23
+#define LINDA_GENOME_ANNOUNCE	24
+#define LINDA_GENOME_NACK		25
+#define LINDA_GENOME_DELTA_MSG	26
+#define LINDA_GENOME_DELTA_NACK	27
+#define LINDA_DIFFUSION_HALO	28
+#define LINDA_NETWORK_MSG		31
+#define LINDA_NETWORK_NACK		32
+//! 33 and 34 are LINDA_STATS_REQ and LINDA_STATS_MSG of all engines, see linda/stats.h
+
+//! Header of a genome part that is multicast by the Elinda engine
+#define LINDA_GENOME_BCAST_HEADER	14
+//! Header of a genome delta, after which come the runs
+#define LINDA_GENOME_DELTA_HEADER	14
+//! Header of the halo of a robot docked to another one, after which come the parts
+#define LINDA_DIFFUSION_HALO_HEADER	7
+//! Header of a part of a developed network, after which comes the part of the frame
+#define LINDA_NETWORK_HEADER	16
 	
 #define LINDA_NEW_CHANNEL		MBUS_ADD_CHANNEL
 
@@ -47,6 +65,9 @@ struct TcpipMessageConfig {
 	uint8_t elinda_id;
 	uint8_t sym3d_id;
 	uint8_t gui_id;
+	struct in_addr mcast_group;
+	int mcast_port;
+	uint8_t mcast_id;
 };
 
 void initMessages();
@@ -66,7 +87,7 @@ struct TcpipMessage *createActuatorMessage(uint8_t robotId,
 		uint8_t actuatorId, int16_t* output);
 
 struct TcpipMessage *createTopologyMessage(uint8_t robotId, 
-		uint8_t* topology, uint8_t length);
+		uint8_t* topology, uint16_t length);
 
 struct TcpipMessage *createRunColindaMessage(uint8_t robotId);
 
@@ -79,6 +100,16 @@ struct TcpipMessage *createGenomeAck(uint8_t robotId);
 
 struct TcpipMessage *createGenomePartAck(uint8_t robotId, uint8_t partId);
 
+struct TcpipMessage *createGenomeNack(uint8_t robotId, uint32_t hash,
+		uint16_t partCount, uint8_t *missing);
+
+struct TcpipMessage *createGenomeDeltaNack(uint8_t robotId, uint32_t baseHash);
+
+struct TcpipMessage *createNetworkNack(uint8_t robotId, uint32_t hash);
+
+struct TcpipMessage *createDiffusionHaloMessage(uint8_t robotId, uint8_t destId, uint8_t side,
+		uint16_t exchange, uint8_t *parts, uint16_t size);
+
 struct TcpipMessageConfig *tmconf;
 
 #ifdef __cplusplus
@@ -50,6 +50,8 @@ extern "C" {
 #endif 
 
 #include <stdint.h>
+#include <fixedpoint.h>
+#include <context.h>
 
 #ifndef NULL
 #define NULL 0
@@ -71,6 +73,7 @@ extern "C" {
 	struct Synapse;
 	struct SpikeHistory;
 	struct NN;
+	struct IzhikevichArrays;
 
 	/**
 	 * The synapse contains a reference to the post synaptic neuron. It also contains a delay which
@@ -89,11 +92,21 @@ extern "C" {
 	};
 
 	/**
-	 * A linked list of ports, each linked to a synapse.
+	 * A doubly linked list of ports, each linked to a synapse. The opposite is the port of the
+	 * same synapse on the other neuron, and the direction tells if the port is in the list of
+	 * ports in or ports out of its neuron, with the bits of getPortContext. So a port can be
+	 * unlinked, and its synapse removed, without walking any list.
 	 */
+#define PORT_IN		0x02
+#define PORT_OUT	0x04
+#define PORT_HEAD	0x08
+
 	struct Port {
 		struct Synapse *synapse;
 		struct Port *next;
+		struct Port *prev;
+		struct Port *opposite;
+		uint8_t direction;
 	};
 
 	/**
@@ -148,17 +161,94 @@ extern "C" {
 //		struct Synapse *lastSynapse;
 	};
 
-	struct NN *nn;
+	/**
+	 * After development the topology does not change anymore. Then the network is compiled by
+	 * finalizeNeuralNetwork, into arrays that the run loop goes through without following
+	 * pointers. The neurons are numbered by group, first the input neurons, then the tonic
+	 * spiking, phasic spiking, integrator and other neurons, each group from groups[g] up to
+	 * groups[g+1] and in the order of the list within it, and order gives those numbers in the
+	 * order of the list. The synapses of neuron i are the ones from row[i] up to row[i+1], in
+	 * the order of its outgoing ports, with the number of the post-synaptic neuron in post.
+	 * The spike history, the input current and the Izhikevich state of each neuron are kept
+	 * in spikes, I and izhikevich, and no longer on the neurons themselves. The number of the
+	 * neuron in a cell is in cells, NO_NEURON if there is none, and the output neurons are
+	 * listed in the order of their cells in outputs.
+	 *
+	 * With WITH_SPIKE_EVENTS spikes are not looked up in the spike histories for every
+	 * synapse, but a neuron that fires adds its weights at once to ring, which has a row of
+	 * inputs for each of the next slots ticks, slots being a power of two above the longest
+	 * delay. Every tick only the row of that tick is added to I and cleared. So there can be
+	 * delays above the 15 ticks of the spike histories, up to 255.
+	 *
+	 * With WITH_FIXED_POINT the weights, the inputs and the Izhikevich state are fixed-point
+	 * numbers, see fixedpoint.h, and the weights are kept divided by 3, which is what a spike
+	 * adds to the input.
+	 *
+	 * With learning, the weights change while the network runs, see CompiledLearning.
+	 */
+#define COMPILED_GROUPS	5
+
+	/**
+	 * The state of the compiled network for learning by STDP while it runs, see
+	 * setCompiledLearning. The incoming synapses of neuron i are from row[i] up to row[i+1],
+	 * synapse gives their index in the outgoing ones and pre the neuron they come from. The
+	 * tables are those of LTP and LTD in the units of the weights, and the weights are clipped
+	 * at max and -max. The stamps are the tick of the pre-synaptic spike that arrived, and of
+	 * the post-synaptic spike, a synapse learned from the last time.
+	 */
+	struct CompiledLearning {
+		uint32_t *row;
+		uint32_t *synapse;
+		uint16_t *pre;
+		uint16_t *ltp_stamp;
+		uint16_t *ltd_stamp;
+		synaptic_t ltp[16];
+		synaptic_t ltd[16];
+		synaptic_t max;
+	};
+
+	struct CompiledNetwork {
+		uint16_t neuron_count;
+		uint16_t output_count;
+		uint32_t synapse_count;
+		struct Neuron **neurons;
+		uint16_t *order;
+		uint16_t groups[COMPILED_GROUPS + 1];
+		uint32_t *row;
+		uint16_t *post;
+		synaptic_t *weight;
+		uint8_t *delay;
+		uint16_t *spikes;
+		neural_t *I;
+		struct IzhikevichArrays *izhikevich;
+		uint16_t *cells;
+		uint16_t *outputs;
+		uint16_t tick;
+		uint16_t slots;
+		neural_t *ring;
+		struct CompiledLearning *learning;
+	};
+
+#define NO_NEURON	0xFFFF
 
 	void getSpikes();
 	void adaptWeights();
 	void propagateSpikes();
 	void updateNeurons();
+
+	void finalizeNeuralNetwork();
+	void freeCompiledNetwork();
+	void spikeCompiledNeuron(uint16_t cell);
+	void propagateCompiledSpikes();
+	void updateCompiledNeurons();
+	void setCompiledLearning(uint8_t on);
 	
 	struct Neuron *duplicateNeuron(struct Neuron *src);
 	void moveOutgoingSynapses(struct Neuron *src, struct Neuron *target);
 	struct Synapse *addSynapse(struct Neuron *src, struct Neuron *target);
 	void portSynapse(struct Neuron *src, struct Neuron *target, struct Port *port);
+	void linkPort(struct Neuron *neuron, struct Port *port, uint8_t direction);
+	void unlinkPort(struct Neuron *neuron, struct Port *port);
 	
 	void portCurrentSynapse(struct Neuron *target);
 	
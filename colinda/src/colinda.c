@@ -38,6 +38,7 @@
 #include <arpa/inet.h>
 #include <syslog.h>
 #include <string.h>
+#include <pthread.h>
 
 #include <linda/abbey.h>
 #include <linda/infocontainer.h>
@@ -46,6 +47,10 @@
 #include <linda/log.h>
 #include <linda/ptreaty.h>
 #include <linda/bits.h>
+#include <linda/slab.h>
+#include <linda/trace.h>
+#include <linda/buffer.h>
+#include <linda/stats.h>
 
 #include <tcpipmsg.h>
 #include <genome.h>
@@ -53,6 +58,7 @@
 #include <sensorimotor.h>
 #include <grid.h>
 #include <neuron.h>
+#include <controlloop.h>
 
 static void *default_hostess(void *context);
 static void *first_channel(void *context);
@@ -61,32 +67,93 @@ static void *add_channel(void *context);
 static void *alive(void *context);
 
 static void *glue_genome(void *context);
+static void *glue_broadcast(void *context);
+static void *genome_announced(void *context);
+static void *genome_repair(void *context);
+static void *extract_genome(void *context);
+static void *apply_delta(void *context);
+static void *glue_network(void *context);
 static void *start_development(void *context);
 static void *handle_sensor_data(void *context);
+static void send_actuators(int16_t *output);
 static void *start_robot(void *context);
+static void *clear_grid(void *context);
 static void *genome_part_ack(void *context);
+static void *send_stats(void *context);
 static void *send_topology(void *context);
+static void send_halo(uint8_t side, uint8_t robot, uint16_t exchange, uint8_t *parts,
+		uint16_t size);
 
 #ifdef WITH_GUI	
 static void *init_connection_to_gui(void *context);
 static void *start_gui(void *context);
 #endif
 
+static struct GenomeAssembly assemblies[COLINDA_ASSEMBLY_COUNT];
+static unsigned int assemblyClock;
+static pthread_mutex_t assemblyMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct GenomeCache lastGenome;
+static pthread_mutex_t lastGenomeMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct NetworkAssembly network;
+static pthread_mutex_t networkMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct GenomeWindow window;
+static pthread_mutex_t windowMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_mutex_t spikesMutex = PTHREAD_MUTEX_INITIALIZER;
+
+//! The developments and the network ticks outside the control loop, see send_stats
+static volatile uint32_t developments;
+static unsigned int developmentHistogram[ABBEY_STATS_BUCKETS];
+static volatile uint64_t networkTicks;
+static uint64_t statsTicks, statsAt;
+static pthread_mutex_t statsMutex = PTHREAD_MUTEX_INITIALIZER;
+
 /**
  * Return default values to initialize the Colinda engine.
  */
 void initColinda() {
-	clconf = malloc(sizeof(struct ColindaConfig));
-	clconf->monk_count = 16;
-	clconf->task_count = 32;
-	clconf->boot = first_channel;
-	clconf->dna_buffer_ptr = 0;
-	clconf->dna_part_ptr = 0;
+	clctx->clconf = malloc(sizeof(struct ColindaConfig));
+	clctx->clconf->monk_count = 16;
+	clctx->clconf->task_count = 32;
+	clctx->clconf->dedicated_monk_count = 2;
+	clctx->clconf->boot = first_channel;
+	clctx->clconf->dna_buffer_ptr = 0;
+	clctx->clconf->dna_part_ptr = 0;
 	clruntime = malloc(sizeof(struct ColindaRuntime));
-	dna = NULL;
+	clruntime->spikes_in = malloc(sizeof(struct AERBuffer));
+	clruntime->spikes_out = malloc(sizeof(struct AERBuffer));
+	initAER(clruntime->spikes_in);
+	initAER(clruntime->spikes_out);
+	unsigned int capacity;
+	const char *text = getenv("LINDA_AER_CAPACITY");
+	if ((text != NULL) && (sscanf(text, "%u", &capacity) == 1) && (capacity < 65536)) {
+		resizeAER(clruntime->spikes_in, capacity);
+		resizeAER(clruntime->spikes_out, capacity);
+	}
+	window.buffer = malloc(MAX_FRAME_SIZE + 8);
+	clctx->dna = NULL;
 	initMessages();
 	initSockets();
 	initGeneExtraction();		
+	sendGridHalo = send_halo;
+}
+
+/**
+ * With LINDA_CONTROL_LOOP set, the sensor messages go to the control loop, see controlloop.h,
+ * instead of to the abbey. Its value is the amount of network ticks per sensor message, and
+ * optionally the deadline in microseconds, as in "1:2000".
+ */
+static void startControl() {
+	unsigned int ticks = 1, deadline = 2000;
+	const char *text = getenv("LINDA_CONTROL_LOOP");
+	if (text == NULL) return;
+	sscanf(text, "%u:%u", &ticks, &deadline);
+	if ((ticks == 0) || (ticks > 255)) ticks = 1;
+	startControlLoop(ticks, deadline, clruntime->spikes_in, clruntime->spikes_out,
+			send_actuators);
 }
 
 /**
@@ -94,8 +161,13 @@ void initColinda() {
  */
 int startColinda() {
 	tprintf(LOG_VERBOSE, __func__, "Start abbey and boot m-bus");
-	initialize_abbey(clconf->monk_count, clconf->task_count);
-	dispatch_described_task(clconf->boot, NULL, "boot");
+	struct AbbeyConfig config;
+	abbey_default_config(&config, clctx->clconf->monk_count, clctx->clconf->task_count);
+	config.dedicated_monk_count = clctx->clconf->dedicated_monk_count;
+	config.dedicated_priority = ABBEY_PRIORITY_IO;
+	initialize_abbey_ex(&config);
+	startControl();
+	dispatch_described_task(clctx->clconf->boot, NULL, "boot");
 	return 0;
 }
 
@@ -110,12 +182,27 @@ static void *first_channel(void *context) {
 	tprintf(LOG_VERBOSE, __func__, "Create first channel");
 	struct InfoChannel *ic = malloc(sizeof(struct InfoChannel));
 	ic->type = 0;
+	if (getenv("LINDA_LOCAL") != NULL) ic->type |= TCPIP_CHANNEL_LOCAL;
 	ic->host = malloc(sizeof(struct in_addr));
 	ic->host->s_addr = INADDR_ANY;
-	ic->port = tmconf->mbus_elinda_port + 2 + clconf->id;
+	ic->port = tmconf->mbus_elinda_port + 2 + clctx->clconf->id;
 	ic->id = tmconf->mbus_id;
 	tprintf(LOG_VERBOSE, __func__, "Dispatch add default channel task");
 	dispatch_described_task(add_channel, (void*)ic, "add default channel");
+
+	//with LINDA_MULTICAST set, join the group of the Elinda engine, that multicasts genomes
+	const char *group = getenv("LINDA_MULTICAST");
+	if (group == NULL) return NULL;
+	if (group[0] != 0 && !inet_aton(group, &tmconf->mcast_group)) {
+		TPRINTF(LOG_WARNING, "Invalid multicast group %s", group);
+	}
+	ic = malloc(sizeof(struct InfoChannel));
+	ic->type = TCPIP_CHANNEL_MULTICAST | MBUS_SERVER_CHANNEL;
+	ic->host = malloc(sizeof(struct in_addr));
+	*ic->host = tmconf->mcast_group;
+	ic->port = tmconf->mcast_port;
+	ic->id = tmconf->mcast_id;
+	dispatch_described_task(add_channel, (void*)ic, "add multicast channel");
 	return NULL;
 }
 
@@ -137,24 +224,53 @@ static void *default_hostess(void *context) {
 
 	switch (msg->payload[0]) {
 	case LINDA_SENSOR_MSG: {
-		struct InfoArray *infoa = malloc(sizeof(struct InfoArray));
 		uint8_t header = 6;
-		infoa->length = msg->size-header;
-		infoa->values = calloc(infoa->length, sizeof(uint8_t));
-		memcpy(infoa->values, &msg->payload[header], infoa->length);
-		infoa->type = msg->payload[5];
-		dispatch_described_task(handle_sensor_data, (void*)infoa, "sensor data");
+		if (controlLoopRunning()) {
+			pushSensorFrame(&msg->payload[header], msg->size-header);
+			freemsg(msg);
+			break;
+		}
+		struct TcpipMessage *values = tcpip_slice_msg(msg, header, msg->size-header);
+		dispatch_prioritized_task(handle_sensor_data, (void*)values, "sensor data",
+				ABBEY_PRIORITY_REALTIME);
 		freemsg(msg);
 		break;
 	}
 	case LINDA_GENOME_MSG: {
 		tprintf(LOG_VVV, __func__, "Gets genome msg");
-		struct InfoSockAndMsg *sam = malloc(sizeof(struct InfoSockAndMsg));
+		struct InfoSockAndMsg *sam = linda_ctx_alloc(sizeof(struct InfoSockAndMsg));
 		sam->msg = msg;
 		sam->sock = tcpSocket;
 		dispatch_described_task(glue_genome, (void*)sam, "glue genome");
 		break;
 	}
+	case LINDA_GENOME_BCAST_MSG: {
+		dispatch_described_task(glue_broadcast, (void*)msg, "glue broadcast genome");
+		break;
+	}
+	case LINDA_GENOME_DELTA_MSG: {
+		dispatch_described_task(apply_delta, (void*)msg, "apply genome delta");
+		break;
+	}
+	case LINDA_NETWORK_MSG: {
+		dispatch_described_task(glue_network, (void*)msg, "glue network");
+		break;
+	}
+	case LINDA_GENOME_ANNOUNCE: {
+		dispatch_described_task(genome_announced, (void*)msg, "genome announced");
+		break;
+	}
+	case LINDA_DIFFUSION_HALO: {
+		//stored right away, the development may be waiting for it
+		if (msg->size >= LINDA_DIFFUSION_HALO_HEADER) {
+			receiveGridHalo(GRID_OPPOSITE(msg->payload[4]), msg->payload[2],
+					(msg->payload[5] << 8) | msg->payload[6],
+					&msg->payload[LINDA_DIFFUSION_HALO_HEADER],
+					msg->size - LINDA_DIFFUSION_HALO_HEADER);
+		}
+		freemsg(msg);
+		break;
+	}
 	case LINDA_TOPOLOGY_REQ: {
 		tprintf(LOG_VVV, __func__, "Topology request");
 		dispatch_described_task(send_topology, NULL, "glue genome");
@@ -167,6 +283,15 @@ static void *default_hostess(void *context) {
 		freemsg(msg);
 		break;
 	}
+	case LINDA_CLEAR_GRID: {
+		dispatch_described_task(clear_grid, NULL, "clear grid");
+		freemsg(msg);
+		break;
+	}
+	case LINDA_STATS_REQ: {
+		dispatch_described_task(send_stats, (void*)msg, "send stats");
+		break;
+	}
 	case LINDA_END_ELINDA_MSG: {
 		if (ptreaty_flag_hoisted(clruntime->sync))
 			ptreaty_make_m_run(clruntime->sync);
@@ -191,9 +316,12 @@ static void *default_hostess(void *context) {
 struct TcpipSocket* ic2sock(struct InfoChannel *ic) {
 	struct TcpipSocket *lsock = tcpip_get(ic->type);
 	lsock->port_nr = ic->port;
-	if (ic->type == 0) lsock->serv_addr.sin_addr = *ic->host;
+	if (!(ic->type & ~(TCPIP_CHANNEL_LOCAL | TCPIP_CHANNEL_MULTICAST)))
+		lsock->serv_addr.sin_addr = *ic->host;
 	else lsock->cli_addr.sin_addr = *ic->host;
 	lsock->callbackIn = default_hostess; //coordination should be exogeneous
+	//only the m-bus channel tells that this controller is alive
+	if (ic->type & TCPIP_CHANNEL_MULTICAST) return lsock;
 #ifdef WITH_GUI	
 	lsock->callbackConnect = init_connection_to_gui;
 #else
@@ -216,7 +344,11 @@ static void *add_channel(void *context) {
 		return NULL;
 	}
 	struct TcpipSocket *lsock = ic2sock(ic);
-	tcpipbank_add(lsock, ic->id);
+	if (tcpipbank_add(lsock, ic->id)) {
+		//another monk added the channel in the meantime
+		tcpip_free(lsock);
+		return NULL;
+	}
 	dispatch_described_task(tcpip_start, (void*)lsock, "start tcp/ip");
 	return NULL;
 }
@@ -227,14 +359,14 @@ static void *add_channel(void *context) {
  */
 static void *init_connection_to_gui(void *context) {
 	tprintf(LOG_INFO, __func__, "Create a channel to the GUI");
-	struct TcpipMessage *msgA = createConnectGUIMessage(clconf->id);
+	struct TcpipMessage *msgA = createConnectGUIMessage(clctx->clconf->id);
 	struct TcpipSocket *lsock_dest = tcpipbank_get(tmconf->mbus_id);
 	if (lsock_dest == NULL) {
 		tprintf(LOG_WARNING, __func__, "Not initialized?");
 		return NULL;
 	}
 	push(lsock_dest->outbox, msgA);
-	dispatch_described_task(tcpip_send_packets, (void*)lsock_dest, "send packets");
+	tcpip_flush(lsock_dest);
 	dispatch_described_task(start_gui, NULL, "start GUI");
 	return NULL;
 }
@@ -246,14 +378,14 @@ static void *init_connection_to_gui(void *context) {
 static void *start_gui(void *context) {
 	sleep(1);
 	tprintf(LOG_INFO, __func__, "Start GUI");
-	struct TcpipMessage *msgA = createRunGUIMessage(clconf->id);
+	struct TcpipMessage *msgA = createRunGUIMessage(clctx->clconf->id);
 	struct TcpipSocket *lsock_dest = tcpipbank_get(tmconf->mbus_id);
 	if (lsock_dest == NULL) {
 		tprintf(LOG_WARNING, __func__, "Not initialized?");
 		return NULL;
 	}
 	push(lsock_dest->outbox, msgA);
-	dispatch_described_task(tcpip_send_packets, (void*)lsock_dest, "send packets");
+	tcpip_flush(lsock_dest);
 	dispatch_described_task(alive, NULL, "Send alive signal");
 	return NULL;
 }
@@ -269,14 +401,14 @@ static void *alive(void *context) {
 	sleep(18);
 #endif
 	tprintf(LOG_INFO, __func__, "Alive signal!");
-	struct TcpipMessage *msg = createRunColindaAckMessage(clconf->id);
+	struct TcpipMessage *msg = createRunColindaAckMessage(clctx->clconf->id);
 	struct TcpipSocket *lsock_dest = tcpipbank_get(tmconf->mbus_id);
 	if (lsock_dest == NULL) {
 		tprintf(LOG_WARNING, __func__, "Not initialized?");
 		return NULL;
 	}
 	push(lsock_dest->outbox, msg);
-	dispatch_described_task(tcpip_send_packets, (void*)lsock_dest, "send packets");
+	tcpip_flush(lsock_dest);
 	return NULL;
 }
 
@@ -286,14 +418,14 @@ static void *alive(void *context) {
 static void *start_robot(void *context) {
 	tprintf(LOG_VERBOSE, __func__, "Start running the robot");
 	int16_t output[2] = {0,0};
-	struct TcpipMessage *msg = createActuatorMessage(clconf->id, 0, (int16_t*)&output);
+	struct TcpipMessage *msg = createActuatorMessage(clctx->clconf->id, 0, (int16_t*)&output);
 	struct TcpipSocket *lsock_dest = tcpipbank_get(tmconf->mbus_id);
 	if (lsock_dest == NULL) {
 		tprintf(LOG_WARNING, __func__, "Not initialized?");
 		return NULL;
 	}
 	push(lsock_dest->outbox, msg);
-	dispatch_described_task(tcpip_send_packets, (void*)lsock_dest, "send packets");
+	tcpip_flush(lsock_dest);
 	return NULL;
 }
 
@@ -302,23 +434,12 @@ static void *start_robot(void *context) {
  */
 static void *send_topology(void *context) {
 	tprintf(LOG_VERBOSE, __func__, "Send topology");
-	uint8_t topology_size = s->rows * s->columns;
+	uint16_t topology_size = clctx->s->rows * clctx->s->columns;
 	uint8_t topology[topology_size];
+	getTopology(topology, topology_size);
 
-	struct Neuron *ln;
-	uint8_t x,y;
-	for (y=0; y < s->rows; y++) {
-		for (x=0;x < s->columns; x++) {
-			ln = getGridCell(x,y)->neuron;
-			if (ln != NULL) {
-				topology[x+y*s->columns] = ln->type;
-			} else {
-				topology[x+y*s->columns] = 0;
-			}		
-		}
-	}
-
-	struct TcpipMessage *msg = createTopologyMessage(clconf->id, (uint8_t*)&topology, topology_size);
+	struct TcpipMessage *msg = createTopologyMessage(clctx->clconf->id, (uint8_t*)&topology,
+			topology_size);
 	char text[msg->size*4+64];
 	sprintf(text, "Topology message ");
 	sprintmsg(msg, text);
@@ -331,61 +452,510 @@ static void *send_topology(void *context) {
 		return NULL;
 	}
 	push(lsock_dest->outbox, msg);
-	dispatch_described_task(tcpip_send_packets, (void*)lsock_dest, "send packets");
+	tcpip_flush(lsock_dest);
 	tprintf(LOG_VV, __func__, "Topology msg created");
 	return NULL;
 }
 
+/**
+ * Sends the halo for the robot docked on a side of the grid over the m-bus, which routes it
+ * to the robot by the destination id.
+ */
+static void send_halo(uint8_t side, uint8_t robot, uint16_t exchange, uint8_t *parts,
+		uint16_t size) {
+	struct TcpipSocket *lsock_dest = tcpipbank_get(tmconf->mbus_id);
+	if (lsock_dest == NULL) {
+		tprintf(LOG_WARNING, __func__, "Not initialized?");
+		return;
+	}
+	push(lsock_dest->outbox, createDiffusionHaloMessage(clctx->clconf->id, robot, side, exchange,
+			parts, size));
+	tcpip_flush(lsock_dest);
+}
+
+/**
+ * Appends data to the last genome, which is made valid by the last part. Must be called
+ * with the lock of the last genome.
+ */
+static void cache_genome(const uint8_t *data, int length, uint8_t last) {
+	int size = lastGenome.size + length;
+	if (size > lastGenome.capacity) {
+		uint8_t *content = realloc(lastGenome.content, size);
+		if (content == NULL) {
+			lastGenome.valid = 0;
+			return;
+		}
+		lastGenome.content = content;
+		lastGenome.capacity = size;
+	}
+	memcpy(&lastGenome.content[lastGenome.size], data, length);
+	lastGenome.size = size;
+	if (last) {
+		lastGenome.hash = linda_buffer_hash(lastGenome.content, lastGenome.size);
+		lastGenome.valid = 1;
+	}
+}
+
+/**
+ * Forgets the parts of the genome that was received before, and the genes of it, for a
+ * genome with the given amount of parts. Must be called with the window lock.
+ */
+static void reset_window(uint8_t partCount) {
+	int i;
+	for (i = 0; i < COLINDA_GENOME_WINDOW; i++) {
+		if (window.parts[i] != NULL) freemsg(window.parts[i]);
+		window.parts[i] = NULL;
+	}
+	window.received = 0;
+	window.part_count = partCount;
+	freeGenes();
+	clctx->clconf->dna_buffer_ptr = 0;
+	clctx->clconf->dna_part_ptr = 0;
+}
+
+/**
+ * The controller is done with one agent of a pool and waits for the genome of the next one,
+ * see elinda/inc/pool.h. The genes and the spikes of the agent are thrown away, but the last
+ * genome is kept, as the base of the delta that comes next.
+ */
+static void *clear_grid(void *context) {
+	tprintf(LOG_VERBOSE, __func__, "Clear grid for the next agent");
+	pthread_mutex_lock(&windowMutex);
+	reset_window(0);
+	pthread_mutex_unlock(&windowMutex);
+	pthread_mutex_lock(&spikesMutex);
+	emptyAERBuffer(clruntime->spikes_in);
+	emptyAERBuffer(clruntime->spikes_out);
+	pthread_mutex_unlock(&spikesMutex);
+	return NULL;
+}
+
+/**
+ * Extracts the genes of the next part, after the codons that are left of the part before
+ * it. Must be called with the window lock.
+ */
+static void glue_part(struct TcpipMessage *msg) {
+	uint8_t header = 6; int value = msg->size - header;
+	if (value > MAX_FRAME_SIZE-header) value = MAX_FRAME_SIZE-header;
+	TPRINTF(LOG_VVV, "Part %i of %i. Size = %i", clctx->clconf->dna_part_ptr, window.part_count,
+			value);
+
+	//keep the genome as it is received, the extraction overwrites the part
+	pthread_mutex_lock(&lastGenomeMutex);
+	if (clctx->clconf->dna_part_ptr == 0) {
+		lastGenome.valid = 0;
+		lastGenome.size = 0;
+	}
+	cache_genome(&msg->payload[header], value, clctx->clconf->dna_part_ptr == window.part_count-1);
+	pthread_mutex_unlock(&lastGenomeMutex);
+
+	memcpy(&window.buffer[clctx->clconf->dna_buffer_ptr], &msg->payload[header], value);
+	clctx->dna->content = (Codon*)window.buffer;
+	clctx->clconf->dna_buffer_ptr = stepGeneExtraction(clctx->clconf->dna_buffer_ptr + value);
+	clctx->dna->content = NULL;
+	clctx->clconf->dna_part_ptr++;
+}
+
 /**
  * There will be genome messages entering until the last one has been received. Then
  * the developmental engine can operate on the genome and translate it to a controller.
  * For now that will be a spatial neural network. For later, that might become a
- * full-fledged multi-agent system. The socket is given as one of the parameter, because
- * the inbox needs to be reshuffled if the messages arrive in the wrong order.
+ * full-fledged multi-agent system. The messages can arrive in the wrong order, so a part
+ * that comes before its turn is kept in the window, see GenomeWindow, and the genes are
+ * extracted from the parts that are there in order. The acknowledgement is for all parts
+ * up to the last one that is extracted, so the Elinda engine can keep several parts on
+ * their way. A first part, or any part after the last genome is received entirely, starts
+ * a new genome.
  */
 static void *glue_genome(void *context) {
 	tprintf(LOG_VV, __func__, "Glue genome");
 	struct InfoSockAndMsg *sam = (struct InfoSockAndMsg*)context;
-	if (dna == NULL) {
+	struct TcpipMessage *msg = sam->msg;
+	linda_ctx_free(sam);
+	if (msg->size <= 6 || msg->payload[4] >= msg->payload[5]) {
+		freemsg(msg);
+		return NULL;
+	}
+	uint8_t partId = msg->payload[4], partCount = msg->payload[5];
+	uint8_t glued = 0, last = 0;
+
+	pthread_mutex_lock(&windowMutex);
+	if (clctx->dna == NULL) {
 		receiveNewGenome();
 	}
+	if ((partId == 0 && clctx->clconf->dna_part_ptr != 0) ||
+			clctx->clconf->dna_part_ptr >= window.part_count) {
+		reset_window(partCount);
+	}
+
+	int offset = partId - clctx->clconf->dna_part_ptr;
+	if (offset < 0) {
+		//extracted already, the acknowledgement might be lost
+		glued = 1;
+		freemsg(msg);
+	} else if (offset >= COLINDA_GENOME_WINDOW || partCount != window.part_count ||
+			RAISED(window.received, offset)) {
+		TPRINTF(LOG_ERR, "Wrong genome part (%i of %i, expected %i of %i) received!",
+				partId, partCount, clctx->clconf->dna_part_ptr, window.part_count);
+		freemsg(msg);
+	} else {
+		window.parts[partId % COLINDA_GENOME_WINDOW] = msg;
+		RAISE(window.received, offset);
+		while (RAISED(window.received, 0)) {
+			struct TcpipMessage **part =
+					&window.parts[clctx->clconf->dna_part_ptr % COLINDA_GENOME_WINDOW];
+			glue_part(*part);
+			freemsg(*part);
+			*part = NULL;
+			window.received >>= 1;
+			glued = 1;
+		}
+		last = glued && (clctx->clconf->dna_part_ptr == window.part_count);
+	}
+	uint8_t acked = clctx->clconf->dna_part_ptr - 1;
+	pthread_mutex_unlock(&windowMutex);
+
+	if (glued) {
+		struct InfoDefault *infod = linda_ctx_alloc(sizeof(struct InfoDefault));
+		infod->id = clctx->clconf->id;
+		infod->value = acked;
+		dispatch_described_task(genome_part_ack, (void*)infod, "genome ack");
+	}
+
+	if (last) {
+		TPRINTF(LOG_VERBOSE, "Last part (%i of %i) received!", acked, partCount);
+		dispatch_prioritized_task(start_development, NULL, "start development",
+				ABBEY_PRIORITY_BULK);
+	}
+	return NULL;
+}
+
+static uint32_t read_hash(const unsigned char *payload) {
+	return ((uint32_t)payload[0] << 24) | (payload[1] << 16) | (payload[2] << 8) | payload[3];
+}
+
+/**
+ * Returns the assembly of the given genome. If there is none, the least recently used one
+ * that is not wanted is cleared for it, or NULL is returned when they are all wanted. Must
+ * be called with the assembly lock.
+ */
+static struct GenomeAssembly *get_assembly(uint32_t hash, uint16_t size, uint16_t partCount) {
+	struct GenomeAssembly *a, *victim = NULL;
+	int i, length = (partCount + 7) / 8;
+	if (!size || !partCount || partCount > size) return NULL;
+	for (i = 0; i < COLINDA_ASSEMBLY_COUNT; i++) {
+		a = &assemblies[i];
+		if (a->content != NULL && a->hash == hash && a->size == size &&
+				a->part_count == partCount) {
+			a->used = ++assemblyClock;
+			return a;
+		}
+		if (!a->wanted && (victim == NULL || a->used < victim->used)) victim = a;
+	}
+	if (victim == NULL) return NULL;
+	free(victim->content);
+	free(victim->missing);
+	victim->content = malloc(size);
+	victim->missing = calloc(length, 1);
+	if (victim->content == NULL || victim->missing == NULL) {
+		free(victim->content);
+		free(victim->missing);
+		victim->content = victim->missing = NULL;
+		return NULL;
+	}
+	for (i = 0; i < partCount; i++) RAISE(victim->missing[i / 8], i % 8);
+	victim->hash = hash;
+	victim->size = size;
+	victim->part_count = partCount;
+	victim->missing_count = partCount;
+	victim->wanted = 0;
+	victim->repairs = 0;
+	victim->used = ++assemblyClock;
+	return victim;
+}
+
+/**
+ * When the genome is complete and wanted, a copy is handed to the gene extraction, which
+ * overwrites its buffer. Must be called with the assembly lock.
+ */
+static void develop_assembly(struct GenomeAssembly *a) {
+	if (!a->wanted || a->missing_count) return;
+	struct TcpipMessage *genome = tcpip_alloc_msg(a->size);
+	if (genome == NULL) return;
+	a->wanted = 0;
+	memcpy(genome->payload, a->content, a->size);
+	TPRINTF(LOG_VERBOSE, "Multicast genome %08x is complete", a->hash);
+	dispatch_prioritized_task(extract_genome, (void*)genome, "extract genome",
+			ABBEY_PRIORITY_BULK);
+}
+
+/**
+ * A part of a genome that is multicast to all controllers. It is kept, also if this robot
+ * does not get that genome (yet), so a clone that is announced later is complete already.
+ * Parts that are received twice are ignored.
+ */
+static void *glue_broadcast(void *context) {
+	struct TcpipMessage *msg = (struct TcpipMessage*)context;
+	uint8_t header = LINDA_GENOME_BCAST_HEADER;
+	if (msg->size <= header) goto glue_broadcast_finish;
+	uint32_t hash = read_hash(&msg->payload[4]);
+	uint16_t partId = (msg->payload[8] << 8) | msg->payload[9];
+	uint16_t partCount = (msg->payload[10] << 8) | msg->payload[11];
+	uint16_t size = (msg->payload[12] << 8) | msg->payload[13];
+	pthread_mutex_lock(&assemblyMutex);
+	struct GenomeAssembly *a = get_assembly(hash, size, partCount);
+	if (a != NULL && partId < partCount && RAISED(a->missing[partId / 8], partId % 8)) {
+		int partSize = (size + partCount - 1) / partCount;
+		int offset = partSize * partId, length = size - offset;
+		if (length > partSize) length = partSize;
+		if (length > 0 && msg->size - header >= length) {
+			memcpy(&a->content[offset], &msg->payload[header], length);
+			CLEAR(a->missing[partId / 8], partId % 8);
+			a->missing_count--;
+			TPRINTF(LOG_VVV, "Part %i of %i of genome %08x", partId, partCount, hash);
+			develop_assembly(a);
+		}
+	}
+	pthread_mutex_unlock(&assemblyMutex);
+glue_broadcast_finish:
+	freemsg(msg);
+	return NULL;
+}
 
-	if (sam->msg->payload[4] == 0) {
-		freeGenes();
-		clconf->dna_buffer_ptr = 0;
-		clconf->dna_part_ptr = 0;
+/**
+ * The Elinda engine tells which multicast genome this robot gets. It replaces a genome
+ * that is announced before and not complete yet. If parts are missing, they are asked
+ * for after a while.
+ */
+static void *genome_announced(void *context) {
+	struct TcpipMessage *msg = (struct TcpipMessage*)context;
+	struct GenomeAssembly *a = NULL;
+	uint32_t hash = 0;
+	int i;
+	if (msg->size >= 12) {
+		hash = read_hash(&msg->payload[4]);
+		uint16_t partCount = (msg->payload[8] << 8) | msg->payload[9];
+		uint16_t size = (msg->payload[10] << 8) | msg->payload[11];
+		pthread_mutex_lock(&assemblyMutex);
+		for (i = 0; i < COLINDA_ASSEMBLY_COUNT; i++) assemblies[i].wanted = 0;
+		a = get_assembly(hash, size, partCount);
+		if (a != NULL) {
+			a->wanted = 1;
+			a->repairs = 0;
+			if (a->missing_count) {
+				uint32_t *ctx = linda_ctx_alloc(sizeof(uint32_t));
+				*ctx = hash;
+				dispatch_delayed_task(genome_repair, (void*)ctx, COLINDA_REPAIR_DELAY);
+			}
+			develop_assembly(a);
+		}
+		pthread_mutex_unlock(&assemblyMutex);
 	}
+	if (a == NULL) TPRINTF(LOG_ERR, "Can not assemble genome %08x", hash);
+	freemsg(msg);
+	return NULL;
+}
 
-	uint8_t partId = sam->msg->payload[4]; 
-	//put pieces in order again
-	if (partId != clconf->dna_part_ptr) {
-		char text2[128]; 
-		sprintf(text2, "Wrong genome part (%i instead of %i) received!",
-				partId, clconf->dna_part_ptr);
-		tprintf(LOG_ERR, __func__, text2);
+/**
+ * Asks the Elinda engine for the parts of the announced genome that did not arrive, for
+ * at most COLINDA_REPAIR_TRIALS times. The context is the hash of the genome.
+ */
+static void *genome_repair(void *context) {
+	uint32_t hash = *(uint32_t*)context;
+	struct GenomeAssembly *a = NULL;
+	struct TcpipMessage *msg = NULL;
+	int i;
+	pthread_mutex_lock(&assemblyMutex);
+	for (i = 0; i < COLINDA_ASSEMBLY_COUNT; i++) {
+		if (assemblies[i].wanted && assemblies[i].hash == hash) a = &assemblies[i];
+	}
+	if (a != NULL && a->repairs++ == COLINDA_REPAIR_TRIALS) {
+		TPRINTF(LOG_ERR, "Genome %08x stays incomplete (%i parts missing)", hash,
+				a->missing_count);
+		a->wanted = 0;
+		a = NULL;
+	}
+	if (a != NULL) msg = createGenomeNack(clctx->clconf->id, hash, a->part_count, a->missing);
+	pthread_mutex_unlock(&assemblyMutex);
+	if (msg == NULL) {
+		linda_ctx_free(context);
 		return NULL;
 	}
+	struct TcpipSocket *lsock_dest = tcpipbank_get(tmconf->mbus_id);
+	if (lsock_dest == NULL) {
+		tprintf(LOG_WARNING, __func__, "Not initialized?");
+		freemsg(msg);
+	} else {
+		push(lsock_dest->outbox, msg);
+		tcpip_flush(lsock_dest);
+	}
+	dispatch_delayed_task(genome_repair, context, COLINDA_REPAIR_DELAY);
+	return NULL;
+}
 
-	uint8_t header = 6; int value = sam->msg->size - header;
-	if (value > MAX_PACKET_SIZE-header) value = MAX_PACKET_SIZE-header;
-	char text[64]; sprintf(text, "Part %i of %i. Size = %i",
-			partId, sam->msg->payload[5], value);
-	tprintf(LOG_VVV, __func__, text);
+/**
+ * Extracts the genes of an entire genome at once, and develops the controller. The context
+ * is a message that holds a copy of the genome, it becomes the last genome.
+ */
+static void *extract_genome(void *context) {
+	struct TcpipMessage *genome = (struct TcpipMessage*)context;
+	pthread_mutex_lock(&lastGenomeMutex);
+	lastGenome.valid = 0;
+	lastGenome.size = 0;
+	cache_genome(genome->payload, genome->size, 1);
+	pthread_mutex_unlock(&lastGenomeMutex);
+	if (clctx->dna == NULL) {
+		receiveNewGenome();
+	}
+	freeGenes();
+	clctx->clconf->dna_buffer_ptr = 0;
+	clctx->clconf->dna_part_ptr = 0;
+	clctx->dna->content = (Codon*)genome->payload;
+	stepGeneExtraction(genome->size);
+	clctx->dna->content = NULL;
+	freemsg(genome);
+	return start_development(NULL);
+}
 
-	dna->content = (Codon*)&sam->msg->payload[header];
-	clconf->dna_buffer_ptr = stepGeneExtraction(value);
-	clconf->dna_part_ptr++;
+/**
+ * A genome that is sent as runs of bytes to xor with the last genome. If the last genome is
+ * not the base of the delta, or the result is not the genome it should be, the Elinda engine
+ * is asked to send the entire genome. The genes are extracted from the whole result again,
+ * the extraction is a single pass, against the development that follows.
+ */
+static void *apply_delta(void *context) {
+	struct TcpipMessage *msg = (struct TcpipMessage*)context;
+	struct TcpipMessage *genome = NULL;
+	uint8_t header = LINDA_GENOME_DELTA_HEADER;
+	uint32_t baseHash = 0;
+	int i, position, length;
+	if (msg->size < header) goto apply_delta_failed;
+	baseHash = read_hash(&msg->payload[4]);
+	uint32_t hash = read_hash(&msg->payload[8]);
+	uint16_t size = (msg->payload[12] << 8) | msg->payload[13];
+	pthread_mutex_lock(&lastGenomeMutex);
+	if (lastGenome.valid && lastGenome.hash == baseHash && lastGenome.size == size) {
+		genome = tcpip_alloc_msg(size);
+		if (genome != NULL) memcpy(genome->payload, lastGenome.content, size);
+	}
+	pthread_mutex_unlock(&lastGenomeMutex);
+	if (genome == NULL) goto apply_delta_failed;
+	for (i = header; i + 3 <= msg->size; i += 3 + length) {
+		position = (msg->payload[i] << 8) | msg->payload[i+1];
+		length = msg->payload[i+2];
+		if (position + length > size || i + 3 + length > msg->size) break;
+		int j; for (j = 0; j < length; j++) genome->payload[position+j] ^= msg->payload[i+3+j];
+	}
+	if (i != msg->size || linda_buffer_hash(genome->payload, size) != hash) {
+		freemsg(genome);
+		goto apply_delta_failed;
+	}
+	TPRINTF(LOG_VERBOSE, "Genome %08x from a delta of %i bytes", hash, msg->size);
+	freemsg(msg);
+	dispatch_prioritized_task(extract_genome, (void*)genome, "extract genome",
+			ABBEY_PRIORITY_BULK);
+	return NULL;
 
-	dispatch_described_task(genome_part_ack, (void*)&partId, "genome ack");
+apply_delta_failed:
+	TPRINTF(LOG_WARNING, "Genome delta on %08x can not be applied", baseHash);
+	freemsg(msg);
+	struct TcpipMessage *nack = createGenomeDeltaNack(clctx->clconf->id, baseHash);
+	struct TcpipSocket *lsock_dest = tcpipbank_get(tmconf->mbus_id);
+	if (lsock_dest == NULL) {
+		tprintf(LOG_WARNING, __func__, "Not initialized?");
+		freemsg(nack);
+		return NULL;
+	}
+	push(lsock_dest->outbox, nack);
+	tcpip_flush(lsock_dest);
+	return NULL;
+}
 
-	if (partId == sam->msg->payload[5]-1) {
-		char text3[128]; 
-		sprintf(text3, "Last part (%i of %i) received!", partId, sam->msg->payload[5]);
-		tprintf(LOG_VERBOSE, __func__, text3);
-		dispatch_described_task(start_development, NULL, "start development");
+/**
+ * Builds the network in the frame that is put together, and tells the Elinda engine, as
+ * start_development does. The last genome is not the base of a delta anymore.
+ */
+static void install_network(uint8_t *frame, uint32_t size, uint32_t hash) {
+	struct TcpipMessage *msg;
+	pthread_mutex_lock(&lastGenomeMutex);
+	lastGenome.valid = 0;
+	lastGenome.size = 0;
+	pthread_mutex_unlock(&lastGenomeMutex);
+	if (installNeuralNetwork(frame, size)) {
+		TPRINTF(LOG_VERBOSE, "Network %08x of %u bytes installed", hash, size);
+		msg = createGenomeAck(clctx->clconf->id);
+	} else {
+		TPRINTF(LOG_WARNING, "Network %08x does not fit this grid", hash);
+		msg = createNetworkNack(clctx->clconf->id, hash);
 	}
+	struct TcpipSocket *lsock_dest = tcpipbank_get(tmconf->mbus_id);
+	if (lsock_dest == NULL) {
+		tprintf(LOG_WARNING, __func__, "Not initialized?");
+		freemsg(msg);
+		return;
+	}
+	push(lsock_dest->outbox, msg);
+	tcpip_flush(lsock_dest);
+}
+
+/**
+ * A part of a network that is developed by the Elinda engine, see netframe.h. The parts are
+ * sent over the m-bus one after the other, but the tasks that glue them can run in another
+ * order. A frame of which the hash does not match once all parts are there, is dropped.
+ */
+static void *glue_network(void *context) {
+	struct TcpipMessage *msg = (struct TcpipMessage*)context;
+	uint8_t header = LINDA_NETWORK_HEADER, *frame = NULL;
+	if (msg->size < header) goto glue_network_finish;
+	uint32_t hash = read_hash(&msg->payload[4]);
+	uint16_t partId = (msg->payload[8] << 8) | msg->payload[9];
+	uint16_t partCount = (msg->payload[10] << 8) | msg->payload[11];
+	uint32_t size = read_hash(&msg->payload[12]);
+	if (!partCount || partId >= partCount) goto glue_network_finish;
+	uint32_t partSize = (size + partCount - 1) / partCount, offset = partSize * partId;
+	uint32_t length = (size - offset < partSize) ? size - offset : partSize;
+	if ((offset >= size && size) || msg->size != header + length) goto glue_network_finish;
 
-	freemsg(sam->msg);
+	pthread_mutex_lock(&networkMutex);
+	if (network.frame == NULL || network.hash != hash || network.size != size ||
+			network.part_count != partCount) {
+		free(network.frame);
+		free(network.received);
+		network.frame = malloc(size ? size : 1);
+		network.received = calloc((partCount + 7) / 8, 1);
+		network.hash = hash;
+		network.size = size;
+		network.part_count = partCount;
+		network.part_received = 0;
+		if (network.frame == NULL || network.received == NULL) {
+			free(network.frame);
+			free(network.received);
+			network.frame = NULL;
+			network.received = NULL;
+			pthread_mutex_unlock(&networkMutex);
+			goto glue_network_finish;
+		}
+	}
+	if (!RAISED(network.received[partId / 8], partId % 8)) {
+		memcpy(network.frame + offset, &msg->payload[header], length);
+		RAISE(network.received[partId / 8], partId % 8);
+		if (++network.part_received == partCount) {
+			frame = network.frame;
+			free(network.received);
+			network.frame = NULL;
+			network.received = NULL;
+		}
+	}
+	pthread_mutex_unlock(&networkMutex);
+	if (frame == NULL) goto glue_network_finish;
+	if (linda_buffer_hash(frame, size) != hash) {
+		TPRINTF(LOG_WARNING, "Network %08x is damaged", hash);
+	} else {
+		install_network(frame, size, hash);
+	}
+	free(frame);
+glue_network_finish:
+	freemsg(msg);
 	return NULL;
 }
 
@@ -395,16 +965,16 @@ static void *glue_genome(void *context) {
  * necessary because the underlying protocol does not preserve the order of the parts.
  */
 static void *genome_part_ack(void *context) {
-	char *partId = (char*)context;
-	struct TcpipMessage *msg = createGenomePartAck(clconf->id, *partId);
-	//	free(partId);
+	struct InfoDefault *infod = (struct InfoDefault*)context;
+	struct TcpipMessage *msg = createGenomePartAck(infod->id, infod->value);
+	linda_ctx_free(infod);
 	struct TcpipSocket *lsock_dest = tcpipbank_get(tmconf->mbus_id);
 	if (lsock_dest == NULL) {
 		tprintf(LOG_WARNING, __func__, "Not initialized?");
 		return NULL;
 	}
 	push(lsock_dest->outbox, msg);
-	dispatch_described_task(tcpip_send_packets, (void*)lsock_dest, "send packets");
+	tcpip_flush(lsock_dest);
 	return NULL;
 }
 
@@ -417,50 +987,127 @@ static void *genome_part_ack(void *context) {
  */
 static void *start_development(void *context) {
 	tprintf(LOG_VERBOSE, __func__, "Develop controller");
-	developNeuralNetwork();
+	pthread_mutex_lock(&lastGenomeMutex);
+	uint8_t valid = lastGenome.valid;
+	uint32_t hash = lastGenome.hash, size = lastGenome.size;
+	pthread_mutex_unlock(&lastGenomeMutex);
+	unsigned long long start = linda_trace_clock_ns();
+	if (valid) developCachedNeuralNetwork(hash, size);
+	else developNeuralNetwork();
+	__sync_fetch_and_add(&developmentHistogram[abbey_stats_bucket(linda_trace_clock_ns() -
+			start)], 1);
+	__sync_fetch_and_add(&developments, 1);
 	tprintf(LOG_VERBOSE, __func__, "Developmental ack");
-	struct TcpipMessage *msg = createGenomeAck(clconf->id);
+	struct TcpipMessage *msg = createGenomeAck(clctx->clconf->id);
 	struct TcpipSocket *lsock_dest = tcpipbank_get(tmconf->mbus_id);
 	if (lsock_dest == NULL) {
 		tprintf(LOG_WARNING, __func__, "Not initialized?");
 		return NULL;
 	}
 	push(lsock_dest->outbox, msg);
-	dispatch_described_task(tcpip_send_packets, (void*)lsock_dest, "send packets");
+	tcpip_flush(lsock_dest);
 	return NULL;
 }
 
 /**
- * This routine handles a sensor message and sends an actuator message back.
+ * This routine handles a sensor message and sends an actuator message back. The context is
+ * a slice of the sensor message with only the sensor values. The spike buffers of the
+ * controller are used by one sensor message at a time.
  */
 static void *handle_sensor_data(void *context) {
-	struct InfoArray *infoa = (struct InfoArray*)context;
-	struct AERBuffer *in = malloc(sizeof(struct AERBuffer));
-	struct AERBuffer *out = malloc(sizeof(struct AERBuffer));
-	initAER(in); initAER(out);
+	struct TcpipMessage *values = (struct TcpipMessage*)context;
+	pthread_mutex_lock(&spikesMutex);
+	struct AERBuffer *in = clruntime->spikes_in;
+	struct AERBuffer *out = clruntime->spikes_out;
+	emptyAERBuffer(in); emptyAERBuffer(out);
 	tprintf(LOG_VV, __func__, "Generate incoming spikes");
-	generateSpikes(infoa->values, infoa->length, in);
+	generateSpikes(values->payload, values->size, in);
+	freemsg(values);
+	uint32_t ticks = 0;
 	do {
 		//print network
 		tprintf(LOG_VV, __func__, "Run network (again)");
-		;
+		ticks++;
 	} while (runNeuralNetwork(in, out));
-	int16_t *output = calloc(2, sizeof(int16_t));
+	__sync_fetch_and_add(&networkTicks, ticks);
+	int16_t output[getMotorMap()->channel_count];
 	tprintf(LOG_VV, __func__, "Interpret outgoing spikes");
 	interpretSpikes(out, output);
+	pthread_mutex_unlock(&spikesMutex);
+	send_actuators(output);
+	return NULL;
+}
 
-	tprintf(LOG_VV, __func__, "Send the actuator commands");
-	struct TcpipMessage *msg = createActuatorMessage(clconf->id, 0, output);
+/**
+ * Answers a request for the statistics, see stats.h. Next to those of the abbey and the
+ * channels, it tells how many networks are developed and how long that took, and how often
+ * the network ran, by the monks and by the control loop together, also per second since
+ * the request before.
+ */
+static void *send_stats(void *context) {
+	struct TcpipMessage *request = (struct TcpipMessage*)context;
 	struct TcpipSocket *lsock_dest = tcpipbank_get(tmconf->mbus_id);
 	if (lsock_dest == NULL) {
 		tprintf(LOG_WARNING, __func__, "Not initialized?");
+		freemsg(request);
 		return NULL;
 	}
-	push(lsock_dest->outbox, msg);
-	dispatch_described_task(tcpip_send_packets, (void*)lsock_dest, "send packets");
+	struct ControlLoopStats *loop = calloc(1, sizeof(struct ControlLoopStats));
+	if (loop == NULL) {
+		freemsg(request);
+		return NULL;
+	}
+	if (controlLoopRunning()) controlLoopStats(loop);
+	uint64_t ticks = networkTicks + loop->ticks, now = linda_trace_clock_ns(), perSecond = 0;
+	pthread_mutex_lock(&statsMutex);
+	if (statsAt && (now > statsAt))
+		perSecond = (ticks - statsTicks) * 1000000000ULL / (now - statsAt);
+	statsTicks = ticks;
+	statsAt = now;
+	pthread_mutex_unlock(&statsMutex);
+
+	uint8_t counters[256], *body = linda_stats_open(counters, LINDA_STATS_COUNTERS), *p;
+	p = linda_stats_counter(body, "developments", developments);
+	p = linda_stats_counter(p, "development_p50_us",
+			abbey_stats_percentile(developmentHistogram, 0.5) / 1000);
+	p = linda_stats_counter(p, "development_p99_us",
+			abbey_stats_percentile(developmentHistogram, 0.99) / 1000);
+	p = linda_stats_counter(p, "ticks", ticks);
+	p = linda_stats_counter(p, "ticks_per_s", perSecond);
+	if (controlLoopRunning()) {
+		p = linda_stats_counter(p, "frames", loop->frames);
+		p = linda_stats_counter(p, "frames_dropped", loop->dropped);
+		p = linda_stats_counter(p, "deadline_misses", loop->misses);
+	}
+	p = linda_stats_close(body, p);
+	free(loop);
+	struct TcpipMessage *msg = linda_stats_reply(request, clctx->clconf->id, LINDA_STATS_COLINDA,
+			counters, p - counters, tcpip_max_message_size(lsock_dest)), *next;
+	freemsg(request);
+	for (; msg != NULL; msg = next) {
+		next = msg->next;
+		push(lsock_dest->outbox, msg);
+	}
+	tcpip_flush(lsock_dest);
 	return NULL;
 }
 
+/**
+ * Sends the actuator commands, from a monk or from the control loop.
+ */
+static void send_actuators(int16_t *output) {
+	tprintf(LOG_VV, __func__, "Send the actuator commands");
+	struct TcpipMessage *msg = createActuatorMessage(clctx->clconf->id, 0, output);
+	struct TcpipSocket *lsock_dest = tcpipbank_get(tmconf->mbus_id);
+	if (lsock_dest == NULL) {
+		tprintf(LOG_WARNING, __func__, "Not initialized?");
+		freemsg(msg);
+		return;
+	}
+	push(lsock_dest->outbox, msg);
+	tcpip_flush(lsock_dest);
+}
+
 #ifdef WITH_GUI
 /**
  * Visualizes the occupation of a grid cell.
@@ -470,15 +1117,16 @@ void *visualize(void *context) {
 	if (infoa->length != 4) {
 		tprintf(LOG_WARNING, __func__, "Inproper visualization command");
 	}
-	struct TcpipMessage *msg = createGUIColorMessage(clconf->id, infoa->values);
+	struct TcpipMessage *msg = createGUIColorMessage(clctx->clconf->id, infoa->values);
+	linda_ctx_free(infoa->values);
+	linda_ctx_free(infoa);
 	struct TcpipSocket *lsock_dest = tcpipbank_get(tmconf->mbus_id);
 	if (lsock_dest == NULL) {
 		tprintf(LOG_WARNING, __func__, "Not initialized?");
 		return NULL;
 	}
 	push(lsock_dest->outbox, msg);
-	dispatch_described_task(tcpip_send_packets, (void*)lsock_dest, "send packets");
-	free(infoa);
+	tcpip_flush(lsock_dest);
 	return NULL;
 }
 #endif
@@ -491,18 +1139,21 @@ void *visualize(void *context) {
 int main(int argc, const char* argv[] ) {
 	initColinda();
 	if (argc == 2) {
-		clconf->id = atoi( argv[1] );
+		clctx->clconf->id = atoi( argv[1] );
 	} else {
 		tprintf(LOG_EMERG, __func__, "Should have a controller id argument");
 	}
 	char text[32]; 
-	sprintf(text, "(id=%i) colinda", clconf->id);
+	sprintf(text, "(id=%i) colinda", clctx->clconf->id);
 	openlog (text, LOG_CONS, LOG_LOCAL0);
 	//	initLog(LOG_DEBUG);
 	initLog(LOG_VERBOSE);
+	startLogThread();
 	logconf->name = calloc(32, sizeof(char));
-	sprintf(logconf->name, "robot:%i", clconf->id);
+	sprintf(logconf->name, "robot:%i", clctx->clconf->id);
 	logconf->printName = 1;
+	sprintf(text, "colinda-%i", clctx->clconf->id);
+	linda_trace_init(text);
 	pthread_t this = pthread_self();
 	ptreaty_add_thread(&this, "Main");
 	tprintf(LOG_NOTICE, __func__, "Start Colinda");
@@ -519,6 +1170,10 @@ int main(int argc, const char* argv[] ) {
 	tprintf(LOG_VERBOSE, __func__, "Wait for EOS");
 	ptreaty_wait(clruntime->sync);
 
+	if (controlLoopRunning()) {
+		stopControlLoop();
+		controlLoopStatsDump();
+	}
 	closelog();
 
 	return 0;
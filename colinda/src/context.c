@@ -0,0 +1,163 @@
+/**
+ * @file context.c
+ *
+ * The context of a thread starts as the one of the process, which is not allocated.
+ *
+ * @date_created    Oct 14, 2026
+ * @date_modified   Oct 14, 2026
+ * @author          Anne C. van Rossum
+ * @project         Replicator
+ * @company         Almende B.V.
+ * @license         open-source, GNU Lesser General Public License
+ */
+
+#include <lindaconfig.h>
+#include <context.h>
+#include <colinda.h>
+#include <genome.h>
+#include <grid.h>
+#include <embryogeny.h>
+#include <topology.h>
+#include <neuron.h>
+#include <sensorimotor.h>
+#include <region.h>
+#include <netframe.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WITH_SYMBRICATOR
+#include "portable.h"
+#endif
+
+/****************************************************************************************************
+ *  		Declarations
+ ***************************************************************************************************/
+
+struct ColindaContext processContext;
+
+__thread struct ColindaContext *clctx = &processContext;
+
+/****************************************************************************************************
+ *  		Implementations
+ ***************************************************************************************************/
+
+/**
+ * A context without a genome or a network, as a process starts. It gets a configuration of
+ * its own, with the given id, and the amount of monks etc. of the context of the thread.
+ */
+struct ColindaContext *newColindaContext(uint8_t id) {
+	struct ColindaContext *context = lindaCalloc(1, sizeof(struct ColindaContext));
+	context->clconf = lindaCalloc(1, sizeof(struct ColindaConfig));
+	if (clctx->clconf != NULL) *context->clconf = *clctx->clconf;
+	context->clconf->dna_buffer_ptr = 0;
+	context->clconf->dna_part_ptr = 0;
+	context->clconf->id = id;
+	return context;
+}
+
+/**
+ * Frees the network, the grid and the genes of the context, and the context itself.
+ */
+void freeColindaContext(struct ColindaContext *context) {
+	enterColindaContext(context);
+	freeCompiledNetwork();
+	if (context->gconf != NULL) {
+		freeGenome();
+		free_embryology();
+	}
+	freeRegion();
+	if (context->eg != NULL) {
+		if (context->eg->genes != NULL) freeGenes();
+		free(context->eg);
+	}
+	free(context->dna);
+	free(context->clconf);
+	leaveColindaContext(context);
+	free(context);
+}
+
+/**
+ * Makes the context the one of the thread, until it is left. Another thread can be in the
+ * same context only once this one left it.
+ */
+void enterColindaContext(struct ColindaContext *context) {
+	context->outer = clctx;
+	clctx = context;
+}
+
+void leaveColindaContext(struct ColindaContext *context) {
+	clctx = context->outer;
+	context->outer = NULL;
+}
+
+struct ColindaContext *switchColindaContext(struct ColindaContext *context) {
+	struct ColindaContext *previous = clctx;
+	clctx = context;
+	return previous;
+}
+
+/**
+ * Extracts the genes of an entire genome into the context, as colinda does for a genome it
+ * receives. The genome is copied, because the extraction writes in it.
+ */
+void extractGenesIn(struct ColindaContext *context, const uint8_t *genome, uint16_t size) {
+	Codon *content = lindaMalloc(size * sizeof(Codon));
+	memcpy(content, genome, size * sizeof(Codon));
+	enterColindaContext(context);
+	if (context->dna == NULL) {
+		receiveNewGenome();
+	}
+	if (context->eg == NULL) {
+		initGeneExtraction();
+	} else if (context->eg->genes != NULL) {
+		freeGenes();
+		context->eg->genes = NULL;
+	}
+	context->g = NULL;
+	context->clconf->dna_buffer_ptr = 0;
+	context->clconf->dna_part_ptr = 0;
+	context->dna->content = content;
+	stepGeneExtraction(size);
+	context->dna->content = NULL;
+	leaveColindaContext(context);
+	free(content);
+}
+
+void developCachedNeuralNetworkIn(struct ColindaContext *context, uint32_t hash, uint32_t size) {
+	enterColindaContext(context);
+	developCachedNeuralNetwork(hash, size);
+	leaveColindaContext(context);
+}
+
+uint8_t stepEmbryologyIn(struct ColindaContext *context) {
+	enterColindaContext(context);
+	uint8_t result = stepEmbryology();
+	leaveColindaContext(context);
+	return result;
+}
+
+/**
+ * The topology of the network of the context, see getTopology.
+ */
+uint16_t getTopologyIn(struct ColindaContext *context, uint8_t *topology, uint16_t size) {
+	enterColindaContext(context);
+	uint16_t result = (context->s == NULL) ? 0 : getTopology(topology, size);
+	leaveColindaContext(context);
+	return result;
+}
+
+/**
+ * The network of the context as a frame, see netframe.h, which the caller frees. Returns NULL
+ * if the context has no network.
+ */
+uint8_t *getNetworkFrameIn(struct ColindaContext *context, uint32_t *size) {
+	uint8_t *frame = NULL;
+	enterColindaContext(context);
+	if ((context->s != NULL) && (context->nn != NULL)) {
+		*size = networkFrameSize();
+		frame = lindaMalloc(*size);
+		if (frame != NULL) writeNetworkFrame(frame);
+	}
+	leaveColindaContext(context);
+	return frame;
+}
@@ -0,0 +1,218 @@
+/**
+ * @file controlloop.c
+ *
+ * The queue has a sequence number per cell, as the task queues of the abbey: a producer may
+ * fill the cell at its position when the sequence equals that position, and the loop may
+ * empty it when the sequence is one more. There is only one consumer, so it needs no
+ * compare-and-swap. A semaphore wakes the loop up for every frame.
+ *
+ * @date_created    Oct 14, 2026
+ * @date_modified   Oct 14, 2026
+ * @author          Anne C. van Rossum
+ * @project         Replicator
+ * @company         Almende B.V.
+ * @license         open-source, GNU Lesser General Public License
+ */
+
+#include <lindaconfig.h>
+#include <controlloop.h>
+#include <sensorimotor.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+
+#include <linda/log.h>
+#include <linda/trace.h>
+
+/****************************************************************************************************
+ *  		Declarations
+ ***************************************************************************************************/
+
+struct SensorFrame {
+	volatile unsigned int sequence;
+	unsigned long long queued_ns;
+	uint8_t size;
+	uint8_t values[CONTROL_FRAME_SIZE];
+};
+
+static struct SensorFrame frames[CONTROL_QUEUE_SIZE];
+static volatile unsigned int enqueuePos;
+static unsigned int dequeuePos;
+static sem_t framesQueued;
+
+static pthread_t loopThread;
+static volatile uint8_t running = 0;
+static uint8_t loopTicks;
+static struct AERBuffer *loopIn, *loopOut;
+static void (*loopEmit)(int16_t *output);
+
+static struct ControlLoopStats loopStats;
+
+/****************************************************************************************************
+ *  		Implementations
+ ***************************************************************************************************/
+
+uint8_t pushSensorFrame(const uint8_t *values, uint8_t size) {
+	struct SensorFrame *frame;
+	unsigned int pos = enqueuePos;
+	while (1) {
+		frame = &frames[pos & (CONTROL_QUEUE_SIZE - 1)];
+		int dif = (int)(frame->sequence - pos);
+		if (dif == 0) {
+			if (__sync_bool_compare_and_swap(&enqueuePos, pos, pos + 1)) break;
+			pos = enqueuePos;
+		} else if (dif < 0) {
+			__sync_add_and_fetch(&loopStats.dropped, 1);
+			return 0;
+		} else {
+			pos = enqueuePos;
+		}
+	}
+	if (size > CONTROL_FRAME_SIZE) size = CONTROL_FRAME_SIZE;
+	memcpy(frame->values, values, size);
+	frame->size = size;
+	frame->queued_ns = linda_trace_clock_ns();
+	__sync_synchronize();
+	frame->sequence = pos + 1;
+	sem_post(&framesQueued);
+	return 1;
+}
+
+static void record(unsigned int *histogram, unsigned long long ns) {
+	histogram[abbey_stats_bucket(ns)]++;
+}
+
+/**
+ * Runs the network for one frame and emits the values for the actuators.
+ */
+static void handleFrame(struct SensorFrame *frame) {
+	unsigned long long start, end;
+	uint8_t i;
+	emptyAERBuffer(loopIn);
+	emptyAERBuffer(loopOut);
+	generateSpikes(frame->values, frame->size, loopIn);
+	for (i = 0; i < loopTicks; i++) {
+		start = linda_trace_clock_ns();
+		while (runNeuralNetwork(loopIn, loopOut));
+		end = linda_trace_clock_ns();
+		record(loopStats.tick_histogram, end - start);
+		loopStats.ticks++;
+	}
+	int16_t output[getMotorMap()->channel_count];
+	interpretSpikes(loopOut, output);
+	loopEmit(output);
+}
+
+static void *controlLoop(void *context) {
+	unsigned long long latency, previous = 0;
+	while (1) {
+		sem_wait(&framesQueued);
+		if (!running) break;
+		struct SensorFrame *frame = &frames[dequeuePos & (CONTROL_QUEUE_SIZE - 1)];
+		//a frame is posted, but the one before it may still be copied in
+		while ((int)(frame->sequence - (dequeuePos + 1)) != 0) sched_yield();
+		__sync_synchronize();
+		handleFrame(frame);
+		latency = linda_trace_clock_ns() - frame->queued_ns;
+		frame->sequence = dequeuePos + CONTROL_QUEUE_SIZE;
+		dequeuePos++;
+
+		loopStats.frames++;
+		loopStats.latency_ns_total += latency;
+		if (latency > loopStats.deadline_ns) loopStats.misses++;
+		record(loopStats.latency_histogram, latency);
+		if (loopStats.frames > 1)
+			record(loopStats.jitter_histogram, latency > previous ? latency - previous :
+					previous - latency);
+		previous = latency;
+	}
+	return NULL;
+}
+
+/**
+ * Without the permission for SCHED_FIFO, the thread is created again with its default policy.
+ */
+int startControlLoop(uint8_t ticks, unsigned long deadline_us, struct AERBuffer *in,
+		struct AERBuffer *out, void (*emit)(int16_t *output)) {
+	unsigned int i;
+	if (running) return -1;
+	for (i = 0; i < CONTROL_QUEUE_SIZE; i++) frames[i].sequence = i;
+	enqueuePos = dequeuePos = 0;
+	memset(&loopStats, 0, sizeof(struct ControlLoopStats));
+	loopStats.deadline_ns = deadline_us * 1000ULL;
+	loopTicks = ticks ? ticks : 1;
+	loopIn = in;
+	loopOut = out;
+	loopEmit = emit;
+	if (sem_init(&framesQueued, 0, 0)) return -1;
+	running = 1;
+
+	pthread_attr_t attr;
+	struct sched_param param;
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	param.sched_priority = CONTROL_LOOP_PRIORITY;
+	pthread_attr_setschedparam(&attr, &param);
+	if (pthread_create(&loopThread, &attr, controlLoop, NULL)) {
+		tprintf(LOG_WARNING, __func__, "No SCHED_FIFO for the control loop");
+		if (pthread_create(&loopThread, NULL, controlLoop, NULL)) {
+			tprintf(LOG_ERR, __func__, "Control loop could not be started");
+			running = 0;
+			pthread_attr_destroy(&attr);
+			sem_destroy(&framesQueued);
+			return -1;
+		}
+	}
+	pthread_attr_destroy(&attr);
+	TPRINTF(LOG_INFO, "Control loop runs %i ticks per frame, deadline %lu us", loopTicks,
+			deadline_us);
+	return 0;
+}
+
+/**
+ * Stops the thread after the frame it is handling, the frames still queued are dropped.
+ */
+void stopControlLoop() {
+	if (!running) return;
+	running = 0;
+	sem_post(&framesQueued);
+	pthread_join(loopThread, NULL);
+	sem_destroy(&framesQueued);
+}
+
+uint8_t controlLoopRunning() {
+	return running;
+}
+
+/**
+ * The statistics are recorded without a lock, by the loop only, a snapshot may be a frame
+ * behind in some of its fields.
+ */
+void controlLoopStats(struct ControlLoopStats *stats) {
+	__sync_synchronize();
+	memcpy(stats, &loopStats, sizeof(struct ControlLoopStats));
+}
+
+/**
+ * Logs a line with the amount of frames, misses and drops, and the median and 99th
+ * percentile of the latency, the jitter and the time of a tick, in microseconds.
+ */
+void controlLoopStatsDump() {
+	struct ControlLoopStats *stats = malloc(sizeof(struct ControlLoopStats));
+	if (stats == NULL) return;
+	controlLoopStats(stats);
+	TPRINTF(LOG_NOTICE, "%lu frames, %lu missed, %lu dropped, latency %llu/%llu us, "
+			"jitter %llu/%llu us, tick %llu/%llu us", stats->frames, stats->misses,
+			stats->dropped,
+			abbey_stats_percentile(stats->latency_histogram, 0.5) / 1000,
+			abbey_stats_percentile(stats->latency_histogram, 0.99) / 1000,
+			abbey_stats_percentile(stats->jitter_histogram, 0.5) / 1000,
+			abbey_stats_percentile(stats->jitter_histogram, 0.99) / 1000,
+			abbey_stats_percentile(stats->tick_histogram, 0.5) / 1000,
+			abbey_stats_percentile(stats->tick_histogram, 0.99) / 1000);
+	free(stats);
+}
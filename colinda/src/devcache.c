@@ -0,0 +1,455 @@
+/**
+ * @file devcache.c
+ *
+ * A blob starts with a magic number, the key and the parameters it is developed with, the
+ * amount of neurons and the amount of synapses. Then come the synapses, with the cells of
+ * their pre- and post-synaptic neurons, because a cell holds one neuron at most, and then
+ * the neurons, with the indices of the synapses on their outgoing and incoming ports.
+ *
+ * @date_created    Oct 14, 2026
+ * @date_modified   Oct 14, 2026
+ * @author          Anne C. van Rossum
+ * @project         Replicator
+ * @company         Almende B.V.
+ * @license         open-source, GNU Lesser General Public License
+ */
+
+#include <lindaconfig.h>
+#include <devcache.h>
+#include <genome.h>
+#include <grid.h>
+#include <embryogeny.h>
+#include <topology.h>
+#include <neuron.h>
+#include <region.h>
+#include <linda/buffer.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef WITH_SYMBRICATOR
+#include "portable.h"
+#else
+#include <stdio.h>
+#include <unistd.h>
+#endif
+
+#ifdef WITH_CONSOLE
+#include <linda/log.h>
+#endif
+
+/****************************************************************************************************
+ *  		Declarations
+ ***************************************************************************************************/
+
+#define DEVCACHE_MAGIC			0x4C444332 //"LDC2"
+#define DEVCACHE_PARAMETERS		26
+#define DEVCACHE_HEADER			(8 + DEVCACHE_PARAMETERS + 4)
+#define DEVCACHE_SYNAPSE		(2 + 2 + 1 + sizeof(float))
+#define DEVCACHE_NEURON			(2 + 1 + 2 + 7 * sizeof(float) + 2 + 2)
+
+struct Development {
+	uint32_t key;
+	uint32_t size;
+	uint8_t *blob;
+	struct Development *next;
+};
+
+//! Most recently used first
+static struct Development *developments = NULL;
+static uint32_t developmentsSize = 0;
+static uint32_t capacity = DEVCACHE_CAPACITY;
+static const char *directory = NULL;
+static uint8_t configured = 0;
+static pthread_mutex_t developmentsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+//! The parameters of the development to come, set by developmentKey, per thread because the
+//! contexts on the monks develop at the same time
+static __thread uint8_t parameters[DEVCACHE_PARAMETERS];
+
+/****************************************************************************************************
+ *  		Implementations
+ ***************************************************************************************************/
+
+static uint8_t *put(uint8_t *p, const void *value, uint32_t size) {
+	memcpy(p, value, size);
+	return p + size;
+}
+
+static const uint8_t *get(const uint8_t *p, void *value, uint32_t size) {
+	memcpy(value, p, size);
+	return p + size;
+}
+
+static void configure() {
+	if (configured) return;
+	configured = 1;
+#ifndef WITH_SYMBRICATOR
+	unsigned int size;
+	const char *text = getenv("LINDA_DEVCACHE_SIZE");
+	if ((text != NULL) && (sscanf(text, "%u", &size) == 1)) capacity = size;
+	directory = getenv("LINDA_DEVCACHE");
+	if ((directory != NULL) && (directory[0] == 0)) directory = NULL;
+#endif
+}
+
+/**
+ * The key of the development of a genome with the given hash and size, with the parameters
+ * as they are now. Must be called after the genome, the grid and the embryogeny are
+ * configured, and before development starts.
+ */
+uint32_t developmentKey(uint32_t genomeHash, uint32_t genomeSize) {
+	uint8_t *p = parameters;
+	p = put(p, &genomeHash, 4);
+	p = put(p, &genomeSize, 4);
+	p = put(p, &clctx->gconf->regulatingFactors, 1);
+	p = put(p, &clctx->gconf->phenotypicFactors, 1);
+	p = put(p, &clctx->s->rows, 1);
+	p = put(p, &clctx->s->columns, 1);
+	p = put(p, &clctx->s->decay_step, 1);
+	p = put(p, &clctx->s->diffuse_ratio, 1);
+	p = put(p, &clctx->s->concentration_threshold, 1);
+	p = put(p, &clctx->s->concentration_default, 1);
+	p = put(p, &clctx->e->default_weight, sizeof(float));
+	p = put(p, &clctx->e->default_delay, 1);
+	p = put(p, &clctx->e->step_budget, 2);
+	p = put(p, &clctx->e->stable_steps, 1);
+	memset(p, 0, parameters + DEVCACHE_PARAMETERS - p);
+	return linda_buffer_hash(parameters, DEVCACHE_PARAMETERS);
+}
+
+/**
+ * Makes the development the most recently used one. Must be called with the lock.
+ */
+static void use(struct Development *ld, struct Development *lprev) {
+	if (lprev == NULL) return;
+	lprev->next = ld->next;
+	ld->next = developments;
+	developments = ld;
+}
+
+/**
+ * Adds a blob, which is taken over, and drops the least recently used ones beyond the
+ * capacity. Must be called with the lock.
+ */
+static void add(uint32_t key, uint8_t *blob, uint32_t size) {
+	struct Development *ld = malloc(sizeof(struct Development)), **lp;
+	if (ld == NULL) {
+		free(blob);
+		return;
+	}
+	ld->key = key; ld->size = size; ld->blob = blob;
+	ld->next = developments;
+	developments = ld;
+	developmentsSize += size;
+	while (developmentsSize > capacity && developments->next != NULL) {
+		for (lp = &developments; (*lp)->next != NULL; lp = &(*lp)->next);
+		developmentsSize -= (*lp)->size;
+		free((*lp)->blob);
+		free(*lp);
+		*lp = NULL;
+	}
+}
+
+#ifndef WITH_SYMBRICATOR
+static void path(char *text, uint32_t key) {
+	sprintf(text, "%.200s/devcache-%08x.bin", directory, key);
+}
+
+/**
+ * Reads the blob of the given key from the directory, or returns NULL.
+ */
+static uint8_t *load(uint32_t key, uint32_t *size) {
+	char text[256];
+	path(text, key);
+	FILE *f = fopen(text, "rb");
+	if (f == NULL) return NULL;
+	uint8_t *blob = NULL;
+	long length;
+	if (!fseek(f, 0, SEEK_END) && ((length = ftell(f)) >= DEVCACHE_HEADER) &&
+			!fseek(f, 0, SEEK_SET) && ((blob = malloc(length)) != NULL)) {
+		if (fread(blob, 1, length, f) != (size_t)length) {
+			free(blob);
+			blob = NULL;
+		}
+		*size = length;
+	}
+	fclose(f);
+	return blob;
+}
+
+/**
+ * Writes the blob to a temporary file first, so that another colinda never reads half a blob.
+ */
+static void save(uint32_t key, const uint8_t *blob, uint32_t size) {
+	char text[256], temp[272];
+	path(text, key);
+	sprintf(temp, "%s.%i", text, (int)getpid());
+	FILE *f = fopen(temp, "wb");
+	if (f == NULL) return;
+	uint8_t written = fwrite(blob, 1, size, f) == size;
+	if (fclose(f) || !written || rename(temp, text)) remove(temp);
+}
+#endif
+
+/**
+ * Builds the network in the blob into the grid, which should not have neurons yet. Returns
+ * 0 if the blob does not belong to this development or does not fit in this grid.
+ */
+static uint8_t instantiate(const uint8_t *blob, uint32_t size) {
+	const uint8_t *p = blob, *end = blob + size;
+	uint32_t magic, key;
+	uint16_t i, j, neuron_count, synapse_count, cell, count, id;
+	uint16_t cells = clctx->s->rows * clctx->s->columns;
+	p = get(p, &magic, 4);
+	p = get(p, &key, 4);
+	if ((magic != DEVCACHE_MAGIC) || memcmp(p, parameters, DEVCACHE_PARAMETERS)) return 0;
+	p += DEVCACHE_PARAMETERS;
+	p = get(p, &neuron_count, 2);
+	p = get(p, &synapse_count, 2);
+	if (p + (uint32_t)synapse_count * DEVCACHE_SYNAPSE > end) return 0;
+
+	//the synapses refer to their neurons by cell, which are allocated first
+	const uint8_t *lsynapses = p, *lneurons = p + (uint32_t)synapse_count * DEVCACHE_SYNAPSE;
+	for (p = lneurons, i = 0; i < neuron_count; i++) {
+		if (p + DEVCACHE_NEURON > end) return 0;
+		get(p, &cell, 2);
+		if ((cell >= cells) || (clctx->s->gridcells[cell].neuron != NULL)) return 0;
+		clctx->s->gridcells[cell].neuron = regionAlloc(REGION_NEURON, sizeof(struct Neuron));
+		p += DEVCACHE_NEURON - 4;
+		p = get(p, &count, 2);
+		p = get(p, &j, 2);
+		p += 2 * ((uint32_t)count + j);
+	}
+	if (p != end) return 0;
+
+	struct Synapse **synapses = lindaMalloc((synapse_count + 1) * sizeof(struct Synapse*));
+	//the port out and the port in of every synapse, to make them each other's opposite
+	struct Port **lsides = lindaMalloc(2 * (synapse_count + 1) * sizeof(struct Port*));
+	for (i = 0; i < 2 * synapse_count; i++) {
+		lsides[i] = NULL;
+	}
+	for (p = lsynapses, i = 0; i < synapse_count; i++) {
+		uint16_t pre, post;
+		struct Synapse *ls = synapses[i] = regionAlloc(REGION_SYNAPSE, sizeof(struct Synapse));
+		p = get(p, &pre, 2);
+		p = get(p, &post, 2);
+		ls->pre_neuron = pre < cells ? clctx->s->gridcells[pre].neuron : NULL;
+		ls->post_neuron = post < cells ? clctx->s->gridcells[post].neuron : NULL;
+		p = get(p, &ls->delay, 1);
+		p = get(p, &ls->weight, sizeof(float));
+	}
+
+	struct Neuron **lnp = &clctx->nn->neurons;
+	for (i = 0; i < neuron_count; i++) {
+		p = get(p, &cell, 2);
+		struct Neuron *ln = *lnp = clctx->s->gridcells[cell].neuron;
+		ln->gridcell = &clctx->s->gridcells[cell];
+		ln->history = regionAlloc(REGION_HISTORY, sizeof(struct SpikeHistory));
+		p = get(p, &ln->type, 1);
+		p = get(p, &ln->history->spike_bitseq, 2);
+		p = get(p, &ln->v, sizeof(float));
+		p = get(p, &ln->u, sizeof(float));
+		p = get(p, &ln->a, sizeof(float));
+		p = get(p, &ln->b, sizeof(float));
+		p = get(p, &ln->c, sizeof(float));
+		p = get(p, &ln->d, sizeof(float));
+		p = get(p, &ln->I, sizeof(float));
+		ln->method = NULL;
+		struct Port **lports[2] = {&ln->ports_out, &ln->ports_in};
+		uint16_t counts[2];
+		p = get(p, &counts[0], 2);
+		p = get(p, &counts[1], 2);
+		for (j = 0; j < 2; j++) {
+			struct Port **lpp = lports[j], *lprev = NULL;
+			for (count = 0; count < counts[j]; count++) {
+				p = get(p, &id, 2);
+				struct Port *lp = *lpp = regionAlloc(REGION_PORT, sizeof(struct Port));
+				lp->synapse = id < synapse_count ? synapses[id] : NULL;
+				lp->direction = j ? PORT_IN : PORT_OUT;
+				lp->prev = lprev;
+				lp->opposite = NULL;
+				if (id < synapse_count) lsides[2 * id + j] = lp;
+				lprev = lp;
+				lpp = &lp->next;
+			}
+			*lpp = NULL;
+		}
+		ln->current_port = ln->ports_out;
+		lnp = &ln->next;
+	}
+	*lnp = NULL;
+	for (i = 0; i < synapse_count; i++) {
+		if ((lsides[2 * i] == NULL) || (lsides[2 * i + 1] == NULL)) continue;
+		lsides[2 * i]->opposite = lsides[2 * i + 1];
+		lsides[2 * i + 1]->opposite = lsides[2 * i];
+	}
+	free(lsides);
+	free(synapses);
+	clctx->np = clctx->nn->neurons;
+	return 1;
+}
+
+/**
+ * Builds the network that is developed before with the given key, from the cache in memory or
+ * in the directory. The grid should be initialized, without neurons. Returns 0 if there is no
+ * such development, then nothing is changed.
+ */
+uint8_t restoreDevelopment(uint32_t key) {
+	struct Development *ld, *lprev = NULL;
+	uint8_t restored = 0;
+	pthread_mutex_lock(&developmentsMutex);
+	configure();
+	for (ld = developments; ld != NULL; lprev = ld, ld = ld->next) {
+		if (ld->key == key) break;
+	}
+#ifndef WITH_SYMBRICATOR
+	if ((ld == NULL) && (directory != NULL)) {
+		uint32_t size;
+		uint8_t *blob = load(key, &size);
+		if (blob != NULL) {
+			add(key, blob, size);
+			ld = developments;
+			lprev = NULL;
+		}
+	}
+#endif
+	if (ld != NULL) {
+		use(ld, lprev);
+		restored = instantiate(ld->blob, ld->size);
+	}
+	pthread_mutex_unlock(&developmentsMutex);
+#ifdef WITH_CONSOLE
+	if (ld != NULL && !restored) tprintf(LOG_WARNING, __func__, "Cached development does not fit");
+#endif
+	if (!restored && ld != NULL) {
+		//a blob that does not fit leaves neurons in the cells, without ports, and synapses
+		uint16_t i;
+		for (i = 0; i < clctx->s->rows * clctx->s->columns; i++) {
+			clctx->s->gridcells[i].neuron = NULL;
+		}
+		regionReset();
+	}
+	return restored;
+}
+
+/**
+ * The index of the synapse in the table, which is open addressing by the pointer. A synapse
+ * that is not there yet, is added with the next free index.
+ */
+static uint16_t indexSynapse(struct Synapse **table, uint16_t *ids, uint32_t mask,
+		struct Synapse *ls, uint16_t *count) {
+	uint32_t h = (uint32_t)(((uintptr_t)ls >> 4) * 2654435761u) & mask;
+	while (table[h] != NULL && table[h] != ls) h = (h + 1) & mask;
+	if (table[h] == NULL) {
+		table[h] = ls;
+		ids[h] = (*count)++;
+	}
+	return ids[h];
+}
+
+/**
+ * Keeps the developed network under the given key, in memory and in the directory if there
+ * is one. Must be called right after the development, before the network runs.
+ */
+void storeDevelopment(uint32_t key) {
+	struct Neuron *ln;
+	struct Port *lp;
+	uint16_t neuron_count = 0, synapse_count = 0, count;
+	uint32_t ports = 0, mask = 1;
+	uint8_t j;
+	for (ln = clctx->nn->neurons; ln != NULL; ln = ln->next) {
+		neuron_count++;
+		for (lp = ln->ports_out; lp != NULL; lp = lp->next) ports++;
+		for (lp = ln->ports_in; lp != NULL; lp = lp->next) ports++;
+	}
+	while (mask < 2 * ports) mask <<= 1;
+	struct Synapse **table = calloc(mask, sizeof(struct Synapse*));
+	uint16_t *ids = malloc(mask * sizeof(uint16_t));
+	uint32_t size = DEVCACHE_HEADER + (uint32_t)neuron_count * DEVCACHE_NEURON + 2 * ports;
+	uint8_t *blob = malloc(size + ports * DEVCACHE_SYNAPSE);
+	if (table == NULL || ids == NULL || blob == NULL) goto free_table;
+	mask--;
+
+	//the neurons go after the synapses, which are only known when the neurons are done
+	uint8_t *lneurons = malloc(size - DEVCACHE_HEADER + 1), *p = lneurons;
+	if (lneurons == NULL) goto free_table;
+	for (ln = clctx->nn->neurons; ln != NULL; ln = ln->next) {
+		uint16_t cell = getGridCellIndex(ln->gridcell), spikes = ln->history->spike_bitseq;
+		p = put(p, &cell, 2);
+		p = put(p, &ln->type, 1);
+		p = put(p, &spikes, 2);
+		p = put(p, &ln->v, sizeof(float));
+		p = put(p, &ln->u, sizeof(float));
+		p = put(p, &ln->a, sizeof(float));
+		p = put(p, &ln->b, sizeof(float));
+		p = put(p, &ln->c, sizeof(float));
+		p = put(p, &ln->d, sizeof(float));
+		p = put(p, &ln->I, sizeof(float));
+		struct Port *lports[2] = {ln->ports_out, ln->ports_in};
+		for (j = 0; j < 2; j++) {
+			for (count = 0, lp = lports[j]; lp != NULL; lp = lp->next) count++;
+			p = put(p, &count, 2);
+		}
+		for (j = 0; j < 2; j++) {
+			for (lp = lports[j]; lp != NULL; lp = lp->next) {
+				uint16_t id = indexSynapse(table, ids, mask, lp->synapse, &synapse_count);
+				p = put(p, &id, 2);
+			}
+		}
+	}
+
+	uint32_t magic = DEVCACHE_MAGIC;
+	uint8_t *q = blob;
+	q = put(q, &magic, 4);
+	q = put(q, &key, 4);
+	q = put(q, parameters, DEVCACHE_PARAMETERS);
+	q = put(q, &neuron_count, 2);
+	q = put(q, &synapse_count, 2);
+	uint32_t h;
+	uint8_t *lsynapses = q;
+	for (h = 0; h <= mask; h++) {
+		struct Synapse *ls = table[h];
+		if (ls == NULL) continue;
+		uint8_t *ps = lsynapses + (uint32_t)ids[h] * DEVCACHE_SYNAPSE;
+		uint16_t pre = ls->pre_neuron != NULL ? getGridCellIndex(ls->pre_neuron->gridcell) : 0xFFFF;
+		uint16_t post = ls->post_neuron != NULL ? getGridCellIndex(ls->post_neuron->gridcell) : 0xFFFF;
+		ps = put(ps, &pre, 2);
+		ps = put(ps, &post, 2);
+		ps = put(ps, &ls->delay, 1);
+		put(ps, &ls->weight, sizeof(float));
+	}
+	q += (uint32_t)synapse_count * DEVCACHE_SYNAPSE;
+	q = put(q, lneurons, p - lneurons);
+	free(lneurons);
+	size = q - blob;
+
+	pthread_mutex_lock(&developmentsMutex);
+	configure();
+#ifndef WITH_SYMBRICATOR
+	if (directory != NULL) save(key, blob, size);
+#endif
+	add(key, blob, size);
+	pthread_mutex_unlock(&developmentsMutex);
+	blob = NULL;
+free_table:
+	free(blob);
+	free(table);
+	free(ids);
+}
+
+/**
+ * Drops all developments in memory, the ones in the directory are kept.
+ */
+void freeDevelopments() {
+	struct Development *ld;
+	pthread_mutex_lock(&developmentsMutex);
+	while (developments != NULL) {
+		ld = developments;
+		developments = ld->next;
+		free(ld->blob);
+		free(ld);
+	}
+	developmentsSize = 0;
+	pthread_mutex_unlock(&developmentsMutex);
+}
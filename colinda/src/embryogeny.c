@@ -11,9 +11,14 @@
 #include <embryogeny.h>
 #include <neuron.h>
 #include <genome.h>
+#include <region.h>
 
 #include <bits.h>
 
+#ifdef WITH_RECORDER
+#include <recorder.h>
+#endif
+
 #ifdef WITH_SYMBRICATOR
 #include "portable.h"
 #endif
@@ -55,7 +60,6 @@ void changeTopologicalType();
 
 #ifdef WITH_PRINT_DISTRIBUTION
 void initPrintDistribution();
-uint16_t *distribution;
 #endif
 
 /****************************************************************************************************
@@ -72,10 +76,14 @@ uint16_t *distribution;
  * to be developped.
  */
 void init_embryology() {
-	e = lindaMalloc(sizeof(struct Embryogeny));
-	e->default_weight = 6;
-	e->default_delay = 1;
-	nn = lindaMalloc(sizeof(struct NN));
+	clctx->e = lindaMalloc(sizeof(struct Embryogeny));
+	clctx->e->default_weight = 6;
+	clctx->e->default_delay = 1;
+	clctx->e->step_budget = EMBRYOGENY_STEP_BUDGET;
+	clctx->e->stable_steps = EMBRYOGENY_STABLE_STEPS;
+	clctx->e->step = 0;
+	clctx->e->stable = 0;
+	clctx->nn = lindaMalloc(sizeof(struct NN));
 
 	configGrid();
 	initGrid();
@@ -86,30 +94,23 @@ void init_embryology() {
 }
 
 /**
- * If the embryology constructs are deallocated before the gridcell, it is possible to
- * use the cellular instructions to free the memory, like removeNeuron. This might not
- * seem to be a big deal, but a neuron is connected to other neurons by synapses etc.
- * So it is quite easy if this is reused for deallocation purposes. 
+ * The neurons, synapses and ports all come from the region, see region.h, so they are freed
+ * at once, without unlinking them one by one with removeNeuron. The cells go with the grid.
  * 
  * The grid is allocated by init_embryology, for which reason it is also logical to
  * deallocate it in free_embryology. 
  */
 void free_embryology() {
-	gc = s->gridcells;
-	do {
-		if (gc->neuron != NULL) {
-			removeNeuron();
-		}
-		gc = gc->next;
-	} while (gc != s->gridcells);
+	clctx->nn->neurons = clctx->np = NULL;
+	regionReset();
 
 #ifdef WITH_PRINT_DISTRIBUTION
-	free(distribution);
+	free(clctx->distribution);
 #endif
 
 	freeGrid();	
-	free(nn);
-	free(e);
+	free(clctx->nn);
+	free(clctx->e);
 }
 
 /**
@@ -120,56 +121,59 @@ void free_embryology() {
  */
 void start_embryology() {
 	//neurons
-	np = nn->neurons = lindaMalloc(sizeof(struct Neuron));
-	np->next = NULL; np->ports_in = NULL; np->ports_out = NULL;
-	np->history = lindaMalloc(sizeof(struct SpikeHistory));
-	np->next = lindaMalloc(sizeof(struct Neuron));
-	np->next->next = NULL; np->next->ports_in = NULL; np->next->ports_out = NULL;
-	np->next->history = lindaMalloc(sizeof(struct SpikeHistory));
-	(np->gridcell = getGridCell(1,1))->neuron = np;
-	(np->next->gridcell = getGridCell(3,3))->neuron = np->next;
+	clctx->np = clctx->nn->neurons = regionAlloc(REGION_NEURON, sizeof(struct Neuron));
+	clctx->np->next = NULL; clctx->np->ports_in = NULL; clctx->np->ports_out = NULL;
+	clctx->np->history = regionAlloc(REGION_HISTORY, sizeof(struct SpikeHistory));
+	clctx->np->next = regionAlloc(REGION_NEURON, sizeof(struct Neuron));
+	clctx->np->next->next = NULL; clctx->np->next->ports_in = NULL;
+	clctx->np->next->ports_out = NULL;
+	clctx->np->next->history = regionAlloc(REGION_HISTORY, sizeof(struct SpikeHistory));
+	(clctx->np->gridcell = getGridCell(1,1))->neuron = clctx->np;
+	(clctx->np->next->gridcell = getGridCell(3,3))->neuron = clctx->np->next;
 
 	//synapse
-	struct Synapse *lsp = lindaMalloc(sizeof(struct Synapse));
-	lsp->pre_neuron = np;
-	lsp->post_neuron = np->next;
-	lsp->weight = e->default_weight;
-	lsp->delay = e->default_delay;
+	struct Synapse *lsp = regionAlloc(REGION_SYNAPSE, sizeof(struct Synapse));
+	lsp->pre_neuron = clctx->np;
+	lsp->post_neuron = clctx->np->next;
+	lsp->weight = clctx->e->default_weight;
+	lsp->delay = clctx->e->default_delay;
 
 	//ports
-	np->ports_out = lindaMalloc(sizeof(struct Port));
-	np->ports_out->next = NULL;
-	np->next->ports_in = lindaMalloc(sizeof(struct Port));
-	np->next->ports_in->next = NULL;
-	np->next->ports_in->synapse = np->ports_out->synapse = lsp;
-	np->current_port = np->ports_out;
-	np->next->current_port = np->next->ports_in;
+	struct Port *lpout = regionAlloc(REGION_PORT, sizeof(struct Port));
+	struct Port *lpin = regionAlloc(REGION_PORT, sizeof(struct Port));
+	lpin->synapse = lpout->synapse = lsp;
+	lpout->opposite = lpin;
+	lpin->opposite = lpout;
+	linkPort(clctx->np, lpout, PORT_OUT);
+	linkPort(clctx->np->next, lpin, PORT_IN);
+	clctx->np->current_port = clctx->np->ports_out;
+	clctx->np->next->current_port = clctx->np->next->ports_in;
 #ifdef WITH_CONSOLE
 	char text[64];
 	sprintf(text, "Created np->ports_out on [%i,%i]",
-			np->gridcell->position->x, np->gridcell->position->y);
+			clctx->np->gridcell->position.x, clctx->np->gridcell->position.y);
 	tprintf(LOG_DEBUG, __func__, text);
 	sprintf(text, "Created np->ports_in on [%i,%i]",
-			np->next->gridcell->position->x, np->next->gridcell->position->y);
+			clctx->np->next->gridcell->position.x, clctx->np->next->gridcell->position.y);
 	tprintf(LOG_DEBUG, __func__, text);
 #endif
 
 	testSynapsePortMapping();
 
 	//types
-	np->type = NEURONSIGN_EXCITATORY | INPUT_NEURON;
-	np->next->type = NEURONSIGN_EXCITATORY | OUTPUT_NEURON;
-	n = np;
+	clctx->np->type = NEURONSIGN_EXCITATORY | INPUT_NEURON;
+	clctx->np->next->type = NEURONSIGN_EXCITATORY | OUTPUT_NEURON;
+	clctx->n = clctx->np;
 	init_neuron();
 #ifdef WITH_GUI
-	visualizeCell(n->gridcell->position->x, n->gridcell->position->y, n->type);
+	visualizeCell(clctx->n->gridcell->position.x, clctx->n->gridcell->position.y, clctx->n->type);
 #endif
-	n = np->next;
+	clctx->n = clctx->np->next;
 	init_neuron();
 #ifdef WITH_GUI
-	visualizeCell(n->gridcell->position->x, n->gridcell->position->y, n->type);
+	visualizeCell(clctx->n->gridcell->position.x, clctx->n->gridcell->position.y, clctx->n->type);
 #endif
-	n = np;
+	clctx->n = clctx->np;
 
 
 }
@@ -177,22 +181,22 @@ void start_embryology() {
 #ifdef WITH_PRINT_DISTRIBUTION
 
 void initPrintDistribution() {
-	if (gconf == NULL) {
+	if (clctx->gconf == NULL) {
 		tprintf(LOG_ERR, __func__, "No gconf struct initialized!");
 		return;
 	}
-	distribution = calloc(gconf->phenotypicFactors, sizeof(uint16_t));
+	clctx->distribution = calloc(clctx->gconf->phenotypicFactors, sizeof(uint16_t));
 }
 
 void printDistribution(uint8_t verbosity) {
 	char *text;
-	text = malloc(gconf->phenotypicFactors * 5 + 128);
+	text = malloc(clctx->gconf->phenotypicFactors * 5 + 128);
 	//	char text[128*5]; 
 	sprintf(text, "Distribution: ");
 	uint8_t i;
-	for (i = 0; i < gconf->phenotypicFactors; i++) {
-		sprintf(text, "%s%03i", text, distribution[i]);
-		if (i != gconf->phenotypicFactors - 1) {
+	for (i = 0; i < clctx->gconf->phenotypicFactors; i++) {
+		sprintf(text, "%s%03i", text, clctx->distribution[i]);
+		if (i != clctx->gconf->phenotypicFactors - 1) {
 			sprintf(text, "%s, ", text);
 		}
 	}
@@ -202,6 +206,38 @@ void printDistribution(uint8_t verbosity) {
 
 #endif
 
+/**
+ * One step of development: the gene products are updated and diffused, and the morphological
+ * changes they code for are applied. Returns 0 when development is done, because the step
+ * budget is spent, or because the development is stable: the concentrations stopped changing
+ * or alternate between two states, without any morphological change, for stable_steps steps.
+ */
+uint8_t stepEmbryology() {
+	uint8_t cycle;
+	updateGridIn(clctx);
+	uint16_t changes = applyEmbryogenesisIn(clctx);
+	uint32_t changed = trackConcentrations(&cycle);
+	clctx->e->step++;
+	if (!changes && (!changed || cycle)) {
+		clctx->e->stable++;
+	} else {
+		clctx->e->stable = 0;
+	}
+	uint8_t result = (clctx->e->stable < clctx->e->stable_steps) &&
+			(clctx->e->step < clctx->e->step_budget);
+#ifdef WITH_RECORDER
+	if (developmentRecording) recordStep(!result);
+#endif
+	if (clctx->e->stable >= clctx->e->stable_steps) {
+#ifdef WITH_CONSOLE
+		char text[64]; sprintf(text, "Development %s after %i steps",
+				changed ? "alternates" : "is stationary", clctx->e->step);
+		tprintf(LOG_VERBOSE, __func__, text);
+#endif
+	}
+	return result;
+}
+
 /**
  * This routine is called by an iterator through the 2D environment, as soon as the retrieved gene
  * products exceed a threshold a morphological law is applied. Bongard et al. apply a rule when the
@@ -209,12 +245,15 @@ void printDistribution(uint8_t verbosity) {
  */
 void applyMorphologicalChange(uint8_t index) {	
 #ifdef WITH_PRINT_DISTRIBUTION
-	if (!distribution[index]) {
+	if (!clctx->distribution[index]) {
 		char text[64]; sprintf(text, "First time operation %i", index);
 		tprintf(LOG_VERBOSE, __func__, text);
 	}
-	distribution[index]++;
+	clctx->distribution[index]++;
 #else
+#endif
+#ifdef WITH_RECORDER
+	if (developmentRecording) recordOperation(index);
 #endif
 	switch (index)
 	{
@@ -236,7 +275,7 @@ void applyMorphologicalChange(uint8_t index) {
 	}
 #ifdef WITH_CONSOLE
 	uint8_t errorvalue = 0;
-	if (distribution[index] < 5) {
+	if (clctx->distribution[index] < 5) {
 		errorvalue += testNeurons();
 		errorvalue += testNeuronGrid();
 		errorvalue += testSynapseExistence();
@@ -245,7 +284,7 @@ void applyMorphologicalChange(uint8_t index) {
 	if (errorvalue) {
 		printNeurons(LOG_ALERT);
 		char textA[64]; sprintf(textA, "Error at operation %i with the %ith execution", 
-				index, distribution[index]);
+				index, clctx->distribution[index]);
 		tprintf(LOG_ALERT, __func__, textA);
 		errorvalue = 0;
 	}
@@ -273,49 +312,50 @@ void applyMorphologicalChange(uint8_t index) {
  * weights and delays are added to this new synapse.
  */
 void splitSparse() {
-	struct GridCell *newgc = np->gridcell->next;
+	struct GridCell *newgc = clctx->np->gridcell->next;
 	if (newgc->neuron != NULL) return; //next grid cell already occupied
-	if (!newgc->position->x) return; //don't warp around grid
+	if (!newgc->position.x) return; //don't warp around grid
 
 #ifdef WITH_CONSOLE
 	char text[64];
 	sprintf(text, "Apply split operation on cell [%i,%i]",
-			gc->position->x, gc->position->y);
+			clctx->gc->position.x, clctx->gc->position.y);
 	tprintf(LOG_VV, __func__, text);
 #endif
 	//create new neuron and link reciprocally to grid
-	struct Neuron *ln = lindaMalloc(sizeof(struct Neuron));
+	struct Neuron *ln = regionAlloc(REGION_NEURON, sizeof(struct Neuron));
 	ln->next = NULL; ln->ports_in = NULL; ln->ports_out = NULL;
-	ln->history = lindaMalloc(sizeof(struct SpikeHistory));
-	np->gridcell->next->neuron = ln;
-	ln->gridcell = np->gridcell->next;
+	ln->history = regionAlloc(REGION_HISTORY, sizeof(struct SpikeHistory));
+	clctx->np->gridcell->next->neuron = ln;
+	ln->gridcell = clctx->np->gridcell->next;
 
 	//copy neuron properties and initialize new neuron
-	ln->type = np->type;
-	n = ln;
+	ln->type = clctx->np->type;
+	clctx->n = ln;
 	init_neuron();
 
 	//move synapses and create new link between neurons
-	moveOutgoingSynapses(np, ln);
+	moveOutgoingSynapses(clctx->np, ln);
 
-	struct Synapse *ls = addSynapse(np, ln);
-	ls->delay = e->default_delay;
-	ls->weight = e->default_weight;
+	struct Synapse *ls = addSynapse(clctx->np, ln);
+	ls->delay = clctx->e->default_delay;
+	ls->weight = clctx->e->default_weight;
 
 	//update current ports
 	ln->current_port = ln->ports_in;
-	np->current_port = np->ports_out;
+	clctx->np->current_port = clctx->np->ports_out;
 
 #ifdef WITH_GUI
-	visualizeCell(n->gridcell->position->x, n->gridcell->position->y, n->type);   
+	visualizeCell(clctx->n->gridcell->position.x, clctx->n->gridcell->position.y,
+			clctx->n->type);   
 #endif
 
 	//jump back to neuron at neuron pointer
-	n = np;
+	clctx->n = clctx->np;
 
 	//add to linked list of neurons
-	struct Neuron *lnext = np->next;
-	np->next = ln;
+	struct Neuron *lnext = clctx->np->next;
+	clctx->np->next = ln;
 	ln->next = lnext;
 #ifdef WITH_TEST
 	uint8_t ncount = countNeurons();
@@ -332,20 +372,20 @@ void splitSparse() {
  * Bongard.
  */
 void splitFull() {
-	struct GridCell *newgc = np->gridcell->next;
+	struct GridCell *newgc = clctx->np->gridcell->next;
 	if (newgc->neuron != NULL) return; //next grid cell already occupied
-	if (!newgc->position->x) return; //don't warp around grid
+	if (!newgc->position.x) return; //don't warp around grid
 
 #ifdef WITH_CONSOLE
 	char text[64];
 	sprintf(text, "Apply copy operation on cell [%i,%i]",
-			gc->position->x, gc->position->y);
+			clctx->gc->position.x, clctx->gc->position.y);
 	tprintf(LOG_VV, __func__, text);
 #endif
 	//duplicate neuron and add reciprocally to grid
-	struct Neuron *ln = duplicateNeuron(np);
-	np->gridcell->next->neuron = ln;
-	ln->gridcell = np->gridcell->next;
+	struct Neuron *ln = duplicateNeuron(clctx->np);
+	clctx->np->gridcell->next->neuron = ln;
+	ln->gridcell = clctx->np->gridcell->next;
 
 	//update current port
 	ln->current_port = ln->ports_in;
@@ -360,8 +400,8 @@ void splitFull() {
 	//	ls->weight = e->default_weight;
 
 	//add to linked list of neurons
-	struct Neuron *lnext = np->next;
-	np->next = ln;
+	struct Neuron *lnext = clctx->np->next;
+	clctx->np->next = ln;
 	ln->next = lnext;
 #ifdef WITH_TEST
 	printNeuron(ln, LOG_VV);
@@ -377,29 +417,29 @@ void splitFull() {
  * Isolated neurons can be used to build a topographic map.
  */
 void splitIsolated() {
-	struct GridCell *newgc = np->gridcell->next;
+	struct GridCell *newgc = clctx->np->gridcell->next;
 	if (newgc->neuron != NULL) return; //next grid cell already occupied
-	if (!newgc->position->x) return; //don't warp around grid
+	if (!newgc->position.x) return; //don't warp around grid
 
 #ifdef WITH_CONSOLE
 	char text[64];
 	sprintf(text, "Apply isolated copy operation on cell [%i,%i]",
-			gc->position->x, gc->position->y);
+			clctx->gc->position.x, clctx->gc->position.y);
 	tprintf(LOG_VV, __func__, text);
 #endif
 
-	struct Neuron *ln = duplicateNeuron(np);
-	ln->next = np->next;
-	np->next = ln;
+	struct Neuron *ln = duplicateNeuron(clctx->np);
+	ln->next = clctx->np->next;
+	clctx->np->next = ln;
 
-	np->gridcell->next->neuron = ln;
-	ln->gridcell = np->gridcell->next;
+	clctx->np->gridcell->next->neuron = ln;
+	ln->gridcell = clctx->np->gridcell->next;
 	//	check this
 	//	ln->current_port = ln->ports_in;
 
 	//add to linked list of neurons
-	struct Neuron *lnext = np->next;
-	np->next = ln;
+	struct Neuron *lnext = clctx->np->next;
+	clctx->np->next = ln;
 	ln->next = lnext;
 
 }
@@ -411,92 +451,92 @@ void splitIsolated() {
  * either.
  */
 void moveNeuronNorth() {
-	struct GridCell *oldgc = np->gridcell;
-	int8_t y = oldgc->position->y - 1;
+	struct GridCell *oldgc = clctx->np->gridcell;
+	int8_t y = oldgc->position.y - 1;
 	if (y < 0) return;
-	int8_t x = oldgc->position->x;
+	int8_t x = oldgc->position.x;
 	struct GridCell *lgc = getGridCell(x,y);
 	if (lgc->neuron != NULL) return;
 #ifdef WITH_CONSOLE
 	char text[64];
 	sprintf(text, "Move neuron on cell [%i,%i] north",
-			gc->position->x, gc->position->y);
+			clctx->gc->position.x, clctx->gc->position.y);
 	tprintf(LOG_VV, __func__, text);
 #endif
-	lgc->neuron = np;
+	lgc->neuron = clctx->np;
 	oldgc->neuron = NULL;
-	np->gridcell = lgc;
+	clctx->np->gridcell = lgc;
 }
 
 void moveNeuronWest() {
-	struct GridCell *oldgc = np->gridcell;
-	int8_t x = oldgc->position->x - 1;
+	struct GridCell *oldgc = clctx->np->gridcell;
+	int8_t x = oldgc->position.x - 1;
 	if (x < 0) return;
-	int8_t y = oldgc->position->y;
+	int8_t y = oldgc->position.y;
 	struct GridCell *lgc = getGridCell(x,y);
 	if (lgc->neuron != NULL) return;
 #ifdef WITH_CONSOLE
 	char text[64];
 	sprintf(text, "Move neuron on cell [%i,%i] west",
-			gc->position->x, gc->position->y);
+			clctx->gc->position.x, clctx->gc->position.y);
 	tprintf(LOG_VV, __func__, text);
 #endif
-	lgc->neuron = np;
+	lgc->neuron = clctx->np;
 	oldgc->neuron = NULL;
-	np->gridcell = lgc;
+	clctx->np->gridcell = lgc;
 }
 
 void moveNeuronSouth() {
-	struct GridCell *oldgc = np->gridcell;
-	int8_t y = oldgc->position->y + 1;
-	if (y >= s->columns) return;
-	int8_t x = oldgc->position->x;
+	struct GridCell *oldgc = clctx->np->gridcell;
+	int8_t y = oldgc->position.y + 1;
+	if (y >= clctx->s->columns) return;
+	int8_t x = oldgc->position.x;
 	struct GridCell *lgc = getGridCell(x,y);
 	if (lgc->neuron != NULL) return;
 #ifdef WITH_CONSOLE
 	char text[64];
 	sprintf(text, "Move neuron on cell [%i,%i] south",
-			gc->position->x, gc->position->y);
+			clctx->gc->position.x, clctx->gc->position.y);
 	tprintf(LOG_VV, __func__, text);
 #endif
-	lgc->neuron = np;
+	lgc->neuron = clctx->np;
 	oldgc->neuron = NULL;
-	np->gridcell = lgc;
+	clctx->np->gridcell = lgc;
 }
 
 void moveNeuronEast() {
-	struct GridCell *oldgc = np->gridcell;
-	int8_t x = oldgc->position->x + 1;
-	if (x >= s->rows) return;
-	int8_t y = oldgc->position->y;
+	struct GridCell *oldgc = clctx->np->gridcell;
+	int8_t x = oldgc->position.x + 1;
+	if (x >= clctx->s->rows) return;
+	int8_t y = oldgc->position.y;
 	struct GridCell *lgc = getGridCell(x,y);
 	if (lgc->neuron != NULL) return;
 #ifdef WITH_CONSOLE
 	char text[64];
 	sprintf(text, "Move neuron on cell [%i,%i] east",
-			gc->position->x, gc->position->y);
+			clctx->gc->position.x, clctx->gc->position.y);
 	tprintf(LOG_VV, __func__, text);
 #endif
-	lgc->neuron = np;
+	lgc->neuron = clctx->np;
 	oldgc->neuron = NULL;
-	np->gridcell = lgc;
+	clctx->np->gridcell = lgc;
 }
 
 /**
  * Moves the current synapse to the neuron in the north, that is, if there is any neuron over there.
  */
 void moveSynapseNorth() {
-	if (np->current_port == NULL) return;
-	struct GridCell *oldgc = np->gridcell;
-	int8_t y = oldgc->position->y - 1;
+	if (clctx->np->current_port == NULL) return;
+	struct GridCell *oldgc = clctx->np->gridcell;
+	int8_t y = oldgc->position.y - 1;
 	if (y < 0) return;
-	int8_t x = oldgc->position->x;
+	int8_t x = oldgc->position.x;
 	struct GridCell *lgc = getGridCell(x,y);
 	if (lgc->neuron == NULL) return;
 #ifdef WITH_CONSOLE
 	char text[64];
 	sprintf(text, "Move synapse on cell [%i,%i] north",
-			gc->position->x, gc->position->y);
+			clctx->gc->position.x, clctx->gc->position.y);
 	tprintf(LOG_VV, __func__, text);
 #endif
 	//	portSynapse(np, lgc->neuron, np->current_port);
@@ -504,34 +544,34 @@ void moveSynapseNorth() {
 }
 
 void moveSynapseWest() {
-	if (np->current_port == NULL) return;
-	struct GridCell *oldgc = np->gridcell;
-	int8_t x = oldgc->position->x - 1;
+	if (clctx->np->current_port == NULL) return;
+	struct GridCell *oldgc = clctx->np->gridcell;
+	int8_t x = oldgc->position.x - 1;
 	if (x < 0) return;
-	int8_t y = oldgc->position->y;
+	int8_t y = oldgc->position.y;
 	struct GridCell *lgc = getGridCell(x,y);
 	if (lgc->neuron == NULL) return;
 #ifdef WITH_CONSOLE
 	char text[64];
 	sprintf(text, "Move synapse on cell [%i,%i] west",
-			gc->position->x, gc->position->y);
+			clctx->gc->position.x, clctx->gc->position.y);
 	tprintf(LOG_VERBOSE, __func__, text);
 #endif
 	portCurrentSynapse(lgc->neuron);
 }
 
 void moveSynapseSouth() {
-	if (np->current_port == NULL) return;
-	struct GridCell *oldgc = np->gridcell;
-	int8_t y = oldgc->position->y + 1;
-	if (y >= s->columns) return;
-	int8_t x = oldgc->position->x;
+	if (clctx->np->current_port == NULL) return;
+	struct GridCell *oldgc = clctx->np->gridcell;
+	int8_t y = oldgc->position.y + 1;
+	if (y >= clctx->s->columns) return;
+	int8_t x = oldgc->position.x;
 	struct GridCell *lgc = getGridCell(x,y);
 	if (lgc->neuron == NULL) return;
 #ifdef WITH_CONSOLE
 	char text[64];
 	sprintf(text, "Move synapse on cell [%i,%i] south",
-			gc->position->x, gc->position->y);
+			clctx->gc->position.x, clctx->gc->position.y);
 	tprintf(LOG_VV, __func__, text);
 #endif
 	//	portSynapse(np, lgc->neuron, np->current_port);
@@ -539,17 +579,17 @@ void moveSynapseSouth() {
 }
 
 void moveSynapseEast() {
-	if (np->current_port == NULL) return;
-	struct GridCell *oldgc = np->gridcell;
-	int8_t x = oldgc->position->x + 1;
-	if (x >= s->rows) return;
-	int8_t y = oldgc->position->y;
+	if (clctx->np->current_port == NULL) return;
+	struct GridCell *oldgc = clctx->np->gridcell;
+	int8_t x = oldgc->position.x + 1;
+	if (x >= clctx->s->rows) return;
+	int8_t y = oldgc->position.y;
 	struct GridCell *lgc = getGridCell(x,y);
 	if (lgc->neuron == NULL) return;
 #ifdef WITH_CONSOLE
 	char text[64];
 	sprintf(text, "Move synapse on cell [%i,%i] east",
-			gc->position->x, gc->position->y);
+			clctx->gc->position.x, clctx->gc->position.y);
 	tprintf(LOG_VV, __func__, text);
 #endif
 	//	portSynapse(np, lgc->neuron, np->current_port);
@@ -561,31 +601,30 @@ void moveSynapseEast() {
  * "current" synapse pointer per neuron.
  */
 void nextSynapse() {
-	if (np->current_port == NULL) return;
+	if (clctx->np->current_port == NULL) return;
 #ifdef WITH_CONSOLE
 	char text[64];
 	sprintf(text, "Move to next synapse on cell [%i,%i]",
-			gc->position->x, gc->position->y);
+			clctx->gc->position.x, clctx->gc->position.y);
 	tprintf(LOG_VV, __func__, text);
 #endif
 
-	if (np->current_port->next != NULL) {
-		np->current_port = np->current_port->next;
+	if (clctx->np->current_port->next != NULL) {
+		clctx->np->current_port = clctx->np->current_port->next;
 		return;
 	}
 
-	uint8_t flags = getPortContext(np, np->current_port);
-	if (RAISED(flags, 1)) {
-		if (np->ports_out != NULL) {
-			np->current_port = np->ports_out;
+	if (clctx->np->current_port->direction == PORT_IN) {
+		if (clctx->np->ports_out != NULL) {
+			clctx->np->current_port = clctx->np->ports_out;
 		} else {
-			np->current_port = np->ports_in;
+			clctx->np->current_port = clctx->np->ports_in;
 		}
 	} else {
-		if (np->ports_in != NULL) {
-			np->current_port = np->ports_in;
+		if (clctx->np->ports_in != NULL) {
+			clctx->np->current_port = clctx->np->ports_in;
 		} else {
-			np->current_port = np->ports_out;
+			clctx->np->current_port = clctx->np->ports_out;
 		}
 	}
 }
@@ -597,15 +636,15 @@ void nextSynapse() {
  * beyond 255.
  */
 void incrementWeight() {
-	if (np->current_port == NULL) return;
+	if (clctx->np->current_port == NULL) return;
 	//is float sp->w += (10 % (0xFF - sp->w));
 #ifdef WITH_CONSOLE
 	char text[64];
 	sprintf(text, "Increment weight of current synapse on neuron @[%i,%i]",
-			gc->position->x, gc->position->y);
+			clctx->gc->position.x, clctx->gc->position.y);
 	tprintf(LOG_VVV, __func__, text);
 #endif
-	struct Synapse *ls = np->current_port->synapse;
+	struct Synapse *ls = clctx->np->current_port->synapse;
 	ls->weight += 1.0; //-= (10 % sp->w);
 	if (ls->weight > 10.0) {
 		ls->weight = 10.0;
@@ -617,14 +656,14 @@ void incrementWeight() {
  * certain ranges.
  */
 void decrementWeight() {
-	if (np->current_port == NULL) return;
+	if (clctx->np->current_port == NULL) return;
 #ifdef WITH_CONSOLE
 	char text[64];
 	sprintf(text, "Decrement weight of current synapse on neuron @[%i,%i]",
-			gc->position->x, gc->position->y);
+			clctx->gc->position.x, clctx->gc->position.y);
 	tprintf(LOG_VV, __func__, text);
 #endif
-	struct Synapse *ls = np->current_port->synapse;
+	struct Synapse *ls = clctx->np->current_port->synapse;
 	ls->weight -= 1.0; //-= (10 % sp->w);
 	if (ls->weight < -10.0) {
 		ls->weight = -10.0;
@@ -634,10 +673,11 @@ void decrementWeight() {
 uint8_t somecounter = 0;
 
 /**
- * This routine called by removeSynapse. It uses the 
+ * This routine called by removeSynapse. It unlinks the current port and the opposite port on
+ * the other neuron, and frees them with their synapse. The current port becomes the next one.
  */
 void removeCurrentSynapse() {
-	struct Port *lp = np->current_port, *lnew = NULL;
+	struct Port *lp = clctx->np->current_port;
 	if (lp == NULL) {
 #ifdef WITH_CONSOLE
 		tprintf(LOG_ERR, __func__, "No current port!");
@@ -645,106 +685,41 @@ void removeCurrentSynapse() {
 		return;
 	}
 	struct Synapse *ls = lp->synapse;
-	if (ls == NULL) {
-#ifdef WITH_CONSOLE
-		tprintf(LOG_ERR, __func__, "Port has no synapse. Error before!");
-#endif
-		//	return;
-	}
-
-#ifdef WITH_CONSOLE
-	tprintf(LOG_VVV, __func__, "Update port list on this side");
-#endif
-	struct Port *lprev = getPreviousPort(np, lp);
-	uint8_t flags = getPortContext(np, lp);
-	if (lprev != NULL) {
-		lnew = (lprev->next = lp->next);
-	} else {
-		if (RAISED(flags, 1)) {
-			lnew = (np->ports_in = lp->next);
-		} else {
-			lnew = (np->ports_out = lp->next);
-		}
-	}
-
-	np->current_port = lnew; //might be NULL
-#ifdef WITH_CONSOLE
-	tprintf(LOG_VVV, __func__, "Update port list on opposite side");
-#endif
-	struct Port *lpother = getOpposite(np, lp, flags);
-
-	if (lpother == NULL) {
+	struct Port *lpother = lp->opposite;
+	if ((ls == NULL) || (lpother == NULL)) {
 #ifdef WITH_CONSOLE
-		if (isPrinted(LOG_VV)) {
-			char textA[128];
-			sprintf(textA, "Command getOpposite(np, lp, %i)", flags);
-			tprintf(LOG_VERBOSE, __func__, textA);
-			uint8_t ncount = countNeurons();
-			sprintf(textA, "Amount of neurons: %i.", ncount);
-			tprintf(LOG_VERBOSE, __func__, textA);
-			printNeuron(np, LOG_EMERG);
-			tprintf(LOG_EMERG, __func__, "Should never occur!");
-		}
+		tprintf(LOG_EMERG, __func__, "Port has no synapse or opposite port. Should never occur!");
 #endif
 		return;
 	}
-#ifdef WITH_CONSOLE
-	tprintf(LOG_VVV, __func__, "Update port list on opposite side");
-#endif
 
-	struct Neuron *lnother;
-	if (RAISED(flags, 1)) {
-#ifdef WITH_CONSOLE
-		tprintf(LOG_VV, __func__, "Other side (while this one is an in-port)");
-#endif
-		lnother = ls->pre_neuron;
-		printNeuron(lnother, LOG_VV);
-		struct Port *lprevother = getPreviousPort(lnother, lpother);
-		if (lprevother != NULL) {
-			lprevother->next = lpother->next;
-		} else {
-			lnother->ports_out = lpother->next;
-		}
-	} else {
-#ifdef WITH_CONSOLE
-		tprintf(LOG_VV, __func__, "Other side (while this one is an out-port)");
-#endif
-		lnother = ls->post_neuron;
-		struct Port *lprevother = getPreviousPort(lnother, lpother);
-		if (lprevother != NULL) {
-			lprevother->next = lpother->next;
-		} else {
-			tprintf(LOG_VV, __func__, "There is no previous port");
-			//			if (lp->next)
-			lnother->ports_in = lpother->next;
-		}
-	}
+	clctx->np->current_port = lp->next; //might be NULL
+	unlinkPort(clctx->np, lp);
 
+	struct Neuron *lnother = (lp->direction == PORT_IN) ? ls->pre_neuron : ls->post_neuron;
+	unlinkPort(lnother, lpother);
 	if (lnother->current_port == lpother) { 
 #ifdef WITH_CONSOLE
 		if (lpother->next == NULL)
 			tprintf(LOG_VV, __func__, "Current port on other side becomes NULL");
-		printNeuron(lnother, LOG_VV);
 #endif
 		lnother->current_port = lpother->next;
-		printNeuron(lnother, LOG_VVVV);
 	}
-	free(lpother);
-	free(lp);
-	free(ls);
+	regionFree(REGION_PORT, lpother);
+	regionFree(REGION_PORT, lp);
+	regionFree(REGION_SYNAPSE, ls);
 }
 
 /**
- * Remove synapse on the current neuron.
- *
- * Complexity O(S) with S the amount of synapses. This is because no double linked list is used.
+ * Remove synapse on the current neuron, in constant time, because the ports are doubly linked
+ * and know their opposite.
  */
 void removeSynapse() {
-	struct Port *lp = np->current_port;
+	struct Port *lp = clctx->np->current_port;
 	if (lp == NULL) return;
 #ifdef WITH_CONSOLE
 	char text[64];
-	sprintf(text, "Remove synapse @[%i,%i]", gc->position->x, gc->position->y);
+	sprintf(text, "Remove synapse @[%i,%i]", clctx->gc->position.x, clctx->gc->position.y);
 	tprintf(LOG_VV, __func__, text);
 #endif
 	removeCurrentSynapse();
@@ -758,38 +733,37 @@ void removeNeuron() {
 	//	printNeuron(np);
 #ifdef WITH_CONSOLE
 	char text[64];
-	sprintf(text, "Remove neuron @[%i,%i]", gc->position->x, gc->position->y);
+	sprintf(text, "Remove neuron @[%i,%i]", clctx->gc->position.x, clctx->gc->position.y);
 	tprintf(LOG_VV, __func__, text);
 #endif
 	struct Port *lpnext;
-	np->current_port = np->ports_in;
-	while (np->current_port != NULL) {
-		lpnext = np->current_port->next;
+	clctx->np->current_port = clctx->np->ports_in;
+	while (clctx->np->current_port != NULL) {
+		lpnext = clctx->np->current_port->next;
 		removeCurrentSynapse();
-		np->current_port = lpnext;
+		clctx->np->current_port = lpnext;
 	}
 
-	np->current_port = np->ports_out;
-	while (np->current_port != NULL) {
-		lpnext = np->current_port->next;
+	clctx->np->current_port = clctx->np->ports_out;
+	while (clctx->np->current_port != NULL) {
+		lpnext = clctx->np->current_port->next;
 		removeCurrentSynapse();
-		np->current_port = lpnext;
+		clctx->np->current_port = lpnext;
 	}
 
-	if (np->history != NULL)
-		free(np->history);
+	regionFree(REGION_HISTORY, clctx->np->history);
 
 #ifdef WITH_CONSOLE
 	tprintf(LOG_VVV, __func__, "Remove neuron from list");
 #endif
-	struct Neuron *ln = np->next;
-	struct Neuron *lnprev = nn->neurons;
-	if (lnprev == np) {
-		nn->neurons = ln;
+	struct Neuron *ln = clctx->np->next;
+	struct Neuron *lnprev = clctx->nn->neurons;
+	if (lnprev == clctx->np) {
+		clctx->nn->neurons = ln;
 		lnprev = NULL;
 	} else {
 		while (lnprev != NULL) {
-			if (lnprev->next == np) {
+			if (lnprev->next == clctx->np) {
 #ifdef WITH_CONSOLE
 				tprintf(LOG_VVVVV, __func__, "Found previous neuron");
 #endif			
@@ -810,13 +784,13 @@ void removeNeuron() {
 	} 
 
 	//remove gridcell reference
-	np->gridcell->neuron = NULL;
+	clctx->np->gridcell->neuron = NULL;
 
 	//free memory
-	free(np);
+	regionFree(REGION_NEURON, clctx->np);
 
 	//update to next neuron, if there is any
-	np = ln;
+	clctx->np = ln;
 
 #ifdef WITH_TEST
 	uint8_t ncount = countNeurons();
@@ -829,17 +803,17 @@ void changeType () {
 #ifdef WITH_CONSOLE
 	//	tprintf(LOG_VERBOSE, __func__, "Next type");
 #endif
-	n = np;
+	clctx->n = clctx->np;
 	next_type();
 }
 
 void changeSign() {
-	n = np;
+	clctx->n = clctx->np;
 	next_sign();
 }
 
 void changeTopologicalType() {
-	n = np;
+	clctx->n = clctx->np;
 	next_topological_type();
 }
 
@@ -851,7 +825,7 @@ void changeTopologicalType() {
  * Counts the amount of neurons. For testing purposes.
  */
 uint16_t countNeurons() {
-	struct Neuron *lnp = nn->neurons; uint16_t i = 0;
+	struct Neuron *lnp = clctx->nn->neurons; uint16_t i = 0;
 	while (lnp != NULL) {
 		i++;
 		lnp = lnp->next;
@@ -861,14 +835,14 @@ uint16_t countNeurons() {
 
 uint8_t testNeuronGrid() {
 	testNeurons();
-	struct Neuron *lnp = nn->neurons;
+	struct Neuron *lnp = clctx->nn->neurons;
 	while (lnp != NULL) { 
 		if (lnp->gridcell == NULL) {
 			tprintf(LOG_ALERT, __func__, "No gridcell attached!!");
 		} else if (lnp->gridcell->neuron != lnp) {
 			char text[128]; 
 			sprintf(text, "Neuron and gridcell [%i,%i] are not interlinked!", 
-					lnp->gridcell->position->x, lnp->gridcell->position->y);
+					lnp->gridcell->position.x, lnp->gridcell->position.y);
 			tprintf(LOG_ALERT, __func__, text);
 			return 1;
 		}
@@ -881,11 +855,11 @@ uint8_t testNeuronGrid() {
  * Test if the list of neurons is not by accident circular, which might lead to infinite loops.
  */
 uint8_t testNeurons() {
-	struct Neuron *lnp = nn->neurons;
+	struct Neuron *lnp = clctx->nn->neurons;
 	if (lnp == NULL) return 0;
 	do {
 		lnp = lnp->next;
-		if (lnp == nn->neurons) {
+		if (lnp == clctx->nn->neurons) {
 			tprintf(LOG_ALERT, __func__, "Neurons form a circular list: Danger of infinite loop!");
 			return 1;
 		}
@@ -898,7 +872,7 @@ uint8_t testNeurons() {
  * is actually attached to a synapse.
  */
 uint8_t testSynapseExistence() {
-	struct Neuron *lnp = nn->neurons; 
+	struct Neuron *lnp = clctx->nn->neurons; 
 	while (lnp != NULL) {
 		struct Port *lpp = lnp->ports_in;
 		while (lpp != NULL) {
@@ -908,7 +882,7 @@ uint8_t testSynapseExistence() {
 					tprintf(LOG_ALERT, __func__, "No gridcell attached!!");
 				char text[128]; 
 				sprintf(text, "This is at neuron at gridcell [%i,%i]", 
-						lnp->gridcell->position->x, lnp->gridcell->position->y);
+						lnp->gridcell->position.x, lnp->gridcell->position.y);
 				return 1;
 			}
 			lpp = lpp->next;
@@ -921,7 +895,7 @@ uint8_t testSynapseExistence() {
 					tprintf(LOG_ALERT, __func__, "No gridcell attached!!");
 				char text[128]; 
 				sprintf(text, "This is at neuron at gridcell [%i,%i]", 
-						lnp->gridcell->position->x, lnp->gridcell->position->y);
+						lnp->gridcell->position.x, lnp->gridcell->position.y);
 				return 1;
 			}
 			lpp = lpp->next;
@@ -936,7 +910,7 @@ uint8_t testSynapseExistence() {
  * neuron. 
  */
 uint8_t testSynapsePortMapping() {
-	struct Neuron *lnp = nn->neurons; 
+	struct Neuron *lnp = clctx->nn->neurons; 
 	while (lnp != NULL) {
 		struct Port *lpp = lnp->ports_in;
 		struct Port *test;
@@ -945,7 +919,7 @@ uint8_t testSynapsePortMapping() {
 			if (test == NULL) {
 				char text[64]; 
 				sprintf(text, "Of neuron [%i,%i]", 
-						lnp->gridcell->position->x, lnp->gridcell->position->y);
+						lnp->gridcell->position.x, lnp->gridcell->position.y);
 				tprintf(LOG_ALERT, __func__, text);
 				return 1;
 			}
@@ -957,7 +931,7 @@ uint8_t testSynapsePortMapping() {
 			if (test == NULL) {
 				char text[64]; 
 				sprintf(text, "Of neuron [%i,%i]", 
-						lnp->gridcell->position->x, lnp->gridcell->position->y);
+						lnp->gridcell->position.x, lnp->gridcell->position.y);
 				tprintf(LOG_ALERT, __func__, text);
 				return 1;
 			}
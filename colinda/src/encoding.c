@@ -0,0 +1,188 @@
+/**
+ * @file encoding.c
+ *
+ * The spikes are gathered in an array on the stack and written in the buffer SPIKE_BULK at a
+ * time. Before the spikes of a channel are gathered it is checked that they fit, so a channel
+ * is encoded entirely or not at all. The rank order is found by counting the channels of
+ * every strength, so it takes one pass over the channels and one over the strengths, without
+ * sorting.
+ *
+ * @date_created    Oct 14, 2026
+ * @date_modified   Oct 14, 2026
+ * @author          Anne C. van Rossum
+ * @project         Replicator
+ * @company         Almende B.V.
+ * @license         open-source, GNU Lesser General Public License
+ */
+
+#include <lindaconfig.h>
+#include <encoding.h>
+#include <sensorimotor.h>
+#include <grid.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef WITH_SYMBRICATOR
+#include "portable.h"
+#else
+#include <time.h>
+#endif
+
+/****************************************************************************************************
+ *  		Declarations
+ ***************************************************************************************************/
+
+static struct SpikeEncoder *spikeEncoder = NULL;
+//! The contexts on the monks configure the encoder once between them
+static pthread_mutex_t spikeEncoderMutex = PTHREAD_MUTEX_INITIALIZER;
+
+struct SpikeBatch {
+	union AER aer[SPIKE_BULK];
+	uint16_t count;
+	struct AERBuffer *buffer;
+};
+
+/****************************************************************************************************
+ *  		Implementations
+ ***************************************************************************************************/
+
+/**
+ * The strengths of the infrared sensors, as the amount of spikes generateSpikes gave before:
+ * 10 for a value below 5, down to 2 below 70, and none from 70 on.
+ */
+struct SpikeEncoder *newSpikeEncoder(uint8_t coding) {
+	static const uint8_t bounds[] = { 5, 10, 15, 20, 30, 40, 50, 60, 70 };
+	struct SpikeEncoder *encoder = lindaMalloc(sizeof(struct SpikeEncoder));
+	uint16_t value;
+	uint8_t k = 0;
+	encoder->coding = coding;
+	encoder->columns = 0;
+	encoder->population = 4;
+	encoder->window = 20;
+	encoder->max_strength = 10;
+	for (value = 0; value < 256; value++) {
+		while ((k < sizeof(bounds)) && (value >= bounds[k])) k++;
+		encoder->strength[value] = (k < sizeof(bounds)) ? 10 - k : 0;
+	}
+	return encoder;
+}
+
+static void addSpike(struct SpikeBatch *batch, uint16_t cell, uint8_t columns, uint16_t tick) {
+	union AER *aer = &batch->aer[batch->count++];
+	aer->coordinate.x = cell % columns;
+	aer->coordinate.y = cell / columns;
+	aer->event = tick;
+	if (batch->count == SPIKE_BULK) {
+		pushAERs(batch->buffer, batch->aer, batch->count);
+		batch->count = 0;
+	}
+}
+
+/**
+ * Whether another amount of spikes fits in the buffer, with the ones in the batch.
+ */
+static uint8_t fits(struct SpikeBatch *batch, uint16_t amount) {
+	return batch->buffer->mask - sizeAER(batch->buffer) >= batch->count + amount;
+}
+
+uint16_t encodeSpikes(struct SpikeEncoder *encoder, const uint8_t *input, uint16_t size,
+		uint16_t tick, struct AERBuffer *aerbuffer) {
+	struct SpikeBatch batch;
+	uint8_t columns = encoder->columns;
+	uint16_t c, j, encoded = 0;
+	batch.count = 0;
+	batch.buffer = aerbuffer;
+	if (!columns) columns = (clctx->s != NULL) ? clctx->s->columns : 5;
+
+	switch (encoder->coding) {
+	case SPIKE_RATE:
+		for (c = 0; c < size; c++) {
+			uint8_t amount = encoder->strength[input[c]];
+			if (!fits(&batch, amount)) break;
+			for (j = 0; j < amount; j++) {
+				addSpike(&batch, c, columns, tick + (j * encoder->window) / amount);
+			}
+			encoded++;
+		}
+		break;
+	case SPIKE_LATENCY: {
+		uint16_t stronger[256], order[size];
+		memset(stronger, 0, sizeof(stronger));
+		for (c = 0; c < size; c++) stronger[encoder->strength[input[c]]]++;
+		//the amount of channels that are stronger than every strength, and where they go
+		uint16_t total = 0;
+		for (j = 256; j-- > 0;) {
+			uint16_t amount = stronger[j];
+			stronger[j] = total;
+			total += amount;
+		}
+		uint16_t next[256];
+		memcpy(next, stronger, sizeof(next));
+		for (c = 0; c < size; c++) order[next[encoder->strength[input[c]]]++] = c;
+		for (j = 0; j < size; j++) {
+			c = order[j];
+			uint8_t strength = encoder->strength[input[c]];
+			if (!strength) {
+				encoded += size - j;
+				break;
+			}
+			if (!fits(&batch, 1)) break;
+			addSpike(&batch, c, columns, tick + stronger[strength]);
+			encoded++;
+		}
+		break;
+	}
+	case SPIKE_POPULATION:
+		for (c = 0; c < size; c++) {
+			if (!fits(&batch, 1)) break;
+			uint16_t cell = encoder->strength[input[c]] * encoder->population /
+					(encoder->max_strength + 1);
+			if (cell >= encoder->population) cell = encoder->population - 1;
+			addSpike(&batch, c * encoder->population + cell, columns, tick);
+			encoded++;
+		}
+		break;
+	}
+	if (batch.count) pushAERs(aerbuffer, batch.aer, batch.count);
+	return encoded;
+}
+
+/**
+ * The default encoder, with the coding of LINDA_SPIKE_CODING and otherwise rate coding.
+ */
+static struct SpikeEncoder *configSpikeEncoder() {
+	uint8_t coding = SPIKE_RATE;
+#ifndef WITH_SYMBRICATOR
+	const char *text = getenv("LINDA_SPIKE_CODING");
+	if (text != NULL) {
+		if (!strcmp(text, "latency")) coding = SPIKE_LATENCY;
+		else if (!strcmp(text, "population")) coding = SPIKE_POPULATION;
+	}
+#endif
+	return newSpikeEncoder(coding);
+}
+
+struct SpikeEncoder *getSpikeEncoder() {
+	pthread_mutex_lock(&spikeEncoderMutex);
+	if (spikeEncoder == NULL) spikeEncoder = configSpikeEncoder();
+	pthread_mutex_unlock(&spikeEncoderMutex);
+	return spikeEncoder;
+}
+
+void setSpikeEncoder(struct SpikeEncoder *encoder) {
+	if (spikeEncoder != NULL) free(spikeEncoder);
+	spikeEncoder = encoder;
+}
+
+uint16_t getSpikeTick() {
+#ifdef WITH_SYMBRICATOR
+	static uint16_t tick = 0;
+	return tick++;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint16_t)(((unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec) /
+			SPIKE_TICK_NS);
+#endif
+}
@@ -8,13 +8,32 @@
 #include <lindaconfig.h>
 
 #include <grid.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WITH_SYMBRICATOR
+#include "portable.h"
+#endif
 
 #ifdef WITH_CONSOLE
 #include <stdio.h>
 #include <linda/log.h>
-#include <string.h>
 #endif
 
+/**
+ * With gcc the genome is scanned for start codons in vectors of 16 codons, which become SSE or
+ * NEON instructions when the target has them. A codon c is a multiple of 10 when it equals
+ * 10 * ((c * 205) >> 11), which is c / 10 for all values of a codon, without a division.
+ */
+#if defined(WITH_GENE_VECTORS) && defined(__GNUC__) && (__GNUC__ >= 9)
+#define GENE_VECTORS
+#define GENE_LANES		16
+typedef uint8_t vcodon __attribute__((vector_size(GENE_LANES)));
+typedef uint16_t vword __attribute__((vector_size(GENE_LANES * sizeof(uint16_t))));
+#endif
+
+#define NO_GENE			0xFFFF
+
 /**
  * Only floating point values for Ribosome's are used, they are truncated to 2D locations for
  * production locations and to gene product indices. It is assumed that a robot can grow on 6 dockable
@@ -52,9 +71,9 @@
  * does not matter.
  */
 void configGenome() {
-	gconf = lindaMalloc(sizeof(struct GenomeConfig));
-	gconf->regulatingFactors = 11;
-	gconf->phenotypicFactors = 14;
+	clctx->gconf = lindaMalloc(sizeof(struct GenomeConfig));
+	clctx->gconf->regulatingFactors = 11;
+	clctx->gconf->phenotypicFactors = 14;
 }
 
 /**
@@ -64,36 +83,39 @@ void configGenome() {
  * all the other deallocation routines. Most modules are also initialized over there. 
  */
 void freeGenome() {
-	free(gconf);
+	free(clctx->gconf);
 }
 
 /**
  * Deallocates all the genes that are extracted. It is assumed that the genes are having a
- * copy of the genome string, and hence the codons are deallocated too. 
+ * copy of the genome string, and hence the codons are deallocated too, with the blocks they
+ * are allocated in.
  */
 void freeGenes() {
-	struct Gene *lg, *lnext;
-	if (eg == NULL) {
+	struct GeneBlock *lb, *lnext;
+	if (clctx->eg == NULL) {
 #ifdef WITH_CONSOLE
 		tprintf(LOG_ALERT, __func__, "No extracted genes struct!");
 #endif
 		return;
 	}
-	if (eg->genes == NULL) {
+	for (lb = clctx->eg->blocks; lb != NULL; lb = lnext) {
+		lnext = lb->next;
+		free(lb);
+	}
+	clctx->eg->blocks = NULL;
+	clctx->g = NULL;
+	if (clctx->eg->genes == NULL) {
 #ifdef WITH_CONSOLE
 		tprintf(LOG_ALERT, __func__, "No extracted genes!");
 #endif
 		return;
 	}
-	
-	lg = eg->genes;
-	while (lg != NULL) {
-		lnext = lg->next;
-		free(lg->codons);
-		free(lg);
-		lg = lnext;
-	}
-	eg->gene_count = 0;
+	clctx->eg->genes = NULL;
+	clctx->eg->gene_count = 0;
+	free(clctx->eg->rules);
+	clctx->eg->rules = NULL;
+	clctx->eg->rule_count = 0;
 }
 
 #ifdef WITH_TIME
@@ -103,12 +125,12 @@ void freeGenes() {
  * that is aboard every operating system and the calloc system call.
  */
 void generateGenome() {
-	dna = lindaMalloc(sizeof(struct Genome));
-	dna->content = lindaCalloc(gconf->genomeSize, sizeof(Codon));
+	clctx->dna = lindaMalloc(sizeof(struct Genome));
+	clctx->dna->content = lindaCalloc(clctx->gconf->genomeSize, sizeof(Codon));
 	srand(time(NULL));
 	uint16_t i;
-	for (i = 0; i < gconf->genomeSize; i++) {
-		dna->content[i] = rand();
+	for (i = 0; i < clctx->gconf->genomeSize; i++) {
+		clctx->dna->content[i] = rand();
 	}
 }
 #else
@@ -122,7 +144,7 @@ void generateGenome() {
  * small parts of a binary instead of the entire binary at one. 
  */
 void receiveNewGenome() {
-	dna = lindaMalloc(sizeof(struct Genome));
+	clctx->dna = lindaMalloc(sizeof(struct Genome));
 }
 
 #endif
@@ -140,6 +162,86 @@ void printCodonGene(union CodonGene *codon, uint8_t verbosity) {
 	tprintf(verbosity, __func__, textV);
 }
 
+/**
+ * Raises a bit in the bitmap for every codon that is a start codon, the first count codons.
+ */
+static void scanStartCodons(const Codon *content, uint16_t count, uint64_t *bitmap) {
+	uint16_t i = 0, w;
+	for (w = 0; w < (count + 63) / 64; w++) {
+		bitmap[w] = 0;
+	}
+#ifdef GENE_VECTORS
+	const vword weights = { 0x0001, 0x0002, 0x0004, 0x0008, 0x0010, 0x0020, 0x0040, 0x0080,
+			0x0100, 0x0200, 0x0400, 0x0800, 0x1000, 0x2000, 0x4000, 0x8000 };
+	for (; i + GENE_LANES <= count; i += GENE_LANES) {
+		vcodon lc;
+		__builtin_memcpy(&lc, content + i, sizeof(lc));
+		vword x = __builtin_convertvector(lc, vword);
+		vword hits = (vword)(x == ((x * 205) >> 11) * 10) & weights;
+		uint16_t bits = 0, l;
+		for (l = 0; l < GENE_LANES; l++) bits |= hits[l];
+		bitmap[i >> 6] |= (uint64_t)bits << (i & 63);
+	}
+#endif
+	for (; i < count; i++) {
+		if (!(content[i] % 10)) bitmap[i >> 6] |= 1ULL << (i & 63);
+	}
+}
+
+/**
+ * The first start codon in the bitmap from the given position, up to and including last.
+ */
+static uint16_t nextStartCodon(const uint64_t *bitmap, uint16_t from, uint16_t last) {
+	uint16_t w = from >> 6;
+	uint64_t bits = bitmap[w] & (~0ULL << (from & 63));
+	while (!bits) {
+		if (++w > (last >> 6)) return NO_GENE;
+		bits = bitmap[w];
+	}
+	uint16_t i = (w << 6) + __builtin_ctzll(bits);
+	return (i <= last) ? i : NO_GENE;
+}
+
+/**
+ * Extracts the genes that start at one of the codons 0 up to and including last, and adds
+ * them to the list after g. A gene is 8 codons, and the next gene is searched for after the
+ * last codon of a gene. First the start codons are put in a bitmap, then the genes that
+ * result from it are counted, and allocated in one block, and then copied into it. Returns
+ * the first codon after the last gene, or after last.
+ */
+static uint16_t extractGeneRange(const Codon *content, uint16_t last) {
+	uint64_t *bitmap = lindaMalloc(((last >> 6) + 1) * sizeof(uint64_t));
+	uint16_t i, count = 0, k, end = last + 1;
+	scanStartCodons(content, last + 1, bitmap);
+	for (i = nextStartCodon(bitmap, 0, last); i != NO_GENE; i = nextStartCodon(bitmap, i, last)) {
+		count++;
+		i += 8;
+		if (i > last) break;
+	}
+	if (count) {
+		struct GeneBlock *lb = lindaMalloc(sizeof(struct GeneBlock) + count *
+				(sizeof(struct Gene) + sizeof(union CodonGene)));
+		lb->genes = (struct Gene*)(lb + 1);
+		lb->codons = (union CodonGene*)(lb->genes + count);
+		lb->next = clctx->eg->blocks;
+		clctx->eg->blocks = lb;
+		for (i = nextStartCodon(bitmap, 0, last), k = 0; k < count; k++) {
+			struct Gene *lg = &lb->genes[k];
+			lg->codons = &lb->codons[k];
+			memcpy(lg->codons->content, content + i, 8);
+			lg->next = NULL;
+			if (clctx->g == NULL) clctx->eg->genes = lg;
+			else clctx->g->next = lg;
+			clctx->g = lg;
+			i += 8;
+			if (i > end) end = i;
+			if (i <= last) i = nextStartCodon(bitmap, i, last);
+		}
+	}
+	free(bitmap);
+	return end;
+}
+
 #ifdef WITH_TEST
 /**
  * In the Genome there are regions that code for genes and regions that do not. Not each time the
@@ -149,72 +251,43 @@ void printCodonGene(union CodonGene *codon, uint8_t verbosity) {
  * extracted genes to the robot.
  */
 void extractGenes(uint16_t genomeSize) {
-	g = NULL; //should already be NULL if there are never genes extracted before
-	uint16_t i = 0;
-	eg = lindaMalloc(sizeof(struct ExtractedGenome));
-	eg->genes = NULL;
-	do {
-		if (!(dna->content[i] % 10)) { //found a gene!
-			if (g == NULL) {
-				eg->genes = (g = lindaMalloc(sizeof(struct Gene)));
-			} else {
-				g = (g->next = lindaMalloc(sizeof(struct Gene)));
-			}
-#ifdef WITH_CONSOLE
-			tprintf(LOG_VVVV, __func__, "New gene");
-#endif
-//			g->codons = (union CodonGene*)&dna->content[i];
-			g->codons = malloc(sizeof(union CodonGene));
-			uint8_t j; for (j = 0; j < 8; j++) g->codons->content[j] = dna->content[i+j];
-			g->next = NULL;
-			i+=7;
-		}
-		i++;
-	} while (i < genomeSize-7);
+	clctx->g = NULL; //should already be NULL if there are never genes extracted before
+	clctx->eg = lindaMalloc(sizeof(struct ExtractedGenome));
+	clctx->eg->genes = NULL;
+	clctx->eg->blocks = NULL;
+	clctx->eg->gene_count = 0;
+	clctx->eg->rules = NULL;
+	clctx->eg->rule_count = 0;
+	if (genomeSize >= 8) extractGeneRange(clctx->dna->content, genomeSize - 8);
 }
 #endif
 
 /**
  * On a resource constrained defined it doesn't make sense to first store the entire genome
  * in its raw format and only then start extracting it. This can be done on the fly when
- * parts of the genome are received. The disadvantage of this is that new memory has to be
- * allocated for each gene, instead of just pointing to each gene in the raw genome structure.
+ * parts of the genome are received. The genes of a part are allocated in one block, instead
+ * of just pointing to each gene in the raw genome structure, see extractGeneRange.
  *
  * There should be taken care of the ends of the genomes,so a gene that is send in two parts
- * is properly recognized. For that reason the function returns the remaining 1 till 7 items
- * that yet have to be processed, and copies it to the start of the buffer.
+ * is properly recognized. For that reason the function returns the remaining 1 till 8 items
+ * that yet have to be processed, and copies it to the start of the buffer. The next part
+ * should be put after them.
  */
 int16_t stepGeneExtraction(uint16_t buffer_size) {
-	char text[64]; sprintf(text, "Gene extraction from buffer with size %i", buffer_size);
-	tprintf(LOG_VV, __func__, text);
 	uint16_t i = 0; int16_t j;
-	do {
-		if (!(dna->content[i] % 10)) { //found a gene!
-			if (g == NULL) {
-				eg->genes = (g = lindaMalloc(sizeof(struct Gene)));
-			} else {
-				g = (g->next = lindaMalloc(sizeof(struct Gene)));
-			}
-			char text[64]; sprintf(text, "New gene at position %i", i);
-			tprintf(LOG_VVV, __func__, text);
-			g->codons = malloc(sizeof(union CodonGene));
-			for (j = 0; j < 8; j++) {
-				g->codons->content[j] = dna->content[i+j];
-			}
-			g->next = NULL;
-			printCodonGene(g->codons, LOG_VVV);
-			i+=7;
-		}
-		i++;
-	} while (i < buffer_size-8);
+	if (buffer_size >= 9) i = extractGeneRange(clctx->dna->content, buffer_size - 9);
+#ifdef WITH_CONSOLE
+	char text[64];
+	sprintf(text, "Genes extracted from buffer with size %i", buffer_size);
+	tprintf(LOG_VV, __func__, text);
+#endif
 
-	tprintf(LOG_VVV, __func__, "Copy last to first");
 	//copy last values of buffer to the start of the buffer
 	j = 0;
-	do {
-		dna->content[j] = dna->content[i];
+	while (i < buffer_size) {
+		clctx->dna->content[j] = clctx->dna->content[i];
 		i++; j++;
-	} while (i < buffer_size-1);
+	}
 	return j;
 }
 
@@ -223,10 +296,13 @@ int16_t stepGeneExtraction(uint16_t buffer_size) {
  * and sets the linked list of to be extracted genes to null.
  */
 void initGeneExtraction() {
-	g = NULL;
-	eg = lindaMalloc(sizeof(struct ExtractedGenome));
-	eg->genes = NULL;
-	eg->gene_count = 0;
+	clctx->g = NULL;
+	clctx->eg = lindaMalloc(sizeof(struct ExtractedGenome));
+	clctx->eg->genes = NULL;
+	clctx->eg->blocks = NULL;
+	clctx->eg->gene_count = 0;
+	clctx->eg->rules = NULL;
+	clctx->eg->rule_count = 0;
 }
 
 uint8_t normalize(uint8_t value, uint8_t bins) {
@@ -247,63 +323,106 @@ uint8_t normalize(uint8_t value, uint8_t bins) {
  * 0...20% value.
  *
  * If the ProductIn is the same as the ProductOut the gene is removed from the pool.
+ *
+ * The transcription is done in place, so only once for the extracted genes, after which they
+ * are compiled into rules, see compileGenes. Another development of the same genes uses the
+ * rules again.
  */
 void transcribeGenes() {
-	g = eg->genes; struct Gene *lgprev = NULL;
+	if (clctx->eg->rules != NULL) return;
+	clctx->g = clctx->eg->genes; struct Gene *lgprev = NULL, *lgnext;
 	
-	if (gconf == NULL) {
+	if (clctx->gconf == NULL) {
 		tprintf(LOG_EMERG, __func__, "Struct gconf not initialized!");
-	} else if (s == NULL) {
+	} else if (clctx->s == NULL) {
 		tprintf(LOG_EMERG, __func__, "Struct s not initialized!");
 		tprintf(LOG_EMERG, __func__, "If initEvolution is not called, remember to manually call configGrid.");
 	}
 	
-	while (g != NULL) {
-		if (g->codons == NULL) {
+	while (clctx->g != NULL) {
+		if (clctx->g->codons == NULL) {
 #ifdef WITH_CONSOLE
 			tprintf(LOG_ALERT, __func__, "Wrong format for genes");
 #endif
-			g = NULL;
+			clctx->g = NULL;
 			break;
 		}
 		
-		g->codons->DeviceToken /= 10; //now DeviceToken's range from 0..25
-		g->codons->ProductIn = normalize(g->codons->ProductIn, gconf->regulatingFactors) + gconf->phenotypicFactors;
-		g->codons->ProductOut = normalize(g->codons->ProductOut, gconf->regulatingFactors + gconf->phenotypicFactors);
-		g->codons->LocationOut_X = normalize(g->codons->LocationOut_X, s->columns);
-		g->codons->LocationOut_Y = normalize(g->codons->LocationOut_Y, s->rows);
-		g->codons->conc_inc = normalize(g->codons->conc_inc, 11) + 10; //from 10-20
-		g->codons->conc_low = normalize(g->codons->conc_low, 101);
-		g->codons->conc_high = normalize(g->codons->conc_high, 101);
+		clctx->g->codons->DeviceToken /= 10; //now DeviceToken's range from 0..25
+		clctx->g->codons->ProductIn = normalize(clctx->g->codons->ProductIn, clctx->gconf->regulatingFactors) + clctx->gconf->phenotypicFactors;
+		clctx->g->codons->ProductOut = normalize(clctx->g->codons->ProductOut, clctx->gconf->regulatingFactors + clctx->gconf->phenotypicFactors);
+		clctx->g->codons->LocationOut_X = normalize(clctx->g->codons->LocationOut_X,
+				clctx->s->columns);
+		clctx->g->codons->LocationOut_Y = normalize(clctx->g->codons->LocationOut_Y,
+				clctx->s->rows);
+		clctx->g->codons->conc_inc = normalize(clctx->g->codons->conc_inc, 11) + 10; //from 10-20
+		clctx->g->codons->conc_low = normalize(clctx->g->codons->conc_low, 101);
+		clctx->g->codons->conc_high = normalize(clctx->g->codons->conc_high, 101);
 #ifdef WITH_CONSOLE
-		printCodonGene(g->codons, LOG_VVV);
+		printCodonGene(clctx->g->codons, LOG_VVV);
 #endif
 
-		//remove gene if self-enforcing
-		if (g->codons->ProductIn == g->codons->ProductOut) {
-			if (lgprev == NULL) eg->genes = g->next;
-			else lgprev->next = g->next;
+		//remove gene if self-enforcing, it is freed with its block
+		lgnext = clctx->g->next;
+		if (clctx->g->codons->ProductIn == clctx->g->codons->ProductOut) {
+			if (lgprev == NULL) clctx->eg->genes = lgnext;
+			else lgprev->next = lgnext;
 		} else {
-			eg->gene_count++;
+			clctx->eg->gene_count++;
+			lgprev = clctx->g;
 		}
-		lgprev = g;
-		g = g->next;
+		clctx->g = lgnext;
 	}
+	compileGenes();
 }
 
 /**
- * From a series of products that a grid cell hosts, the product with the given id is returned.
+ * Compiles the transcribed genes into a table of rules, ordered by the cell the genes code for,
+ * so updateConcentrations goes through the concentrations of one cell after the other. The
+ * genes are sorted by counting the genes per cell, which keeps the order of the genes within
+ * a cell.
  */
-struct Product *getProduct(struct ProductId *id) {
-	struct Product *p = gc->products;
-	while (p != NULL) {
-		if (p->id[0] == id->id[0])
-			//			if (p->id[1] == id->id[1])
-			//				if (p->id[2] == id->id[2])
-			return p;
-		p = p->next;
+void compileGenes() {
+	uint16_t i, n = clctx->s->rows * clctx->s->columns;
+	uint16_t *start = lindaMalloc((n + 1) * sizeof(uint16_t));
+	for (i = 0; i <= n; i++) start[i] = 0;
+	clctx->eg->rule_count = 0;
+	for (clctx->g = clctx->eg->genes; clctx->g != NULL; clctx->g = clctx->g->next) {
+		start[clctx->g->codons->LocationOut_X +
+				clctx->g->codons->LocationOut_Y * clctx->s->columns + 1]++;
+		clctx->eg->rule_count++;
 	}
-	return NULL;
+	for (i = 0; i < n; i++) start[i + 1] += start[i];
+	clctx->eg->rules = lindaMalloc((clctx->eg->rule_count ? clctx->eg->rule_count : 1) *
+			sizeof(struct GeneRule));
+	for (clctx->g = clctx->eg->genes; clctx->g != NULL; clctx->g = clctx->g->next) {
+		union CodonGene *lc = clctx->g->codons;
+		uint16_t cell = lc->LocationOut_X + lc->LocationOut_Y * clctx->s->columns;
+		struct GeneRule *lr = &clctx->eg->rules[start[cell]++];
+		lr->cell = cell;
+		lr->product_in = lc->ProductIn;
+		lr->product_out = lc->ProductOut;
+		if (lc->conc_low < lc->conc_high) {
+			lr->low = lc->conc_low;
+			lr->high = lc->conc_high;
+			lr->amount = lc->conc_inc;
+		} else {
+			lr->low = lc->conc_high;
+			lr->high = lc->conc_low;
+			lr->amount = -lc->conc_inc;
+		}
+	}
+	free(start);
+}
+
+/**
+ * Returns the concentration of the product with the given id in the current grid cell, in the
+ * plane of that product. Or NULL if there is no such product.
+ */
+uint8_t *getConcentration(struct ProductId *id) {
+	uint8_t *plane = getConcentrationPlane(id->id[0]);
+	if (plane == NULL) return NULL;
+	return &plane[getGridCellIndex(clctx->gc)];
 }
 
 
@@ -315,81 +434,16 @@ struct Product *getProduct(struct ProductId *id) {
  *
  ***********************************************************************************************/
 
-/**
- * Stores the change in concentration of a gene product in a grid cell. The amount might be
- * positive or negative. Precede this calculation by calling precalculateChangeConcentration
- * with "p->concentration".
- */
-void precalculateChangeConcentration(struct Product *p, int8_t amount) {
-	if (p == NULL) return; //add product?
-	int16_t sum = (int16_t)p->new_concentration + amount;
-	if (sum > 100) p->new_concentration = 100;
-	else if (sum < 0) p->new_concentration = 0;
-	else p->new_concentration = (uint8_t)sum;
-}
-
 /**
  * Changes the concentration of a gene product in a grid cell. The amount might be positive or
- * negative. The borders of the type of p->concentration are respected (0 - 100).
+ * negative. The borders of the concentration are respected (0 - 100).
  */
-void changeConcentration(struct Product *p, int8_t amount) {
-	if (p == NULL) return; //add product?
-	int16_t sum = (int16_t)p->concentration + amount;
-	if (sum > 100) p->concentration = 100;
-	else if (sum < 0) p->concentration = 0;
-	else p->concentration = (uint8_t)sum;
-}
-
-/**
- * Current gene is given by global parameter "g", the current grid cell by "gc". The concentration in
- * the grid cell is updated using the getProduct function on the arguments given by the gene parameter.
- * This way this function does not need to know if it is living in e.g. a 5x5 squared 2D grid. It
- * does neither need to know how to iterate through the genes.
- */
-void updateConcentration() {
-	struct Product *p_in = getProduct((struct ProductId*)&g->codons->ProductIn);
-	struct Product *p_out = getProduct((struct ProductId*)&g->codons->ProductOut);
-
-#ifdef WITH_CONSOLE
-	if (p_in == NULL) {
-		tprintf(LOG_ALERT, __func__, "ProductIn not found!");
-		printCodonGene(g->codons, LOG_ALERT);
-		tprintf(LOG_ALERT, __func__, "This might be because not all genes are interpreted");
-		tprintf(LOG_ALERT, __func__, "That might happen if parts of the genome arrive after development has started");
-	}
-	if (p_out == NULL) {
-		tprintf(LOG_ALERT, __func__, "ProductOut not found!");
-		tprintf(LOG_ALERT, __func__, "See error about ProductIn message, comes never alone...");
-	}
-#endif
-
-#ifdef WITH_CONSOLE
-	char text[64]; sprintf(text, "%i ? E [%i ... %i]",
-			p_in->concentration, g->codons->conc_low, g->codons->conc_high);
-	tprintf(LOG_VVVV, __func__, text);
-#endif
-
-	if (g->codons->conc_low < g->codons->conc_high) {
-		if ((p_in->concentration > g->codons->conc_low) && (p_in->concentration < g->codons->conc_high)) {
-			changeConcentration(p_out, g->codons->conc_inc);
-			//			tprintf(LOG_VVVV, __func__, "Plus");
-		} else if ((p_in->concentration > 0) && (p_in->concentration < 10)) {
-			changeConcentration(p_out, -g->codons->conc_inc);
-			//			tprintf(LOG_VVVV, __func__, "Minus");
-		}
-	} else {
-		if ((p_in->concentration > g->codons->conc_high) && (p_in->concentration < g->codons->conc_low)) {
-			changeConcentration(p_out, -g->codons->conc_inc);
-			//			tprintf(LOG_VVVV, __func__, "Minus");
-		} else if ((p_in->concentration > 0) && (p_in->concentration < 10)) {
-			changeConcentration(p_out, g->codons->conc_inc);
-			//#ifdef WITH_CONSOLE
-			//			char text[64]; sprintf(text, "New concentration %i (d[%i]) @[%i,%i]",
-			//					p_out->concentration, g->codons->conc_inc, gc->position->x, gc->position->y);
-			//			tprintf(LOG_VVVV, __func__, text);
-			//#endif
-		}
-	}
+void changeConcentration(uint8_t *c, int8_t amount) {
+	if (c == NULL) return; //add product?
+	int16_t sum = (int16_t)*c + amount;
+	if (sum > 100) *c = 100;
+	else if (sum < 0) *c = 0;
+	else *c = (uint8_t)sum;
 }
 
 #ifdef WITH_CONSOLE
@@ -408,17 +462,17 @@ void updateConcentration() {
  * to check if the extraction of genes was appropriate.
  */
 void printGenes() {
-	g = eg->genes;
+	clctx->g = clctx->eg->genes;
 	uint16_t i = 0, j;
-	while (g != NULL) {
+	while (clctx->g != NULL) {
 		if (!(i % 2)) printf("\n%3i: ", i);
 		printf("[");
 		for (j = 0; j < 8; j++) {
-			printf("%3i", g->codons->content[j]);
+			printf("%3i", clctx->g->codons->content[j]);
 			if (j != 7) printf(", ");
 			else printf("] ");
 		}
-		g = g->next;
+		clctx->g = clctx->g->next;
 		i++;
 	}
 	printf("\n");
@@ -434,9 +488,9 @@ const char genome_print_columns = 1;
  * the total number of genes.
  */
 uint16_t printGenesToStr(char *str, uint16_t length) {
-	g = eg->genes;
+	clctx->g = clctx->eg->genes;
 	uint16_t i = 0, j;
-	while (g != NULL) {
+	while (clctx->g != NULL) {
 		if (!(i % genome_print_columns)) sprintf(str, "%s\n%3i: ", str, i);
 		if (strlen(str) > (length - (8*5+1))) {
 			sprintf(str, "%s\n", str);
@@ -444,11 +498,11 @@ uint16_t printGenesToStr(char *str, uint16_t length) {
 		}
 		sprintf(str, "%s[", str);
 		for (j = 0; j < 8; j++) {
-			sprintf(str, "%s%3i", str, g->codons->content[j]);
+			sprintf(str, "%s%3i", str, clctx->g->codons->content[j]);
 			if (j != 7) sprintf(str, "%s, ", str);
 			else sprintf(str, "%s] ", str);
 		}
-		g = g->next;
+		clctx->g = clctx->g->next;
 		i++;
 	}
 	sprintf(str, "%s\n", str);
@@ -461,20 +515,20 @@ uint16_t printGenesToStr(char *str, uint16_t length) {
  * all products.
  */
 void printGenesOfProduct(uint8_t productId) {
-	g = eg->genes;
+	clctx->g = clctx->eg->genes;
 	uint16_t i = 0, j;
-	while (g != NULL) {
-		if (g->codons->ProductOut == productId) {
+	while (clctx->g != NULL) {
+		if (clctx->g->codons->ProductOut == productId) {
 			if (!(i % 2)) printf("\n%3i: ", i);
 			printf("[");
 			for (j = 0; j < 8; j++) {
-				printf("%3i", g->codons->content[j]);
+				printf("%3i", clctx->g->codons->content[j]);
 				if (j != 7) printf(", ");
 				else printf("] ");
 			}
 			i++;
 		}
-		g = g->next;
+		clctx->g = clctx->g->next;
 	}
 	printf("\n");
 }
@@ -483,15 +537,15 @@ void printGenesOfProduct(uint8_t productId) {
  * Prints the amount of genes dedicated to a certain gene product.
  */
 void printGenesPerProductDistribution() {
-	uint8_t arr_size = gconf->phenotypicFactors + gconf->regulatingFactors;
+	uint8_t arr_size = clctx->gconf->phenotypicFactors + clctx->gconf->regulatingFactors;
 	uint8_t *dist = lindaCalloc(arr_size, sizeof(uint8_t)), j;
 	tprintf(LOG_VERBOSE, __func__, "Print genes per product distribution");
 	for (j = 0; j < arr_size; j++) {
-		g = eg->genes;
-		while (g != NULL) {
-			if (g->codons->ProductOut == j)
+		clctx->g = clctx->eg->genes;
+		while (clctx->g != NULL) {
+			if (clctx->g->codons->ProductOut == j)
 				dist[j] = dist[j] + 1;
-			g = g->next;
+			clctx->g = clctx->g->next;
 		}
 	}
 	printf("[");
@@ -3,9 +3,16 @@
 #include <genome.h>
 #include <topology.h>
 #include <neuron.h>
+#include <linda/abbey.h>
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
 
 #ifdef WITH_SYMBRICATOR
 #include "portable.h"
+#else
+#include <stdio.h>
 #endif
 
 #ifdef WITH_CONSOLE
@@ -20,6 +27,7 @@
 #include <colinda.h>
 #include <infocontainer.h>
 #include <linda/abbey.h>
+#include <linda/slab.h>
 #include <unistd.h> //for sleep
 #endif
 
@@ -29,11 +37,32 @@
  *  		Declarations
  ***************************************************************************************************/
 
-void updateConcentrations();
-void decayConcentrations();
-void diffuseConcentrations();
-void copyConcentrationsToNew();
-void avgConcentrationsToCurrent();
+//! A diffusion plane is padded by a row on both sides
+#define DIFFUSION_PLANE_SIZE(s)	((uint32_t)((s)->rows + 2) * (s)->columns)
+
+//! Milliseconds to wait for the halo of a docked robot, before the robot is given up
+#define GRID_HALO_TIMEOUT		1000
+
+void (*sendGridHalo)(uint8_t side, uint8_t robot, uint16_t exchange, uint8_t *parts,
+		uint16_t size);
+
+//! The robots docked on the sides, the grid takes them over in initGrid
+static int16_t dockedRobots[GRID_SIDES] = {-1, -1, -1, -1};
+
+//! The incoming halos are written by another thread, they exist while halosActive is set
+static pthread_mutex_t haloMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t haloArrived = PTHREAD_COND_INITIALIZER;
+static uint8_t halosActive = 0;
+
+void updateConcentrations(struct ColindaContext *context);
+static void updateGridTiles(struct Space *ls);
+static void sendGridHalos(struct Space *ls);
+static void receiveGridHalos(struct Space *ls);
+static void freeGridHalos();
+void decayConcentrations(struct Space *ls);
+void diffuseConcentrations(struct Space *ls);
+void copyConcentrationsToNew(struct Space *ls);
+void avgConcentrationsToCurrent(struct Space *ls);
 
 /****************************************************************************************************
  *  		Implementations
@@ -45,8 +74,8 @@ void avgConcentrationsToCurrent();
  * able to visualize different types of neuron in a 2D grid. 
  */
 void visualizeCell(uint8_t x, uint8_t y, uint8_t value) {
-	struct InfoArray *infoa = malloc(sizeof(struct InfoArray));
-	infoa->values = calloc(4, sizeof(uint8_t));
+	struct InfoArray *infoa = linda_ctx_alloc(sizeof(struct InfoArray));
+	infoa->values = linda_ctx_calloc(4, sizeof(uint8_t));
 	infoa->values[0] = x;
 	infoa->values[1] = y;
 	infoa->values[2] = value;// & 0x0F;
@@ -61,15 +90,15 @@ void visualizeCell(uint8_t x, uint8_t y, uint8_t value) {
  * possible to include a "sleep()" call over here. 
  */
 void visualizeCells() {
-	struct GridCell *lgc = s->gridcells;
+	struct GridCell *lgc = clctx->s->gridcells;
 	do {
 		if (lgc->neuron != NULL) {
-			visualizeCell(lgc->position->x, lgc->position->y, lgc->neuron->type);
+			visualizeCell(lgc->position.x, lgc->position.y, lgc->neuron->type);
 		} else {
-			visualizeCell(lgc->position->x, lgc->position->y, 0);
+			visualizeCell(lgc->position.x, lgc->position.y, 0);
 		}
 		lgc = lgc->next;
-	} while (lgc != s->gridcells);
+	} while (lgc != clctx->s->gridcells);
 }
 #endif
 
@@ -77,12 +106,7 @@ void visualizeCells() {
  * Retrieve a gridcell using 2D coordinates.
  */
 struct GridCell *getGridCell(uint8_t x, uint8_t y) {
-	uint8_t counter = x + y * s->columns;
-	struct GridCell *lgc = s->gridcells;
-	while ((lgc != NULL) && (counter != 0)) {
-		counter--;
-		lgc = lgc->next;
-	}
+	struct GridCell *lgc = getGridCellByIndex(x + y * clctx->s->columns);
 #ifdef WITH_CONSOLE
 	if (lgc == NULL)
 		tprintf(LOG_ALERT, __func__, "GridCell not found!");
@@ -90,23 +114,66 @@ struct GridCell *getGridCell(uint8_t x, uint8_t y) {
 	return lgc;
 }
 
-struct GridCell *getGridCellByIndex(uint8_t i) {
-	struct GridCell *lgc = s->gridcells;
-	while ((lgc != NULL) && (i != 0)) {
-		i--;
-		lgc = lgc->next;
+/**
+ * Retrieve a gridcell by its index, row by row. An index beyond the last cell wraps around,
+ * as it did when the cells were found by walking the circular list.
+ */
+struct GridCell *getGridCellByIndex(uint16_t i) {
+	if (clctx->s->gridcells == NULL) return NULL;
+	return &clctx->s->gridcells[i % (clctx->s->rows * clctx->s->columns)];
+}
+
+uint16_t getGridCellIndex(struct GridCell *lgc) {
+	return (uint16_t)(lgc - clctx->s->gridcells);
+}
+
+/**
+ * Writes the type of the neuron in every cell, or 0 for a cell without one, row by row, as
+ * far as the array is large enough. Returns the amount of cells.
+ */
+uint16_t getTopology(uint8_t *topology, uint16_t size) {
+	uint16_t i, cells = clctx->s->rows * clctx->s->columns;
+	for (i = 0; (i < cells) && (i < size); i++) {
+		struct Neuron *ln = clctx->s->gridcells[i].neuron;
+		topology[i] = (ln != NULL) ? ln->type : 0;
+	}
+	return cells;
+}
+
+/**
+ * Returns the plane with the concentrations of the given product in all cells, row by row.
+ * Or NULL if there is no such product, or the concentrations are not initialized yet.
+ */
+uint8_t *getConcentrationPlane(uint8_t product_id) {
+	if ((clctx->s->concentrations == NULL) || (product_id >= clctx->s->product_count)) return NULL;
+	return &clctx->s->concentrations[(uint32_t)product_id * clctx->s->rows * clctx->s->columns];
+}
+
+/**
+ * Returns the index of the k-th cell along a side, from west to east or from north to south.
+ */
+static uint32_t getBorderCell(struct Space *ls, uint8_t side, uint16_t k) {
+	switch (side) {
+	case GRID_NORTH: return k;
+	case GRID_SOUTH: return (uint32_t)(ls->rows - 1) * ls->columns + k;
+	case GRID_EAST: return (uint32_t)k * ls->columns + ls->columns - 1;
+	default: return (uint32_t)k * ls->columns;
 	}
-	return lgc;
 }
 
 /**
  * Go through the grid cells and diffuse gene concentrations to neighbouring grid cells. And decay
  * all gene product concentrations everywhere by a small amount.
  */
-void updateGrid() {
-	updateConcentrations();
-	decayConcentrations();
-	copyConcentrationsToNew();
+void updateGridIn(struct ColindaContext *context) {
+	struct Space *ls = context->s;
+	updateConcentrations(context);
+	decayConcentrations(ls);
+	if (ls->tile_count > 1) {
+		updateGridTiles(ls);
+		return;
+	}
+	copyConcentrationsToNew(ls);
 	//	printf("\n");
 	//#ifdef WITH_CONSOLE
 	//	tprintf(LOG_NOTICE, __func__, "Before diffusion:");
@@ -116,7 +183,7 @@ void updateGrid() {
 	//	tprintf(LOG_NOTICE, __func__, "Before diffusion (new conc):");
 	//#endif
 	//	printAllConcentrationUpdates();
-	diffuseConcentrations();
+	diffuseConcentrations(ls);
 	//#ifdef WITH_CONSOLE
 	//	tprintf(LOG_NOTICE, __func__, "After diffusion:");
 	//#endif
@@ -125,159 +192,177 @@ void updateGrid() {
 	//	tprintf(LOG_NOTICE, __func__, "Diffusion grid:");
 	//#endif
 	//	printAllConcentrationUpdates();
-	avgConcentrationsToCurrent();
+	avgConcentrationsToCurrent(ls);
 	//#ifdef WITH_CONSOLE
 	//	tprintf(LOG_NOTICE, __func__, "After averaging:");
 	//#endif
 	//	printAllConcentrations();
 }
 
+void updateGrid() {
+	updateGridIn(&processContext);
+}
+
 /**
  * The configGrid routine only needs to be called once. It allocates memory for a 2D space and
- * defines the amount of cells on it and sets decay and diffusion parameters.
+ * defines the amount of cells on it and sets decay and diffusion parameters. The default grid
+ * is 5x5, the LINDA_GRID environment variable can give another size, as in "64x64" for rows
+ * by columns. LINDA_GRID_TILES gives the amount of tiles to update the grid in parallel.
+ * LINDA_DOCKED tells which robots are docked on which sides, as in "north=3,east=4", and
+ * LINDA_HALO_INTERVAL every how many steps the halos are exchanged with them.
  */
 void configGrid() {
-	s = lindaMalloc(sizeof(struct Space));
-	s->rows = 5;
-	s->columns = 5;
-	s->decay_step = 1;
-	s->diffuse_ratio = 8; //should be 4 or more
-	s->concentration_threshold = 75;
-	s->concentration_default = 20;
+	clctx->s = lindaMalloc(sizeof(struct Space));
+	clctx->s->rows = 5;
+	clctx->s->columns = 5;
+	clctx->s->decay_step = 1;
+	clctx->s->diffuse_ratio = 8; //should be 4 or more
+	clctx->s->concentration_threshold = 75;
+	clctx->s->concentration_default = 20;
+	clctx->s->tile_count = 1;
+	clctx->s->remote = 0;
+	clctx->s->halo_interval = 1;
+	clctx->s->halo_step = 0;
+#ifndef WITH_SYMBRICATOR
+	unsigned int rows, columns, tiles, interval, robot;
+	const char *size = getenv("LINDA_GRID");
+	if ((size != NULL) && (sscanf(size, "%ux%u", &rows, &columns) == 2) &&
+			(rows > 0) && (rows < 256) && (columns > 0) && (columns < 256)) {
+		clctx->s->rows = rows;
+		clctx->s->columns = columns;
+	}
+	const char *tiling = getenv("LINDA_GRID_TILES");
+	if ((tiling != NULL) && (sscanf(tiling, "%u", &tiles) == 1) && (tiles > 0)) {
+		clctx->s->tile_count = tiles < clctx->s->rows ? tiles : clctx->s->rows;
+	}
+	const char *halo = getenv("LINDA_HALO_INTERVAL");
+	if ((halo != NULL) && (sscanf(halo, "%u", &interval) == 1) && (interval > 0) &&
+			(interval < 256)) {
+		clctx->s->halo_interval = interval;
+	}
+	const char *docked = getenv("LINDA_DOCKED");
+	static const char *sides[GRID_SIDES] = {"north", "south", "east", "west"};
+	char side[8];
+	int used;
+	uint8_t i;
+	while ((docked != NULL) &&
+			(sscanf(docked, " %7[a-z]=%u%n", side, &robot, &used) == 2) && (robot < 256)) {
+		for (i = 0; i < GRID_SIDES; i++) {
+			if (!strcmp(side, sides[i])) dockGrid(i, robot);
+		}
+		docked += used;
+		if (*docked == ',') docked++;
+	}
+#endif
 }
 
 /**
- * Deallocates a gridcell. This means position information, as well as deallocating
- * the linked list of connections (which should not be circular), and a linked list
- * of gene products.
+ * Docks the robot with the given id on a side of the grid, or undocks it with -1. The grid
+ * that is initialized next, in the next development, exchanges diffusion with it.
  */
-void freeGridCell(struct GridCell *lgc) {
-	struct Product *lp, *lpnext;
-	struct GridConnection *lgcc, *lgccnext;
-	free(lgc->position);
-	lgcc = lgc->connections;
-	if (lgcc == NULL) goto free_gridcell_products;
-	lgccnext = lgcc->next;
-	while (lgccnext != NULL) {
-		free(lgcc);
-		lgcc = lgccnext;
-		lgccnext = lgcc->next;
-	}
-	free(lgcc);
-
-free_gridcell_products:
-	lp = lgc->products;
-	if (lp == NULL) goto free_gridcell;
-	lpnext = lp->next;
-	while (lpnext != NULL) {
-		free(lp);
-		lp = lpnext;
-		lpnext = lp->next;
-	}
-	free(lp);
-	
-free_gridcell:
-	free(lgc);
+void dockGrid(uint8_t side, int16_t robot) {
+	if (side < GRID_SIDES) dockedRobots[side] = robot;
 }
 
 /**
- * The gridcells are stored in a circular linked list, so care has to be taken
- * in deallocating all cells appropriately. Hence, iterating over rows and columns
- * is the easiest way to free the space.
+ * The gridcells are stored in one array, and so are the connections between them, the
+ * stencil and the planes with concentrations.
  */
 void freeGrid() {
-	struct GridCell *lgc = s->gridcells, *lgcnext;
-	if (lgc == NULL) {
+	if (clctx->s->gridcells == NULL) {
 #ifdef WITH_CONSOLE
 		tprintf(LOG_ALERT, __func__, "No cells!");
 #endif
 		goto free_space;
 	}
-	lgcnext = lgc->next; uint8_t i;
-	for (i=1; i<(s->rows * s->columns); i++) {
-		lgc = lgcnext;
-		lgcnext = lgc->next;
-		freeGridCell(lgc);
-	}
-	if (lgcnext != s->gridcells) {
-#ifdef WITH_CONSOLE
-		tprintf(LOG_ALERT, __func__, "No proper circular list of cells!");
-#endif
-		goto free_space;
-	}
-	freeGridCell(s->gridcells);
+	free(clctx->s->gridcells);
+	free(clctx->s->links);
+	free(clctx->s->neighbours);
+	free(clctx->s->tiles);
+	free(clctx->s->concentrations);
+	free(clctx->s->new_concentrations);
+	free(clctx->s->diffusion);
+	free(clctx->s->history);
+	pthread_mutex_lock(&haloMutex);
+	freeGridHalos();
+	pthread_mutex_unlock(&haloMutex);
 free_space:
-	free(s);
+	free(clctx->s);
+}
+
+/**
+ * Connects the cell with index i to the cell with index j, using the next free element of the
+ * array of links, which is returned. The connection is prepended to the ones of the cell.
+ */
+static struct GridConnection *connectGridCells(struct GridConnection *lgcc, uint16_t i,
+		uint16_t j) {
+	lgcc->from = &clctx->s->gridcells[i];
+	lgcc->to = &clctx->s->gridcells[j];
+	lgcc->next = clctx->s->gridcells[i].connections;
+	clctx->s->gridcells[i].connections = lgcc;
+	return lgcc + 1;
 }
 
 /**
  * Allocate space for all grid elements, using the configuration parameters set before in configGrid.
- * The cells are stored in a circular linked list. The positions are set to proper [x,y] coordinates.
+ * The cells are one array, linked in a circular list. The positions are set to proper [x,y]
+ * coordinates. Every cell is connected to its neighbours east, west, north and south, in that
+ * order, as far as they exist. The concentrations are allocated by initConcentrations. The
+ * rows are divided over the tiles as evenly as possible. The cells along a side on which a
+ * robot is docked get one neighbour more, across the side.
  */
 void initGrid() {
-	uint8_t i;
-	s->gridcells = lindaMalloc(sizeof(struct GridCell));
-	struct GridCell *lgc = s->gridcells;
-	lgc->neuron = NULL;
-	lgc->position = lindaMalloc(sizeof(struct Position));
-	lgc->position->x = 0; lgc->position->y = 0;
-	for (i=1; i<(s->rows * s->columns); i++) {
-		lgc->next = lindaMalloc(sizeof(struct GridCell));
-		lgc = lgc->next;
+	uint8_t side;
+	uint16_t i, n = clctx->s->rows * clctx->s->columns;
+	clctx->s->gridcells = lindaMalloc(n * sizeof(struct GridCell));
+	clctx->s->links = lindaMalloc(4 * n * sizeof(struct GridConnection));
+	struct GridConnection *lgcc = clctx->s->links;
+	for (i=0; i<n; i++) {
+		struct GridCell *lgc = &clctx->s->gridcells[i];
+		lgc->connections = NULL;
 		lgc->neuron = NULL;
-		lgc->position = lindaMalloc(sizeof(struct Position));
-		lgc->position->x = i % s->columns; lgc->position->y = i / s->columns;
-	}
-	lgc->next = s->gridcells;
-
-	lgc = s->gridcells; struct GridConnection *lgcc = NULL;
-	for (i=0; i<(s->rows * s->columns); i++) {
-		if (((i + 1) % s->columns)) {
-			//									printf("Add east: %i\n", i);
-			lgc->connections = lindaMalloc(sizeof(struct GridConnection));
-			lgcc = lgc->connections;
-			lgcc->from = lgc;
-			lgcc->to = getGridCellByIndex(i + 1);
-		}
-		if ((i % s->columns)) {
-			//									printf("Add west: %i\n", i);
-			if (lgcc == NULL) {
-				lgc->connections = lindaMalloc(sizeof(struct GridConnection));
-				lgcc = lgc->connections;
-			} else {
-				lgcc->next = lindaMalloc(sizeof(struct GridConnection));
-				lgcc = lgcc->next;
-			}
-			lgcc->from = lgc;
-			lgcc->to = getGridCellByIndex(i - 1);
-		}
-		if (!(i < s->columns)) {
-			//									printf("Add north: %i\n", i);
-			if (lgcc == NULL) {
-				lgc->connections = lindaMalloc(sizeof(struct GridConnection));
-				lgcc = lgc->connections;
-			} else {
-				lgcc->next = lindaMalloc(sizeof(struct GridConnection));
-				lgcc = lgcc->next;
-			}
-			lgcc->from = lgc;
-			lgcc->to = getGridCellByIndex(i - s->columns);
-		}
-		if (!(i >= (s->rows - 1) * s->columns)) {
-			//						printf("Add south: %i\n", i);
-			if (lgcc == NULL) {
-				lgc->connections = lindaMalloc(sizeof(struct GridConnection));
-				lgcc = lgc->connections;
-			} else {
-				lgcc->next = lindaMalloc(sizeof(struct GridConnection));
-				lgcc = lgcc->next;
-			}
-			lgcc->from = lgc;
-			lgcc->to = getGridCellByIndex(i + s->columns);
+		lgc->next = &clctx->s->gridcells[(i + 1) % n];
+		lgc->position.x = i % clctx->s->columns; lgc->position.y = i / clctx->s->columns;
+	}
+	for (i=0; i<n; i++) {
+		//prepended, so south first to end up with east in front
+		if (!(i >= (clctx->s->rows - 1) * clctx->s->columns))
+			lgcc = connectGridCells(lgcc, i, i + clctx->s->columns);
+		if (!(i < clctx->s->columns)) lgcc = connectGridCells(lgcc, i, i - clctx->s->columns);
+		if ((i % clctx->s->columns)) lgcc = connectGridCells(lgcc, i, i - 1);
+		if (((i + 1) % clctx->s->columns)) lgcc = connectGridCells(lgcc, i, i + 1);
+	}
+
+	clctx->s->neighbours = lindaMalloc(3 * n);
+	clctx->s->east = clctx->s->neighbours + n;
+	clctx->s->west = clctx->s->east + n;
+	for (i=0; i<n; i++) {
+		clctx->s->east[i] = ((i + 1) % clctx->s->columns) ? 0xFF : 0;
+		clctx->s->west[i] = (i % clctx->s->columns) ? 0xFF : 0;
+		clctx->s->neighbours[i] = !!clctx->s->east[i] + !!clctx->s->west[i] +
+				!(i < clctx->s->columns) + !(i >= (clctx->s->rows - 1) * clctx->s->columns);
+	}
+	clctx->s->remote = 0;
+	for (side = 0; side < GRID_SIDES; side++) {
+		struct GridBorder *lb = &clctx->s->borders[side];
+		lb->robot = dockedRobots[side];
+		lb->length = side < GRID_EAST ? clctx->s->columns : clctx->s->rows;
+		lb->outgoing = lb->incoming[0] = lb->incoming[1] = NULL;
+		if (lb->robot < 0) continue;
+		clctx->s->remote++;
+		for (i = 0; i < lb->length; i++) {
+			clctx->s->neighbours[getBorderCell(clctx->s, side, i)]++;
 		}
-		lgc = lgc->next;
-		lgcc = NULL;
 	}
+	clctx->s->tiles = lindaMalloc(clctx->s->tile_count * sizeof(struct GridTile));
+	for (i = 0; i < clctx->s->tile_count; i++) {
+		clctx->s->tiles[i].first_row = i * clctx->s->rows / clctx->s->tile_count;
+		clctx->s->tiles[i].last_row = (i + 1) * clctx->s->rows / clctx->s->tile_count;
+		clctx->s->tiles[i].context = clctx;
+	}
+	clctx->s->product_count = 0;
+	clctx->s->concentrations = clctx->s->new_concentrations = clctx->s->diffusion = NULL;
+	clctx->s->history = NULL;
 }
 
 /***********************************************************************************************
@@ -293,67 +378,93 @@ void initGrid() {
 /**
  * After all genes are extracted, the concentrations of products have to be initalized, not
  * only for the cells in which gene products are disseminated according to genetic information,
- * but also for the other cells in which gene products can appear by diffusion.
+ * but also for the other cells in which gene products can appear by diffusion. Every product
+ * gets a plane, the phenotypic factors first, then the regulating factors. So does every
+ * border on which a robot is docked, for its halos.
  */
 void initConcentrations() {
-	gc = s->gridcells;
-	if (gc == NULL) return;
-	do {
-		uint8_t i;
-		struct Product *lpprev = gc->products;
-		for (i = 0; i < gconf->phenotypicFactors; i++) {
-			//#ifdef WITH_CONSOLE
-			//	tprintf(LOG_INFO, __func__, "Create gene product");
-			//#endif
-			struct Product *lp = lindaMalloc(sizeof(struct Product));
-			lp->id[0] = i;
-			lp->concentration = s->concentration_default;
-			lp->next = NULL;
-			if (i == 0)
-				gc->products = lp;
-			else {
-				lpprev->next = lp;
-			}
-			lpprev = lp;
-			lp = lp->next;
-		}
-		for (i = gconf->phenotypicFactors; i < gconf->phenotypicFactors + gconf->regulatingFactors; i++) {
-			struct Product *lp = lindaMalloc(sizeof(struct Product));
-			lp->id[0] = i;
-			lp->concentration = s->concentration_default;
-			lp->next = NULL;
-			if (i == 0)
-				gc->products = lp;
-			else {
-				lpprev->next = lp;
-			}
-			lpprev = lp;
-			lp = lp->next;
-		}
-		gc = gc->next;
-	} while (gc != s->gridcells);
+	uint8_t side;
+	uint32_t i, size;
+	free(clctx->s->concentrations);
+	free(clctx->s->new_concentrations);
+	free(clctx->s->diffusion);
+	free(clctx->s->history);
+	clctx->s->product_count = clctx->gconf->phenotypicFactors + clctx->gconf->regulatingFactors;
+	size = (uint32_t)clctx->s->product_count * clctx->s->rows * clctx->s->columns;
+	clctx->s->concentrations = lindaMalloc(size);
+	clctx->s->new_concentrations = lindaMalloc(size);
+	clctx->s->diffusion = lindaMalloc(DIFFUSION_PLANE_SIZE(clctx->s) * clctx->s->product_count);
+	for (i = 0; i < DIFFUSION_PLANE_SIZE(clctx->s) * clctx->s->product_count; i++) {
+		clctx->s->diffusion[i] = 0;
+	}
+	clctx->s->history = lindaMalloc(2 * size);
+	clctx->s->last = 1;
+	for (i = 0; i < size; i++) {
+		clctx->s->concentrations[i] = clctx->s->concentration_default;
+	}
+	//no concentration is 0xFF, so the first steps are never stable
+	for (i = 0; i < 2 * size; i++) {
+		clctx->s->history[i] = 0xFF;
+	}
+	pthread_mutex_lock(&haloMutex);
+	freeGridHalos();
+	for (side = 0; side < GRID_SIDES; side++) {
+		struct GridBorder *lb = &clctx->s->borders[side];
+		if (lb->robot < 0) continue;
+		size = (uint32_t)lb->length * clctx->s->product_count;
+		lb->outgoing = lindaMalloc(size);
+		memset(lb->outgoing, 0, size);
+		lb->incoming[0] = lindaMalloc(size);
+		lb->incoming[1] = lindaMalloc(size);
+		lb->exchange[0] = lb->exchange[1] = 0;
+	}
+	clctx->s->halo_step = 0;
+	halosActive = clctx->s->remote > 0;
+	pthread_mutex_unlock(&haloMutex);
+}
+
+/**
+ * Compares the concentrations with those of the previous step and returns how many of them
+ * changed. If they are the same as two steps ago, cycle is set. That includes concentrations that
+ * did not change at all in the last two steps. Afterwards the current concentrations become
+ * the history of the previous step.
+ */
+uint32_t trackConcentrations(uint8_t *cycle) {
+	uint32_t i, changed = 0,
+			size = (uint32_t)clctx->s->product_count * clctx->s->rows * clctx->s->columns;
+	uint8_t *c = clctx->s->concentrations;
+	uint8_t *previous = &clctx->s->history[clctx->s->last * size],
+			*before = &clctx->s->history[!clctx->s->last * size];
+	for (i = 0; i < size; i++) {
+		changed += (c[i] != previous[i]);
+	}
+	*cycle = !memcmp(c, before, size);
+	memcpy(before, c, size);
+	clctx->s->last = !clctx->s->last;
+	return changed;
 }
 
 /**
  * In every gene there is a spot - it is called P4 in Bongard's paper in figure 3 - that codes for
- * the location (grid cell) in which a gene product might be disseminated.
- * Complexity O(g*a), with g the amount of genes, and a the amount of activated / non-empty cells.
- * If only a few cells are coded for by the genes, not all the cells have to be iterated.
+ * the location (grid cell) in which a gene product might be disseminated. The genes are compiled
+ * to rules by transcribeGenes, which are applied in one pass, cell after cell.
+ * Complexity O(g), with g the amount of genes.
  */
-void updateConcentrations() {
+void updateConcentrations(struct ColindaContext *context) {
 #ifdef WITH_CONSOLE
 	tprintf(LOG_VVV, __func__, "New update iteration");
 #endif
-	g = eg->genes;
-	while (g != NULL) {
-		gc = getGridCell(g->codons->LocationOut_X, g->codons->LocationOut_Y);
-#ifdef WITH_CONSOLE
-		char text[64]; sprintf(text, "@[%i,%i]",
-				g->codons->LocationOut_X, g->codons->LocationOut_Y);
-		tprintf(LOG_VVV, __func__, text);
-#endif
-		updateConcentration();
-		g = g->next;
+	uint32_t n = context->s->rows * context->s->columns;
+	uint8_t *c = context->s->concentrations;
+	struct GeneRule *lr = context->eg->rules, *end = context->eg->rules + context->eg->rule_count;
+	for (; lr < end; lr++) {
+		uint8_t in = c[lr->product_in * n + lr->cell];
+		uint8_t *out = &c[lr->product_out * n + lr->cell];
+		if ((in > lr->low) && (in < lr->high)) {
+			changeConcentration(out, lr->amount);
+		} else if ((in > 0) && (in < 10)) {
+			changeConcentration(out, -lr->amount);
+		}
 	}
 #ifdef WITH_CONSOLE
 	tprintf(LOG_VVV, __func__, "Concentrations updated");
@@ -364,19 +475,62 @@ void updateConcentrations() {
  * Decays the concentrations in each cell in the grid. Complexity O(c*p), with c the amount of
  * cells, p the amount of products. The decay is constant, independent on the concentration.
  */
-void decayConcentrations() {
-	//#ifdef WITH_CONSOLE
-	//	//	tprintf(LOG_INFO, __func__, "Start");
-	//#endif
-	//	gc = s->gridcells;
-	//	do {
-	//		struct Product *lp = gc->products;
-	//		while (lp != NULL) {
-	//			changeConcentration(lp, -s->decay_step);
-	//			lp = lp->next;
-	//		}
-	//		gc = gc->next;
-	//	} while (gc != s->gridcells);
+void decayConcentrations(struct Space *ls) {
+	//	uint16_t i, size = s->product_count * s->rows * s->columns;
+	//	for (i = 0; i < size; i++) {
+	//		uint8_t c = s->concentrations[i];
+	//		s->concentrations[i] = c > s->decay_step ? c - s->decay_step : 0;
+	//	}
+}
+
+/**
+ * The part that the cells from first up to last give to each of their neighbours, to be
+ * received by receiveConcentrations. The part is subtracted from the concentrations c right
+ * away, and stored in the diffusion plane d.
+ */
+static void giveConcentrations(struct Space *ls, uint8_t *restrict c, uint8_t *restrict d,
+		uint32_t first, uint32_t last) {
+	uint8_t ratio = ls->diffuse_ratio;
+	uint16_t reciprocal = 65535 / ratio + 1; //exact division for ratios from 2 on
+	const uint8_t *restrict neighbours = ls->neighbours;
+	uint32_t i;
+	for (i = first; i < last; i++) {
+		uint8_t part = (uint8_t)(((uint32_t)c[i] * reciprocal) >> 16);
+		part = c[i] > ratio ? part : 0;
+		uint8_t given = part * neighbours[i];
+		d[i] = part;
+		c[i] = c[i] > given ? c[i] - given : 0;
+	}
+}
+
+/**
+ * Adds what the cells from first up to last receive from their neighbours to the new
+ * concentrations nc. The neighbours north and south may lie outside this range, so all parts
+ * have to be given before.
+ */
+static void receiveConcentrations(struct Space *ls, uint8_t *restrict nc,
+		const uint8_t *restrict d, uint32_t first, uint32_t last) {
+	const uint8_t *restrict east = ls->east, *restrict west = ls->west;
+	const uint8_t *from_east = d + 1, *from_west = d - 1;
+	const uint8_t *from_north = d - ls->columns, *from_south = d + ls->columns;
+	uint32_t i;
+	for (i = first; i < last; i++) {
+		uint8_t sum = nc[i] + (from_east[i] & east[i]) + (from_west[i] & west[i]) +
+				from_north[i] + from_south[i];
+		nc[i] = sum > 100 ? 100 : sum;
+	}
+}
+
+static void averageConcentrations(uint8_t *restrict c, const uint8_t *restrict nc,
+		uint32_t first, uint32_t last) {
+	uint32_t i;
+	for (i = first; i < last; i++) {
+		c[i] = ((uint16_t)nc[i] + c[i]) / 2;
+	}
+}
+
+static uint8_t *getDiffusionPlane(struct Space *ls, uint8_t product_id) {
+	return &ls->diffusion[(uint32_t)product_id * DIFFUSION_PLANE_SIZE(ls) + ls->columns];
 }
 
 /**
@@ -385,116 +539,281 @@ void decayConcentrations() {
  * The concentration of the gene product in question doesn't have an influence on the diffusion
  * amounts. However, the concentration at the source location decrements of course.
  *
+ * A cell with a concentration above the diffuse ratio gives a part (concentration / ratio) to
+ * each of its neighbours, which is added in the new concentrations (up to 100), and subtracted
+ * from its own concentration. A cell only reads its own concentration, so this is a stencil
+ * over each plane: first the part that every cell gives, then what each cell receives from its
+ * neighbours. The loops do not branch, the division is a multiplication by the reciprocal, and
+ * all values stay below 256, so a compiler can vectorize them over bytes (SSE2, NEON). The
+ * masks keep a cell at the east border from receiving from the first cell of the next row, and
+ * the padding of the diffusion plane supplies zeros north and south.
+ *
+ * With more than one tile, updateGridTiles does the same over the tiles in parallel.
+ *
  * Complexity O(c*p*l) with c the amount of cells, p the amount of products and l the amount of
  * links between cells or in other words the amount of neighbours.
  *
- * @todo There is also no inter-unit diffusion yet, which should be implemented through inter-robot
- * links. The instruction "gc = lc->to" which switches the current active grid cell to the target
- * cell of the connection and the subsequent command "precalculateChangeConcentration" should in that case be
- * interpreted as a inter-module command involving communication. That's easy to do, in "gc" there
- * should be a "local" versus "remote" field and "precalculateChangeConcentration" should check that field
- * and relay the command if needed (put it on its "task output queue").
+ * Diffusion over the sides on which other robots are docked goes by halo: the parts given
+ * over a side are packed into one frame per neighbour, which is sent before the cells receive
+ * their parts, so the exchange overlaps with that pass. See sendGridHalos.
  */
-void diffuseConcentrations() {
+void diffuseConcentrations(struct Space *ls) {
 #ifdef WITH_CONSOLE
 	tprintf(LOG_VVV, __func__, "New diffusion iteration");
 #endif
-	struct GridCell *lgc = s->gridcells; int8_t diffuse_amount;
-	do {
-		struct Product *lp = lgc->products;
-
-		while (lp != NULL) {
-			struct GridConnection *lc = lgc->connections;
-			diffuse_amount = 0;
-			while (lc != NULL) {
-				if (lp->concentration > s->diffuse_ratio) {
-					gc = lc->to;
+	uint8_t p;
+	uint32_t n = ls->rows * ls->columns;
+	for (p = 0; p < ls->product_count; p++) {
+		uint8_t *d = getDiffusionPlane(ls, p);
+		giveConcentrations(ls, &ls->concentrations[p * n], d, 0, n);
+		if (!ls->remote) receiveConcentrations(ls, &ls->new_concentrations[p * n], d, 0, n);
+	}
+	if (!ls->remote) return;
+	sendGridHalos(ls);
+	for (p = 0; p < ls->product_count; p++) {
+		receiveConcentrations(ls, &ls->new_concentrations[p * n], getDiffusionPlane(ls, p), 0, n);
+	}
+	receiveGridHalos(ls);
+}
+
+void copyConcentrationsToNew(struct Space *ls) {
 #ifdef WITH_CONSOLE
-					char text[100];
-					sprintf(text, "Change concentration of %i @[%i,%i] with %i. Caused by %i @[%i,%i].",
-							lp->id[0],	gc->position->x, gc->position->y, lp->concentration / s->diffuse_ratio,
-							lp->concentration, lgc->position->x, lgc->position->y);
-					tprintf(LOG_VVVV, __func__, text);
+	tprintf(LOG_VVV, __func__, "Copy concentration values");
 #endif
-					struct Product *ltop = getProduct((struct ProductId*)lp->id);
-					precalculateChangeConcentration(ltop, lp->concentration / s->diffuse_ratio);
-					diffuse_amount += (lp->concentration / s->diffuse_ratio);
-				}
-				lc = lc->next;
+	memcpy(ls->new_concentrations, ls->concentrations,
+			(uint32_t)ls->product_count * ls->rows * ls->columns);
+#ifdef WITH_CONSOLE
+	tprintf(LOG_VVV, __func__, "Concentrations copied");
+#endif
+}
+
+void avgConcentrationsToCurrent(struct Space *ls) {
+	averageConcentrations(ls->concentrations, ls->new_concentrations, 0,
+			(uint32_t)ls->product_count * ls->rows * ls->columns);
+}
+
+/**
+ * Updates the rows of one tile, in all planes. In the first phase the concentrations are
+ * copied to the new ones and the parts to give are computed. In the second phase the cells
+ * receive their parts, also from the rows of the tiles next to it, and the result is averaged.
+ * If robots are docked, the averaging is a third phase, after their halos are received. The
+ * grid is the one of the context of the tile, whichever context the monk is in.
+ */
+static void *updateGridTile(void *context) {
+	struct GridTile *tile = (struct GridTile*)context;
+	struct Space *ls = tile->context->s;
+	uint32_t n = ls->rows * ls->columns;
+	uint32_t first = tile->first_row * ls->columns, last = tile->last_row * ls->columns;
+	uint8_t p;
+	for (p = 0; p < ls->product_count; p++) {
+		uint8_t *c = &ls->concentrations[p * n], *nc = &ls->new_concentrations[p * n];
+		if (ls->tile_phase == 0) {
+			memcpy(&nc[first], &c[first], last - first);
+			giveConcentrations(ls, c, getDiffusionPlane(ls, p), first, last);
+		} else if (ls->tile_phase == 1) {
+			receiveConcentrations(ls, nc, getDiffusionPlane(ls, p), first, last);
+			if (!ls->remote) averageConcentrations(c, nc, first, last);
+		} else {
+			averageConcentrations(c, nc, first, last);
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Copies, diffuses and averages the concentrations like updateGrid does, but per tile of rows,
+ * which are dispatched to the monks. The first tile is done by the caller. Joining all tiles
+ * after the first phase is the barrier after which the parts in the rows at the border of a
+ * tile, the halo, can be received by the tile next to it. A tile that can not be dispatched is
+ * done by the caller too, so the outcome does not depend on the amount of monks. Every tile
+ * carries the context of its grid, so it does not matter which context the caller entered.
+ * The halos of docked robots are sent and received by the caller between the phases.
+ */
+static void updateGridTiles(struct Space *ls) {
+	struct AbbeyHandle *handles[ls->tile_count];
+	uint8_t i, phases = ls->remote ? 3 : 2;
+	for (ls->tile_phase = 0; ls->tile_phase < phases; ls->tile_phase++) {
+		if (ls->tile_phase == 1 && ls->remote) sendGridHalos(ls);
+		if (ls->tile_phase == 2) receiveGridHalos(ls);
+		for (i = 1; i < ls->tile_count; i++) {
+			handles[i] = dispatch_joinable_task(updateGridTile, &ls->tiles[i],
+					"update grid tile", ABBEY_PRIORITY_NORMAL);
+		}
+		updateGridTile(&ls->tiles[0]);
+		for (i = 1; i < ls->tile_count; i++) {
+			if (handles[i] == NULL) {
+				updateGridTile(&ls->tiles[i]);
+				continue;
 			}
-			gc = lgc;
-			changeConcentration(lp, -diffuse_amount);
-			//			changeConcentration(lp, -diffuse_amount / 2);
-			lp = lp->next;
+			abbey_join(handles[i]);
+			abbey_release_handle(handles[i]);
 		}
-		lgc = lgc->next;
-	} while (lgc != s->gridcells);
+	}
 }
 
-void copyConcentrationsToNew() {
-#ifdef WITH_CONSOLE
-	tprintf(LOG_VVV, __func__, "Copy concentration values");
-#endif
-	struct GridCell *lgc = s->gridcells;
-	do {
-		struct Product *lp = lgc->products;
-		while (lp != NULL) {
-			lp->new_concentration = lp->concentration;
-			lp = lp->next;
+/**
+ * Adds the parts that the cells along the sides with a docked robot gave in this step to the
+ * outgoing halos, saturating at 255. Every halo_interval steps the halos are sent, one frame
+ * per neighbour with all products, and emptied. In between, the parts given to the other
+ * robot are only collected, so a larger interval costs less bandwidth, but diffusion between
+ * the robots lags behind.
+ */
+static void sendGridHalos(struct Space *ls) {
+	uint8_t side, p;
+	uint16_t k, exchange = ls->halo_step / ls->halo_interval;
+	uint8_t exchanged = !((ls->halo_step + 1) % ls->halo_interval);
+	for (side = 0; side < GRID_SIDES; side++) {
+		struct GridBorder *lb = &ls->borders[side];
+		if (lb->robot < 0) continue;
+		uint8_t *out = lb->outgoing;
+		for (p = 0; p < ls->product_count; p++) {
+			const uint8_t *d = getDiffusionPlane(ls, p);
+			for (k = 0; k < lb->length; k++, out++) {
+				uint16_t sum = *out + d[getBorderCell(ls, side, k)];
+				*out = sum > 255 ? 255 : sum;
+			}
 		}
-		lgc = lgc->next;
-	} while (lgc != s->gridcells);
+		if (!exchanged) continue;
+		uint16_t size = lb->length * ls->product_count;
+		if (sendGridHalo != NULL) sendGridHalo(side, lb->robot, exchange, lb->outgoing, size);
+		memset(lb->outgoing, 0, size);
+	}
+}
+
+/**
+ * When the halos are exchanged in this step, waits for those of all docked robots and adds
+ * them to the new concentrations of the cells along the sides, up to 100. A robot that does
+ * not send its halo in time is undocked, the cells along its side do not give to it anymore.
+ */
+static void receiveGridHalos(struct Space *ls) {
+	uint8_t side, p;
+	uint16_t k, exchange = ls->halo_step / ls->halo_interval, slot = exchange & 1;
+	uint32_t n = ls->rows * ls->columns;
+	uint8_t exchanged = !((ls->halo_step + 1) % ls->halo_interval);
+	struct timespec deadline;
+	ls->halo_step++;
+	if (!exchanged) return;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += GRID_HALO_TIMEOUT / 1000;
+	deadline.tv_nsec += (GRID_HALO_TIMEOUT % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+	pthread_mutex_lock(&haloMutex);
+	for (side = 0; side < GRID_SIDES; side++) {
+		struct GridBorder *lb = &ls->borders[side];
+		if (lb->robot < 0) continue;
+		while (lb->exchange[slot] != exchange + 1) {
+			if (pthread_cond_timedwait(&haloArrived, &haloMutex, &deadline) == ETIMEDOUT) break;
+		}
+		if (lb->exchange[slot] != exchange + 1) {
 #ifdef WITH_CONSOLE
-	tprintf(LOG_VVV, __func__, "Concentrations copied");
+			char text[64];
+			sprintf(text, "No halo from robot %i, undock it", lb->robot);
+			tprintf(LOG_WARNING, __func__, text);
 #endif
+			lb->robot = -1;
+			ls->remote--;
+			for (k = 0; k < lb->length; k++) {
+				ls->neighbours[getBorderCell(ls, side, k)]--;
+			}
+			continue;
+		}
+		const uint8_t *in = lb->incoming[slot];
+		for (p = 0; p < ls->product_count; p++) {
+			uint8_t *nc = &ls->new_concentrations[p * n];
+			for (k = 0; k < lb->length; k++, in++) {
+				uint32_t i = getBorderCell(ls, side, k);
+				uint16_t sum = nc[i] + *in;
+				nc[i] = sum > 100 ? 100 : sum;
+			}
+		}
+		lb->exchange[slot] = 0;
+	}
+	pthread_mutex_unlock(&haloMutex);
 }
 
-void avgConcentrationsToCurrent() {
-	struct GridCell *lgc = s->gridcells;
-	do {
-		struct Product *lp = lgc->products;
-		while (lp != NULL) {
-			lp->concentration = ((uint16_t)lp->new_concentration + lp->concentration) / 2;
-			lp = lp->next;
+/**
+ * Stores the halo that the robot docked on a side sent for the given exchange, with the parts
+ * packed per product like the outgoing ones. This is called by the engine, from any thread.
+ * Returns 0 if the halo does not fit, or nothing is developing with that robot.
+ */
+uint8_t receiveGridHalo(uint8_t side, uint8_t robot, uint16_t exchange, const uint8_t *parts,
+		uint16_t size) {
+	uint8_t taken = 0;
+	pthread_mutex_lock(&haloMutex);
+	if (halosActive && (side < GRID_SIDES)) {
+		struct GridBorder *lb = &clctx->s->borders[side];
+		if ((lb->robot == robot) && (size == lb->length * clctx->s->product_count)) {
+			memcpy(lb->incoming[exchange & 1], parts, size);
+			lb->exchange[exchange & 1] = exchange + 1;
+			pthread_cond_broadcast(&haloArrived);
+			taken = 1;
 		}
-		lgc = lgc->next;
-	} while (lgc != s->gridcells);
+	}
+	pthread_mutex_unlock(&haloMutex);
+	return taken;
 }
 
+/**
+ * Frees the halos of the borders. Must be called with the halo lock.
+ */
+static void freeGridHalos() {
+	uint8_t side;
+	for (side = 0; side < GRID_SIDES; side++) {
+		struct GridBorder *lb = &clctx->s->borders[side];
+		free(lb->outgoing);
+		free(lb->incoming[0]);
+		free(lb->incoming[1]);
+		lb->outgoing = lb->incoming[0] = lb->incoming[1] = NULL;
+	}
+	halosActive = 0;
+}
 
 /**
  * The concentrations in the grid cells, when exceeding a concentration incur morphological
  * changes, such as duplicating a neuron from one grid cell to another. Hence, for every
  * gridcell this is executed by calling a routine. Only the lower set of products are
  * phenotypic factors, the top set are regulating factors. Only the phenotypic factors code
- * for morphological changes.
+ * for morphological changes. Returns the amount of morphological changes applied.
  */
-void applyEmbryogenesis() {
-	gc = s->gridcells;
+uint16_t applyEmbryogenesisIn(struct ColindaContext *context) {
+	uint8_t i;
+	struct Space *ls = context->s;
+	uint32_t n = ls->rows * ls->columns;
+	uint16_t changes = 0;
+	//the cellular encoding operations find the neuron to change through the thread
+	struct ColindaContext *outer = switchColindaContext(context);
+	context->gc = ls->gridcells;
 	do {
-		if (gc->neuron != NULL) {
-			struct Product *lp = gc->products;
-			while (lp != NULL) {
-				if (lp->id[0] < gconf->phenotypicFactors) {
-					if (lp->concentration >= s->concentration_threshold) {
-						//check if neuron is still there: can be moved by morphological change
-						if (gc->neuron != NULL) {
-							np = gc->neuron;
+		if (context->gc->neuron != NULL) {
+			uint8_t *lc = &ls->concentrations[getGridCellIndex(context->gc)];
+			for (i = 0; i < context->gconf->phenotypicFactors; i++) {
+				if (lc[i * n] >= ls->concentration_threshold) {
+					//check if neuron is still there: can be moved by morphological change
+					if (context->gc->neuron != NULL) {
+						context->np = context->gc->neuron;
 #ifdef WITH_CONSOLE
-							char text[64];
-							sprintf(text, "Apply operation %i in cell [%i,%i]",
-									lp->id[0], gc->position->x, gc->position->y);
-							tprintf(LOG_VVV, __func__, text);
+						char text[64];
+						sprintf(text, "Apply operation %i in cell [%i,%i]",
+								i, context->gc->position.x, context->gc->position.y);
+						tprintf(LOG_VVV, __func__, text);
 #endif
-							applyMorphologicalChange(lp->id[0]);
-						}
+						applyMorphologicalChange(i);
+						changes++;
 					}
 				}
-				lp = lp->next;
 			}
 		}
-		gc = gc->next;
-	} while (gc != s->gridcells);
+		context->gc = context->gc->next;
+	} while (context->gc != ls->gridcells);
+	switchColindaContext(outer);
+	return changes;
+}
+
+uint16_t applyEmbryogenesis() {
+	return applyEmbryogenesisIn(&processContext);
 }
 
 /** @} */
@@ -514,7 +833,7 @@ void printConcentrations(uint8_t product_id);
 void printAllConcentrations() {
 	uint8_t i;
 	//	printf("Concentrations of all gene products in grid format\n\n");
-	for (i = 0; i < gconf->phenotypicFactors + gconf->regulatingFactors; i++) {
+	for (i = 0; i < clctx->gconf->phenotypicFactors + clctx->gconf->regulatingFactors; i++) {
 		printf("Gene product %i\n", i);
 		printConcentrations(i);
 		printf("\n");
@@ -526,8 +845,8 @@ void printConcentrationsPerRow(uint8_t product_id, uint8_t row_id);
 void printAllConcentrationsMultiplePerRow() {
 	uint8_t i, j;
 	//	printf("Concentrations of all gene products in grid format\n\n");
-	for (i = 0; i < gconf->phenotypicFactors + gconf->regulatingFactors; i+=5) {
-		for (j = 0; j < s->rows; j++) {
+	for (i = 0; i < clctx->gconf->phenotypicFactors + clctx->gconf->regulatingFactors; i+=5) {
+		for (j = 0; j < clctx->s->rows; j++) {
 			printConcentrationsPerRow(i, j);
 			printConcentrationsPerRow(i+1, j);
 			printConcentrationsPerRow(i+2, j);
@@ -541,45 +860,37 @@ void printAllConcentrationsMultiplePerRow() {
 
 
 void printConcentrationsPerRow(uint8_t product_id, uint8_t row_id) {
+	uint8_t *plane = getConcentrationPlane(product_id);
 	struct GridCell *lgc = getGridCell(0, row_id);
-	uint8_t cell_id = row_id * s->columns;
+	uint16_t cell_id = row_id * clctx->s->columns;
 	do {
-		struct Product *lp = lgc->products;
-		while (lp != NULL) {
-			if (lp->id[0] == product_id) break;
-			lp = lp->next;
-		}
-		if (lp != NULL) {
-			printf("%3i ", lp->concentration);
+		if (plane != NULL) {
+			printf("%3i ", plane[getGridCellIndex(lgc)]);
 		} else {
 			printf("    ");
 		}
 		cell_id++;
-		if (!(cell_id % 5)) {
+		if (!(cell_id % clctx->s->columns)) {
 			printf("  ");
 			break;
 		}
 		lgc = lgc->next;
-	} while (lgc != s->gridcells);
+	} while (lgc != clctx->s->gridcells);
 }
 
 void printConcentrations(uint8_t product_id) {
-	struct GridCell *lgc = s->gridcells; uint8_t cell_id = 0;
+	uint8_t *plane = getConcentrationPlane(product_id);
+	struct GridCell *lgc = clctx->s->gridcells; uint16_t cell_id = 0;
 	do {
-		struct Product *lp = lgc->products;
-		while (lp != NULL) {
-			if (lp->id[0] == product_id) break;
-			lp = lp->next;
-		}
-		if (lp != NULL) {
-			printf("%3i ", lp->concentration);
+		if (plane != NULL) {
+			printf("%3i ", plane[getGridCellIndex(lgc)]);
 		} else {
 			printf("FFF ");
 		}
 		cell_id++;
-		if (!(cell_id % 5)) printf("\n");
+		if (!(cell_id % clctx->s->columns)) printf("\n");
 		lgc = lgc->next;
-	} while (lgc != s->gridcells);
+	} while (lgc != clctx->s->gridcells);
 }
 
 void printConcentrationUpdates(uint8_t product_id);
@@ -587,7 +898,7 @@ void printConcentrationUpdates(uint8_t product_id);
 void printAllConcentrationUpdates() {
 	uint8_t i;
 	//		printf("Concentrations of all gene products in grid format\n\n");
-	for (i = 0; i < gconf->phenotypicFactors + gconf->regulatingFactors; i++) {
+	for (i = 0; i < clctx->gconf->phenotypicFactors + clctx->gconf->regulatingFactors; i++) {
 		printf("Gene product %i\n", i);
 		printConcentrationUpdates(i);
 		printf("\n");
@@ -595,37 +906,34 @@ void printAllConcentrationUpdates() {
 }
 
 void printConcentrationUpdates(uint8_t product_id) {
-	struct GridCell *lgc = s->gridcells; uint8_t cell_id = 0;
+	uint8_t *plane = (product_id < clctx->s->product_count) ?
+			&clctx->s->new_concentrations[product_id * clctx->s->rows * clctx->s->columns] : NULL;
+	struct GridCell *lgc = clctx->s->gridcells; uint16_t cell_id = 0;
 	do {
-		struct Product *lp = lgc->products;
-		while (lp != NULL) {
-			if (lp->id[0] == product_id) break;
-			lp = lp->next;
-		}
-		if (lp != NULL) {
-			printf("%3i ", lp->new_concentration);
+		if (plane != NULL) {
+			printf("%3i ", plane[getGridCellIndex(lgc)]);
 		} else {
 			printf("FFF ");
 		}
 		cell_id++;
-		if (!(cell_id % 5)) printf("\n");
+		if (!(cell_id % clctx->s->columns)) printf("\n");
 		lgc = lgc->next;
-	} while (lgc != s->gridcells);
+	} while (lgc != clctx->s->gridcells);
 }
 
 void printGrid2() {
 	struct Neuron *ln;
 	printf("Grid:  ");
-	uint8_t i = 0;
-	for (i=0; i < s->columns; i++) printf("%d  ", i);
+	uint16_t i = 0;
+	for (i=0; i < clctx->s->columns; i++) printf("%d  ", i);
 	printf("\n      ");
-	for (i=0; i < s->columns; i++) printf("---");
+	for (i=0; i < clctx->s->columns; i++) printf("---");
 	printf("\n");
-	struct GridCell *lgc = s->gridcells;
+	struct GridCell *lgc = clctx->s->gridcells;
 	i = 0;
 	do {
 		ln = lgc->neuron;
-		if (!(i % 5)) printf("   %d |", i % 5);
+		if (!(i % clctx->s->columns)) printf("   %d |", i / clctx->s->columns);
 		if (ln != NULL) {
 			if ((ln->type & TOPOLOGY_MASK) == OUTPUT_NEURON)
 				printf(" O ");
@@ -636,9 +944,9 @@ void printGrid2() {
 		} else {
 			printf("   ");
 		}
-		if ((i % 5) == 4) printf("\n");
+		if ((i % clctx->s->columns) == clctx->s->columns - 1) printf("\n");
 		lgc = lgc->next; i++;
-	} while (lgc != s->gridcells);
+	} while (lgc != clctx->s->gridcells);
 	printf("\n");	
 }
 
@@ -646,13 +954,13 @@ void printGridToStr(char *string) {
 	struct Neuron *ln;
 	uint8_t x,y;
 	sprintf(string, "Grid:  ");
-	for (y=0; y < s->columns; y++) sprintf(string, "%s%d  ", string, y);
+	for (y=0; y < clctx->s->columns; y++) sprintf(string, "%s%d  ", string, y);
 	sprintf(string, "%s\n      ", string);
-	for (y=0; y < s->columns; y++) sprintf(string, "%s---", string);
+	for (y=0; y < clctx->s->columns; y++) sprintf(string, "%s---", string);
 	sprintf(string, "%s\n", string);
-	for (y=0; y < s->rows; y++) {
+	for (y=0; y < clctx->s->rows; y++) {
 		sprintf(string, "%s   %d |", string, y);
-		for (x=0;x < s->columns; x++) {
+		for (x=0;x < clctx->s->columns; x++) {
 			ln = getGridCell(x,y)->neuron;
 			if (ln != NULL) {
 				if ((ln->type & TOPOLOGY_MASK) == OUTPUT_NEURON)
@@ -676,13 +984,13 @@ void printGrid() {
 	struct Neuron *ln;
 	uint8_t x,y;
 	printf("Grid:  ");
-	for (y=0; y < s->columns; y++) printf("%d  ", y);
+	for (y=0; y < clctx->s->columns; y++) printf("%d  ", y);
 	printf("\n      ");
-	for (y=0; y < s->columns; y++) printf("---");
+	for (y=0; y < clctx->s->columns; y++) printf("---");
 	printf("\n");
-	for (y=0; y < s->rows; y++) {
+	for (y=0; y < clctx->s->rows; y++) {
 		printf("   %d |", y);
-		for (x=0;x < s->columns; x++) {
+		for (x=0;x < clctx->s->columns; x++) {
 			ln = getGridCell(x,y)->neuron;
 			if (ln != NULL) {
 				if ((ln->type & TOPOLOGY_MASK) == OUTPUT_NEURON)
@@ -708,15 +1016,15 @@ void drawGrid() {
 	gnuplot_ctrl *h1;
 	h1 = gnuplot_init();
 	gnuplot_setstyle(h1, "points");
-	uint8_t x,y,z = 0;
-	double *x_axis = (double*) calloc(s->columns, sizeof(double));
-	double *y_axis = (double*) calloc(s->rows, sizeof(double));
-	double *z_axis = (double*) calloc(s->columns * s->rows, sizeof(double));
-	for (x=0; x < s->columns; x++) x_axis[x] = x;
-	for (y=0; y < s->rows; y++) y_axis[y] = y;
-	for (x=0; x < s->columns; x++) {
-		for (y=0; y < s->rows; y++) {
-			z = x*s->columns + y;
+	uint8_t x,y; uint16_t z = 0;
+	double *x_axis = (double*) calloc(clctx->s->columns, sizeof(double));
+	double *y_axis = (double*) calloc(clctx->s->rows, sizeof(double));
+	double *z_axis = (double*) calloc(clctx->s->columns * clctx->s->rows, sizeof(double));
+	for (x=0; x < clctx->s->columns; x++) x_axis[x] = x;
+	for (y=0; y < clctx->s->rows; y++) y_axis[y] = y;
+	for (x=0; x < clctx->s->columns; x++) {
+		for (y=0; y < clctx->s->rows; y++) {
+			z = x*clctx->s->columns + y;
 			struct Neuron *ln = getGridCell(x,y)->neuron;
 			if (ln != NULL) {
 				if ((ln->type & TOPOLOGY_MASK) == OUTPUT_NEURON)
@@ -730,7 +1038,7 @@ void drawGrid() {
 			}
 		}
 	}
-	gnuplot_splot(h1,x_axis,y_axis,z_axis,s->columns * s->rows,"Grid");
+	gnuplot_splot(h1,x_axis,y_axis,z_axis,clctx->s->columns * clctx->s->rows,"Grid");
 
 	//needs to be freed
 }
@@ -768,13 +1076,14 @@ void drawAllConcentrations(uint16_t fileIndex) {
 	gnuplot_cmd(handle, "set origin 0,0");
 
 	char text[64];
-	uint8_t columns = 4, rows = (gconf->phenotypicFactors + gconf->regulatingFactors + columns-1) / columns;
+	uint8_t columns = 4, rows = (clctx->gconf->phenotypicFactors +
+			clctx->gconf->regulatingFactors + columns-1) / columns;
 	uint8_t i = 0;
 	sprintf(text, "set multiplot layout %i,%i rowsfirst scale 1.8,2.0", rows+1,columns);
 
 	//	tprintf(LOG_VERBOSE, __func__, text);
 	gnuplot_cmd(handle, text);
-	while (i < gconf->phenotypicFactors + gconf->regulatingFactors) {
+	while (i < clctx->gconf->phenotypicFactors + clctx->gconf->regulatingFactors) {
 		drawAgainConcentrations(i, fileIndex, handle);
 		i++;
 	}
@@ -811,30 +1120,26 @@ void drawConcentrations(uint8_t product_id, uint16_t fileIndex) {
 }
 
 void drawAgainConcentrations(uint8_t product_id, uint16_t fileIndex, gnuplot_ctrl *handle) {
-	uint8_t n = s->columns * s->rows;
-	uint8_t x = 0, y = 0, i = 0;
+	uint16_t n = clctx->s->columns * clctx->s->rows;
+	uint16_t x = 0, y = 0, i = 0;
 	double *x_axis = (double*) calloc(n, sizeof(double));
 	double *y_axis = (double*) calloc(n, sizeof(double));
 	double *z_axis = (double*) calloc(n, sizeof(double));
 
-	struct GridCell *lgc = s->gridcells;
+	uint8_t *plane = getConcentrationPlane(product_id);
+	struct GridCell *lgc = clctx->s->gridcells;
 	do {
-		struct Product *lp = lgc->products;
-		while (lp != NULL) {
-			if (lp->id[0] == product_id) break;
-			lp = lp->next;
-		}
 		x_axis[i] = x;
 		y_axis[i] = y;
-		if (lp != NULL) {
-			z_axis[i] = lp->concentration;
+		if (plane != NULL) {
+			z_axis[i] = plane[i];
 		} else {
 			z_axis[i] = 0;
 		}
 		lgc = lgc->next;
 		i++; x++;
-		if (!(i % 5)) { y++; x = 0; }
-	} while (lgc != s->gridcells);
+		if (!(i % clctx->s->columns)) { y++; x = 0; }
+	} while (lgc != clctx->s->gridcells);
 	gnuplot_splot(handle, x_axis, y_axis, z_axis, n, "%");
 	free(x_axis);
 	free(y_axis);
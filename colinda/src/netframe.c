@@ -0,0 +1,252 @@
+/**
+ * @file netframe.c
+ *
+ * The neurons are numbered in the order of the list of the network. The incoming ports of a
+ * neuron are built in the order of its pre-synaptic neurons, which is all the compiled network
+ * needs, the order of the outgoing ports is that of the frame.
+ *
+ * @date_created    Oct 14, 2026
+ * @date_modified   Oct 14, 2026
+ * @author          Anne C. van Rossum
+ * @project         Replicator
+ * @company         Almende B.V.
+ * @license         open-source, GNU Lesser General Public License
+ */
+
+#include <lindaconfig.h>
+#include <netframe.h>
+#include <grid.h>
+#include <topology.h>
+#include <neuron.h>
+#include <region.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WITH_SYMBRICATOR
+#include "portable.h"
+#endif
+
+#ifdef WITH_CONSOLE
+#include <linda/log.h>
+#endif
+
+/****************************************************************************************************
+ *  		Implementations
+ ***************************************************************************************************/
+
+static uint8_t *put16(uint8_t *p, uint16_t value) {
+	p[0] = value >> 8; p[1] = value;
+	return p + 2;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t value) {
+	p[0] = value >> 24; p[1] = value >> 16; p[2] = value >> 8; p[3] = value;
+	return p + 4;
+}
+
+static uint8_t *putFloat(uint8_t *p, float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, 4);
+	return put32(p, bits);
+}
+
+static uint16_t get16(const uint8_t *p) {
+	return (p[0] << 8) | p[1];
+}
+
+static uint32_t get32(const uint8_t *p) {
+	return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static float getFloat(const uint8_t *p) {
+	uint32_t bits = get32(p);
+	float value;
+	memcpy(&value, &bits, 4);
+	return value;
+}
+
+uint32_t networkFrameSize() {
+	struct Neuron *ln;
+	struct Port *lp;
+	uint32_t size = NETFRAME_HEADER;
+	for (ln = clctx->nn->neurons; ln != NULL; ln = ln->next) {
+		size += NETFRAME_NEURON;
+		for (lp = ln->ports_out; lp != NULL; lp = lp->next) size += NETFRAME_SYNAPSE;
+	}
+	return size;
+}
+
+void writeNetworkFrame(uint8_t *frame) {
+	struct Neuron *ln;
+	struct Port *lp;
+	uint16_t i, cells = clctx->s->rows * clctx->s->columns, neuron_count = 0, count;
+	uint32_t synapse_count = 0;
+	//the number of the neuron in every cell, for the post-synaptic neurons
+	uint16_t *numbers = lindaMalloc(cells * sizeof(uint16_t));
+	for (i = 0; i < cells; i++) {
+		numbers[i] = NO_NEURON;
+	}
+	for (ln = clctx->nn->neurons; ln != NULL; ln = ln->next) {
+		numbers[getGridCellIndex(ln->gridcell)] = neuron_count++;
+		for (lp = ln->ports_out; lp != NULL; lp = lp->next) synapse_count++;
+	}
+
+	uint8_t *p = put32(frame, NETFRAME_MAGIC);
+	*p++ = clctx->s->rows;
+	*p++ = clctx->s->columns;
+	p = put16(p, neuron_count);
+	p = put32(p, synapse_count);
+	for (ln = clctx->nn->neurons; ln != NULL; ln = ln->next) {
+		p = put16(p, getGridCellIndex(ln->gridcell));
+		*p++ = ln->type;
+		p = put16(p, ln->history->spike_bitseq);
+		p = putFloat(p, ln->v);
+		p = putFloat(p, ln->u);
+		p = putFloat(p, ln->a);
+		p = putFloat(p, ln->b);
+		p = putFloat(p, ln->c);
+		p = putFloat(p, ln->d);
+		p = putFloat(p, ln->I);
+		for (count = 0, lp = ln->ports_out; lp != NULL; lp = lp->next) count++;
+		p = put16(p, count);
+	}
+	for (ln = clctx->nn->neurons; ln != NULL; ln = ln->next) {
+		for (lp = ln->ports_out; lp != NULL; lp = lp->next) {
+			struct Neuron *post = lp->synapse->post_neuron;
+			p = put16(p, post != NULL ? numbers[getGridCellIndex(post->gridcell)] : NO_NEURON);
+			*p++ = lp->synapse->delay;
+			p = putFloat(p, lp->synapse->weight);
+		}
+	}
+	free(numbers);
+}
+
+/**
+ * Adds a port for the synapse to the end of a list of ports, of which the last one is kept in
+ * tail. Returns NULL if the region is full.
+ */
+static struct Port *appendPort(struct Port **head, struct Port **tail, struct Synapse *ls,
+		uint8_t direction) {
+	struct Port *lp = regionAlloc(REGION_PORT, sizeof(struct Port));
+	if (lp == NULL) return NULL;
+	lp->synapse = ls;
+	lp->direction = direction;
+	lp->next = NULL;
+	lp->prev = *tail;
+	lp->opposite = NULL;
+	if (*tail == NULL) *head = lp;
+	else (*tail)->next = lp;
+	*tail = lp;
+	return lp;
+}
+
+/**
+ * The neurons and their state, in the order of the frame. Returns 0 if a neuron does not fit
+ * the grid or the region.
+ */
+static uint8_t readNeurons(const uint8_t *p, uint16_t neuron_count, struct Neuron **neurons) {
+	uint16_t i, cell, cells = clctx->s->rows * clctx->s->columns;
+	struct Neuron **lnp = &clctx->nn->neurons;
+	for (i = 0; i < neuron_count; i++, p += NETFRAME_NEURON) {
+		cell = get16(p);
+		if ((cell >= cells) || (clctx->s->gridcells[cell].neuron != NULL)) return 0;
+		struct Neuron *ln = regionAlloc(REGION_NEURON, sizeof(struct Neuron));
+		if (ln == NULL) return 0;
+		clctx->s->gridcells[cell].neuron = neurons[i] = *lnp = ln;
+		ln->gridcell = &clctx->s->gridcells[cell];
+		ln->history = regionAlloc(REGION_HISTORY, sizeof(struct SpikeHistory));
+		if (ln->history == NULL) return 0;
+		ln->type = p[2];
+		ln->history->spike_bitseq = get16(p + 3);
+		ln->v = getFloat(p + 5);
+		ln->u = getFloat(p + 9);
+		ln->a = getFloat(p + 13);
+		ln->b = getFloat(p + 17);
+		ln->c = getFloat(p + 21);
+		ln->d = getFloat(p + 25);
+		ln->I = getFloat(p + 29);
+		ln->method = NULL;
+		ln->ports_out = ln->ports_in = NULL;
+		lnp = &ln->next;
+	}
+	*lnp = NULL;
+	return 1;
+}
+
+/**
+ * The synapses of every neuron, with a port out on it and a port in on the post-synaptic
+ * neuron. The last ports in are kept in tails.
+ */
+static uint8_t readSynapses(const uint8_t *lneurons, const uint8_t *p, uint16_t neuron_count,
+		struct Neuron **neurons, struct Port **tails) {
+	uint16_t i, j, count, post;
+	for (i = 0; i < neuron_count; i++) {
+		struct Neuron *ln = neurons[i];
+		struct Port *tail = NULL;
+		count = get16(lneurons + (uint32_t)i * NETFRAME_NEURON + NETFRAME_NEURON - 2);
+		for (j = 0; j < count; j++, p += NETFRAME_SYNAPSE) {
+			post = get16(p);
+			if ((post >= neuron_count) && (post != NO_NEURON)) return 0;
+			struct Synapse *ls = regionAlloc(REGION_SYNAPSE, sizeof(struct Synapse));
+			if (ls == NULL) return 0;
+			ls->pre_neuron = ln;
+			ls->post_neuron = post != NO_NEURON ? neurons[post] : NULL;
+			ls->delay = p[2];
+			ls->weight = getFloat(p + 3);
+			struct Port *lout = appendPort(&ln->ports_out, &tail, ls, PORT_OUT);
+			if (lout == NULL) return 0;
+			if (post == NO_NEURON) continue;
+			struct Port *lin = appendPort(&neurons[post]->ports_in, &tails[post], ls, PORT_IN);
+			if (lin == NULL) return 0;
+			lout->opposite = lin;
+			lin->opposite = lout;
+		}
+		ln->current_port = ln->ports_out;
+	}
+	return 1;
+}
+
+uint8_t readNetworkFrame(const uint8_t *frame, uint32_t size) {
+	uint16_t i, neuron_count, cells = clctx->s->rows * clctx->s->columns;
+	uint32_t synapse_count, count = 0;
+	uint8_t built = 0;
+	if ((size < NETFRAME_HEADER) || (get32(frame) != NETFRAME_MAGIC) ||
+			(frame[4] != clctx->s->rows) || (frame[5] != clctx->s->columns)) return 0;
+	neuron_count = get16(frame + 6);
+	synapse_count = get32(frame + 8);
+	const uint8_t *lneurons = frame + NETFRAME_HEADER;
+	const uint8_t *lsynapses = lneurons + (uint32_t)neuron_count * NETFRAME_NEURON;
+	//in 64 bits, a synapse count that wraps around could match the counts of the neurons
+	if ((neuron_count > cells) ||
+			(size != NETFRAME_HEADER + (uint64_t)neuron_count * NETFRAME_NEURON +
+			(uint64_t)synapse_count * NETFRAME_SYNAPSE)) return 0;
+	for (i = 0; i < neuron_count; i++) {
+		count += get16(lneurons + (uint32_t)i * NETFRAME_NEURON + NETFRAME_NEURON - 2);
+	}
+	if (count != synapse_count) return 0;
+
+	struct Neuron **neurons = lindaMalloc((neuron_count + 1) * sizeof(struct Neuron*));
+	struct Port **tails = lindaMalloc((neuron_count + 1) * sizeof(struct Port*));
+	if ((neurons != NULL) && (tails != NULL)) {
+		for (i = 0; i < neuron_count; i++) {
+			tails[i] = NULL;
+		}
+		built = readNeurons(lneurons, neuron_count, neurons) &&
+				readSynapses(lneurons, lsynapses, neuron_count, neurons, tails);
+	}
+	free(tails);
+	free(neurons);
+	if (!built) {
+#ifdef WITH_CONSOLE
+		tprintf(LOG_WARNING, __func__, "Network frame does not fit");
+#endif
+		for (i = 0; i < cells; i++) {
+			clctx->s->gridcells[i].neuron = NULL;
+		}
+		clctx->nn->neurons = NULL;
+		regionReset();
+		return 0;
+	}
+	clctx->np = clctx->nn->neurons;
+	return 1;
+}
@@ -9,6 +9,21 @@
 #include <neuron.h>
 #include <bits.h>
 
+/**
+ * With gcc the neuron arrays are updated in vectors of NEURON_LANES neurons, which become SSE,
+ * AVX or NEON instructions when the target has them, or plain instructions if not. The first
+ * half of the Euler step is in double precision, like in update, so the result is the same.
+ */
+#if defined(WITH_NEURON_VECTORS) && defined(__GNUC__) && (__GNUC__ >= 9)
+#define NEURON_VECTORS
+typedef float vfloat __attribute__((vector_size(NEURON_LANES * sizeof(float))));
+typedef double vdouble __attribute__((vector_size(NEURON_LANES * sizeof(double))));
+typedef int32_t vmask __attribute__((vector_size(NEURON_LANES * sizeof(int32_t))));
+#define VLOAD(x, p) __builtin_memcpy(&(x), (p), sizeof(x))
+#define VSTORE(p, x) __builtin_memcpy((p), &(x), sizeof(x))
+#define VSELECT(m, x, y) ((vfloat)(((m) & (vmask)(x)) | (~(m) & (vmask)(y))))
+#endif
+
 #ifdef WITH_CONSOLE
 #include <stdio.h> //only for printf
 #include <linda/log.h>
@@ -19,30 +34,30 @@
  * To see the graphs, use testNeuron, however, adapt the time scale and the input each time.
  */
 void init_neuron() {
-	switch (n->type & NEURONTYPE_MASK) {
+	switch (clctx->n->type & NEURONTYPE_MASK) {
 	case NEURONTYPE_TONIC_SPIKING:
-		n->a = +0.02; n->b = +0.20; n->c = -65.0; n->d = +6.00;
-		n->v = -70.0; n->u = n->v * n->b;
+		clctx->n->a = +0.02; clctx->n->b = +0.20; clctx->n->c = -65.0; clctx->n->d = +6.00;
+		clctx->n->v = -70.0; clctx->n->u = clctx->n->v * clctx->n->b;
 		break;
 	case NEURONTYPE_PHASIC_SPIKING:
-		n->a = +0.02; n->b = +0.25; n->c = -65.0; n->d = +6.00;
-		n->v = -64.0; n->u = n->v * n->b;
+		clctx->n->a = +0.02; clctx->n->b = +0.25; clctx->n->c = -65.0; clctx->n->d = +6.00;
+		clctx->n->v = -64.0; clctx->n->u = clctx->n->v * clctx->n->b;
 		break;
 	case NEURONTYPE_INTEGRATOR:
-		n->a = +0.02; n->b = -0.10; n->c = -55.0; n->d = +6.00;
-		n->v = -60.0; n->u = n->v * n->b;
+		clctx->n->a = +0.02; clctx->n->b = -0.10; clctx->n->c = -55.0; clctx->n->d = +6.00;
+		clctx->n->v = -60.0; clctx->n->u = clctx->n->v * clctx->n->b;
 		break;
 	default:
-		n->v = -64.0;
-		n->u = n->v * 0.2;
-		n->b = +0.25;
-		n->c = -65.0;
-		if (n->type & NEURONSIGN_MASK) {
-			n->a = +0.02; //should be randomized
-			n->d = +6.00;
+		clctx->n->v = -64.0;
+		clctx->n->u = clctx->n->v * 0.2;
+		clctx->n->b = +0.25;
+		clctx->n->c = -65.0;
+		if (clctx->n->type & NEURONSIGN_MASK) {
+			clctx->n->a = +0.02; //should be randomized
+			clctx->n->d = +6.00;
 		} else {
-			n->a = +0.10;
-			n->d = +2.00;
+			clctx->n->a = +0.10;
+			clctx->n->d = +2.00;
 		}
 	}
 }
@@ -60,12 +75,12 @@ void init_neuron() {
  */
 BOOL fired() {
 	BOOL result = 0;
-	if (n->type & NEURONSIGN_MASK) {
+	if (clctx->n->type & NEURONSIGN_MASK) {
 		//set I
 	}
-	if (n->v >= 30.0) {
-		n->v = n->c;
-		n->u += n->d;
+	if (clctx->n->v >= 30.0) {
+		clctx->n->v = clctx->n->c;
+		clctx->n->u += clctx->n->d;
 		//if (n->u > 100) n->u = -65.0/4; //weird behaviour, unstable with current I input
 		result = 1;
 	} 
@@ -80,29 +95,165 @@ BOOL fired() {
 void update(float I) {
 	//printf("Parameters: %f, %f becomes with input I=%f: ", n->v, n->u, I);
 	float euler_step = 0.5;
-	switch (n->type & NEURONTYPE_MASK) {
+	switch (clctx->n->type & NEURONTYPE_MASK) {
 	case NEURONTYPE_INTEGRATOR:
 		euler_step = 0.25; uint8_t euler = 4;
 		do {
-			n->v += euler_step * ((0.04 * n->v + 4.1) * n->v + 108.0 - n->u + I);
+			clctx->n->v += euler_step * ((0.04 * clctx->n->v + 4.1) * clctx->n->v + 108.0 -
+					clctx->n->u + I);
 			euler--;
 		} while (euler > 0);
 		break;
 	default:
-		n->v += euler_step * ((0.04 * n->v + 5.0) * n->v + 140.0 - n->u + I);
-		n->v += euler_step * ((0.04 * n->v + 5.0) * n->v + 140.0 - n->u + I);
+		clctx->n->v += euler_step * ((0.04 * clctx->n->v + 5.0) * clctx->n->v + 140.0 -
+				clctx->n->u + I);
+		clctx->n->v += euler_step * ((0.04 * clctx->n->v + 5.0) * clctx->n->v + 140.0 -
+				clctx->n->u + I);
+	}
+	clctx->n->u += clctx->n->a * (clctx->n->b * clctx->n->v - clctx->n->u);
+}
+
+#ifdef WITH_FIXED_POINT
+/**
+ * What update and fired do for neuron i of the arrays, in Q16.16. The terms of a half step
+ * are summed in 64 bits and saturated once, 0.04 * v * v is v * v / 25.
+ */
+static inline void updateNeuronElement(struct IzhikevichArrays *z, uint16_t i, uint8_t type,
+		neural_t I, uint16_t *spikes) {
+	neural_t v = z->v[i], u = z->u[i];
+	int64_t dv, du;
+	uint8_t euler;
+	if (type == NEURONTYPE_INTEGRATOR) {
+		for (euler = 0; euler < 4; euler++) {
+			dv = (((int64_t)v * v) >> FIXED_SHIFT) / 25 + (((int64_t)v * FIXED(4.1)) >> FIXED_SHIFT)
+				+ FIXED(108.0) - u + I;
+			v = saturateFixed(v + (dv >> 2));
+		}
+	} else {
+		for (euler = 0; euler < 2; euler++) {
+			dv = (((int64_t)v * v) >> FIXED_SHIFT) / 25 + 5 * (int64_t)v + FIXED(140.0) - u + I;
+			v = saturateFixed(v + (dv >> 1));
+		}
+	}
+	du = (((int64_t)z->b[i] * v) >> FIXED_SHIFT) - u;
+	u = saturateFixed(u + ((z->a[i] * du) >> FIXED_SHIFT));
+	ADVANCE(spikes[i]);
+	if (v >= FIXED(30.0)) {
+		v = z->c[i];
+		u = addFixed(u, z->d[i]);
+		RAISE(spikes[i], 1);
+	}
+	z->v[i] = v; z->u[i] = u;
+}
+#else
+/**
+ * What update and fired do for neuron i of the arrays.
+ */
+static inline void updateNeuronElement(struct IzhikevichArrays *z, uint16_t i, uint8_t type,
+		float I, uint16_t *spikes) {
+	float v = z->v[i], u = z->u[i];
+	float euler_step = 0.5;
+	if (type == NEURONTYPE_INTEGRATOR) {
+		euler_step = 0.25; uint8_t euler = 4;
+		do {
+			v += euler_step * ((0.04 * v + 4.1) * v + 108.0 - u + I);
+			euler--;
+		} while (euler > 0);
+	} else {
+		v += euler_step * ((0.04 * v + 5.0) * v + 140.0 - u + I);
+		v += euler_step * ((0.04 * v + 5.0) * v + 140.0 - u + I);
+	}
+	u += z->a[i] * (z->b[i] * v - u);
+	ADVANCE(spikes[i]);
+	if (v >= 30.0) {
+		v = z->c[i];
+		u += z->d[i];
+		RAISE(spikes[i], 1);
+	}
+	z->v[i] = v; z->u[i] = u;
+}
+#endif
+
+/**
+ * Updates the neurons from index "from" up to "to" of the arrays with the inputs in I, as
+ * update does, sets their inputs to 0, and shifts their spike histories with a spike at bit
+ * 1 for the neurons that fired. All those neurons are updated as the given type, so the
+ * neurons should be grouped by type. Only NEURONTYPE_INTEGRATOR has another update.
+ */
+void updateNeuronArrays(struct IzhikevichArrays *z, uint16_t from, uint16_t to, uint8_t type,
+		neural_t *I, uint16_t *spikes) {
+	uint16_t i = from;
+#ifdef NEURON_VECTORS
+	const vfloat zero = {0};
+	for (; i + NEURON_LANES <= to; i += NEURON_LANES) {
+		vfloat v, u, a, b, c, d, in;
+		vdouble vd, ud, Id;
+		uint8_t l;
+		VLOAD(v, z->v + i); VLOAD(u, z->u + i); VLOAD(in, I + i);
+		ud = __builtin_convertvector(u, vdouble);
+		Id = __builtin_convertvector(in, vdouble);
+		if (type == NEURONTYPE_INTEGRATOR) {
+			for (l = 0; l < 4; l++) {
+				vd = __builtin_convertvector(v, vdouble);
+				vd += 0.25 * ((0.04 * vd + 4.1) * vd + 108.0 - ud + Id);
+				v = __builtin_convertvector(vd, vfloat);
+			}
+		} else {
+			for (l = 0; l < 2; l++) {
+				vd = __builtin_convertvector(v, vdouble);
+				vd += 0.5 * ((0.04 * vd + 5.0) * vd + 140.0 - ud + Id);
+				v = __builtin_convertvector(vd, vfloat);
+			}
+		}
+		VLOAD(a, z->a + i); VLOAD(b, z->b + i);
+		u += a * (b * v - u);
+		vmask m = (v >= 30.0f);
+		VLOAD(c, z->c + i); VLOAD(d, z->d + i);
+		v = VSELECT(m, c, v);
+		u = VSELECT(m, u + d, u);
+		VSTORE(z->v + i, v); VSTORE(z->u + i, u); VSTORE(I + i, zero);
+		for (l = 0; l < NEURON_LANES; l++) {
+			ADVANCE(spikes[i + l]);
+			if (m[l]) RAISE(spikes[i + l], 1);
+		}
+	}
+#endif
+	for (; i < to; i++) {
+		updateNeuronElement(z, i, type, I[i], spikes);
+		I[i] = 0;
+	}
+}
+
+/**
+ * Shifts the spike histories of the neurons from "from" up to "to" and checks them with the
+ * threshold, as fired does, without an update, which is how input neurons are handled.
+ */
+void fireNeuronArrays(struct IzhikevichArrays *z, uint16_t from, uint16_t to, uint16_t *spikes) {
+	uint16_t i;
+	for (i = from; i < to; i++) {
+		ADVANCE(spikes[i]);
+#ifdef WITH_FIXED_POINT
+		if (z->v[i] >= FIXED(30.0)) {
+			z->v[i] = z->c[i];
+			z->u[i] = addFixed(z->u[i], z->d[i]);
+#else
+		if (z->v[i] >= 30.0) {
+			z->v[i] = z->c[i];
+			z->u[i] += z->d[i];
+#endif
+			RAISE(spikes[i], 1);
+		}
 	}
-	n->u += n->a * (n->b * n->v - n->u);
 }
 
 void next_type() {
-	uint8_t neurontype = (n->type & NEURONTYPE_MASK) + (0x01 < NEURONTYPE_SHIFT);
+	uint8_t neurontype = (clctx->n->type & NEURONTYPE_MASK) + (0x01 < NEURONTYPE_SHIFT);
 	neurontype %= NEURONTYPE_INHIB_IND_BURSTING;
-	n->type = n->type & ~NEURONTYPE_MASK;
-	n->type = n->type | neurontype;
+	clctx->n->type = clctx->n->type & ~NEURONTYPE_MASK;
+	clctx->n->type = clctx->n->type | neurontype;
 }
 
 void next_sign() {
-	TOGGLE(n->type, NEURONSIGN_MASK);
+	TOGGLE(clctx->n->type, NEURONSIGN_MASK);
 }
 
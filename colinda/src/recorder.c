@@ -0,0 +1,270 @@
+/**
+ * @file recorder.c
+ *
+ * A record is put together in one buffer and written with one fwrite, to a file with a large
+ * buffer of its own, so a step costs about one pass over the planes. The file is flushed at
+ * the end of every development, so a process that is stopped leaves whole developments. The
+ * developments in other contexts wait for the one that is recorded, so records do not mix.
+ *
+ * @date_created    Oct 14, 2026
+ * @date_modified   Oct 14, 2026
+ * @author          Anne C. van Rossum
+ * @project         Replicator
+ * @company         Almende B.V.
+ * @license         open-source, GNU Lesser General Public License
+ */
+
+#include <lindaconfig.h>
+
+#ifdef WITH_RECORDER
+
+#include <recorder.h>
+#include <colinda.h>
+#include <grid.h>
+#include <embryogeny.h>
+#include <genome.h>
+#include <topology.h>
+#include <neuron.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#ifdef WITH_CONSOLE
+#include <linda/log.h>
+#endif
+
+/****************************************************************************************************
+ *  		Declarations
+ ***************************************************************************************************/
+
+#define RECORDER_FILE_BUFFER	(256 * 1024)
+
+__thread uint8_t developmentRecording = 0;
+
+//held by the thread that records a development, from its start to its end
+static pthread_mutex_t recorderMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint8_t configured = 0;
+static FILE *file = NULL;
+static uint16_t interval = 1;
+static uint8_t pack = 0;
+
+//the record that is put together, and the planes of the step recorded before
+static uint8_t *record = NULL;
+static uint32_t capacity = 0;
+static uint8_t *previous = NULL;
+static uint32_t previous_size = 0;
+static uint8_t delta = 0;
+
+//the operations since the step recorded before, as cell and index
+static uint8_t *operations = NULL;
+static uint16_t operation_count = 0, operation_capacity = 0;
+
+/****************************************************************************************************
+ *  		Implementations
+ ***************************************************************************************************/
+
+static uint8_t *put16(uint8_t *p, uint16_t value) {
+	p[0] = value >> 8; p[1] = value;
+	return p + 2;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t value) {
+	p[0] = value >> 24; p[1] = value >> 16; p[2] = value >> 8; p[3] = value;
+	return p + 4;
+}
+
+/**
+ * Makes sure the record can hold size bytes, returns 0 if it can not.
+ */
+static uint8_t reserve(uint32_t size) {
+	if (size <= capacity) return 1;
+	uint8_t *lrecord = realloc(record, size);
+	if (lrecord == NULL) return 0;
+	record = lrecord;
+	capacity = size;
+	return 1;
+}
+
+/**
+ * Writes the record that ends at end, with the length of all after the type in front.
+ */
+static void writeRecord(uint8_t type, uint8_t *end) {
+	put32(record, end - record - 5);
+	record[4] = type;
+	if (fwrite(record, 1, end - record, file) != (size_t)(end - record)) {
+#ifdef WITH_CONSOLE
+		tprintf(LOG_WARNING, __func__, "Could not write the record, recording stops");
+#endif
+		stopRecorder();
+	}
+}
+
+static void configure() {
+	configured = 1;
+	unsigned int value;
+	char path[256];
+	const char *directory = getenv("LINDA_RECORD");
+	if ((directory == NULL) || (directory[0] == 0)) return;
+	const char *text = getenv("LINDA_RECORD_INTERVAL");
+	if ((text != NULL) && (sscanf(text, "%u", &value) == 1) && value) interval = value;
+	pack = getenv("LINDA_RECORD_PACK") != NULL;
+	snprintf(path, sizeof(path), "%s/development-%i.lrec", directory, getpid());
+	file = fopen(path, "wb");
+	if (file == NULL) {
+#ifdef WITH_CONSOLE
+		char ltext[300]; sprintf(ltext, "Could not open %s", path);
+		tprintf(LOG_WARNING, __func__, ltext);
+#endif
+		return;
+	}
+	setvbuf(file, NULL, _IOFBF, RECORDER_FILE_BUFFER);
+	uint8_t magic[4];
+	put32(magic, RECORDER_MAGIC);
+	fwrite(magic, 1, 4, file);
+}
+
+/**
+ * Ends the record of the development of this thread, so another can start.
+ */
+static void endRecord() {
+	if (!developmentRecording) return;
+	developmentRecording = 0;
+	pthread_mutex_unlock(&recorderMutex);
+}
+
+void recordDevelopment() {
+	pthread_mutex_lock(&recorderMutex);
+	if (!configured) configure();
+	if ((file == NULL) || !reserve(11)) {
+		pthread_mutex_unlock(&recorderMutex);
+		return;
+	}
+	developmentRecording = 1;
+	operation_count = 0;
+	delta = 0;
+	uint8_t *p = record + 5;
+	*p++ = clctx->clconf != NULL ? clctx->clconf->id : 0;
+	*p++ = clctx->s->rows;
+	*p++ = clctx->s->columns;
+	*p++ = clctx->s->product_count;
+	*p++ = clctx->gconf->phenotypicFactors;
+	*p++ = clctx->s->concentration_threshold;
+	writeRecord(RECORD_DEVELOPMENT, p);
+}
+
+void recordOperation(uint8_t index) {
+	if (operation_count == operation_capacity) {
+		if (operation_capacity == 0xFFFF) return;
+		uint16_t lcapacity = operation_capacity ? operation_capacity * 2 : 64;
+		if (lcapacity < operation_capacity) lcapacity = 0xFFFF;
+		uint8_t *loperations = realloc(operations, lcapacity * 3);
+		if (loperations == NULL) return;
+		operations = loperations;
+		operation_capacity = lcapacity;
+	}
+	uint8_t *p = put16(operations + operation_count * 3, getGridCellIndex(clctx->np->gridcell));
+	*p = index;
+	operation_count++;
+}
+
+/**
+ * Packs the exclusive or of the planes with the previous ones into p, see recorder.h. The
+ * exclusive or is taken in the previous planes. Whether a byte is zero is no branch, it only
+ * moves p on or not, because the bytes that change are scattered over the planes.
+ */
+static uint8_t *packPlanes(uint8_t *p, const uint8_t *planes, uint32_t size) {
+	uint32_t i, j;
+	for (i = 0; i < size; i++) previous[i] ^= planes[i];
+	for (i = 0; i < size; i += 8) {
+		uint8_t *lmask = p++, mask = 0;
+		for (j = 0; (j < 8) && (i + j < size); j++) {
+			uint8_t value = previous[i + j];
+			*p = value;
+			p += value != 0;
+			mask |= (value != 0) << j;
+		}
+		*lmask = mask;
+	}
+	return p;
+}
+
+void recordStep(uint8_t last) {
+	if (!last && (clctx->e->step != 1) && (clctx->e->step % interval)) return;
+	struct Neuron *ln;
+	uint16_t neuron_count = 0;
+	uint32_t size = (uint32_t)clctx->s->product_count * clctx->s->rows * clctx->s->columns;
+	for (ln = clctx->nn->neurons; ln != NULL; ln = ln->next) neuron_count++;
+	//packed, the planes get at most a mask byte per 8 bytes
+	if (!reserve(5 + 7 + neuron_count * 3 + operation_count * 3 + size + size / 8 + 1)) {
+		return;
+	}
+	if (pack && (previous_size < size)) {
+		uint8_t *lprevious = realloc(previous, size);
+		if (lprevious == NULL) return;
+		previous = lprevious;
+		previous_size = size;
+	}
+	uint8_t packed = delta && pack;
+	uint8_t *p = put16(record + 5, clctx->e->step);
+	*p++ = packed ? RECORD_DELTA : 0;
+	p = put16(p, neuron_count);
+	for (ln = clctx->nn->neurons; ln != NULL; ln = ln->next) {
+		p = put16(p, getGridCellIndex(ln->gridcell));
+		*p++ = ln->type;
+	}
+	p = put16(p, operation_count);
+	memcpy(p, operations, operation_count * 3);
+	p += operation_count * 3;
+	operation_count = 0;
+	if (packed) {
+		p = packPlanes(p, clctx->s->concentrations, size);
+	} else {
+		memcpy(p, clctx->s->concentrations, size);
+		p += size;
+	}
+	if (pack) memcpy(previous, clctx->s->concentrations, size);
+	delta = 1;
+	writeRecord(RECORD_STEP, p);
+}
+
+void recordTopology() {
+	struct Neuron *ln;
+	struct Port *lp;
+	uint32_t synapse_count = 0;
+	for (ln = clctx->nn->neurons; ln != NULL; ln = ln->next) {
+		for (lp = ln->ports_out; lp != NULL; lp = lp->next) synapse_count++;
+	}
+	if (!reserve(5 + 6 + synapse_count * 9)) {
+		endRecord();
+		return;
+	}
+	uint8_t *p = put16(record + 5, clctx->e->step);
+	p = put32(p, synapse_count);
+	for (ln = clctx->nn->neurons; ln != NULL; ln = ln->next) {
+		for (lp = ln->ports_out; lp != NULL; lp = lp->next) {
+			struct Neuron *post = lp->synapse->post_neuron;
+			uint32_t bits;
+			memcpy(&bits, &lp->synapse->weight, 4);
+			p = put16(p, getGridCellIndex(ln->gridcell));
+			p = put16(p, post != NULL ? getGridCellIndex(post->gridcell) : NO_CELL);
+			p = put32(p, bits);
+			*p++ = lp->synapse->delay;
+		}
+	}
+	writeRecord(RECORD_TOPOLOGY, p);
+	if (developmentRecording) fflush(file);
+	endRecord();
+}
+
+void stopRecorder() {
+	if (!developmentRecording) pthread_mutex_lock(&recorderMutex);
+	developmentRecording = 0;
+	if (file != NULL) fclose(file);
+	file = NULL;
+	pthread_mutex_unlock(&recorderMutex);
+}
+
+#endif //WITH_RECORDER
@@ -0,0 +1,132 @@
+/**
+ * @file region.c
+ *
+ * An object on a free list holds the pointer to the next one in its first bytes, so every
+ * object is rounded up to a multiple of the size of a pointer, which aligns them as well.
+ * When the current block is full, the next block is used, which is there already after a
+ * reset, or else a new one is added after it.
+ *
+ * @date_created    Oct 14, 2026
+ * @date_modified   Oct 14, 2026
+ * @author          Anne C. van Rossum
+ * @project         Replicator
+ * @company         Almende B.V.
+ * @license         open-source, GNU Lesser General Public License
+ */
+
+#include <lindaconfig.h>
+#include <region.h>
+#include <stdlib.h>
+
+#ifdef WITH_SYMBRICATOR
+#include "portable.h"
+#endif
+
+#ifdef WITH_CONSOLE
+#include <linda/log.h>
+#endif
+
+/****************************************************************************************************
+ *  		Declarations
+ ***************************************************************************************************/
+
+#define REGION_ALIGN(size)		(((size) + sizeof(void*) - 1) & ~(sizeof(void*) - 1))
+
+#ifdef WITH_SYMBRICATOR
+static void *staticData[REGION_STATIC_SIZE / sizeof(void*)];
+static struct RegionBlock staticBlock = { NULL, sizeof(staticData), (uint8_t*)staticData };
+static struct Region staticRegion;
+#endif
+
+/****************************************************************************************************
+ *  		Implementations
+ ***************************************************************************************************/
+
+#ifndef WITH_SYMBRICATOR
+static struct RegionBlock *newRegionBlock(uint32_t size) {
+	struct RegionBlock *block = lindaMalloc(sizeof(struct RegionBlock) + size);
+	if (block == NULL) return NULL;
+	block->next = NULL;
+	block->size = size;
+	block->data = (uint8_t*)(block + 1);
+	return block;
+}
+#endif
+
+static void initRegion() {
+#ifdef WITH_SYMBRICATOR
+	clctx->region = &staticRegion;
+	clctx->region->blocks = &staticBlock;
+#else
+	clctx->region = lindaMalloc(sizeof(struct Region));
+	clctx->region->blocks = newRegionBlock(REGION_BLOCK_SIZE);
+#endif
+	clctx->region->current = clctx->region->blocks;
+	regionReset();
+}
+
+/**
+ * Adds a block after the current one, large enough for an object of the given size.
+ */
+static uint8_t addRegionBlock(uint16_t size) {
+#ifdef WITH_SYMBRICATOR
+#ifdef WITH_CONSOLE
+	tprintf(LOG_ALERT, __func__, "Region is full");
+#endif
+	return 0;
+#else
+	struct RegionBlock *block = newRegionBlock(size > REGION_BLOCK_SIZE ? size :
+			REGION_BLOCK_SIZE);
+	if (block == NULL) return 0;
+	clctx->region->current->next = block;
+	return 1;
+#endif
+}
+
+void *regionAlloc(uint8_t kind, uint16_t size) {
+	void *object;
+	if (clctx->region == NULL) initRegion();
+	if ((object = clctx->region->free_list[kind]) != NULL) {
+		clctx->region->free_list[kind] = *(void**)object;
+		return object;
+	}
+	size = REGION_ALIGN(size);
+	while (clctx->region->used + size > clctx->region->current->size) {
+		if ((clctx->region->current->next == NULL) && !addRegionBlock(size)) return NULL;
+		clctx->region->current = clctx->region->current->next;
+		clctx->region->used = 0;
+	}
+	object = clctx->region->current->data + clctx->region->used;
+	clctx->region->used += size;
+	return object;
+}
+
+void regionFree(uint8_t kind, void *object) {
+	if (object == NULL) return;
+	*(void**)object = clctx->region->free_list[kind];
+	clctx->region->free_list[kind] = object;
+}
+
+void regionReset() {
+	uint8_t i;
+	if (clctx->region == NULL) return;
+	clctx->region->current = clctx->region->blocks;
+	clctx->region->used = 0;
+	for (i = 0; i < REGION_KINDS; i++) {
+		clctx->region->free_list[i] = NULL;
+	}
+}
+
+void freeRegion() {
+	if (clctx->region == NULL) return;
+#ifndef WITH_SYMBRICATOR
+	struct RegionBlock *block = clctx->region->blocks, *next;
+	while (block != NULL) {
+		next = block->next;
+		free(block);
+		block = next;
+	}
+	free(clctx->region);
+#endif
+	clctx->region = NULL;
+}
@@ -8,7 +8,6 @@
 #include <sensorimotor.h>
 #include <aer.h>
 #include <stdint.h>
-#include <time.h>  //TODO: check
 
 #ifdef WITH_CONSOLE
 #include <stdio.h>
@@ -21,58 +20,27 @@
 #endif
 
 #include <stdlib.h>
+#include <pthread.h>
 #include <embryogeny.h>
 #include <bits.h>
 #include <topology.h>
 #include <neuron.h>
 #include <genome.h>
+#include <devcache.h>
+#include <netframe.h>
+#include <encoding.h>
+
+#ifdef WITH_RECORDER
+#include <recorder.h>
+#endif
 
 #ifdef WITH_GNUPLOT
 #include <testPlayerStageHelper.h>
 #endif
 
-time_t *prev_cycle = NULL;
-uint8_t timeResolutionResolved = 0;
-time_t *time_resolution = NULL;
-uint8_t running_state = 0;
-
-/**
- * A routine might be called several times, the time in between those calls might
- * be an indication for the load a routine may exert on the system. When the amount
- * of data or the resolution of the data has a relation with the frequency of the
- * call to a routine, it might be desired that it is kept constant the same for a
- * long time. A fully dynamic adjustment of the caller's output depending on the
- * local phase between calls, might impose too large demands on the receiving party
- * of the data. Hence, over here a boolean is set and the second(!) in-between time
- * between two function calls is used to set the so-called resolution.
- *
- * This function depends on state, first, second, third call:
- *   1. Returns NULL;
- *   2. Returns first indication of time_resolution that can be used by caller;
- *   3. Returns adapted time_resolution figure to be used by caller forever;
- *
- * In the subsequent phase caller's of this function might adapt their output on
- * the system, for example by adding more spikes, and subsequently inspect the
- * result in terms of time between routine calls.
- */
-time_t *setTimeResolution() {
-	if (timeResolutionResolved > 1)
-		return time_resolution;
-	time_t now = time(NULL);
-
-	if (prev_cycle == NULL) {
-		prev_cycle = (time_t*) lindaMalloc(sizeof(time_t));
-		time_resolution = (time_t*) lindaMalloc(sizeof(time_t));
-		*prev_cycle = now;
-		return NULL;
-	}
-
-	*time_resolution = now - *prev_cycle;
-	timeResolutionResolved++;
-	*prev_cycle = now;
-	return time_resolution;
-}
-
+static void prepareDevelopment();
+static void growNeuralNetwork();
+static void presentNeuralNetwork();
 
 /**
  * Adds an AER item to the buffer. The buffer is considered full if the head pointer
@@ -81,7 +49,7 @@ time_t *setTimeResolution() {
  * On addition, the head pointer is updated to the next slot in the buffer.
  */
 bool pushAER(struct AERBuffer *aerbuffer, union AER *aertuple) {
-	uint8_t head_next = (aerbuffer->head + 1) % MAX_AER_TUPLES;
+	uint16_t head_next = (aerbuffer->head + 1) & aerbuffer->mask;
 	if (head_next == aerbuffer->tail) return false; //buffer = full
 	aerbuffer->aer[aerbuffer->head] = *aertuple;
 	aerbuffer->head = head_next;
@@ -95,7 +63,7 @@ bool pushAER(struct AERBuffer *aerbuffer, union AER *aertuple) {
  * calls each time.
  */
 uint8_t pushAER_xyt(struct AERBuffer *aerbuffer, uint8_t x, uint8_t y, uint16_t time) {
-	uint8_t head_next = (aerbuffer->head + 1) % MAX_AER_TUPLES;
+	uint16_t head_next = (aerbuffer->head + 1) & aerbuffer->mask;
 	if (head_next == aerbuffer->tail) return false; //buffer = full
 	aerbuffer->aer[aerbuffer->head].coordinate.x = x;
 	aerbuffer->aer[aerbuffer->head].coordinate.y = y;
@@ -104,12 +72,76 @@ uint8_t pushAER_xyt(struct AERBuffer *aerbuffer, uint8_t x, uint8_t y, uint16_t
 	return 1;
 }
 
+/**
+ * Adds as many of the given tuples as fit in the buffer, in order, and returns how many.
+ */
+uint16_t pushAERs(struct AERBuffer *aerbuffer, const union AER *aertuples, uint16_t count) {
+	uint16_t i, space = aerbuffer->mask - sizeAER(aerbuffer);
+	if (count > space) count = space;
+	for (i = 0; i < count; i++) {
+		aerbuffer->aer[aerbuffer->head] = aertuples[i];
+		aerbuffer->head = (aerbuffer->head + 1) & aerbuffer->mask;
+	}
+	return count;
+}
+
+/**
+ * Copies at most count tuples from the buffer, from the tail on, and removes them. Returns
+ * how many.
+ */
+uint16_t popAERs(struct AERBuffer *aerbuffer, union AER *aertuples, uint16_t count) {
+	uint16_t i, size = sizeAER(aerbuffer);
+	if (count > size) count = size;
+	for (i = 0; i < count; i++) {
+		aertuples[i] = aerbuffer->aer[aerbuffer->tail];
+		aerbuffer->tail = (aerbuffer->tail + 1) & aerbuffer->mask;
+	}
+	return count;
+}
+
+/**
+ * Initializes an empty buffer with the fixed capacity of MAX_AER_TUPLES. A buffer that is
+ * resized should be freed with freeAER instead, to be initialized again.
+ */
 void initAER(struct AERBuffer *aerbuffer) {
-	uint8_t i;
+	aerbuffer->aer = aerbuffer->fixed;
+	aerbuffer->mask = MAX_AER_TUPLES - 1;
 	aerbuffer->head = aerbuffer->tail = 0;
-	for (i = 0; i < MAX_AER_TUPLES-1; i++) {
-		aerbuffer->aer[i].data = 0;
+}
+
+/**
+ * Gives the buffer at least the given capacity, rounded up to a power of two, and at most
+ * 32768. The tuples in the buffer are kept. Returns false, and leaves the buffer as it is,
+ * if it has more tuples than the new capacity can hold, or if there is no memory.
+ */
+bool resizeAER(struct AERBuffer *aerbuffer, uint16_t capacity) {
+	uint16_t i, size = sizeAER(aerbuffer), mask = MAX_AER_TUPLES - 1;
+	union AER *aer = aerbuffer->fixed;
+	while ((mask < capacity - 1) && (mask < 0x7FFF)) mask = (mask << 1) | 1;
+	if (mask == aerbuffer->mask) return true;
+	if (size > mask) return false;
+	if (mask != MAX_AER_TUPLES - 1) {
+		aer = lindaMalloc((mask + 1) * sizeof(union AER));
+		if (aer == NULL) return false;
 	}
+	for (i = 0; i < size; i++) {
+		aer[i] = aerbuffer->aer[(aerbuffer->tail + i) & aerbuffer->mask];
+	}
+	if (aerbuffer->aer != aerbuffer->fixed) free(aerbuffer->aer);
+	aerbuffer->aer = aer;
+	aerbuffer->mask = mask;
+	aerbuffer->tail = 0;
+	aerbuffer->head = size;
+	return true;
+}
+
+/**
+ * Frees the tuples of a resized buffer. The buffer is empty afterwards, with the fixed
+ * capacity again.
+ */
+void freeAER(struct AERBuffer *aerbuffer) {
+	if (aerbuffer->aer != aerbuffer->fixed) free(aerbuffer->aer);
+	initAER(aerbuffer);
 }
 
 /**
@@ -120,6 +152,10 @@ uint8_t isEmptyAER(struct AERBuffer *aerbuffer) {
 	return (aerbuffer->tail == aerbuffer->head);
 }
 
+uint16_t sizeAER(struct AERBuffer *aerbuffer) {
+	return (aerbuffer->head - aerbuffer->tail) & aerbuffer->mask;
+}
+
 /**
  * Empties the buffer by popping tuples.
  */
@@ -132,11 +168,10 @@ void doEmptyAER(struct AERBuffer *aerbuffer) {
 
 /**
  * The buffer is considered full when the tail pointer finds the head pointer in the
- * next slot. This routine uses MAX_AER_TUPLES to know the size of the circular
- * AERBuffer.
+ * next slot.
  */
 uint8_t isFullAER(struct AERBuffer *aerbuffer) {
-	return (((aerbuffer->head + 1) % MAX_AER_TUPLES) == aerbuffer->tail);
+	return (((aerbuffer->head + 1) & aerbuffer->mask) == aerbuffer->tail);
 }
 
 /**
@@ -147,7 +182,7 @@ uint8_t isFullAER(struct AERBuffer *aerbuffer) {
 union AER *popAER(struct AERBuffer *aerbuffer) {
 	if (aerbuffer->tail == aerbuffer->head) return NULL;
 	union AER *result = &aerbuffer->aer[aerbuffer->tail];
-	aerbuffer->tail = (aerbuffer->tail + 1) % MAX_AER_TUPLES;
+	aerbuffer->tail = (aerbuffer->tail + 1) & aerbuffer->mask;
 	return result;
 }
 
@@ -162,80 +197,35 @@ void emptyAERBuffer(struct AERBuffer *aerbuffer) {
  * Counts the amount of spikes with coordinates x and y in the given AERBuffer. In the
  * buffer all items are iterated from the tail to the head pointer, even if the head
  * pointer has wrapped around the buffer. The buffer is considered empty if the tail
- * and head pointer point to the same item.
+ * and head pointer point to the same item. To count the spikes of several cells, use
+ * readSpikes, which counts them all at once.
  */
 uint8_t count_spikes(struct AERBuffer *b, uint8_t x, uint8_t y) {
-	uint8_t i, amount = 0;
-	if (b->head > b->tail) {
-		for (i=b->tail; i < b->head; i++) {
-			if ((b->aer[i].coordinate.x == x) && (b->aer[i].coordinate.y == y)) amount++;
-		}
-	} else if (b->head == b->tail) {
-
-	} else {
-		for (i=b->tail; i < MAX_AER_TUPLES; i++) {
-			if ((b->aer[i].coordinate.x == x) && (b->aer[i].coordinate.y == y)) amount++;
-		}
-		for (i=0; i < b->head; i++) {
-			if ((b->aer[i].coordinate.x == x) && (b->aer[i].coordinate.y == y)) amount++;
-		}
+	uint16_t i;
+	uint8_t amount = 0;
+	for (i = b->tail; i != b->head; i = (i + 1) & b->mask) {
+		if ((b->aer[i].coordinate.x == x) && (b->aer[i].coordinate.y == y)) amount++;
 	}
 	return amount;
 }
 
 /**
- * Only one input sensor array might generate lots of AER tuples. This routine thus might
- * be called several times, to generate all spikes. This routine generateSpikes is called
- * with an additional "counter" parameter which is decremented till zero. When the counter
- * reaches zero no spikes are generated anymore. It might be the time to retrieve another
- * sensor value array from the simulator.
- *
- * The function returns:
- *   0. when nothing is executed because the time resolution is not set yet.
+ * Encodes all input values into spikes with the encoder of the process, at the tick of now,
+ * see encoding.h. The function returns:
  * 	 1. when all spikes are generated successfully and added to the buffer.
- *   2. when the buffer is full.
+ *   2. when the buffer is full, the values that did not fit are not encoded.
  *   3. on error
  */
 uint8_t generateSpikes(uint8_t *input, uint8_t inputbuf_size, struct AERBuffer *aerbuffer) {
-	uint8_t result = 1; uint8_t i, j, spikecnt; time_t *resolution; time_t now;
-
-	//printf("Start settr\n");
-	resolution = setTimeResolution();
-	if (resolution == NULL) return 0;
-
-	now = time(NULL);
-	*resolution /= 20;
-
-	if (inputbuf_size < 3) {
+	if (!inputbuf_size) {
 #ifdef WITH_CONSOLE
-		char msg[64];
-		sprintf(msg, "Not enough input values (%i < 3)", inputbuf_size);
-		tprintf(LOG_ALERT, __func__, msg);
+		tprintf(LOG_ALERT, __func__, "No input values");
 #endif
 		return 3;
 	}
-	//for (i=0; i < 8; i++) {
-	for (i=0; i < 3; i+=2) {
-		switch(input[i]) {
-		case  0 ...  4: spikecnt = 10; break;
-		case  5 ...  9: spikecnt = 9; break;
-		case 10 ... 14: spikecnt = 8; break;
-		case 15 ... 19: spikecnt = 7; break;
-		case 20 ... 29: spikecnt = 6; break;
-		case 30 ... 39: spikecnt = 5; break;
-		case 40 ... 49: spikecnt = 4; break;
-		case 50 ... 59: spikecnt = 3; break;
-		case 60 ... 69: spikecnt = 2; break;
-		case 70 ... 79: spikecnt = 0; break;
-		default: spikecnt = 0;
-		}
-		for (j=0; j < spikecnt; j++) {
-			result = result && pushAER_xyt(aerbuffer, i % 5, i / 5,
-					(uint16_t)(now + (*resolution)*j));
-		}
-		if (!result) return 2;
-	}
-	return result;
+	if (encodeSpikes(getSpikeEncoder(), input, inputbuf_size, getSpikeTick(), aerbuffer)
+			< inputbuf_size) return 2;
+	return 1;
 }
 
 #ifdef WITH_CONSOLE
@@ -244,10 +234,10 @@ uint8_t generateSpikes(uint8_t *input, uint8_t inputbuf_size, struct AERBuffer *
  */
 void printNetwork() {
 	printf("Prints the neural network\n");
-	struct Neuron *ln = nn->neurons; uint8_t i = 0;
+	struct Neuron *ln = clctx->nn->neurons; uint8_t i = 0;
 	while (ln != NULL) {
 		printf("Position neuron %d: [%d,%d]\n", i,
-				ln->gridcell->position->x, ln->gridcell->position->y);
+				ln->gridcell->position.x, ln->gridcell->position.y);
 		i++;
 		ln = ln->next;
 	}
@@ -272,24 +262,24 @@ void printConnections() {
 	struct Neuron *ln_src, *ln_tar;
 	uint8_t x_src,y_src,x_tar,y_tar;
 	printf("Conn:  ");
-	for (y_src=0; y_src < s->rows; y_src++) {
-		for (x_src=0;x_src < s->columns; x_src++) {
+	for (y_src=0; y_src < clctx->s->rows; y_src++) {
+		for (x_src=0;x_src < clctx->s->columns; x_src++) {
 			printf("%d-%d ", x_src, y_src);
 		}
 	}
 	printf("\n       ");
-	for (y_src=0; y_src < s->columns * s->rows; y_src++) printf("----");
+	for (y_src=0; y_src < clctx->s->columns * clctx->s->rows; y_src++) printf("----");
 	printf("\n");
 
-	for (y_src=0; y_src < s->rows; y_src++) {
-		for (x_src=0;x_src < s->columns; x_src++) {
+	for (y_src=0; y_src < clctx->s->rows; y_src++) {
+		for (x_src=0;x_src < clctx->s->columns; x_src++) {
 			printf(" %d-%d  |", x_src, y_src);
 
 			ln_src = getGridCell(x_src,y_src)->neuron;
 
 			if (ln_src != NULL) {
-				for (y_tar=0; y_tar < s->rows; y_tar++) {
-					for (x_tar=0;x_tar < s->columns; x_tar++) {
+				for (y_tar=0; y_tar < clctx->s->rows; y_tar++) {
+					for (x_tar=0;x_tar < clctx->s->columns; x_tar++) {
 						ln_tar = getGridCell(x_tar,y_tar)->neuron;
 						struct Synapse *ls = existConnection(ln_src, ln_tar);
 						if (ls != NULL) {
@@ -310,10 +300,10 @@ void printConnections() {
 
 void printCurrents() {
 	printf("Prints the input currents of neurons in the neural network\n");
-	struct Neuron *ln = nn->neurons;
+	struct Neuron *ln = clctx->nn->neurons;
 	while (ln != NULL) {
 		printf("Current neuron [%d,%d]: %f\n",
-				ln->gridcell->position->x, ln->gridcell->position->y,
+				ln->gridcell->position.x, ln->gridcell->position.y,
 				ln->I);
 		ln = ln->next;
 	}
@@ -323,19 +313,72 @@ void printCurrents() {
 
 /**
  * This development of a neural network starts with the configuration of the genome. It
- * overwrite the settings of the amount of regulating and phenotypic factors. On the robot
- * it may be decided to send the actual topology instead of a genome to the robot. In that
- * case this function can be skipped and it's better to create the grid directly via other
- * means.
+ * overwrite the settings of the amount of regulating and phenotypic factors. The robot can
+ * also get the developed network instead of a genome, then this function is skipped, see
+ * installNeuralNetwork.
  *
  * The routine expects the genes to be already extracted, and starts transcribing genes
  * (scaling the different values to proper ranges). After the genes are transcribed, it
- * starts the embryogenetic process. For t=0...1000 concentrations are tested and updated
- * and cellular instructions executed if appropriate. After this process, the grid is
+ * starts the embryogenetic process. For at most 1000 steps concentrations are tested and updated
+ * and cellular instructions executed if appropriate, see stepEmbryology for when development
+ * stops earlier. After this process, the grid is
  * filled with the neural network and might be printed.
+ *
+ * The stages find the context through the thread, so the thread is switched to it for the
+ * call, and the tiles of the grid get it with them, see updateGridTiles.
  */
+void developNeuralNetworkIn(struct ColindaContext *context) {
+	struct ColindaContext *outer = switchColindaContext(context);
+	prepareDevelopment();
+	growNeuralNetwork();
+	finalizeNeuralNetwork();
+	presentNeuralNetwork();
+	switchColindaContext(outer);
+}
+
 void developNeuralNetwork() {
-	if (gconf != NULL) {
+	developNeuralNetworkIn(&processContext);
+}
+
+/**
+ * Like developNeuralNetwork, but the network is taken from the development cache if the
+ * genome with the given hash and size is developed before with the same parameters, and it
+ * is kept there otherwise. With other robots docked development depends on them as well, so
+ * then it is not cached.
+ */
+void developCachedNeuralNetwork(uint32_t hash, uint32_t size) {
+	prepareDevelopment();
+	uint32_t key = developmentKey(hash, size);
+	if (clctx->s->remote || !restoreDevelopment(key)) {
+		growNeuralNetwork();
+		if (!clctx->s->remote) storeDevelopment(key);
+	}
+#ifdef WITH_CONSOLE
+	else tprintf(LOG_VERBOSE, __func__, "Network restored from the development cache");
+#endif
+	finalizeNeuralNetwork();
+	presentNeuralNetwork();
+}
+
+/**
+ * Instead of developing a genome, the network is built from a frame that is developed
+ * elsewhere, see netframe.h, and only compiled here. Returns 0 if the frame does not fit,
+ * then there is no network.
+ */
+uint8_t installNeuralNetwork(const uint8_t *frame, uint32_t size) {
+	prepareDevelopment();
+	if (!readNetworkFrame(frame, size)) return 0;
+	finalizeNeuralNetwork();
+	presentNeuralNetwork();
+	return 1;
+}
+
+/**
+ * Frees the previous network and configures the genome, the grid and the embryogeny.
+ */
+static void prepareDevelopment() {
+	freeCompiledNetwork();
+	if (clctx->gconf != NULL) {
 #ifdef WITH_CONSOLE
 		tprintf(LOG_VERBOSE, __func__, "Deallocated everything");
 #endif
@@ -348,13 +391,15 @@ void developNeuralNetwork() {
 	
 	configGenome();
 	init_embryology();
-		
+}
+
+static void growNeuralNetwork() {
 //	gconf->regulatingFactors = 4;
 //	gconf->phenotypicFactors = 4;
 	transcribeGenes();
 
 #ifdef WITH_CONSOLE
-	if (eg->gene_count < 10) {
+	if (clctx->eg->gene_count < 10) {
 		tprintf(LOG_VERBOSE, __func__, "Print interpreted/transcribed genes");
 		//	printf("Legend: [DeviceToken ProductIn ProductOut GridX GridY conc_inc conc_low conc_high]");
 		char textA[1024];
@@ -374,37 +419,72 @@ void developNeuralNetwork() {
 	tprintf(LOG_DEBUG, __func__, "Run GRN");
 #endif
 
-	uint16_t t = 0;
-	do {
-		updateGrid();
-#ifdef WITH_CONSOLE
-		if (t == 0)
-		tprintf(LOG_VERBOSE, __func__, "Apply morphological changes");
+#ifdef WITH_RECORDER
+	recordDevelopment();
 #endif
-		applyEmbryogenesis();
+
+	while (stepEmbryology()) {
 #ifdef WITH_CONSOLE
-		if (t == 0)
+		if (clctx->e->step == 1)
 		tprintf(LOG_VERBOSE, __func__, "First cycle passed");
 #endif
 #ifdef WITH_GUI
-//		if (!(t % 100)) visualizeCells();
+//		if (!(e->step % 100)) visualizeCells();
 #endif
-		t++;
-	} while(t < 1000);
+	}
 
+#ifdef WITH_RECORDER
+	if (developmentRecording) recordTopology();
+#endif
+}
+
+static void presentNeuralNetwork() {
 #ifdef WITH_GUI
 	visualizeCells();
 #endif
 
 #ifdef WITH_CONSOLE
-	char text[128]; sprintf(text, "The resulting topology for robot %i", clconf->id);
+	char text[128]; sprintf(text, "The resulting topology for robot %i", clctx->clconf->id);
 	tprintf(LOG_DEBUG, __func__, text);
-	char text1[1024]; 
+	char text1[1024];
+	//a line of at most 4 characters a cell, the larger grids do not fit
+	if ((uint32_t)(clctx->s->rows + 2) * (4 * clctx->s->columns + 10) > sizeof(text1)) return;
 	printGridToStr(text1);
 	btprintf(LOG_DEBUG, __func__, text1);
 #endif
 }
 
+/**
+ * The stages of runNeuralNetwork on the compiled network.
+ */
+static uint8_t runCompiledNetwork(struct ColindaContext *context, struct AERBuffer *in,
+		struct AERBuffer *out) {
+	union AER *aer;
+	uint16_t i;
+	switch(context->running_state) {
+	case 0:
+		while ((aer = popAER(in)) != NULL) {
+			struct GridCell *lgc = getGridCell(aer->coordinate.x, aer->coordinate.y);
+			if (lgc != NULL) spikeCompiledNeuron(getGridCellIndex(lgc));
+		}
+		propagateCompiledSpikes();
+		break;
+	case 1:
+		updateCompiledNeurons();
+		for (i = 0; i < context->cn->output_count; i++) {
+			uint16_t j = context->cn->outputs[i];
+			if (RAISED(context->cn->spikes[j], 1)) {
+				struct Position *lpos = &context->cn->neurons[j]->gridcell->position;
+				pushAER_xyt(out, lpos->x, lpos->y, 0);
+			}
+		}
+		break;
+	}
+	context->running_state++;
+	context->running_state %= 2;
+	return context->running_state;
+}
+
 /**
  * This routine calls all the Linda Engine API functions like propagateSpikes, calculateWeights,
  * etc. It might be called again from the SymbricatorRTOS or from the (extended) hardware
@@ -414,20 +494,33 @@ void developNeuralNetwork() {
  * possible to visualize the network on a state-transition. The result value of this
  * routine will indicate the next stage. With a return value of 0, everything is handled
  * and a new input buffer with AER tuples is expected and inspected.
+ *
+ * A developed network is finalized, then the stages run on the compiled network. A network
+ * that is put together by hand, runs on the pointers, until it is finalized too. Like
+ * development, the stages find the context through the thread, which is switched to it.
  */
-uint8_t runNeuralNetwork(struct AERBuffer *in, struct AERBuffer *out) {
+uint8_t runNeuralNetworkIn(struct ColindaContext *context, struct AERBuffer *in,
+		struct AERBuffer *out) {
 	union AER *aer;
+	uint8_t result;
+	struct ColindaContext *outer = switchColindaContext(context);
+
+	if (context->cn != NULL) {
+		result = runCompiledNetwork(context, in, out);
+		switchColindaContext(outer);
+		return result;
+	}
 
-	switch(running_state) {
+	switch(context->running_state) {
 	case 0:
 		aer = popAER(in);
 		while (aer != NULL) {
 			struct GridCell *lgc = getGridCell(aer->coordinate.x, aer->coordinate.y);
 			if (lgc != NULL) {
 				if (lgc->neuron != NULL) {
-					n = lgc->neuron;
-					ADVANCE(n->history->spike_bitseq);
-					RAISE(n->history->spike_bitseq, 1);
+					context->n = lgc->neuron;
+					ADVANCE(context->n->history->spike_bitseq);
+					RAISE(context->n->history->spike_bitseq, 1);
 				}
 			}
 			aer = popAER(in);
@@ -450,15 +543,15 @@ uint8_t runNeuralNetwork(struct AERBuffer *in, struct AERBuffer *out) {
 		tprintf(LOG_VVV, __func__, "Push aer tuples");
 #endif
 		//read output neurons
-		struct GridCell *lgc = s->gridcells;
-		uint8_t size = s->columns * s->rows, i = 0;
+		struct GridCell *lgc = context->s->gridcells;
+		uint16_t size = context->s->columns * context->s->rows, i = 0;
 		while ((lgc != NULL) & (i < size)) {
 			if (lgc->neuron != NULL) {
 				if ((lgc->neuron->type & TOPOLOGY_MASK) == OUTPUT_NEURON) {
-					n = lgc->neuron;
-					if (RAISED(n->history->spike_bitseq, 1)) {
-						pushAER_xyt(out, n->gridcell->position->x,
-								n->gridcell->position->y, 0);
+					context->n = lgc->neuron;
+					if (RAISED(context->n->history->spike_bitseq, 1)) {
+						pushAER_xyt(out, context->n->gridcell->position.x,
+								context->n->gridcell->position.y, 0);
 					}
 				}
 			}
@@ -468,22 +561,136 @@ uint8_t runNeuralNetwork(struct AERBuffer *in, struct AERBuffer *out) {
 
 		break;
 	}
-	running_state++;
-	running_state %= 2;
-	return running_state;
+	context->running_state++;
+	context->running_state %= 2;
+	result = context->running_state;
+	switchColindaContext(outer);
+	return result;
+}
+
+uint8_t runNeuralNetwork(struct AERBuffer *in, struct AERBuffer *out) {
+	return runNeuralNetworkIn(&processContext, in, out);
 }
 
 /**
- * The output in this case is just velocities for the two wheels. It gets from the union AER buffer
- * exactly spike_cnt values and adapts the velocity according to the amount of spikes by
- * the two output neurons. It expects the neuron coordinates to be [3,3] and [5,3]. The spike_cnt
- * variables is set to 0 by this function itself.
+ * A map of the given size, without any cell mapped yet, so every channel just gives its
+ * offset.
  */
-void interpretSpikes(struct AERBuffer *b, int16_t *output) {
-	output[1] = 20 * (count_spikes(b, 3, 3)) - 20 * count_spikes(b, 1, 3) + 10;
-	output[0] = 20 * (count_spikes(b, 4, 3)) - 20 * count_spikes(b, 2, 3) + 10;
+struct MotorMap *newMotorMap(uint8_t columns, uint8_t rows, uint8_t channel_count,
+		int16_t offset) {
+	uint16_t i, cells = columns * rows;
+	struct MotorMap *map = lindaMalloc(sizeof(struct MotorMap));
+	map->columns = columns;
+	map->rows = rows;
+	map->channel_count = channel_count;
+	map->channels = lindaMalloc(cells * sizeof(uint8_t));
+	map->gains = lindaMalloc(cells * sizeof(int16_t));
+	map->offsets = lindaMalloc(channel_count * sizeof(int16_t));
+	for (i = 0; i < cells; i++) {
+		map->channels[i] = MOTOR_UNMAPPED;
+		map->gains[i] = 0;
+	}
+	for (i = 0; i < channel_count; i++) map->offsets[i] = offset;
+	return map;
+}
 
+/**
+ * Every spike of the neuron in the given cell adds the gain to the channel. A cell outside
+ * of the map, or a channel the map does not have, is ignored.
+ */
+void mapMotorCell(struct MotorMap *map, uint8_t x, uint8_t y, uint8_t channel, int16_t gain) {
+	if ((x >= map->columns) || (y >= map->rows) || (channel >= map->channel_count)) return;
+	map->channels[x + y * map->columns] = channel;
+	map->gains[x + y * map->columns] = gain;
+}
 
-	//empty buffer
-	doEmptyAER(b);
+void freeMotorMap(struct MotorMap *map) {
+	free(map->channels);
+	free(map->gains);
+	free(map->offsets);
+	free(map);
+}
+
+static struct MotorMap *motorMap = NULL;
+//! The contexts on the monks configure the map once between them
+static pthread_mutex_t motorMapMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * The default map gives velocities for the two wheels, from the output neurons at [1,3] to
+ * [4,3]: spikes of [3,3] and [4,3] speed up the wheels, spikes of [1,3] and [2,3] slow them
+ * down. LINDA_MOTOR_MAP can give another map, as in "3,3:1:20 1,3:1:-20", a cell, a channel
+ * and a gain for each mapped cell, with an offset of 10 for every channel.
+ */
+static struct MotorMap *configMotorMap() {
+	struct MotorMap *map = newMotorMap(5, 4, MOTOR_CHANNELS, 10);
+	mapMotorCell(map, 3, 3, 1, 20);
+	mapMotorCell(map, 1, 3, 1, -20);
+	mapMotorCell(map, 4, 3, 0, 20);
+	mapMotorCell(map, 2, 3, 0, -20);
+#ifndef WITH_SYMBRICATOR
+	unsigned int x[MOTOR_MAP_ENTRIES], y[MOTOR_MAP_ENTRIES], channel[MOTOR_MAP_ENTRIES];
+	unsigned int columns = 0, rows = 0, channels = MOTOR_CHANNELS;
+	int gain[MOTOR_MAP_ENTRIES], used;
+	uint8_t i, count = 0;
+	const char *text = getenv("LINDA_MOTOR_MAP");
+	while ((text != NULL) && (count < MOTOR_MAP_ENTRIES) && (sscanf(text, " %u,%u:%u:%d%n",
+			&x[count], &y[count], &channel[count], &gain[count], &used) == 4) &&
+			(x[count] < 255) && (y[count] < 255) && (channel[count] < 255)) {
+		if (x[count] >= columns) columns = x[count] + 1;
+		if (y[count] >= rows) rows = y[count] + 1;
+		if (channel[count] >= channels) channels = channel[count] + 1;
+		count++;
+		text += used;
+	}
+	if (!count) return map;
+	freeMotorMap(map);
+	map = newMotorMap(columns, rows, channels, 10);
+	for (i = 0; i < count; i++) {
+		mapMotorCell(map, x[i], y[i], channel[i], gain[i]);
+	}
+#endif
+	return map;
+}
+
+/**
+ * The map interpretSpikes uses, for all controllers in the process.
+ */
+struct MotorMap *getMotorMap() {
+	pthread_mutex_lock(&motorMapMutex);
+	if (motorMap == NULL) motorMap = configMotorMap();
+	pthread_mutex_unlock(&motorMapMutex);
+	return motorMap;
+}
+
+/**
+ * Replaces the map interpretSpikes uses, the map is taken over.
+ */
+void setMotorMap(struct MotorMap *map) {
+	if (motorMap != NULL) freeMotorMap(motorMap);
+	motorMap = map;
+}
+
+/**
+ * Empties the buffer, and adds the gain of the cell of every spike to its channel in the
+ * output, which should have room for the channels of the map. The spikes are read only once,
+ * whatever the amount of mapped cells.
+ */
+void readSpikes(struct AERBuffer *b, struct MotorMap *map, int16_t *output) {
+	union AER *aer;
+	uint8_t i;
+	for (i = 0; i < map->channel_count; i++) output[i] = map->offsets[i];
+	while ((aer = popAER(b)) != NULL) {
+		if ((aer->coordinate.x >= map->columns) || (aer->coordinate.y >= map->rows)) continue;
+		uint16_t cell = aer->coordinate.x + aer->coordinate.y * map->columns;
+		if (map->channels[cell] != MOTOR_UNMAPPED)
+			output[map->channels[cell]] += map->gains[cell];
+	}
+}
+
+/**
+ * The output in this case is just velocities for the two wheels, see configMotorMap, or
+ * whatever channels the map of the process has. The buffer is empty afterwards.
+ */
+void interpretSpikes(struct AERBuffer *b, int16_t *output) {
+	readSpikes(b, getMotorMap(), output);
 }
@@ -5,6 +5,7 @@
 #include <genome.h>
 #include <tcpipmsg.h>
 #include <string.h>
+#include <arpa/inet.h>
 
 #include <linda/tcpip.h>
 
@@ -16,6 +17,9 @@ void initMessages() {
 	tmconf->mbus_id = 254;
 	tmconf->sym3d_id = 253;
 	tmconf->gui_id = 200; //start of port ids
+	inet_aton("239.255.76.67", &tmconf->mcast_group);
+	tmconf->mcast_port = 3332;
+	tmconf->mcast_id = 252;
 }
 
 #ifdef WITH_GUI
@@ -24,9 +28,7 @@ void initMessages() {
  * port 3333. So, that connection should already have been set-up before.
  */
 struct TcpipMessage *createRunGUIMessage(uint8_t robotId) {
-	struct TcpipMessage *lm = malloc(sizeof(struct TcpipMessage));
-	lm->size = MAX_PACKET_SIZE-1;
-	lm->payload = calloc(lm->size, sizeof(unsigned char));
+	struct TcpipMessage *lm = tcpip_alloc_msg(MAX_PACKET_SIZE-1);
 	lm->payload[0] = LINDA_NEW_PROCESS_MSG;
 	char* name = (char*)&lm->payload[2];
 	uint16_t gui_size = 270 + 10, screen_size = 1280;
@@ -42,9 +44,7 @@ struct TcpipMessage *createRunGUIMessage(uint8_t robotId) {
  * Creates a new channel in the m-bus to the GUI.
  */
 struct TcpipMessage *createConnectGUIMessage(uint8_t robotId) {
-	struct TcpipMessage *lm = malloc(sizeof(struct TcpipMessage));
-	lm->size = 10;
-	lm->payload = calloc(lm->size, sizeof(unsigned char));
+	struct TcpipMessage *lm = tcpip_alloc_msg(10);
 	lm->payload[0] = LINDA_NEW_CHANNEL;
 	lm->payload[1] = lm->size - 2;
 	lm->payload[2] = MBUS_SERVER_CHANNEL; 
@@ -63,9 +63,7 @@ struct TcpipMessage *createConnectGUIMessage(uint8_t robotId) {
  * and connected beforehand.
  */
 struct TcpipMessage *createGUIColorMessage(uint8_t robotId, uint8_t *msg) {
-	struct TcpipMessage *lm = malloc(sizeof(struct TcpipMessage));
-	lm->size = 9;
-	lm->payload = calloc(lm->size, sizeof(unsigned char));
+	struct TcpipMessage *lm = tcpip_alloc_msg(9);
 	lm->payload[0] = LINDA_SET_COLOR_VALUE;
 	lm->payload[1] = lm->size - 2;
 	lm->payload[2] = robotId;
@@ -89,9 +87,7 @@ struct TcpipMessage *createGUIColorMessage(uint8_t robotId, uint8_t *msg) {
  */
 struct TcpipMessage *createActuatorMessage(uint8_t robotId, uint8_t actuatorId, 
 		int16_t* output) {
-	struct TcpipMessage *lm = malloc(sizeof(struct TcpipMessage));
-	lm->size = 8;
-	lm->payload = calloc(lm->size, sizeof(unsigned char));
+	struct TcpipMessage *lm = tcpip_alloc_msg(8);
 	lm->payload[0] = LINDA_ACTUATOR_MSG;
 	lm->payload[1] = lm->size - 2;
 	lm->payload[2] = robotId; //origin
@@ -106,16 +102,14 @@ struct TcpipMessage *createActuatorMessage(uint8_t robotId, uint8_t actuatorId,
 /**
  * Creates a topology message. This will be sent to the sym3d simulator.
  */
-struct TcpipMessage *createTopologyMessage(uint8_t robotId, uint8_t* topology, uint8_t length) {
-	struct TcpipMessage *lm = malloc(sizeof(struct TcpipMessage));
-	lm->size = 5+length;
-	lm->payload = calloc(lm->size, sizeof(unsigned char));
+struct TcpipMessage *createTopologyMessage(uint8_t robotId, uint8_t* topology, uint16_t length) {
+	struct TcpipMessage *lm = tcpip_alloc_msg(5+length);
 	lm->payload[0] = LINDA_TOPOLOGY_MSG;
-	lm->payload[1] = lm->size - 2;
+	lm->payload[1] = lm->size - 2 > 255 ? 255 : lm->size - 2;
 	lm->payload[2] = robotId; //origin
 	lm->payload[3] = tmconf->sym3d_id;
 	lm->payload[4] = robotId;
-	uint8_t i;
+	uint16_t i;
 	for (i = 0; i < length; i++) {
 		lm->payload[i+5] = topology[i];
 	}
@@ -129,9 +123,7 @@ struct TcpipMessage *createTopologyMessage(uint8_t robotId, uint8_t* topology, u
  * is actually started a new channel has to be created in the m-bus.
  */
 struct TcpipMessage *createRunColindaMessage(uint8_t robotId) {
-	struct TcpipMessage *lm = malloc(sizeof(struct TcpipMessage));
-	lm->size = MAX_PACKET_SIZE-1;
-	lm->payload = calloc(lm->size, sizeof(unsigned char));
+	struct TcpipMessage *lm = tcpip_alloc_msg(MAX_PACKET_SIZE-1);
 	lm->payload[0] = LINDA_NEW_PROCESS_MSG;
 	lm->payload[1] = lm->size - 2;
 	char* name = (char*)&lm->payload[2]; //check
@@ -143,9 +135,7 @@ struct TcpipMessage *createRunColindaMessage(uint8_t robotId) {
  * Sends an ack.
  */
 struct TcpipMessage *createRunColindaAckMessage(uint8_t robotId) {
-	struct TcpipMessage *lm = malloc(sizeof(struct TcpipMessage));
-	lm->size = 4;
-	lm->payload = calloc(lm->size, sizeof(unsigned char));
+	struct TcpipMessage *lm = tcpip_alloc_msg(4);
 	lm->payload[0] = LINDA_NEW_PROCESS_ACK;
 	lm->payload[1] = lm->size - 2;
 	lm->payload[2] = robotId;
@@ -158,9 +148,7 @@ struct TcpipMessage *createRunColindaAckMessage(uint8_t robotId) {
  * controller. When this is finished an acknowledgment message is sent back.
  */
 struct TcpipMessage *createGenomeAck(uint8_t robotId) {
-	struct TcpipMessage *lm = malloc(sizeof(struct TcpipMessage));
-	lm->size = 4;
-	lm->payload = calloc(lm->size, sizeof(unsigned char));
+	struct TcpipMessage *lm = tcpip_alloc_msg(4);
 	lm->payload[0] = LINDA_GENOME_ACK;
 	lm->payload[1] = lm->size - 2;
 	lm->payload[2] = robotId;
@@ -169,12 +157,11 @@ struct TcpipMessage *createGenomeAck(uint8_t robotId) {
 }
 
 /**
- * Each part of the genome is acknowledged.
+ * The parts of the genome are acknowledged cumulatively: the acknowledgement of a part is
+ * for that part and all parts before it.
  */
 struct TcpipMessage *createGenomePartAck(uint8_t robotId, uint8_t partId) {
-	struct TcpipMessage *lm = malloc(sizeof(struct TcpipMessage));
-	lm->size = 5;
-	lm->payload = calloc(lm->size, sizeof(unsigned char));
+	struct TcpipMessage *lm = tcpip_alloc_msg(5);
 	lm->payload[0] = LINDA_GENOME_PART_ACK;
 	lm->payload[1] = lm->size - 2;
 	lm->payload[2] = robotId;
@@ -182,3 +169,78 @@ struct TcpipMessage *createGenomePartAck(uint8_t robotId, uint8_t partId) {
 	lm->payload[4] = partId;
 	return lm;
 }
+
+/**
+ * Asks for the parts of a multicast genome that are not received, the bitmap has a bit
+ * raised for every part that is missing.
+ */
+struct TcpipMessage *createGenomeNack(uint8_t robotId, uint32_t hash, uint16_t partCount,
+		uint8_t *missing) {
+	int length = (partCount + 7) / 8;
+	struct TcpipMessage *lm = tcpip_alloc_msg(10 + length);
+	lm->payload[0] = LINDA_GENOME_NACK;
+	lm->payload[1] = lm->size - 2 > 255 ? 255 : lm->size - 2;
+	lm->payload[2] = robotId;
+	lm->payload[3] = tmconf->elinda_id;
+	lm->payload[4] = hash >> 24;
+	lm->payload[5] = hash >> 16;
+	lm->payload[6] = hash >> 8;
+	lm->payload[7] = hash;
+	lm->payload[8] = partCount >> 8;
+	lm->payload[9] = partCount;
+	memcpy(&lm->payload[10], missing, length);
+	return lm;
+}
+
+/**
+ * Tells that a genome delta can not be applied, because the base genome is not the last one
+ * received here. The Elinda engine sends the entire genome instead.
+ */
+struct TcpipMessage *createGenomeDeltaNack(uint8_t robotId, uint32_t baseHash) {
+	struct TcpipMessage *lm = tcpip_alloc_msg(8);
+	lm->payload[0] = LINDA_GENOME_DELTA_NACK;
+	lm->payload[1] = lm->size - 2;
+	lm->payload[2] = robotId;
+	lm->payload[3] = tmconf->elinda_id;
+	lm->payload[4] = baseHash >> 24;
+	lm->payload[5] = baseHash >> 16;
+	lm->payload[6] = baseHash >> 8;
+	lm->payload[7] = baseHash;
+	return lm;
+}
+
+/**
+ * Tells that a network frame can not be built into the grid here, see netframe.h. The Elinda
+ * engine sends genomes instead.
+ */
+struct TcpipMessage *createNetworkNack(uint8_t robotId, uint32_t hash) {
+	struct TcpipMessage *lm = tcpip_alloc_msg(8);
+	lm->payload[0] = LINDA_NETWORK_NACK;
+	lm->payload[1] = lm->size - 2;
+	lm->payload[2] = robotId;
+	lm->payload[3] = tmconf->elinda_id;
+	lm->payload[4] = hash >> 24;
+	lm->payload[5] = hash >> 16;
+	lm->payload[6] = hash >> 8;
+	lm->payload[7] = hash;
+	return lm;
+}
+
+/**
+ * The halo for another robot that is docked on a side of the grid: the parts that the cells
+ * along that side gave it since the last exchange, for all products. The side is the one of
+ * the sender, so the receiver finds them along the opposite side of its own grid.
+ */
+struct TcpipMessage *createDiffusionHaloMessage(uint8_t robotId, uint8_t destId, uint8_t side,
+		uint16_t exchange, uint8_t *parts, uint16_t size) {
+	struct TcpipMessage *lm = tcpip_alloc_msg(LINDA_DIFFUSION_HALO_HEADER + size);
+	lm->payload[0] = LINDA_DIFFUSION_HALO;
+	lm->payload[1] = lm->size - 2 > 255 ? 255 : lm->size - 2;
+	lm->payload[2] = robotId;
+	lm->payload[3] = destId;
+	lm->payload[4] = side;
+	lm->payload[5] = exchange >> 8;
+	lm->payload[6] = exchange;
+	memcpy(&lm->payload[LINDA_DIFFUSION_HALO_HEADER], parts, size);
+	return lm;
+}
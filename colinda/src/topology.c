@@ -5,6 +5,7 @@
 #include <bits.h>
 #include <topology.h>
 #include <neuron.h>
+#include <region.h>
 #include <stdlib.h>
 
 #ifdef WITH_SYMBRICATOR
@@ -55,15 +56,15 @@ const float LTP[16] = {0.100000, 0.095123, 0.090484, 0.086071, 0.081873, 0.07788
  */
 void getSpikes() {
 	//struct Neuron *
-	n = nn->neurons;
-	while (n != NULL) {
+	clctx->n = clctx->nn->neurons;
+	while (clctx->n != NULL) {
 		//if ((n->type & TOPOLOGY_MASK) != INPUT_NEURON) {
-		ADVANCE(n->history->spike_bitseq);
+		ADVANCE(clctx->n->history->spike_bitseq);
 		if (fired()) {
-			RAISE(n->history->spike_bitseq, 1);
+			RAISE(clctx->n->history->spike_bitseq, 1);
 		}
 		//}
-		n = n->next;
+		clctx->n = clctx->n->next;
 	}
 }
 
@@ -72,7 +73,8 @@ void getSpikes() {
  * To be able to forget patterns again, learning should not only strengthening synapses, but it
  * should also be possible to weaken them again. LTP stands for long-term potentiation, LTD for
  * long-term depression. In the former case, the weight increases, in the latter case, the weight
- * decreases. The weights are clipped to 10.0 and -10.0.
+ * decreases. The weights are clipped to 10.0 and -10.0. The compiled network learns only
+ * from the neurons that fire instead, see setCompiledLearning.
  */
 /**
  * Freek's note#1: In calculating the interspike distance between a pre and post synaptic neuron,
@@ -104,7 +106,7 @@ void updateSynapses() {
  }
  */
 void adaptWeights() {
-	struct Neuron *ln = nn->neurons;
+	struct Neuron *ln = clctx->nn->neurons;
 	struct Port *lp;
 	int16_t interspike_distance;
 
@@ -139,7 +141,7 @@ void adaptWeights() {
  * for the next processing stage.
  */
 void propagateSpikes() {
-	struct Neuron *ln = nn->neurons;
+	struct Neuron *ln = clctx->nn->neurons;
 	struct Port *lp;
 	while (ln != NULL) {
 		lp = ln->ports_out;
@@ -164,19 +166,440 @@ void propagateSpikes() {
  */
 void updateNeurons() {
 	//struct Neuron *
-	n = nn->neurons;
-	while (n != NULL) {
-		if ((n->type & TOPOLOGY_MASK) != INPUT_NEURON) {
-			//printf("[%d,%d] ", n->gridcell->position->x, n->gridcell->position->y);
-			update(n->I);
-			n->I = 0;
+	clctx->n = clctx->nn->neurons;
+	while (clctx->n != NULL) {
+		if ((clctx->n->type & TOPOLOGY_MASK) != INPUT_NEURON) {
+			//printf("[%d,%d] ", n->gridcell->position.x, n->gridcell->position.y);
+			update(clctx->n->I);
+			clctx->n->I = 0;
 		}
-		n = n->next;
+		clctx->n = clctx->n->next;
 	}
 }
 
 /** @} */
 
+/***********************************************************************************************
+ *
+ * @name compiled_architecture
+ * The same routines on the compiled network cn, the run loop uses those once the network is
+ * finalized.
+ *
+ ***********************************************************************************************/
+
+/** @{ */
+
+/**
+ * The conversions to the numbers of the compiled network, and what a spike over a synapse
+ * adds to an input, see fixedpoint.h.
+ */
+#ifdef WITH_FIXED_POINT
+#define COMPILED_STATE(x)		toFixed(x)
+#define COMPILED_FLOAT(x)		fromFixed(x)
+#define COMPILED_WEIGHT(w)		toSynaptic((w) / 3.0f)
+#define COMPILED_SPIKE(I, w)	((I) = addFixed((I), fromSynaptic(w)))
+#define COMPILED_ADD(I, x)		((I) = addFixed((I), (x)))
+#define COMPILED_TOLERANCE		1e-3
+#define COMPILED_EXACT			0
+#else
+#define COMPILED_STATE(x)		(x)
+#define COMPILED_FLOAT(x)		(x)
+#define COMPILED_WEIGHT(w)		(w)
+#define COMPILED_SPIKE(I, w)	((I) += ((w) / 3.0))
+#define COMPILED_ADD(I, x)		((I) += (x))
+#define COMPILED_TOLERANCE		1e-10
+#define COMPILED_EXACT			(clctx->cn->ring == NULL)
+#endif
+
+/**
+ * The group of a neuron in the compiled network, by which it is updated.
+ */
+static uint8_t getCompiledGroup(struct Neuron *neuron) {
+	if ((neuron->type & TOPOLOGY_MASK) == INPUT_NEURON) return 0;
+	switch (neuron->type & NEURONTYPE_MASK) {
+	case NEURONTYPE_TONIC_SPIKING: return 1;
+	case NEURONTYPE_PHASIC_SPIKING: return 2;
+	case NEURONTYPE_INTEGRATOR: return 3;
+	default: return 4;
+	}
+}
+
+/**
+ * The type the neurons in a group are updated as, of the input neurons it is not used.
+ */
+static const uint8_t compiledGroupType[COMPILED_GROUPS] = { NEURONTYPE_TONIC_SPIKING,
+		NEURONTYPE_TONIC_SPIKING, NEURONTYPE_PHASIC_SPIKING, NEURONTYPE_INTEGRATOR,
+		NEURONTYPE_MASK };
+
+/**
+ * Compiles the developed network, see CompiledNetwork, a network compiled before is freed. A
+ * synapse to a neuron that is not in the list of neurons is left out. The weights and delays
+ * are copied, so the network should be compiled again when they change. The Izhikevich state
+ * is copied as well, and from then on only the compiled network is updated. The spikes in the
+ * histories of the neurons are put in the ring, at the ticks they would arrive.
+ */
+void finalizeNeuralNetwork() {
+	struct Neuron *ln;
+	struct Port *lp;
+	struct IzhikevichArrays *z;
+	uint16_t i, j, count = 0, cells = clctx->s->rows * clctx->s->columns;
+	uint16_t next[COMPILED_GROUPS];
+	uint32_t k = 0;
+	freeCompiledNetwork();
+	clctx->cn = lindaMalloc(sizeof(struct CompiledNetwork));
+	for (i = 0; i <= COMPILED_GROUPS; i++) {
+		clctx->cn->groups[i] = 0;
+	}
+	for (ln = clctx->nn->neurons; ln != NULL; ln = ln->next) {
+		count++;
+		clctx->cn->groups[getCompiledGroup(ln) + 1]++;
+		for (lp = ln->ports_out; lp != NULL; lp = lp->next) k++;
+	}
+	for (i = 0; i < COMPILED_GROUPS; i++) {
+		clctx->cn->groups[i + 1] += clctx->cn->groups[i];
+		next[i] = clctx->cn->groups[i];
+	}
+	clctx->cn->neuron_count = count;
+	clctx->cn->output_count = 0;
+	clctx->cn->neurons = lindaMalloc(count * sizeof(struct Neuron*));
+	clctx->cn->order = lindaMalloc(count * sizeof(uint16_t));
+	clctx->cn->row = lindaMalloc((count + 1) * sizeof(uint32_t));
+	clctx->cn->spikes = lindaMalloc(count * sizeof(uint16_t));
+	clctx->cn->I = lindaMalloc(count * sizeof(neural_t));
+	clctx->cn->outputs = lindaMalloc(count * sizeof(uint16_t));
+	clctx->cn->cells = lindaMalloc(cells * sizeof(uint16_t));
+	clctx->cn->post = lindaMalloc(k * sizeof(uint16_t));
+	clctx->cn->weight = lindaMalloc(k * sizeof(synaptic_t));
+	clctx->cn->delay = lindaMalloc(k);
+	z = clctx->cn->izhikevich = lindaMalloc(sizeof(struct IzhikevichArrays));
+	z->v = lindaMalloc(6 * count * sizeof(neural_t));
+	z->u = z->v + count; z->a = z->u + count; z->b = z->a + count;
+	z->c = z->b + count; z->d = z->c + count;
+	clctx->cn->tick = 0;
+	clctx->cn->slots = 0;
+	clctx->cn->ring = NULL;
+	clctx->cn->learning = NULL;
+
+	for (i = 0; i < cells; i++) {
+		clctx->cn->cells[i] = NO_NEURON;
+	}
+	for (j = 0, ln = clctx->nn->neurons; ln != NULL; ln = ln->next, j++) {
+		i = next[getCompiledGroup(ln)]++;
+		clctx->cn->order[j] = i;
+		clctx->cn->neurons[i] = ln;
+		clctx->cn->cells[getGridCellIndex(ln->gridcell)] = i;
+		clctx->cn->spikes[i] = ln->history->spike_bitseq;
+		clctx->cn->I[i] = COMPILED_STATE(ln->I);
+		z->v[i] = COMPILED_STATE(ln->v); z->u[i] = COMPILED_STATE(ln->u);
+		z->a[i] = COMPILED_STATE(ln->a); z->b[i] = COMPILED_STATE(ln->b);
+		z->c[i] = COMPILED_STATE(ln->c); z->d[i] = COMPILED_STATE(ln->d);
+	}
+	for (i = 0, k = 0; i < count; i++) {
+		clctx->cn->row[i] = k;
+		for (lp = clctx->cn->neurons[i]->ports_out; lp != NULL; lp = lp->next) {
+			struct Neuron *lpost = lp->synapse->post_neuron;
+			if ((lpost == NULL) || (lpost->gridcell == NULL)) continue;
+			clctx->cn->post[k] = clctx->cn->cells[getGridCellIndex(lpost->gridcell)];
+			if (clctx->cn->post[k] == NO_NEURON) continue;
+			clctx->cn->weight[k] = COMPILED_WEIGHT(lp->synapse->weight);
+			clctx->cn->delay[k] = lp->synapse->delay;
+			if (clctx->cn->delay[k] >= clctx->cn->slots) clctx->cn->slots = clctx->cn->delay[k];
+			k++;
+		}
+	}
+	clctx->cn->row[count] = clctx->cn->synapse_count = k;
+#ifdef WITH_SPIKE_EVENTS
+	for (i = 2; i <= clctx->cn->slots; i <<= 1);
+	clctx->cn->slots = i;
+	clctx->cn->ring = lindaCalloc(clctx->cn->slots * count, sizeof(neural_t));
+	for (i = 0; i < count; i++) {
+		for (k = clctx->cn->row[i]; k < clctx->cn->row[i + 1]; k++) {
+			uint8_t b, d = clctx->cn->delay[k];
+			for (b = 1; (b <= d) && (b < 16); b++) {
+				if (RAISED(clctx->cn->spikes[i], b)) {
+					COMPILED_SPIKE(clctx->cn->ring[(d - b) * count + clctx->cn->post[k]],
+							clctx->cn->weight[k]);
+				}
+			}
+		}
+	}
+#endif
+	for (i = 0; i < cells; i++) {
+		j = clctx->cn->cells[i];
+		if ((j != NO_NEURON) && ((clctx->cn->neurons[j]->type & TOPOLOGY_MASK) == OUTPUT_NEURON)) {
+			clctx->cn->outputs[clctx->cn->output_count++] = j;
+		}
+	}
+#ifndef WITH_SYMBRICATOR
+	if (getenv("LINDA_STDP") != NULL) setCompiledLearning(1);
+#endif
+}
+
+void freeCompiledNetwork() {
+	if (clctx->cn == NULL) return;
+	free(clctx->cn->neurons);
+	free(clctx->cn->order);
+	free(clctx->cn->row);
+	free(clctx->cn->spikes);
+	free(clctx->cn->I);
+	free(clctx->cn->izhikevich->v);
+	free(clctx->cn->izhikevich);
+	free(clctx->cn->outputs);
+	free(clctx->cn->cells);
+	free(clctx->cn->post);
+	free(clctx->cn->weight);
+	free(clctx->cn->delay);
+	free(clctx->cn->ring);
+	setCompiledLearning(0);
+	free(clctx->cn);
+	clctx->cn = NULL;
+}
+
+/**
+ * Learning is switched on by building the incoming synapses of every neuron, by counting
+ * them per post-synaptic neuron first, and switched off by freeing them again. The pointer
+ * form does not learn, so with WITH_NETWORK_CHECK learning can not be switched on.
+ */
+void setCompiledLearning(uint8_t on) {
+	struct CompiledLearning *l;
+	uint16_t i;
+	uint32_t k;
+	if (clctx->cn == NULL) return;
+	l = clctx->cn->learning;
+	if (!on) {
+		if (l == NULL) return;
+		free(l->row);
+		free(l->synapse);
+		free(l->pre);
+		free(l->ltp_stamp);
+		free(l->ltd_stamp);
+		free(l);
+		clctx->cn->learning = NULL;
+		return;
+	}
+#ifdef WITH_NETWORK_CHECK
+#ifdef WITH_CONSOLE
+	tprintf(LOG_WARNING, __func__, "No learning with WITH_NETWORK_CHECK");
+#endif
+	return;
+#endif
+	if (l != NULL) return;
+	l = lindaMalloc(sizeof(struct CompiledLearning));
+	l->row = lindaMalloc((clctx->cn->neuron_count + 1) * sizeof(uint32_t));
+	l->synapse = lindaMalloc(clctx->cn->synapse_count * sizeof(uint32_t));
+	l->pre = lindaMalloc(clctx->cn->synapse_count * sizeof(uint16_t));
+	l->ltp_stamp = lindaMalloc(clctx->cn->synapse_count * sizeof(uint16_t));
+	l->ltd_stamp = lindaMalloc(clctx->cn->synapse_count * sizeof(uint16_t));
+	for (i = 0; i <= clctx->cn->neuron_count; i++) {
+		l->row[i] = 0;
+	}
+	for (k = 0; k < clctx->cn->synapse_count; k++) {
+		l->row[clctx->cn->post[k] + 1]++;
+		l->ltp_stamp[k] = l->ltd_stamp[k] = clctx->cn->tick - 0x8000;
+	}
+	for (i = 0; i < clctx->cn->neuron_count; i++) {
+		l->row[i + 1] += l->row[i];
+	}
+	for (i = 0; i < clctx->cn->neuron_count; i++) {
+		for (k = clctx->cn->row[i]; k < clctx->cn->row[i + 1]; k++) {
+			uint32_t m = l->row[clctx->cn->post[k]]++;
+			l->synapse[m] = k;
+			l->pre[m] = i;
+		}
+	}
+	for (i = clctx->cn->neuron_count; i > 0; i--) {
+		l->row[i] = l->row[i - 1];
+	}
+	l->row[0] = 0;
+	for (i = 0; i < 16; i++) {
+		l->ltp[i] = COMPILED_WEIGHT(LTP[i]);
+		l->ltd[i] = COMPILED_WEIGHT(LTD[i]);
+	}
+	l->max = COMPILED_WEIGHT(10.0f);
+	clctx->cn->learning = l;
+}
+
+/**
+ * As in adaptWeights, LTP clips the weight at max and LTD at -max.
+ */
+static void learnCompiledSynapse(uint32_t k, synaptic_t delta) {
+	const synaptic_t max = clctx->cn->learning->max;
+	synaptic_t weight = clctx->cn->weight[k] + delta;
+	if ((delta > 0) && (weight > max)) weight = max;
+	else if ((delta < 0) && (weight < -max)) weight = -max;
+	clctx->cn->weight[k] = weight;
+}
+
+/**
+ * Does what adaptWeights does, but only for the synapses of the neurons that fired in this
+ * tick, and with their delays. When a neuron fires, every incoming synapse gets LTP from the
+ * last pre-synaptic spike that arrived, counted from 1 for one that arrived in this tick, as
+ * the spike histories do. Every outgoing synapse gets LTD from the time the post-synaptic
+ * neuron fired last until this spike arrives. A post-synaptic spike while this spike is still
+ * under way is not learned from. The stamps make that a spike pair is learned from only once,
+ * also if one of the two spikes is paired again.
+ */
+static void learnCompiledSynapses() {
+	struct CompiledLearning *l = clctx->cn->learning;
+	const uint16_t tick = clctx->cn->tick;
+	uint16_t i, history, spike;
+	uint32_t k, m;
+	uint16_t first, interval;
+	for (i = 0; i < clctx->cn->neuron_count; i++) {
+		if (!RAISED(clctx->cn->spikes[i], 1)) continue;
+		for (m = l->row[i]; m < l->row[i + 1]; m++) {
+			k = l->synapse[m];
+			if (!clctx->cn->delay[k] || (clctx->cn->delay[k] > 15)) continue;
+			history = (clctx->cn->spikes[l->pre[m]] >> clctx->cn->delay[k]) & ~1;
+			if (!history) continue;
+			first = __builtin_ctz(history);
+			spike = tick + 1 - first;
+			if (l->ltp_stamp[k] == spike) continue;
+			l->ltp_stamp[k] = spike;
+			learnCompiledSynapse(k, l->ltp[first]);
+		}
+		for (k = clctx->cn->row[i]; k < clctx->cn->row[i + 1]; k++) {
+			history = clctx->cn->spikes[clctx->cn->post[k]] & ~1;
+			if (!clctx->cn->delay[k] || !history) continue;
+			first = __builtin_ctz(history);
+			interval = first - 1 + clctx->cn->delay[k];
+			if (interval > 15) continue;
+			spike = tick + 1 - first;
+			if (l->ltd_stamp[k] == spike) continue;
+			l->ltd_stamp[k] = spike;
+			learnCompiledSynapse(k, l->ltd[interval]);
+		}
+	}
+}
+
+/**
+ * Adds the weights of the synapses of neuron i to the inputs of their post-synaptic neurons
+ * in the ring, at the slot that is their delay after the given tick. A delay of 0 is never
+ * delivered, like a spike is never at bit 0 of a spike history.
+ */
+static void scheduleCompiledSpike(uint16_t i, uint16_t tick) {
+	const uint16_t mask = clctx->cn->slots - 1;
+	uint32_t k;
+	for (k = clctx->cn->row[i]; k < clctx->cn->row[i + 1]; k++) {
+		uint8_t delay = clctx->cn->delay[k];
+		if (delay == 0) continue;
+		COMPILED_SPIKE(clctx->cn->ring[((uint16_t)(tick + delay) & mask) * clctx->cn->neuron_count +
+				clctx->cn->post[k]], clctx->cn->weight[k]);
+	}
+}
+
+/**
+ * A spike from outside on the neuron in the cell with the given index, if there is one. It
+ * arrives over a synapse with a delay of 1 in this tick, not the next. A neuron spikes at
+ * most once a tick, as in its spike history, so it is not sent off again if the neuron fired
+ * in the previous tick or had a spike from outside before.
+ */
+void spikeCompiledNeuron(uint16_t cell) {
+	uint16_t i = clctx->cn->cells[cell];
+	if (i == NO_NEURON) return;
+	uint8_t spiked = RAISED(clctx->cn->spikes[i], 1) != 0;
+	clctx->cn->spikes[i] = (uint16_t)(clctx->cn->spikes[i] << 1) | 0x02;
+	if ((clctx->cn->ring != NULL) && !spiked) scheduleCompiledSpike(i, clctx->cn->tick - 1);
+}
+
+#ifdef WITH_NETWORK_CHECK
+/**
+ * Runs propagateSpikes over the pointers, from the spikes and currents of the compiled
+ * network before propagateCompiledSpikes, and tells if the currents differ after it. With
+ * the ring the inputs may be added in another order, and in fixed-point they are rounded, so
+ * then they only have to be close, and delays should not be above 15.
+ */
+static void checkCompiledSpikes(uint8_t after) {
+	uint16_t i;
+	for (i = 0; i < clctx->cn->neuron_count; i++) {
+		struct Neuron *ln = clctx->cn->neurons[i];
+		if (!after) {
+			ln->history->spike_bitseq = clctx->cn->spikes[i];
+			ln->I = COMPILED_FLOAT(clctx->cn->I[i]);
+			continue;
+		}
+		float I = COMPILED_FLOAT(clctx->cn->I[i]);
+		if (COMPILED_EXACT ? (ln->I != I) :
+				((ln->I - I) * (ln->I - I) > COMPILED_TOLERANCE * (1 + ln->I * ln->I))) {
+#ifdef WITH_CONSOLE
+			char text[96];
+			sprintf(text, "Compiled network differs in [%i,%i]: I = %f instead of %f",
+					ln->gridcell->position.x, ln->gridcell->position.y, I, ln->I);
+			tprintf(LOG_ALERT, __func__, text);
+#endif
+		}
+	}
+	if (!after) propagateSpikes();
+}
+#endif
+
+/**
+ * Does what propagateSpikes does, the neurons are visited in the order of the list, so the
+ * contributions to the input of a neuron are added in the same order, and the result is the
+ * same to the bit. With the ring, the row of this tick is added instead.
+ */
+void propagateCompiledSpikes() {
+	const uint32_t *row = clctx->cn->row;
+	const uint16_t *post = clctx->cn->post;
+	const synaptic_t *weight = clctx->cn->weight;
+	const uint8_t *delay = clctx->cn->delay;
+	neural_t *I = clctx->cn->I;
+	uint16_t i, j;
+	uint32_t k;
+#ifdef WITH_NETWORK_CHECK
+	checkCompiledSpikes(0);
+#endif
+	if (clctx->cn->ring != NULL) {
+		neural_t *slot = clctx->cn->ring +
+				(clctx->cn->tick & (clctx->cn->slots - 1)) * clctx->cn->neuron_count;
+		for (i = 0; i < clctx->cn->neuron_count; i++) {
+			COMPILED_ADD(I[i], slot[i]);
+			slot[i] = 0;
+		}
+#ifdef WITH_NETWORK_CHECK
+		checkCompiledSpikes(1);
+#endif
+		return;
+	}
+	for (j = 0; j < clctx->cn->neuron_count; j++) {
+		i = clctx->cn->order[j];
+		uint16_t spikes = clctx->cn->spikes[i];
+		if (!spikes) continue;
+		for (k = row[i]; k < row[i + 1]; k++) {
+			if (RAISED(spikes, delay[k])) COMPILED_SPIKE(I[post[k]], weight[k]);
+		}
+	}
+#ifdef WITH_NETWORK_CHECK
+	checkCompiledSpikes(1);
+#endif
+}
+
+/**
+ * Does what updateNeurons and getSpikes do, one group of neurons at a time. With the ring,
+ * the spikes of the neurons that fired are sent off, in the order of the list, and the
+ * next tick starts. With learning the synapses of the neurons that fired learn.
+ */
+void updateCompiledNeurons() {
+	uint16_t j;
+	uint8_t g;
+	fireNeuronArrays(clctx->cn->izhikevich, clctx->cn->groups[0], clctx->cn->groups[1],
+			clctx->cn->spikes);
+	for (g = 1; g < COMPILED_GROUPS; g++) {
+		updateNeuronArrays(clctx->cn->izhikevich, clctx->cn->groups[g], clctx->cn->groups[g + 1],
+				compiledGroupType[g], clctx->cn->I, clctx->cn->spikes);
+	}
+	if (clctx->cn->ring != NULL) {
+		for (j = 0; j < clctx->cn->neuron_count; j++) {
+			uint16_t i = clctx->cn->order[j];
+			if (RAISED(clctx->cn->spikes[i], 1)) scheduleCompiledSpike(i, clctx->cn->tick);
+		}
+	}
+	if (clctx->cn->learning != NULL) learnCompiledSynapses();
+	clctx->cn->tick++;
+}
+
+/** @} */
+
 /***********************************************************************************************
  *
  * @name developmental_architecture
@@ -279,11 +702,11 @@ void copyPorts(struct Neuron *src, struct Neuron *target, uint8_t context) {
  * neuron. If they were just moved, weights can't be adjusted per synapse of course.
  */
 struct Neuron *duplicateNeuron(struct Neuron *src) {
-	struct Neuron *ln = lindaMalloc(sizeof(struct Neuron));
+	struct Neuron *ln = regionAlloc(REGION_NEURON, sizeof(struct Neuron));
 	ln->next = NULL; ln->ports_in = NULL; ln->ports_out = NULL;
-	ln->history = lindaMalloc(sizeof(struct SpikeHistory));
+	ln->history = regionAlloc(REGION_HISTORY, sizeof(struct SpikeHistory));
 	ln->type = src->type;
-	n = ln;
+	clctx->n = ln;
 	init_neuron();
 	uint8_t context = 0;
 #ifdef WITH_CONSOLE
@@ -324,179 +747,98 @@ void moveOutgoingSynapses(struct Neuron *src, struct Neuron *target) {
  */
 struct Synapse *addSynapse(struct Neuron *src, struct Neuron *target) {
 	//create synapse
-	struct Synapse *ls = lindaMalloc(sizeof(struct Synapse));
+	struct Synapse *ls = regionAlloc(REGION_SYNAPSE, sizeof(struct Synapse));
 	ls->pre_neuron = src;
 	ls->post_neuron = target;
 
-	//create source port, add to port list
-	struct Port *lp = lindaMalloc(sizeof(struct Port));
-	lp->synapse = ls;
-	lp->next = src->ports_out;
-	src->ports_out = lp;
-
-	//create target port, add to port list
-	lp = lindaMalloc(sizeof(struct Port));
-	lp->synapse = ls;
-	lp->next = target->ports_in;
-	target->ports_in = lp;
+	//create source and target port, add to port lists
+	struct Port *lpout = regionAlloc(REGION_PORT, sizeof(struct Port));
+	struct Port *lpin = regionAlloc(REGION_PORT, sizeof(struct Port));
+	lpout->synapse = lpin->synapse = ls;
+	lpout->opposite = lpin;
+	lpin->opposite = lpout;
+	linkPort(src, lpout, PORT_OUT);
+	linkPort(target, lpin, PORT_IN);
 
 	return ls;
 }
 
 /**
- * Returns the previous "in" port. Ports are stored in a single linked list, so complexity of this
- * retrieval function is O(n) with n the amounts of ports. Making it a double linked list
- * would expand memory space with S(2*n) bytes, with n the overall amount of synapses in the
- * neural network. Reverse search is very rare (only for embryogeny purposes) so the trade-off
- * is easy in this case.
+ * Adds the port at the head of the list of ports in or out of the neuron.
  */
-struct Port *getPreviousPort(struct Neuron *neuron, struct Port *port) {
-	struct Port *lp = neuron->ports_in;
-	if (lp == port) return NULL;
-	if (lp != NULL) {
-		while (lp->next != NULL) {
-			if (lp->next == port) return lp;
-			lp = lp->next;
-		}
-	}
-	lp = neuron->ports_out;
-	if (lp == port)	return NULL;
-	if (lp != NULL) {
-		while (lp->next != NULL) {
-			if (lp->next == port) return lp;
-			lp = lp->next;
-		}
+void linkPort(struct Neuron *neuron, struct Port *port, uint8_t direction) {
+	struct Port **lhead = (direction == PORT_IN) ? &neuron->ports_in : &neuron->ports_out;
+	port->direction = direction;
+	port->prev = NULL;
+	port->next = *lhead;
+	if (*lhead != NULL) (*lhead)->prev = port;
+	*lhead = port;
+}
+
+/**
+ * Removes the port from the list it is in on the neuron, the port itself is not changed.
+ */
+void unlinkPort(struct Neuron *neuron, struct Port *port) {
+	if (port->prev != NULL) {
+		port->prev->next = port->next;
+	} else if (port->direction == PORT_IN) {
+		neuron->ports_in = port->next;
+	} else {
+		neuron->ports_out = port->next;
 	}
-	return NULL;
+	if (port->next != NULL) port->next->prev = port->prev;
+}
+
+/**
+ * Returns the previous port in the list of the given port, NULL if it is the head.
+ */
+struct Port *getPreviousPort(struct Neuron *neuron, struct Port *port) {
+	return port->prev;
 }
 
 struct Port *getPreviousInPort(struct Neuron *neuron, struct Port *port) {
-	struct Port *lp = neuron->ports_in;
-	if (lp == port) return NULL;
-	if (lp != NULL) {
-		while (lp->next != NULL) {
-			if (lp->next == port) return lp;
-			lp = lp->next;
-		}
-	}
-	return NULL;
+	return (port->direction == PORT_IN) ? port->prev : NULL;
 }
 
 struct Port *getPreviousOutPort(struct Neuron *neuron, struct Port *port) {
-	struct Port *lp = neuron->ports_out;
-	if (lp == port) return NULL;
-	if (lp != NULL) {
-		while (lp->next != NULL) {
-			if (lp->next == port) return lp;
-			lp = lp->next;
-		}
-	}
-	return NULL;
+	return (port->direction == PORT_OUT) ? port->prev : NULL;
 }
 
 /**
- * The flags tell the caller if the port was found in the in-ports or the out-ports list,
- * and additionally tells if a NULL value is caused because the port is the head of the
- * linked list. A bit at 1 set is "in", a bit at 2 set is "out", a bit at 3 set is "head".
+ * The flags tell the caller if the port is in the in-ports or the out-ports list, and
+ * additionally if it is the head of the linked list. A bit at 1 set is "in", a bit at 2 set
+ * is "out", a bit at 3 set is "head".
  */
 uint8_t getPortContext(struct Neuron *neuron, struct Port *port) {
-	uint8_t flags = 0;
-	struct Port *lp = neuron->ports_in;
-	if (lp != NULL) {
-		RAISE(flags, 1);
-		if (lp == port) { RAISE(flags, 3); return flags; }
-		do {
-			lp = lp->next;
-			if (lp == port) return flags;
-		} while (lp != NULL);
-	}
-	lp = neuron->ports_out;
-	if (lp != NULL) {
-		flags = 0; RAISE(flags, 2);
-		if (lp == port) { RAISE(flags, 3); return flags; }
-		do {
-			lp = lp->next;
-			if (lp == port) return flags;
-		} while (lp != NULL);
-		flags = 0;
-	}
-	return flags;
+	return port->direction | ((port->prev == NULL) ? PORT_HEAD : 0);
 }
 
 /**
- * The flags variable says if the given port is ingoing (bit at 1 is set) or outgoing (bit is
- * not set). The returned port is of course the opposite.
+ * The port of the same synapse on the other neuron. The flags are not needed anymore, the
+ * port knows its opposite.
  */
 struct Port *getOpposite(struct Neuron *neuron, struct Port *port, uint8_t flags) {
-	struct Neuron *lnother = NULL;
-	if (RAISED(flags, 1)) {
-		if (port->synapse == NULL) {
-			tprintf(LOG_ALERT, __func__, "No synapse attached to port (in)!");
-		}
-		lnother = port->synapse->pre_neuron;
-		struct Port *lp = lnother->ports_out;
-		if (lp == NULL) {
-			tprintf(LOG_ALERT, __func__, "No ports out at all at other side!");
-		}
-		while (lp != NULL) {
-			if (lp->synapse->post_neuron == neuron) return lp;
-			lp = lp->next;
-		}
 #ifdef WITH_CONSOLE
-		tprintf(LOG_ALERT, __func__, "No synapse connects to port out of the other neuron!");
-#endif
-		return NULL;
-	} else {
-		if (port->synapse == NULL) {
-			tprintf(LOG_ALERT, __func__, "No synapse attached to port (out)!");
-		}
-		lnother = port->synapse->post_neuron;
-		struct Port *lp = lnother->ports_in;
-		if (lp == NULL) {
-			tprintf(LOG_ALERT, __func__, "No ports in at all at other side!");
-		}
-		while (lp != NULL) {
-			if (lp->synapse->pre_neuron == neuron) return lp;
-			lp = lp->next;
-		}
-#ifdef WITH_CONSOLE
-		tprintf(LOG_ALERT, __func__, "No synapse connects to port in of the other neuron!");
-#endif
-		return NULL;
+	if (port->opposite == NULL) {
+		tprintf(LOG_ALERT, __func__, "No opposite port!");
 	}
+#endif
+	return port->opposite;
 }
 
 /**
  * Porting a synapse by moving the given "port" struct from the source neuron to the target
- * neuron.
+ * neuron. The synapse then connects the target neuron, instead of the source neuron, with the
+ * neuron on the opposite side.
  */
 void portSynapse(struct Neuron *src, struct Neuron *target, struct Port *port) {
-	uint8_t flags = getPortContext(src, port);
-	struct Port *lprev = getPreviousPort(src, port);
-	if (RAISED(flags, 3)) {
-		if (RAISED(flags, 1)) src->ports_in = port->next;
-		else src->ports_out = port->next;
-	} else if (lprev == NULL) {
-#ifdef WITH_CONSOLE
-		tprintf(LOG_ALERT, __func__, "Port has no predecessor.");
-#endif
-	} else {
-		lprev->next = port->next;
-	}
-
-	if (RAISED(flags, 1)) {
-		port->next = target->ports_in;
-		target->ports_in = port;
-	} else if (RAISED(flags, 2)) {
-		port->next = target->ports_out;
-		target->ports_out = port;
+	unlinkPort(src, port);
+	linkPort(target, port, port->direction);
+	if (port->direction == PORT_IN) {
+		port->synapse->post_neuron = target;
 	} else {
-#ifdef WITH_CONSOLE
-		tprintf(LOG_ALERT, __func__, "Huh?");
-#endif
+		port->synapse->pre_neuron = target;
 	}
-	port->synapse->pre_neuron = src;
-	port->synapse->post_neuron = target;
 }
 
 /**
@@ -507,20 +849,9 @@ void portCurrentSynapse(struct Neuron *target) {
 	
 	//@todo Check if synapse on neuron becomes self-referential
 	
-	struct Port *lpnext = np->current_port->next, *lpnew = NULL;
-	struct Port *lpprev = getPreviousPort(np, np->current_port);
-	uint8_t flags = getPortContext(np, np->current_port);
-	portSynapse(np, target, np->current_port);
-	if (lpprev != NULL) {
-		lpnew = (lpprev->next = lpnext);
-	} else {
-		if (RAISED(flags, 1)) {
-			lpnew = (np->ports_in = lpnext);
-		} else {
-			lpnew = (np->ports_out = lpnext);
-		}
-	}
-	np->current_port = lpnew; //may be NULL
+	struct Port *lpnext = clctx->np->current_port->next;
+	portSynapse(clctx->np, target, clctx->np->current_port);
+	clctx->np->current_port = lpnext; //may be NULL
 }
 
 /**
@@ -528,11 +859,11 @@ void portCurrentSynapse(struct Neuron *target) {
  * input to hidden to output neuron.
  */
 void next_topological_type() {
-	uint8_t topological_type = (n->type & TOPOLOGY_MASK) + (0x01 < TOPOLOGY_SHIFT);
+	uint8_t topological_type = (clctx->n->type & TOPOLOGY_MASK) + (0x01 < TOPOLOGY_SHIFT);
 	topological_type %= INPUT_NEURON;
 	if (topological_type == 0) topological_type += (0x01 < TOPOLOGY_SHIFT);
-	n->type = n->type & ~TOPOLOGY_MASK;
-	n->type = n->type | topological_type;
+	clctx->n->type = clctx->n->type & ~TOPOLOGY_MASK;
+	clctx->n->type = clctx->n->type | topological_type;
 }
 
 /** @} */
@@ -540,7 +871,7 @@ void next_topological_type() {
 #ifdef WITH_CONSOLE
 
 void printNeurons(uint8_t verbosity) {
-	struct Neuron *ln = nn->neurons;
+	struct Neuron *ln = clctx->nn->neurons;
 	while (ln != NULL) {
 		printNeuron(ln, verbosity);
 		ln = ln->next;
@@ -556,7 +887,7 @@ void printNeuron(struct Neuron *neuron, uint8_t verbosity) {
 		tprintf(LOG_ALERT, __func__, "Neuron is not linked to gridcell");
 		return;
 	}
-	struct Position *lpos = neuron->gridcell->position;
+	struct Position *lpos = &neuron->gridcell->position;
 	char text[256];
 	sprintf(text, "Neuron at [%i,%i], in: ", lpos->x, lpos->y);
 	struct Port *lp; uint8_t existing = 0;
@@ -565,7 +896,7 @@ void printNeuron(struct Neuron *neuron, uint8_t verbosity) {
 		if (lp->synapse == NULL) goto print_neuron_no_synapse;
 		if (lp->synapse->pre_neuron == NULL) goto print_neuron_no_neuron;
 		if (lp->synapse->pre_neuron->gridcell == NULL) goto print_neuron_no_gridcell;
-		lpos = lp->synapse->pre_neuron->gridcell->position;
+		lpos = &lp->synapse->pre_neuron->gridcell->position;
 		sprintf(text, "%s [%i,%i]", text, lpos->x, lpos->y);
 		existing = 1;
 		lp = lp->next;
@@ -578,7 +909,7 @@ void printNeuron(struct Neuron *neuron, uint8_t verbosity) {
 		if (lp->synapse == NULL) goto print_neuron_no_synapse;
 		if (lp->synapse->post_neuron == NULL) goto print_neuron_no_neuron;
 		if (lp->synapse->post_neuron->gridcell == NULL) goto print_neuron_no_gridcell;
-		lpos = lp->synapse->post_neuron->gridcell->position;
+		lpos = &lp->synapse->post_neuron->gridcell->position;
 		sprintf(text, "%s [%i,%i]", text, lpos->x, lpos->y);
 		existing = 1;
 		lp = lp->next;
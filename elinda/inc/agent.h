@@ -57,7 +57,7 @@ struct Agent;
 
 struct AgentBasicContainer {
 //	struct Agent *next;
-	uint8_t id;
+	uint32_t id;
 };
 
 /**
@@ -91,7 +91,10 @@ struct Agent *aa;
  *  		Methods
  ***************************************************************************************************/
 
-struct Agent *getAgent(uint8_t id);
+/**
+ * The agent with the given id, which is its index in aa.
+ */
+struct Agent *getAgent(uint32_t id);
 
 void printAgentStates();
 
@@ -99,6 +102,19 @@ void initAgents();
 
 void clearSimulationState();
 
+/**
+ * The simulation state of an agent should only be changed by this routine, so the agents are
+ * kept in a queue per state, and the routines below do not have to search all agents.
+ */
+void setSimulationState(struct Agent *agent, uint8_t state);
+
+uint32_t countAgents(uint8_t state);
+
+/**
+ * One of the countAgents(state) agents in the given state, in no particular order.
+ */
+struct Agent *getAgentInState(uint8_t state, uint32_t index);
+
 struct Agent *getAgentToBeSimulated();
 
 uint8_t allAgentsSimulated();
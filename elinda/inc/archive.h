@@ -0,0 +1,95 @@
+/**
+ * @file archive.h
+ * @brief The population of every generation in one file
+ * @author Anne C. van Rossum
+ *
+ * An archive is a file that holds a record for every generation that is evaluated: the
+ * generation, the seed of the random generator that evolution continues with, the fitness
+ * of every agent and the genome of every agent. The records have all the same size, given
+ * the genome size and the population size in the header, so record i starts at a known
+ * offset. Records are only appended. The header counts the records, and is only updated
+ * after a record is written entirely, so a run that crashes while it writes a record leaves
+ * the archive as it was before that record.
+ *
+ * The file is mapped in memory, so a reader gets a pointer to a record or a genome in it,
+ * without reading or copying anything. The mapping follows the file when records are
+ * appended by the same archive. With LINDA_ARCHIVE set to a path the Elinda engine writes a
+ * record for every generation, and resumes from the last record in it, see startEvolution.
+ */
+
+#ifndef ARCHIVE_H_
+#define ARCHIVE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+
+#define ARCHIVE_MAGIC			0x4C415232		// "LAR2"
+
+struct ArchiveHeader {
+	uint32_t magic;
+	uint16_t genome_size;
+	uint16_t reserved;
+	uint32_t population_size;
+	uint32_t record_size;
+	uint32_t record_count;
+};
+
+/**
+ * A record is followed by the fitness of every agent, and then by the genomes, at offset
+ * ARCHIVE_GENOMES(population_size) in the record.
+ */
+struct ArchiveRecord {
+	uint32_t generation;
+	uint32_t seed;
+};
+
+#define ARCHIVE_GENOMES(population_size) \
+	((sizeof(struct ArchiveRecord) + (population_size) + 7) & ~7)
+
+struct Archive {
+	int fd;
+	uint8_t writable;
+	uint8_t *map;
+	uint64_t map_size;
+	struct ArchiveHeader *header;
+};
+
+/**
+ * Opens an archive for genomes of the given size and populations of the given size. When
+ * writable is set, it is created if it does not exist. Returns NULL if the archive can not be
+ * opened, or holds genomes or populations of another size, unless the sizes are 0, then
+ * those of the archive are taken.
+ */
+struct Archive *openArchive(const char *path, uint16_t genomeSize, uint32_t populationSize,
+		uint8_t writable);
+
+void closeArchive(struct Archive *archive);
+
+/**
+ * Appends a record, with the fitness of every agent and the genome of every agent, in parts
+ * of partSize codons, the last part of a genome holds the codons that are left. So there are
+ * (genome_size + partSize - 1) / partSize parts for every agent, and genomes that are kept in
+ * one block are given by a part of genome_size each. Returns 0 if it can not be written.
+ */
+uint8_t appendArchive(struct Archive *archive, uint32_t generation, uint32_t seed,
+		const uint8_t *fitness, const uint8_t **parts, uint32_t partSize);
+
+/**
+ * The record with the given index, the last one is record_count - 1, or NULL if there is no
+ * such record.
+ */
+const struct ArchiveRecord *getArchiveRecord(struct Archive *archive, uint32_t index);
+
+const uint8_t *getArchiveFitness(const struct ArchiveRecord *record);
+
+const uint8_t *getArchiveGenome(struct Archive *archive, const struct ArchiveRecord *record,
+		uint32_t agent);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*ARCHIVE_H_*/
@@ -0,0 +1,61 @@
+/**
+ * @file batch.h
+ * @brief Evaluation of the population within the Elinda process
+ *
+ * A fitness function that does not need the simulator, like the novelty of the topology that
+ * the flinda engine judges, does not need the Colinda processes either. In batch mode, with
+ * LINDA_IN_PROCESS set, elinda links the developmental engine of colinda, and develops every
+ * agent in a ColindaContext of its own (see context.h), on the monks of the abbey. The novelty
+ * of the topology is the fitness, which is added with addFitness, without any message.
+ *
+ * The novelty is judged as flinda does: the topology, the type of the neuron in each cell of
+ * the grid, is compared with an archive of topologies, see novelty.h. The archive keeps
+ * BATCH_TOPOLOGY_COUNT topologies, or LINDA_TOPOLOGY_COUNT if that is set.
+ *
+ * With LINDA_PRECOMPILE set, the agents are simulated by the Colinda processes as usual, but
+ * their genomes are developed here in the same way, and the robots get the network that came
+ * out as a frame, see developNetwork and colinda/inc/netframe.h, instead of the genome.
+ *
+ * @date_created    Oct 14, 2026
+ * @date_modified   Oct 14, 2026
+ * @author          Anne C. van Rossum
+ * @project         Replicator
+ * @company         Almende B.V.
+ * @license         open-source, GNU Lesser General Public License
+ */
+
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+
+#define BATCH_TOPOLOGY_COUNT		10
+
+struct RawGenome;
+
+/**
+ * Allocates a ColindaContext for every agent in the population.
+ */
+void initBatch();
+
+/**
+ * Develops the genome in the context of the agent with the given id, and returns the novelty
+ * of its topology. Can be called by several monks at once.
+ */
+uint8_t evaluateTopology(uint32_t id, struct RawGenome *genome);
+
+/**
+ * Develops the genome in the context of the agent with the given id, and returns the frame
+ * of the network, which the caller frees, or NULL. Can be called by several monks at once.
+ */
+uint8_t *developNetwork(uint32_t id, struct RawGenome *genome, uint32_t *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*BATCH_H_*/
@@ -14,7 +14,12 @@ extern "C" {
 #define ELINDA_PROCSTATE_DEFAULT	0x00
 #define ELINDA_PROCSTATE_STARTING	0x01
 #define ELINDA_PROCSTATE_RUNNING	0x10
+
+//! The amount of parts of a genome on their way to a controller that did not acknowledge them
+#define ELINDA_GENOME_WINDOW		8
 	
+struct RawGenome;
+
 /**
  * Defines hooks end of simulation (eosim) and and of booting procedure (eoboot).
  */
@@ -24,21 +29,34 @@ struct ElindaRuntime {
 };
 	
 struct ElindaConfig {
-	uint8_t simulation_size;
+	uint16_t simulation_size;
 	uint8_t monk_count;
 	uint8_t task_count;
 	uint8_t generation_count;
 	uint8_t generation_id;
+	uint8_t in_process;
+	uint8_t precompile;
 	void *(*boot)(void*);
 };
 
 /**
  * The robots that have been simulated, the ones that are currently running and the ones
- * that have to be simulated still.
+ * that have to be simulated still. The genome that is sent last to the controller of the
+ * robot is kept with its hash, so a next genome can be sent as a delta to it. The part of
+ * the genome that is sent next is part_next, see inseminate. The slot is the place of the
+ * robot in the simulator, one of simulation_size. The queue index is the place of the agent
+ * in the queue of its simulation state, see setSimulationState.
  */
 struct AgentElindaContainer {
 	uint8_t simulation_state;
 	uint8_t process_state;
+	uint16_t slot;
+	uint32_t queue_index;
+	uint8_t part_next;
+	struct RawGenome *sent_genome;
+	uint32_t sent_hash;
+	//! The Colinda process that is lent to the agent, see pool.h
+	uint16_t worker;
 };
 
 struct ElindaConfig *elconf;
@@ -22,24 +22,36 @@ extern "C" {
 #endif 
 
 #include <inttypes.h>
+
+struct Archive;
 	
 /**
  * The population size is the amount of robots in one generation. This is different from the
  * amount of robots that is tested in one trial. There can be way less robots simulated at one
- * particular moment in time than there are actually robots in the population.
+ * particular moment in time than there are actually robots in the population. The generation
+ * counts the steps of evolution, and each evaluated generation is kept in the archive, if
+ * there is one, see archive.h. With a tournament size, evolution is steady-state, see
+ * stepSteadyState, instead of by generation.
  */
 struct EvolutionConfig {
-	uint8_t population_size;
+	uint32_t population_size;
+	uint8_t tournament_size;
+	uint32_t generation;
+	struct Archive *archive;
 };
 
 struct EvolutionConfig *econf;
 
 void initEvolution();
 
-void startEvolution();
+uint32_t startEvolution();
+
+void checkpointEvolution();
 
 void stepEvolution();
 
+struct Agent *stepSteadyState();
+
 #ifdef __cplusplus
 }
 #endif 
@@ -27,7 +27,7 @@ struct FitnessConfig *fconf;
 
 void initFitnessModule();
 
-void addFitness(uint8_t id, uint8_t fitness);
+void addFitness(uint32_t id, uint8_t fitness);
 
 #ifdef __cplusplus
 }
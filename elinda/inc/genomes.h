@@ -30,11 +30,27 @@ extern "C" {
 #define Codon uint8_t
 
 	/**
-	 * The RawGenome is a series of Codons, just an array of characters. It is supposed to be 
-	 * allocated in one block with calloc, so individual codons can be retrieved by content[i]. 
+	 * The RawGenome is a series of Codons, kept in pages of GENOME_PAGE_SIZE codons. A page
+	 * can be shared by many genomes: copyGenome only shares the pages of the source, and a
+	 * page is copied when one of the genomes that share it changes, by touchGenome. So a
+	 * survivor that is copied into many agents costs the memory of one genome, plus a page for
+	 * every page that a mutation touches. The last page only holds the codons up to the genome
+	 * size. Codons are read by peekGenome, or all at once into a buffer by flattenGenome.
+	 * With a hundred mutations in a genome of ten thousand codons every page is touched, so
+	 * smaller pages share more, at the cost of a larger table of pages in every genome.
 	 */
+#ifndef GENOME_PAGE_SIZE
+#define GENOME_PAGE_SIZE		4096
+#endif
+#define GENOME_PAGES			((UINT16_MAX + GENOME_PAGE_SIZE) / GENOME_PAGE_SIZE)
+
+	struct GenomePage {
+		uint32_t refs;
+		Codon codons[];
+	};
+
 	struct RawGenome {
-		Codon *content;
+		struct GenomePage *pages[GENOME_PAGES];
 	};
 	
 	/**
@@ -62,7 +78,7 @@ extern "C" {
 	 * A genome is generated for the agent with the given id. And it will be put in the 
 	 * AgentGenomeContainer in the Agent struct.  
 	 */
-	void generateGenomeFor(uint8_t id);
+	void generateGenomeFor(uint32_t id);
 
 	/**
 	 * Initializes the default configuration.
@@ -70,9 +86,61 @@ extern "C" {
 	void initGenomes();
 	
 	/**
-	 * Copy the content of a source genome to the target data structure.
+	 * Makes the target the same genome as the source, by sharing the pages of the source.
 	 */
 	void copyGenome(struct RawGenome *src, struct RawGenome *target);
+
+	/**
+	 * Makes the codons from first up to last the ones of the source. Pages that are covered
+	 * entirely are shared.
+	 */
+	void copyGenomeRange(const struct RawGenome *src, struct RawGenome *target, uint32_t first,
+			uint32_t last);
+
+	/**
+	 * A genome that shares the pages of the source.
+	 */
+	struct RawGenome *cloneGenome(const struct RawGenome *src);
+
+	void freeGenome(struct RawGenome *genome);
+
+	/**
+	 * The codon at the given position, the codons after it up to the end of its page follow
+	 * it in memory.
+	 */
+	const Codon *peekGenome(const struct RawGenome *genome, uint32_t position);
+
+	/**
+	 * Like peekGenome, but the page of the codon is copied first if other genomes share it,
+	 * so the codons can be changed.
+	 */
+	Codon *touchGenome(struct RawGenome *genome, uint32_t position);
+
+	/**
+	 * Copies length codons from the given position on to buffer.
+	 */
+	void readGenomeCodons(const struct RawGenome *genome, uint32_t position, uint32_t length,
+			Codon *buffer);
+
+	/**
+	 * Copies the codons to buffer, which has room for the genome size, and returns it.
+	 */
+	Codon *flattenGenome(const struct RawGenome *genome, Codon *buffer);
+
+	/**
+	 * Overwrites the genome with the codons in the buffer.
+	 */
+	void setGenome(struct RawGenome *genome, const Codon *buffer);
+
+	/**
+	 * The hash of linda_buffer_hash over the codons, without flattening the genome.
+	 */
+	uint32_t hashGenome(const struct RawGenome *genome);
+
+	/**
+	 * The amount of codons that the page holds that starts at the given position.
+	 */
+	uint16_t genomePageLength(uint32_t position);
 	
 	/**
 	 * Print head and tail, and perhaps some statistical information about a genome.
@@ -0,0 +1,85 @@
+/**
+ * @file island.h
+ * @brief Migration between Elinda engines that each evolve an island
+ * @author Anne C. van Rossum
+ *
+ * A population can be spread over several Elinda engines, each with its own simulator and
+ * controllers, that evolve a part of it, an island. Every interval generations an island
+ * sends count of its genomes to its neighbours, the fittest ones or ones at random, and the
+ * genomes that arrive from its neighbours replace the least fit agents that are evaluated,
+ * together with the fitness they had on their own island.
+ *
+ * Migration does not wait for anything. The migrants are sent over the links with the
+ * neighbours as LINDA_MIGRANT_MSG parts, and the parts that arrive are put together on the
+ * monks, while the island goes on. A migrant that is complete waits until the next call of
+ * exchangeMigrants. So a slow island does not hold up a fast one, the fast one just gets
+ * fewer migrants.
+ *
+ * An island needs LINDA_ISLAND set to its id. LINDA_ISLAND_PORTS gives the ports on which it
+ * waits for a neighbour, one neighbour per port, and LINDA_ISLAND_PEERS the neighbours that
+ * it connects to itself, as "host:port", both separated by commas. A link carries migrants
+ * both ways, so for a ring every island connects to the next one and waits for the one
+ * before it. LINDA_MIGRATION is "interval,count,policy", with policy "best" or "random",
+ * by default "5,2,best".
+ */
+
+#ifndef ISLAND_H_
+#define ISLAND_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+
+#define ISLAND_MAX_LINKS		8
+//! The ids of the links in the bank of sockets start here
+#define ISLAND_SOCKET_ID		1024
+//! Migrants that are put together at once, and that wait for exchangeMigrants
+#define ISLAND_PENDING			8
+#define ISLAND_ARRIVALS			32
+//! A link that can not connect is tried again every 3 seconds, this amount of times
+#define ISLAND_CONNECT_TRIALS	100
+
+#define ISLAND_POLICY_BEST		0
+#define ISLAND_POLICY_RANDOM	1
+
+struct TcpipSocket;
+struct TcpipMessage;
+
+struct IslandConfig {
+	uint8_t id;
+	uint16_t interval;
+	uint8_t count;
+	uint8_t policy;
+	uint8_t link_count;
+	struct TcpipSocket *links[ISLAND_MAX_LINKS];
+};
+
+/**
+ * NULL if this engine is not an island.
+ */
+struct IslandConfig *ilconf;
+
+/**
+ * Reads the configuration and opens the links, which needs the abbey to be running.
+ */
+void initIslands();
+
+/**
+ * Lets the migrants that arrived replace the least fit agents that are evaluated, and every
+ * interval generations sends migrants to all neighbours. Should be called when the fitness
+ * of the agents is known, before selection.
+ */
+void exchangeMigrants();
+
+/**
+ * A part of a migrant that came in over a link. The message is freed.
+ */
+void receiveMigrant(struct TcpipMessage *msg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*ISLAND_H_*/
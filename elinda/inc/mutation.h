@@ -2,6 +2,16 @@
  * @file mutation.h
  * @brief Mutation engine.
  * @author Anne C. van Rossum
+ *
+ * A genome is changed by a series of mutation operators, each with a rate. The point
+ * mutations flip every bit with the chance bit_rate, the codon substitutions replace every
+ * codon with the chance codon_rate by a random one, and crossover takes a part of the genome
+ * of a mate with the chance crossover_rate. LINDA_MUTATION sets those rates, as
+ * "bit[,codon[,crossover]]". Other operators can be added by addMutationOperator.
+ *
+ * The random numbers of a mutation come from a stream that is seeded by the seed of
+ * seedMutations and the id of the agent, so the outcome does not depend on the order in
+ * which agents are mutated, nor on the monk that does it.
  */
 
 #ifndef MUTATION_H_
@@ -9,22 +19,67 @@
 
 #ifdef __cplusplus
 extern "C" {
-#endif 
+#endif
 
 #include <inttypes.h>
-	
+
+struct RawGenome;
+struct LindaRandom;
+
+/**
+ * An operator changes the genome with the given rate, what the rate is the chance of is up to
+ * the operator. The mate is NULL when there is no other genome, operators that need one do
+ * nothing then.
+ */
+typedef void (*MutationOperator)(struct RawGenome *genome, const struct RawGenome *mate,
+		float rate, struct LindaRandom *random);
+
+#define MUTATION_MAX_OPERATORS	8
+
+//! The mate of an agent that is not crossed with another one
+#define MUTATION_NO_MATE		UINT32_MAX
+
 struct MutationConfig {
-	uint8_t mutation_count;
+	uint8_t operator_count;
+	MutationOperator operators[MUTATION_MAX_OPERATORS];
+	float rates[MUTATION_MAX_OPERATORS];
+	uint32_t seed;
 };
 
 struct MutationConfig *mconf;
 
 void configMutation();
 
-void applyMutations(uint8_t id);
+/**
+ * Adds an operator after the ones that are there. Returns 0 if there are too many.
+ */
+uint8_t addMutationOperator(MutationOperator op, float rate);
+
+void seedMutations(uint32_t seed);
+
+/**
+ * Applies the operators in order to the genome of the agent, with the genome of the agent
+ * mate as mate, if it is not MUTATION_NO_MATE.
+ */
+void applyMutations(uint32_t id, uint32_t mate);
+
+/**
+ * Mutates all agents, on the monks. The agents that have a mate in mates are done first,
+ * and their mates are only mutated after that. So mates should not have a mate themselves.
+ */
+void mutatePopulation(const uint32_t *mates);
+
+void flipBits(struct RawGenome *genome, const struct RawGenome *mate, float rate,
+		struct LindaRandom *random);
+
+void substituteCodons(struct RawGenome *genome, const struct RawGenome *mate, float rate,
+		struct LindaRandom *random);
+
+void crossGenomes(struct RawGenome *genome, const struct RawGenome *mate, float rate,
+		struct LindaRandom *random);
 
 #ifdef __cplusplus
 }
-#endif 
+#endif
 
 #endif /*MUTATION_H_*/
@@ -0,0 +1,142 @@
+/**
+ * @file pool.h
+ * @brief Colinda processes that are started once and lent to the agents
+ * @author Anne C. van Rossum
+ *
+ * Without a pool every agent gets a Colinda process of its own, with the id of the agent, the
+ * first time it is simulated. With LINDA_POOL set to an amount of workers, elinda starts that
+ * amount of Colinda processes when it boots, with the ids 0 up to that amount, and lends an
+ * idle one to every agent that is to be simulated. An agent that finds no idle worker waits
+ * in line. When the fitness of the agent comes in, the worker gets a LINDA_CLEAR_GRID to
+ * reset it, and goes to the next agent in line, or becomes idle.
+ *
+ * The messages to and from Colinda processes carry the id of the process, which is the id of
+ * the agent without a pool, see processOf and agentOfProcess. The genome that is sent last to
+ * a worker moves with it from agent to agent, so the next genome is still sent as a delta.
+ *
+ * Workers that do not tell they are alive within POOL_START_TIMEOUT seconds, or that could
+ * not be started because the m-bus was not there yet, are started again by a task that runs
+ * every POOL_TOPUP_PERIOD in the background. The m-bus cannot stop a process, and the one
+ * that was late may still come up, so a worker that is started again gets a fresh id from
+ * the ones above the size of the pool. The old id is retired, and a process that comes up
+ * with it later is ignored. Ids are never handed out twice, so once the ids up to
+ * POOL_MAX_PROCESSES are used, a worker that does not come up is not started again.
+ *
+ * @date_created    Oct 14, 2026
+ * @date_modified   Oct 14, 2026
+ * @author          Anne C. van Rossum
+ * @project         Replicator
+ * @company         Almende B.V.
+ * @license         open-source, GNU Lesser General Public License
+ */
+
+#ifndef POOL_H_
+#define POOL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+#include <time.h>
+
+//! The ids of processes are one byte on the wire
+#define POOL_MAX_WORKERS		256
+#define POOL_NO_WORKER			UINT16_MAX
+#define POOL_NO_AGENT			UINT32_MAX
+//! The ids above are those of elinda, the m-bus, the simulator and the multicast group
+#define POOL_MAX_PROCESSES		252
+
+//! In microseconds
+#define POOL_TOPUP_PERIOD		1000000
+//! In seconds
+#define POOL_START_TIMEOUT		10
+
+#define POOL_WORKER_DEFAULT		0x00
+#define POOL_WORKER_STARTING	0x01
+#define POOL_WORKER_IDLE		0x02
+#define POOL_WORKER_LEASED		0x10
+
+struct RawGenome;
+struct Agent;
+struct AbbeyTimer;
+
+struct PoolWorker {
+	uint8_t state;
+	//! The id of its Colinda process, a fresh one every time it is started again
+	uint16_t process;
+	uint32_t agent;
+	time_t started;
+	struct RawGenome *sent_genome;
+	uint32_t sent_hash;
+};
+
+struct PoolConfig {
+	uint16_t size;
+	//! Dispatched with an InfoDefault with the id of the agent when it gets a worker
+	void *(*lease)(void*);
+	struct PoolWorker workers[POOL_MAX_WORKERS];
+	//! The worker of every process id below next_process, POOL_NO_WORKER if it is retired
+	uint16_t worker_of[POOL_MAX_WORKERS];
+	uint16_t next_process;
+	//! The agents that wait for a worker, in a ring
+	uint32_t *waiting;
+	uint32_t waiting_first;
+	uint32_t waiting_count;
+	struct AbbeyTimer *topup;
+};
+
+/**
+ * NULL if every agent has a process of its own.
+ */
+struct PoolConfig *plconf;
+
+/**
+ * Reads LINDA_POOL, should be called after the agents are initialized.
+ */
+void initPool(void *(*lease)(void*));
+
+/**
+ * Starts all workers and the task that keeps them started. Needs the m-bus.
+ */
+void startPool();
+
+void stopPool();
+
+/**
+ * The id of the process that simulates the agent, or POOL_NO_WORKER if it has no worker.
+ * Takes the pool lock.
+ */
+uint32_t processOf(struct Agent *la);
+
+/**
+ * The agent that the process simulates, or NULL. Takes the pool lock.
+ */
+struct Agent *agentOfProcess(uint32_t process);
+
+/**
+ * Writes the ids of the processes of the workers that are alive, and returns how many.
+ */
+uint16_t runningWorkers(uint8_t *ids);
+
+/**
+ * The worker tells it is alive, it is lent to the first agent that waits, if any. Returns 0
+ * if the process is not a worker. A process with a retired id is a worker, but is ignored.
+ */
+uint8_t workerAlive(uint32_t process);
+
+/**
+ * Lends an idle worker to the agent, or lets it wait in line.
+ */
+void leaseWorker(struct Agent *la);
+
+/**
+ * Resets the worker of the agent and lends it to the next agent in line.
+ */
+void releaseWorker(struct Agent *la);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*POOL_H_*/
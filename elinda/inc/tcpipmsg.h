@@ -13,6 +13,8 @@ extern "C" {
 
 #include <linda/tcpip.h>
 
+struct RawGenome;
+
 #define MBUS_ADD_CHANNEL  30
 #define MBUS_NEW_PROCESS  50
 
@@ -25,6 +27,25 @@ extern "C" {
 #define LINDA_GENOME_ACK		16
 #define LINDA_RUNROBOT_MSG		17
 #define LINDA_GENOME_PART_ACK	18
+#define LINDA_CLEAR_GRID		22
+#define LINDA_GENOME_BCAST_MSG	23
+#define LINDA_GENOME_ANNOUNCE	24
+#define LINDA_GENOME_NACK		25
+#define LINDA_GENOME_DELTA_MSG	26
+#define LINDA_GENOME_DELTA_NACK	27
+#define LINDA_MIGRANT_MSG		29
+#define LINDA_NETWORK_MSG		31
+#define LINDA_NETWORK_NACK		32
+//! 33 and 34 are LINDA_STATS_REQ and LINDA_STATS_MSG of all engines, see linda/stats.h
+
+//! Header of a genome part that is multicast, see createGenomeBroadcastMessage
+#define LINDA_GENOME_BCAST_HEADER	14
+//! Header of a genome delta, see createGenomeDeltaMessage
+#define LINDA_GENOME_DELTA_HEADER	14
+//! Header of a part of a migrant genome, see createMigrantMessage
+#define LINDA_MIGRANT_HEADER		15
+//! Header of a part of a developed network, see createNetworkMessage
+#define LINDA_NETWORK_HEADER		16
 	
 #define LINDA_NEW_CHANNEL		MBUS_ADD_CHANNEL
 
@@ -41,6 +62,9 @@ struct TcpipMessageConfig {
 	uint8_t elinda_id;
 	uint8_t sym3d_id;
 //	uint8_t gui_id;
+	struct in_addr mcast_group;
+	int mcast_port;
+	uint8_t mcast_id;
 };
 
 void initMessages();
@@ -58,12 +82,36 @@ struct TcpipMessage *createConnectColindaMessage(uint8_t robotId);
 struct TcpipMessage *createRunColindaMessage(uint8_t robotId);
 
 struct TcpipMessage *createGenomeMessage(
-		uint8_t robotId, uint8_t *pdna, uint8_t partId);
+		uint8_t robotId, const struct RawGenome *genome, uint8_t partId, int maxSize);
+
+int genomeBroadcastParts(int maxSize);
+
+struct TcpipMessage *createGenomeBroadcastMessage(
+		const struct RawGenome *genome, uint32_t hash, uint16_t partId, uint16_t partCount);
+
+struct TcpipMessage *createGenomeAnnounceMessage(
+		uint8_t robotId, uint32_t hash, uint16_t partCount);
+
+struct TcpipMessage *createGenomeDeltaMessage(uint8_t robotId,
+		const struct RawGenome *base, const struct RawGenome *genome, uint32_t baseHash,
+		uint32_t hash, int maxSize);
+
+int migrantParts(int maxSize);
+
+struct TcpipMessage *createMigrantMessage(uint8_t island, const struct RawGenome *genome,
+		uint32_t hash, uint8_t fitness, uint16_t partId, uint16_t partCount);
+
+int networkParts(uint32_t size, int maxSize);
+
+struct TcpipMessage *createNetworkMessage(uint8_t robotId, const uint8_t *frame, uint32_t size,
+		uint32_t hash, uint16_t partId, uint16_t partCount);
 
 struct TcpipMessage *createConnectSym3DMessage();
 
 struct TcpipMessage *createRunRobotMessage(uint8_t robotId);
 
+struct TcpipMessage *createClearGridMessage(uint8_t robotId);
+
 struct TcpipMessageConfig *tmconf;
 
 #ifdef __cplusplus
@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <elinda.h>
 #include <stdio.h>
+#include <pthread.h>
 
 #include <linda/log.h>
 
@@ -31,7 +32,43 @@
  ***********************************************************************************************/
 
 /**
- * 
+ * The agents in each simulation state, see setSimulationState. An agent holds its place in
+ * the queue of its state, so it is moved to another queue at once. The lock is for the
+ * tasks that handle several agents at the same time.
+ */
+struct AgentQueue {
+	uint32_t *agents;
+	uint32_t count;
+};
+
+static struct AgentQueue queues[3];
+static pthread_mutex_t queueMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct AgentQueue *getQueue(uint8_t state) {
+	switch (state) {
+	case ELINDA_SIMSTATE_CURRENT: return &queues[1];
+	case ELINDA_SIMSTATE_DONE: return &queues[2];
+	default: return &queues[0];
+	}
+}
+
+static void removeFromQueue(struct Agent *agent) {
+	struct AgentQueue *q = getQueue(agent->elinda.simulation_state);
+	uint32_t last = q->agents[--q->count];
+	q->agents[agent->elinda.queue_index] = last;
+	aa[last].elinda.queue_index = agent->elinda.queue_index;
+}
+
+static void addToQueue(struct Agent *agent, uint8_t state) {
+	struct AgentQueue *q = getQueue(state);
+	agent->elinda.simulation_state = state;
+	agent->elinda.queue_index = q->count;
+	q->agents[q->count++] = agent->id;
+}
+
+/**
+ * The id of an agent is its index in aa, and stays the same, selection does not move the
+ * agents around, see applySelection.
  */
 void initAgents() {
 	if (econf == NULL) return;
@@ -39,37 +76,69 @@ void initAgents() {
 	tprintf(LOG_VERBOSE, __func__, "Initialize agents");
 
 	aa = calloc(econf->population_size, sizeof(struct Agent));
-	uint8_t i;
+	uint32_t i;
+	for (i = 0; i < 3; i++) {
+		queues[i].agents = malloc(econf->population_size * sizeof(uint32_t));
+		queues[i].count = 0;
+	}
 	for (i = 0; i < econf->population_size; i++) {
-		aa[i].elinda.simulation_state = ELINDA_SIMSTATE_TODO;
 		aa[i].elinda.process_state = ELINDA_PROCSTATE_DEFAULT;
 		aa[i].id = i;
 		aa[i].fitness_level = 0;
 		aa[i].fitness = 0;
+		addToQueue(&aa[i], ELINDA_SIMSTATE_TODO);
 	}
-	clearSimulationState();
 }
 
 void clearSimulationState() {
-	uint8_t i;
+	uint32_t i;
+	pthread_mutex_lock(&queueMutex);
+	for (i = 0; i < 3; i++) queues[i].count = 0;
 	for (i = 0; i < econf->population_size; i++) {
-		aa[i].elinda.simulation_state = ELINDA_SIMSTATE_TODO;
+		addToQueue(&aa[i], ELINDA_SIMSTATE_TODO);
 	}
+	pthread_mutex_unlock(&queueMutex);
 //	printAgentStates();
 }
 
+void setSimulationState(struct Agent *agent, uint8_t state) {
+	pthread_mutex_lock(&queueMutex);
+	if (agent->elinda.simulation_state != state) {
+		removeFromQueue(agent);
+		addToQueue(agent, state);
+	}
+	pthread_mutex_unlock(&queueMutex);
+}
+
+uint32_t countAgents(uint8_t state) {
+	return getQueue(state)->count;
+}
+
+struct Agent *getAgentInState(uint8_t state, uint32_t index) {
+	struct AgentQueue *q = getQueue(state);
+	struct Agent *agent = NULL;
+	pthread_mutex_lock(&queueMutex);
+	if (index < q->count) agent = &aa[q->agents[index]];
+	pthread_mutex_unlock(&queueMutex);
+	return agent;
+}
+
 struct Agent *getAgentToBeSimulated() {
-	uint8_t i;
-	for (i = 0; i < econf->population_size; i++) {
-		if (aa[i].elinda.simulation_state == ELINDA_SIMSTATE_TODO) {
-			aa[i].elinda.simulation_state = ELINDA_SIMSTATE_CURRENT;
-			char text[64]; sprintf(text, "Return agent %i at index %i", aa[i].id, i);
-			tprintf(LOG_INFO, __func__, text);
-			return &aa[i];
-		}
+	struct AgentQueue *q = getQueue(ELINDA_SIMSTATE_TODO);
+	struct Agent *agent = NULL;
+	pthread_mutex_lock(&queueMutex);
+	if (q->count) {
+		agent = &aa[q->agents[q->count - 1]];
+		removeFromQueue(agent);
+		addToQueue(agent, ELINDA_SIMSTATE_CURRENT);
 	}
-	tprintf(LOG_WARNING, __func__, "No agents to be simulated!");
-	return NULL;
+	pthread_mutex_unlock(&queueMutex);
+	if (agent == NULL) {
+		tprintf(LOG_WARNING, __func__, "No agents to be simulated!");
+		return NULL;
+	}
+	TPRINTF(LOG_INFO, "Return agent %u", agent->id);
+	return agent;
 }
 
 /**
@@ -77,47 +146,36 @@ struct Agent *getAgentToBeSimulated() {
  * and there are some agents in a "todo" state, return 2 if all agents have been run.
  */
 uint8_t allAgentsSimulated() {
-	uint8_t i;
-	for (i = 0; i < econf->population_size; i++) {
-		if (aa[i].elinda.simulation_state == ELINDA_SIMSTATE_CURRENT) {
-			tprintf(LOG_INFO, __func__, "Some agents are still running...");
-			return 0;
-		}
+	if (countAgents(ELINDA_SIMSTATE_CURRENT)) {
+		tprintf(LOG_INFO, __func__, "Some agents are still running...");
+		return 0;
 	}
-	for (i = 0; i < econf->population_size; i++) {
-		if (aa[i].elinda.simulation_state == ELINDA_SIMSTATE_TODO) {
-			tprintf(LOG_INFO, __func__, "Some agents have to be run...");
-			return 1;
-		}
+	if (countAgents(ELINDA_SIMSTATE_TODO)) {
+		tprintf(LOG_INFO, __func__, "Some agents have to be run...");
+		return 1;
 	}
 	tprintf(LOG_INFO, __func__, "All agents did run...");
 	return 2;
 }
 
 void printAgentStates() {
-	uint8_t i;
+	uint32_t i;
 	for (i = 0; i < econf->population_size; i++) {
 		switch(aa[i].elinda.simulation_state) {
 		case ELINDA_SIMSTATE_CURRENT: 
-			printf("Agent %i: CURRENTLY RUNNING\n", i); break;
+			printf("Agent %u: CURRENTLY RUNNING\n", i); break;
 		case ELINDA_SIMSTATE_TODO: 
-			printf("Agent %i: TODO\n", i); break;
+			printf("Agent %u: TODO\n", i); break;
 		case ELINDA_SIMSTATE_DONE: 
-			printf("Agent %i: DID ALREADY RUN\n", i); break;
+			printf("Agent %u: DID ALREADY RUN\n", i); break;
 		default: 
-			printf("Agent %i: UKNOWN\n", i); 
+			printf("Agent %u: UKNOWN\n", i); 
 		}
 	}
 }
 
-struct Agent *getAgent(uint8_t id) {
-	uint8_t i;
-	for (i = 0; i < econf->population_size; i++) {
-		if (aa[i].id == id) {
-			return &aa[i];
-		}
-	}
-	char text[64]; sprintf(text, "Agent %i does not exist!", id);
-	tprintf(LOG_WARNING, __func__, text);
+struct Agent *getAgent(uint32_t id) {
+	if (id < econf->population_size) return &aa[id];
+	TPRINTF(LOG_WARNING, "Agent %u does not exist!", id);
 	return NULL;
 }
@@ -0,0 +1,165 @@
+/**
+ * @file archive.c
+ *
+ * Records are written with pwrite, and the mapping is only read. A record is flushed to
+ * disk before the header counts it, and the header is flushed too, so the count never
+ * covers a record that is not there. When the file grows beyond the mapping, it is
+ * mapped again.
+ *
+ * @date_created    Oct 14, 2026
+ * @date_modified   Oct 14, 2026
+ * @author          Anne C. van Rossum
+ * @project         Replicator
+ * @company         Almende B.V.
+ * @license         open-source, GNU Lesser General Public License
+ */
+
+#include <archive.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <linda/log.h>
+
+/****************************************************************************************************
+ *  		Implementations
+ ***************************************************************************************************/
+
+/**
+ * Maps the header and all records that it counts. Returns 0 if that fails, then the mapping
+ * is kept as it was.
+ */
+static uint8_t mapArchive(struct Archive *archive, uint64_t size) {
+	uint8_t *map = mmap(NULL, size, PROT_READ, MAP_SHARED, archive->fd, 0);
+	if (map == MAP_FAILED) return 0;
+	if (archive->map != NULL) munmap(archive->map, archive->map_size);
+	archive->map = map;
+	archive->map_size = size;
+	archive->header = (struct ArchiveHeader*)archive->map;
+	return 1;
+}
+
+static uint64_t archiveSize(struct ArchiveHeader *header, uint32_t count) {
+	return sizeof(struct ArchiveHeader) + (uint64_t)count * header->record_size;
+}
+
+struct Archive *openArchive(const char *path, uint16_t genomeSize, uint32_t populationSize,
+		uint8_t writable) {
+	struct Archive *archive;
+	struct ArchiveHeader header;
+	struct stat st;
+	int fd = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+	if (fd < 0) {
+		TPRINTF(LOG_ERR, "Can not open archive %s", path);
+		return NULL;
+	}
+	if (fstat(fd, &st) < 0) goto open_archive_failed;
+	if (st.st_size == 0 && writable && genomeSize && populationSize) {
+		header.magic = ARCHIVE_MAGIC;
+		header.genome_size = genomeSize;
+		header.population_size = populationSize;
+		header.reserved = 0;
+		uint64_t size = ARCHIVE_GENOMES(populationSize) + (uint64_t)populationSize * genomeSize;
+		if (size > UINT32_MAX) goto open_archive_failed;
+		header.record_size = size;
+		header.record_count = 0;
+		if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) goto open_archive_failed;
+	} else if (pread(fd, &header, sizeof(header), 0) != sizeof(header)) {
+		goto open_archive_failed;
+	}
+	if (header.magic != ARCHIVE_MAGIC ||
+			(genomeSize && header.genome_size != genomeSize) ||
+			(populationSize && header.population_size != populationSize)) {
+		TPRINTF(LOG_ERR, "Archive %s is not one of genomes of size %i for %i agents", path,
+				genomeSize, populationSize);
+		goto open_archive_failed;
+	}
+	//a record after the ones that are counted is not finished, the next one overwrites it
+	if ((uint64_t)st.st_size < archiveSize(&header, header.record_count) &&
+			st.st_size != 0) {
+		TPRINTF(LOG_ERR, "Archive %s is truncated", path);
+		goto open_archive_failed;
+	}
+
+	archive = malloc(sizeof(struct Archive));
+	archive->fd = fd;
+	archive->writable = writable;
+	archive->map = NULL;
+	if (!mapArchive(archive, archiveSize(&header, header.record_count))) {
+		free(archive);
+		goto open_archive_failed;
+	}
+	return archive;
+
+open_archive_failed:
+	close(fd);
+	return NULL;
+}
+
+void closeArchive(struct Archive *archive) {
+	if (archive == NULL) return;
+	if (archive->map != NULL) munmap(archive->map, archive->map_size);
+	close(archive->fd);
+	free(archive);
+}
+
+uint8_t appendArchive(struct Archive *archive, uint32_t generation, uint32_t seed,
+		const uint8_t *fitness, const uint8_t **parts, uint32_t partSize) {
+	struct ArchiveHeader *header = archive->header;
+	uint32_t count = header->record_count, i;
+	uint32_t population = header->population_size;
+	uint64_t offset = archiveSize(header, count);
+	uint16_t size = header->genome_size;
+	struct ArchiveRecord record = { generation, seed };
+	uint8_t padding[8] = { 0 };
+	if (!archive->writable) return 0;
+
+	if (pwrite(archive->fd, &record, sizeof(record), offset) != sizeof(record)) return 0;
+	offset += sizeof(record);
+	if (pwrite(archive->fd, fitness, population, offset) != population) return 0;
+	offset += population;
+	i = ARCHIVE_GENOMES(population) - sizeof(record) - population;
+	if (i && pwrite(archive->fd, padding, i, offset) != i) return 0;
+	offset += i;
+	for (i = 0; i < population; i++) {
+		uint32_t codons, length;
+		for (codons = 0; codons < size; codons += length, offset += length) {
+			length = (size - codons < partSize) ? size - codons : partSize;
+			if (pwrite(archive->fd, *parts++, length, offset) != length) return 0;
+		}
+	}
+	if (fdatasync(archive->fd) < 0) return 0;
+
+	count++;
+	if (pwrite(archive->fd, &count, sizeof(count), offsetof(struct ArchiveHeader,
+			record_count)) != sizeof(count)) return 0;
+	if (fdatasync(archive->fd) < 0) return 0;
+	return mapArchive(archive, archiveSize(header, count));
+}
+
+const struct ArchiveRecord *getArchiveRecord(struct Archive *archive, uint32_t index) {
+	struct ArchiveHeader *header = archive->header;
+	if (index >= header->record_count) return NULL;
+	//the records are appended by another process
+	if (archiveSize(header, index + 1) > archive->map_size &&
+			!mapArchive(archive, archiveSize(header, header->record_count))) return NULL;
+	return (const struct ArchiveRecord*)
+			(archive->map + archiveSize(archive->header, index));
+}
+
+const uint8_t *getArchiveFitness(const struct ArchiveRecord *record) {
+	return (const uint8_t*)(record + 1);
+}
+
+const uint8_t *getArchiveGenome(struct Archive *archive, const struct ArchiveRecord *record,
+		uint32_t agent) {
+	struct ArchiveHeader *header = archive->header;
+	if (agent >= header->population_size) return NULL;
+	return (const uint8_t*)record + ARCHIVE_GENOMES(header->population_size) +
+			(uint64_t)agent * header->genome_size;
+}
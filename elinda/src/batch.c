@@ -0,0 +1,81 @@
+/**
+ * @file batch.c
+ *
+ * Every agent develops in a context of its own, so the agents develop at the same time on the
+ * monks, each with the tiles of its grid, while no process is spawned and no genome is sent.
+ *
+ * @date_created    Oct 14, 2026
+ * @date_modified   Oct 14, 2026
+ * @author          Anne C. van Rossum
+ * @project         Replicator
+ * @company         Almende B.V.
+ * @license         open-source, GNU Lesser General Public License
+ */
+
+#include <batch.h>
+#include <genomes.h>
+#include <evolution.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <context.h>
+
+#include <linda/buffer.h>
+#include <linda/novelty.h>
+#include <linda/slab.h>
+#include <linda/log.h>
+
+/****************************************************************************************************
+ *  		Declarations
+ ***************************************************************************************************/
+
+static struct ColindaContext **contexts = NULL;
+
+static struct LindaNovelty *archive = NULL;
+
+/****************************************************************************************************
+ *  		Implementations
+ ***************************************************************************************************/
+
+void initBatch() {
+	uint32_t i, count = BATCH_TOPOLOGY_COUNT;
+	const char *text = getenv("LINDA_TOPOLOGY_COUNT");
+	if (text != NULL) sscanf(text, "%u", &count);
+	archive = linda_novelty_new(count ? count : 1, LINDA_NOVELTY_CAP);
+	contexts = malloc(econf->population_size * sizeof(struct ColindaContext*));
+	for (i = 0; i < econf->population_size; i++) {
+		contexts[i] = newColindaContext(i);
+	}
+}
+
+/**
+ * A clone of a genome that is developed before is restored from the development cache, by
+ * the hash of its genome.
+ */
+static struct ColindaContext *develop(uint32_t id, struct RawGenome *genome) {
+	struct ColindaContext *context = contexts[id];
+	uint32_t hash = hashGenome(genome);
+	struct LindaArenaMark mark = linda_arena_mark();
+	extractGenesIn(context, flattenGenome(genome, linda_arena_alloc(gsconf->genomeSize)),
+			gsconf->genomeSize);
+	linda_arena_release(mark);
+	developCachedNeuralNetworkIn(context, hash, gsconf->genomeSize);
+	return context;
+}
+
+uint8_t evaluateTopology(uint32_t id, struct RawGenome *genome) {
+	struct ColindaContext *context = develop(id, genome);
+	uint16_t length = getTopologyIn(context, NULL, 0);
+	struct LindaArenaMark mark = linda_arena_mark();
+	uint8_t *cells = linda_arena_alloc(length);
+	getTopologyIn(context, cells, length);
+	uint8_t fitness = linda_novelty_judge(archive, cells, length);
+	linda_arena_release(mark);
+	TPRINTF(LOG_VERBOSE, "Topology of %u has novelty %i", id, fitness);
+	return fitness;
+}
+
+uint8_t *developNetwork(uint32_t id, struct RawGenome *genome, uint32_t *size) {
+	return getNetworkFrameIn(develop(id, genome), size);
+}
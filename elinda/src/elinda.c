@@ -21,6 +21,7 @@
  * functionality can be reused for other purposes to run tasks in parallel at the Elinda
  * level. The tasks that can be distinguished in the Elinda engine are:
  *   # default_hostess: receiving messages and starting tasks
+ *   # evaluate_generation: in batch mode, evaluating all agents without any other process
  *
  * @date_created    Mar 16, 2009
  * @date_modified   May 06, 2009
@@ -34,6 +35,7 @@
 #include <wait.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <syslog.h>
@@ -46,6 +48,10 @@
 #include <linda/bits.h>
 #include <linda/poseta.h>
 #include <linda/infocontainer.h>
+#include <linda/slab.h>
+#include <linda/trace.h>
+#include <linda/buffer.h>
+#include <linda/stats.h>
 
 #include <tcpipmsg.h>
 #include <evolution.h>
@@ -53,6 +59,9 @@
 #include <fitness.h>
 #include <agent.h>
 #include <mutation.h>
+#include <batch.h>
+#include <island.h>
+#include <pool.h>
 
 static void *default_hostess(void *context);
 static void *first_channel(void *context);
@@ -62,18 +71,48 @@ static void *connect_to_3dsim(void *context);
 static void *generate(void *context);
 static void *inseminate(void *context);
 static void *reincarnate(void *context);
+static void *repair_genome(void *context);
+static void *resend_genome(void *context);
 static void *handle_fitness(void *context);
 static void *simulate_next_group(void *context);
+static void *simulate_next_agent(void *context);
 static void *simulate_next_generation(void *context);
 static void *generate_all(void *context);
 static void *init0(void *context);
 static void *run_robot(void *context);
 static void *finalize(void *context);
+static void *simulation_end(void *context);
 static void *tcpip_started(void *context);
 static void *tcpip_started_callback(void *context);
+static void *evaluate_generation(void *context);
+static void *evaluate_agent(void *context);
+static void *evaluated_generation(void *context);
+static void *send_stats(void *context);
+static void *stats_gathered(void *context);
 
 void connectTasksInLinda();
 
+//! The amount of genome hashes that are remembered as multicast already
+#define ELINDA_BROADCAST_HISTORY	64
+
+static uint32_t broadcastHashes[ELINDA_BROADCAST_HISTORY];
+static int broadcastCount;
+static pthread_mutex_t broadcastMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t windowMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int evaluationCount;
+static pthread_mutex_t steadyStateMutex = PTHREAD_MUTEX_INITIALIZER;
+
+//! How long the controllers get to answer an aggregated request for statistics, in microseconds
+#define ELINDA_STATS_WINDOW			200000
+
+//! The aggregated request of which the answers are gathered, see send_stats
+static struct TcpipMessage *statsRequest;
+static struct TcpipMessage *statsReplies[POOL_MAX_WORKERS];
+static uint16_t statsAsked, statsAnswered;
+static uint8_t statsRound;
+static pthread_mutex_t statsMutex = PTHREAD_MUTEX_INITIALIZER;
+
 /**
  * Return default values to initialize the Elinda engine.
  */
@@ -85,6 +124,13 @@ void initElinda() {
 	elconf->generation_count = 8;
 	elconf->generation_id = 0;
 	elconf->boot = first_channel;
+	elconf->in_process = (getenv("LINDA_IN_PROCESS") != NULL);
+	elconf->precompile = (getenv("LINDA_PRECOMPILE") != NULL);
+	unsigned int size;
+	const char *text = getenv("LINDA_SIMULATION_SIZE");
+	if ((text != NULL) && (sscanf(text, "%u", &size) == 1) && size && (size < 65536)) {
+		elconf->simulation_size = size;
+	}
 	elruntime = malloc(sizeof(struct ElindaRuntime));
 	elruntime->eosim = malloc(sizeof(struct SyncThreads));
 	ptreaty_init(elruntime->eosim);
@@ -126,12 +172,27 @@ static void *first_channel(void *context) {
 	tprintf(LOG_VERBOSE, __func__, "Create first channel");
 	struct InfoChannel *ic = malloc(sizeof(struct InfoChannel));
 	ic->type = 0;
+	if (getenv("LINDA_LOCAL") != NULL) ic->type |= TCPIP_CHANNEL_LOCAL;
 	ic->host = malloc(sizeof(struct in_addr));
 	ic->host->s_addr = INADDR_ANY;
 	ic->port = tmconf->mbus_elinda_port;
 	ic->id = tmconf->mbus_id;
 	tprintf(LOG_VERBOSE, __func__, "Dispatch add default channel task");
 	dispatch_described_task(add_channel, (void*)ic, "add default channel");
+
+	//with LINDA_MULTICAST set, genomes are multicast, to its value if that is a group
+	const char *group = getenv("LINDA_MULTICAST");
+	if (group == NULL) return NULL;
+	if (group[0] != 0 && !inet_aton(group, &tmconf->mcast_group)) {
+		TPRINTF(LOG_WARNING, "Invalid multicast group %s", group);
+	}
+	ic = malloc(sizeof(struct InfoChannel));
+	ic->type = TCPIP_CHANNEL_MULTICAST;
+	ic->host = malloc(sizeof(struct in_addr));
+	*ic->host = tmconf->mcast_group;
+	ic->port = tmconf->mcast_port;
+	ic->id = tmconf->mcast_id;
+	dispatch_described_task(add_channel, (void*)ic, "add multicast channel");
 	return NULL;
 }
 
@@ -153,45 +214,118 @@ static void *default_hostess(void *context) {
 
 	switch (msg->payload[0]) {
 	case LINDA_NEW_PROCESS_ACK: {
-		struct InfoDefault *infod = malloc(sizeof(struct InfoDefault));
+		if (workerAlive(msg->payload[2])) {
+			freemsg(msg);
+			break;
+		}
+		struct InfoDefault *infod = linda_ctx_alloc(sizeof(struct InfoDefault));
 		infod->id = msg->payload[2];
 		infod->value = 0;
 		struct Agent *la = getAgent(infod->id);
-		if (la == NULL) break;
+		if (la == NULL) {
+			linda_ctx_free(infod);
+			break;
+		}
 		la->elinda.process_state = ELINDA_PROCSTATE_RUNNING;
 		dispatch_described_task(inseminate, (void*)infod, "inseminate");
 		freemsg(msg);
 		break;
 	}
 	case LINDA_GENOME_ACK: {
-		struct InfoDefault *infod = malloc(sizeof(struct InfoDefault));
-		infod->id = msg->payload[2];
+		struct Agent *la = agentOfProcess(msg->payload[2]);
+		if (la == NULL) {
+			freemsg(msg);
+			break;
+		}
+		struct InfoDefault *infod = linda_ctx_alloc(sizeof(struct InfoDefault));
+		infod->id = la->id;
 		infod->value = msg->payload[3];
 		dispatch_poseta_task(reincarnate, (void*)infod, "reincarnate");
 		freemsg(msg);
 		break;
 	}
 	case LINDA_GENOME_PART_ACK: {
-		struct InfoDefault *infod = malloc(sizeof(struct InfoDefault));
-		infod->id = msg->payload[2];
+		struct Agent *la = agentOfProcess(msg->payload[2]);
+		if (la == NULL) {
+			freemsg(msg);
+			break;
+		}
+		struct InfoDefault *infod = linda_ctx_alloc(sizeof(struct InfoDefault));
+		infod->id = la->id;
 		infod->value = msg->payload[4] + 1;
 		dispatch_described_task(inseminate, (void*)infod, "inseminate");
 		freemsg(msg);
 		break;
 	}
+	case LINDA_GENOME_NACK: {
+		dispatch_described_task(repair_genome, (void*)msg, "repair genome");
+		break;
+	}
+	case LINDA_GENOME_DELTA_NACK: {
+		struct Agent *la = agentOfProcess(msg->payload[2]);
+		if (la == NULL) {
+			freemsg(msg);
+			break;
+		}
+		struct InfoDefault *infod = linda_ctx_alloc(sizeof(struct InfoDefault));
+		infod->id = la->id;
+		infod->value = 0;
+		dispatch_described_task(resend_genome, (void*)infod, "resend genome");
+		freemsg(msg);
+		break;
+	}
+	case LINDA_NETWORK_NACK: {
+		struct Agent *la = agentOfProcess(msg->payload[2]);
+		if (la == NULL) {
+			freemsg(msg);
+			break;
+		}
+		//the robots do not have the grid the networks are developed in
+		tprintf(LOG_WARNING, __func__, "Network refused, send genomes from now on");
+		elconf->precompile = 0;
+		struct InfoDefault *infod = linda_ctx_alloc(sizeof(struct InfoDefault));
+		infod->id = la->id;
+		infod->value = 0;
+		dispatch_described_task(resend_genome, (void*)infod, "resend genome");
+		freemsg(msg);
+		break;
+	}
 	case LINDA_FITNESS_MSG: {
-		struct InfoDefault *infod = malloc(sizeof(struct InfoDefault));
+		struct InfoDefault *infod = linda_ctx_alloc(sizeof(struct InfoDefault));
 		tprintmsg(msg, LOG_VV);
-		infod->id = msg->payload[4];
 		infod->value = msg->payload[5]; //and [6]?
-		struct Agent *la = getAgent(infod->id);
-		if (la == NULL) break;
+		struct Agent *la = agentOfProcess(msg->payload[4]);
+		if (la == NULL) {
+			linda_ctx_free(infod);
+			break;
+		}
+		infod->id = la->id;
 		//		RAISE(la->simulation_state, ELINDA_SIMSTATE_DONE);
 		//		CLEAR(la->simulation_state, ELINDA_SIMSTATE_CURRENT);
 		dispatch_described_task(handle_fitness, (void*)infod, "handle fitness");
 		freemsg(msg);
 		break;
 	}
+	case LINDA_STATS_REQ: {
+		dispatch_described_task(send_stats, (void*)msg, "send stats");
+		break;
+	}
+	case LINDA_STATS_MSG: {
+		uint8_t round = (msg->size >= LINDA_STATS_HEADER) ? msg->payload[5] : 0;
+		uint8_t source = msg->payload[2], done = 0;
+		pthread_mutex_lock(&statsMutex);
+		if ((statsRequest != NULL) && (msg->size >= LINDA_STATS_HEADER) &&
+				(round == statsRound) && (statsReplies[source] == NULL)) {
+			statsReplies[source] = msg;
+			msg = NULL;
+			done = (++statsAnswered == statsAsked);
+		}
+		pthread_mutex_unlock(&statsMutex);
+		if (msg != NULL) freemsg(msg);
+		if (done) dispatch_described_task(stats_gathered, (void*)(uintptr_t)round,
+				"stats gathered");
+		break;
+	}
 	case LINDA_END_ELINDA_MSG: {
 		dispatch_described_task(finalize, NULL, "finalize");
 		freemsg(msg);
@@ -216,10 +350,12 @@ struct TcpipSocket* ic2sock(struct InfoChannel *ic) {
 	tprintf(LOG_VERBOSE, __func__, "Retrieve channel");
 	struct TcpipSocket *lsock = tcpip_get(ic->type);
 	lsock->port_nr = ic->port;
-	if (ic->type == 0) lsock->serv_addr.sin_addr = *ic->host;
+	if (!(ic->type & ~(TCPIP_CHANNEL_LOCAL | TCPIP_CHANNEL_MULTICAST)))
+		lsock->serv_addr.sin_addr = *ic->host;
 	else lsock->cli_addr.sin_addr = *ic->host;
 	lsock->callbackIn = default_hostess; //coordination should be exogenous
-	lsock->callbackConnect = tcpip_started_callback;
+	//the boot waits for the m-bus only
+	if (!(ic->type & TCPIP_CHANNEL_MULTICAST)) lsock->callbackConnect = tcpip_started_callback;
 	return lsock;
 }
 
@@ -237,7 +373,12 @@ static void *add_channel(void *context) {
 		return NULL;
 	}
 	struct TcpipSocket *lsock = ic2sock(ic);
-	tcpipbank_add(lsock, ic->id);
+	if (tcpipbank_add(lsock, ic->id)) {
+		//another monk added the channel in the meantime
+		tcpip_free(lsock);
+		free(ic);
+		return NULL;
+	}
 	dispatch_described_task(tcpip_start, (void*)lsock, "start tcp/ip");
 	free(ic);
 	return NULL;
@@ -265,7 +406,7 @@ static void *connect_to_3dsim(void *context) {
 		return NULL;
 	}
 	push(lsock_dest->outbox, msgA);
-	dispatch_described_task(tcpip_send_packets, (void*)lsock_dest, "send packets");
+	tcpip_flush(lsock_dest);
 	return NULL;
 }
 
@@ -276,8 +417,8 @@ static void *connect_to_3dsim(void *context) {
  * engine. Only then a genome can be sent in the direction of the new Colinda engine.
  */
 static void *generate(void *context) {
-	uint8_t robotId = *(uint8_t*)context;
-	char text[64]; sprintf(text, "To-be-simulated robot: %i", robotId);
+	uint32_t robotId = *(uint32_t*)context;
+	char text[64]; sprintf(text, "To-be-simulated robot: %u", robotId);
 	tprintf(LOG_INFO, __func__, text);
 	getAgent(robotId)->elinda.process_state = ELINDA_PROCSTATE_STARTING;
 	tprintf(LOG_VERBOSE, __func__, "Initialize a channel to the robot");
@@ -288,29 +429,123 @@ static void *generate(void *context) {
 		return NULL;
 	}
 	push(lsock_dest->outbox, msgA);
-	dispatch_described_task(tcpip_send_packets, (void*)lsock_dest, "send packets");
 	tprintf(LOG_INFO, __func__, "Generate new colinda process");
 	struct TcpipMessage *msgB = createRunColindaMessage(robotId);
 	push(lsock_dest->outbox, msgB);
-	dispatch_described_task(tcpip_send_packets, (void*)lsock_dest, "send packets");
+	tcpip_flush(lsock_dest);
 	return NULL;
 }
 
+/**
+ * Returns 1 if the genome with the given hash is not multicast before, and remembers that
+ * it is now. Only the last ELINDA_BROADCAST_HISTORY hashes are remembered.
+ */
+static int broadcast_first(uint32_t hash) {
+	int i, n;
+	pthread_mutex_lock(&broadcastMutex);
+	n = broadcastCount < ELINDA_BROADCAST_HISTORY ? broadcastCount : ELINDA_BROADCAST_HISTORY;
+	for (i = 0; i < n; i++) {
+		if (broadcastHashes[i] == hash) {
+			pthread_mutex_unlock(&broadcastMutex);
+			return 0;
+		}
+	}
+	broadcastHashes[broadcastCount++ % ELINDA_BROADCAST_HISTORY] = hash;
+	pthread_mutex_unlock(&broadcastMutex);
+	return 1;
+}
+
+/**
+ * Announces the genome to the robot over the m-bus, and multicasts its parts, unless the
+ * same genome is multicast already, for a clone. Controllers that missed parts, for example
+ * because they were not running yet, ask for them again (see repair_genome).
+ */
+static void broadcast_genome(uint8_t robotId, struct RawGenome *ldna,
+		struct TcpipSocket *lsock_dest, struct TcpipSocket *lsock_group) {
+	uint32_t hash = hashGenome(ldna);
+	int partCount = genomeBroadcastParts(tcpip_max_message_size(lsock_group));
+	uint16_t partId;
+	push(lsock_dest->outbox, createGenomeAnnounceMessage(robotId, hash, partCount));
+	tcpip_flush(lsock_dest);
+	if (!broadcast_first(hash)) {
+		TPRINTF(LOG_VERBOSE, "Genome %08x of %i is multicast already", hash, robotId);
+		return;
+	}
+	for (partId = 0; partId < partCount; partId++) {
+		push(lsock_group->outbox, createGenomeBroadcastMessage(ldna, hash, partId,
+				partCount));
+	}
+	tcpip_flush(lsock_group);
+}
+
+/**
+ * Sends the genome as a delta to the genome that is sent to the robot before, and
+ * remembers the genome as the one that is sent now. That one shares its pages with the
+ * genome of the agent, until a mutation touches them, so only the pages that changed are
+ * compared for the next delta. Returns 0 if there is no genome sent before, or if the
+ * delta is too large, then the entire genome should be sent.
+ */
+static int send_genome_delta(struct Agent *la, struct TcpipSocket *lsock_dest) {
+	struct AgentElindaContainer *sent = &la->elinda;
+	uint32_t hash = hashGenome(la->genome);
+	struct TcpipMessage *msg = NULL;
+	if (sent->sent_genome != NULL) {
+		msg = createGenomeDeltaMessage(processOf(la), sent->sent_genome, la->genome,
+				sent->sent_hash, hash, tcpip_max_message_size(lsock_dest));
+	}
+	freeGenome(sent->sent_genome);
+	sent->sent_genome = cloneGenome(la->genome);
+	sent->sent_hash = hash;
+	if (msg == NULL) return 0;
+	TPRINTF(LOG_VERBOSE, "Genome of %u sent as delta of %i bytes", la->id, msg->size);
+	push(lsock_dest->outbox, msg);
+	tcpip_flush(lsock_dest);
+	return 1;
+}
+
+/**
+ * Develops the genome of the agent here and sends the network that came out, see batch.h.
+ * The robot does not have a genome after it, so a genome sent later is not a delta. Returns
+ * 0 if there is no network, then the genome should be sent.
+ */
+static int send_network(struct Agent *la, struct TcpipSocket *lsock_dest) {
+	uint32_t size;
+	uint8_t *frame = developNetwork(la->id, la->genome, &size);
+	if (frame == NULL) return 0;
+	uint32_t hash = linda_buffer_hash(frame, size);
+	uint16_t partId, partCount = networkParts(size, tcpip_max_message_size(lsock_dest));
+	for (partId = 0; partId < partCount; partId++) {
+		push(lsock_dest->outbox, createNetworkMessage(processOf(la), frame, size, hash,
+				partId, partCount));
+	}
+	tcpip_flush(lsock_dest);
+	free(frame);
+	freeGenome(la->elinda.sent_genome);
+	la->elinda.sent_genome = NULL;
+	TPRINTF(LOG_VERBOSE, "Network of %u sent in %i parts of %u bytes", la->id, partCount, size);
+	return 1;
+}
+
 /**
  * The identifier of the robot in the Symbricator3D simulator is different from the
  * identifier of the Colinda engine. The simulatedRobotId is the robotId modulus the
- * amount of simulated robots at once.
+ * amount of simulated robots at once. With LINDA_PRECOMPILE the robot gets the developed
+ * network instead, see send_network. A robot that got a genome before, gets the next
+ * one as a delta. Otherwise the whole genome is sent at once with a multicast channel,
+ * or else part by part. Then ELINDA_GENOME_WINDOW parts are on their way, and every
+ * acknowledgement, which is for all parts up to the given one, makes room for more. The
+ * Colinda engine puts parts that come in the wrong order in place.
  */
 static void *inseminate(void *context) {
 	struct InfoDefault *infod = (struct InfoDefault*)context;
-	uint8_t robotId = infod->id;
+	uint32_t robotId = infod->id;
 	uint8_t partId = infod->value;
 	if (!(infod->value)) {
-		char text[64]; sprintf(text, "Start insemination of %i", robotId);
+		char text[64]; sprintf(text, "Start insemination of %u", robotId);
 		tprintf(LOG_INFO, __func__, text);
-		getAgent(robotId)->elinda.simulation_state = ELINDA_SIMSTATE_CURRENT;
+		setSimulationState(getAgent(robotId), ELINDA_SIMSTATE_CURRENT);
 	} else {
-		char text[64]; sprintf(text, "Continue insemination of %i (part %i)", robotId, partId);
+		char text[64]; sprintf(text, "Continue insemination of %u (part %i)", robotId, partId);
 		tprintf(LOG_VERBOSE, __func__, text);
 	}
 
@@ -318,28 +553,95 @@ static void *inseminate(void *context) {
 	struct RawGenome *ldna = getAgent(robotId)->genome;
 	if (ldna == NULL) {
 		tprintf(LOG_WARNING, __func__, "No genome found!");
-		free(infod);
+		linda_ctx_free(infod);
 		return NULL;
 	}
 	
 	tprintf(LOG_VERBOSE, __func__, "Get socket");
 	struct TcpipSocket *lsock_dest = tcpipbank_get(tmconf->mbus_id);
-	struct TcpipMessage *msg;
-	msg = createGenomeMessage(robotId, ldna->content, partId);
-	if (msg == NULL) goto inseminate_finish;
-	
 	if (lsock_dest == NULL) {
 		tprintf(LOG_WARNING, __func__, "Not initialized?");
+		goto inseminate_finish;
 	}
-	tprintf(LOG_VVV, __func__, "Push");
-	push(lsock_dest->outbox, msg);
-	dispatch_described_task(tcpip_send_packets, (void*)lsock_dest, "send packets");
+	if (!partId && elconf->precompile && send_network(getAgent(robotId), lsock_dest))
+		goto inseminate_finish;
+	if (!partId && send_genome_delta(getAgent(robotId), lsock_dest)) goto inseminate_finish;
+	uint32_t processId = processOf(getAgent(robotId));
+	struct TcpipSocket *lsock_group = tcpipbank_get(tmconf->mcast_id);
+	if (lsock_group != NULL && !partId) {
+		broadcast_genome(processId, ldna, lsock_dest, lsock_group);
+		goto inseminate_finish;
+	}
+	struct TcpipMessage *msg;
+	struct AgentElindaContainer *sent = &getAgent(robotId)->elinda;
+	int end = partId + ELINDA_GENOME_WINDOW;
+	pthread_mutex_lock(&windowMutex);
+	if (!partId) sent->part_next = 0;
+	while (sent->part_next < end) {
+		msg = createGenomeMessage(processId, ldna, sent->part_next,
+				tcpip_max_message_size(lsock_dest));
+		if (msg == NULL) break;
+		tprintf(LOG_VVV, __func__, "Push");
+		push(lsock_dest->outbox, msg);
+		sent->part_next++;
+	}
+	pthread_mutex_unlock(&windowMutex);
+	tcpip_flush(lsock_dest);
 	
 inseminate_finish:
-	free(infod);
+	linda_ctx_free(infod);
 	return NULL;
 }
 
+/**
+ * Multicasts the parts of a genome again for which a controller sends a LINDA_GENOME_NACK,
+ * with the hash of the genome and a bitmap of the parts it misses. A hash that is not the
+ * genome of the robot anymore, belongs to an announcement that is outdated.
+ */
+static void *repair_genome(void *context) {
+	struct TcpipMessage *msg = (struct TcpipMessage*)context;
+	struct TcpipSocket *lsock_group = tcpipbank_get(tmconf->mcast_id);
+	struct Agent *la = agentOfProcess(msg->payload[2]);
+	uint32_t hash;
+	uint16_t partId, partCount;
+	if (lsock_group == NULL || la == NULL || la->genome == NULL || msg->size < 10)
+		goto repair_finish;
+	hash = (msg->payload[4] << 24) | (msg->payload[5] << 16) | (msg->payload[6] << 8) |
+			msg->payload[7];
+	partCount = (msg->payload[8] << 8) | msg->payload[9];
+	if (hash != hashGenome(la->genome) ||
+			partCount != genomeBroadcastParts(tcpip_max_message_size(lsock_group)) ||
+			msg->size < 10 + (partCount + 7) / 8) {
+		TPRINTF(LOG_VERBOSE, "Outdated repair request for genome %08x", hash);
+		goto repair_finish;
+	}
+	for (partId = 0; partId < partCount; partId++) {
+		if (!RAISED(msg->payload[10 + partId / 8], partId % 8)) continue;
+		push(lsock_group->outbox, createGenomeBroadcastMessage(la->genome, hash,
+				partId, partCount));
+	}
+	tcpip_flush(lsock_group);
+repair_finish:
+	freemsg(msg);
+	return NULL;
+}
+
+/**
+ * The controller did not have the base of a delta, so it gets the entire genome.
+ */
+static void *resend_genome(void *context) {
+	struct InfoDefault *infod = (struct InfoDefault*)context;
+	struct Agent *la = getAgent(infod->id);
+	if (la == NULL) {
+		linda_ctx_free(infod);
+		return NULL;
+	}
+	TPRINTF(LOG_WARNING, "Robot %i misses the base genome, send it entirely", infod->id);
+	freeGenome(la->elinda.sent_genome);
+	la->elinda.sent_genome = NULL;
+	return inseminate(context);
+}
+
 /**
  * This routine gets the robot_id from the context parameter and sends reincarnation
  * commands. This can be (re)position as well as (re)orientation messages to the
@@ -349,18 +651,19 @@ inseminate_finish:
  */
 static void *reincarnate(void *context) {
 	struct InfoDefault *infod = (struct InfoDefault*)context;
-	uint8_t robotId = infod->id;
-	struct TcpipMessage *msg = createPositionMessage(robotId, 
-			(robotId % elconf->simulation_size) * -10, 0, 1);
+	uint32_t robotId = infod->id;
+	struct Agent *la = getAgent(robotId);
+	struct TcpipMessage *msg = createPositionMessage(processOf(la), la->elinda.slot * -10, 0, 1);
 	struct TcpipSocket *lsock_dest = tcpipbank_get(tmconf->mbus_id);
 	if (lsock_dest == NULL) {
 		tprintf(LOG_WARNING, __func__, "Not initialized?");
-		free(msg);
-		dispatch_described_task(reincarnate, context, "try to reincarnate again");
+		freemsg(msg);
+		dispatch_delayed_prioritized_task(reincarnate, context, "try to reincarnate again",
+				ABBEY_PRIORITY_NORMAL, 100000);
 		return NULL;
 	}
 	push(lsock_dest->outbox, msg);
-	dispatch_described_task(tcpip_send_packets, (void*)lsock_dest, "send packets");
+	tcpip_flush(lsock_dest);
 	dispatch_described_task(run_robot, context, "run robot");
 	//infod is freed in run_robot
 	return NULL;
@@ -376,28 +679,41 @@ static void *reincarnate(void *context) {
 static void *run_robot(void *context) {
 	tprintf(LOG_VERBOSE, __func__, "Run robot");
 	struct InfoDefault *infod = (struct InfoDefault*)context;
-	uint8_t robotId = infod->id;
-	struct TcpipMessage *msg = createRunRobotMessage(robotId);
+	uint32_t robotId = infod->id;
+	struct TcpipMessage *msg = createRunRobotMessage(processOf(getAgent(robotId)));
 	struct TcpipSocket *lsock_dest = tcpipbank_get(tmconf->mbus_id);
 	push(lsock_dest->outbox, msg);
-	dispatch_described_task(tcpip_send_packets, (void*)lsock_dest, "send packets");
-	free(infod);
+	tcpip_flush(lsock_dest);
+	linda_ctx_free(infod);
 	return NULL;
 }
 
 /**
  * This routine has two responsibilities. First it adds the fitness value to an array of
  * values. And if it concerns the last robot in a set of simulated robots, it needs to
- * start the cycle again starting with insemination of a new genome.
+ * start the cycle again starting with insemination of a new genome. In steady-state
+ * evolution it does not wait for the other robots, the slot of the robot goes to the next
+ * agent at once, see simulate_next_agent.
  */
 static void *handle_fitness(void *context) {
 	struct InfoDefault *infod = (struct InfoDefault*)context;
-	char text[32]; sprintf(text, "Handle fitness for %i", infod->id);
+	char text[32]; sprintf(text, "Handle fitness for %u", infod->id);
 	tprintf(LOG_WARNING, __func__, text);
+	struct Agent *la = getAgent(infod->id);
+	if (la == NULL) {
+		linda_ctx_free(infod);
+		return NULL;
+	}
 	addFitness(infod->id, infod->value);
+	if (plconf != NULL) releaseWorker(la);
 
 	//	printAgentStates();
-	aa[infod->id].elinda.simulation_state = ELINDA_SIMSTATE_DONE;
+	if (econf->tournament_size) {
+		dispatch_described_task(simulate_next_agent, (void*)la, "next agent");
+		linda_ctx_free(infod);
+		return NULL;
+	}
+	setSimulationState(la, ELINDA_SIMSTATE_DONE);
 	switch(allAgentsSimulated()) {
 	case 1: {
 		dispatch_described_task(simulate_next_group, NULL, "next group");
@@ -408,7 +724,7 @@ static void *handle_fitness(void *context) {
 	} default:
 		; // wait for subsequent fitness values
 	}
-	free(infod);
+	linda_ctx_free(infod);
 	return NULL;
 }
 
@@ -419,19 +735,70 @@ static void *handle_fitness(void *context) {
  */
 static void *simulate_next_group(void *context) {
 	tprintf(LOG_INFO, __func__, "Simulate next group");
-	uint8_t i;
+	uint16_t i, n = 0;
+	void *(*funcs[elconf->simulation_size])(void *);
+	void *contexts[elconf->simulation_size];
+	char *descs[elconf->simulation_size];
 	for (i = 0; i < elconf->simulation_size; i++) {
 		struct Agent *la = getAgentToBeSimulated();
 		if (la == NULL) break;
-		if (la->elinda.process_state == ELINDA_PROCSTATE_DEFAULT) {
-			dispatch_described_task(generate, (void*)&la->id, "generate");
+		la->elinda.slot = la->id % elconf->simulation_size;
+		if (plconf != NULL) {
+			leaseWorker(la);
+		} else if (la->elinda.process_state == ELINDA_PROCSTATE_DEFAULT) {
+			funcs[n] = generate;
+			contexts[n] = (void*)&la->id;
+			descs[n++] = "generate";
 		} else {
-			struct InfoDefault *infod = malloc(sizeof(struct InfoDefault));
+			struct InfoDefault *infod = linda_ctx_alloc(sizeof(struct InfoDefault));
 			infod->id = la->id;
 			infod->value = 0;
-			dispatch_described_task(inseminate, (void*)infod, "inseminate");
+			funcs[n] = inseminate;
+			contexts[n] = (void*)infod;
+			descs[n++] = "inseminate";
 		}
 	}
+	dispatch_task_batch(funcs, contexts, descs, n);
+	return NULL;
+}
+
+/**
+ * In steady-state evolution the slot of an agent that is evaluated goes to the next agent
+ * right away: one that is not evaluated yet, or else the offspring of a tournament, see
+ * stepSteadyState. There are no groups and no generations to wait for, a generation is
+ * just counted every population_size evaluations, for the archive and for the end.
+ */
+static void *simulate_next_agent(void *context) {
+	struct Agent *done = (struct Agent*)context, *la;
+	uint8_t finished = 0;
+	pthread_mutex_lock(&steadyStateMutex);
+	setSimulationState(done, ELINDA_SIMSTATE_DONE);
+	if (!(++evaluationCount % econf->population_size)) {
+		elconf->generation_id++;
+		checkpointEvolution();
+		exchangeMigrants();
+		econf->generation++;
+		finished = (elconf->generation_count == elconf->generation_id);
+	}
+	la = finished ? NULL : getAgentToBeSimulated();
+	if (la == NULL && !finished && stepSteadyState() != NULL) la = getAgentToBeSimulated();
+	if (la != NULL) la->elinda.slot = done->elinda.slot;
+	pthread_mutex_unlock(&steadyStateMutex);
+
+	if (finished) {
+		dispatch_described_task(finalize, NULL, "finalize");
+	} else if (la == NULL) {
+		tprintf(LOG_WARNING, __func__, "No agent for the slot");
+	} else if (plconf != NULL) {
+		leaseWorker(la);
+	} else if (la->elinda.process_state == ELINDA_PROCSTATE_DEFAULT) {
+		dispatch_described_task(generate, (void*)&la->id, "generate");
+	} else {
+		struct InfoDefault *infod = linda_ctx_alloc(sizeof(struct InfoDefault));
+		infod->id = la->id;
+		infod->value = 0;
+		dispatch_described_task(inseminate, (void*)infod, "inseminate");
+	}
 	return NULL;
 }
 
@@ -442,6 +809,7 @@ static void *simulate_next_group(void *context) {
 static void *simulate_next_generation(void *context) {
 	tprintf(LOG_INFO, __func__, "Simulate next generation");
 	elconf->generation_id++;
+	checkpointEvolution();
 	if (elconf->generation_count == elconf->generation_id) {
 		dispatch_described_task(finalize, NULL, "finalize");
 		return NULL;
@@ -458,12 +826,67 @@ static void *simulate_next_generation(void *context) {
  */
 static void *generate_all(void *context) {
 	tprintf(LOG_INFO, __func__, "Start");
-	uint8_t i; struct Agent *la;
+	uint16_t i, n = 0; struct Agent *la;
+	void *(*funcs[elconf->simulation_size])(void *);
+	void *contexts[elconf->simulation_size];
+	char *descs[elconf->simulation_size];
+	startPool();
 	for (i = 0; i < elconf->simulation_size; i++) {
 		la = getAgentToBeSimulated();
 		if (la == NULL) break;
-		dispatch_described_task(generate, (void*)&la->id, "generate");
+		la->elinda.slot = la->id % elconf->simulation_size;
+		if (plconf != NULL) {
+			leaseWorker(la);
+			continue;
+		}
+		funcs[n] = generate;
+		contexts[n] = (void*)&la->id;
+		descs[n++] = "generate";
 	}
+	dispatch_task_batch(funcs, contexts, descs, n);
+	return NULL;
+}
+
+/**
+ * In batch mode, see batch.h, the agents of a generation are evaluated at once, by the nodes
+ * of a graph without edges, and the next generation follows when the last agent is done.
+ */
+static void *evaluate_generation(void *context) {
+	tprintf(LOG_INFO, __func__, "Evaluate generation");
+	struct PosetaGraph *graph = poseta_graph_create();
+	uint32_t i;
+	for (i = 0; i < econf->population_size; i++) {
+		setSimulationState(&aa[i], ELINDA_SIMSTATE_CURRENT);
+		poseta_graph_add(graph, evaluate_agent, (void*)&aa[i], "evaluate agent");
+	}
+	if (poseta_graph_run(graph, evaluated_generation, NULL, "evaluated generation")) {
+		tprintf(LOG_ERR, __func__, "Generation could not be evaluated");
+		poseta_graph_free(graph);
+	}
+	return NULL;
+}
+
+static void *evaluate_agent(void *context) {
+	struct Agent *la = (struct Agent*)context;
+	addFitness(la->id, evaluateTopology(la->id, la->genome));
+	setSimulationState(la, ELINDA_SIMSTATE_DONE);
+	return NULL;
+}
+
+/**
+ * The batch counterpart of simulate_next_generation.
+ */
+static void *evaluated_generation(void *context) {
+	elconf->generation_id++;
+	TPRINTF(LOG_NOTICE, "Generation %i evaluated", elconf->generation_id);
+	checkpointEvolution();
+	if (elconf->generation_count == elconf->generation_id) {
+		dispatch_described_task(finalize, NULL, "finalize");
+		return NULL;
+	}
+	stepEvolution();
+	clearSimulationState();
+	dispatch_described_task(evaluate_generation, NULL, "evaluate generation");
 	return NULL;
 }
 
@@ -477,9 +900,165 @@ static void *init0(void *context) {
 	return NULL;
 }
 
+/**
+ * The ids of the controllers that run, those of the workers in the pool that are started,
+ * or else those of the agents with a process of their own.
+ */
+static uint16_t running_controllers(uint8_t *ids) {
+	uint16_t i, n = 0;
+	if (plconf != NULL) {
+		n = runningWorkers(ids);
+	} else if (aa != NULL) {
+		for (i = 0; (i < econf->population_size) && (i < tmconf->sym3d_id); i++) {
+			if (aa[i].elinda.process_state == ELINDA_PROCSTATE_RUNNING) ids[n++] = i;
+		}
+	}
+	return n;
+}
+
+/**
+ * Sends the part of a reply before, with LINDA_STATS_MORE, and returns the next part with the
+ * given sections, or the part before again without memory for the next.
+ */
+static struct TcpipMessage *next_stats_part(struct TcpipSocket *lsock_dest,
+		struct TcpipMessage *last, uint8_t *sections, uint16_t size) {
+	struct TcpipMessage *part = linda_stats_message(last->payload[2], last->payload[3],
+			last->payload[5], 0, last->payload[7], sections, size);
+	if (part == NULL) return last;
+	last->payload[6] |= LINDA_STATS_MORE;
+	push(lsock_dest->outbox, last);
+	return part;
+}
+
+/**
+ * Sends the statistics of this process to the source of the request. If there are replies of
+ * the controllers, their sections come after those in as many more messages as needed, see
+ * stats.h.
+ */
+static void reply_stats(struct TcpipSocket *lsock_dest, struct TcpipMessage *request,
+		struct TcpipMessage **replies, uint16_t asked) {
+	uint16_t i, answered = 0;
+	int max_size = tcpip_max_message_size(lsock_dest);
+	if (replies != NULL) {
+		for (i = 0; i < POOL_MAX_WORKERS; i++) answered += (replies[i] != NULL);
+	}
+	uint8_t counters[256], *body = linda_stats_open(counters, LINDA_STATS_COUNTERS), *p;
+	p = linda_stats_counter(body, "generation", elconf->generation_id);
+	p = linda_stats_counter(p, "generations", elconf->generation_count);
+	if (aa != NULL) {
+		p = linda_stats_counter(p, "population", econf->population_size);
+		p = linda_stats_counter(p, "agents_todo", countAgents(ELINDA_SIMSTATE_TODO));
+		p = linda_stats_counter(p, "agents_current", countAgents(ELINDA_SIMSTATE_CURRENT));
+		p = linda_stats_counter(p, "agents_done", countAgents(ELINDA_SIMSTATE_DONE));
+	}
+	p = linda_stats_counter(p, "evaluations", evaluationCount);
+	if (replies != NULL) {
+		p = linda_stats_counter(p, "controllers", asked);
+		p = linda_stats_counter(p, "controllers_answered", answered);
+	}
+	p = linda_stats_close(body, p);
+	struct TcpipMessage *last = linda_stats_reply(request, tmconf->elinda_id,
+			LINDA_STATS_ELINDA, counters, p - counters, max_size), *next;
+	if (last == NULL) return;
+	//the answers of the controllers follow the last part
+	for (; last->next != NULL; last = next) {
+		next = last->next;
+		push(lsock_dest->outbox, last);
+	}
+	uint16_t room = (max_size < MAX_FRAME_SIZE ? max_size : MAX_FRAME_SIZE) -
+			LINDA_STATS_HEADER;
+	uint8_t *sections = (replies != NULL) ? malloc(room) : NULL;
+	for (i = 0, p = sections; (sections != NULL) && (i < POOL_MAX_WORKERS); i++) {
+		if (replies[i] == NULL) continue;
+		uint8_t *q = linda_stats_process(p, sections + room - p, replies[i]);
+		if ((q == p) && (p > sections)) {
+			//the part is full, the answer goes in the next one
+			last = next_stats_part(lsock_dest, last, sections, p - sections);
+			p = sections;
+			q = linda_stats_process(p, room, replies[i]);
+		}
+		p = q;
+	}
+	if ((sections != NULL) && (p > sections))
+		last = next_stats_part(lsock_dest, last, sections, p - sections);
+	free(sections);
+	push(lsock_dest->outbox, last);
+	tcpip_flush(lsock_dest);
+}
+
+/**
+ * Answers a request for the statistics, see stats.h, with the progress of evolution next to
+ * the statistics of the abbey and the channels. An aggregated request is passed on to all
+ * controllers that run, and answered once they all did, or after ELINDA_STATS_WINDOW. While
+ * the answers to one are gathered, another one is answered without those.
+ */
+static void *send_stats(void *context) {
+	struct TcpipMessage *request = (struct TcpipMessage*)context;
+	uint8_t ids[POOL_MAX_WORKERS], round;
+	uint16_t i, n;
+	struct TcpipSocket *lsock_dest = tcpipbank_get(tmconf->mbus_id);
+	if (lsock_dest == NULL) {
+		tprintf(LOG_WARNING, __func__, "Not initialized?");
+		freemsg(request);
+		return NULL;
+	}
+	uint8_t aggregate = (request->size >= LINDA_STATS_REQ_SIZE) &&
+			(request->payload[4] & LINDA_STATS_AGGREGATE);
+	pthread_mutex_lock(&statsMutex);
+	if (!aggregate || (statsRequest != NULL)) {
+		pthread_mutex_unlock(&statsMutex);
+		reply_stats(lsock_dest, request, NULL, 0);
+		freemsg(request);
+		return NULL;
+	}
+	statsRequest = request;
+	round = ++statsRound;
+	statsAnswered = 0;
+	statsAsked = n = running_controllers(ids);
+	pthread_mutex_unlock(&statsMutex);
+	if (!n) return stats_gathered((void*)(uintptr_t)round);
+	for (i = 0; i < n; i++) {
+		struct TcpipMessage *msg = linda_stats_request(tmconf->elinda_id, ids[i], 0, round);
+		if (msg != NULL) push(lsock_dest->outbox, msg);
+	}
+	tcpip_flush(lsock_dest);
+	dispatch_delayed_task(stats_gathered, (void*)(uintptr_t)round, ELINDA_STATS_WINDOW);
+	return NULL;
+}
+
+/**
+ * The answers to the aggregated request of the given round are in, or the time is up.
+ */
+static void *stats_gathered(void *context) {
+	uint8_t round = (uintptr_t)context;
+	uint16_t i, asked;
+	struct TcpipMessage **replies = calloc(POOL_MAX_WORKERS, sizeof(struct TcpipMessage*));
+	if (replies == NULL) return NULL;
+	pthread_mutex_lock(&statsMutex);
+	struct TcpipMessage *request = statsRequest;
+	if ((request == NULL) || (round != statsRound)) {
+		pthread_mutex_unlock(&statsMutex);
+		free(replies);
+		return NULL;
+	}
+	statsRequest = NULL;
+	asked = statsAsked;
+	memcpy(replies, statsReplies, sizeof(statsReplies));
+	memset(statsReplies, 0, sizeof(statsReplies));
+	pthread_mutex_unlock(&statsMutex);
+	struct TcpipSocket *lsock_dest = tcpipbank_get(tmconf->mbus_id);
+	if (lsock_dest != NULL) reply_stats(lsock_dest, request, replies, asked);
+	for (i = 0; i < POOL_MAX_WORKERS; i++) {
+		if (replies[i] != NULL) freemsg(replies[i]);
+	}
+	free(replies);
+	freemsg(request);
+	return NULL;
+}
 
 static void *finalize(void *context) {
 	tprintf(LOG_NOTICE, __func__, "Finalize!");
+	stopPool();
 	//@todo messages to attached processes!
 	
 	//@todo free everything
@@ -487,37 +1066,62 @@ static void *finalize(void *context) {
 	return NULL;
 }
 
+/**
+ * The continuation of main, dispatched when finalize runs. It ends the process.
+ */
+static void *simulation_end(void *context) {
+	tprintf(LOG_NOTICE, __func__, "Simulation end");
+	ptreaty_free(elruntime->eosim);
+	closelog();
+	exit(0);
+	return NULL;
+}
+
 /**
  * The elinda engine starts evolution itself. It assumes that the m-bus is already
- * running. It generates some initial processes via the m-bus and waits conditionally
- * till an end-of-simulation message arrives over TCP/IP.
+ * running. It generates some initial processes via the m-bus and registers a continuation
+ * that ends the process when an end-of-simulation message arrives over TCP/IP. The main
+ * thread exits, so it does not wait for anything, the process lives on in the abbey.
  */
 int main() {
 	openlog ("elinda", LOG_CONS, LOG_LOCAL0);
 	initLog(LOG_INFO);
 //	initLog(LOG_BLABLA);
+	startLogThread();
+	linda_trace_init("elinda");
 	pthread_t this = pthread_self();
 	ptreaty_add_thread(&this, "Main");
 	tprintf(LOG_NOTICE, __func__, "Start Elinda");
 	initElinda();
-	startElinda();
+	if (!elconf->in_process) startElinda();
+	else initialize_abbey(elconf->monk_count, elconf->task_count);
 
 	tprintf(LOG_INFO, __func__, "Init and start evolution cycle");
 	configMutation();
 	initEvolution();
 	gsconf->genomeSize = 10000;
 	initAgents();
-	startEvolution();
-	
-	tprintf(LOG_INFO, __func__, "Init 0 task dispatched");
-	dispatch_poseta_task(init0, NULL, "Init 0");
+	initPool(inseminate);
+	if (!elconf->in_process && plconf == NULL && econf->population_size > 256) {
+		TPRINTF(LOG_WARNING, "Only 256 of the %u robots can be addressed over the m-bus, "
+				"see LINDA_POOL", econf->population_size);
+	}
+	initIslands();
+	elconf->generation_id = startEvolution();
+	if (elconf->precompile && !elconf->in_process) initBatch();
 
-	ptreaty_init_baton(elruntime->eosim);
-	ptreaty_hoist_flag(elruntime->eosim);
-	ptreaty_wait(elruntime->eosim);
-	tprintf(LOG_NOTICE, __func__, "Simulation end");
-	ptreaty_free(elruntime->eosim); 
-	closelog();
+	if (elconf->generation_id >= elconf->generation_count) {
+		dispatch_described_task(finalize, NULL, "finalize");
+	} else if (elconf->in_process) {
+		initBatch();
+		dispatch_described_task(evaluate_generation, NULL, "evaluate generation");
+	} else {
+		tprintf(LOG_INFO, __func__, "Init 0 task dispatched");
+		dispatch_poseta_task(init0, NULL, "Init 0");
+	}
+
+	ptreaty_on_run(elruntime->eosim, simulation_end, NULL, "simulation end");
+	pthread_exit(NULL);
 	return 0;
 }
 
@@ -21,6 +21,8 @@
 #include <agent.h>
 #include <stdio.h>
 #include <fitness.h>
+#include <archive.h>
+#include <island.h>
 
 #include <linda/log.h>
 
@@ -32,6 +34,22 @@
 void configEvolution() {
 	econf = malloc(sizeof(struct EvolutionConfig));
 	econf->population_size = 4;
+	econf->tournament_size = 0;
+	econf->generation = 0;
+	econf->archive = NULL;
+	unsigned int size;
+	//LINDA_POPULATION overrides the population size
+	const char *text = getenv("LINDA_POPULATION");
+	if ((text != NULL) && (sscanf(text, "%u", &size) == 1) && size) {
+		econf->population_size = size;
+	}
+	//with LINDA_STEADY_STATE set, evolution is steady-state, with tournaments of its value
+	text = getenv("LINDA_STEADY_STATE");
+	if (text != NULL) {
+		size = 2;
+		sscanf(text, "%u", &size);
+		econf->tournament_size = (size < 2) ? 2 : (size > 255) ? 255 : size;
+	}
 }
 
 /**
@@ -45,73 +63,176 @@ void initEvolution() {
 	initGenomes();
 }
 
+/**
+ * Continues from the last generation in the archive: its genomes and fitness values are
+ * put back, the random generator gets the seed it had, and evolution steps to the next
+ * generation, as it did when the archive was written.
+ */
+static void resumeEvolution() {
+	struct Archive *archive = econf->archive;
+	const struct ArchiveRecord *record;
+	uint32_t i;
+	record = getArchiveRecord(archive, archive->header->record_count - 1);
+	if (record == NULL) return;
+	for (i = 0; i < econf->population_size; i++) {
+		setGenome(aa[i].genome, getArchiveGenome(archive, record, i));
+		aa[i].fitness = getArchiveFitness(record)[i];
+	}
+	TPRINTF(LOG_NOTICE, "Resume after generation %i", record->generation);
+	srand(record->seed);
+	econf->generation = record->generation;
+	stepEvolution();
+}
+
 /**
  * Starts evolution by generating a series of genomes. They are coupled to agents and the agents
  * should be allocated beforehand and amount to the configured population_size over here.
+ * With LINDA_ARCHIVE set to a path, every evaluated generation is kept in that archive, and
+ * if there are generations in it already, evolution resumes after the last one. Returns the
+ * generation that is evaluated first.
  */
-void startEvolution() {
+uint32_t startEvolution() {
 	initFitnessModule();
-	char text[64]; sprintf(text, "Generate %i genomes", econf->population_size);
+	char text[64]; sprintf(text, "Generate %u genomes", econf->population_size);
 	tprintf(LOG_INFO, __func__, text); 
-	uint8_t i;
+	uint32_t i;
 	for (i = 0; i < econf->population_size; i++) {
 		aa[i].genome = generateGenome();
 		printGenomeSummary(aa[i].genome, LOG_NOTICE);
 	}
+	econf->generation = 0;
+	const char *path = getenv("LINDA_ARCHIVE");
+	if (path != NULL) {
+		econf->archive = openArchive(path, gsconf->genomeSize, econf->population_size, 1);
+		if (econf->archive != NULL && econf->archive->header->record_count) resumeEvolution();
+	}
+	return econf->generation;
+}
+
+/**
+ * Appends the generation that is evaluated to the archive, with a new seed for the random
+ * generator, so evolution can continue from it the same way later on. Should be called
+ * before stepEvolution.
+ */
+void checkpointEvolution() {
+	if (econf->archive == NULL) return;
+	uint32_t pages = (gsconf->genomeSize + GENOME_PAGE_SIZE - 1) / GENOME_PAGE_SIZE;
+	uint8_t *fitness = malloc(econf->population_size);
+	const uint8_t **genomes = malloc(econf->population_size * pages * sizeof(uint8_t*));
+	uint32_t i, j;
+	for (i = 0; i < econf->population_size; i++) {
+		fitness[i] = aa[i].fitness;
+		for (j = 0; j < pages; j++) {
+			genomes[i * pages + j] = peekGenome(aa[i].genome, j * GENOME_PAGE_SIZE);
+		}
+	}
+	uint32_t seed = rand();
+	srand(seed);
+	if (!appendArchive(econf->archive, econf->generation, seed, fitness, genomes,
+			GENOME_PAGE_SIZE)) {
+		TPRINTF(LOG_ERR, "Generation %i is not archived", econf->generation);
+	}
+	free(fitness);
+	free(genomes);
 }
 
 /**
- * Comparison function used by the qsort algorithm in applySelection. The function returns
- * a positive value if the value of a0 is LESS than the value of a1.
+ * Comparison function used by the qsort algorithm in applySelection, on the indices of the
+ * agents. The function returns a positive value if the fitness of agent a0 is LESS than the
+ * fitness of agent a1.
  */
 int compare_agent_fitness (const void *a0, const void *a1) {
-  const struct Agent* aa0 = (const struct Agent*) a0;
-  const struct Agent* aa1 = (const struct Agent*) a1;
+  const struct Agent* aa0 = &aa[*(const uint32_t*) a0];
+  const struct Agent* aa1 = &aa[*(const uint32_t*) a1];
   return (aa0->fitness < aa1->fitness) - (aa0->fitness > aa1->fitness);
 }
 
 /**
- * Sort the agents on fitness and replace non-fit genomes by the fittest ones.
+ * Sort the agents on fitness and replace non-fit genomes by the fittest ones. Only the
+ * indices of the agents are sorted, the agents keep their place and their id, so messages
+ * that are on their way for an agent still find it. Every agent that gets the genome of a
+ * survivor gets another survivor as mate, for crossover. Returns the mates of all agents,
+ * MUTATION_NO_MATE for the survivors, to be freed by the caller, or NULL.
  */
-void applySelection() {
+uint32_t *applySelection() {
 	if (fconf == NULL) {
-		tprintf(LOG_ERR, __func__, "Fitness module not initialized!"); return;	
+		tprintf(LOG_ERR, __func__, "Fitness module not initialized!"); return NULL;
 	}
 	
-	qsort(aa, econf->population_size, sizeof(struct Agent), compare_agent_fitness);
+	uint32_t *order = malloc(econf->population_size * sizeof(uint32_t));
+	uint32_t *mates = malloc(econf->population_size * sizeof(uint32_t));
+	uint32_t i;
+	for (i = 0; i < econf->population_size; i++) {
+		order[i] = i;
+		mates[i] = MUTATION_NO_MATE;
+	}
+	qsort(order, econf->population_size, sizeof(uint32_t), compare_agent_fitness);
 	tprintf(LOG_INFO, __func__, "Get survivors");
-	uint8_t i; char text[128];
-	uint8_t population_survivors = (econf->population_size * fconf->survival_percentage) / 100;
-	sprintf(text, "There are %i survivors", population_survivors);
-	tprintf(LOG_NOTICE, __func__, text);
+	uint32_t population_survivors = (econf->population_size * fconf->survival_percentage) / 100;
+	if (!population_survivors) population_survivors = 1;
+	TPRINTF(LOG_NOTICE, "There are %u survivors", population_survivors);
 	for (i = 0; i < econf->population_size; i++) {
-		char text2[128]; 
-		sprintf(text2, "Fitness of %i is %i", i, aa[i].fitness);
-		tprintf(LOG_NOTICE, __func__, text2); 
+		TPRINTF(LOG_VERBOSE, "Fitness of %u is %i", order[i], aa[order[i]].fitness);
 	}
 	for (i = population_survivors; i < econf->population_size; i++) {
-		uint8_t ancestor = rand() % population_survivors;
-		copyGenome(aa[ancestor].genome, aa[i].genome);
-	}
-	
-	//reorganize indices
-	for (i = 0; i < econf->population_size; i++) {
-		aa[i].id = i;
+		uint32_t ancestor = rand() % population_survivors;
+		uint32_t mate = rand() % population_survivors;
+		copyGenome(aa[order[ancestor]].genome, aa[order[i]].genome);
+		if (mate != ancestor) mates[order[i]] = order[mate];
 	}
+	free(order);
 
 	tprintf(LOG_INFO, __func__, "Agents procreated");
+	return mates;
+}
+
+/**
+ * One step of steady-state evolution, instead of a generation at once. A tournament is held
+ * between tournament_size agents that are evaluated, picked at random. The one with the
+ * lowest fitness gets a mutated copy of the genome of the one with the highest fitness, and
+ * has to be evaluated again. Agents that are still evaluated do not take part. Returns that
+ * agent, or NULL if less than two agents are evaluated.
+ */
+struct Agent *stepSteadyState() {
+	struct Agent *best = NULL, *worst = NULL, *la;
+	uint32_t count = countAgents(ELINDA_SIMSTATE_DONE), first = 0, index;
+	uint8_t i;
+	if (count < 2) return NULL;
+	for (i = 0; i < econf->tournament_size; i++) {
+		index = rand() % count;
+		la = getAgentInState(ELINDA_SIMSTATE_DONE, index);
+		if (la == NULL) continue;
+		if (best == NULL) first = index;
+		if (best == NULL || la->fitness > best->fitness) best = la;
+		if (worst == NULL || la->fitness < worst->fitness) worst = la;
+	}
+	//all of them are equally fit, or the same agent is picked every time
+	if (best == worst) worst = getAgentInState(ELINDA_SIMSTATE_DONE, (first + 1) % count);
+	if (best == NULL || worst == NULL || best == worst) return NULL;
+
+	//the mate for crossover is any other agent that is evaluated
+	la = getAgentInState(ELINDA_SIMSTATE_DONE, rand() % count);
+	TPRINTF(LOG_INFO, "Agent %u replaces agent %u", best->id, worst->id);
+	copyGenome(best->genome, worst->genome);
+	seedMutations(rand());
+	applyMutations(worst->id, (la == NULL || la == worst) ? MUTATION_NO_MATE : la->id);
+	worst->fitness = 0;
+	setSimulationState(worst, ELINDA_SIMSTATE_TODO);
+	return worst;
 }
 
 /**
  * Apply natural selection given the set of fitness values. Multiply the ones that come through
  * that natural selection filter. And step through all the genomes that remain with a mutation 
- * operator. 
+ * operator, on the monks, see mutatePopulation. On an island the migrants come in first, so
+ * they take part in the selection.
  */
 void stepEvolution() {
 	tprintf(LOG_INFO, __func__, "Step evolution");
-	uint8_t i;
-	applySelection();
-	for (i = 0; i < econf->population_size; i++) {
-		applyMutations(i);
-	}
+	exchangeMigrants();
+	uint32_t *mates = applySelection();
+	seedMutations(rand());
+	mutatePopulation(mates);
+	free(mates);
+	econf->generation++;
 }
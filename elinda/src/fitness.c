@@ -12,7 +12,7 @@ void initFitnessModule() {
 	fconf->survival_percentage = 50;
 }
 
-void addFitness(uint8_t id, uint8_t fitness) {
+void addFitness(uint32_t id, uint8_t fitness) {
 	struct Agent *la = getAgent(id);
 	if (la == NULL) return;
 	la->fitness = fitness;
@@ -8,8 +8,11 @@
 #include <stdlib.h>
 #include <time.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <linda/log.h>
+#include <linda/prng.h>
+#include <linda/buffer.h>
 
 /**
  * In the colinda engine the genome is also initialized. Be careful in testing cases and
@@ -22,7 +25,12 @@
 void initGenomes() {
 	gsconf = malloc(sizeof(struct GenomesConfig));
 	gsconf->genomeSize = 5000;
-	srand(time(NULL));
+	//LINDA_SEED makes a run repeatable, the mutations are seeded by rand() as well
+	unsigned int seed = time(NULL);
+	const char *text = getenv("LINDA_SEED");
+	if (text != NULL) sscanf(text, "%u", &seed);
+	srand(seed);
+	linda_random_seed_threads(seed);
 }
 
 /**
@@ -31,34 +39,65 @@ void initGenomes() {
  */
 void printGenomeSummary(struct RawGenome *g, uint8_t verbosity) {
 	tprintf(verbosity, __func__, "Genome start");
-	uint16_t i; char textV[128];
+	uint16_t i, j; char textV[128]; Codon c[10];
 
 	for (i = 0; i < 30; i+=10) {
+		for (j = 0; j < 10; j++) c[j] = *peekGenome(g, i + j);
 		sprintf(textV, "[%i, %i, %i, %i, %i, %i, %i, %i, %i, %i]", 
-				g->content[i+0], g->content[i+1], g->content[i+2], g->content[i+3], g->content[i+4], 
-				g->content[i+5], g->content[i+6], g->content[i+7], g->content[i+8], g->content[i+9]); 
+				c[0], c[1], c[2], c[3], c[4], c[5], c[6], c[7], c[8], c[9]);
 		tprintf(verbosity, __func__, textV);
 	}
 
 	tprintf(verbosity, __func__, "Genome end");
 	for (i = gsconf->genomeSize - 30; i < gsconf->genomeSize; i+=10) {
+		for (j = 0; j < 10; j++) c[j] = *peekGenome(g, i + j);
 		sprintf(textV, "[%i, %i, %i, %i, %i, %i, %i, %i, %i, %i]", 
-				g->content[i+0], g->content[i+1], g->content[i+2], g->content[i+3], g->content[i+4], 
-				g->content[i+5], g->content[i+6], g->content[i+7], g->content[i+8], g->content[i+9]); 
+				c[0], c[1], c[2], c[3], c[4], c[5], c[6], c[7], c[8], c[9]);
 		tprintf(verbosity, __func__, textV);
 	}	
 }
 
+/**
+ * A page of its own for the codons from the given position on, or NULL if there is no memory
+ * for it.
+ */
+static struct GenomePage *newGenomePage(uint32_t position) {
+	struct GenomePage *page = malloc(sizeof(struct GenomePage) + genomePageLength(position));
+	if (page != NULL) page->refs = 1;
+	return page;
+}
+
+static void releaseGenomePage(struct GenomePage *page) {
+	if (page != NULL && __sync_sub_and_fetch(&page->refs, 1) == 0) free(page);
+}
+
+/**
+ * A genome with pages of its own, that are not initialized.
+ */
+static struct RawGenome *newGenome() {
+	struct RawGenome *ldna = calloc(1, sizeof(struct RawGenome));
+	uint32_t position;
+	for (position = 0; position < gsconf->genomeSize; position += GENOME_PAGE_SIZE) {
+		ldna->pages[position / GENOME_PAGE_SIZE] = newGenomePage(position);
+	}
+	return ldna;
+}
+
+uint16_t genomePageLength(uint32_t position) {
+	uint32_t first = position - position % GENOME_PAGE_SIZE;
+	return (gsconf->genomeSize - first < GENOME_PAGE_SIZE) ? gsconf->genomeSize - first :
+			GENOME_PAGE_SIZE;
+}
+
 /**
  * The random genome can be used as a seed. Subsequent genomes should be formed by manipulating
  * the genomes of previous generations, or be load from a file.
  */
 struct RawGenome *generateRandomGenome() {
-	struct RawGenome *ldna = malloc(sizeof(struct RawGenome));
-	ldna->content = malloc(gsconf->genomeSize * sizeof(Codon));
+	struct RawGenome *ldna = newGenome();
 	uint16_t i;
 	for (i = 0; i < gsconf->genomeSize; i++) { 
-		ldna->content[i] = rand();
+		*touchGenome(ldna, i) = rand();
 	}
 	return ldna;	
 }
@@ -71,18 +110,17 @@ struct RawGenome *generateRandomGenome() {
  * processes.
  */
 struct RawGenome *generateTestGenome() {
-	struct RawGenome *ldna = malloc(sizeof(struct RawGenome));
-	ldna->content = calloc(gsconf->genomeSize, sizeof(Codon));
+	struct RawGenome *ldna = newGenome();
 	uint16_t i;
 	for (i = 0; i < gsconf->genomeSize; i++) { 
-		ldna->content[i] = i / 2;
+		*touchGenome(ldna, i) = i / 2;
 	}
 	return ldna;
 }
 
 /**
  * A genome is generated and needs to be added to the agent, if it is gonna to be used. It
- * is also possible to use generateGenomeFor(uint8_t id).  
+ * is also possible to use generateGenomeFor(uint32_t id).  
  */
 struct RawGenome *generateGenome() {
 	//	return generateTestGenome();
@@ -90,14 +128,100 @@ struct RawGenome *generateGenome() {
 }
 
 /**
- * Assumes both structs are already allocated, as well as their content array of Codons,
- * which is both assumed to be the size of gsconf->genomeSize.
+ * Both genomes are assumed to be allocated. The pages of the target are released, the ones
+ * of the source are shared. A page that is released by the last genome that shares it, is
+ * freed.
  */
 void copyGenome(struct RawGenome *src, struct RawGenome *target) {
-	uint16_t i;
-	for (i = 0; i < gsconf->genomeSize; i++) { 
-		target->content[i] = src->content[i];
-	}		
+	copyGenomeRange(src, target, 0, gsconf->genomeSize);
+}
+
+void copyGenomeRange(const struct RawGenome *src, struct RawGenome *target, uint32_t first,
+		uint32_t last) {
+	while (first < last) {
+		uint16_t page = first / GENOME_PAGE_SIZE, offset = first % GENOME_PAGE_SIZE;
+		uint32_t length = genomePageLength(first) - offset;
+		if (length > last - first) length = last - first;
+		if (src->pages[page] == target->pages[page]) {
+		} else if (length == genomePageLength(first)) {
+			__sync_add_and_fetch(&src->pages[page]->refs, 1);
+			releaseGenomePage(target->pages[page]);
+			target->pages[page] = src->pages[page];
+		} else {
+			memcpy(touchGenome(target, first), peekGenome(src, first), length);
+		}
+		first += length;
+	}
+}
+
+struct RawGenome *cloneGenome(const struct RawGenome *src) {
+	struct RawGenome *ldna = calloc(1, sizeof(struct RawGenome));
+	uint16_t page;
+	for (page = 0; page < GENOME_PAGES; page++) {
+		if (src->pages[page] != NULL) __sync_add_and_fetch(&src->pages[page]->refs, 1);
+		ldna->pages[page] = src->pages[page];
+	}
+	return ldna;
+}
+
+void freeGenome(struct RawGenome *genome) {
+	uint16_t page;
+	if (genome == NULL) return;
+	for (page = 0; page < GENOME_PAGES; page++) releaseGenomePage(genome->pages[page]);
+	free(genome);
+}
+
+const Codon *peekGenome(const struct RawGenome *genome, uint32_t position) {
+	return &genome->pages[position / GENOME_PAGE_SIZE]->codons[position % GENOME_PAGE_SIZE];
+}
+
+/**
+ * Pages are shared between agents that are mutated on different monks at the same time, so
+ * the count of the page that is left is decremented atomically. Two genomes that touch the
+ * same shared page at the same time may both copy it, the last one frees the page then.
+ */
+Codon *touchGenome(struct RawGenome *genome, uint32_t position) {
+	struct GenomePage **page = &genome->pages[position / GENOME_PAGE_SIZE];
+	if ((*page)->refs > 1) {
+		struct GenomePage *copy = newGenomePage(position);
+		memcpy(copy->codons, (*page)->codons, genomePageLength(position));
+		releaseGenomePage(*page);
+		*page = copy;
+	}
+	return &(*page)->codons[position % GENOME_PAGE_SIZE];
+}
+
+void readGenomeCodons(const struct RawGenome *genome, uint32_t position, uint32_t length,
+		Codon *buffer) {
+	while (length) {
+		uint32_t size = genomePageLength(position) - position % GENOME_PAGE_SIZE;
+		if (size > length) size = length;
+		memcpy(buffer, peekGenome(genome, position), size);
+		buffer += size;
+		position += size;
+		length -= size;
+	}
+}
+
+Codon *flattenGenome(const struct RawGenome *genome, Codon *buffer) {
+	readGenomeCodons(genome, 0, gsconf->genomeSize, buffer);
+	return buffer;
+}
+
+void setGenome(struct RawGenome *genome, const Codon *buffer) {
+	uint32_t position;
+	for (position = 0; position < gsconf->genomeSize; position += GENOME_PAGE_SIZE) {
+		memcpy(touchGenome(genome, position), buffer + position, genomePageLength(position));
+	}
+}
+
+uint32_t hashGenome(const struct RawGenome *genome) {
+	uint32_t hash = LINDA_BUFFER_HASH_START, position;
+	for (position = 0; position < gsconf->genomeSize; position += GENOME_PAGE_SIZE) {
+		hash = linda_buffer_hash_more(hash, peekGenome(genome, position),
+				genomePageLength(position));
+	}
+	return hash;
 }
 
 /**
@@ -108,7 +232,7 @@ void printGenome(struct RawGenome *genome) {
 	uint16_t i, line_size = 16;
 	for (i = 0; i < gsconf->genomeSize; i++) {
 		if (!(i % line_size)) printf("\n%3i: ", i);
-		printf("%3i", genome->content[i]);
+		printf("%3i", *peekGenome(genome, i));
 		if (((i + 1) % line_size) && (i+1 != gsconf->genomeSize)) printf(", ");
 	}
 }
@@ -0,0 +1,320 @@
+/**
+ * @file island.c
+ *
+ * The parts of a migrant can come in between the parts of another one, because the migrants
+ * are sent by different tasks, so a few migrants are put together at the same time, by their
+ * hash. A migrant that is complete moves to the arrivals, where it waits for
+ * exchangeMigrants. If there is no room, the oldest one that is put together is dropped, and
+ * arrivals beyond ISLAND_ARRIVALS are dropped too: a migrant is not worth waiting for.
+ *
+ * @date_created    Oct 14, 2026
+ * @date_modified   Oct 14, 2026
+ * @author          Anne C. van Rossum
+ * @project         Replicator
+ * @company         Almende B.V.
+ * @license         open-source, GNU Lesser General Public License
+ */
+
+#include <island.h>
+#include <evolution.h>
+#include <genomes.h>
+#include <agent.h>
+#include <tcpipmsg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include <linda/tcpip.h>
+#include <linda/tcpipbank.h>
+#include <linda/abbey.h>
+#include <linda/buffer.h>
+#include <linda/prng.h>
+#include <linda/log.h>
+
+/****************************************************************************************************
+ *  		Declarations
+ ***************************************************************************************************/
+
+/**
+ * A migrant that is put together, or that arrived when all its parts are received.
+ */
+struct Migrant {
+	uint32_t hash;
+	uint8_t island;
+	uint8_t fitness;
+	uint16_t part_count;
+	uint16_t part_received;
+	uint8_t *received;
+	Codon *codons;
+};
+
+static struct Migrant pending[ISLAND_PENDING];
+static uint8_t pendingNext = 0;
+static struct Migrant arrivals[ISLAND_ARRIVALS];
+static uint8_t arrivalCount = 0;
+static pthread_mutex_t migrantMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static volatile uint8_t connected[ISLAND_MAX_LINKS];
+
+/****************************************************************************************************
+ *  		Implementations
+ ***************************************************************************************************/
+
+static void freeMigrant(struct Migrant *migrant) {
+	free(migrant->received);
+	free(migrant->codons);
+	memset(migrant, 0, sizeof(struct Migrant));
+}
+
+static void *island_hostess(void *context) {
+	struct TcpipSocket *lsock = (struct TcpipSocket*)context;
+	struct TcpipMessage *msg = pop(lsock->inbox);
+	if (msg == NULL) return NULL;
+	if (msg->payload[0] == LINDA_MIGRANT_MSG) {
+		receiveMigrant(msg);
+		return NULL;
+	}
+	tprintf(LOG_WARNING, __func__, "Unrecognized message from an island!");
+	freemsg(msg);
+	return NULL;
+}
+
+/**
+ * Migrants are only sent over links that are connected, the others have no descriptor yet
+ * or a closed one.
+ */
+static void *island_connected(void *context) {
+	uint8_t i;
+	for (i = 0; i < ilconf->link_count; i++) {
+		if (ilconf->links[i] == context) connected[i] = 1;
+	}
+	tprintf(LOG_INFO, __func__, "Linked to a neighbour island");
+	return NULL;
+}
+
+/**
+ * Called by tcpip.c before the link is started again, so it does not undo a new connection.
+ */
+static void *island_lost(void *context) {
+	uint8_t i;
+	for (i = 0; i < ilconf->link_count; i++) {
+		if (ilconf->links[i] == context) connected[i] = 0;
+	}
+	return NULL;
+}
+
+/**
+ * A link to a neighbour, that connects to host if it is not NULL, and else waits for the
+ * neighbour on the port. The neighbour is an elinda too, so it is greeted with a hello.
+ */
+static void addLink(const char *host, int port) {
+	if (ilconf->link_count == ISLAND_MAX_LINKS) {
+		tprintf(LOG_WARNING, __func__, "Too many neighbour islands");
+		return;
+	}
+	struct TcpipSocket *lsock = tcpip_get((host == NULL) | TCPIP_CHANNEL_HELLO);
+	lsock->port_nr = port;
+	if (host != NULL && !inet_aton(host, &lsock->serv_addr.sin_addr)) {
+		TPRINTF(LOG_WARNING, "Invalid address of neighbour island %s", host);
+		tcpip_free(lsock);
+		return;
+	}
+	lsock->trials = ISLAND_CONNECT_TRIALS;
+	lsock->callbackIn = island_hostess;
+	lsock->callbackConnect = island_connected;
+	lsock->callbackLost = island_lost;
+	if (tcpipbank_add(lsock, ISLAND_SOCKET_ID + ilconf->link_count)) {
+		tcpip_free(lsock);
+		return;
+	}
+	ilconf->links[ilconf->link_count++] = lsock;
+	dispatch_described_task(tcpip_start, (void*)lsock, "start island link");
+}
+
+void initIslands() {
+	const char *text = getenv("LINDA_ISLAND");
+	unsigned int id, interval = 5, count = 2, port;
+	char policy[16] = "best", host[64];
+	ilconf = NULL;
+	if (text == NULL || sscanf(text, "%u", &id) != 1) return;
+	ilconf = calloc(1, sizeof(struct IslandConfig));
+	ilconf->id = id;
+	text = getenv("LINDA_MIGRATION");
+	if (text != NULL) sscanf(text, "%u,%u,%15s", &interval, &count, policy);
+	ilconf->interval = interval ? interval : 1;
+	ilconf->count = count;
+	ilconf->policy = strcmp(policy, "random") ? ISLAND_POLICY_BEST : ISLAND_POLICY_RANDOM;
+
+	text = getenv("LINDA_ISLAND_PORTS");
+	while (text != NULL && sscanf(text, "%u", &port) == 1) {
+		addLink(NULL, port);
+		text = strchr(text, ',');
+		if (text != NULL) text++;
+	}
+	text = getenv("LINDA_ISLAND_PEERS");
+	while (text != NULL && sscanf(text, "%63[^:]:%u", host, &port) == 2) {
+		addLink(host, port);
+		text = strchr(text, ',');
+		if (text != NULL) text++;
+	}
+	TPRINTF(LOG_NOTICE, "Island %i with %i neighbours sends %i migrants every %i generations",
+			ilconf->id, ilconf->link_count, ilconf->count, ilconf->interval);
+}
+
+/**
+ * The migrant with the given hash from the given island that is put together, or a new one.
+ */
+static struct Migrant *getPending(uint8_t island, uint32_t hash, uint16_t partCount) {
+	uint8_t i;
+	struct Migrant *migrant;
+	for (i = 0; i < ISLAND_PENDING; i++) {
+		migrant = &pending[i];
+		if (migrant->codons != NULL && migrant->hash == hash && migrant->island == island &&
+				migrant->part_count == partCount) return migrant;
+	}
+	migrant = &pending[pendingNext];
+	pendingNext = (pendingNext + 1) % ISLAND_PENDING;
+	freeMigrant(migrant);
+	migrant->codons = malloc(gsconf->genomeSize);
+	migrant->received = calloc((partCount + 7) / 8, 1);
+	if (migrant->codons == NULL || migrant->received == NULL) {
+		freeMigrant(migrant);
+		return NULL;
+	}
+	migrant->hash = hash;
+	migrant->island = island;
+	migrant->part_count = partCount;
+	return migrant;
+}
+
+/**
+ * Parts of another genome size, or of which the hash does not match once they are all
+ * there, are dropped.
+ */
+void receiveMigrant(struct TcpipMessage *msg) {
+	uint8_t header = LINDA_MIGRANT_HEADER;
+	struct Migrant *migrant;
+	if (ilconf == NULL || msg->size < header) goto receive_finish;
+	uint32_t hash = (msg->payload[4] << 24) | (msg->payload[5] << 16) |
+			(msg->payload[6] << 8) | msg->payload[7];
+	uint16_t partId = (msg->payload[9] << 8) | msg->payload[10];
+	uint16_t partCount = (msg->payload[11] << 8) | msg->payload[12];
+	uint16_t size = (msg->payload[13] << 8) | msg->payload[14];
+	if (size != gsconf->genomeSize || !partCount || partId >= partCount) goto receive_finish;
+	int partSize = (size + partCount - 1) / partCount;
+	int offset = partSize * partId;
+	int length = (size - offset < partSize) ? size - offset : partSize;
+	if (offset >= size || msg->size != header + length) goto receive_finish;
+
+	pthread_mutex_lock(&migrantMutex);
+	migrant = getPending(msg->payload[3], hash, partCount);
+	if (migrant == NULL || (migrant->received[partId / 8] & (1 << (partId % 8)))) {
+		pthread_mutex_unlock(&migrantMutex);
+		goto receive_finish;
+	}
+	memcpy(migrant->codons + offset, &msg->payload[header], length);
+	migrant->received[partId / 8] |= 1 << (partId % 8);
+	migrant->fitness = msg->payload[8];
+	if (++migrant->part_received == partCount) {
+		if (linda_buffer_hash(migrant->codons, size) != hash) {
+			TPRINTF(LOG_WARNING, "Migrant %08x from island %i is damaged", hash, migrant->island);
+			freeMigrant(migrant);
+		} else if (arrivalCount == ISLAND_ARRIVALS) {
+			freeMigrant(migrant);
+		} else {
+			arrivals[arrivalCount++] = *migrant;
+			memset(migrant, 0, sizeof(struct Migrant));
+		}
+	}
+	pthread_mutex_unlock(&migrantMutex);
+receive_finish:
+	freemsg(msg);
+}
+
+/**
+ * Sends the genome of the agent to all neighbours that are connected, in as many parts as
+ * the link needs.
+ */
+static void emigrate(struct Agent *la) {
+	uint32_t hash = hashGenome(la->genome);
+	uint16_t partId, partCount;
+	uint8_t i;
+	for (i = 0; i < ilconf->link_count; i++) {
+		struct TcpipSocket *lsock = ilconf->links[i];
+		if (!connected[i]) continue;
+		partCount = migrantParts(tcpip_max_message_size(lsock));
+		for (partId = 0; partId < partCount; partId++) {
+			push(lsock->outbox, createMigrantMessage(ilconf->id, la->genome, hash, la->fitness,
+					partId, partCount));
+		}
+		tcpip_flush(lsock);
+	}
+}
+
+/**
+ * The fittest agents, or agents at random, are picked by going through the population once
+ * for every migrant, as there are only a few of them. An agent is sent only once a round.
+ */
+static void emigrateAll() {
+	uint8_t *sent = calloc(econf->population_size, 1), k;
+	uint32_t i, best, skip;
+	if (sent == NULL) return;
+	for (k = 0; k < ilconf->count && k < econf->population_size; k++) {
+		if (ilconf->policy == ISLAND_POLICY_RANDOM) {
+			//skip that many of the agents that are not sent yet
+			skip = linda_random_below(linda_random_thread(), econf->population_size - k);
+			for (best = UINT32_MAX, i = 0; best == UINT32_MAX; i++) {
+				if (!sent[i] && !skip--) best = i;
+			}
+		} else {
+			for (best = UINT32_MAX, i = 0; i < econf->population_size; i++) {
+				if (sent[i]) continue;
+				if (best == UINT32_MAX || aa[i].fitness > aa[best].fitness) best = i;
+			}
+		}
+		sent[best] = 1;
+		emigrate(&aa[best]);
+	}
+	free(sent);
+}
+
+/**
+ * Every migrant replaces the least fit agent that is evaluated and that is not replaced by
+ * another migrant already.
+ */
+static void immigrateAll() {
+	struct Migrant migrants[ISLAND_ARRIVALS];
+	uint8_t count, k;
+	uint32_t i, worst;
+	pthread_mutex_lock(&migrantMutex);
+	count = arrivalCount;
+	memcpy(migrants, arrivals, count * sizeof(struct Migrant));
+	arrivalCount = 0;
+	pthread_mutex_unlock(&migrantMutex);
+	if (!count) return;
+
+	uint8_t *replaced = calloc(econf->population_size, 1);
+	for (k = 0; k < count; k++) {
+		for (worst = UINT32_MAX, i = 0; replaced != NULL && i < econf->population_size; i++) {
+			if (replaced[i] || aa[i].elinda.simulation_state != ELINDA_SIMSTATE_DONE) continue;
+			if (worst == UINT32_MAX || aa[i].fitness < aa[worst].fitness) worst = i;
+		}
+		if (worst != UINT32_MAX && aa[worst].fitness < migrants[k].fitness) {
+			TPRINTF(LOG_INFO, "Migrant %08x from island %i replaces agent %u",
+					migrants[k].hash, migrants[k].island, worst);
+			setGenome(aa[worst].genome, migrants[k].codons);
+			aa[worst].fitness = migrants[k].fitness;
+			replaced[worst] = 1;
+		}
+		freeMigrant(&migrants[k]);
+	}
+	free(replaced);
+}
+
+void exchangeMigrants() {
+	if (ilconf == NULL) return;
+	immigrateAll();
+	if (!(econf->generation % ilconf->interval)) emigrateAll();
+}
@@ -4,32 +4,179 @@
 
 #include <mutation.h>
 #include <genomes.h>
-#include <time.h>
 #include <stdlib.h>
 #include <agent.h>
+#include <evolution.h>
 #include <stdio.h>
 
 #include <linda/bits.h>
 #include <linda/log.h>
+#include <linda/prng.h>
+#include <linda/abbey.h>
 
+//! The amount of agents that one task mutates
+#define MUTATION_CHUNK		64
+
+/**
+ * The agents from first up to last that one task mutates, in one of the two phases of
+ * mutatePopulation.
+ */
+struct MutationChunk {
+	uint32_t first;
+	uint32_t last;
+	const uint32_t *mates;
+	uint8_t crossed;
+};
+
+/**
+ * The rates give about as many point mutations as the 100 there used to be for every genome,
+ * for genomes of 10000 codons. Crossover is off by default.
+ */
 void configMutation() {
 	mconf = malloc(sizeof(struct MutationConfig));
-	mconf->mutation_count = 100;
+	mconf->operator_count = 0;
+	mconf->seed = 0;
+	float bitRate = 0.00125, codonRate = 0, crossoverRate = 0;
+	const char *text = getenv("LINDA_MUTATION");
+	if (text != NULL) sscanf(text, "%f,%f,%f", &bitRate, &codonRate, &crossoverRate);
+	addMutationOperator(crossGenomes, crossoverRate);
+	addMutationOperator(flipBits, bitRate);
+	addMutationOperator(substituteCodons, codonRate);
+}
+
+uint8_t addMutationOperator(MutationOperator op, float rate) {
+	if (mconf->operator_count == MUTATION_MAX_OPERATORS) return 0;
+	mconf->operators[mconf->operator_count] = op;
+	mconf->rates[mconf->operator_count] = rate;
+	mconf->operator_count++;
+	return 1;
+}
+
+/**
+ * Should be given a new seed before every round of mutations, drawn from rand() that is
+ * seeded by initGenomes, or by checkpointEvolution, so the mutations can be repeated.
+ */
+void seedMutations(uint32_t seed) {
+	mconf->seed = seed;
+}
+
+/**
+ * Point mutations, the gaps between the bits that are flipped are drawn from the geometric
+ * distribution, so a genome of thousands of codons takes a draw per mutation, not per bit.
+ * Only the pages with a mutation are copied, if they are shared.
+ */
+void flipBits(struct RawGenome *genome, const struct RawGenome *mate, float rate,
+		struct LindaRandom *random) {
+	uint32_t bits = gsconf->genomeSize * 8;
+	uint32_t position = linda_random_geometric(random, rate);
+	while (position < bits) {
+		TOGGLE(*touchGenome(genome, position >> 3), position & 7);
+		uint32_t gap = linda_random_geometric(random, rate);
+		if (gap >= bits) break;
+		position += gap + 1;
+	}
+}
+
+/**
+ * Replaces codons by random ones, the new codon can be the old one by chance.
+ */
+void substituteCodons(struct RawGenome *genome, const struct RawGenome *mate, float rate,
+		struct LindaRandom *random) {
+	uint32_t position = linda_random_geometric(random, rate);
+	while (position < gsconf->genomeSize) {
+		*touchGenome(genome, position) = linda_random_next(random) >> 56;
+		uint32_t gap = linda_random_geometric(random, rate);
+		if (gap >= gsconf->genomeSize) break;
+		position += gap + 1;
+	}
 }
 
 /**
- * Applies a series of mutations, for now just point mutations.
+ * Two-point crossover, the codons from one random point up to another are those of the mate.
+ * The pages in between are shared with the mate, rather than copied.
  */
-void applyMutations(uint8_t id) {
+void crossGenomes(struct RawGenome *genome, const struct RawGenome *mate, float rate,
+		struct LindaRandom *random) {
+	if (mate == NULL || linda_random_unit(random) > rate) return;
+	uint32_t first = linda_random_below(random, gsconf->genomeSize);
+	uint32_t last = linda_random_below(random, gsconf->genomeSize);
+	if (first > last) { uint32_t swap = first; first = last; last = swap; }
+	copyGenomeRange(mate, genome, first, last);
+}
+
+/**
+ * Applies the operators one after the other, with a stream of random numbers of this agent.
+ */
+void applyMutations(uint32_t id, uint32_t mate) {
 	tprintf(LOG_VERBOSE, __func__, "Mutate genome");
 	struct Agent *la = getAgent(id);
-	srand(time(NULL)); uint8_t i;
-	for (i = 0; i < mconf->mutation_count; i++) {
-		uint8_t position = rand() % gsconf->genomeSize;
-		uint8_t bit = rand() % 8;
-//		printf("Switch genome at position %i from %i", position, 
-//				la->genome->content[position]);
-		TOGGLE(la->genome->content[position], bit);
-//		printf(" to %i\n", la->genome->content[position]);
+	struct RawGenome *mateGenome = NULL;
+	struct LindaRandom random;
+	uint8_t i;
+	if (la == NULL) return;
+	if (mate != MUTATION_NO_MATE && getAgent(mate) != NULL) mateGenome = getAgent(mate)->genome;
+	linda_random_seed(&random, mconf->seed, id);
+	for (i = 0; i < mconf->operator_count; i++) {
+		if (mconf->rates[i] <= 0) continue;
+		mconf->operators[i](la->genome, mateGenome, mconf->rates[i], &random);
+	}
+}
+
+static void *mutateChunk(void *context) {
+	struct MutationChunk *chunk = (struct MutationChunk*)context;
+	uint32_t i;
+	for (i = chunk->first; i < chunk->last; i++) {
+		uint32_t mate = (chunk->mates == NULL) ? MUTATION_NO_MATE : chunk->mates[i];
+		if ((mate != MUTATION_NO_MATE) != chunk->crossed) continue;
+		applyMutations(i, mate);
+	}
+	return NULL;
+}
+
+/**
+ * The population is cut in chunks, which are dispatched to the monks, except for the first,
+ * which is done by the caller. A chunk that can not be dispatched is done by the caller too,
+ * as is the whole population if there is no memory for the chunks.
+ * The agents that are crossed read the genomes of their mates, so they are all done before
+ * the mates are mutated themselves.
+ */
+void mutatePopulation(const uint32_t *mates) {
+	uint32_t count = (econf->population_size + MUTATION_CHUNK - 1) / MUTATION_CHUNK, i;
+	if (!count) return;
+	struct MutationChunk single, *chunks = malloc(count * sizeof(struct MutationChunk));
+	struct AbbeyHandle **handles = malloc(count * sizeof(struct AbbeyHandle*));
+	uint8_t crossed;
+	if ((chunks == NULL) || (handles == NULL)) {
+		//without memory for the chunks, the caller does the population in one
+		free(chunks);
+		free(handles);
+		chunks = &single;
+		handles = NULL;
+		count = 1;
+	}
+	for (i = 0; i < count; i++) {
+		chunks[i].first = i * MUTATION_CHUNK;
+		chunks[i].last = (count == 1) ? econf->population_size : chunks[i].first + MUTATION_CHUNK;
+		if (chunks[i].last > econf->population_size) chunks[i].last = econf->population_size;
+		chunks[i].mates = mates;
+	}
+	for (crossed = (mates != NULL); ; crossed = 0) {
+		for (i = 0; i < count; i++) chunks[i].crossed = crossed;
+		for (i = 1; i < count; i++) {
+			handles[i] = dispatch_joinable_task(mutateChunk, &chunks[i], "mutate agents",
+					ABBEY_PRIORITY_BULK);
+		}
+		mutateChunk(&chunks[0]);
+		for (i = 1; i < count; i++) {
+			if (handles[i] == NULL) {
+				mutateChunk(&chunks[i]);
+				continue;
+			}
+			abbey_join(handles[i]);
+			abbey_release_handle(handles[i]);
+		}
+		if (!crossed) break;
 	}
+	free(handles);
+	if (chunks != &single) free(chunks);
 }
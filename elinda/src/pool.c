@@ -0,0 +1,286 @@
+/**
+ * @file pool.c
+ *
+ * The workers are only touched with the pool lock, also to look up the agent of a process,
+ * because a worker goes to another agent, and gets another id, under that lock. Messages
+ * are pushed with it too, so the reset of a worker is in the outbox before the worker goes
+ * to the next agent, but they are flushed, and the genome of that agent is sent, only when
+ * the lock is released.
+ *
+ * @date_created    Oct 14, 2026
+ * @date_modified   Oct 14, 2026
+ * @author          Anne C. van Rossum
+ * @project         Replicator
+ * @company         Almende B.V.
+ * @license         open-source, GNU Lesser General Public License
+ */
+
+#include <pool.h>
+#include <elinda.h>
+#include <evolution.h>
+#include <genomes.h>
+#include <agent.h>
+#include <tcpipmsg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include <linda/tcpip.h>
+#include <linda/tcpipbank.h>
+#include <linda/abbey.h>
+#include <linda/infocontainer.h>
+#include <linda/slab.h>
+#include <linda/log.h>
+
+/****************************************************************************************************
+ *  		Declarations
+ ***************************************************************************************************/
+
+static pthread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/****************************************************************************************************
+ *  		Implementations
+ ***************************************************************************************************/
+
+void initPool(void *(*lease)(void*)) {
+	const char *text = getenv("LINDA_POOL");
+	unsigned int size;
+	uint32_t i;
+	plconf = NULL;
+	for (i = 0; i < econf->population_size; i++) aa[i].elinda.worker = POOL_NO_WORKER;
+	if (text == NULL || sscanf(text, "%u", &size) != 1 || !size) return;
+	if (size > POOL_MAX_PROCESSES) {
+		TPRINTF(LOG_WARNING, "Only %i of the %u workers can be addressed over the m-bus",
+				POOL_MAX_PROCESSES, size);
+		size = POOL_MAX_PROCESSES;
+	}
+	plconf = calloc(1, sizeof(struct PoolConfig));
+	plconf->waiting = malloc(econf->population_size * sizeof(uint32_t));
+	if (plconf->waiting == NULL) {
+		free(plconf);
+		plconf = NULL;
+		return;
+	}
+	plconf->size = size;
+	plconf->lease = lease;
+	for (i = 0; i < size; i++) {
+		plconf->workers[i].agent = POOL_NO_AGENT;
+		plconf->workers[i].process = i;
+		plconf->worker_of[i] = i;
+	}
+	plconf->next_process = size;
+	TPRINTF(LOG_NOTICE, "A pool of %i Colinda processes for %u agents", size,
+			econf->population_size);
+}
+
+/**
+ * Asks the m-bus for a channel to the worker and to start it. Must be called with the pool
+ * lock.
+ */
+static void spawnWorker(uint16_t id, struct TcpipSocket *lsock_dest) {
+	struct PoolWorker *w = &plconf->workers[id];
+	push(lsock_dest->outbox, createConnectColindaMessage(w->process));
+	push(lsock_dest->outbox, createRunColindaMessage(w->process));
+	w->state = POOL_WORKER_STARTING;
+	w->started = time(NULL);
+}
+
+/**
+ * The process of the worker did not come up in time, but may still do so, so it is not
+ * started again under the same id. Returns 0 if there is no fresh id left. Must be called
+ * with the pool lock.
+ */
+static uint8_t retireProcess(uint16_t id) {
+	struct PoolWorker *w = &plconf->workers[id];
+	if (plconf->next_process >= POOL_MAX_PROCESSES) return 0;
+	TPRINTF(LOG_WARNING, "Worker %i did not come up as process %i, it gets id %i", id,
+			w->process, plconf->next_process);
+	plconf->worker_of[w->process] = POOL_NO_WORKER;
+	w->process = plconf->next_process++;
+	plconf->worker_of[w->process] = id;
+	return 1;
+}
+
+/**
+ * Starts the workers that never started, or that did not tell they are alive in time.
+ */
+static void topUp() {
+	struct TcpipSocket *lsock_dest = tcpipbank_get(tmconf->mbus_id);
+	uint16_t i, n = 0;
+	time_t now = time(NULL);
+	if (lsock_dest == NULL) return;
+	pthread_mutex_lock(&poolMutex);
+	for (i = 0; i < plconf->size; i++) {
+		struct PoolWorker *w = &plconf->workers[i];
+		if (w->state == POOL_WORKER_STARTING && now - w->started > POOL_START_TIMEOUT) {
+			if (!retireProcess(i)) continue;
+		} else if (w->state != POOL_WORKER_DEFAULT) {
+			continue;
+		}
+		spawnWorker(i, lsock_dest);
+		n++;
+	}
+	pthread_mutex_unlock(&poolMutex);
+	if (!n) return;
+	tcpip_flush(lsock_dest);
+	TPRINTF(LOG_INFO, "Started %i workers of the pool", n);
+}
+
+static void *pool_topup(void *context) {
+	topUp();
+	return NULL;
+}
+
+void startPool() {
+	if (plconf == NULL) return;
+	topUp();
+	plconf->topup = dispatch_periodic_task(pool_topup, NULL, "top up pool", POOL_TOPUP_PERIOD);
+	if (plconf->topup == NULL) {
+		tprintf(LOG_WARNING, __func__, "Workers that do not start will not be started again");
+	}
+}
+
+void stopPool() {
+	if (plconf == NULL || plconf->topup == NULL) return;
+	abbey_cancel_timer(plconf->topup);
+	plconf->topup = NULL;
+}
+
+uint32_t processOf(struct Agent *la) {
+	uint32_t process = POOL_NO_WORKER;
+	if (plconf == NULL) return la->id;
+	pthread_mutex_lock(&poolMutex);
+	if (la->elinda.worker < plconf->size) process = plconf->workers[la->elinda.worker].process;
+	pthread_mutex_unlock(&poolMutex);
+	return process;
+}
+
+/**
+ * The worker with the process id, or POOL_NO_WORKER. Must be called with the pool lock.
+ */
+static uint16_t workerOf(uint32_t process) {
+	if (process >= plconf->next_process) return POOL_NO_WORKER;
+	return plconf->worker_of[process];
+}
+
+struct Agent *agentOfProcess(uint32_t process) {
+	uint32_t agent = POOL_NO_AGENT;
+	if (plconf == NULL) return getAgent(process);
+	pthread_mutex_lock(&poolMutex);
+	uint16_t id = workerOf(process);
+	if (id != POOL_NO_WORKER) agent = plconf->workers[id].agent;
+	pthread_mutex_unlock(&poolMutex);
+	return (agent == POOL_NO_AGENT) ? NULL : getAgent(agent);
+}
+
+uint16_t runningWorkers(uint8_t *ids) {
+	uint16_t i, n = 0;
+	pthread_mutex_lock(&poolMutex);
+	for (i = 0; i < plconf->size; i++) {
+		uint8_t state = plconf->workers[i].state;
+		if ((state == POOL_WORKER_IDLE) || (state == POOL_WORKER_LEASED))
+			ids[n++] = plconf->workers[i].process;
+	}
+	pthread_mutex_unlock(&poolMutex);
+	return n;
+}
+
+/**
+ * The genome that is sent last to the worker goes with it to the agent. Must be called with
+ * the pool lock.
+ */
+static void lend(uint16_t id, struct Agent *la) {
+	struct PoolWorker *w = &plconf->workers[id];
+	w->state = POOL_WORKER_LEASED;
+	w->agent = la->id;
+	la->elinda.worker = id;
+	freeGenome(la->elinda.sent_genome);
+	la->elinda.sent_genome = w->sent_genome;
+	la->elinda.sent_hash = w->sent_hash;
+	w->sent_genome = NULL;
+}
+
+/**
+ * Lends the worker to the first agent that waits, or makes it idle. Returns the agent, or
+ * NULL. Must be called with the pool lock.
+ */
+static struct Agent *lendToWaiting(uint16_t id) {
+	struct PoolWorker *w = &plconf->workers[id];
+	if (!plconf->waiting_count) {
+		w->state = POOL_WORKER_IDLE;
+		w->agent = POOL_NO_AGENT;
+		return NULL;
+	}
+	struct Agent *la = getAgent(plconf->waiting[plconf->waiting_first]);
+	plconf->waiting_first = (plconf->waiting_first + 1) % econf->population_size;
+	plconf->waiting_count--;
+	lend(id, la);
+	return la;
+}
+
+/**
+ * The agent got a worker, so its genome can be sent.
+ */
+static void leased(struct Agent *la) {
+	TPRINTF(LOG_INFO, "Agent %u is simulated by worker %i", la->id, la->elinda.worker);
+	struct InfoDefault *infod = linda_ctx_alloc(sizeof(struct InfoDefault));
+	infod->id = la->id;
+	infod->value = 0;
+	dispatch_described_task(plconf->lease, (void*)infod, "inseminate");
+}
+
+uint8_t workerAlive(uint32_t process) {
+	struct Agent *la = NULL;
+	if (plconf == NULL) return 0;
+	pthread_mutex_lock(&poolMutex);
+	if (process >= plconf->next_process) {
+		pthread_mutex_unlock(&poolMutex);
+		return 0;
+	}
+	uint16_t id = workerOf(process);
+	//a retired process that came up late is ignored, a worker tells it is alive only once
+	if ((id != POOL_NO_WORKER) && (plconf->workers[id].state == POOL_WORKER_STARTING))
+		la = lendToWaiting(id);
+	pthread_mutex_unlock(&poolMutex);
+	if (la != NULL) leased(la);
+	return 1;
+}
+
+void leaseWorker(struct Agent *la) {
+	uint16_t i;
+	pthread_mutex_lock(&poolMutex);
+	for (i = 0; i < plconf->size; i++) {
+		if (plconf->workers[i].state == POOL_WORKER_IDLE) break;
+	}
+	if (i < plconf->size) {
+		lend(i, la);
+	} else {
+		//every agent waits at most once, so the ring is large enough
+		plconf->waiting[(plconf->waiting_first + plconf->waiting_count++) %
+				econf->population_size] = la->id;
+		la = NULL;
+	}
+	pthread_mutex_unlock(&poolMutex);
+	if (la != NULL) leased(la);
+}
+
+void releaseWorker(struct Agent *la) {
+	struct TcpipSocket *lsock_dest = tcpipbank_get(tmconf->mbus_id);
+	struct Agent *next = NULL;
+	pthread_mutex_lock(&poolMutex);
+	uint16_t id = la->elinda.worker;
+	if (id >= plconf->size || plconf->workers[id].agent != la->id) {
+		pthread_mutex_unlock(&poolMutex);
+		return;
+	}
+	struct PoolWorker *w = &plconf->workers[id];
+	w->sent_genome = la->elinda.sent_genome;
+	w->sent_hash = la->elinda.sent_hash;
+	la->elinda.sent_genome = NULL;
+	la->elinda.worker = POOL_NO_WORKER;
+	if (lsock_dest != NULL) push(lsock_dest->outbox, createClearGridMessage(w->process));
+	next = lendToWaiting(id);
+	pthread_mutex_unlock(&poolMutex);
+	if (lsock_dest != NULL) tcpip_flush(lsock_dest);
+	if (next != NULL) leased(next);
+}
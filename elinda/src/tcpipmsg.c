@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include <inttypes.h>
 #include <string.h>
+#include <arpa/inet.h>
 #include <genomes.h>
 #include <elinda.h>
 
@@ -18,6 +19,9 @@ void initMessages() {
 	tmconf->mbus_id = 254;
 	tmconf->sym3d_id = 253;
 //	tmconf->gui_id = 200;
+	inet_aton("239.255.76.67", &tmconf->mcast_group);
+	tmconf->mcast_port = 3332;
+	tmconf->mcast_id = 252;
 }
 
 /**
@@ -27,9 +31,7 @@ void initMessages() {
  * robots actually running in the simulator (by a modulus operation).
  */
 struct TcpipMessage *createPositionMessage(uint8_t robotId, int16_t x, int16_t y, int16_t z) {
-	struct TcpipMessage *lm = malloc(sizeof(struct TcpipMessage));
-	lm->payload = calloc(MAX_PACKET_SIZE-1, sizeof(unsigned char));
-	lm->size = 11;
+	struct TcpipMessage *lm = tcpip_alloc_msg(11);
 	lm->payload[0] = LINDA_POSITION_MSG;
 	lm->payload[1] = lm->size - 2;
 	lm->payload[2] = tmconf->elinda_id;
@@ -55,9 +57,7 @@ struct TcpipMessage *createPositionMessage(uint8_t robotId, int16_t x, int16_t y
  * is actually started a new channel has to be created in the m-bus.
  */
 struct TcpipMessage *createRunColindaMessage(uint8_t robotId) {
-	struct TcpipMessage *lm = malloc(sizeof(struct TcpipMessage));
-	lm->size = MAX_PACKET_SIZE-1;
-	lm->payload = calloc(lm->size, sizeof(unsigned char));
+	struct TcpipMessage *lm = tcpip_alloc_msg(MAX_PACKET_SIZE-1);
 	lm->payload[0] = LINDA_NEW_PROCESS_MSG;
 	char* name = (char*)&lm->payload[2];
 	sprintf(name, "colinda %i", robotId);
@@ -70,9 +70,7 @@ struct TcpipMessage *createRunColindaMessage(uint8_t robotId) {
  * Creates a new channel in the m-bus to a Colinda instance.
  */
 struct TcpipMessage *createConnectColindaMessage(uint8_t robotId) {
-	struct TcpipMessage *lm = malloc(sizeof(struct TcpipMessage));
-	lm->size = 10;
-	lm->payload = calloc(lm->size, sizeof(unsigned char));
+	struct TcpipMessage *lm = tcpip_alloc_msg(10);
 	lm->payload[0] = LINDA_NEW_CHANNEL;
 	lm->payload[1] = lm->size - 2;
 	lm->payload[2] = 1; //server
@@ -90,9 +88,7 @@ struct TcpipMessage *createConnectColindaMessage(uint8_t robotId) {
  * Creates a new channel in the m-bus to the Symbricator3D simulator.
  */
 struct TcpipMessage *createConnectSym3DMessage() {
-	struct TcpipMessage *lm = malloc(sizeof(struct TcpipMessage));
-	lm->size = 10;
-	lm->payload = calloc(lm->size, sizeof(unsigned char));
+	struct TcpipMessage *lm = tcpip_alloc_msg(10);
 	lm->payload[0] = LINDA_NEW_CHANNEL;
 	lm->payload[1] = lm->size - 2;
 	lm->payload[2] = 0; //client
@@ -109,44 +105,262 @@ struct TcpipMessage *createConnectSym3DMessage() {
 /**
  * The genome message might be cut in several pieces before sending it as
  * separate tcp/ip messages. Especially if later on, not TCP, but UDP is used.
- * Hence partId ranges from 0 till what is needed to sent the message across. If
- * the genome is sent, its value is set to -1.
+ * Hence partId ranges from 0 till what is needed to sent the message across. The
+ * parts are as large as maxSize allows, which is the largest message the socket
+ * can carry (see tcpip_max_message_size). If the genome is sent, NULL is returned.
  */
-struct TcpipMessage *createGenomeMessage(uint8_t robotId, uint8_t *pdna, uint8_t partId) {
+struct TcpipMessage *createGenomeMessage(uint8_t robotId, const struct RawGenome *genome,
+		uint8_t partId, int maxSize) {
 	tprintf(LOG_VV, __func__, "Next genome part");
 	uint8_t header = 6;
-	struct TcpipMessage *lm = malloc(sizeof(struct TcpipMessage));
-	lm->size = MAX_PACKET_SIZE;
-	lm->payload = calloc(lm->size, sizeof(unsigned char));
+	int partSize = maxSize - header;
+	int partCount = (gsconf->genomeSize + partSize - 1) / partSize;
+	int offset = partSize * partId;
+	if (offset >= gsconf->genomeSize) return NULL;
+	if (partCount > 255) {
+		tprintf(LOG_ERR, __func__, "Genome needs too many parts");
+		return NULL;
+	}
+	int size = gsconf->genomeSize - offset;
+	if (size > partSize) size = partSize;
+	struct TcpipMessage *lm = tcpip_alloc_msg(size + header);
 	lm->payload[0] = LINDA_GENOME_MSG;
-	lm->payload[1] = lm->size - 2;
+	lm->payload[1] = lm->size - 2 > 255 ? 255 : lm->size - 2;
 	lm->payload[2] = tmconf->elinda_id;
 	lm->payload[3] = robotId;
 	lm->payload[4] = partId;
-	lm->payload[5] = gsconf->genomeSize / (uint16_t)(lm->size - header);
-	if ((lm->payload[5] * (lm->size - header)) < gsconf->genomeSize) lm->payload[5]++;
-	uint16_t i, j = (lm->size - header) * partId;
-	if (j >= gsconf->genomeSize) {
-		free(lm);
-		return NULL;
+	lm->payload[5] = partCount;
+	readGenomeCodons(genome, offset, size, &lm->payload[header]);
+	if (partId == partCount - 1) {
+		TPRINTF(LOG_VERBOSE, "Created %i parts of size %i for total genome of size %i",
+				partCount, partSize, gsconf->genomeSize);
+	}
+	return lm;
+}
+
+/**
+ * The amount of parts in which a genome is multicast, when a part can be maxSize bytes. The
+ * parts are as equal in size as possible, so the receiver can compute where each of them
+ * goes from the genome size and the part count alone.
+ */
+int genomeBroadcastParts(int maxSize) {
+	int partSize = maxSize - LINDA_GENOME_BCAST_HEADER;
+	return (gsconf->genomeSize + partSize - 1) / partSize;
+}
+
+/**
+ * A part of a genome that is multicast to all Colinda controllers at once. It is addressed
+ * to every robot (0xFF), and identified by the hash of the entire genome, because several
+ * robots may get the same genome. After the hash come the part id, the part count and the
+ * size of the genome, as 16-bit values, most significant first. Returns NULL if there is no
+ * part with the given id.
+ */
+struct TcpipMessage *createGenomeBroadcastMessage(const struct RawGenome *genome,
+		uint32_t hash, uint16_t partId, uint16_t partCount) {
+	uint8_t header = LINDA_GENOME_BCAST_HEADER;
+	int partSize = (gsconf->genomeSize + partCount - 1) / partCount;
+	int offset = partSize * partId;
+	if (partId >= partCount || offset >= gsconf->genomeSize) return NULL;
+	int size = gsconf->genomeSize - offset;
+	if (size > partSize) size = partSize;
+	struct TcpipMessage *lm = tcpip_alloc_msg(size + header);
+	lm->payload[0] = LINDA_GENOME_BCAST_MSG;
+	lm->payload[1] = lm->size - 2 > 255 ? 255 : lm->size - 2;
+	lm->payload[2] = tmconf->elinda_id;
+	lm->payload[3] = 0xFF;
+	lm->payload[4] = hash >> 24;
+	lm->payload[5] = hash >> 16;
+	lm->payload[6] = hash >> 8;
+	lm->payload[7] = hash;
+	lm->payload[8] = partId >> 8;
+	lm->payload[9] = partId;
+	lm->payload[10] = partCount >> 8;
+	lm->payload[11] = partCount;
+	lm->payload[12] = gsconf->genomeSize >> 8;
+	lm->payload[13] = gsconf->genomeSize;
+	readGenomeCodons(genome, offset, size, &lm->payload[header]);
+	return lm;
+}
+
+/**
+ * Tells a Colinda controller which genome it gets, by its hash, the parts are multicast.
+ * The controller answers with a LINDA_GENOME_NACK for the parts it did not receive, or
+ * with a LINDA_GENOME_ACK when it has them all.
+ */
+struct TcpipMessage *createGenomeAnnounceMessage(uint8_t robotId, uint32_t hash,
+		uint16_t partCount) {
+	struct TcpipMessage *lm = tcpip_alloc_msg(12);
+	lm->payload[0] = LINDA_GENOME_ANNOUNCE;
+	lm->payload[1] = lm->size - 2;
+	lm->payload[2] = tmconf->elinda_id;
+	lm->payload[3] = robotId;
+	lm->payload[4] = hash >> 24;
+	lm->payload[5] = hash >> 16;
+	lm->payload[6] = hash >> 8;
+	lm->payload[7] = hash;
+	lm->payload[8] = partCount >> 8;
+	lm->payload[9] = partCount;
+	lm->payload[10] = gsconf->genomeSize >> 8;
+	lm->payload[11] = gsconf->genomeSize;
+	return lm;
+}
+
+/**
+ * The end of the run of differences that starts at position i, within one page.
+ */
+static int deltaRunEnd(const uint8_t *pbase, const uint8_t *pdna, int i, int length) {
+	int j, end = i + 1;
+	for (j = i + 1; j < length && j - i < 255 && j - end <= 3; j++) {
+		if (pbase[j] != pdna[j]) end = j + 1;
 	}
-	for (i = 0; i < lm->size - header; i++) {
-		if ((i+j) >= gsconf->genomeSize) {
-			lm->size = i + header;
-			lm->payload[1] = lm->size - 2;
-			char text[128]; 
-			sprintf(text, "Created %i parts of size %i (= %i) for total genome of size %i",
-					lm->payload[5], MAX_PACKET_SIZE - header, 
-					lm->payload[5] * (MAX_PACKET_SIZE - header), 
-					gsconf->genomeSize);
-			tprintf(LOG_VERBOSE, __func__, text);
-			sprintf(text, "This last part %i (without header) is of size %i", lm->payload[4], lm->size-header);
-			tprintf(LOG_VERBOSE, __func__, text);
-			return lm;
+	return end;
+}
+
+/**
+ * Writes the runs of differences to run, if it is not NULL, and returns their size. Pages
+ * that the genomes share are the same, so only the other pages are compared. A run does not
+ * cross the border of a page.
+ */
+static int deltaRuns(const struct RawGenome *base, const struct RawGenome *genome,
+		unsigned char *run) {
+	int i, j, end, first, length, size = 0;
+	for (first = 0; first < gsconf->genomeSize; first += length) {
+		length = genomePageLength(first);
+		if (base->pages[first / GENOME_PAGE_SIZE] == genome->pages[first / GENOME_PAGE_SIZE])
+			continue;
+		const uint8_t *pbase = peekGenome(base, first), *pdna = peekGenome(genome, first);
+		for (i = 0; i < length; i = end) {
+			if (pbase[i] == pdna[i]) {
+				end = i + 1;
+				continue;
+			}
+			end = deltaRunEnd(pbase, pdna, i, length);
+			size += 3 + end - i;
+			if (run == NULL) continue;
+			*run++ = (first + i) >> 8;
+			*run++ = first + i;
+			*run++ = end - i;
+			for (j = i; j < end; j++) *run++ = pbase[j] ^ pdna[j];
 		}
-		lm->payload[header+i] = pdna[i+j];
-		//@todo Check if everything has been sent
 	}
+	return size;
+}
+
+/**
+ * The difference between a genome and the base genome the robot got before, as runs of a
+ * 16-bit position, a length byte and that many bytes to xor with the base. Differences that
+ * are a few bytes apart share a run, because a run header costs three bytes. Both genomes
+ * are identified by their hash, the robot checks them before and after applying the delta.
+ * Returns NULL if the delta does not fit in maxSize, then the entire genome should be sent.
+ */
+struct TcpipMessage *createGenomeDeltaMessage(uint8_t robotId, const struct RawGenome *base,
+		const struct RawGenome *genome, uint32_t baseHash, uint32_t hash, int maxSize) {
+	uint8_t header = LINDA_GENOME_DELTA_HEADER;
+	int size = header + deltaRuns(base, genome, NULL), length = gsconf->genomeSize;
+	if (size > maxSize) return NULL;
+	struct TcpipMessage *lm = tcpip_alloc_msg(size);
+	lm->payload[0] = LINDA_GENOME_DELTA_MSG;
+	lm->payload[1] = lm->size - 2 > 255 ? 255 : lm->size - 2;
+	lm->payload[2] = tmconf->elinda_id;
+	lm->payload[3] = robotId;
+	lm->payload[4] = baseHash >> 24;
+	lm->payload[5] = baseHash >> 16;
+	lm->payload[6] = baseHash >> 8;
+	lm->payload[7] = baseHash;
+	lm->payload[8] = hash >> 24;
+	lm->payload[9] = hash >> 16;
+	lm->payload[10] = hash >> 8;
+	lm->payload[11] = hash;
+	lm->payload[12] = length >> 8;
+	lm->payload[13] = length;
+	deltaRuns(base, genome, &lm->payload[header]);
+	return lm;
+}
+
+/**
+ * The amount of parts in which a migrant is sent, when a part can be maxSize bytes. Like
+ * the multicast parts, they are as equal in size as possible.
+ */
+int migrantParts(int maxSize) {
+	int partSize = maxSize - LINDA_MIGRANT_HEADER;
+	return (gsconf->genomeSize + partSize - 1) / partSize;
+}
+
+/**
+ * A part of a genome that migrates from one island to another, see island.h. After the id
+ * of the island it comes from, are the hash of the genome, its fitness on that island, the
+ * part id, the part count and the size of the genome, as 16-bit values, most significant
+ * first. Returns NULL if there is no part with the given id.
+ */
+struct TcpipMessage *createMigrantMessage(uint8_t island, const struct RawGenome *genome,
+		uint32_t hash, uint8_t fitness, uint16_t partId, uint16_t partCount) {
+	uint8_t header = LINDA_MIGRANT_HEADER;
+	int partSize = (gsconf->genomeSize + partCount - 1) / partCount;
+	int offset = partSize * partId;
+	if (partId >= partCount || offset >= gsconf->genomeSize) return NULL;
+	int size = gsconf->genomeSize - offset;
+	if (size > partSize) size = partSize;
+	struct TcpipMessage *lm = tcpip_alloc_msg(size + header);
+	lm->payload[0] = LINDA_MIGRANT_MSG;
+	lm->payload[1] = lm->size - 2 > 255 ? 255 : lm->size - 2;
+	lm->payload[2] = tmconf->elinda_id;
+	lm->payload[3] = island;
+	lm->payload[4] = hash >> 24;
+	lm->payload[5] = hash >> 16;
+	lm->payload[6] = hash >> 8;
+	lm->payload[7] = hash;
+	lm->payload[8] = fitness;
+	lm->payload[9] = partId >> 8;
+	lm->payload[10] = partId;
+	lm->payload[11] = partCount >> 8;
+	lm->payload[12] = partCount;
+	lm->payload[13] = gsconf->genomeSize >> 8;
+	lm->payload[14] = gsconf->genomeSize;
+	readGenomeCodons(genome, offset, size, &lm->payload[header]);
+	return lm;
+}
+
+/**
+ * The amount of parts in which a network frame of the given size is sent, when a part can be
+ * maxSize bytes.
+ */
+int networkParts(uint32_t size, int maxSize) {
+	int partSize = maxSize - LINDA_NETWORK_HEADER;
+	return size ? (size + partSize - 1) / partSize : 1;
+}
+
+/**
+ * A part of the frame of a network that is developed here, see colinda/inc/netframe.h. After
+ * the id of the robot are the hash of the frame, the part id and the part count as 16-bit
+ * values and the size of the frame as 32-bit value, most significant first. Returns NULL if
+ * there is no part with the given id.
+ */
+struct TcpipMessage *createNetworkMessage(uint8_t robotId, const uint8_t *frame, uint32_t size,
+		uint32_t hash, uint16_t partId, uint16_t partCount) {
+	uint8_t header = LINDA_NETWORK_HEADER;
+	uint32_t partSize = (size + partCount - 1) / partCount;
+	uint32_t offset = partSize * partId;
+	if (partId >= partCount || (offset >= size && size)) return NULL;
+	uint32_t length = size - offset;
+	if (length > partSize) length = partSize;
+	struct TcpipMessage *lm = tcpip_alloc_msg(length + header);
+	lm->payload[0] = LINDA_NETWORK_MSG;
+	lm->payload[1] = lm->size - 2 > 255 ? 255 : lm->size - 2;
+	lm->payload[2] = tmconf->elinda_id;
+	lm->payload[3] = robotId;
+	lm->payload[4] = hash >> 24;
+	lm->payload[5] = hash >> 16;
+	lm->payload[6] = hash >> 8;
+	lm->payload[7] = hash;
+	lm->payload[8] = partId >> 8;
+	lm->payload[9] = partId;
+	lm->payload[10] = partCount >> 8;
+	lm->payload[11] = partCount;
+	lm->payload[12] = size >> 24;
+	lm->payload[13] = size >> 16;
+	lm->payload[14] = size >> 8;
+	lm->payload[15] = size;
+	memcpy(&lm->payload[header], frame + offset, length);
 	return lm;
 }
 
@@ -154,12 +368,22 @@ struct TcpipMessage *createGenomeMessage(uint8_t robotId, uint8_t *pdna, uint8_t
  * Message that will be sent to the Colinda controller from the Elinda engine.
  */
 struct TcpipMessage *createRunRobotMessage(uint8_t robotId) {
-	struct TcpipMessage *lm = malloc(sizeof(struct TcpipMessage));
-	lm->size = 4;
-	lm->payload = calloc(lm->size, sizeof(unsigned char));
+	struct TcpipMessage *lm = tcpip_alloc_msg(4);
 	lm->payload[0] = LINDA_RUNROBOT_MSG;
 	lm->payload[1] = lm->size - 2;
 	lm->payload[2] = tmconf->elinda_id;
 	lm->payload[3] = robotId;
 	return lm;
 }
+
+/**
+ * Resets a Colinda controller that is done with one agent, before it gets the next one.
+ */
+struct TcpipMessage *createClearGridMessage(uint8_t robotId) {
+	struct TcpipMessage *lm = tcpip_alloc_msg(4);
+	lm->payload[0] = LINDA_CLEAR_GRID;
+	lm->payload[1] = lm->size - 2;
+	lm->payload[2] = tmconf->elinda_id;
+	lm->payload[3] = robotId;
+	return lm;
+}
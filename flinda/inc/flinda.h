@@ -7,8 +7,12 @@ extern "C" {
 
 #include <linda/ptreaty.h>
 #include <linda/infocontainer.h>
+#include <linda/novelty.h>
 
 #include <inttypes.h>
+
+//! The fitness values that are pushed at most before the outbox is flushed
+#define FLINDA_REPLY_BATCH		16
 	
 struct FlindaRuntime {
 	struct SyncThreads *eosim;
@@ -19,12 +23,15 @@ struct FlindaConfig {
 	uint8_t monk_count;
 	uint8_t task_count;
 	void *(*boot)(void*);
-	uint8_t topology_count;
+	uint32_t topology_count;
 };
 
+/**
+ * The topologies that are judged before, see novelty.h. LINDA_TOPOLOGY_COUNT sets how many
+ * are kept, 10 by default.
+ */
 struct FlindaHistory {
-	struct InfoArray **topologies;
-	uint8_t topology_count;
+	struct LindaNovelty *topologies;
 };
 
 struct FlindaConfig *flconf;
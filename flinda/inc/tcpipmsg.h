@@ -27,6 +27,7 @@ extern "C" {
 #define LINDA_GENOME_PART_ACK	18
 #define LINDA_TOPOLOGY_MSG		19
 #define LINDA_TOPOLOGY_REQ		20
+//! 33 and 34 are LINDA_STATS_REQ and LINDA_STATS_MSG of all engines, see linda/stats.h
 	
 #define LINDA_NEW_CHANNEL		MBUS_ADD_CHANNEL
 
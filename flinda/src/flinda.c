@@ -18,8 +18,9 @@
  * simulator, the elinda engine needs to be fooled during start-up in sending this same
  * ack.
  * 
- * The topology is interpreted is communicated as an array of characters. Only the absence
- * or existence of neurons on the grid cells is taken as input to judge diversity.
+ * The topology is communicated as an array of characters, the type of the neuron in every
+ * grid cell, or 0 for a cell without one. The cells are taken as input to judge diversity,
+ * see novelty.h.
  */
 #include <flinda.h>
 #include <tcpipmsg.h>
@@ -35,6 +36,9 @@
 #include <linda/bits.h>
 #include <linda/abbey.h>
 #include <linda/infocontainer.h>
+#include <linda/slab.h>
+#include <linda/trace.h>
+#include <linda/stats.h>
 
 static void *default_hostess(void *context);
 static void *first_channel(void *context);
@@ -43,6 +47,11 @@ static void *add_channel(void *context);
 static void *handle_topology(void *context);
 static void *send_topology_request(void *context);
 static void *finalize(void *context);
+static void *send_stats(void *context);
+
+//! The topologies that are dispatched but not answered yet
+static volatile uint32_t topologiesJudged = 0;
+static volatile uint32_t repliesPushed = 0;
 
 /**
  * Return default values to initialize the Elinda engine.
@@ -53,15 +62,13 @@ void initFlinda() {
 	flconf->task_count = 32;
 	flconf->boot = first_channel;
 	flconf->topology_count = 10;
+	const char *count = getenv("LINDA_TOPOLOGY_COUNT");
+	if (count != NULL) sscanf(count, "%u", &flconf->topology_count);
+	if (!flconf->topology_count) flconf->topology_count = 1;
 	flruntime = malloc(sizeof(struct FlindaRuntime));
 	flruntime->eosim = malloc(sizeof(struct SyncThreads));
 	flhistory = malloc(sizeof(struct FlindaHistory));
-	flhistory->topologies = malloc(flconf->topology_count * sizeof(struct InfoArray*));
-	uint8_t i;
-	for (i=0; i < flconf->topology_count; i++) {
-		flhistory->topologies[i] = NULL;
-	}
-	flhistory->topology_count = 0;
+	flhistory->topologies = linda_novelty_new(flconf->topology_count, LINDA_NOVELTY_CAP);
 	ptreaty_init(flruntime->eosim);
 	ptreaty_init_baton(flruntime->eosim);
 	initMessages();
@@ -86,6 +93,7 @@ static void *first_channel(void *context) {
 	tprintf(LOG_VERBOSE, __func__, "Create first channel");
 	struct InfoChannel *ic = malloc(sizeof(struct InfoChannel));
 	ic->type = 1;
+	if (getenv("LINDA_LOCAL") != NULL) ic->type |= TCPIP_CHANNEL_LOCAL;
 	ic->host = malloc(sizeof(struct in_addr));
 	ic->host->s_addr = INADDR_ANY;
 	ic->port = tmconf->mbus_sym3d_port;
@@ -113,20 +121,16 @@ static void *default_hostess(void *context) {
 
 	switch (msg->payload[0]) {
 	case LINDA_TOPOLOGY_MSG: {
-		struct InfoArray *infoa = malloc(sizeof(struct InfoArray));
-		uint8_t header = 6;
-		infoa->length = msg->size-header;
-		infoa->values = calloc(infoa->length, sizeof(uint8_t));
-		memcpy(infoa->values, &msg->payload[header], infoa->length);
-		infoa->type = msg->payload[4]; //robotId
-		dispatch_described_task(handle_topology, (void*)infoa, "handle topology");
-//		free(infoa);
-		freemsg(msg);
+		__sync_fetch_and_add(&topologiesJudged, 1);
+		if (dispatch_described_task(handle_topology, (void*)msg, "handle topology")) {
+			__sync_fetch_and_sub(&topologiesJudged, 1);
+			freemsg(msg);
+		}
 		break;
 	}
 	case LINDA_ACTUATOR_MSG: {
 		tprintf(LOG_VERBOSE, __func__, "Actuator message received");
-		struct InfoDefault *infod = malloc(sizeof(struct InfoDefault));
+		struct InfoDefault *infod = linda_ctx_alloc(sizeof(struct InfoDefault));
 		infod->id = msg->payload[2];
 		dispatch_described_task(send_topology_request, (void*)infod, "topology request");
 		freemsg(msg);
@@ -137,6 +141,10 @@ static void *default_hostess(void *context) {
 		freemsg(msg);
 		break;
 	}
+	case LINDA_STATS_REQ: {
+		dispatch_described_task(send_stats, (void*)msg, "send stats");
+		break;
+	}
 	case LINDA_END_ELINDA_MSG: {
 		dispatch_described_task(finalize, NULL, "finalize");
 		freemsg(msg);
@@ -160,7 +168,7 @@ static void *default_hostess(void *context) {
 struct TcpipSocket* ic2sock(struct InfoChannel *ic) {
 	struct TcpipSocket *lsock = tcpip_get(ic->type);
 	lsock->port_nr = ic->port;
-	if (ic->type == 0) lsock->serv_addr.sin_addr = *ic->host;
+	if (!(ic->type & ~TCPIP_CHANNEL_LOCAL)) lsock->serv_addr.sin_addr = *ic->host;
 	else lsock->cli_addr.sin_addr = *ic->host;
 	lsock->callbackIn = default_hostess; //coordination should be exogenous
 	return lsock;
@@ -180,7 +188,12 @@ static void *add_channel(void *context) {
 		return NULL;
 	}
 	struct TcpipSocket *lsock = ic2sock(ic);
-	tcpipbank_add(lsock, ic->id);
+	if (tcpipbank_add(lsock, ic->id)) {
+		//another monk added the channel in the meantime
+		tcpip_free(lsock);
+		free(ic);
+		return NULL;
+	}
 	dispatch_described_task(tcpip_start, (void*)lsock, "start tcp/ip");
 	free(ic);
 	return NULL;
@@ -198,102 +211,80 @@ static void *send_topology_request(void *context) {
 	if (lsock_dest == NULL) {
 		tprintf(LOG_WARNING, __func__, "Not initialized?");
 		freemsg(msg);
+		linda_ctx_free(infod);
 		return NULL;
 	}
 	push(lsock_dest->outbox, msg);
-	dispatch_described_task(tcpip_send_packets, (void*)lsock_dest, "send packets");
-	free(infod);
+	tcpip_flush(lsock_dest);
+	linda_ctx_free(infod);
 	return NULL;
 }
 
-uint8_t compare(struct InfoArray *a1, struct InfoArray *a2) {
-	uint8_t i, result = 0;
-	for (i = 0; i < a1->length; i++) {
-		if (a1->values[i] != a2->values[i]) result++; 
-	}
-	return result;
-}
-
-uint8_t lower_fitness(uint8_t given_fitness) {
-	uint8_t i;
-	for (i = 0; i <	flhistory->topology_count; i++) {
-		if (flhistory->topologies[i]->type < given_fitness)
-			return 1;
-	}
-	return 0;
-}
-
-uint8_t lowest_fitness() {
-	if (flhistory->topology_count == 0) {
-		tprintf(LOG_ERR, __func__, "Don't call this routine if there are no topologies");
-		return 0;
-	}
-	uint8_t i, fitness = flhistory->topologies[0]->type, fitnessId = 0;
-	for (i = 1; i <	flhistory->topology_count; i++) {
-		if (flhistory->topologies[i]->type < fitness) {
-			fitness = flhistory->topologies[i]->type;
-			fitnessId = i;
-		}
-	}
-	return fitnessId; 
-}
-
 /**
- * 
+ * The message is the topology as colinda sends it, the cells come after a header of 5
+ * bytes, the fourth of which is the robot id. Topologies are judged by all monks at once,
+ * see novelty.h. The fitness is pushed in the outbox right away, but only the last monk that
+ * is judging flushes it, so the fitness values that go out at once are written in one go.
+ * While topologies keep coming in, the outbox is flushed every FLINDA_REPLY_BATCH values.
  */
 static void *handle_topology(void *context) {
 	tprintf(LOG_VERBOSE, __func__, "Handle topology");
-	struct InfoArray *infoa = (struct InfoArray*)context;
-	uint8_t robotId = infoa->type;
-
-	uint8_t fitness = 0, i, fitness_delta, equal = 0;
-	tprintf(LOG_VERBOSE, __func__, "Iterate existing topologies");
-	for (i = 0; i <	flhistory->topology_count; i++) {
-		fitness_delta = compare(flhistory->topologies[i], infoa);
-		if (!fitness_delta) equal = 1;
-		if (fitness_delta > 25) fitness_delta = 25;
-		fitness += fitness_delta;
-	}
-
-	if (!flhistory->topology_count) {
-		tprintf(LOG_VERBOSE, __func__, "Add first topology");
-		flhistory->topologies[0] = infoa;
-		flhistory->topologies[0]->type = fitness;
-		flhistory->topology_count++;
-	} else if (!equal) {
-		tprintf(LOG_VERBOSE, __func__, "Same topology, be idle");
-		free(infoa->values);
-		free(infoa);
-	} else if (flhistory->topology_count < flconf->topology_count) {
-		tprintf(LOG_VERBOSE, __func__, "Add next topology");
-		flhistory->topologies[flhistory->topology_count] = infoa;
-		flhistory->topologies[flhistory->topology_count]->type = fitness;
-		char text[128];
-		sprintf(text, "Added topology number %i", flhistory->topology_count); 
-		tprintf(LOG_VERBOSE, __func__, text);
-		flhistory->topology_count++;
-	} else if (!lower_fitness(fitness)) {
-		tprintf(LOG_VERBOSE, __func__, "Add topology with lowest fitness");
-		uint8_t replaceId = lowest_fitness();
-		free(flhistory->topologies[replaceId]);
-		flhistory->topologies[replaceId] = infoa;
-		flhistory->topologies[replaceId]->type = fitness;
-	} else {
-		tprintf(LOG_VERBOSE, __func__, "No higher fitness");
-		free(infoa->values);
-		free(infoa);
-	}
+	struct TcpipMessage *topology = (struct TcpipMessage*)context;
+	uint8_t header = 5;
+	uint8_t robotId = topology->payload[4];
+	uint8_t fitness = linda_novelty_judge(flhistory->topologies, &topology->payload[header],
+			(topology->size > header) ? topology->size - header : 0);
+	freemsg(topology);
+	TPRINTF(LOG_VERBOSE, "Topology of robot %i has novelty %i", robotId, fitness);
 
 	struct TcpipMessage *msg = createFitnessMessage(robotId, fitness);
 	struct TcpipSocket *lsock_dest = tcpipbank_get(tmconf->mbus_id);
 	if (lsock_dest == NULL) {
 		tprintf(LOG_WARNING, __func__, "Not initialized?");
 		freemsg(msg);
+		//the last judge flushes, also the replies the others pushed before the m-bus went
+		if (!__sync_sub_and_fetch(&topologiesJudged, 1) &&
+				((lsock_dest = tcpipbank_get(tmconf->mbus_id)) != NULL)) {
+			__sync_lock_test_and_set(&repliesPushed, 0);
+			tcpip_flush(lsock_dest);
+		}
 		return NULL;
 	}
 
 	push(lsock_dest->outbox, msg);
-	dispatch_described_task(tcpip_send_packets, (void*)lsock_dest, "send packets");
+	uint32_t replies = __sync_add_and_fetch(&repliesPushed, 1);
+	if (!__sync_sub_and_fetch(&topologiesJudged, 1) || replies >= FLINDA_REPLY_BATCH) {
+		__sync_lock_test_and_set(&repliesPushed, 0);
+		tcpip_flush(lsock_dest);
+	}
+	return NULL;
+}
+
+/**
+ * Answers a request for the statistics, see stats.h, with the topologies that are stored
+ * and those that are being judged.
+ */
+static void *send_stats(void *context) {
+	struct TcpipMessage *request = (struct TcpipMessage*)context;
+	struct TcpipSocket *lsock_dest = tcpipbank_get(tmconf->mbus_id);
+	if (lsock_dest == NULL) {
+		tprintf(LOG_WARNING, __func__, "Not initialized?");
+		freemsg(request);
+		return NULL;
+	}
+	uint8_t counters[64], *body = linda_stats_open(counters, LINDA_STATS_COUNTERS);
+	uint8_t *p = linda_stats_counter(body, "topologies",
+			linda_novelty_count(flhistory->topologies));
+	p = linda_stats_counter(p, "judging", topologiesJudged);
+	p = linda_stats_close(body, p);
+	struct TcpipMessage *msg = linda_stats_reply(request, tmconf->sym3d_id, LINDA_STATS_FLINDA,
+			counters, p - counters, tcpip_max_message_size(lsock_dest)), *next;
+	freemsg(request);
+	for (; msg != NULL; msg = next) {
+		next = msg->next;
+		push(lsock_dest->outbox, msg);
+	}
+	tcpip_flush(lsock_dest);
 	return NULL;
 }
 
@@ -311,6 +302,8 @@ static void *finalize(void *context) {
 int main() {
 	openlog ("flinda", LOG_CONS, LOG_LOCAL0);
 	initLog(LOG_NOTICE);
+	startLogThread();
+	linda_trace_init("flinda");
 	pthread_t this = pthread_self();
 	ptreaty_add_thread(&this, "Main");
 	tprintf(LOG_NOTICE, __func__, "Start Flinda");
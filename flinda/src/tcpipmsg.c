@@ -18,9 +18,7 @@ void initMessages() {
 }
 
 struct TcpipMessage *createTopologyRequestMessage(uint8_t robotId) {
-	struct TcpipMessage *lm = malloc(sizeof(struct TcpipMessage));
-	lm->size = 4;
-	lm->payload = calloc(lm->size, sizeof(unsigned char));
+	struct TcpipMessage *lm = tcpip_alloc_msg(4);
 	lm->payload[0] = LINDA_TOPOLOGY_REQ;
 	lm->payload[1] = lm->size - 2;
 	lm->payload[2] = tmconf->sym3d_id;
@@ -29,9 +27,7 @@ struct TcpipMessage *createTopologyRequestMessage(uint8_t robotId) {
 }
 
 struct TcpipMessage *createFitnessMessage(uint8_t robotId, uint8_t fitvalue) {
-	struct TcpipMessage *lm = malloc(sizeof(struct TcpipMessage));
-	lm->size = 6;
-	lm->payload = calloc(lm->size, sizeof(uint8_t));
+	struct TcpipMessage *lm = tcpip_alloc_msg(6);
 	lm->payload[0] = LINDA_FITNESS_MSG;
 	lm->payload[1] = lm->size - 2;
 	lm->payload[2] = tmconf->sym3d_id;
@@ -48,9 +44,7 @@ struct TcpipMessage *createFitnessMessage(uint8_t robotId, uint8_t fitvalue) {
  * robots actually running in the simulator (by a modulus operation).
  */
 struct TcpipMessage *createPositionMessage(uint8_t robotId, int16_t x, int16_t y, int16_t z) {
-	struct TcpipMessage *lm = malloc(sizeof(struct TcpipMessage));
-	lm->size = 11;
-	lm->payload = calloc(lm->size, sizeof(unsigned char));
+	struct TcpipMessage *lm = tcpip_alloc_msg(11);
 	lm->payload[0] = LINDA_POSITION_MSG;
 	lm->payload[1] = lm->size - 2;
 	lm->payload[2] = tmconf->elinda_id;
@@ -76,9 +70,7 @@ struct TcpipMessage *createPositionMessage(uint8_t robotId, int16_t x, int16_t y
  * is actually started a new channel has to be created in the m-bus.
  */
 struct TcpipMessage *createRunColindaMessage(uint8_t robotId) {
-	struct TcpipMessage *lm = malloc(sizeof(struct TcpipMessage));
-	lm->size = MAX_PACKET_SIZE-1;
-	lm->payload = calloc(lm->size, sizeof(unsigned char));
+	struct TcpipMessage *lm = tcpip_alloc_msg(MAX_PACKET_SIZE-1);
 	lm->payload[0] = LINDA_NEW_PROCESS_MSG;
 	char* name = (char*)&lm->payload[2]; //check
 //	sprintf(name, "../../colinda/Debug/colinda %i", robotId);
@@ -93,9 +85,7 @@ struct TcpipMessage *createRunColindaMessage(uint8_t robotId) {
  * Creates a new channel in the m-bus to a Colinda instance.
  */
 struct TcpipMessage *createConnectColindaMessage(uint8_t robotId) {
-	struct TcpipMessage *lm = malloc(sizeof(struct TcpipMessage));
-	lm->size = 10;
-	lm->payload = calloc(lm->size, sizeof(unsigned char));
+	struct TcpipMessage *lm = tcpip_alloc_msg(10);
 	lm->payload[0] = LINDA_NEW_CHANNEL;
 	lm->payload[1] = lm->size - 2;
 	lm->payload[2] = 1; //server
@@ -113,9 +103,7 @@ struct TcpipMessage *createConnectColindaMessage(uint8_t robotId) {
  * creates a new channel in the m-bus to the Symbricator3D simulator.
  */
 struct TcpipMessage *createConnectSym3DMessage() {
-	struct TcpipMessage *lm = malloc(sizeof(struct TcpipMessage));
-	lm->size = 10;
-	lm->payload = calloc(lm->size, sizeof(unsigned char));
+	struct TcpipMessage *lm = tcpip_alloc_msg(10);
 	lm->payload[0] = LINDA_NEW_CHANNEL;
 	lm->payload[1] = lm->size - 2;
 	lm->payload[2] = 0; //client
@@ -133,9 +121,7 @@ struct TcpipMessage *createConnectSym3DMessage() {
  * Message that will be sent to the Colinda controller from the Elinda engine.
  */
 struct TcpipMessage *createRunRobotMessage(uint8_t robotId) {
-	struct TcpipMessage *lm = malloc(sizeof(struct TcpipMessage));
-	lm->size = 4;
-	lm->payload = calloc(lm->size, sizeof(unsigned char));
+	struct TcpipMessage *lm = tcpip_alloc_msg(4);
 	lm->payload[0] = LINDA_RUNROBOT_MSG;
 	lm->payload[1] = lm->size - 2;
 	lm->payload[2] = tmconf->elinda_id;
@@ -77,11 +77,75 @@ extern "C" {
 *
 ******************************************************************************/
 
+/**
+ * The priorities of tasks. Monks always pick the highest
+ * priority task that is available. Monks can be dedicated to
+ * the realtime and I/O priorities by abbey_reserve_monks().
+ */
+#define ABBEY_PRIORITY_REALTIME  0
+#define ABBEY_PRIORITY_IO        1
+#define ABBEY_PRIORITY_NORMAL    2
+#define ABBEY_PRIORITY_BULK      3
+#define ABBEY_PRIORITY_COUNT     4
+
+/**
+ * The configuration of the abbey. The amount of monks ranges
+ * from min_monk_count to max_monk_count, monks above the
+ * minimum retire after idle_timeout_ms (0 means never). If
+ * cpu_count is non-zero, monk i is pinned to processor
+ * first_cpu + (i % cpu_count). If stats_dump_ms is non-zero,
+ * the statistics are logged with that interval.
+ */
+struct AbbeyConfig {
+	int min_monk_count;
+	int max_monk_count;
+	int task_count;
+	int idle_timeout_ms;
+	int dedicated_monk_count;
+	int dedicated_priority;
+	int first_cpu;
+	int cpu_count;
+	int stats_dump_ms;
+};
+
+void abbey_default_config(struct AbbeyConfig *config, 
+  int monkCount, int taskBuffer);
+
+int initialize_abbey_ex(struct AbbeyConfig *config);
+
 int initialize_abbey(int monkCount, int taskBuffer);
 
+/**
+ * Dedicates the first count monks to tasks with the given or a
+ * higher priority. At least one monk is kept for all tasks.
+ */
+int abbey_reserve_monks(int count, int priority);
+
+/**
+ * A descriptor of a kind of task. Register it once and dispatch
+ * tasks by the descriptor, so a task does not carry a copy of
+ * its description. The stats field is the index of the kind in
+ * the statistics, see abbey_stats_snapshot. Dispatching with a
+ * description looks up the descriptor of the function.
+ */
+struct AbbeyTaskDescriptor {
+	void *(*func)(void *);
+	const char *name;
+	int priority;
+	int stats;
+};
+
+const struct AbbeyTaskDescriptor *abbey_register_task(void *(*func)(void *), 
+  const char *name, int priority);
+
+int dispatch_descriptor_task(const struct AbbeyTaskDescriptor *descriptor, 
+  void *context);
+
 /**
  * There are three ways differing in the parameters used to
- * aid dispatching. 
+ * aid dispatching. A task that is dispatched from within a
+ * task ends up in the deque of the monk that runs it, idle
+ * monks steal from the deques of their brothers.
  */
 int dispatch_described_task(void *(*func)(void *), 
   void *context, char *taskDesc);
@@ -89,6 +153,110 @@ int dispatch_task(void *(*func)(void *),
   void *context);
 int dispatch_vararray_task(void *(*func)(void *), ...);
 
+/**
+ * Dispatches n tasks at once, funcs[i] will be called with
+ * contexts[i]. The descriptions may be NULL. At most n idle
+ * monks are woken up, rather than one per task.
+ */
+int dispatch_task_batch(void *(**funcs)(void *), 
+  void **contexts, char **taskDescs, int n);
+
+/**
+ * Dispatches a task with one of the ABBEY_PRIORITY_* values,
+ * the other dispatch routines use ABBEY_PRIORITY_NORMAL.
+ */
+int dispatch_prioritized_task(void *(*func)(void *), 
+  void *context, char *taskDesc, int priority);
+
+/**
+ * A handle to a task that can be joined. A joinable task can
+ * be waited for with abbey_join, which returns the result of
+ * the task, or followed by a continuation by abbey_when_all,
+ * which returns -1 if the continuation can not be scheduled.
+ * Release the handle with abbey_release_handle afterwards.
+ * A join runs the task itself if no monk started it yet, and
+ * never runs other tasks while it waits.
+ */
+struct AbbeyHandle;
+
+struct AbbeyHandle *dispatch_joinable_task(void *(*func)(void *), 
+  void *context, char *taskDesc, int priority);
+
+void *abbey_join(struct AbbeyHandle *handle);
+
+int abbey_when_all(struct AbbeyHandle **handles, int n, 
+  void *(*continuation)(void *), void *context, char *taskDesc);
+
+void abbey_release_handle(struct AbbeyHandle *handle);
+
+/**
+ * Tasks that are dispatched after a delay or every period, in
+ * microseconds with a resolution of a millisecond. A single
+ * timer thread keeps them, so no monk sleeps in the meantime.
+ * A periodic task is stopped with abbey_cancel_timer, after
+ * which it is not dispatched anymore. A run dispatched before
+ * may still be queued or running, so do not free its context
+ * before that run is known to be done.
+ */
+struct AbbeyTimer;
+
+int dispatch_delayed_task(void *(*func)(void *), 
+  void *context, long delay_us);
+
+int dispatch_delayed_prioritized_task(void *(*func)(void *), 
+  void *context, char *taskDesc, int priority, long delay_us);
+
+struct AbbeyTimer *dispatch_periodic_task(void *(*func)(void *), 
+  void *context, char *taskDesc, long period_us);
+
+void abbey_cancel_timer(struct AbbeyTimer *timer);
+
+/**
+ * Statistics of the abbey, per task description. The time a
+ * task waited in a queue and the time it ran are recorded in
+ * log-linear histograms of nanoseconds: bucket b < 4 holds
+ * value b, above that every power of two is split in four.
+ * Descriptions beyond ABBEY_STATS_MAX_KINDS - 1 are counted
+ * together as "(other)".
+ */
+#define ABBEY_STATS_BUCKETS      128
+#define ABBEY_STATS_MAX_KINDS    64
+
+struct AbbeyTaskStats {
+	char description[64];
+	unsigned long count;
+	unsigned long long wait_ns_total;
+	unsigned long long run_ns_total;
+	unsigned int wait_histogram[ABBEY_STATS_BUCKETS];
+	unsigned int run_histogram[ABBEY_STATS_BUCKETS];
+};
+
+struct AbbeyStats {
+	int monk_count;
+	int busy_monks;
+	int queue_depth[ABBEY_PRIORITY_COUNT];
+	int kind_count;
+	struct AbbeyTaskStats kind[ABBEY_STATS_MAX_KINDS];
+};
+
+/**
+ * Monks record their statistics without a lock, a snapshot
+ * merges those of all monks. The snapshot is big, allocate
+ * it on the heap rather than on the stack of a monk.
+ */
+int abbey_stats_snapshot(struct AbbeyStats *stats);
+
+/**
+ * The bucket of a value in nanoseconds, to record other latencies
+ * in histograms of the same kind.
+ */
+int abbey_stats_bucket(unsigned long long ns);
+
+unsigned long long abbey_stats_percentile(const unsigned int *histogram, 
+  double fraction);
+
+void abbey_stats_dump();
+
 #ifdef __cplusplus
 }
 #endif 
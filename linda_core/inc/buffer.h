@@ -0,0 +1,53 @@
+/**
+ * @file buffer.h
+ * @brief Reference-counted buffers for message payloads.
+ * @author Anne C. van Rossum
+ *
+ * A buffer is allocated once and can be shared by several owners, for example the messages
+ * in the outboxes of different sockets, or a message and a task that reads part of its
+ * payload. Every owner holds a reference and gives it back with linda_buffer_unref, the
+ * last one frees the buffer. The memory comes from the size classes of slab.h, so small
+ * payloads like acknowledgements do not touch the heap.
+ */
+
+#ifndef BUFFER_H_
+#define BUFFER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <inttypes.h>
+
+struct LindaBuffer {
+	volatile int refs;
+	int capacity;
+	unsigned char data[];
+};
+
+struct LindaBuffer *linda_buffer_alloc(size_t capacity);
+
+struct LindaBuffer *linda_buffer_ref(struct LindaBuffer *buffer);
+
+void linda_buffer_unref(struct LindaBuffer *buffer);
+
+/**
+ * A 32-bit FNV-1a hash of the data, so that two processes can tell that they hold the same
+ * content without sending it, like a genome that is sent to many controllers.
+ */
+uint32_t linda_buffer_hash(const void *data, size_t size);
+
+/**
+ * Continues the hash with more data, so data that is kept in pieces gets the hash it would
+ * have in one block, when the first piece is hashed from LINDA_BUFFER_HASH_START.
+ */
+#define LINDA_BUFFER_HASH_START		2166136261u
+
+uint32_t linda_buffer_hash_more(uint32_t hash, const void *data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*BUFFER_H_*/
@@ -13,7 +13,7 @@ extern "C" {
  */
 struct InfoDefault {
 	uint8_t type;
-	uint8_t id;
+	uint32_t id;
 	uint8_t value;
 };
 
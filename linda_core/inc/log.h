@@ -14,6 +14,7 @@ extern "C" {
 #include <inttypes.h>
 #include <syslog.h>
 #include <pthread.h>
+#include <stdio.h>
 	
 //#define	LOG_EMERG	0	/* system is unusable */
 //#define	LOG_ALERT	1	/* action must be taken immediately */
@@ -33,11 +34,30 @@ extern "C" {
 #define LOG_VVVVVVV 15
 #define LOG_BLABLA  16
 
+/**
+ * The most verbose level that is compiled in. Calls to tprintf and TPRINTF with a higher,
+ * constant, verbosity are removed by the compiler. Release builds (NDEBUG) leave out
+ * LOG_VVV and everything more verbose, unless the level is given on the command line.
+ */
+#ifndef LINDA_LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define LINDA_LOG_MIN_LEVEL LOG_VV
+#else
+#define LINDA_LOG_MIN_LEVEL LOG_BLABLA
+#endif
+#endif
+
+/**
+ * If async is set, by startLogThread, messages are written by a separate thread and not by
+ * the thread that logs them. If file is set, by setLogFile, messages are written to it too.
+ */
 struct LogConf {
 	uint8_t levelOfVerbosity;
 	char *name;
 	uint8_t printName;
 	pthread_mutex_t *printAtomic;
+	uint8_t async;
+	FILE *file;
 };
 
 void initLog(uint8_t verbosity);
@@ -46,7 +66,24 @@ uint8_t isPrinted(uint8_t verbosity);
 
 void ntprintf(uint8_t verbosity, const char *function, char *msg);
 
-void tprintf(uint8_t verbosity, const char *function, char *msg);
+void (tprintf)(uint8_t verbosity, const char *function, char *msg);
+
+#define tprintf(verbosity, function, msg) \
+	((verbosity) > LINDA_LOG_MIN_LEVEL ? (void)0 : (tprintf)(verbosity, function, msg))
+
+/**
+ * Formats the message itself. Use it by the TPRINTF macro, which leaves out the formatting
+ * entirely when the message is not printed, and removes the call when the verbosity is
+ * above LINDA_LOG_MIN_LEVEL. So no sprintf into a buffer at the call site is needed.
+ */
+void tprintf_format(uint8_t verbosity, const char *function, const char *format, ...)
+	__attribute__ ((format (printf, 3, 4)));
+
+#define TPRINTF(verbosity, ...) \
+	do { \
+		if ((verbosity) <= LINDA_LOG_MIN_LEVEL && isPrinted(verbosity)) \
+			tprintf_format(verbosity, __func__, __VA_ARGS__); \
+	} while (0)
 
 void btprintf(uint8_t verbosity, const char *function, char *msg);
 
@@ -54,6 +91,12 @@ void printfBinary(uint8_t x, uint8_t newLine);
 
 void setVerbosity(uint8_t verbosity);
 
+int setLogFile(const char *path);
+
+int startLogThread();
+
+void stopLogThread();
+
 struct LogConf *logconf;
 
 #ifdef __cplusplus
@@ -0,0 +1,125 @@
+/**
+ * @file novelty.h
+ * @brief An archive of topologies that judges how novel a new one is
+ * @author Anne C. van Rossum
+ *
+ * A topology is the type of the neuron in every cell of the grid, one byte per cell. Its
+ * novelty is the amount of cells in which it differs from every archived topology, up to cap
+ * per archived topology, summed and saturated at 255. A cell beyond the end of the shorter of
+ * two topologies differs always. A new topology goes into the archive while it is not full,
+ * and then only in place of the one with the lowest novelty, if its own novelty is higher.
+ * A topology that is in the archive already is not added again.
+ *
+ * The topologies are packed in 64-bit words, eight cells a word, one after the other in one
+ * array, so the cells that differ are counted a word at a time with a popcount. A topology
+ * that is in the archive already is found by its 64-bit hash in an open addressing table.
+ * The archived novelties are kept in a min-heap, so the one to replace is known right away.
+ * Comparing stops when the novelty is saturated, so a large archive mainly costs the time
+ * for topologies that are not novel.
+ *
+ * The archive is split in shards of at most LINDA_NOVELTY_SHARD_SIZE topologies, a topology
+ * belongs to the shard of its hash. A shard is read through a snapshot, so judging takes no
+ * lock, and any amount of monks can judge at once. Only a topology that goes into the archive
+ * takes the lock of its shard. While the shard is not full, the topology is added to the
+ * snapshot in place, behind its count, which is raised with a release store, so the
+ * topologies that a reader counts do not change. Otherwise the topology goes into a new
+ * snapshot, which is published in its place. Either way the epoch goes up. The old snapshot
+ * is freed once the readers that could have it are done, see novelty.c. A topology replaces
+ * the one with the lowest novelty of its own shard, which is the lowest of all only as long
+ * as there is one shard.
+ */
+
+#ifndef NOVELTY_H_
+#define NOVELTY_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+//! The default novelty that one archived topology contributes at most
+#define LINDA_NOVELTY_CAP			25
+
+#define LINDA_NOVELTY_SHARD_SIZE	1024
+#define LINDA_NOVELTY_MAX_SHARDS	16
+
+/**
+ * A shard as it was at some epoch. All arrays are in the same block of memory.
+ */
+struct NoveltySnapshot {
+	uint64_t epoch;
+	uint32_t capacity;
+	uint32_t count;
+	//! The words per topology, a new snapshot gets a larger stride for a longer topology
+	uint16_t stride;
+	uint64_t *words;
+	uint16_t *lengths;
+	uint64_t *hashes;
+	uint8_t *novelties;
+	//! The archived topologies, lowest novelty first
+	uint32_t *heap;
+	//! The archived topologies by hash, plus one, 0 is an empty slot
+	uint32_t *table;
+	uint32_t table_mask;
+	//! The next snapshot that is retired
+	struct NoveltySnapshot *next;
+};
+
+struct NoveltyShard {
+	struct NoveltySnapshot *volatile snapshot;
+	pthread_mutex_t mutex;
+};
+
+struct LindaNovelty {
+	uint32_t capacity;
+	uint8_t cap;
+	uint8_t shard_count;
+	struct NoveltyShard *shards;
+	//! The snapshots that are retired since the era flipped
+	struct NoveltySnapshot *retired;
+	//! The snapshots that are retired before, freed once the readers of the old era are gone
+	struct NoveltySnapshot *waiting;
+	//! The amount of readers in each era, and the current era
+	volatile uint32_t readers[2];
+	volatile uint8_t era;
+	uint8_t flipped;
+	pthread_mutex_t retired_mutex;
+};
+
+/**
+ * An archive for at most capacity topologies, with cap as most novelty per topology. Returns
+ * NULL if there is not enough memory.
+ */
+struct LindaNovelty *linda_novelty_new(uint32_t capacity, uint8_t cap);
+
+/**
+ * Should only be called when no monk judges anymore.
+ */
+void linda_novelty_free(struct LindaNovelty *novelty);
+
+/**
+ * Returns the novelty of the topology, and takes a copy of it in the archive if it is novel
+ * enough. Can be called by several monks at once.
+ */
+uint8_t linda_novelty_judge(struct LindaNovelty *novelty, const uint8_t *cells,
+		uint16_t length);
+
+/**
+ * The amount of topologies in the archive.
+ */
+uint32_t linda_novelty_count(struct LindaNovelty *novelty);
+
+/**
+ * The amount of cells in which the topologies a and b differ.
+ */
+uint16_t linda_novelty_distance(const uint8_t *a, uint16_t a_length, const uint8_t *b,
+		uint16_t b_length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*NOVELTY_H_*/
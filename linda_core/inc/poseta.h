@@ -5,7 +5,7 @@
  * term poseta comes from POSET (partial ordered sets) and from a(bbey).
  *
  * @date_created    May 14, 2009
- * @date_modified   May 14, 2009
+ * @date_modified   Oct 14, 2026
  * @author          Anne C. van Rossum
  * @project         Replicator
  * @company         Almende B.V.
@@ -23,6 +23,8 @@ void initPoseta();
 
 void poseta_func1_if_func0(void *(*func0)(void *), void *(*func1)(void *));
 
+void poseta_func0_then_func1(void *(*func0)(void *), void *(*func1)(void *));
+
 int dispatch_poseta_task(void *(*func)(void *), void *context, char *taskDesc);
 
 /**
@@ -31,6 +33,25 @@ int dispatch_poseta_task(void *(*func)(void *), void *context, char *taskDesc);
 int dispatch_tuple_task(void *(*func0)(void *), void *context0,
 						void *(*func1)(void*), void *context1, char *taskDesc);
 
+/**
+ * A graph of tasks that runs once. A node is dispatched when all nodes it has an edge from
+ * are done, no monk waits in the meantime.
+ */
+struct PosetaGraph;
+struct PosetaNode;
+
+struct PosetaGraph *poseta_graph_create();
+
+struct PosetaNode *poseta_graph_add(struct PosetaGraph *graph, void *(*func)(void *),
+						void *context, char *taskDesc);
+
+int poseta_graph_edge(struct PosetaNode *before, struct PosetaNode *after);
+
+int poseta_graph_run(struct PosetaGraph *graph, void *(*done)(void *), void *context,
+						char *taskDesc);
+
+void poseta_graph_free(struct PosetaGraph *graph);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,66 @@
+/**
+ * @file prng.h
+ * @brief Random streams that do not share a lock
+ * @author Anne C. van Rossum
+ *
+ * The rand() of the C library has one state for the whole process, behind a lock, so monks
+ * that draw random numbers at the same time wait for each other, and the numbers one of them
+ * gets depend on what the others drew. A LindaRandom is a xoshiro256** generator with a state
+ * of its own. It is seeded by a seed and a stream number, like the seed of a run and the id
+ * of an agent, so a task that seeds its own stream gets the same numbers every run, however
+ * the tasks are spread over the monks.
+ *
+ * For random numbers that do not have to be repeated, every thread has a stream of its own,
+ * see linda_random_thread.
+ */
+
+#ifndef PRNG_H_
+#define PRNG_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+struct LindaRandom {
+	uint64_t s[4];
+};
+
+/**
+ * Seeds a stream. Streams with the same seed and another stream number are independent.
+ */
+void linda_random_seed(struct LindaRandom *random, uint64_t seed, uint64_t stream);
+
+uint64_t linda_random_next(struct LindaRandom *random);
+
+/**
+ * A number from 0 up to, but not including, bound, without the bias of a modulo.
+ */
+uint32_t linda_random_below(struct LindaRandom *random, uint32_t bound);
+
+/**
+ * A number in the half-open interval (0, 1].
+ */
+double linda_random_unit(struct LindaRandom *random);
+
+/**
+ * The amount of failures before the first success, of trials that succeed with the given
+ * chance. So positions with that chance of being picked are visited by skipping this amount
+ * of positions every time, rather than by a draw for every position.
+ */
+uint32_t linda_random_geometric(struct LindaRandom *random, double chance);
+
+/**
+ * The stream of the calling thread. The stream that a thread gets first is seeded by the
+ * seed of linda_random_seed_threads and the order in which the threads ask for one.
+ */
+struct LindaRandom *linda_random_thread();
+
+void linda_random_seed_threads(uint64_t seed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*PRNG_H_*/
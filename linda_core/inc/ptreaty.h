@@ -14,6 +14,15 @@ extern "C" {
 #include <inttypes.h>
 #include <pthread.h>
 	
+struct PtreatyContinuation;
+
+/**
+ * Besides threads that wait on the signal or ack condition, tasks can be registered as
+ * continuations by ptreaty_on_run and ptreaty_on_continue. Those are dispatched to the
+ * abbey by the same calls that would wake up a waiting thread. A run or continue that
+ * comes before any continuation is registered is remembered in pending_runs respectively
+ * pending_continues.
+ */
 struct SyncThreads {
 	pthread_mutex_t *request;
 	pthread_mutex_t *baton;
@@ -21,6 +30,10 @@ struct SyncThreads {
 	pthread_cond_t *ack;
 	uint8_t predicate;
 	uint8_t flags;
+	struct PtreatyContinuation *on_run;
+	struct PtreatyContinuation *on_continue;
+	uint8_t pending_runs;
+	uint8_t pending_continues;
 };
 
 void ptreaty_init(struct SyncThreads *st);
@@ -31,6 +44,10 @@ void ptreaty_add_thread(pthread_t *thread, const char *name);
 
 const char* ptreaty_get_thread_name(pthread_t *thread);
 
+void ptreaty_set_thread_name(const char *name);
+
+const char* ptreaty_thread_name();
+
 void ptreaty_hoist_flag(struct SyncThreads *st);
 
 uint8_t ptreaty_flag_hoisted(struct SyncThreads *st);
@@ -73,6 +90,11 @@ void ptreaty_should_be_first(struct SyncThreads *st);
 
 void ptreaty_should_be_later(struct SyncThreads *st);
 
+int ptreaty_on_run(struct SyncThreads *st, void *(*func)(void *), void *context, char *taskDesc);
+
+int ptreaty_on_continue(struct SyncThreads *st, void *(*func)(void *), void *context,
+		char *taskDesc);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,56 @@
+/**
+ * @file slab.h
+ * @brief Size-class allocator for the small contexts that are handed to tasks.
+ * @author Anne C. van Rossum
+ *
+ * Almost every task gets a small struct as context, like an InfoDefault or an InfoArray,
+ * that is allocated by the dispatcher and freed by the task. Those contexts are taken from
+ * slabs of equally sized objects. Every thread keeps a cache of free objects per size class,
+ * so allocating and freeing does not take a lock in the common case. A context may be freed
+ * by another thread than the one that allocated it.
+ *
+ * Besides that every thread has an arena, memory for scratch use within a task, that is
+ * given back in one go by linda_arena_release.
+ */
+
+#ifndef SLAB_H_
+#define SLAB_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/**
+ * The largest size that is served from the slabs, larger contexts are allocated by
+ * malloc, but can still be freed by linda_ctx_free.
+ */
+#define LINDA_CTX_MAX_SIZE		2048
+
+void *linda_ctx_alloc(size_t size);
+
+void *linda_ctx_calloc(size_t count, size_t size);
+
+void linda_ctx_free(void *ptr);
+
+/**
+ * A position in the arena of a thread. Everything allocated after the mark is given back
+ * by releasing it.
+ */
+struct LindaArenaMark {
+	void *chunk;
+	size_t used;
+};
+
+struct LindaArenaMark linda_arena_mark();
+
+void *linda_arena_alloc(size_t size);
+
+void linda_arena_release(struct LindaArenaMark mark);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*SLAB_H_*/
@@ -0,0 +1,124 @@
+/**
+ * @file stats.h
+ * @brief The counters of a running process, asked for with a message over the m-bus
+ * @author Anne C. van Rossum
+ *
+ * Every engine answers a LINDA_STATS_REQ with a LINDA_STATS_MSG to the source of the
+ * request, so a dashboard on the m-bus can watch the processes while they run, instead of
+ * reading their logs afterwards. The request is [0] LINDA_STATS_REQ, [1] the size, [2] the
+ * source, [3] the destination, [4] the flags and [5] a tag, which comes back in the reply.
+ * With LINDA_STATS_AGGREGATE in the flags, the Elinda engine asks all its controllers as
+ * well, and puts their answers in its reply.
+ *
+ * The reply starts with LINDA_STATS_HEADER bytes: the command, size, source and destination
+ * as usual, [4] LINDA_STATS_VERSION, [5] the tag, [6] the flags, [7] the kind of process and
+ * [8..11] the processor time of the process in milliseconds. A reply that does not fit in
+ * one message is sent as several, all but the last with LINDA_STATS_MORE in their flags.
+ * After the header come sections, each as its type in one byte, the length of its body in
+ * two and the body. A section of an unknown type can be skipped. All values are in network
+ * byte order, like a network frame, see netframe.h, durations are in microseconds.
+ *  - LINDA_STATS_ABBEY: the amount of monks and of busy monks in two bytes each, the amount
+ *    of priorities in one, and the amount of tasks queued per priority in four bytes each.
+ *  - LINDA_STATS_TASKS: per task description that ran, the amount of runs, the median and
+ *    the 99th percentile of the time those waited in a queue and of the time they ran, in
+ *    four bytes each, and then the description as its length in one byte and its characters.
+ *    The tasks that do not fit in a message continue in the next one, and so do the
+ *    channels.
+ *  - LINDA_STATS_CHANNELS: per channel in the bank, its id in two bytes, the messages in its
+ *    inbox and in its outbox and the messages that came in and went out in four bytes each,
+ *    and the bytes that came in and went out in eight bytes each.
+ *  - LINDA_STATS_COUNTERS: those of the engine, each as a name, its length in one byte and
+ *    its characters, and a value in eight bytes.
+ *  - LINDA_STATS_PROCESS: the answer of a controller in an aggregated reply, its id, its kind
+ *    and its processor time in four bytes, followed by the abbey and counter sections of its
+ *    own reply.
+ */
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+
+struct TcpipMessage;
+
+/**
+ * The message ids are shared by all engines, next to their own in tcpipmsg.h.
+ */
+#define LINDA_STATS_REQ			33
+#define LINDA_STATS_MSG			34
+
+#define LINDA_STATS_VERSION		1
+#define LINDA_STATS_REQ_SIZE	6
+#define LINDA_STATS_HEADER		12
+
+#define LINDA_STATS_AGGREGATE	0x01
+#define LINDA_STATS_MORE		0x01
+
+#define LINDA_STATS_ELINDA		1
+#define LINDA_STATS_COLINDA		2
+#define LINDA_STATS_FLINDA		3
+
+#define LINDA_STATS_ABBEY		1
+#define LINDA_STATS_TASKS		2
+#define LINDA_STATS_CHANNELS	3
+#define LINDA_STATS_COUNTERS	4
+#define LINDA_STATS_PROCESS		5
+
+//! The bytes a section takes before its body
+#define LINDA_STATS_SECTION		3
+
+struct TcpipMessage *linda_stats_request(uint8_t source, uint8_t destination, uint8_t flags,
+		uint8_t tag);
+
+/**
+ * A reply of the given kind to the request in msg, in parts of at most max_size bytes, see
+ * tcpip_max_message_size. The size bytes of sections in extra, the counters of the engine
+ * for example, come after the abbey section in the first part. The parts are returned in
+ * order, linked by their next fields, all but the last with LINDA_STATS_MORE. Push them one
+ * by one, a push clears next. Returns NULL without memory.
+ */
+struct TcpipMessage *linda_stats_reply(const struct TcpipMessage *request, uint8_t source,
+		uint8_t kind, const uint8_t *extra, uint16_t size, int max_size);
+
+/**
+ * A message with the header of a reply and the given sections.
+ */
+struct TcpipMessage *linda_stats_message(uint8_t source, uint8_t destination, uint8_t tag,
+		uint8_t flags, uint8_t kind, const uint8_t *sections, uint16_t size);
+
+/**
+ * Writes the header of a section of the given type at p, and returns where its body starts.
+ * The section is closed by linda_stats_close with the end of the body, which fills in its
+ * length.
+ */
+uint8_t *linda_stats_open(uint8_t *p, uint8_t type);
+
+uint8_t *linda_stats_close(uint8_t *body, uint8_t *end);
+
+/**
+ * Writes a counter of a counter section at p, returns where the next can be written. A
+ * counter takes 9 bytes and its name.
+ */
+uint8_t *linda_stats_counter(uint8_t *p, const char *name, uint64_t value);
+
+/**
+ * Writes the reply of a controller as a process section at p, if it fits in the space that
+ * is left, and returns the end of the section, or p if it does not fit.
+ */
+uint8_t *linda_stats_process(uint8_t *p, uint16_t space, const struct TcpipMessage *reply);
+
+/**
+ * Writes the reply as one line of JSON into text, without a newline at the end. Returns the
+ * length of the text, or -1 if the reply is damaged or does not fit.
+ */
+int linda_stats_json(const struct TcpipMessage *reply, char *text, int length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*STATS_H_*/
@@ -13,6 +13,7 @@ extern "C" {
 
 #include <pthread.h>
 #include <netinet/in.h>
+#include <inttypes.h>
 
 /************************************************************************************************
  *                      Defines
@@ -26,6 +27,48 @@ extern "C" {
 #define TCP_SERVER			2
 #define TCP_STOP_STREAM		1
 #define TCP_IDLE			0
+#define TCP_LOCAL			5
+#define TCP_MULTICAST		6
+#define TCP_HELLO			7
+
+/**
+ * Given to tcpip_get together with the server flag, for a channel to a process on the same
+ * machine. Such a channel is not a TCP/IP connection, but a pair of rings in shared memory,
+ * set up over a Unix socket named after the port. The peer has to be local as well.
+ */
+#define TCPIP_CHANNEL_LOCAL	0x02
+
+/**
+ * Given to tcpip_get for a channel that sends every message in one UDP datagram to a
+ * multicast group, with the server flag for a channel that joins the group and receives
+ * them. Datagrams may be lost, duplicated or reordered, and are never larger than
+ * TCPIP_DATAGRAM_MAX_SIZE, so they fit in one ethernet frame.
+ */
+#define TCPIP_CHANNEL_MULTICAST	0x04
+#define TCPIP_DATAGRAM_MAX_SIZE	1400
+
+/**
+ * Given to tcpip_get for a channel that greets its peer with a hello when it connects, see
+ * below. Only for a peer that is known to speak version 2, a version 1 peer would take the
+ * hello for a command.
+ */
+#define TCPIP_CHANNEL_HELLO		0x08
+
+/**
+ * The wire protocol. Version 1 frames are the message itself, so their size is limited by
+ * the size byte in payload[1]. A version 2 frame starts with TCPIP_FRAME_MARKER and the
+ * size of the message in two bytes, most significant first, followed by the message.
+ * A channel made with TCPIP_CHANNEL_HELLO sends a version 1 TCPIP_HELLO_MSG with its protocol
+ * version on connect, any other channel only answers a hello with its own. Both sides use
+ * version 2 frames only once the peer said it understands them. So a channel never sends a
+ * hello to a peer that did not greet it first, unless it is told to, and a version 1 peer
+ * sees nothing but version 1 frames.
+ */
+#define TCPIP_VERSION		2
+#define TCPIP_FRAME_MARKER	0xFE
+#define TCPIP_HELLO_MSG		0xFD
+#define TCPIP_V1_MAX_SIZE	257
+#define MAX_FRAME_SIZE		8192
 
 /************************************************************************************************
  *                      Data Structures
@@ -36,20 +79,50 @@ extern "C" {
  * payload, also if the first items are command or identifier-like. And they are. This is needed
  * because a TCP/IP package may be of different size. The payload[0] value is considered to be
  * a command in tcpip.c and payload[1] the size of the rest of the command. Hence, the value of
- * size over here is 2 more than the value in payload[1].
+ * size over here is 2 more than the value in payload[1]. Messages above TCPIP_V1_MAX_SIZE
+ * bytes can only be sent to version 2 peers, for them payload[1] is just 255.
+ *
+ * The payload lies in a reference-counted buffer (see buffer.h), which may be shared with
+ * other messages. Allocate messages with tcpip_alloc_msg, and let a message point into the
+ * payload of another with tcpip_slice_msg, to forward or to read part of it without a copy.
  */
 struct TcpipMessage {
-	unsigned char size;
+	uint16_t size;
 	unsigned char *payload;
 	struct TcpipMessage *next;
+	struct LindaBuffer *buffer;
 };
 
+/**
+ * A mailbox is an intrusive queue of messages, linked by their next fields, to which any
+ * thread can push without a lock. Last is the message that is pushed most recently, first
+ * the one that is popped next, or the stub when the queue is drained up to the stub. The
+ * lock only serializes the threads that take messages out. Depth is the amount of messages
+ * in the mailbox, it can be ahead by the messages that are being pushed at that moment.
+ */
 struct TcpipMailbox {
+	struct TcpipMessage *volatile last;
 	struct TcpipMessage *first;
-	struct TcpipMessage *last;
+	struct TcpipMessage stub;
+	volatile int depth;
 	pthread_mutex_t *lock;
 };
 
+struct TcpipReader;
+struct LindaBuffer;
+
+/**
+ * A connection. Once connected, the socket is watched by the reactor thread of tcpip.c, which
+ * reads incoming frames into the inbox. The state of a frame that is partially received is
+ * kept in reader. For a local channel the read and write descriptors are eventfds, that tell
+ * there is something in the rings in shared memory. A multicast channel has no peer, the
+ * group is in serv_addr for the sender and in cli_addr for a receiver. The messages and bytes
+ * that came in and went out are counted for the statistics of the process, see stats.h.
+ * The socket is counted by refs: the bank holds one, see tcpipbank.h, and so does every task
+ * that is dispatched with it. It is freed by the last tcpip_release. callbackLost is not
+ * dispatched but called right away, before the socket is started again, so it comes before
+ * the callbackConnect of the next connection, and should only note the loss.
+ */
 struct TcpipSocket {
 	int port_nr;
 	struct sockaddr_in serv_addr, cli_addr;
@@ -60,8 +133,18 @@ struct TcpipSocket {
 	void *(*callbackIn)(void*);
 	void *(*callbackOut)(void*);
 	void *(*callbackConnect)(void*);
+	void *(*callbackLost)(void*);
 	struct SyncThreads *sync;
 	int trials;
+	struct TcpipReader *reader;
+	uint8_t peer_version;
+	//! Whether this side sent its hello on the current connection
+	uint8_t hello_sent;
+	volatile uint8_t flush_scheduled;
+	volatile uint32_t messages_in, messages_out;
+	volatile uint64_t bytes_in, bytes_out;
+	volatile int refs;
+	volatile uint8_t closed;
 };
 
 struct InfoSockAndMsg {
@@ -98,14 +181,34 @@ void *tcpip_retrieve_packets(void* context);
 
 void *tcpip_send_packets(void* context); 
 
+void tcpip_flush(struct TcpipSocket *tcpSocket);
+
 void tcpip_close_all(struct TcpipSocket *tcpSocket);
 
+void tcpip_free(struct TcpipSocket *tcpSocket);
+
+/**
+ * A socket starts with one reference, of its creator, which is handed over to the bank by
+ * tcpipbank_add.
+ */
+void tcpip_hold(struct TcpipSocket *tcpSocket);
+
+void tcpip_release(struct TcpipSocket *tcpSocket);
+
+int tcpip_max_message_size(struct TcpipSocket *tcpSocket);
+
 /************************************************************************************************
  *                      External Function Declarations (for mailboxes)
  ************************************************************************************************/
 
+struct TcpipMessage *tcpip_alloc_msg(int size);
+
+struct TcpipMessage *tcpip_slice_msg(struct TcpipMessage *msg, int offset, int size);
+
 void freemsg(struct TcpipMessage *m);
 
+void tcpip_init_mailbox(struct TcpipMailbox *M);
+
 void push (struct TcpipMailbox *M, struct TcpipMessage *m);
 
 int count(struct TcpipMailbox *M);
@@ -8,30 +8,36 @@ extern "C" {
 #include <tcpip.h>
 #include <inttypes.h>
 
-struct TcpipSocket_LI;
-
-struct TcpipSocket_LI {
-	struct TcpipSocket_LI* next;
-	struct TcpipSocket *item;
-	uint8_t id;
-};
-
-struct Sockets {
-	struct TcpipSocket_LI* first;
-	struct TcpipSocket_LI* last;
-};
-
-struct Sockets sockets;
+/**
+ * Channel ids on the wire are one byte, but a process can hold more connections than that,
+ * so the bank takes ids up to TCPIPBANK_MAX_ID. The functions take an unsigned int, callers
+ * with a uint8_t id do not need to change.
+ */
+#define TCPIPBANK_MAX_ID		65536
 
 void initSockets();
 
-//struct TcpipSocket* tcpipbank_create();
+int tcpipbank_add(struct TcpipSocket *sock, unsigned int id);
+
+void tcpipbank_del(unsigned int id);
 
-void tcpipbank_add(struct TcpipSocket *sock, uint8_t id);
+/**
+ * The socket of a channel, without a reference, so it can be used as long as the channel is
+ * not deleted.
+ */
+struct TcpipSocket* tcpipbank_get(unsigned int id);
 
-void tcpipbank_del(uint8_t id);
+/**
+ * The socket of a channel with a reference, which the caller gives back by tcpip_release,
+ * also if the channel is deleted in the meantime. Returns NULL if there is no such channel.
+ */
+struct TcpipSocket* tcpipbank_hold(unsigned int id);
 
-struct TcpipSocket* tcpipbank_get(uint8_t id);
+/**
+ * Writes the ids of up to max channels in the bank to ids, in ascending order, and returns
+ * how many there are. A channel that is added or deleted meanwhile may be missed.
+ */
+unsigned int tcpipbank_ids(unsigned int *ids, unsigned int max);
 
 #ifdef __cplusplus
 }
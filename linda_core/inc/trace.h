@@ -0,0 +1,57 @@
+/**
+ * @file trace.h
+ * @brief Execution tracing in the Chrome trace format, which Perfetto can load.
+ * @author Anne C. van Rossum
+ *
+ * Tracing is off unless it is started, by linda_trace_init when the LINDA_TRACE environment
+ * variable names a directory, or by linda_trace_start. Every process writes its own file,
+ * trace-<process>-<pid>.json. Events are recorded into a binary buffer per thread, and only
+ * formatted when such a buffer is flushed. The time stamps are taken from CLOCK_MONOTONIC,
+ * which is shared by all processes on one machine, so the files of elinda, the colinda's
+ * and flinda can be merged into one timeline by concatenating their event arrays.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <inttypes.h>
+
+#define LINDA_TRACE_SEND		0
+#define LINDA_TRACE_RECEIVE		1
+
+/**
+ * Set while tracing, the trace routines should only be called when it is. An unset
+ * flag costs the callers no more than this check.
+ */
+extern volatile uint8_t lindaTraceEnabled;
+
+int linda_trace_init(const char *process);
+
+int linda_trace_start(const char *directory, const char *process);
+
+void linda_trace_stop();
+
+unsigned long long linda_trace_clock_ns();
+
+/**
+ * Records a task, or anything else with a name, that ran from start to end. The name is
+ * not copied, it should stay valid, like a task description or __func__.
+ */
+void linda_trace_span(const char *name, const char *category, unsigned long long start_ns,
+		unsigned long long end_ns);
+
+/**
+ * Records a message that is sent or received. The type is in payload[0], the source and
+ * destination ids in payload[2] and payload[3].
+ */
+void linda_trace_message(uint8_t direction, const unsigned char *payload, int size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*TRACE_H_*/
@@ -4,29 +4,44 @@
  * \ingroup AbbeyCore
  */
 
+#define _GNU_SOURCE  //for pthread_setaffinity_np
 #include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>  //for variadic functions
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <time.h>
 #include <abbey.h>
 #include <ptreaty.h>
-
-//! Task slot is ready to be filled with new task
-#define TS_READY    0
-//! Task slot is being filled with new task
-#define TS_CREATING 1
-//! Task (slot) is open to be handled by a monk
-#define TS_OPEN     2
-//! Task (slot) is being handled by a monk
-#define TS_BUSY     3
+#include <log.h>
+#include <trace.h>
 
 //! The debug flag that prints more or less information
 #define DEBUG_ABBEY 0
 //! Boolean true=1 for readability
 #define true 1
-//! Task description parameter is a char array of fixed length
+//! Descriptions are truncated to this length in the statistics
 #define MAX_TASK_DESCRIPTION_LEN 64
+//! Upper bound on the amount of monks, the monk table is never reallocated
+#define MAX_MONKS 256
+//! Initial capacity of a task deque, should be a power of two
+#define DEFAULT_DEQUE_SIZE 16
+//! Every level of the timer wheel has 2^TIMER_WHEEL_BITS slots
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SIZE (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SIZE - 1)
+//! With four levels and ticks of a millisecond the wheel spans 4.6 hours
+#define TIMER_WHEEL_LEVELS 4
+//! Size of the open addressing table that maps descriptions to statistics
+#define STATS_HASH_SIZE 256
+//! Buckets of the descriptor registry and entries of the per thread cache
+#define DESCRIPTOR_HASH_SIZE 256
+#define DESCRIPTOR_CACHE_SIZE 64
 
 /**
  * Pointer Algorithmitic Reminder...
@@ -44,280 +59,1504 @@
  */
 
 /**
- * The task has a state, a function pointer and a context pointer. The latter
- * is used on the later evocation moment to be passed as argument to the
- * function.
+ * A continuation that is scheduled by abbey_when_all once all handles it
+ * waits for are done. The remaining counter is decremented atomically by
+ * the completing tasks.
+ */
+struct AbbeyJoin {
+	volatile int remaining;
+	const struct AbbeyTaskDescriptor *descriptor;
+	void *context;
+};
+
+/**
+ * An entry in the list of continuations that wait for a handle.
+ */
+struct AbbeyWaiter {
+	struct AbbeyJoin *join;
+	struct AbbeyWaiter *next;
+};
+
+/**
+ * The handle of a joinable task. It is referenced by the caller and by the
+ * task in the queue, the last one to let go frees it. The result is the
+ * return value of the function of the task. The task is run by whoever
+ * claims it first, a monk that finds it or the thread that joins it, which
+ * is why the handle keeps the descriptor and the context as well.
+ */
+struct AbbeyHandle {
+	volatile int done;
+	void *result;
+	volatile int refs;
+	volatile int claimed;
+	const struct AbbeyTaskDescriptor *descriptor;
+	void *context;
+	unsigned long long enqueued;
+	struct AbbeyWaiter *waiters;
+};
+
+/**
+ * The task has a descriptor, with the function pointer, and a context
+ * pointer. The latter is used on the later evocation moment to be passed as
+ * argument to the function. Tasks are copied by value into and out of the
+ * deques, so a monk that is executing a task never refers to a slot that
+ * might be moved by a growing deque. The handle is NULL for tasks that can
+ * not be joined.
  */
 typedef struct {
-	//! The state field flags if a task slot is occupied, a monk is busy, etc.
-	int state;
-	//! A pointer to a function to be executed.
-	void *(*func)(void *);
+	//! The interned descriptor with the function to be executed.
+	const struct AbbeyTaskDescriptor *descriptor;
 	//! A void pointer to the arguments of the to be executed function.
 	void *context;
-	//! Description of the task.
-	char description[MAX_TASK_DESCRIPTION_LEN];
+	//! Handle to signal completion to, for joinable tasks.
+	struct AbbeyHandle *handle;
+	//! Time of dispatch in nanoseconds, for the queue wait statistics.
+	unsigned long long enqueued;
 } Task;
 
 /**
- * This abbey uses threads from the pThread library. The pointer pthread_t
- * points to the first thread in the thread pool. Its size is determined once
- * depending on the number of monks in the abbey_init method. The task pointer
- * points to a bunch of tasks to be performed.
- */
-static pthread_t *threadId;
-static Task *task;
-static int nofMonks, nofTasks;
+ * A double-ended queue of tasks. The owning monk pushes and pops at the
+ * bottom (last in, first out, which keeps the data of a task and the one it
+ * dispatched warm in the cache), while idle monks steal from the top. The
+ * slot array is a ring with a power of two capacity, head and tail only
+ * increase and are masked on access. Each deque has its own lock, so there
+ * is contention only when a monk is robbed.
+ */
+typedef struct {
+	pthread_mutex_t lock;
+	Task *slot;
+	int capacity;
+	volatile int head;
+	volatile int tail;
+} TaskDeque;
+
+/**
+ * One cell of a task ring. The sequence number tells producers and
+ * consumers whose turn it is for this cell, see the ring routines below.
+ */
+typedef struct {
+	volatile unsigned int sequence;
+	Task task;
+} TaskCell;
+
+/**
+ * A bounded ring of task cells. Producers claim a cell by a compare and
+ * swap on enqueuePos, consumers by a compare and swap on dequeuePos, there
+ * is no lock. The positions are kept apart so they do not share a cache
+ * line. When a segment is full it is not reallocated, but a bigger segment
+ * is linked behind it.
+ */
+typedef struct TaskSegment {
+	TaskCell *cell;
+	unsigned int mask;
+	char pad0[64];
+	volatile unsigned int enqueuePos;
+	char pad1[64];
+	volatile unsigned int dequeuePos;
+	char pad2[64];
+	struct TaskSegment *volatile next;
+} TaskSegment;
+
+/**
+ * The multi-producer, multi-consumer task ring, a chain of segments that
+ * only ever grows. Segments are never moved or freed while the abbey lives,
+ * so a task that is being copied in or out of a cell can not be invalidated
+ * by growth. Each segment doubles the capacity of the previous one, so the
+ * chain stays short: the amount of segments is logarithmic in the highest
+ * amount of queued tasks.
+ */
+typedef struct {
+	TaskSegment *first;
+	TaskSegment *volatile last;
+	pthread_mutex_t growLock;
+	volatile int count;
+} TaskRing;
+
+/**
+ * A monk owns a thread and a deque per priority. Tasks dispatched from
+ * within a task that runs on this monk end up in its own deques. A monk
+ * only runs tasks with a priority up to and including lowestPriority, for
+ * a dedicated monk this is ABBEY_PRIORITY_IO or ABBEY_PRIORITY_REALTIME.
+ */
+typedef struct {
+	pthread_t thread;
+	TaskDeque deque[ABBEY_PRIORITY_COUNT];
+	int lowestPriority;
+	int id;
+	//! A retired monk leaves its slot (and empty deques) behind for reuse
+	volatile int alive;
+	//! Statistics per kind of task, only written by the monk itself
+	struct AbbeyTaskStats *stats[ABBEY_STATS_MAX_KINDS];
+} Monk;
+
+/**
+ * A delayed or periodic task. Expires is the absolute tick (in milliseconds
+ * since the timer thread started) at which the task is dispatched, a period
+ * of zero means it is dispatched only once. A cancelled timer is not touched
+ * by the caller anymore. It is freed right away if it is in the wheel,
+ * otherwise by the timer thread, which has it in hand then.
+ */
+struct AbbeyTimer {
+	struct AbbeyTimer *next;
+	unsigned long expires;
+	unsigned long period;
+	const struct AbbeyTaskDescriptor *descriptor;
+	void *context;
+	volatile int cancelled;
+};
+
+/**
+ * An entry in the registry of descriptors. Entries are never removed, so a
+ * descriptor can be referred to by any task at any time.
+ */
+typedef struct DescriptorEntry {
+	struct AbbeyTaskDescriptor descriptor;
+	struct DescriptorEntry *next;
+} DescriptorEntry;
+
+/**
+ * A thread remembers the descriptors it used for a function, a description
+ * and a priority, so dispatching by description only compares pointers and
+ * the (short) description itself rather than going to the registry.
+ */
+typedef struct {
+	void *(*func)(void *);
+	const char *name;
+	int priority;
+	const struct AbbeyTaskDescriptor *descriptor;
+} DescriptorCacheEntry;
+
+/**
+ * This abbey uses threads from the pThread library. The monk table has a
+ * fixed size, so pointers to monks (and to their pthread_t which is
+ * registered with ptreaty) stay valid when monks are added. Tasks that are
+ * dispatched from threads that are not monks, like the main thread, go into
+ * the shared ring of their priority. The abbey mutex and condition variables
+ * are only used to let idle monks sleep and to wake them up. Dedicated monks
+ * sleep on their own condition, so a bulk task never wakes a monk that is
+ * not allowed to run it.
+ */
+static Monk *monks[MAX_MONKS];
+static volatile int nofMonks;
+static TaskRing sharedRing[ABBEY_PRIORITY_COUNT];
 static pthread_mutex_t abbeyMutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t  abbeyCond  = PTHREAD_COND_INITIALIZER;
-static int taskBufferContent = 4, *taskBuffer = &taskBufferContent;
-static int dedicatedTaskBuffer = 2;
-static int amountOfMonksBusy = 0;
+static pthread_cond_t  dedicatedCond  = PTHREAD_COND_INITIALIZER;
+static volatile int sleepingMonks = 0;
+static volatile int sleepingDedicatedMonks = 0;
+static int dedicatedPriority = ABBEY_PRIORITY_COUNT - 1;
+static volatile int amountOfMonksBusy = 0;
+static volatile int liveMonks = 0;
+static struct AbbeyConfig abbeyConfig;
+
+/**
+ * Completion of joinable tasks is protected by its own mutex, so it never
+ * interferes with monks going to sleep. The condition is only broadcast if
+ * somebody is actually joining.
+ */
+static pthread_mutex_t handleMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  handleCond  = PTHREAD_COND_INITIALIZER;
+static volatile int joiningThreads = 0;
+
+/**
+ * The hierarchical timer wheel. Level 0 has a slot per tick, a slot at level
+ * n covers 2^(n*TIMER_WHEEL_BITS) ticks. When the lower level wraps around,
+ * the timers of the next slot of the level above are cascaded down, so a
+ * timer is moved at most TIMER_WHEEL_LEVELS times and adding or expiring one
+ * is O(1). The wheel belongs to the timer thread and is protected by the
+ * timer mutex. The timer thread sleeps until the next tick at which a slot
+ * expires or cascades, or indefinitely if there are no timers at all, so a
+ * monk never has to sleep for a delay itself.
+ */
+static struct AbbeyTimer *timerWheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE];
+static unsigned long timerTick = 0;
+//! The tick the timer thread sleeps until, earlier timers have to wake it up
+static unsigned long timerDeadline = ULONG_MAX;
+static int pendingTimers = 0;
+static struct timespec timerEpoch;
+static pthread_t timerThread;
+static int timerThreadStarted = 0;
+static pthread_mutex_t timerMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  timerCond;
+
+/**
+ * The kinds of tasks for the statistics, one per description. Kinds are
+ * only ever added, under the stats mutex, and looked up without a lock via
+ * a hash of the description. The name of a kind is written before its index
+ * is published in the hash table.
+ */
+static char statsKind[ABBEY_STATS_MAX_KINDS][MAX_TASK_DESCRIPTION_LEN];
+static volatile int nofStatsKinds = 0;
+static volatile unsigned char statsHash[STATS_HASH_SIZE];
+static pthread_mutex_t statsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+//! The registry of descriptors, a chained hash table
+static DescriptorEntry *descriptorTable[DESCRIPTOR_HASH_SIZE];
+static pthread_mutex_t descriptorMutex = PTHREAD_MUTEX_INITIALIZER;
+static __thread DescriptorCacheEntry descriptorCache[DESCRIPTOR_CACHE_SIZE];
+
+//! The monk that runs on the current thread, NULL for other threads
+static __thread Monk *self = NULL;
 
-static void *increaseTaskBuffer(void* context);
 static void *monk(void *arg);
 
-#if DEBUG_ABBEY > 0
-void print_tasks() {
-	int i;
-	printf("Tasks:\n");
-	for(i = dedicatedTaskBuffer; i < nofTasks; i++) {
-		printf(" %i: %s\n", i, task[i].description);
-	}
+/*! \brief Initialize an empty deque
+ */
+static int deque_init(TaskDeque *dq, int capacity) {
+	pthread_mutex_init(&dq->lock, NULL);
+	dq->slot = (Task *)calloc(capacity, sizeof(Task));
+	if (dq->slot == NULL) return -1;
+	dq->capacity = capacity;
+	dq->head = dq->tail = 0;
+	return 0;
 }
-#endif
 
-/*! \brief
- * In setTaskState a monk wants to change the state of a task. It may
- * have executed it, it may be busy with it, whatever. To prevent that
- * multiple monks start on the same task, there is a mutex within this
- * method. Although a monk may have choosen to do this task, it may
- * encounter a lock, because another monk is busy with it. The mutex is
- * "abbey broad". This means that it is not possible that a monk starts
- * with a task during this period in testAndSetTask.
+/*! \brief The amount of tasks in a deque
+ *
+ * Read without taking the lock, so it is only a hint. It is used to decide
+ * if a monk may go to sleep, which is safe because the deque is checked
+ * again before blocking.
  */
-static int set_task_state(int taskId, int state) {
-	pthread_mutex_lock(&abbeyMutex);
+static int deque_size(TaskDeque *dq) {
+	return dq->tail - dq->head;
+}
+
+/*! \brief Double the ring, must be called with the deque lock held
+ */
+static int deque_grow(TaskDeque *dq) {
+	int i, capacity = dq->capacity * 2;
+	Task *slot = (Task *)calloc(capacity, sizeof(Task));
+	if (slot == NULL) {
+		printf("Abbey Error: Couldn't increase task deque...\n");
+		return -1;
+	}
+	for (i = dq->head; i != dq->tail; i++) {
+		slot[i & (capacity - 1)] = dq->slot[i & (dq->capacity - 1)];
+	}
+	free(dq->slot);
+	dq->slot = slot;
+	dq->capacity = capacity;
 #if DEBUG_ABBEY > 0
-	printf("Abbey: Set task %d to state %d.\n", taskId, state);
+	printf("Abbey: Deque is increased to %d tasks.\n", capacity);
 #endif
-	task[taskId].state = state;
-	pthread_cond_broadcast(&abbeyCond);
-	pthread_mutex_unlock(&abbeyMutex);
 	return 0;
 }
 
-/*! \brief
- * The testAndSetTask routine is called from two different places. From
- * the routines *monk and dispatchTask. *monk sets a task state from
- * open to busy. The boolean mayFail is set to true, so failure in the
- * sense of not finding a task in an open state, does result in a
- * conditional wait, not in an exception. dispatchTask sets a task state
- * from ready to creating, and calls afterwards setTaskState to set it
- * to open. Between that it assigns the context, func and description
- * attributes of the task.
+/*! \brief Fill in a task
+ */
+static void task_fill(Task *t, const struct AbbeyTaskDescriptor *descriptor,
+		void *context, struct AbbeyHandle *handle, unsigned long long stamp) {
+	t->descriptor = descriptor;
+	t->context = context;
+	t->handle = handle;
+	t->enqueued = stamp;
+}
+
+/*! \brief Push n tasks at the bottom of a deque
  *
- * @remark There is a habit to use while(-1) instead of while(1), that is
- * less naturally read as while(true).
+ * All tasks are pushed within one acquisition of the deque lock. The
+ * handles array may be NULL.
  */
-static int find_task_and_change_state(int state, int newState, int mayFail) {
+static int deque_push(TaskDeque *dq, const struct AbbeyTaskDescriptor **descriptors,
+		void **contexts, struct AbbeyHandle **handles, int n, unsigned long long stamp) {
 	int i;
-	pthread_mutex_lock(&abbeyMutex);
+	pthread_mutex_lock(&dq->lock);
+	for (i = 0; i < n; i++) {
+		if (deque_size(dq) == dq->capacity && deque_grow(dq)) {
+			pthread_mutex_unlock(&dq->lock);
+			return -1;
+		}
+		task_fill(&dq->slot[dq->tail & (dq->capacity - 1)], descriptors[i], contexts[i],
+				(handles == NULL) ? NULL : handles[i], stamp);
+		dq->tail++;
+	}
+	pthread_mutex_unlock(&dq->lock);
+	return 0;
+}
+
+/*! \brief Pop the most recently pushed task, used by the owner
+ */
+static int deque_pop_bottom(TaskDeque *dq, Task *t) {
+	if (!deque_size(dq)) return 0;
+	pthread_mutex_lock(&dq->lock);
+	if (!deque_size(dq)) {
+		pthread_mutex_unlock(&dq->lock);
+		return 0;
+	}
+	dq->tail--;
+	*t = dq->slot[dq->tail & (dq->capacity - 1)];
+	pthread_mutex_unlock(&dq->lock);
+	return 1;
+}
+
+/*! \brief Pop the oldest task, used by thieves
+ */
+static int deque_pop_top(TaskDeque *dq, Task *t) {
+	if (!deque_size(dq)) return 0;
+	pthread_mutex_lock(&dq->lock);
+	if (!deque_size(dq)) {
+		pthread_mutex_unlock(&dq->lock);
+		return 0;
+	}
+	*t = dq->slot[dq->head & (dq->capacity - 1)];
+	dq->head++;
+	pthread_mutex_unlock(&dq->lock);
+	return 1;
+}
+
+/*! \brief Allocate a segment with a power of two amount of cells
+ *
+ * The sequence number of a cell starts at its index, which marks it as free
+ * for the producer that claims that position.
+ */
+static TaskSegment *segment_alloc(unsigned int capacity) {
+	unsigned int i;
+	TaskSegment *seg = (TaskSegment *)calloc(1, sizeof(TaskSegment));
+	if (seg == NULL) return NULL;
+	seg->cell = (TaskCell *)calloc(capacity, sizeof(TaskCell));
+	if (seg->cell == NULL) {
+		free(seg);
+		return NULL;
+	}
+	for (i = 0; i < capacity; i++) {
+		seg->cell[i].sequence = i;
+	}
+	seg->mask = capacity - 1;
+	return seg;
+}
+
+/*! \brief Put a task in a segment, returns 0 if the segment is full
+ *
+ * A producer may fill the cell at position pos, if the sequence number of
+ * that cell equals pos. After copying the task the sequence is set to pos+1,
+ * which hands the cell over to the consumer of that position.
+ */
+static int segment_push(TaskSegment *seg, Task *t) {
+	TaskCell *cell;
+	unsigned int pos = seg->enqueuePos;
 	while(true) {
-		for(i = dedicatedTaskBuffer; i < nofTasks; i++) {
-			if(task[i].state == state) {
+		cell = &seg->cell[pos & seg->mask];
+		int dif = (int)(cell->sequence - pos);
+		if (dif == 0) {
+			if (__sync_bool_compare_and_swap(&seg->enqueuePos, pos, pos + 1)) break;
+			pos = seg->enqueuePos;
+		} else if (dif < 0) {
+			return 0;
+		} else {
+			pos = seg->enqueuePos;
+		}
+	}
+	cell->task = *t;
+	__sync_synchronize();
+	cell->sequence = pos + 1;
+	return 1;
+}
+
+/*! \brief Get a task from a segment, returns 0 if the segment is empty
+ *
+ * A consumer may empty the cell at position pos, if its sequence number is
+ * pos+1. Afterwards the sequence is set to pos+capacity, the position the
+ * producer has in the next round around the ring.
+ */
+static int segment_pop(TaskSegment *seg, Task *t) {
+	TaskCell *cell;
+	unsigned int pos = seg->dequeuePos;
+	while(true) {
+		cell = &seg->cell[pos & seg->mask];
+		int dif = (int)(cell->sequence - (pos + 1));
+		if (dif == 0) {
+			if (__sync_bool_compare_and_swap(&seg->dequeuePos, pos, pos + 1)) break;
+			pos = seg->dequeuePos;
+		} else if (dif < 0) {
+			return 0;
+		} else {
+			pos = seg->dequeuePos;
+		}
+	}
+	*t = cell->task;
+	__sync_synchronize();
+	cell->sequence = pos + seg->mask + 1;
+	return 1;
+}
+
+/*! \brief Initialize a ring with one segment
+ */
+static int ring_init(TaskRing *ring, unsigned int capacity) {
+	pthread_mutex_init(&ring->growLock, NULL);
+	ring->first = ring->last = segment_alloc(capacity);
+	ring->count = 0;
+	return (ring->first == NULL) ? -1 : 0;
+}
+
+/*! \brief The amount of tasks in the ring, a hint just as deque_size
+ */
+static int ring_size(TaskRing *ring) {
+	return ring->count;
+}
+
+/*! \brief Put a task in the first segment that has room
+ *
+ * If all segments are full, a segment twice the size of the last one is
+ * linked behind it. The grow lock is only taken in that case, and only to
+ * make sure that not every producer that finds the ring full adds a segment.
+ */
+static int ring_push(TaskRing *ring, Task *t) {
+	TaskSegment *seg;
+	while(true) {
+		for (seg = ring->first; seg != NULL; seg = seg->next) {
+			if (segment_push(seg, t)) {
+				__sync_add_and_fetch(&ring->count, 1);
+				return 0;
+			}
+		}
+		seg = ring->last;
+		pthread_mutex_lock(&ring->growLock);
+		if (seg == ring->last) {
+			TaskSegment *next = segment_alloc((seg->mask + 1) * 2);
+			if (next == NULL) {
+				printf("Abbey Error: Couldn't increase task ring...\n");
+				pthread_mutex_unlock(&ring->growLock);
+				return -1;
+			}
 #if DEBUG_ABBEY > 0
-				printf("Abbey: Set task %d from state %d to state %d.\n", i, state, newState);
+			printf("Abbey: Task ring is increased with %d tasks.\n", next->mask + 1);
 #endif
-				task[i].state = newState;
-				pthread_cond_broadcast(&abbeyCond);
-				pthread_mutex_unlock(&abbeyMutex);
-				return i;
-			}
+			__sync_synchronize();
+			seg->next = next;
+			ring->last = next;
+		}
+		pthread_mutex_unlock(&ring->growLock);
+	}
+}
+
+/*! \brief Get a task from the first segment that has one
+ */
+static int ring_pop(TaskRing *ring, Task *t) {
+	TaskSegment *seg;
+	if (!ring_size(ring)) return 0;
+	for (seg = ring->first; seg != NULL; seg = seg->next) {
+		if (segment_pop(seg, t)) {
+			__sync_sub_and_fetch(&ring->count, 1);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*! \brief Check if there is work in the abbey up to a certain priority
+ */
+static int abbey_has_work(int lowestPriority) {
+	int i, p, count = nofMonks;
+	for (p = 0; p <= lowestPriority; p++) {
+		if (ring_size(&sharedRing[p])) return 1;
+		for (i = 0; i < count; i++) {
+			if (deque_size(&monks[i]->deque[p])) return 1;
 		}
-		if(mayFail || !dedicatedTaskBuffer)
-			pthread_cond_wait(&abbeyCond, &abbeyMutex);
-		else {
-			printf("Abbey Error: Find_task_and_change_state(): Failed to find a ");
-			printf("task in the state %d for new state %d.\n", state, newState);
-			printf("This probably means that tasks are input in a faster rate than ");
-			printf("the monks can process.\n");
+	}
+	return 0;
+}
+
+/*! \brief Wake up at most n sleeping monks
+ *
+ * The full barrier makes sure that either the dispatcher sees the monk that
+ * is about to sleep, or the monk sees the task that has just been pushed.
+ * Monks that are awake will find the tasks by themselves, so there is no
+ * need to wake more monks than there are new tasks, and there is never a
+ * broadcast to all of them.
+ */
+static void wake_monks(int n, int priority) {
+	int dedicated = 0;
+	__sync_synchronize();
+	if (priority <= dedicatedPriority) dedicated = sleepingDedicatedMonks;
+	if (!sleepingMonks && !dedicated) return;
+	pthread_mutex_lock(&abbeyMutex);
+	if (priority <= dedicatedPriority) {
+		dedicated = (n > sleepingDedicatedMonks) ? sleepingDedicatedMonks : n;
+		n -= dedicated;
+		while (dedicated--) {
+			pthread_cond_signal(&dedicatedCond);
+		}
+	}
+	if (n > sleepingMonks) n = sleepingMonks;
+	while (n-- > 0) {
+		pthread_cond_signal(&abbeyCond);
+	}
+	pthread_mutex_unlock(&abbeyMutex);
+}
 
+/*! \brief Find a task for a monk
+ *
+ * The priorities are visited from high (realtime) to low (bulk), so a
+ * realtime task anywhere in the abbey goes before a bulk task in the own
+ * deque. Per priority the monk looks first in its own deque, then in the
+ * shared ring where tasks from outside the abbey arrive, and at last it
+ * tries to steal from the other monks. The victims are visited starting at
+ * the neighbour of the monk, so thieves do not all queue up at the same
+ * deque.
+ */
+static int find_task(Monk *m, Task *t) {
+	int i, p, count;
+	for (p = 0; p <= m->lowestPriority; p++) {
+		if (deque_pop_bottom(&m->deque[p], t)) return 1;
+		if (ring_pop(&sharedRing[p], t)) return 1;
+		count = nofMonks;
+		for (i = 1; i < count; i++) {
+			Monk *victim = monks[(m->id + i) % count];
+			if (deque_pop_top(&victim->deque[p], t)) {
 #if DEBUG_ABBEY > 0
-			print_tasks();
+				printf("Abbey: Monk %d steals task from monk %d.\n", m->id, victim->id);
 #endif
-			//of course no exception, but counter measures
-			dedicatedTaskBuffer = 0;
-//			pthread_mutex_unlock(&abbeyMutex);
-			//dispatch_task(*increaseTaskBuffer, taskBuffer);
-			increaseTaskBuffer(taskBuffer);
-			pthread_mutex_unlock(&abbeyMutex);
-			//printf("Dedicated task did run.\n\n");
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
 
+/*! \brief Let an idle monk sleep until there is work it is allowed to do
+ *
+ * If there are more monks than the minimum, the monk only waits for the idle
+ * timeout. If there is still nothing to do afterwards, the monk retires and
+ * this routine returns 1. Dedicated monks never retire.
+ */
+static int wait_for_task(Monk *m) {
+	int retire = 0;
+	pthread_mutex_lock(&abbeyMutex);
+	int dedicated = (m->lowestPriority < ABBEY_PRIORITY_COUNT - 1);
+	volatile int *sleeping = dedicated ? &sleepingDedicatedMonks : &sleepingMonks;
+	pthread_cond_t *cond = dedicated ? &dedicatedCond : &abbeyCond;
+	__sync_add_and_fetch(sleeping, 1);
+	__sync_synchronize();
+	if (!abbey_has_work(m->lowestPriority)) {
+		if (dedicated || !abbeyConfig.idle_timeout_ms ||
+				liveMonks <= abbeyConfig.min_monk_count) {
+			pthread_cond_wait(cond, &abbeyMutex);
+		} else {
+			struct timeval now;
+			struct timespec timeout;
+			gettimeofday(&now, NULL);
+			long usec = now.tv_usec + (abbeyConfig.idle_timeout_ms % 1000) * 1000;
+			timeout.tv_sec = now.tv_sec + abbeyConfig.idle_timeout_ms / 1000 + usec / 1000000;
+			timeout.tv_nsec = (usec % 1000000) * 1000;
+			if (pthread_cond_timedwait(cond, &abbeyMutex, &timeout) == ETIMEDOUT &&
+					liveMonks > abbeyConfig.min_monk_count &&
+					!abbey_has_work(m->lowestPriority)) {
+				retire = 1;
+				liveMonks--;
+				m->alive = 0;
+			}
 		}
 	}
+	__sync_sub_and_fetch(sleeping, 1);
+	pthread_mutex_unlock(&abbeyMutex);
+#if DEBUG_ABBEY > 0
+	if (retire) printf("Abbey: Monk %d retires.\n", m->id);
+#endif
+	return retire;
 }
 
-/*! \brief Task buffer increase
+/*! \brief Pin the calling monk to a processor
  *
- * Increases the task buffer with a certain amount, the void pointer should be
- * castable to an int pointer.
+ * Monk i runs on processor first_cpu + (i % cpu_count), so several processes
+ * on one host can each be given their own range of cores.
  */
-static void *increaseTaskBuffer(void* context) {
-	int amount = *(int*) context;
-	printf("The task buffer is increased from %d to %d\n", nofTasks, nofTasks + amount);
-	Task *newtask = (Task *) realloc(task, sizeof(Task) * (nofTasks + amount));
-	if (newtask == NULL) {
-		printf("Couldn't increase task buffer...\n");
-		return NULL;
+static void pin_monk(Monk *m) {
+#ifdef CPU_SET
+	if (!abbeyConfig.cpu_count) return;
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	CPU_SET(abbeyConfig.first_cpu + (m->id % abbeyConfig.cpu_count), &cpus);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus) != 0) {
+		printf("Abbey Error: Failed to pin monk %d to a processor!\n", m->id);
 	}
-	task = newtask;
-	nofTasks += amount;
-	dedicatedTaskBuffer = 2;
-	printf("Buffer is increased now...\n");
-	return NULL;
+#endif
 }
 
 /**
- * Adds one monk to the abbey.
- * @todo: The reallocation procedure is incorrect apparently; error: 
- *    *** glibc detected *** colinda: realloc(): invalid next size: 0x08c14308 ***
- *    The amount of monks is increased from 16 to 17
- */
-static void *addMonk(void* context) {
-	printf("The amount of monks is increased from %d to %d\n", nofMonks, nofMonks+1);
-	pthread_t *newthreadId = (pthread_t *) 
-			realloc(threadId, (sizeof(pthread_t) * (nofMonks+1)));
-	if (newthreadId == NULL) {
-		printf("Couldn't add monk to memory...\n");
-		return NULL;
+ * Adds one monk to the abbey, if the maximum amount of monks is not reached
+ * yet. The slot of a retired monk is reused, otherwise a new slot is taken.
+ * The monk table has a fixed size, so contrary to the former realloc'ed
+ * array of threads, monks that are already running never move. Returns -1
+ * if the monk can not be added.
+ */
+static int addMonk() {
+	int id, p, failed;
+	Monk *m = NULL;
+	pthread_mutex_lock(&abbeyMutex);
+	if (liveMonks >= abbeyConfig.max_monk_count) {
+		pthread_mutex_unlock(&abbeyMutex);
+		return -1;
+	}
+	for (id = 0; id < nofMonks; id++) {
+		if (!monks[id]->alive) {
+			m = monks[id];
+			break;
+		}
 	}
-	threadId = newthreadId;
-	nofMonks++;
-	if(pthread_create(&threadId[nofMonks], NULL, monk, NULL) != 0) {
+	if (m == NULL) {
+		if (id == MAX_MONKS) {
+			pthread_mutex_unlock(&abbeyMutex);
+			return -1;
+		}
+		m = (Monk *)calloc(1, sizeof(Monk));
+		failed = (m == NULL);
+		for (p = 0; !failed && p < ABBEY_PRIORITY_COUNT; p++) {
+			failed = deque_init(&m->deque[p], DEFAULT_DEQUE_SIZE);
+		}
+		if (failed) {
+			printf("Couldn't add monk to memory...\n");
+			free(m);
+			pthread_mutex_unlock(&abbeyMutex);
+			return -1;
+		}
+		m->id = id;
+		monks[id] = m;
+		__sync_synchronize();
+		nofMonks = id + 1;
+	}
+	m->lowestPriority = ABBEY_PRIORITY_COUNT - 1;
+	m->alive = 1;
+	liveMonks++;
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if(pthread_create(&m->thread, &attr, monk, m) != 0) {
 		printf("Abbey Error: Failed to create thread!\n");
-		return NULL;
+		m->alive = 0;
+		liveMonks--;
+		pthread_attr_destroy(&attr);
+		pthread_mutex_unlock(&abbeyMutex);
+		return -1;
 	}
-	char name[64];
-	sprintf(name, "Monk %i", nofMonks);
-	ptreaty_add_thread(&threadId[nofMonks], name);
+	pthread_attr_destroy(&attr);
+	pthread_mutex_unlock(&abbeyMutex);
 #if DEBUG_ABBEY > 1
-	printf("Abbey: Create thread 0x%lx (number %d).\n", threadId[nofMonks], nofMonks);
+	printf("Abbey: Create thread 0x%lx (number %d).\n", m->thread, id);
 #endif
+	return 0;
+}
 
-	printf("Monk has been added.\n");
-	dedicatedTaskBuffer = 2;
-	return NULL;
+static int dispatch_batch(const struct AbbeyTaskDescriptor **descriptors,
+		void **contexts, struct AbbeyHandle **handles, int n, int priority);
+
+/*! \brief A monotonic clock in nanoseconds
+ */
+static unsigned long long abbey_clock_ns() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/*! \brief The log-linear histogram bucket of a duration
+ *
+ * Values below four have a bucket of their own, every power of two above
+ * that is split into four buckets by the two bits below the highest one.
+ */
+static int stats_bucket(unsigned long long ns) {
+	int msb, bucket;
+	if (ns < 4) return (int)ns;
+	msb = 63 - __builtin_clzll(ns);
+	bucket = 4 * (msb - 1) + (int)((ns >> (msb - 2)) & 3);
+	return bucket < ABBEY_STATS_BUCKETS ? bucket : ABBEY_STATS_BUCKETS - 1;
+}
+
+int abbey_stats_bucket(unsigned long long ns) {
+	return stats_bucket(ns);
+}
+
+/*! \brief The kind of task with the given description
+ *
+ * A new description is added under the stats mutex, all other lookups only
+ * read. If there is no room, the task is counted as the last kind, "(other)".
+ * This is only done when a descriptor is registered. Descriptions longer than
+ * a kind name are compared on their first MAX_TASK_DESCRIPTION_LEN-1 bytes.
+ */
+static int stats_kind(const char *desc) {
+	unsigned int h = 2166136261U;
+	const char *c;
+	int slot, kind;
+	for (c = desc; *c != '\0'; c++) h = (h ^ (unsigned char)*c) * 16777619U;
+	slot = h & (STATS_HASH_SIZE - 1);
+	while (true) {
+		kind = statsHash[slot];
+		if (!kind) {
+			pthread_mutex_lock(&statsMutex);
+			kind = statsHash[slot];
+			if (!kind && nofStatsKinds < ABBEY_STATS_MAX_KINDS - 1) {
+				strncpy(statsKind[nofStatsKinds], desc, MAX_TASK_DESCRIPTION_LEN - 1);
+				__sync_synchronize();
+				kind = ++nofStatsKinds;
+				statsHash[slot] = kind;
+			}
+			pthread_mutex_unlock(&statsMutex);
+			if (!kind) return ABBEY_STATS_MAX_KINDS - 1;
+		}
+		if (!strncmp(statsKind[kind - 1], desc, MAX_TASK_DESCRIPTION_LEN - 1))
+			return kind - 1;
+		slot = (slot + 1) & (STATS_HASH_SIZE - 1);
+	}
+}
+
+/*! \brief Record the wait and run time of a task in the stats of this monk
+ */
+static void stats_record(Monk *m, Task *t, unsigned long long wait,
+		unsigned long long run) {
+	int kind = t->descriptor->stats;
+	struct AbbeyTaskStats *ts = m->stats[kind];
+	if (ts == NULL) {
+		ts = m->stats[kind] = calloc(1, sizeof(struct AbbeyTaskStats));
+		if (ts == NULL) return;
+	}
+	ts->count++;
+	ts->wait_ns_total += wait;
+	ts->run_ns_total += run;
+	ts->wait_histogram[stats_bucket(wait)]++;
+	ts->run_histogram[stats_bucket(run)]++;
+}
+
+/*! \brief Look up or add a descriptor in the registry
+ *
+ * The registry is only consulted when a descriptor is registered and when
+ * a thread dispatches a function with a description it did not use before.
+ */
+static const struct AbbeyTaskDescriptor *register_task(void *(*func)(void *),
+		const char *name, int priority) {
+	unsigned int h = 2166136261U ^ (unsigned int)((uintptr_t)func >> 4);
+	const char *c;
+	DescriptorEntry *e;
+	if (name == NULL) name = "";
+	if (priority < 0) priority = 0;
+	if (priority >= ABBEY_PRIORITY_COUNT) priority = ABBEY_PRIORITY_COUNT - 1;
+	for (c = name; *c != '\0'; c++) h = (h ^ (unsigned char)*c) * 16777619U;
+	h &= DESCRIPTOR_HASH_SIZE - 1;
+	pthread_mutex_lock(&descriptorMutex);
+	for (e = descriptorTable[h]; e != NULL; e = e->next) {
+		if (e->descriptor.func == func && e->descriptor.priority == priority &&
+				!strcmp(e->descriptor.name, name)) break;
+	}
+	if (e == NULL && (e = malloc(sizeof(DescriptorEntry))) != NULL) {
+		e->descriptor.func = func;
+		e->descriptor.name = strdup(name);
+		e->descriptor.priority = priority;
+		if (e->descriptor.name == NULL) {
+			free(e);
+			e = NULL;
+		} else {
+			e->descriptor.stats = stats_kind(name);
+			e->next = descriptorTable[h];
+			descriptorTable[h] = e;
+		}
+	}
+	pthread_mutex_unlock(&descriptorMutex);
+	return e == NULL ? NULL : &e->descriptor;
+}
+
+/*! \brief The descriptor for a function with a description, via the cache
+ *
+ * A description is nearly always a string literal, so the pointer matches
+ * the cached one. The string is compared as well, because a caller may reuse
+ * a buffer with another description.
+ */
+static const struct AbbeyTaskDescriptor *intern_task(void *(*func)(void *),
+		const char *name, int priority) {
+	DescriptorCacheEntry *c;
+	if (name == NULL) name = "";
+	c = &descriptorCache[(((uintptr_t)func >> 4) ^ ((uintptr_t)name >> 3) ^ priority)
+			& (DESCRIPTOR_CACHE_SIZE - 1)];
+	if (c->descriptor != NULL && c->func == func && c->name == name &&
+			c->priority == priority && !strcmp(c->descriptor->name, name))
+		return c->descriptor;
+	c->descriptor = register_task(func, name, priority);
+	c->func = func;
+	c->name = name;
+	c->priority = priority;
+	return c->descriptor;
+}
+
+/*! \brief Mark a handle as done and schedule continuations
+ *
+ * Joining threads are woken up. Every continuation that waits for this
+ * handle is decremented and dispatched when this was the last handle it
+ * waited for. The reference of the task to the handle is dropped by the
+ * one that takes the task out of the queue, see run_task.
+ */
+static void complete_handle(struct AbbeyHandle *h, void *result) {
+	struct AbbeyWaiter *w, *next;
+	pthread_mutex_lock(&handleMutex);
+	h->result = result;
+	__sync_synchronize();
+	h->done = 1;
+	w = h->waiters;
+	h->waiters = NULL;
+	if (joiningThreads) pthread_cond_broadcast(&handleCond);
+	pthread_mutex_unlock(&handleMutex);
+	for (; w != NULL; w = next) {
+		next = w->next;
+		struct AbbeyJoin *join = w->join;
+		if (!__sync_sub_and_fetch(&join->remaining, 1)) {
+			dispatch_batch(&join->descriptor, &join->context, NULL, 1,
+					join->descriptor->priority);
+			free(join);
+		}
+		free(w);
+	}
+}
+
+/*! \brief Execute a task
+ *
+ * The clock is read once per task: when the task is done, now is updated
+ * and serves as the start of the next task the monk finds right away. Pass
+ * a zero now if there was a pause since it was last set.
+ */
+static void execute_task(Task *t, unsigned long long *now) {
+#if DEBUG_ABBEY > 0
+	if(t->descriptor->name[0] != '\0')
+		printf("Abbey: Monk %d executing Task: %s\n", self->id, t->descriptor->name);
+#endif
+	unsigned long long start = *now ? *now : abbey_clock_ns();
+	//the real work! :-)
+	void *result = t->descriptor->func(t->context);
+	*now = abbey_clock_ns();
+	if (self != NULL)
+		stats_record(self, t, start > t->enqueued ? start - t->enqueued : 0, *now - start);
+	if (lindaTraceEnabled) linda_trace_span(t->descriptor->name, "task", start, *now);
+	if (t->handle != NULL) complete_handle(t->handle, result);
+}
+
+/*! \brief Execute a task that is taken out of a queue
+ *
+ * A joinable task is only executed if the thread that joins it did not
+ * claim it already. Either way the reference of the queued task to the
+ * handle is dropped.
+ */
+static void run_task(Task *t, unsigned long long *now) {
+	struct AbbeyHandle *h = t->handle;
+	if (h == NULL) {
+		execute_task(t, now);
+		return;
+	}
+	if (__sync_bool_compare_and_swap(&h->claimed, 0, 1)) execute_task(t, now);
+	abbey_release_handle(h);
 }
 
 /*! \brief Monk as stateful thread
  *
- * The monk iterates the tasks to find one that is open, sets it state flag to
- * busy and calls func(context). Afterwards it sets the task state to ready.
- * Job finished.
+ * The monk looks for a task, in its own deques, the shared ones or the ones
+ * of its brothers, and calls func(context). If all monks are busy and there
+ * is still work waiting, a monk is added to the abbey, up to the maximum.
+ * A monk that is idle for too long retires. Job finished.
  */
 static void *monk(void *arg) {
-	int taskId;
+	Task t;
+	unsigned long long now = 0;
+	char name[64];
+	self = (Monk *)arg;
+	sprintf(name, "Monk %i", self->id);
+	ptreaty_set_thread_name(name);
+	pin_monk(self);
 
 	while(true) {
-		taskId = find_task_and_change_state(TS_OPEN, TS_BUSY, 1);
+		if (!find_task(self, &t)) {
+			if (wait_for_task(self)) break;
+			now = 0;
+			continue;
+		}
 
-		amountOfMonksBusy++;
-#if DEBUG_ABBEY > 0
-		printf("Abbey: Monk 0x%lx starts to work on task %d.\n", pthread_self(), taskId);
-#endif
+		int busy = __sync_add_and_fetch(&amountOfMonksBusy, 1);
+		run_task(&t, &now);
 
+		if (busy >= liveMonks && liveMonks < abbeyConfig.max_monk_count &&
+				abbey_has_work(ABBEY_PRIORITY_COUNT - 1)) {
 #if DEBUG_ABBEY > 0
-		if(task[taskId].description[0] != '\0')
-			printf("Abbey: Executing Task: %s\n", task[taskId].description);
+			printf("Amount of monks busy is %d, total is %d\n", busy, liveMonks);
 #endif
+			addMonk();
+		}
+		__sync_sub_and_fetch(&amountOfMonksBusy, 1);
+	}
+	return NULL;
+}
 
-		//the real work! :-)
-		task[taskId].func(task[taskId].context);
+/*! \brief The tick of the timer wheel that corresponds with the current time
+ */
+static unsigned long timer_now() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - timerEpoch.tv_sec) * 1000 +
+			(now.tv_nsec - timerEpoch.tv_nsec) / 1000000;
+}
 
-		set_task_state(taskId, TS_READY);
+/*! \brief Put a timer in the slot that corresponds with its expiry
+ *
+ * Timers beyond the span of the wheel are put in the last slot of the top
+ * level that is still ahead, they are cascaded and inserted again from there.
+ * Must be called with the timer mutex held.
+ */
+static void timer_insert(struct AbbeyTimer *timer) {
+	unsigned long expires = timer->expires, delta;
+	int level, index;
+	if (expires < timerTick) expires = timerTick;
+	delta = expires - timerTick;
+	if (delta >= (1UL << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS)))
+		expires = timerTick + (1UL << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS)) - 1;
+	for (level = 0; level < TIMER_WHEEL_LEVELS - 1; level++) {
+		if (delta < (1UL << ((level + 1) * TIMER_WHEEL_BITS))) break;
+	}
+	index = (expires >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK;
+	timer->next = timerWheel[level][index];
+	timerWheel[level][index] = timer;
+}
 
+/*! \brief Move the timers of the current slot of a level down
+ *
+ * @return the index of the slot, zero means the level above needs cascading too
+ */
+static int timer_cascade(int level) {
+	int index = (timerTick >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK;
+	struct AbbeyTimer *timer = timerWheel[level][index], *next;
+	timerWheel[level][index] = NULL;
+	for (; timer != NULL; timer = next) {
+		next = timer->next;
+		timer_insert(timer);
+	}
+	return index;
+}
 
-#if DEBUG_ABBEY > 0
-		printf("Amount of monks busy is %d, total is %d\n", amountOfMonksBusy, nofMonks);
-#endif
-		pthread_mutex_lock(&abbeyMutex);
-		if (amountOfMonksBusy >= nofMonks) {
-			dedicatedTaskBuffer = 0;
-//			dispatch_task(*addMonk, NULL);
-			addMonk(NULL); //can not be dispatched
+/*! \brief Advance the wheel by one tick
+ *
+ * Returns the list of timers that expired. Must be called with the timer
+ * mutex held, the timers are dispatched after it is released.
+ */
+static struct AbbeyTimer *timer_step() {
+	int level, index = timerTick & TIMER_WHEEL_MASK;
+	struct AbbeyTimer *expired;
+	if (!index) {
+		for (level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+			if (timer_cascade(level)) break;
 		}
-		pthread_mutex_unlock(&abbeyMutex);
-		
-#if DEBUG_ABBEY > 0
-		printf("Abbey: Monk 0x%lx is free again.\n", pthread_self());
-#endif
-		amountOfMonksBusy--;
+	}
+	expired = timerWheel[0][index];
+	timerWheel[0][index] = NULL;
+	timerTick++;
+	return expired;
+}
 
+/*! \brief The first tick from the current one at which timer_step does any work
+ *
+ * A slot at level 0 expires at its own tick, a slot at a higher level when
+ * the levels below it wrap around to it. The ticks before it can be skipped,
+ * their slots are empty. Must be called with the timer mutex held, returns
+ * ULONG_MAX for an empty wheel.
+ */
+static unsigned long timer_next() {
+	unsigned long next = ULONG_MAX, tick, base;
+	int level, index, slot, ahead, aligned;
+	for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		base = timerTick >> (level * TIMER_WHEEL_BITS);
+		index = base & TIMER_WHEEL_MASK;
+		//! A slot at the current index of a higher level, once started, comes around again
+		aligned = !level || !(timerTick & ((1UL << (level * TIMER_WHEEL_BITS)) - 1));
+		for (slot = 0; slot < TIMER_WHEEL_SIZE; slot++) {
+			if (timerWheel[level][slot] == NULL) continue;
+			ahead = (slot - index) & TIMER_WHEEL_MASK;
+			if (!ahead && !aligned) ahead = TIMER_WHEEL_SIZE;
+			tick = (base + ahead) << (level * TIMER_WHEEL_BITS);
+			if (tick < next) next = tick;
+		}
+	}
+	return next;
+}
 
+/*! \brief The thread that services the timer wheel
+ *
+ * Expired timers are dispatched as ordinary tasks. Periodic timers are put
+ * back one period after the tick they were due, so they do not drift when
+ * the timer thread was late. In between the thread sleeps until the next
+ * tick that has work, ticks without any are skipped.
+ */
+static void *timer_keeper(void *arg) {
+	struct AbbeyTimer *expired = NULL, *last, *timer, *next;
+	struct timespec wakeup;
+	unsigned long now;
+	ptreaty_set_thread_name("Timer");
+	while (true) {
+		//! Dispatched with the mutex held, so no run is dispatched after a cancel
+		pthread_mutex_lock(&timerMutex);
+		for (timer = expired; timer != NULL; timer = timer->next) {
+			if (!timer->cancelled)
+				dispatch_batch(&timer->descriptor, &timer->context, NULL, 1,
+						timer->descriptor->priority);
+		}
+		for (timer = expired; timer != NULL; timer = next) {
+			next = timer->next;
+			if (timer->period && !timer->cancelled) {
+				timer->expires += timer->period;
+				timer_insert(timer);
+			} else {
+				pendingTimers--;
+				free(timer);
+			}
+		}
+		expired = NULL;
+		while (true) {
+			now = timer_now();
+			timerDeadline = timer_next();
+			if (timerDeadline <= now) break;
+			//! Nothing happens before the deadline, so the wheel can catch up with the clock
+			if (timerTick <= now) timerTick = now + 1;
+			if (timerDeadline == ULONG_MAX) {
+				pthread_cond_wait(&timerCond, &timerMutex);
+				continue;
+			}
+			wakeup.tv_sec = timerEpoch.tv_sec + timerDeadline / 1000;
+			wakeup.tv_nsec = timerEpoch.tv_nsec + (timerDeadline % 1000) * 1000000;
+			if (wakeup.tv_nsec >= 1000000000) {
+				wakeup.tv_sec++;
+				wakeup.tv_nsec -= 1000000000;
+			}
+			pthread_cond_timedwait(&timerCond, &timerMutex, &wakeup);
+		}
+		//! Jump from one tick with work to the next, a cascade may add work in between
+		for (; timerDeadline <= now; timerDeadline = timer_next()) {
+			timerTick = timerDeadline;
+			last = timer_step();
+			if (last == NULL) continue;
+			for (timer = last; timer->next != NULL; timer = timer->next);
+			timer->next = expired;
+			expired = last;
+		}
+		if (timerTick <= now) timerTick = now + 1;
+		pthread_mutex_unlock(&timerMutex);
 	}
 	return NULL;
 }
 
-/*! \brief Allocation of buffer of tasks and pool of monks.
+/*! \brief Take a timer out of the wheel
  *
- * The initialization concerns the allocations of a set of tasks, where
- * calloc allocates such a block which individual sizes of Task. Similarly
- * a set of threads is created. Each thread that is created gets a
- * reference to a monk routine. So, it are a bunch of the same (monk)
- * routines that are eternally executed in parallel.
+ * Returns 0 if it is not in the wheel, because the timer thread has it in
+ * hand. Must be called with the timer mutex held.
  */
-int initialize_abbey(int monkCount, int taskBuffer) {
-	unsigned int i;
-	nofTasks = taskBuffer;
-	nofMonks = monkCount;
+static int timer_remove(struct AbbeyTimer *timer) {
+	struct AbbeyTimer **link;
+	int level, index;
+	for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		for (index = 0; index < TIMER_WHEEL_SIZE; index++) {
+			for (link = &timerWheel[level][index]; *link != NULL; link = &(*link)->next) {
+				if (*link != timer) continue;
+				*link = timer->next;
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+/*! \brief Start the timer thread
+ */
+static int start_timer_keeper() {
+	pthread_condattr_t attr;
+	if (timerThreadStarted) return 0;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&timerCond, &attr);
+	pthread_condattr_destroy(&attr);
+	clock_gettime(CLOCK_MONOTONIC, &timerEpoch);
+	if (pthread_create(&timerThread, NULL, timer_keeper, NULL)) return -1;
+	pthread_detach(timerThread);
+	timerThreadStarted = 1;
+	return 0;
+}
 
-	task = (Task *)calloc(nofTasks, sizeof(Task));
-	threadId = (pthread_t *) calloc(nofMonks, sizeof(pthread_t));
+/*! \brief Put a new timer in the wheel
+ *
+ * Delays and periods are rounded up to whole ticks, so a periodic task is
+ * dispatched at most once per millisecond.
+ */
+static struct AbbeyTimer *add_timer(const struct AbbeyTaskDescriptor *descriptor,
+		void *context, long delay_us, long period_us) {
+	struct AbbeyTimer *timer;
+	if (!timerThreadStarted || descriptor == NULL) return NULL;
+	timer = malloc(sizeof(struct AbbeyTimer));
+	if (timer == NULL) return NULL;
+	timer->descriptor = descriptor;
+	timer->context = context;
+	timer->cancelled = 0;
+	timer->period = period_us > 0 ? (period_us + 999) / 1000 : 0;
+	pthread_mutex_lock(&timerMutex);
+	//! The current tick has partly passed, so add one to never run too early
+	timer->expires = timer_now() + (delay_us > 0 ? (delay_us + 999) / 1000 + 1 : 0);
+	timer_insert(timer);
+	pendingTimers++;
+	if (timer->expires < timerDeadline) pthread_cond_signal(&timerCond);
+	pthread_mutex_unlock(&timerMutex);
+	return timer;
+}
+
+/*! \brief Periodic task that logs the statistics
+ */
+static void *stats_dump_task(void *context) {
+	abbey_stats_dump();
+	return NULL;
+}
+
+/*! \brief Default configuration of the abbey
+ *
+ * The abbey starts with monkCount monks and may grow to twice that amount
+ * when all monks are busy. Surplus monks retire after ten seconds of
+ * idleness. Monks are not pinned to processors and none are dedicated.
+ */
+void abbey_default_config(struct AbbeyConfig *config, int monkCount, int taskBuffer) {
+	config->min_monk_count = monkCount;
+	config->max_monk_count = 2 * monkCount;
+	config->task_count = taskBuffer;
+	config->idle_timeout_ms = 10000;
+	config->dedicated_monk_count = 0;
+	config->dedicated_priority = ABBEY_PRIORITY_IO;
+	config->first_cpu = 0;
+	config->cpu_count = 0;
+	config->stats_dump_ms = 0;
+}
+
+/*! \brief Allocation of the shared ring and pool of monks.
+ *
+ * The initialization concerns the allocation of the shared rings, for which
+ * the task_count is the initial capacity (rounded up to a power of two),
+ * and of the minimum amount of monks. Each monk gets its own deques. Each
+ * thread that is created gets a reference to a monk routine. So, it are a
+ * bunch of the same (monk) routines that are executed in parallel, as long
+ * as the abbey needs them.
+ */
+int initialize_abbey_ex(struct AbbeyConfig *config) {
+	int i, capacity = DEFAULT_DEQUE_SIZE;
+	abbeyConfig = *config;
+	if (abbeyConfig.min_monk_count < 1) abbeyConfig.min_monk_count = 1;
+	if (abbeyConfig.max_monk_count > MAX_MONKS) abbeyConfig.max_monk_count = MAX_MONKS;
+	if (abbeyConfig.max_monk_count < abbeyConfig.min_monk_count)
+		abbeyConfig.max_monk_count = abbeyConfig.min_monk_count;
+	while (capacity < abbeyConfig.task_count) capacity *= 2;
+	for (i = 0; i < ABBEY_PRIORITY_COUNT; i++) {
+		if (ring_init(&sharedRing[i], capacity)) return -1;
+	}
 #if DEBUG_ABBEY > 1
 	printf("Abbey: Initialize abbey from thread: 0x%lx.\n", pthread_self());
 #endif
-	for(i = 0; i < nofMonks; i++) {
-		if(pthread_create(&threadId[i], NULL, monk, NULL) != 0) {
-			printf("Abbey Error: Failed to create thread!\n");
+	for(i = 0; i < abbeyConfig.min_monk_count; i++) {
+		if (addMonk()) return -1;
+	}
+	if (abbeyConfig.dedicated_monk_count)
+		abbey_reserve_monks(abbeyConfig.dedicated_monk_count,
+				abbeyConfig.dedicated_priority);
+	if (start_timer_keeper()) return -1;
+	if (abbeyConfig.stats_dump_ms > 0 && dispatch_periodic_task(stats_dump_task,
+			NULL, "abbey stats", abbeyConfig.stats_dump_ms * 1000L) == NULL)
+		return -1;
+	return 0;
+}
+
+/*! \brief Initialize the abbey with the default configuration
+ */
+int initialize_abbey(int monkCount, int taskBuffer) {
+	struct AbbeyConfig config;
+	abbey_default_config(&config, monkCount, taskBuffer);
+	return initialize_abbey_ex(&config);
+}
+
+/*! \brief Dedicate monks to high priority tasks
+ *
+ * The first count monks will from now on only run tasks with the given
+ * priority or a higher one, for example ABBEY_PRIORITY_IO. Monks that are
+ * sleeping are woken up, so they go to sleep again on the right condition.
+ * Returns the amount of monks that are actually dedicated.
+ */
+int abbey_reserve_monks(int count, int priority) {
+	int i;
+	if (priority < 0 || priority >= ABBEY_PRIORITY_COUNT - 1) return 0;
+	pthread_mutex_lock(&abbeyMutex);
+	if (count > liveMonks - 1) count = liveMonks - 1;
+	int reserved = 0;
+	for (i = 0; i < nofMonks; i++) {
+		if (!monks[i]->alive) continue;
+		monks[i]->lowestPriority = (reserved < count) ? priority : ABBEY_PRIORITY_COUNT - 1;
+		if (reserved < count) reserved++;
+	}
+	dedicatedPriority = priority;
+	pthread_cond_broadcast(&abbeyCond);
+	pthread_cond_broadcast(&dedicatedCond);
+	pthread_mutex_unlock(&abbeyMutex);
+	return count;
+}
+
+/*! \brief Publish a batch of tasks with the same priority
+ *
+ * Called by a monk that may run tasks of this priority, the tasks are
+ * pushed on its deque under one lock acquisition, otherwise they go into
+ * the shared ring which takes no lock at all. Afterwards at most n sleeping
+ * monks are woken up. The array with handles may be NULL.
+ */
+static int dispatch_batch(const struct AbbeyTaskDescriptor **descriptors,
+		void **contexts, struct AbbeyHandle **handles, int n, int priority) {
+	int i;
+	unsigned long long stamp;
+	if (n <= 0) return 0;
+	for (i = 0; i < n; i++) {
+		if (descriptors[i] == NULL) return -1;
+	}
+	stamp = abbey_clock_ns();
+	if (priority < 0) priority = 0;
+	if (priority >= ABBEY_PRIORITY_COUNT) priority = ABBEY_PRIORITY_COUNT - 1;
+	if (self != NULL && priority <= self->lowestPriority) {
+		if (deque_push(&self->deque[priority], descriptors, contexts, handles, n, stamp))
 			return -1;
+	} else {
+		Task t;
+		for (i = 0; i < n; i++) {
+			task_fill(&t, descriptors[i], contexts[i],
+					(handles == NULL) ? NULL : handles[i], stamp);
+			if (ring_push(&sharedRing[priority], &t)) {
+				wake_monks(i, priority);
+				return -1;
+			}
 		}
-		char name[64];
-		sprintf(name, "Monk %i", i);
-		ptreaty_add_thread(&threadId[i], name);
-
-#if DEBUG_ABBEY > 1
-		printf("Abbey: Create thread 0x%lx (number %d).\n", threadId[i], i);
+	}
+#if DEBUG_ABBEY > 0
+	printf("Abbey: Batch of %d tasks with priority %d is dispatched.\n", n, priority);
 #endif
+	wake_monks(n, priority);
+	return 0;
+}
+
+/*! \brief Dispatch a batch of tasks to the abbey.
+ *
+ * Publishes n tasks with normal priority at once.
+ */
+int dispatch_task_batch(void *(**funcs)(void *), void **contexts,
+		char **taskDescs, int n) {
+	int i;
+	const struct AbbeyTaskDescriptor *descriptors[n > 0 ? n : 1];
+	for (i = 0; i < n; i++) {
+		descriptors[i] = intern_task(funcs[i], (taskDescs == NULL) ? NULL : taskDescs[i],
+				ABBEY_PRIORITY_NORMAL);
+	}
+	return dispatch_batch(descriptors, contexts, NULL, n, ABBEY_PRIORITY_NORMAL);
+}
+
+/*! \brief Register a kind of task
+ *
+ * Returns the descriptor for the function, name and priority, the same one
+ * for every call with the same arguments. The name is copied. Descriptors
+ * live as long as the process.
+ */
+const struct AbbeyTaskDescriptor *abbey_register_task(void *(*func)(void *),
+		const char *name, int priority) {
+	return register_task(func, name, priority);
+}
+
+/*! \brief Dispatch a task by its descriptor
+ *
+ * This is the cheapest way to dispatch: nothing is looked up or copied but
+ * the descriptor pointer and the context.
+ */
+int dispatch_descriptor_task(const struct AbbeyTaskDescriptor *descriptor,
+		void *context) {
+	if (descriptor == NULL) return -1;
+	return dispatch_batch(&descriptor, &context, NULL, 1, descriptor->priority);
+}
+
+/*! \brief Dispatch a task with a priority
+ *
+ * Monks first run realtime tasks, then I/O tasks, then normal tasks and at
+ * last bulk tasks. Long running computations, like development of a neural
+ * network, should be dispatched as bulk, so they never keep the monks from
+ * handling sensor data or network traffic.
+ */
+int dispatch_prioritized_task(void *(*func)(void *), void *context,
+		char *taskDesc, int priority) {
+	const struct AbbeyTaskDescriptor *descriptor = intern_task(func, taskDesc, priority);
+	if (descriptor == NULL) return -1;
+	return dispatch_batch(&descriptor, &context, NULL, 1, descriptor->priority);
+}
+
+/*! \brief Dispatch a task that can be joined
+ *
+ * Returns a handle that can be given to abbey_join or abbey_when_all, or
+ * NULL if the task could not be dispatched. The handle has to be released
+ * by abbey_release_handle when it is not needed anymore.
+ */
+struct AbbeyHandle *dispatch_joinable_task(void *(*func)(void *), void *context,
+		char *taskDesc, int priority) {
+	const struct AbbeyTaskDescriptor *descriptor = intern_task(func, taskDesc, priority);
+	if (descriptor == NULL) return NULL;
+	struct AbbeyHandle *h = (struct AbbeyHandle *)calloc(1, sizeof(struct AbbeyHandle));
+	if (h == NULL) return NULL;
+	h->refs = 2;
+	h->descriptor = descriptor;
+	h->context = context;
+	h->enqueued = abbey_clock_ns();
+	if (dispatch_batch(&descriptor, &context, &h, 1, descriptor->priority)) {
+		free(h);
+		return NULL;
+	}
+	return h;
+}
+
+/*! \brief Wait for a joinable task and return its result
+ *
+ * If no monk started the task yet, the thread that joins takes it back and
+ * runs it itself, otherwise it waits until the task is done. It never runs
+ * other tasks in the meantime, so a task that joins does not find itself
+ * in the middle of another one, with its locks held, its thread local state
+ * and its stack. A monk that joins a task that is running elsewhere is idle
+ * until then, fan out with abbey_when_all to not lose it.
+ */
+void *abbey_join(struct AbbeyHandle *h) {
+	if (!h->done && __sync_bool_compare_and_swap(&h->claimed, 0, 1)) {
+		Task t;
+		unsigned long long stamp = 0;
+		task_fill(&t, h->descriptor, h->context, h, h->enqueued);
+		execute_task(&t, &stamp);
+	}
+	pthread_mutex_lock(&handleMutex);
+	joiningThreads++;
+	while (!h->done) pthread_cond_wait(&handleCond, &handleMutex);
+	joiningThreads--;
+	pthread_mutex_unlock(&handleMutex);
+	__sync_synchronize();
+	return h->result;
+}
+
+/*! \brief Schedule a continuation after a set of joinable tasks
+ *
+ * The continuation is dispatched by the monk that completes the last of
+ * the n tasks, no thread waits for it. If all tasks are already done, it is
+ * dispatched right away. The counter starts one too high, so completions
+ * during registration can not dispatch the continuation too early. The
+ * waiters are all allocated before any is registered, so without memory
+ * -1 is returned and nothing waits for the handles. The handles remain
+ * owned by the caller, also then.
+ */
+int abbey_when_all(struct AbbeyHandle **handles, int n,
+		void *(*continuation)(void *), void *context, char *taskDesc) {
+	int i;
+	const struct AbbeyTaskDescriptor *descriptor = intern_task(continuation, taskDesc,
+			ABBEY_PRIORITY_NORMAL);
+	if (descriptor == NULL) return -1;
+	struct AbbeyJoin *join = (struct AbbeyJoin *)malloc(sizeof(struct AbbeyJoin));
+	if (join == NULL) return -1;
+	struct AbbeyWaiter *w, *spare = NULL;
+	for (i = 0; i < n; i++) {
+		w = (struct AbbeyWaiter *)malloc(sizeof(struct AbbeyWaiter));
+		if (w == NULL) {
+			for (; spare != NULL; spare = w) {
+				w = spare->next;
+				free(spare);
+			}
+			free(join);
+			return -1;
+		}
+		w->join = join;
+		w->next = spare;
+		spare = w;
+	}
+	join->remaining = n + 1;
+	join->descriptor = descriptor;
+	join->context = context;
+	for (i = 0; i < n; i++) {
+		pthread_mutex_lock(&handleMutex);
+		if (!handles[i]->done) {
+			w = spare;
+			spare = w->next;
+			w->next = handles[i]->waiters;
+			handles[i]->waiters = w;
+			pthread_mutex_unlock(&handleMutex);
+		} else {
+			pthread_mutex_unlock(&handleMutex);
+			__sync_sub_and_fetch(&join->remaining, 1);
+		}
+	}
+	//the waiters of the handles that were done already
+	for (; spare != NULL; spare = w) {
+		w = spare->next;
+		free(spare);
+	}
+	if (!__sync_sub_and_fetch(&join->remaining, 1)) {
+		dispatch_batch(&join->descriptor, &join->context, NULL, 1, descriptor->priority);
+		free(join);
 	}
 	return 0;
 }
 
-/*! \brief Dispatch a task to the task buffer.
+/*! \brief Drop a reference to a handle
+ */
+void abbey_release_handle(struct AbbeyHandle *h) {
+	if (h == NULL) return;
+	if (!__sync_sub_and_fetch(&h->refs, 1)) free(h);
+}
+
+/*! \brief Dispatch a task after a delay
+ *
+ * The task is handed to the timer thread, which dispatches it when the delay
+ * (rounded up to milliseconds) has passed. Nobody sleeps in the meantime.
+ */
+int dispatch_delayed_prioritized_task(void *(*func)(void *), void *context,
+		char *taskDesc, int priority, long delay_us) {
+	return add_timer(intern_task(func, taskDesc, priority), context, delay_us, 0) == NULL ?
+			-1 : 0;
+}
+
+/*! \brief Dispatch a task after a delay with normal priority
+ */
+int dispatch_delayed_task(void *(*func)(void *), void *context, long delay_us) {
+	return dispatch_delayed_prioritized_task(func, context, "",
+			ABBEY_PRIORITY_NORMAL, delay_us);
+}
+
+/*! \brief Dispatch a task every period
+ *
+ * The first time the task is dispatched is one period from now. If the task
+ * takes longer than a period, the next one may run concurrently with it.
+ */
+struct AbbeyTimer *dispatch_periodic_task(void *(*func)(void *), void *context,
+		char *taskDesc, long period_us) {
+	if (period_us <= 0) return NULL;
+	return add_timer(intern_task(func, taskDesc, ABBEY_PRIORITY_NORMAL), context,
+			period_us, period_us);
+}
+
+/*! \brief Stop a periodic (or delayed) task
+ *
+ * After this call the task is not dispatched anymore. A run that was
+ * dispatched before is not stopped, it may still wait in a queue or be
+ * running, so the context may only be freed once such a run is known to
+ * be done, by the task itself for example. The timer is freed, here or by
+ * the timer thread, so it should not be used after this call.
+ */
+void abbey_cancel_timer(struct AbbeyTimer *timer) {
+	if (timer == NULL) return;
+	pthread_mutex_lock(&timerMutex);
+	timer->cancelled = 1;
+	if (timer_remove(timer)) {
+		pendingTimers--;
+		free(timer);
+	}
+	pthread_mutex_unlock(&timerMutex);
+}
+
+/*! \brief Dispatch a task to the abbey.
  *
  * The dispatch routine can eat a description, nothing trendy about that
- * thing. It iterates the tasks for ready ones. When it finds one it
- * overwrites that task (that is of course executed before) with the new
- * func(context) thing to execute. The state is set to open, and a monk
- * may start it whenever pan happens.
+ * thing. The function and description are looked up in the descriptor cache
+ * of the calling thread. It is a batch of one task with normal priority: if it is called
+ * by a monk, the task is pushed on the deque of that monk, which will likely
+ * run it next, unless one of its idle brothers steals it. Otherwise the task
+ * goes into the shared ring. One sleeping monk, if any, is signalled.
  *
  * @remark The ugly names are of course because ANSI C does not allow
  * function polymorphism / overloading.
  */
 int dispatch_described_task(
 		void *(*func)(void *), void *context, char *taskDesc) {
-
-	int taskId = find_task_and_change_state(TS_READY, TS_CREATING, 0);
-
-#if DEBUG_ABBEY > 0
-	printf("Abbey: Task %d is dispatched.\n", taskId);
-#endif
-	task[taskId].context = context;
-	task[taskId].func = func;
-	strncpy(task[taskId].description, taskDesc, MAX_TASK_DESCRIPTION_LEN-1);
-	set_task_state(taskId, TS_OPEN);
-
-	return 0;
+	return dispatch_prioritized_task(func, context, taskDesc, ABBEY_PRIORITY_NORMAL);
 }
 
 /*! \brief Dispatch task
@@ -341,3 +1580,92 @@ int dispatch_vararray_task(void *(*func)(void *), ...) {
 	va_start(vl, func);
 	return dispatch_described_task(func, vl, "VarArgD");
 }
+
+/*! \brief Statistics of the abbey
+ *
+ * The counters of all monks are summed per kind of task. Monks keep on
+ * recording while this runs, so the snapshot is not exact to the task, but
+ * counters are never reset, so they do not go backwards either.
+ */
+int abbey_stats_snapshot(struct AbbeyStats *stats) {
+	int i, k, b, p, kinds = nofStatsKinds, count = nofMonks;
+	struct AbbeyTaskStats *ts, *sum;
+	memset(stats, 0, sizeof(struct AbbeyStats));
+	stats->monk_count = liveMonks;
+	stats->busy_monks = amountOfMonksBusy;
+	for (p = 0; p < ABBEY_PRIORITY_COUNT; p++) {
+		stats->queue_depth[p] = ring_size(&sharedRing[p]);
+		for (i = 0; i < count; i++) {
+			if (monks[i] != NULL) stats->queue_depth[p] += deque_size(&monks[i]->deque[p]);
+		}
+	}
+	for (k = 0; k < ABBEY_STATS_MAX_KINDS; k++) {
+		if (k == kinds) k = ABBEY_STATS_MAX_KINDS - 1;
+		sum = &stats->kind[stats->kind_count];
+		for (i = 0; i < count; i++) {
+			if (monks[i] == NULL || (ts = monks[i]->stats[k]) == NULL) continue;
+			sum->count += ts->count;
+			sum->wait_ns_total += ts->wait_ns_total;
+			sum->run_ns_total += ts->run_ns_total;
+			for (b = 0; b < ABBEY_STATS_BUCKETS; b++) {
+				sum->wait_histogram[b] += ts->wait_histogram[b];
+				sum->run_histogram[b] += ts->run_histogram[b];
+			}
+		}
+		if (k == ABBEY_STATS_MAX_KINDS - 1) {
+			if (!sum->count) break;
+			strcpy(sum->description, "(other)");
+		} else {
+			strcpy(sum->description, statsKind[k]);
+		}
+		stats->kind_count++;
+	}
+	return 0;
+}
+
+/*! \brief The duration below which the given fraction of the tasks stayed
+ *
+ * Returns the upper bound of the bucket in which the fraction is reached.
+ */
+unsigned long long abbey_stats_percentile(const unsigned int *histogram, double fraction) {
+	unsigned long long total = 0, seen = 0;
+	int b;
+	for (b = 0; b < ABBEY_STATS_BUCKETS; b++) total += histogram[b];
+	if (!total) return 0;
+	for (b = 0; b < ABBEY_STATS_BUCKETS - 1; b++) {
+		seen += histogram[b];
+		if (seen >= fraction * total) break;
+	}
+	if (b < 4) return b;
+	return ((unsigned long long)(4 + (b & 3) + 1) << (b / 4 - 1)) - 1;
+}
+
+/*! \brief Log the statistics of the abbey
+ *
+ * A line per kind of task with the amount of runs and the median and 99th
+ * percentile of the time it waited and the time it ran, in microseconds.
+ */
+void abbey_stats_dump() {
+	char text[192];
+	int k;
+	struct AbbeyStats *stats = malloc(sizeof(struct AbbeyStats));
+	if (stats == NULL) return;
+	abbey_stats_snapshot(stats);
+	sprintf(text, "%d monks, %d busy, queued %d/%d/%d/%d", stats->monk_count,
+			stats->busy_monks, stats->queue_depth[ABBEY_PRIORITY_REALTIME],
+			stats->queue_depth[ABBEY_PRIORITY_IO], stats->queue_depth[ABBEY_PRIORITY_NORMAL],
+			stats->queue_depth[ABBEY_PRIORITY_BULK]);
+	tprintf(LOG_INFO, __func__, text);
+	for (k = 0; k < stats->kind_count; k++) {
+		struct AbbeyTaskStats *ts = &stats->kind[k];
+		if (!ts->count) continue;
+		snprintf(text, sizeof(text), "%s: %lu tasks, wait %llu/%llu us, run %llu/%llu us",
+				ts->description[0] ? ts->description : "(undescribed)", ts->count,
+				abbey_stats_percentile(ts->wait_histogram, 0.5) / 1000,
+				abbey_stats_percentile(ts->wait_histogram, 0.99) / 1000,
+				abbey_stats_percentile(ts->run_histogram, 0.5) / 1000,
+				abbey_stats_percentile(ts->run_histogram, 0.99) / 1000);
+		tprintf(LOG_INFO, __func__, text);
+	}
+	free(stats);
+}
@@ -0,0 +1,57 @@
+/**
+ * @file buffer.c
+ *
+ * The buffer header with the reference count is put in front of the data, in the same
+ * allocation. Only the count is shared between threads, the data itself should not be
+ * written anymore once a buffer has more than one owner.
+ *
+ * @date_created    Oct 14, 2026
+ * @date_modified   Oct 14, 2026
+ * @author          Anne C. van Rossum
+ * @project         Replicator
+ * @company         Almende B.V.
+ * @license         open-source, GNU Lesser General Public License
+ */
+
+#include <buffer.h>
+#include <slab.h>
+
+/**
+ * Allocates a buffer with one reference, held by the caller. The data is not cleared.
+ */
+struct LindaBuffer *linda_buffer_alloc(size_t capacity) {
+	struct LindaBuffer *buffer = linda_ctx_alloc(sizeof(struct LindaBuffer) + capacity);
+	if (buffer == NULL) return NULL;
+	buffer->refs = 1;
+	buffer->capacity = capacity;
+	return buffer;
+}
+
+/**
+ * Adds a reference to the buffer and returns it, for the new owner.
+ */
+struct LindaBuffer *linda_buffer_ref(struct LindaBuffer *buffer) {
+	__sync_add_and_fetch(&buffer->refs, 1);
+	return buffer;
+}
+
+/**
+ * Gives back a reference, the buffer is freed when it was the last one.
+ */
+void linda_buffer_unref(struct LindaBuffer *buffer) {
+	if (buffer == NULL) return;
+	if (__sync_sub_and_fetch(&buffer->refs, 1) == 0) linda_ctx_free(buffer);
+}
+
+uint32_t linda_buffer_hash(const void *data, size_t size) {
+	return linda_buffer_hash_more(LINDA_BUFFER_HASH_START, data, size);
+}
+
+uint32_t linda_buffer_hash_more(uint32_t hash, const void *data, size_t size) {
+	const unsigned char *byte = (const unsigned char*)data;
+	while (size--) {
+		hash ^= *byte++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
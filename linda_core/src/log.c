@@ -2,6 +2,12 @@
  * @file log.c
  * @brief Prints depending on verbosity. Thread aware.   
  * @author Anne C. van Rossum
+ *
+ * By default a message is written by the thread that logs it. After startLogThread a
+ * message is copied into a ring of the logging thread instead, and a single log thread
+ * writes it to stdout, syslog and the log file. Each ring has only one writer and one
+ * reader, so no lock is needed. If a ring is full, the message is written directly after
+ * all, so no message gets lost.
  */
 
 #include <stdio.h>
@@ -11,6 +17,47 @@
 #include <stdlib.h>
 #include <syslog.h>
 #include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+//! Amount of records in the ring of a thread, should be a power of two
+#define LOG_RING_SIZE		256
+#define LOG_FUNCTION_LEN	48
+#define LOG_THREAD_LEN		32
+#define LOG_MSG_LEN			256
+
+/**
+ * A message with everything needed to write it, the thread name is copied because it is
+ * stored in thread-local storage of the logging thread.
+ */
+struct LogRecord {
+	uint8_t verbosity;
+	char function[LOG_FUNCTION_LEN];
+	char thread[LOG_THREAD_LEN];
+	char msg[LOG_MSG_LEN];
+};
+
+/**
+ * The messages of one thread. Head is only written by that thread, tail only by the log
+ * thread. A ring of a thread that exited is orphaned, and freed by the log thread when it
+ * is empty.
+ */
+struct LogRing {
+	struct LogRecord record[LOG_RING_SIZE];
+	volatile unsigned int head;
+	volatile unsigned int tail;
+	volatile uint8_t orphaned;
+	struct LogRing *next;
+};
+
+static struct LogRing *rings;
+static __thread struct LogRing *ring;
+static pthread_key_t ringKey;
+static pthread_t logThread;
+static pthread_mutex_t logMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t logCond = PTHREAD_COND_INITIALIZER;
+static volatile uint8_t logAsleep = 0;
+static volatile uint8_t logStop = 0;
 
 /**
  * This routine has to be called before logging can start. It uses the pthread library,
@@ -22,6 +69,18 @@ void initLog(uint8_t verbosity) {
 	logconf->printName = 0;
 	logconf->printAtomic = malloc(sizeof(pthread_mutex_t));
 	pthread_mutex_init (logconf->printAtomic, NULL);
+	logconf->async = 0;
+	logconf->file = NULL;
+}
+
+/**
+ * Writes messages to the given file as well, in append mode. The file is not colored.
+ */
+int setLogFile(const char *path) {
+	FILE *file = fopen(path, "a");
+	if (file == NULL) return -1;
+	logconf->file = file;
+	return 0;
 }
 
 /**
@@ -81,13 +140,11 @@ void textcolor(int attr, int fg, int bg) {
 }
 
 /*
- * Prints the verbosity level, the function in which it occurs (given parameter __func__),
- * the thread name and the message.
+ * Writes one message to stdout in the color of its verbosity, to syslog and to the log
+ * file. Does not flush, that is left to the caller.
  */
-void tprintf(uint8_t verbosity, const char *function, char *msg) {
-	if (verbosity > logconf->levelOfVerbosity) return;
-	pthread_t this = pthread_self();
-	const char *thread = ptreaty_get_thread_name(&this);
+static void write_record(uint8_t verbosity, const char *function, const char *thread,
+		const char *msg) {
 	uint8_t color = 7;
 
 	uint8_t text_style = 0;
@@ -115,24 +172,207 @@ void tprintf(uint8_t verbosity, const char *function, char *msg) {
 		printf("[%s | %s] %s\n", function, thread, msg);
 	}
 	textcolor(RESET, WHITE, BLACK);
+	if (logconf->file != NULL) {
+		fprintf(logconf->file, "%i [%s | %s] %s\n", verbosity, function, thread, msg);
+	}
 	
 	// The syslog function is a possible cancellation point, so threading errors might
 	// very well appear right here... syslog doesn't understand verbosities > 7
 	if (verbosity > 7) verbosity = 7;
 	syslog(LOG_MAKEPRI(LOG_LOCAL0, verbosity), "[%s | %s] %s\n", function, thread, msg);
+}
+
+/**
+ * The ring of a thread that exits is left to the log thread.
+ */
+static void orphan_ring(void *arg) {
+	((struct LogRing*)arg)->orphaned = 1;
+}
+
+/**
+ * Returns a free record in the ring of this thread, or NULL if there is no room. The
+ * record is only visible to the log thread after push_record.
+ */
+static struct LogRecord *reserve_record() {
+	if (ring == NULL) {
+		ring = calloc(1, sizeof(struct LogRing));
+		if (ring == NULL) return NULL;
+		pthread_setspecific(ringKey, ring);
+		pthread_mutex_lock(&logMutex);
+		ring->next = rings;
+		rings = ring;
+		pthread_mutex_unlock(&logMutex);
+	}
+	if (ring->head - ring->tail == LOG_RING_SIZE) return NULL;
+	return &ring->record[ring->head & (LOG_RING_SIZE - 1)];
+}
+
+static void push_record() {
+	__sync_synchronize();
+	ring->head++;
+	if (logAsleep) {
+		pthread_mutex_lock(&logMutex);
+		pthread_cond_signal(&logCond);
+		pthread_mutex_unlock(&logMutex);
+	}
+}
+
+static void fill_record(struct LogRecord *rec, uint8_t verbosity, const char *function) {
+	rec->verbosity = verbosity;
+	snprintf(rec->function, LOG_FUNCTION_LEN, "%s", function);
+	snprintf(rec->thread, LOG_THREAD_LEN, "%s", ptreaty_thread_name());
+}
+
+/**
+ * Writes all messages in all rings, and frees the rings of exited threads. Returns the
+ * amount of messages written.
+ */
+static int drain_rings() {
+	struct LogRing *r, **prev;
+	int n = 0;
+	pthread_mutex_lock(&logMutex);
+	r = rings;
+	pthread_mutex_unlock(&logMutex);
+	for (; r != NULL; r = r->next) {
+		while (r->tail != r->head) {
+			struct LogRecord *rec = &r->record[r->tail & (LOG_RING_SIZE - 1)];
+			__sync_synchronize();
+			write_record(rec->verbosity, rec->function, rec->thread, rec->msg);
+			__sync_synchronize();
+			r->tail++;
+			n++;
+		}
+	}
+	pthread_mutex_lock(&logMutex);
+	for (prev = &rings; (r = *prev) != NULL; ) {
+		if (r->orphaned && r->tail == r->head) {
+			*prev = r->next;
+			free(r);
+		} else {
+			prev = &r->next;
+		}
+	}
+	pthread_mutex_unlock(&logMutex);
+	if (n) fflush(NULL);
+	return n;
+}
+
+/**
+ * The log thread. It sleeps when there is nothing to write, at most 10 ms, so a wakeup
+ * that is missed only delays messages.
+ */
+static void *log_keeper(void *arg) {
+	struct timespec wakeup;
+	ptreaty_set_thread_name("Log");
+	while (1) {
+		if (drain_rings()) continue;
+		if (logStop) break;
+		clock_gettime(CLOCK_REALTIME, &wakeup);
+		wakeup.tv_nsec += 10000000;
+		if (wakeup.tv_nsec >= 1000000000) {
+			wakeup.tv_sec++;
+			wakeup.tv_nsec -= 1000000000;
+		}
+		pthread_mutex_lock(&logMutex);
+		logAsleep = 1;
+		pthread_cond_timedwait(&logCond, &logMutex, &wakeup);
+		logAsleep = 0;
+		pthread_mutex_unlock(&logMutex);
+	}
+	drain_rings();
+	return NULL;
+}
+
+/**
+ * Starts the log thread, log messages are not written by the logging threads from now on.
+ * The remaining messages are written at exit. Call it after initLog.
+ */
+int startLogThread() {
+	if (logconf->async) return 0;
+	pthread_key_create(&ringKey, orphan_ring);
+	logStop = 0;
+	if (pthread_create(&logThread, NULL, log_keeper, NULL)) return -1;
+	logconf->async = 1;
+	atexit(stopLogThread);
+	return 0;
+}
+
+/**
+ * Writes the remaining messages and stops the log thread. Messages logged afterwards are
+ * written directly again.
+ */
+void stopLogThread() {
+	if (!logconf->async) return;
+	logconf->async = 0;
+	logStop = 1;
+	pthread_mutex_lock(&logMutex);
+	pthread_cond_signal(&logCond);
+	pthread_mutex_unlock(&logMutex);
+	pthread_join(logThread, NULL);
+}
+
+/*
+ * Prints the verbosity level, the function in which it occurs (given parameter __func__),
+ * the thread name and the message. The parentheses around the name keep the tprintf macro
+ * out of it.
+ */
+void (tprintf)(uint8_t verbosity, const char *function, char *msg) {
+	if (verbosity > logconf->levelOfVerbosity) return;
+	if (logconf->async) {
+		struct LogRecord *rec = reserve_record();
+		if (rec != NULL) {
+			fill_record(rec, verbosity, function);
+			snprintf(rec->msg, LOG_MSG_LEN, "%s", msg);
+			push_record();
+			return;
+		}
+	}
+	write_record(verbosity, function, ptreaty_thread_name(), msg);
+	fflush(NULL);
+}
+
+/*
+ * Like tprintf, but formats the message itself. In the asynchronous case the message is
+ * formatted directly into the ring.
+ */
+void tprintf_format(uint8_t verbosity, const char *function, const char *format, ...) {
+	va_list args;
+	if (verbosity > logconf->levelOfVerbosity) return;
+	va_start(args, format);
+	if (logconf->async) {
+		struct LogRecord *rec = reserve_record();
+		if (rec != NULL) {
+			fill_record(rec, verbosity, function);
+			vsnprintf(rec->msg, LOG_MSG_LEN, format, args);
+			va_end(args);
+			push_record();
+			return;
+		}
+	}
+	char msg[LOG_MSG_LEN];
+	vsnprintf(msg, LOG_MSG_LEN, format, args);
+	va_end(args);
+	write_record(verbosity, function, ptreaty_thread_name(), msg);
 	fflush(NULL);
 }
 
+/*
+ * Prints a message of multiple lines, without lines of other threads in between. The lines
+ * of one thread stay together in its ring, so only the direct way needs the lock.
+ */
 void btprintf(uint8_t verbosity, const char *function, char *msg) {
-	pthread_mutex_lock(logconf->printAtomic);
-	char * pch;
-	pch = strtok (msg,"\n");
+	uint8_t async = logconf->async;
+	char *pch, *save;
+	if (!async) pthread_mutex_lock(logconf->printAtomic);
+	pch = strtok_r(msg, "\n", &save);
 	while (pch!=NULL) {
 		tprintf(verbosity, function, pch);
-		pch= strtok(NULL,"\n");
+		pch = strtok_r(NULL, "\n", &save);
+	}
+	if (!async) {
+		fflush(NULL);
+		pthread_mutex_unlock(logconf->printAtomic);
 	}
-	fflush(NULL);
-	pthread_mutex_unlock(logconf->printAtomic);
 }
 
 /**
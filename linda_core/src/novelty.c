@@ -0,0 +1,423 @@
+/**
+ * @file novelty.c
+ *
+ * A byte of the exclusive or of two words is not zero when the cells differ, which shows in
+ * its highest bit after adding 0x7F to the lower seven bits of every byte, so one popcount
+ * counts the cells of a word that differ. The table uses linear probing, and removes an
+ * entry by shifting the entries after it back, so there are no tombstones.
+ *
+ * A topology that is added to a shard that is not full is written in the slot after the
+ * count, where no reader looks, and shows when the count is raised with a release store, so
+ * filling the archive does not copy it. Its entry in the table is a release store in an empty
+ * slot, which a reader loads with acquire, so it sees the entry with the topology, or not at
+ * all. A reader only looks at the heap once the shard is full, and then the shard is not
+ * changed in place anymore. A topology that replaces another one, or that needs a larger
+ * stride, goes into a copy of the snapshot, which is swapped in. A reader that got the old
+ * one can go on with it, the topology it misses is just not compared with, as if it came in a
+ * bit later. Every change raises the epoch, and when the writer finds another epoch than the
+ * reader saw, the topology is looked up again.
+ *
+ * The readers count themselves in one of two eras. A snapshot that is swapped out is retired,
+ * and the next time the retired ones are reclaimed, the era flips. Who comes in after that
+ * counts in the new era, so once the count of the old era drops to zero, no reader holds the
+ * retired snapshots anymore and they are freed. A reader that comes in while the era flips
+ * sees it when it checks again, and counts in the new one. A flip waits until the one before
+ * it is done, so all readers of before a flip are in the old era.
+ *
+ * @date_created    Oct 14, 2026
+ * @date_modified   Oct 14, 2026
+ * @author          Anne C. van Rossum
+ * @project         Replicator
+ * @company         Almende B.V.
+ * @license         open-source, GNU Lesser General Public License
+ */
+
+#include <novelty.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <log.h>
+
+#define LOW_SEVEN		0x7F7F7F7F7F7F7F7FULL
+
+/****************************************************************************************************
+ *  		Snapshots
+ ***************************************************************************************************/
+
+static inline uint16_t wordCount(uint16_t length) {
+	return (length + 7) / 8;
+}
+
+static inline uint64_t *slotWords(const struct NoveltySnapshot *snapshot, uint32_t slot) {
+	return &snapshot->words[(size_t)slot * snapshot->stride];
+}
+
+/**
+ * The arrays follow the snapshot itself, from the largest alignment to the smallest.
+ */
+static struct NoveltySnapshot *newSnapshot(uint32_t capacity, uint16_t stride) {
+	uint32_t size = 16;
+	while (size < 2 * capacity) size <<= 1;
+	size_t words = (size_t)capacity * stride * sizeof(uint64_t);
+	struct NoveltySnapshot *snapshot = calloc(1, sizeof(struct NoveltySnapshot) + words +
+			capacity * (sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint16_t) + 1) +
+			size * sizeof(uint32_t));
+	if (snapshot == NULL) return NULL;
+	snapshot->capacity = capacity;
+	snapshot->stride = stride;
+	snapshot->words = (uint64_t*)(snapshot + 1);
+	snapshot->hashes = (uint64_t*)((char*)snapshot->words + words);
+	snapshot->heap = (uint32_t*)(snapshot->hashes + capacity);
+	snapshot->table = snapshot->heap + capacity;
+	snapshot->lengths = (uint16_t*)(snapshot->table + size);
+	snapshot->novelties = (uint8_t*)(snapshot->lengths + capacity);
+	snapshot->table_mask = size - 1;
+	return snapshot;
+}
+
+static struct NoveltySnapshot *copySnapshot(const struct NoveltySnapshot *old, uint16_t stride) {
+	struct NoveltySnapshot *snapshot = newSnapshot(old->capacity, stride);
+	uint32_t i;
+	if (snapshot == NULL) return NULL;
+	if (stride == old->stride) {
+		memcpy(snapshot->words, old->words, (size_t)old->count * stride * sizeof(uint64_t));
+	} else for (i = 0; i < old->count; i++) {
+		memcpy(slotWords(snapshot, i), slotWords(old, i), old->stride * sizeof(uint64_t));
+	}
+	memcpy(snapshot->hashes, old->hashes, old->count * sizeof(uint64_t));
+	memcpy(snapshot->heap, old->heap, old->count * sizeof(uint32_t));
+	memcpy(snapshot->table, old->table, (old->table_mask + 1) * sizeof(uint32_t));
+	memcpy(snapshot->lengths, old->lengths, old->count * sizeof(uint16_t));
+	memcpy(snapshot->novelties, old->novelties, old->count);
+	snapshot->count = old->count;
+	snapshot->epoch = old->epoch + 1;
+	return snapshot;
+}
+
+static void freeSnapshots(struct NoveltySnapshot *snapshot) {
+	struct NoveltySnapshot *next;
+	for (; snapshot != NULL; snapshot = next) {
+		next = snapshot->next;
+		free(snapshot);
+	}
+}
+
+/**
+ * Frees the snapshots that waited for the readers of the old era, if those are gone, and
+ * flips the era for the ones that are retired since. Must be called with the retired mutex.
+ */
+static void reclaimSnapshots(struct LindaNovelty *novelty) {
+	uint8_t i;
+	for (i = 0; i < 2; i++) {
+		if (novelty->flipped) {
+			if (__atomic_load_n(&novelty->readers[novelty->era ^ 1], __ATOMIC_SEQ_CST)) return;
+			freeSnapshots(novelty->waiting);
+			novelty->waiting = NULL;
+			novelty->flipped = 0;
+		}
+		if (novelty->retired == NULL) return;
+		novelty->waiting = novelty->retired;
+		novelty->retired = NULL;
+		__atomic_store_n(&novelty->era, novelty->era ^ 1, __ATOMIC_SEQ_CST);
+		novelty->flipped = 1;
+	}
+}
+
+static void retireSnapshot(struct LindaNovelty *novelty, struct NoveltySnapshot *snapshot) {
+	pthread_mutex_lock(&novelty->retired_mutex);
+	snapshot->next = novelty->retired;
+	novelty->retired = snapshot;
+	reclaimSnapshots(novelty);
+	pthread_mutex_unlock(&novelty->retired_mutex);
+}
+
+/**
+ * Counts the reader in the current era, see above, and returns the era.
+ */
+static uint8_t enterReader(struct LindaNovelty *novelty) {
+	uint8_t era;
+	while (1) {
+		era = __atomic_load_n(&novelty->era, __ATOMIC_SEQ_CST);
+		__atomic_add_fetch(&novelty->readers[era], 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&novelty->era, __ATOMIC_SEQ_CST) == era) return era;
+		__atomic_sub_fetch(&novelty->readers[era], 1, __ATOMIC_SEQ_CST);
+	}
+}
+
+/**
+ * The last reader of an old era reclaims the snapshots, unless a writer is at it already.
+ */
+static void leaveReader(struct LindaNovelty *novelty, uint8_t era) {
+	if (__atomic_sub_fetch(&novelty->readers[era], 1, __ATOMIC_SEQ_CST) ||
+			(__atomic_load_n(&novelty->era, __ATOMIC_SEQ_CST) == era)) return;
+	if (pthread_mutex_trylock(&novelty->retired_mutex)) return;
+	reclaimSnapshots(novelty);
+	pthread_mutex_unlock(&novelty->retired_mutex);
+}
+
+static inline struct NoveltySnapshot *loadSnapshot(struct NoveltyShard *shard) {
+	return __atomic_load_n(&shard->snapshot, __ATOMIC_ACQUIRE);
+}
+
+static inline uint32_t loadCount(const struct NoveltySnapshot *snapshot) {
+	return __atomic_load_n(&snapshot->count, __ATOMIC_ACQUIRE);
+}
+
+/****************************************************************************************************
+ *  		Archive
+ ***************************************************************************************************/
+
+struct LindaNovelty *linda_novelty_new(uint32_t capacity, uint8_t cap) {
+	struct LindaNovelty *novelty = calloc(1, sizeof(struct LindaNovelty));
+	uint32_t shards = (capacity + LINDA_NOVELTY_SHARD_SIZE - 1) / LINDA_NOVELTY_SHARD_SIZE;
+	uint8_t i;
+	if (novelty == NULL || !capacity) {
+		free(novelty);
+		return NULL;
+	}
+	novelty->capacity = capacity;
+	novelty->cap = cap;
+	novelty->shard_count = (shards > LINDA_NOVELTY_MAX_SHARDS) ? LINDA_NOVELTY_MAX_SHARDS : shards;
+	novelty->shards = calloc(novelty->shard_count, sizeof(struct NoveltyShard));
+	pthread_mutex_init(&novelty->retired_mutex, NULL);
+	if (novelty->shards == NULL) {
+		free(novelty);
+		return NULL;
+	}
+	for (i = 0; i < novelty->shard_count; i++) {
+		pthread_mutex_init(&novelty->shards[i].mutex, NULL);
+		novelty->shards[i].snapshot = newSnapshot(capacity / novelty->shard_count +
+				(i < capacity % novelty->shard_count), 1);
+		if (novelty->shards[i].snapshot == NULL) {
+			linda_novelty_free(novelty);
+			return NULL;
+		}
+	}
+	return novelty;
+}
+
+void linda_novelty_free(struct LindaNovelty *novelty) {
+	struct NoveltySnapshot *snapshot;
+	uint8_t i;
+	if (novelty == NULL) return;
+	for (i = 0; i < novelty->shard_count; i++) {
+		pthread_mutex_destroy(&novelty->shards[i].mutex);
+		free(novelty->shards[i].snapshot);
+	}
+	freeSnapshots(novelty->retired);
+	freeSnapshots(novelty->waiting);
+	pthread_mutex_destroy(&novelty->retired_mutex);
+	free(novelty->shards);
+	free(novelty);
+}
+
+uint32_t linda_novelty_count(struct LindaNovelty *novelty) {
+	uint32_t count = 0;
+	uint8_t i, era = enterReader(novelty);
+	for (i = 0; i < novelty->shard_count; i++) count += loadCount(loadSnapshot(&novelty->shards[i]));
+	leaveReader(novelty, era);
+	return count;
+}
+
+/**
+ * Only the words that the topology covers are hashed, so the hash does not change when the
+ * stride grows.
+ */
+static uint64_t hashWords(const uint64_t *words, uint16_t length) {
+	uint64_t hash = 0x9E3779B97F4A7C15ULL ^ length;
+	uint16_t i;
+	for (i = 0; i < wordCount(length); i++) {
+		hash = (hash ^ words[i]) * 0xFF51AFD7ED558CCDULL;
+		hash ^= hash >> 32;
+	}
+	return hash;
+}
+
+static inline uint16_t differingCells(uint64_t x) {
+	return __builtin_popcountll((((x & LOW_SEVEN) + LOW_SEVEN) | x) & ~LOW_SEVEN);
+}
+
+/**
+ * The words are zero beyond the end of a topology, but the cells there are not, so the last
+ * word that both topologies cover is masked.
+ */
+static uint16_t wordDistance(const uint64_t *a, uint16_t a_length, const uint64_t *b,
+		uint16_t b_length) {
+	uint16_t n = (a_length < b_length) ? a_length : b_length, i;
+	uint16_t result = (a_length < b_length) ? b_length - n : a_length - n;
+	for (i = 0; i < n / 8; i++) {
+		result += differingCells(a[i] ^ b[i]);
+	}
+	if (n % 8) {
+		uint64_t mask = 0;
+		memset(&mask, 0xFF, n % 8);
+		result += differingCells((a[i] ^ b[i]) & mask);
+	}
+	return result;
+}
+
+uint16_t linda_novelty_distance(const uint8_t *a, uint16_t a_length, const uint8_t *b,
+		uint16_t b_length) {
+	uint16_t n = (a_length < b_length) ? a_length : b_length, i;
+	uint16_t result = (a_length < b_length) ? b_length - n : a_length - n;
+	for (i = 0; i < n; i++) {
+		if (a[i] != b[i]) result++;
+	}
+	return result;
+}
+
+static void insertTable(struct NoveltySnapshot *snapshot, uint32_t slot) {
+	uint32_t i = snapshot->hashes[slot] & snapshot->table_mask;
+	while (snapshot->table[i]) i = (i + 1) & snapshot->table_mask;
+	__atomic_store_n(&snapshot->table[i], slot + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * An entry after the one that is removed moves back into its place, if the place it hashes to
+ * is not in between.
+ */
+static void removeTable(struct NoveltySnapshot *snapshot, uint32_t slot) {
+	uint32_t mask = snapshot->table_mask, i = snapshot->hashes[slot] & mask, j, k;
+	while (snapshot->table[i] != slot + 1) i = (i + 1) & mask;
+	for (j = (i + 1) & mask; snapshot->table[j]; j = (j + 1) & mask) {
+		k = snapshot->hashes[snapshot->table[j] - 1] & mask;
+		if ((i <= j) ? (k <= i || k > j) : (k <= i && k > j)) {
+			snapshot->table[i] = snapshot->table[j];
+			i = j;
+		}
+	}
+	snapshot->table[i] = 0;
+}
+
+static uint8_t findTable(const struct NoveltySnapshot *snapshot, const uint64_t *words,
+		uint16_t length, uint64_t hash) {
+	uint32_t i = hash & snapshot->table_mask, slot;
+	for (; (slot = __atomic_load_n(&snapshot->table[i], __ATOMIC_ACQUIRE)) != 0;
+			i = (i + 1) & snapshot->table_mask) {
+		slot--;
+		if (snapshot->hashes[slot] == hash && snapshot->lengths[slot] == length &&
+				!memcmp(slotWords(snapshot, slot), words, wordCount(length) * sizeof(uint64_t)))
+			return 1;
+	}
+	return 0;
+}
+
+static void siftUp(struct NoveltySnapshot *snapshot, uint32_t i) {
+	uint32_t *heap = snapshot->heap, slot = heap[i];
+	while (i > 0 && snapshot->novelties[heap[(i - 1) / 2]] > snapshot->novelties[slot]) {
+		heap[i] = heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	heap[i] = slot;
+}
+
+static void siftDown(struct NoveltySnapshot *snapshot, uint32_t i) {
+	uint32_t *heap = snapshot->heap, slot = heap[i], child;
+	while ((child = 2 * i + 1) < snapshot->count) {
+		if (child + 1 < snapshot->count &&
+				snapshot->novelties[heap[child + 1]] < snapshot->novelties[heap[child]]) child++;
+		if (snapshot->novelties[heap[child]] >= snapshot->novelties[slot]) break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = slot;
+}
+
+/**
+ * Whether the topology would go into the archive, given this snapshot of its shard. The heap
+ * is only read when the shard is full, when it does not change in place anymore.
+ */
+static inline uint8_t admits(const struct NoveltySnapshot *snapshot, uint8_t value) {
+	return loadCount(snapshot) < snapshot->capacity ||
+			snapshot->novelties[snapshot->heap[0]] < value;
+}
+
+static void storeSlot(struct NoveltySnapshot *snapshot, uint32_t slot, const uint64_t *words,
+		uint16_t length, uint64_t hash, uint8_t value) {
+	memset(slotWords(snapshot, slot), 0, snapshot->stride * sizeof(uint64_t));
+	memcpy(slotWords(snapshot, slot), words, wordCount(length) * sizeof(uint64_t));
+	snapshot->lengths[slot] = length;
+	snapshot->hashes[slot] = hash;
+	snapshot->novelties[slot] = value;
+	insertTable(snapshot, slot);
+}
+
+/**
+ * Publishes a snapshot of the shard with the topology in it, if it still has to go in.
+ */
+static void archiveTopology(struct LindaNovelty *novelty, struct NoveltyShard *shard,
+		uint64_t epoch, const uint64_t *words, uint16_t length, uint64_t hash, uint8_t value) {
+	uint16_t stride = wordCount(length) ? wordCount(length) : 1;
+	uint32_t slot;
+	pthread_mutex_lock(&shard->mutex);
+	struct NoveltySnapshot *old = shard->snapshot, *snapshot;
+	if ((old->epoch != epoch && findTable(old, words, length, hash)) || !admits(old, value)) {
+		pthread_mutex_unlock(&shard->mutex);
+		return;
+	}
+	if (old->count < old->capacity && stride <= old->stride) {
+		slot = old->count;
+		storeSlot(old, slot, words, length, hash, value);
+		old->heap[slot] = slot;
+		siftUp(old, slot);
+		__atomic_store_n(&old->count, slot + 1, __ATOMIC_RELEASE);
+		__atomic_store_n(&old->epoch, old->epoch + 1, __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&shard->mutex);
+		return;
+	}
+	snapshot = copySnapshot(old, (stride > old->stride) ? stride : old->stride);
+	if (snapshot == NULL) {
+		pthread_mutex_unlock(&shard->mutex);
+		tprintf(LOG_ERR, __func__, "No memory for the topology");
+		return;
+	}
+	if (snapshot->count < snapshot->capacity) {
+		slot = snapshot->count++;
+		storeSlot(snapshot, slot, words, length, hash, value);
+		snapshot->heap[slot] = slot;
+		siftUp(snapshot, slot);
+	} else {
+		slot = snapshot->heap[0];
+		removeTable(snapshot, slot);
+		storeSlot(snapshot, slot, words, length, hash, value);
+		siftDown(snapshot, 0);
+	}
+	__atomic_store_n(&shard->snapshot, snapshot, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&shard->mutex);
+	retireSnapshot(novelty, old);
+}
+
+uint8_t linda_novelty_judge(struct LindaNovelty *novelty, const uint8_t *cells,
+		uint16_t length) {
+	uint16_t sum = 0, delta;
+	uint32_t i;
+	uint8_t k;
+	uint64_t *words = calloc(wordCount(length) ? wordCount(length) : 1, sizeof(uint64_t));
+	if (words == NULL) {
+		tprintf(LOG_ERR, __func__, "No memory for the topology");
+		return 0;
+	}
+	memcpy(words, cells, length);
+	uint64_t hash = hashWords(words, length);
+	struct NoveltyShard *shard = &novelty->shards[hash % novelty->shard_count];
+	uint8_t era = enterReader(novelty);
+	struct NoveltySnapshot *own = loadSnapshot(shard), *snapshot;
+	uint64_t epoch = __atomic_load_n(&own->epoch, __ATOMIC_ACQUIRE);
+
+	for (k = 0; k < novelty->shard_count && sum < 255; k++) {
+		snapshot = (&novelty->shards[k] == shard) ? own : loadSnapshot(&novelty->shards[k]);
+		uint32_t count = loadCount(snapshot);
+		for (i = 0; i < count && sum < 255; i++) {
+			delta = wordDistance(slotWords(snapshot, i), snapshot->lengths[i], words, length);
+			sum += (delta > novelty->cap) ? novelty->cap : delta;
+		}
+	}
+	uint8_t value = (sum > 255) ? 255 : sum;
+
+	if (!findTable(own, words, length, hash) && admits(own, value)) {
+		archiveTopology(novelty, shard, epoch, words, length, hash, value);
+	}
+	leaveReader(novelty, era);
+	free(words);
+	return value;
+}
@@ -11,11 +11,19 @@
  * daughter tasks in which only the last one needs to evoke this callback task. This became
  * obvious in the implementation of TCP/IP routines.
  *
+ * There are two ways to express an order. Conditions are registered once on functions, like
+ * "func1 only after func0", and hold for every later dispatch via dispatch_poseta_task. A task
+ * that is dispatched before its conditions are met is parked in the condition table, not on a
+ * monk, and dispatched by the monk that completes the last function it waits for. Graphs are
+ * built for one run: nodes with any amount of predecessors, each with a counter of the
+ * predecessors that did not finish yet. A node is handed to the abbey when its counter drops
+ * to zero, so no thread ever waits for another one.
+ *
  * Another type of task, called a TupleTask is defined. In some cases it might be necessary not
  * to give up execution of control. Subsequent tasks are then executed by the same monk.
  *
  * @date_created    May 14, 2009
- * @date_modified   May 14, 2009
+ * @date_modified   Oct 14, 2026
  * @author          Anne C. van Rossum
  * @project         Replicator
  * @company         Almende B.V.
@@ -26,10 +34,16 @@
 #include <abbey.h>
 #include <stdlib.h>
 #include <poseta.h>
+#include <slab.h>
 #include <inttypes.h>
+#include <stdint.h>
 #include <string.h>
 #include <log.h>
 #include <stdio.h>
+#include <pthread.h>
+
+//! Amount of buckets in the condition table, should be a power of two
+#define CONDITION_TABLE_SIZE	64
 
 /***********************************************************************************************
  *
@@ -54,79 +68,101 @@ struct TupleTask {
 };
 
 /**
- * The same as a TupleTask, but now with the second routine specified as a condition
- * in the form of a "treaty". Those "treaties" use several mutexes and conditionals
- * from a SyncThread struct, to implement synchronization primitives, like signals
- * and handshakes. The order field defines if first the treaty is checked and then
- * the function is executed (order=1), or the other way around (order=0).
+ * A dispatch of a function that waits for its conditions. The descriptor keeps a copy of the
+ * description, so the caller does not have to.
  */
-struct PosetaTask {
-	//! A pointer to a function to be executed.
-	void *(*func)(void *);
-	//! A pointer to the arguments of the to be executed function.
+struct ParkedTask {
+	const struct AbbeyTaskDescriptor *descriptor;
 	void *context;
-	//! A pointer to the treaty
-	void (*treaty)(struct SyncThreads *);
-	//! A pointer to the arguments of the treaty
-	struct SyncThreads *st;
-	//! Order
-	uint8_t order;
+	struct ParkedTask *next;
 };
 
 /**
- * Multiple conditions can not be registered on one task. For that you would need to define
- * multiple tasks.
- * @todo This needs to be rewritten. Multiple conditions are not straightforward to
- * implement. Most logical is not to call exec(context) each time a condition is met, but
- * to check a bunch of prerequisites/conditions, only then execute a function and end with
- * a series of post-conditions. Perhaps it is not necessary to really define multiple
- * conditions on a routine, but at least every function should be able to have a precondition
- * as well as a postcondition.
+ * The conditions on one function. A condition is indexed with the function pointer. The
+ * function has run when done is set. It is only allowed to run itself when all functions in
+ * after have run, dispatches before that moment are parked. Every function in then is
+ * dispatched after each run of this function, with its result as context. The arrays only
+ * grow when conditions are registered.
  */
 struct Condition {
-	//! A condition is indexed with void function pointers.
 	void *(*name)(void *);
-	//! A condition index defines the type of condition.
-	uint8_t condition_index;
-	//! The function to be executed. It's most probably a poseta_task routine.
-	void *(*exec)(void *);
-	//! The context to the to be executed function. Most probably a PosetaTask.
-	void *context;
-	//! The conditions are a linked list.
+	volatile int done;
+	struct Condition **after;
+	uint8_t after_count;
+	struct Condition **before;
+	uint8_t before_count;
+	void *(**then)(void *);
+	uint8_t then_count;
+	struct ParkedTask *parked;
+	//! The conditions in one bucket of the table are a linked list.
 	struct Condition *next;
 };
 
-// doesn't work just by having condition blocks, see the to do above
-//struct ConditionBlock {
-//	struct Condition *cond;
-//	uint8_t count;
-//	struct ConditionBlock *next;
-//};
+/**
+ * The context of a task that runs a function with conditions and reports back afterwards.
+ */
+struct PosetaRun {
+	struct Condition *cond;
+	void *context;
+};
 
 /**
- * Configuration parameters. Contains the head of the linked list of conditions.
+ * Configuration parameters. Contains the hash table of conditions. The mutex protects the
+ * registration of conditions and the parked tasks, not the lookup.
  */
 struct PosetaConfig {
-	struct Condition *cond;
+	struct Condition *cond[CONDITION_TABLE_SIZE];
+	pthread_mutex_t lock;
 };
 
 //! Global variable to store the configuration
 struct PosetaConfig *posconf;
 
+/**
+ * A node in a task graph. Pending counts the predecessors that have not finished yet in the
+ * current run, predecessors is the total, which is what pending starts with.
+ */
+struct PosetaNode {
+	const struct AbbeyTaskDescriptor *descriptor;
+	void *context;
+	volatile int pending;
+	int predecessors;
+	struct PosetaNode **successors;
+	int successor_count;
+	int successor_capacity;
+	struct PosetaGraph *graph;
+};
+
+/**
+ * A set of nodes that runs once. Remaining counts the nodes that did not finish, the last
+ * one to finish dispatches the done continuation and frees the graph.
+ */
+struct PosetaGraph {
+	struct PosetaNode **nodes;
+	int node_count;
+	int node_capacity;
+	volatile int remaining;
+	void *(*done)(void *);
+	void *done_context;
+	char *done_desc;
+};
 
 /***********************************************************************************************
  * Function declarations
  ***********************************************************************************************/
 
 /**
- * Returns the condition with the given name from the linked list.
+ * Returns the condition with the given name from the table.
  */
 struct Condition *getCondition(void *(*name)(void*));
 
 /**
- * Adds a condition to the linked list.
+ * Returns the condition with the given name, it is added if it does not exist yet.
  */
-void addCondition(struct Condition *cond);
+static struct Condition *addCondition(void *(*name)(void*));
+
+static int condition_dispatch(struct Condition *lc, const struct AbbeyTaskDescriptor *descriptor,
+		void *context);
 
 /***********************************************************************************************
  *
@@ -136,58 +172,106 @@ void addCondition(struct Condition *cond);
  *
  ***********************************************************************************************/
 
+static inline unsigned int condition_hash(void *(*name)(void*)) {
+	uintptr_t h = (uintptr_t)name;
+	return (unsigned int)((h >> 4) ^ (h >> 12)) & (CONDITION_TABLE_SIZE - 1);
+}
+
 /**
- * Allocates memory for the configuration struct and initializes the list pointer.
+ * Allocates memory for the configuration struct and initializes the table.
  */
 void initPoseta() {
-	posconf = malloc(sizeof(struct PosetaConfig));
-	posconf->cond = NULL;
+	posconf = calloc(1, sizeof(struct PosetaConfig));
+	pthread_mutex_init(&posconf->lock, NULL);
 }
 
 /**
- * Adds a condition to the linked list. It is checked if the condition with this name
- * already exists, and in that case an error is thrown and the condition is not added.
+ * Adds an empty condition to the table, or returns the existing one with this name. Must be
+ * called with the poseta lock held. The condition is filled in before it becomes visible to
+ * getCondition, which does not take the lock.
  */
-void addCondition(struct Condition *cond) {
-	//first condition ever
-	struct Condition *lc = posconf->cond;
-	if (lc == NULL) {
-		tprintf(LOG_VERBOSE, __func__, "Add first condition");
-		lc = posconf->cond = cond;
-		lc->next = NULL;
-		return;
-	}
-	if (getCondition(cond->name) != NULL) {
-		tprintf(LOG_ALERT, __func__, "Condition exists already");
-		return;
-	}
+static struct Condition *addCondition(void *(*name)(void*)) {
+	struct Condition *lc = getCondition(name);
+	if (lc != NULL) return lc;
+	lc = calloc(1, sizeof(struct Condition));
+	if (lc == NULL) return NULL;
+	lc->name = name;
+	unsigned int h = condition_hash(name);
+	lc->next = posconf->cond[h];
+	__sync_synchronize();
+	posconf->cond[h] = lc;
 	tprintf(LOG_VERBOSE, __func__, "Success");
-	cond->next = lc;
-	posconf->cond = cond;
+	return lc;
 }
 
 /**
- * Retrieves a condition from the linked list. If the condition is not found a NULL pointer
- * is returned.
+ * Retrieves a condition from the table. If the condition is not found a NULL pointer is
+ * returned.
  */
 struct Condition *getCondition(void *(*name)(void*)) {
-	struct Condition *lc = posconf->cond;
-	if (lc == NULL) {
-		tprintf(LOG_WARNING, __func__, "No conditions at all...");
-		return NULL;
+	struct Condition *lc = posconf->cond[condition_hash(name)];
+	for (; lc != NULL; lc = lc->next) {
+		if (lc->name == name) return lc;
 	}
-	uint8_t i = 0;
-	do {
-		//strncmp doesnt work on function pointers of course
-		if(*lc->name == *name) return lc;
-		lc = lc->next;
-		i++;
-	} while (lc != NULL);
-//	char text[64]; sprintf(text, "Condition not found in list of %i items", i);
-//	tprintf(LOG_VERBOSE, __func__, text);
 	return NULL;
 }
 
+/**
+ * Appends an item to one of the arrays of a condition.
+ */
+static int append(void ***array, uint8_t *count, void *item) {
+	void **grown = realloc(*array, (*count + 1) * sizeof(void*));
+	if (grown == NULL) return -1;
+	grown[(*count)++] = item;
+	*array = grown;
+	return 0;
+}
+
+/**
+ * Returns if all functions that this condition waits for have run. Must be called with the
+ * poseta lock held.
+ */
+static int condition_ready(struct Condition *lc) {
+	uint8_t i;
+	for (i = 0; i < lc->after_count; i++) {
+		if (!lc->after[i]->done) return 0;
+	}
+	return 1;
+}
+
+/**
+ * Called after a run of the function of a condition. The first run marks the condition as
+ * done and dispatches the parked tasks of the conditions that become ready by that. Those are
+ * taken from the table under the lock, but dispatched after it is released.
+ */
+static void condition_completed(struct Condition *lc, void *result) {
+	struct ParkedTask *ready = NULL, *pt, *next;
+	uint8_t i;
+	if (!lc->done) {
+		pthread_mutex_lock(&posconf->lock);
+		if (!lc->done) {
+			lc->done = 1;
+			for (i = 0; i < lc->before_count; i++) {
+				struct Condition *lb = lc->before[i];
+				if (lb->parked == NULL || !condition_ready(lb)) continue;
+				for (pt = lb->parked; pt->next != NULL; pt = pt->next);
+				pt->next = ready;
+				ready = lb->parked;
+				lb->parked = NULL;
+			}
+		}
+		pthread_mutex_unlock(&posconf->lock);
+	}
+	for (pt = ready; pt != NULL; pt = next) {
+		next = pt->next;
+		condition_dispatch(getCondition(pt->descriptor->func), pt->descriptor, pt->context);
+		linda_ctx_free(pt);
+	}
+	for (i = 0; i < lc->then_count; i++) {
+		dispatch_poseta_task(lc->then[i], result, "poseta then");
+	}
+}
+
 /***********************************************************************************************
  *
  * @name poseta_tasks
@@ -199,28 +283,57 @@ struct Condition *getCondition(void *(*name)(void*)) {
 /**
  * Expects context to be a TupleTask. Casts it like that and executes the task in the order
  * func0 and then func1. It is guaranteed to be executed by the same monk and in this order.
+ * The TupleTask is given back to the slab afterwards.
  */
 void *tuple_task(void *context) {
 	struct TupleTask *tt = (struct TupleTask*)context;
 	tt->func0(tt->context0);
 	tt->func1(tt->context1);
+	linda_ctx_free(tt);
 	return NULL;
 }
 
 /**
- * Expects context to be a PosetaTask. Casts it like that and executes the task in the order
- * specified by the order parameter in the PosetaTask struct.
+ * Expects context to be a PosetaRun. Runs the function of the condition and reports its
+ * completion, which releases the tasks that wait for it.
  */
 void *poseta_task(void *context) {
-	struct PosetaTask *pt = (struct PosetaTask*)context;
-	if (!pt->order) {
-		pt->func(pt->context);
-		pt->treaty(pt->st);
-	} else {
-		pt->treaty(pt->st);
-		pt->func(pt->context);
+	struct PosetaRun *pr = (struct PosetaRun*)context;
+	struct Condition *lc = pr->cond;
+	void *result = lc->name(pr->context);
+	linda_ctx_free(pr);
+	condition_completed(lc, result);
+	return result;
+}
+
+/**
+ * Runs the function of a node in a graph. Successors whose last predecessor this was are
+ * dispatched in one batch. The last node of the graph dispatches the done continuation and
+ * frees the graph.
+ */
+void *poseta_node_task(void *context) {
+	struct PosetaNode *node = (struct PosetaNode*)context;
+	struct PosetaGraph *graph = node->graph;
+	int i, n = 0;
+	void *result = node->descriptor->func(node->context);
+	void *(*funcs[node->successor_count > 0 ? node->successor_count : 1])(void *);
+	void *contexts[node->successor_count > 0 ? node->successor_count : 1];
+	char *descs[node->successor_count > 0 ? node->successor_count : 1];
+	for (i = 0; i < node->successor_count; i++) {
+		struct PosetaNode *s = node->successors[i];
+		if (!__sync_sub_and_fetch(&s->pending, 1)) {
+			funcs[n] = poseta_node_task;
+			contexts[n] = s;
+			descs[n++] = (char*)s->descriptor->name;
+		}
 	}
-	return NULL;
+	if (n) dispatch_task_batch(funcs, contexts, descs, n);
+	if (!__sync_sub_and_fetch(&graph->remaining, 1)) {
+		if (graph->done != NULL)
+			dispatch_described_task(graph->done, graph->done_context, graph->done_desc);
+		poseta_graph_free(graph);
+	}
+	return result;
 }
 
 /***********************************************************************************************
@@ -238,74 +351,87 @@ void *poseta_task(void *context) {
  * routines like dispatch_described_task or dispatch_task. Only the poseta variant
  * knows how to set the "trap" and catch it later again.
  *
- * This routine reformulates the condition into a function that is called first when the
- * dispatch_poseta_task routine is executed.
+ * Contrary to the treaties this used to be built on, func1 can depend on several
+ * functions, by calling this routine for each of them.
  */
 void poseta_func1_if_func0(void *(*func0)(void *), void *(*func1)(void *)) {
-	//register func0, execute func(hoist, func0) when encountered
-	struct PosetaTask *pt0 = malloc(sizeof(struct PosetaTask));
-	pt0->func = func0;
-	pt0->treaty = ptreaty_should_be_first;
-	pt0->st = malloc(sizeof(struct SyncThreads));
-	pt0->order = 0;
-	ptreaty_init(pt0->st);
-	struct Condition *cond0 = malloc(sizeof(struct Condition));
-	cond0->condition_index = 0;
-	cond0->exec = poseta_task;
-	cond0->context = (void*)pt0;
-	cond0->name = func0;
-	addCondition(cond0);
-
-	//register func1, execute func(hoisted, func1) when encountered
-	struct PosetaTask *pt1 = malloc(sizeof(struct PosetaTask));
-	pt1->func = func1;
-	pt1->treaty = ptreaty_should_be_later;
-	pt1->st = pt0->st;
-	pt1->order = 1;
-	struct Condition *cond1 = malloc(sizeof(struct Condition));
-	cond1->condition_index = 1;
-	cond1->exec = poseta_task;
-	cond1->context = (void*)pt1;
-	cond1->name = func1;
-	addCondition(cond1);
+	pthread_mutex_lock(&posconf->lock);
+	struct Condition *cond0 = addCondition(func0);
+	struct Condition *cond1 = addCondition(func1);
+	if (cond0 == NULL || cond1 == NULL ||
+			append((void***)&cond0->before, &cond0->before_count, cond1) ||
+			append((void***)&cond1->after, &cond1->after_count, cond0)) {
+		tprintf(LOG_ERR, __func__, "Condition could not be added");
+	}
+	pthread_mutex_unlock(&posconf->lock);
 }
 
 /**
  * Executes always func1 after detection of func0 being executed. This not only indicates
  * a dependency, but it also automatically executes func1 when func0 is dispatched. So,
- * what is the context of this second function? Mmm... that is not known... So, this
- * does work only with a second function without context, or a first function providing
- * direct context for the second function.
+ * what is the context of this second function? Mmm... that is not known... So, the result
+ * of the first function is used as direct context for the second function.
  */
 void poseta_func0_then_func1(void *(*func0)(void *), void *(*func1)(void *)) {
-	//register func0, execute func(func0,func1) when encountered
+	pthread_mutex_lock(&posconf->lock);
+	struct Condition *cond0 = addCondition(func0);
+	if (cond0 == NULL ||
+			append((void***)&cond0->then, &cond0->then_count, (void*)func1)) {
+		tprintf(LOG_ERR, __func__, "Condition could not be added");
+	}
+	pthread_mutex_unlock(&posconf->lock);
+}
+
+/**
+ * Dispatches or parks a task of a function with conditions. It only needs to be wrapped in a
+ * poseta_task if something has to happen after it ran.
+ */
+static int condition_dispatch(struct Condition *lc, const struct AbbeyTaskDescriptor *descriptor,
+		void *context) {
+	if (lc->after_count && !lc->done) {
+		pthread_mutex_lock(&posconf->lock);
+		if (!condition_ready(lc)) {
+			struct ParkedTask *pt = linda_ctx_alloc(sizeof(struct ParkedTask));
+			if (pt == NULL) {
+				pthread_mutex_unlock(&posconf->lock);
+				return -1;
+			}
+			pt->descriptor = descriptor;
+			pt->context = context;
+			pt->next = lc->parked;
+			lc->parked = pt;
+			pthread_mutex_unlock(&posconf->lock);
+			tprintf(LOG_VERBOSE, __func__, "Parked until its conditions are met");
+			return 0;
+		}
+		pthread_mutex_unlock(&posconf->lock);
+	}
+	if ((!lc->before_count || lc->done) && !lc->then_count)
+		return dispatch_descriptor_task(descriptor, context);
+	struct PosetaRun *pr = linda_ctx_alloc(sizeof(struct PosetaRun));
+	if (pr == NULL) return -1;
+	pr->cond = lc;
+	pr->context = context;
+	return dispatch_prioritized_task(poseta_task, (void*)pr, (char*)descriptor->name,
+			descriptor->priority);
 }
 
 /**
  * Dispatches a task. This just works as dispatch_described_task or dispatch_task, but
  * now checks eventual conditions set beforehand. It is unnecessary to call this version
  * if not a routine like poseta_func1_if_func0, or another such a routine is called
- * before. The context wouldn't be set correctly in that case, and the function falls
- * back on just execution of that task.
+ * before. A function without conditions is just dispatched.
  */
 int dispatch_poseta_task(void *(*func)(void *), void *context, char *taskDesc) {
 	tprintf(LOG_VERBOSE, __func__, taskDesc);
 	struct Condition *lc = getCondition(func);
 	if (lc == NULL) {
 		char text[128]; sprintf(text, "Task \"%s\" is not registered before!", taskDesc);
-		tprintf(LOG_WARNING, __func__, text);
-		goto fallback;
+		tprintf(LOG_VERBOSE, __func__, text);
+		return dispatch_described_task(func, context, taskDesc);
 	}
-	switch (lc->condition_index) {
-	case 0: case 1:
-		((struct PosetaTask*)lc->context)->context = context;
-		break;
-	default:
-		;
-	}
-
-fallback:
-	return dispatch_described_task(lc->exec, lc->context, taskDesc);
+	return condition_dispatch(lc, abbey_register_task(func, taskDesc, ABBEY_PRIORITY_NORMAL),
+			context);
 }
 
 /**
@@ -316,7 +442,8 @@ fallback:
  */
 int dispatch_tuple_task(void *(*func0)(void *), void *context0,
 		void *(*func1)(void*), void *context1, char *taskDesc) {
-	struct TupleTask *tt = malloc(sizeof(struct TupleTask));
+	struct TupleTask *tt = linda_ctx_alloc(sizeof(struct TupleTask));
+	if (tt == NULL) return -1;
 	tt->func0 = func0;
 	tt->context0 = context0;
 	tt->func1 = func1;
@@ -324,3 +451,117 @@ int dispatch_tuple_task(void *(*func0)(void *), void *context0,
 	return dispatch_described_task(tuple_task, (void*)tt, taskDesc);
 }
 
+/***********************************************************************************************
+ *
+ * @name poseta_graphs
+ *
+ * Graphs of tasks that run once.
+ *
+ ***********************************************************************************************/
+
+/**
+ * Creates an empty graph.
+ */
+struct PosetaGraph *poseta_graph_create() {
+	return calloc(1, sizeof(struct PosetaGraph));
+}
+
+/**
+ * Adds a node that will run func(context) once all its predecessors have run.
+ */
+struct PosetaNode *poseta_graph_add(struct PosetaGraph *graph, void *(*func)(void *),
+		void *context, char *taskDesc) {
+	if (graph->node_count == graph->node_capacity) {
+		int capacity = graph->node_capacity ? 2 * graph->node_capacity : 16;
+		struct PosetaNode **nodes = realloc(graph->nodes, capacity * sizeof(struct PosetaNode*));
+		if (nodes == NULL) return NULL;
+		graph->nodes = nodes;
+		graph->node_capacity = capacity;
+	}
+	struct PosetaNode *node = linda_ctx_calloc(1, sizeof(struct PosetaNode));
+	if (node == NULL) return NULL;
+	node->descriptor = abbey_register_task(func, taskDesc, ABBEY_PRIORITY_NORMAL);
+	node->context = context;
+	node->graph = graph;
+	graph->nodes[graph->node_count++] = node;
+	return node;
+}
+
+/**
+ * Lets node after wait for node before. Edges can only be added before the graph runs.
+ */
+int poseta_graph_edge(struct PosetaNode *before, struct PosetaNode *after) {
+	if (before->successor_count == before->successor_capacity) {
+		int capacity = before->successor_capacity ? 2 * before->successor_capacity : 4;
+		struct PosetaNode **successors = realloc(before->successors,
+				capacity * sizeof(struct PosetaNode*));
+		if (successors == NULL) return -1;
+		before->successors = successors;
+		before->successor_capacity = capacity;
+	}
+	before->successors[before->successor_count++] = after;
+	after->predecessors++;
+	return 0;
+}
+
+/**
+ * Runs the graph: all nodes without predecessors are dispatched at once, all others when
+ * their last predecessor has finished. When all nodes are done, the done continuation (which
+ * may be NULL) is dispatched and the graph is freed. The graph is checked for cycles first,
+ * by ordering it topologically, an empty or cyclic graph is not run and not freed.
+ */
+int poseta_graph_run(struct PosetaGraph *graph, void *(*done)(void *), void *context,
+		char *taskDesc) {
+	int i, j, head = 0, tail = 0, n = graph->node_count;
+	if (!n) return -1;
+	struct PosetaNode **order = malloc(n * sizeof(struct PosetaNode*));
+	if (order == NULL) return -1;
+	for (i = 0; i < n; i++) {
+		graph->nodes[i]->pending = graph->nodes[i]->predecessors;
+		if (!graph->nodes[i]->pending) order[tail++] = graph->nodes[i];
+	}
+	int roots = tail;
+	while (head < tail) {
+		struct PosetaNode *node = order[head++];
+		for (j = 0; j < node->successor_count; j++) {
+			if (!--node->successors[j]->pending) order[tail++] = node->successors[j];
+		}
+	}
+	if (tail != n) {
+		tprintf(LOG_ERR, __func__, "The graph contains a cycle");
+		free(order);
+		return -1;
+	}
+
+	void *(*funcs[roots])(void *);
+	void *contexts[roots];
+	char *descs[roots];
+	for (i = 0; i < n; i++) {
+		graph->nodes[i]->pending = graph->nodes[i]->predecessors;
+	}
+	for (i = 0; i < roots; i++) {
+		funcs[i] = poseta_node_task;
+		contexts[i] = order[i];
+		descs[i] = (char*)order[i]->descriptor->name;
+	}
+	free(order);
+	graph->remaining = n;
+	graph->done = done;
+	graph->done_context = context;
+	graph->done_desc = taskDesc;
+	return dispatch_task_batch(funcs, contexts, descs, roots);
+}
+
+/**
+ * Frees a graph and its nodes. Only needed for graphs that are not run, a graph that runs
+ * is freed after its last node.
+ */
+void poseta_graph_free(struct PosetaGraph *graph) {
+	int i;
+	for (i = 0; i < graph->node_count; i++) {
+		free(graph->nodes[i]->successors);
+		linda_ctx_free(graph->nodes[i]);
+	}
+	free(graph->nodes);
+	free(graph);
+}
@@ -0,0 +1,102 @@
+/**
+ * @file prng.c
+ *
+ * The generator is xoshiro256** by Blackman and Vigna. Its state is filled by splitmix64,
+ * which is started from the seed mixed with the stream number, so nearby seeds and streams
+ * do not give nearby states. The bounded numbers use the multiply and shift of Lemire, with
+ * a rejection of the few values that would make the low numbers more likely.
+ *
+ * @date_created    Oct 14, 2026
+ * @date_modified   Oct 14, 2026
+ * @author          Anne C. van Rossum
+ * @project         Replicator
+ * @company         Almende B.V.
+ * @license         open-source, GNU Lesser General Public License
+ */
+
+#include <prng.h>
+#include <math.h>
+
+static uint64_t threadSeed = 0x5EED;
+static uint64_t threadCount = 0;
+
+static __thread struct LindaRandom threadRandom;
+static __thread uint8_t threadSeeded = 0;
+
+/****************************************************************************************************
+ *  		Implementations
+ ***************************************************************************************************/
+
+static uint64_t splitmix(uint64_t *x) {
+	uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+static inline uint64_t rotl(uint64_t x, int k) {
+	return (x << k) | (x >> (64 - k));
+}
+
+void linda_random_seed(struct LindaRandom *random, uint64_t seed, uint64_t stream) {
+	uint64_t x = seed;
+	x = splitmix(&x) ^ stream;
+	uint8_t i;
+	for (i = 0; i < 4; i++) random->s[i] = splitmix(&x);
+}
+
+uint64_t linda_random_next(struct LindaRandom *random) {
+	uint64_t *s = random->s;
+	uint64_t result = rotl(s[1] * 5, 7) * 9;
+	uint64_t t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
+	return result;
+}
+
+uint32_t linda_random_below(struct LindaRandom *random, uint32_t bound) {
+	uint64_t m = (linda_random_next(random) >> 32) * bound;
+	uint32_t low = (uint32_t)m;
+	if (low < bound) {
+		uint32_t threshold = -bound % bound;
+		while (low < threshold) {
+			m = (linda_random_next(random) >> 32) * bound;
+			low = (uint32_t)m;
+		}
+	}
+	return m >> 32;
+}
+
+double linda_random_unit(struct LindaRandom *random) {
+	return ((linda_random_next(random) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * Inverts the distribution function, so it takes one draw and one logarithm per success,
+ * instead of a draw per trial.
+ */
+uint32_t linda_random_geometric(struct LindaRandom *random, double chance) {
+	if (chance >= 1) return 0;
+	if (chance <= 0) return UINT32_MAX;
+	double gap = floor(log(linda_random_unit(random)) / log1p(-chance));
+	return (gap >= UINT32_MAX) ? UINT32_MAX : (uint32_t)gap;
+}
+
+struct LindaRandom *linda_random_thread() {
+	if (!threadSeeded) {
+		linda_random_seed(&threadRandom, threadSeed, __sync_fetch_and_add(&threadCount, 1));
+		threadSeeded = 1;
+	}
+	return &threadRandom;
+}
+
+/**
+ * Only affects threads that did not ask for their stream yet.
+ */
+void linda_random_seed_threads(uint64_t seed) {
+	threadSeed = seed;
+}
@@ -10,9 +10,15 @@
  * makes sure that there is always some thread doing something. And that never all
  * threads are stalled.
  *
+ * The baton routines block the calling thread. Called from within a task that means a monk
+ * less in the abbey. So every handshake that ends in the wakeup of a waiting thread can
+ * also dispatch a task instead, registered by ptreaty_on_run or ptreaty_on_continue.
+ *
  * For some background on threads, see the bottom of this file.
  */
 
+#define _GNU_SOURCE  //for pthread_setname_np
+
 #include <pthread.h>
 #include <inttypes.h>
 #include <errno.h>
@@ -21,6 +27,10 @@
 #include <log.h>
 #include <stdlib.h>
 #include <bits.h>
+#include <abbey.h>
+#include <trace.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 
 /***********************************************************************************************
  *
@@ -41,11 +51,37 @@ struct ThreadName {
 	struct ThreadName *next;
 };
 
+/**
+ * A task that is dispatched once, instead of waking up a waiting thread.
+ */
+struct PtreatyContinuation {
+	void *(*func)(void *);
+	void *context;
+	char *taskDesc;
+	struct PtreatyContinuation *next;
+};
+
 /************************************************************************************************
  *                      Global variables
  ************************************************************************************************/
 struct ThreadName *threadnames;
 
+//! Protects the list of thread names, only needed to name other threads than the caller
+static pthread_mutex_t threadnamesMutex = PTHREAD_MUTEX_INITIALIZER;
+
+//! The name of the calling thread, empty if it is not named
+static __thread char threadName[64];
+
+/**
+ * Protects the continuations and pending counters of all SyncThreads objects. These are
+ * touched once per handshake, so there is no need for a lock per object.
+ */
+static pthread_mutex_t continuationMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint8_t run_continuations(struct PtreatyContinuation **list);
+
+static void pend_event(struct PtreatyContinuation **list, uint8_t *pending);
+
 /***********************************************************************************************
  *
  * @name ptreaty_names
@@ -53,12 +89,38 @@ struct ThreadName *threadnames;
  *
  ***********************************************************************************************/
 
+/**
+ * Names the calling thread. The name is kept in thread-local storage, so the logging
+ * facility can find it without a lookup. The thread is named at OS level as well, so it
+ * shows up in tools as top -H and perf, but for the main thread, because that would
+ * rename the entire process. The OS truncates names to 15 characters.
+ */
+void ptreaty_set_thread_name(const char *name) {
+	snprintf(threadName, sizeof(threadName), "%s", name);
+	if (syscall(SYS_gettid) == getpid()) return;
+	char osName[16];
+	snprintf(osName, sizeof(osName), "%s", name);
+	pthread_setname_np(pthread_self(), osName);
+}
+
+/**
+ * Returns the name of the calling thread, or "Unknown thread" if it is not named.
+ */
+const char* ptreaty_thread_name() {
+	if (threadName[0] == 0) return "Unknown thread";
+	return threadName;
+}
+
 /**
  * Add a thread and a name to a linked list. There is no error checking upon adding threads
- * multiple times.
+ * multiple times. If the thread is the calling thread, it is named by ptreaty_set_thread_name
+ * as well. Threads that can name themselves, should better use that routine directly.
  */
 void ptreaty_add_thread(pthread_t *thread, const char *name) {
 	struct ThreadName *ltn;
+	pthread_t this = pthread_self();
+	if (pthread_equal(*thread, this)) ptreaty_set_thread_name(name);
+	pthread_mutex_lock(&threadnamesMutex);
 	if (threadnames == NULL) {
 		threadnames = malloc(sizeof(struct ThreadName));
 		ltn = threadnames;
@@ -73,19 +135,25 @@ void ptreaty_add_thread(pthread_t *thread, const char *name) {
 	ltn->thread = thread;
 	sprintf(ltn->name, "%s", name);
 	ltn->next = NULL;
+	pthread_mutex_unlock(&threadnamesMutex);
 }
 
 /**
- * Returns the name of the given thread, if it is added before by ptreaty_add_thread. If
- * it can not be found "Unknown thread" is returned as name.
+ * Returns the name of the given thread. The name of the calling thread is taken from
+ * thread-local storage, other threads should have been added before by ptreaty_add_thread.
+ * If it can not be found "Unknown thread" is returned as name.
  */
 const char* ptreaty_get_thread_name(pthread_t *thread) {
 	struct ThreadName *ltn;
+	pthread_t this = pthread_self();
+	if (threadName[0] && pthread_equal(*thread, this)) return threadName;
+	pthread_mutex_lock(&threadnamesMutex);
 	ltn = threadnames;
 	while (ltn != NULL) {
 		if (pthread_equal(*ltn->thread, *thread)) break;
 		ltn = ltn->next;
 	}
+	pthread_mutex_unlock(&threadnamesMutex);
 	if (ltn == NULL) return "Unknown thread";
 	return ltn->name;
 }
@@ -108,12 +176,25 @@ void ptreaty_init(struct SyncThreads *st)  {
 	pthread_cond_init (st->signal, NULL);
 	st->flags = 0;
 	st->predicate = 0;
+	st->on_run = NULL;
+	st->on_continue = NULL;
+	st->pending_runs = 0;
+	st->pending_continues = 0;
 }
 
 /**
  * The content of the SyncThread structure is deallocated.
  */
 void ptreaty_free(struct SyncThreads *st) {
+	struct PtreatyContinuation *pc;
+	while ((pc = st->on_run) != NULL) {
+		st->on_run = pc->next;
+		free(pc);
+	}
+	while ((pc = st->on_continue) != NULL) {
+		st->on_continue = pc->next;
+		free(pc);
+	}
 	pthread_mutex_destroy(st->baton);
 	pthread_mutex_destroy(st->request);
 	pthread_cond_destroy(st->ack);
@@ -197,10 +278,12 @@ void ptreaty_return_baton(struct SyncThreads *st) {
  * ptreaty_hoist_flag and ptreaty_lower_flag routines.
  */
 void ptreaty_wait(struct SyncThreads *st) {
+	unsigned long long start = lindaTraceEnabled ? linda_trace_clock_ns() : 0;
 	while (st->predicate == 0) {
 		tprintf(LOG_VV, __func__, "Wait for signal");
 		pthread_cond_wait(st->signal, st->baton);
 	}
+	if (start) linda_trace_span(__func__, "baton", start, linda_trace_clock_ns());
 	tprintf(LOG_VV, __func__, "Signal came");
 	st->predicate--;
 }
@@ -243,6 +326,7 @@ uint8_t ptreaty_flag_hoisted(struct SyncThreads *st) {
  * ptreaty_make_m_just_run instead.
  */
 void ptreaty_make_m_run(struct SyncThreads *st) {
+	if (run_continuations(&st->on_run)) return;
 	if (ptreaty_flag_hoisted(st)) {
 		tprintf(LOG_VV, __func__, "Lock baton");
 		pthread_mutex_lock(st->baton);
@@ -253,6 +337,7 @@ void ptreaty_make_m_run(struct SyncThreads *st) {
 		pthread_mutex_unlock(st->baton);
 	} else {
 		pthread_mutex_unlock(st->request);
+		pend_event(&st->on_run, &st->pending_runs);
 	}
 }
 
@@ -279,7 +364,9 @@ void ptreaty_should_be_later(struct SyncThreads *st) {
 	} else {
 		pthread_mutex_lock(st->baton);
 		tprintf(LOG_DEBUG, __func__, "Wait for first routine");
+		unsigned long long start = lindaTraceEnabled ? linda_trace_clock_ns() : 0;
 		pthread_cond_wait(st->signal, st->request);
+		if (start) linda_trace_span(__func__, "baton", start, linda_trace_clock_ns());
 //		pthread_mutex_lock(st->request);
 		tprintf(LOG_VERBOSE, __func__, "Execution continues");
 	}
@@ -291,6 +378,7 @@ void ptreaty_should_be_later(struct SyncThreads *st) {
  * check for ptreaty_flag_hoisted, because it will be hoisted of course.
  */
 void ptreaty_make_m_just_run(struct SyncThreads *st) {
+	if (run_continuations(&st->on_run)) return;
 	st->predicate++;
 	pthread_cond_signal(st->signal);
 }
@@ -303,6 +391,7 @@ void ptreaty_make_m_just_run(struct SyncThreads *st) {
  * instead.
  */
 void ptreaty_make_m_run_once(struct SyncThreads *st) {
+	if (run_continuations(&st->on_run)) return;
 	tprintf(LOG_VV, __func__, "Lock baton");
 	uint8_t unlock = (pthread_mutex_lock(st->baton) != EDEADLK);
 	if (!unlock)
@@ -312,7 +401,9 @@ void ptreaty_make_m_run_once(struct SyncThreads *st) {
 		tprintf(LOG_ALERT, __func__, "Predicate value should be 1");
 	pthread_cond_signal(st->signal);
 	if (st->predicate != 0) {
+		unsigned long long start = lindaTraceEnabled ? linda_trace_clock_ns() : 0;
 		pthread_cond_wait(st->ack, st->baton);
+		if (start) linda_trace_span(__func__, "baton", start, linda_trace_clock_ns());
 	}
 	if (unlock) pthread_mutex_unlock(st->baton);
 }
@@ -331,6 +422,7 @@ void ptreaty_has_run(struct SyncThreads *st) {
  * waiting thread to acknowledge this routine before getting blocked for something else.
  */
 void ptreaty_make_m_run_nx(struct SyncThreads *st) {
+	if (run_continuations(&st->on_run)) return;
 	if (ptreaty_flag_hoisted(st)) {
 		ptreaty_make_m_run_once(st);
 	} else {
@@ -347,7 +439,9 @@ void ptreaty_make_m_run_nx(struct SyncThreads *st) {
  */
 void ptreaty_wait_to_continue(struct SyncThreads *st) {
 	tprintf(LOG_VERBOSE, __func__, "Wait for ack signal");
+	unsigned long long start = lindaTraceEnabled ? linda_trace_clock_ns() : 0;
 	pthread_cond_wait(st->ack, st->baton);
+	if (start) linda_trace_span(__func__, "baton", start, linda_trace_clock_ns());
 	tprintf(LOG_VERBOSE, __func__, "Received ack signal");
 }
 
@@ -356,6 +450,7 @@ void ptreaty_wait_to_continue(struct SyncThreads *st) {
  * ptreaty_wait function.
  */
 void ptreaty_make_m_continue(struct SyncThreads *st) {
+	if (run_continuations(&st->on_continue)) return;
 	if (ptreaty_flag_hoisted(st)) {
 		tprintf(LOG_VERBOSE, __func__, "Lock baton");
 		pthread_mutex_lock(st->baton);
@@ -365,7 +460,94 @@ void ptreaty_make_m_continue(struct SyncThreads *st) {
 		pthread_mutex_unlock(st->baton);
 	} else {
 		pthread_mutex_unlock(st->request);
+		pend_event(&st->on_continue, &st->pending_continues);
+	}
+}
+
+/***********************************************************************************************
+ *
+ * @name ptreaty_continuations
+ * The handshakes without waiting threads.
+ *
+ ***********************************************************************************************/
+
+/**
+ * Registers a continuation in the given list, or dispatches it right away if the event
+ * happened already, in which case that event is consumed.
+ */
+static int add_continuation(struct PtreatyContinuation **list, uint8_t *pending,
+		void *(*func)(void *), void *context, char *taskDesc) {
+	pthread_mutex_lock(&continuationMutex);
+	if (*pending) {
+		(*pending)--;
+		pthread_mutex_unlock(&continuationMutex);
+		return dispatch_described_task(func, context, taskDesc);
+	}
+	struct PtreatyContinuation *pc = malloc(sizeof(struct PtreatyContinuation));
+	if (pc == NULL) {
+		pthread_mutex_unlock(&continuationMutex);
+		return -1;
 	}
+	pc->func = func;
+	pc->context = context;
+	pc->taskDesc = taskDesc;
+	pc->next = *list;
+	*list = pc;
+	pthread_mutex_unlock(&continuationMutex);
+	return 0;
+}
+
+/**
+ * Dispatches all continuations in the list. Returns 0 if there were none.
+ */
+static uint8_t run_continuations(struct PtreatyContinuation **list) {
+	struct PtreatyContinuation *pc, *next;
+	if (*list == NULL) return 0;
+	pthread_mutex_lock(&continuationMutex);
+	pc = *list;
+	*list = NULL;
+	pthread_mutex_unlock(&continuationMutex);
+	if (pc == NULL) return 0;
+	for (; pc != NULL; pc = next) {
+		next = pc->next;
+		dispatch_described_task(pc->func, pc->context, pc->taskDesc);
+		free(pc);
+	}
+	return 1;
+}
+
+/**
+ * Remembers an event that had no continuation and no waiting thread. A continuation that
+ * is registered in the meantime is dispatched after all.
+ */
+static void pend_event(struct PtreatyContinuation **list, uint8_t *pending) {
+	pthread_mutex_lock(&continuationMutex);
+	if (*list == NULL) {
+		(*pending)++;
+		pthread_mutex_unlock(&continuationMutex);
+		return;
+	}
+	pthread_mutex_unlock(&continuationMutex);
+	run_continuations(list);
+}
+
+/**
+ * The continuation counterpart of ptreaty_hoist_flag and ptreaty_wait: func is dispatched
+ * with context as soon as another party calls ptreaty_make_m_run, or one of its variants,
+ * or ptreaty_make_m_stop. A continuation runs once, register it again to catch the next
+ * run. If a run came before, func is dispatched immediately.
+ */
+int ptreaty_on_run(struct SyncThreads *st, void *(*func)(void *), void *context, char *taskDesc) {
+	return add_continuation(&st->on_run, &st->pending_runs, func, context, taskDesc);
+}
+
+/**
+ * The continuation counterpart of ptreaty_wait_to_continue, func is dispatched at the next
+ * ptreaty_make_m_continue.
+ */
+int ptreaty_on_continue(struct SyncThreads *st, void *(*func)(void *), void *context,
+		char *taskDesc) {
+	return add_continuation(&st->on_continue, &st->pending_continues, func, context, taskDesc);
 }
 
 /***********************************************************************************************
@@ -381,6 +563,7 @@ void ptreaty_make_m_continue(struct SyncThreads *st) {
  */
 void ptreaty_make_m_stop(struct SyncThreads *st) {
 	RAISE(st->flags, 1);
+	if (run_continuations(&st->on_run)) return;
 	pthread_mutex_lock(st->baton);
 	st->predicate++;
 	pthread_cond_signal(st->signal);
@@ -0,0 +1,311 @@
+/**
+ * @file slab.c
+ *
+ * The slab allocator for task contexts. There is a size class for every power of two from
+ * 16 up to LINDA_CTX_MAX_SIZE bytes. Each object is preceded by a small header that holds
+ * its size class, so linda_ctx_free does not need to be told the size. Free objects are
+ * linked through their own memory.
+ *
+ * A thread takes objects from its own cache. If the cache is empty, a batch is taken from
+ * the depot of that size class, and if the depot is empty as well, a new slab is cut into
+ * objects. Freed objects go back into the cache of the freeing thread, and when that cache
+ * holds too many of them, a batch is moved to the depot. So the depot lock is only taken
+ * once per CTX_BATCH allocations or frees, and memory that is freed on another monk than it
+ * was allocated on finds its way back. Slabs are never given back to the system, which is
+ * what avoids fragmentation of the heap on small targets: after warming up, contexts do not
+ * touch the heap anymore.
+ *
+ * @date_created    Oct 14, 2026
+ * @date_modified   Oct 14, 2026
+ * @author          Anne C. van Rossum
+ * @project         Replicator
+ * @company         Almende B.V.
+ * @license         open-source, GNU Lesser General Public License
+ */
+
+#include <slab.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+//! The amount of size classes, 16 << (CTX_CLASSES - 1) should be LINDA_CTX_MAX_SIZE
+#define CTX_CLASSES			8
+#define CTX_MIN_SIZE		16
+//! The header keeps the payload aligned on 16 bytes
+#define CTX_HEADER			16
+//! Size class of objects that are allocated by malloc
+#define CTX_LARGE			0xFF
+//! A thread keeps at most this amount of free objects per class
+#define CTX_CACHE_LIMIT		64
+//! The amount of objects moved between a thread and the depot at once
+#define CTX_BATCH			32
+//! Size of a slab, a slab holds at least CTX_BATCH objects
+#define SLAB_CHUNK_SIZE		(64 * 1024)
+//! Size of an arena chunk, bigger requests get a chunk of their own size
+#define ARENA_CHUNK_SIZE	(16 * 1024)
+#define ARENA_HEADER		((sizeof(struct ArenaChunk) + 15) & ~15)
+
+/***********************************************************************************************
+ *
+ * @name slab_structs
+ *
+ ***********************************************************************************************/
+
+union CtxHeader {
+	size_t sizeClass;
+	char pad[CTX_HEADER];
+};
+
+struct CtxFree {
+	struct CtxFree *next;
+};
+
+/**
+ * The free objects of one thread. Registered is set when the thread exit handler, that
+ * gives the objects back to the depots, has been installed.
+ */
+struct CtxCache {
+	struct CtxFree *free[CTX_CLASSES];
+	int count[CTX_CLASSES];
+	int registered;
+};
+
+struct CtxDepot {
+	pthread_mutex_t lock;
+	struct CtxFree *free;
+};
+
+/**
+ * A chunk of arena memory, the data follows the header. Chunks are kept in a list and
+ * reused after a release.
+ */
+struct ArenaChunk {
+	struct ArenaChunk *next;
+	size_t size;
+	size_t used;
+};
+
+struct Arena {
+	struct ArenaChunk *first;
+	struct ArenaChunk *current;
+};
+
+static struct CtxDepot depot[CTX_CLASSES];
+static pthread_once_t slabOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t slabKey;
+
+static __thread struct CtxCache cache;
+static __thread struct Arena arena;
+
+/***********************************************************************************************
+ *
+ * @name slab_internals
+ *
+ ***********************************************************************************************/
+
+static inline size_t class_size(int c) {
+	return (size_t)CTX_MIN_SIZE << c;
+}
+
+static int size_class(size_t size) {
+	int c = 0;
+	while (c < CTX_CLASSES && class_size(c) < size) c++;
+	return c < CTX_CLASSES ? c : CTX_LARGE;
+}
+
+/**
+ * Moves n objects of class c from the cache of this thread to the depot.
+ */
+static void drain(int c, int n) {
+	struct CtxFree *head = cache.free[c], *tail = head;
+	int i;
+	if (head == NULL || n <= 0) return;
+	for (i = 1; i < n && tail->next != NULL; i++) tail = tail->next;
+	cache.free[c] = tail->next;
+	cache.count[c] -= i;
+	pthread_mutex_lock(&depot[c].lock);
+	tail->next = depot[c].free;
+	depot[c].free = head;
+	pthread_mutex_unlock(&depot[c].lock);
+}
+
+/**
+ * Gives everything back when a thread exits: cached objects go to the depots and the arena
+ * chunks are freed.
+ */
+static void slab_thread_exit(void *arg) {
+	struct ArenaChunk *chunk, *next;
+	int c;
+	for (c = 0; c < CTX_CLASSES; c++) {
+		drain(c, cache.count[c]);
+	}
+	for (chunk = arena.first; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+	arena.first = arena.current = NULL;
+}
+
+static void slab_init() {
+	int c;
+	for (c = 0; c < CTX_CLASSES; c++) {
+		pthread_mutex_init(&depot[c].lock, NULL);
+		depot[c].free = NULL;
+	}
+	pthread_key_create(&slabKey, slab_thread_exit);
+}
+
+static void register_thread() {
+	if (cache.registered) return;
+	pthread_once(&slabOnce, slab_init);
+	pthread_setspecific(slabKey, &cache);
+	cache.registered = 1;
+}
+
+/**
+ * Fills the empty cache of class c, from the depot or from a new slab.
+ */
+static int refill(int c) {
+	struct CtxFree *head, *tail;
+	size_t stride = CTX_HEADER + class_size(c);
+	int i, n;
+	register_thread();
+	pthread_mutex_lock(&depot[c].lock);
+	head = tail = depot[c].free;
+	if (head != NULL) {
+		for (i = 1; i < CTX_BATCH && tail->next != NULL; i++) tail = tail->next;
+		depot[c].free = tail->next;
+		tail->next = NULL;
+	}
+	pthread_mutex_unlock(&depot[c].lock);
+	if (head != NULL) {
+		cache.free[c] = head;
+		cache.count[c] = i;
+		return 0;
+	}
+
+	n = SLAB_CHUNK_SIZE / stride;
+	if (n < CTX_BATCH) n = CTX_BATCH;
+	char *slab = malloc(n * stride);
+	if (slab == NULL) return -1;
+	for (i = n - 1; i >= 0; i--) {
+		union CtxHeader *h = (union CtxHeader*)(slab + i * stride);
+		struct CtxFree *f = (struct CtxFree*)(h + 1);
+		h->sizeClass = c;
+		f->next = cache.free[c];
+		cache.free[c] = f;
+	}
+	cache.count[c] = n;
+	return 0;
+}
+
+/***********************************************************************************************
+ *
+ * @name slab_functions
+ *
+ ***********************************************************************************************/
+
+/**
+ * Allocates a context of at least size bytes. Contexts above LINDA_CTX_MAX_SIZE are
+ * allocated by malloc. Just as malloc, the returned memory is not cleared.
+ */
+void *linda_ctx_alloc(size_t size) {
+	int c = size_class(size);
+	struct CtxFree *f;
+	if (c == CTX_LARGE) {
+		union CtxHeader *h = malloc(CTX_HEADER + size);
+		if (h == NULL) return NULL;
+		h->sizeClass = CTX_LARGE;
+		return h + 1;
+	}
+	if (cache.free[c] == NULL && refill(c)) return NULL;
+	f = cache.free[c];
+	cache.free[c] = f->next;
+	cache.count[c]--;
+	return f;
+}
+
+/**
+ * Allocates a cleared context for count elements of the given size.
+ */
+void *linda_ctx_calloc(size_t count, size_t size) {
+	void *ptr = linda_ctx_alloc(count * size);
+	if (ptr != NULL) memset(ptr, 0, count * size);
+	return ptr;
+}
+
+/**
+ * Frees a context that is allocated by linda_ctx_alloc or linda_ctx_calloc, on any thread.
+ */
+void linda_ctx_free(void *ptr) {
+	union CtxHeader *h;
+	struct CtxFree *f = (struct CtxFree*)ptr;
+	int c;
+	if (ptr == NULL) return;
+	h = (union CtxHeader*)ptr - 1;
+	c = h->sizeClass;
+	if (c == CTX_LARGE) {
+		free(h);
+		return;
+	}
+	register_thread();
+	f->next = cache.free[c];
+	cache.free[c] = f;
+	if (++cache.count[c] > CTX_CACHE_LIMIT) drain(c, CTX_BATCH);
+}
+
+/**
+ * Returns the current position in the arena of this thread.
+ */
+struct LindaArenaMark linda_arena_mark() {
+	struct LindaArenaMark mark;
+	mark.chunk = arena.current;
+	mark.used = (arena.current == NULL) ? 0 : arena.current->used;
+	return mark;
+}
+
+/**
+ * Borrows size bytes from the arena of this thread, aligned on 16 bytes. The memory is
+ * valid until the arena is released to a mark taken before, it can not be freed by itself
+ * and should not be handed to another thread.
+ */
+void *linda_arena_alloc(size_t size) {
+	struct ArenaChunk *chunk = arena.current, *fresh;
+	size = (size + 15) & ~(size_t)15;
+	if (chunk == NULL) chunk = arena.first;
+	while (1) {
+		if (chunk != NULL && chunk->used + size <= chunk->size) {
+			void *ptr = (char*)chunk + ARENA_HEADER + chunk->used;
+			chunk->used += size;
+			arena.current = chunk;
+			return ptr;
+		}
+		if (chunk != NULL && chunk->next != NULL) {
+			chunk = chunk->next;
+			chunk->used = 0;
+			continue;
+		}
+		size_t capacity = size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE;
+		fresh = malloc(ARENA_HEADER + capacity);
+		if (fresh == NULL) return NULL;
+		register_thread();
+		fresh->next = NULL;
+		fresh->size = capacity;
+		fresh->used = 0;
+		if (chunk == NULL) arena.first = fresh; else chunk->next = fresh;
+		chunk = fresh;
+	}
+}
+
+/**
+ * Gives back everything that was borrowed from the arena after the mark was taken.
+ */
+void linda_arena_release(struct LindaArenaMark mark) {
+	if (mark.chunk == NULL) {
+		arena.current = arena.first;
+		if (arena.first != NULL) arena.first->used = 0;
+		return;
+	}
+	arena.current = (struct ArenaChunk*)mark.chunk;
+	arena.current->used = mark.used;
+}
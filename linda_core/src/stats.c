@@ -0,0 +1,416 @@
+/**
+ * @file stats.c
+ *
+ * A reply is put together in a buffer of the largest size the peer takes, and copied into a
+ * message of the size that is used. The abbey is read with abbey_stats_snapshot, so a reply
+ * costs about as much as the periodic dump of the statistics, see AbbeyConfig.
+ *
+ * @date_created    Oct 14, 2026
+ * @date_modified   Oct 14, 2026
+ * @author          Anne C. van Rossum
+ * @project         Replicator
+ * @company         Almende B.V.
+ * @license         open-source, GNU Lesser General Public License
+ */
+
+#include <stats.h>
+#include <abbey.h>
+#include <tcpip.h>
+#include <tcpipbank.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+/****************************************************************************************************
+ *  		Declarations
+ ***************************************************************************************************/
+
+//! The channels that are looked at for a reply, the ids of the m-bus are one byte
+#define STATS_MAX_CHANNELS		256
+
+#define STATS_TASK_SIZE			21
+#define STATS_CHANNEL_SIZE		34
+#define STATS_PROCESS_SIZE		6
+
+static const char *kinds[] = { "unknown", "elinda", "colinda", "flinda" };
+
+/**
+ * The JSON text that is written, full is set once it does not fit anymore.
+ */
+struct StatsText {
+	char *text;
+	int length, used;
+	uint8_t full;
+};
+
+/****************************************************************************************************
+ *  		Implementations
+ ***************************************************************************************************/
+
+static uint8_t *put16(uint8_t *p, uint16_t value) {
+	p[0] = value >> 8; p[1] = value;
+	return p + 2;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t value) {
+	p[0] = value >> 24; p[1] = value >> 16; p[2] = value >> 8; p[3] = value;
+	return p + 4;
+}
+
+static uint8_t *put64(uint8_t *p, uint64_t value) {
+	put32(p, value >> 32);
+	return put32(p + 4, value);
+}
+
+static uint16_t get16(const uint8_t *p) {
+	return (p[0] << 8) | p[1];
+}
+
+static uint32_t get32(const uint8_t *p) {
+	return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static uint64_t get64(const uint8_t *p) {
+	return ((uint64_t)get32(p) << 32) | get32(p + 4);
+}
+
+static uint32_t microseconds(const unsigned int *histogram, double fraction) {
+	unsigned long long us = abbey_stats_percentile(histogram, fraction) / 1000;
+	return us > UINT32_MAX ? UINT32_MAX : us;
+}
+
+struct TcpipMessage *linda_stats_request(uint8_t source, uint8_t destination, uint8_t flags,
+		uint8_t tag) {
+	struct TcpipMessage *msg = tcpip_alloc_msg(LINDA_STATS_REQ_SIZE);
+	if (msg == NULL) return NULL;
+	msg->payload[0] = LINDA_STATS_REQ;
+	msg->payload[1] = msg->size - 2;
+	msg->payload[2] = source;
+	msg->payload[3] = destination;
+	msg->payload[4] = flags;
+	msg->payload[5] = tag;
+	return msg;
+}
+
+struct TcpipMessage *linda_stats_message(uint8_t source, uint8_t destination, uint8_t tag,
+		uint8_t flags, uint8_t kind, const uint8_t *sections, uint16_t size) {
+	struct timespec ts;
+	struct TcpipMessage *msg = tcpip_alloc_msg(LINDA_STATS_HEADER + size);
+	if (msg == NULL) return NULL;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	msg->payload[0] = LINDA_STATS_MSG;
+	msg->payload[1] = msg->size - 2 > 255 ? 255 : msg->size - 2;
+	msg->payload[2] = source;
+	msg->payload[3] = destination;
+	msg->payload[4] = LINDA_STATS_VERSION;
+	msg->payload[5] = tag;
+	msg->payload[6] = flags;
+	msg->payload[7] = kind;
+	put32(&msg->payload[8], (uint32_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+	memcpy(&msg->payload[LINDA_STATS_HEADER], sections, size);
+	return msg;
+}
+
+uint8_t *linda_stats_open(uint8_t *p, uint8_t type) {
+	*p = type;
+	return p + LINDA_STATS_SECTION;
+}
+
+uint8_t *linda_stats_close(uint8_t *body, uint8_t *end) {
+	put16(body - 2, end - body);
+	return end;
+}
+
+uint8_t *linda_stats_counter(uint8_t *p, const char *name, uint64_t value) {
+	uint8_t length = strlen(name) > 255 ? 255 : strlen(name);
+	*p++ = length;
+	memcpy(p, name, length);
+	return put64(p + length, value);
+}
+
+static uint8_t *writeAbbey(uint8_t *p, const struct AbbeyStats *stats) {
+	int i;
+	uint8_t *body = linda_stats_open(p, LINDA_STATS_ABBEY);
+	p = put16(body, stats->monk_count);
+	p = put16(p, stats->busy_monks);
+	*p++ = ABBEY_PRIORITY_COUNT;
+	for (i = 0; i < ABBEY_PRIORITY_COUNT; i++) p = put32(p, stats->queue_depth[i]);
+	return linda_stats_close(body, p);
+}
+
+/**
+ * The tasks that ran from the one at *next on, as many as fit before end, *next is set to
+ * the first that did not fit. The section is left out if none fit.
+ */
+static uint8_t *writeTasks(uint8_t *p, uint8_t *end, const struct AbbeyStats *stats,
+		int *next) {
+	int k;
+	if (end - p < LINDA_STATS_SECTION + STATS_TASK_SIZE) return p;
+	uint8_t *start = p, *body = linda_stats_open(p, LINDA_STATS_TASKS);
+	p = body;
+	for (k = *next; k < stats->kind_count; k++) {
+		const struct AbbeyTaskStats *ts = &stats->kind[k];
+		const char *description = ts->description[0] ? ts->description : "(undescribed)";
+		uint8_t length = strnlen(description, sizeof(ts->description));
+		if (!ts->count) continue;
+		if (end - p < STATS_TASK_SIZE + length) break;
+		p = put32(p, ts->count);
+		p = put32(p, microseconds(ts->wait_histogram, 0.5));
+		p = put32(p, microseconds(ts->wait_histogram, 0.99));
+		p = put32(p, microseconds(ts->run_histogram, 0.5));
+		p = put32(p, microseconds(ts->run_histogram, 0.99));
+		*p++ = length;
+		memcpy(p, description, length);
+		p += length;
+	}
+	*next = k;
+	if (p == body) return start;
+	return linda_stats_close(body, p);
+}
+
+/**
+ * The channels with the given ids from the one at *next on, as many as fit before end, like
+ * writeTasks.
+ */
+static uint8_t *writeChannels(uint8_t *p, uint8_t *end, const unsigned int *ids,
+		unsigned int n, unsigned int *next) {
+	unsigned int i;
+	if (end - p < LINDA_STATS_SECTION + STATS_CHANNEL_SIZE) return p;
+	uint8_t *start = p, *body = linda_stats_open(p, LINDA_STATS_CHANNELS);
+	p = body;
+	for (i = *next; (i < n) && (end - p >= STATS_CHANNEL_SIZE); i++) {
+		//held, the channels are not the ones of the caller and may be deleted meanwhile
+		struct TcpipSocket *sock = tcpipbank_hold(ids[i]);
+		if (sock == NULL) continue;
+		p = put16(p, ids[i]);
+		p = put32(p, sock->inbox->depth);
+		p = put32(p, sock->outbox->depth);
+		p = put32(p, sock->messages_in);
+		p = put32(p, sock->messages_out);
+		p = put64(p, sock->bytes_in);
+		p = put64(p, sock->bytes_out);
+		tcpip_release(sock);
+	}
+	*next = i;
+	if (p == body) return start;
+	return linda_stats_close(body, p);
+}
+
+struct TcpipMessage *linda_stats_reply(const struct TcpipMessage *request, uint8_t source,
+		uint8_t kind, const uint8_t *extra, uint16_t size, int max_size) {
+	int room = (max_size < MAX_FRAME_SIZE ? max_size : MAX_FRAME_SIZE) - LINDA_STATS_HEADER;
+	uint8_t tag = request->size >= LINDA_STATS_REQ_SIZE ? request->payload[5] : 0;
+	if (room < LINDA_STATS_SECTION + 5 + 4 * ABBEY_PRIORITY_COUNT) return NULL;
+	uint8_t *sections = malloc(room), *p, *end = sections + room;
+	unsigned int ids[STATS_MAX_CHANNELS], n = tcpipbank_ids(ids, STATS_MAX_CHANNELS), channel = 0;
+	int task = 0;
+	struct AbbeyStats *stats = malloc(sizeof(struct AbbeyStats));
+	struct TcpipMessage *first = NULL, *last = NULL, *part;
+	if ((sections == NULL) || (stats == NULL)) goto linda_stats_reply_finish;
+	abbey_stats_snapshot(stats);
+	p = writeAbbey(sections, stats);
+	if (size <= end - p) {
+		memcpy(p, extra, size);
+		p += size;
+	}
+	while (1) {
+		p = writeTasks(p, end, stats, &task);
+		if (task == stats->kind_count) p = writeChannels(p, end, ids, n, &channel);
+		//a task with a description that does not fit in a part at all, ends the reply
+		if ((p == sections) && (last != NULL)) break;
+		part = linda_stats_message(source, request->payload[2], tag, 0, kind, sections,
+				p - sections);
+		if (part == NULL) {
+			for (; first != NULL; first = part) {
+				part = first->next;
+				freemsg(first);
+			}
+			last = NULL;
+			break;
+		}
+		if (last == NULL) first = part; else last->next = part;
+		last = part;
+		if ((task == stats->kind_count) && (channel >= n)) break;
+		p = sections;
+	}
+	for (part = first; (part != NULL) && (part != last); part = part->next)
+		part->payload[6] |= LINDA_STATS_MORE;
+linda_stats_reply_finish:
+	free(stats);
+	free(sections);
+	return first;
+}
+
+/**
+ * The body of the section at p, with its type and length, or NULL if it does not end before
+ * end.
+ */
+static const uint8_t *section(const uint8_t *p, const uint8_t *end, uint8_t *type,
+		uint16_t *length) {
+	if (end - p < LINDA_STATS_SECTION) return NULL;
+	*type = p[0];
+	*length = get16(p + 1);
+	if (end - p - LINDA_STATS_SECTION < *length) return NULL;
+	return p + LINDA_STATS_SECTION;
+}
+
+static uint8_t validReply(const struct TcpipMessage *reply) {
+	return (reply->size >= LINDA_STATS_HEADER) && (reply->payload[0] == LINDA_STATS_MSG) &&
+			(reply->payload[4] == LINDA_STATS_VERSION);
+}
+
+uint8_t *linda_stats_process(uint8_t *p, uint16_t space, const struct TcpipMessage *reply) {
+	const uint8_t *lp, *body, *end = reply->payload + reply->size;
+	uint8_t type;
+	uint16_t length;
+	uint32_t size = LINDA_STATS_SECTION + STATS_PROCESS_SIZE;
+	if (!validReply(reply)) return p;
+	for (lp = reply->payload + LINDA_STATS_HEADER; (body = section(lp, end, &type, &length));
+			lp = body + length) {
+		if ((type == LINDA_STATS_ABBEY) || (type == LINDA_STATS_COUNTERS))
+			size += LINDA_STATS_SECTION + length;
+	}
+	if ((size > space) || (size - LINDA_STATS_SECTION > 0xFFFF)) return p;
+	uint8_t *lbody = linda_stats_open(p, LINDA_STATS_PROCESS), *q = lbody;
+	*q++ = reply->payload[2];
+	*q++ = reply->payload[7];
+	memcpy(q, &reply->payload[8], 4);
+	q += 4;
+	for (lp = reply->payload + LINDA_STATS_HEADER; (body = section(lp, end, &type, &length));
+			lp = body + length) {
+		if ((type != LINDA_STATS_ABBEY) && (type != LINDA_STATS_COUNTERS)) continue;
+		memcpy(q, lp, LINDA_STATS_SECTION + length);
+		q += LINDA_STATS_SECTION + length;
+	}
+	return linda_stats_close(lbody, q);
+}
+
+static void append(struct StatsText *t, const char *format, ...) {
+	va_list args;
+	if (t->full) return;
+	va_start(args, format);
+	int n = vsnprintf(t->text + t->used, t->length - t->used, format, args);
+	va_end(args);
+	if ((n < 0) || (n >= t->length - t->used)) t->full = 1;
+	else t->used += n;
+}
+
+/**
+ * A name in quotes, with quotes and backslashes escaped and control characters left out.
+ */
+static void appendName(struct StatsText *t, const uint8_t *name, uint8_t length) {
+	uint8_t i;
+	append(t, "\"");
+	for (i = 0; i < length; i++) {
+		if (name[i] < 0x20) continue;
+		if ((name[i] == '"') || (name[i] == '\\')) append(t, "\\%c", name[i]);
+		else append(t, "%c", name[i]);
+	}
+	append(t, "\"");
+}
+
+static uint8_t appendAbbey(struct StatsText *t, const uint8_t *p, uint16_t length) {
+	uint8_t i;
+	if ((length < 5) || (length < 5 + 4 * p[4])) return 0;
+	append(t, ",\"monks\":%u,\"busy\":%u,\"queued\":[", get16(p), get16(p + 2));
+	for (i = 0; i < p[4]; i++) append(t, "%s%u", i ? "," : "", get32(p + 5 + 4 * i));
+	append(t, "]");
+	return 1;
+}
+
+static uint8_t appendTasks(struct StatsText *t, const uint8_t *p, uint16_t length) {
+	const uint8_t *end = p + length;
+	append(t, ",\"tasks\":[");
+	for (; p < end; p += STATS_TASK_SIZE + p[STATS_TASK_SIZE - 1]) {
+		if ((end - p < STATS_TASK_SIZE) || (end - p < STATS_TASK_SIZE + p[STATS_TASK_SIZE - 1]))
+			return 0;
+		append(t, "%s{\"task\":", p == end - length ? "" : ",");
+		appendName(t, p + STATS_TASK_SIZE, p[STATS_TASK_SIZE - 1]);
+		append(t, ",\"count\":%u,\"wait_p50_us\":%u,\"wait_p99_us\":%u,\"run_p50_us\":%u,"
+				"\"run_p99_us\":%u}", get32(p), get32(p + 4), get32(p + 8), get32(p + 12),
+				get32(p + 16));
+	}
+	append(t, "]");
+	return 1;
+}
+
+static uint8_t appendChannels(struct StatsText *t, const uint8_t *p, uint16_t length) {
+	uint16_t i;
+	if (length % STATS_CHANNEL_SIZE) return 0;
+	append(t, ",\"channels\":[");
+	for (i = 0; i < length; i += STATS_CHANNEL_SIZE, p += STATS_CHANNEL_SIZE) {
+		append(t, "%s{\"id\":%u,\"inbox\":%u,\"outbox\":%u,\"messages_in\":%u,"
+				"\"messages_out\":%u,\"bytes_in\":%llu,\"bytes_out\":%llu}", i ? "," : "",
+				get16(p), get32(p + 2), get32(p + 6), get32(p + 10), get32(p + 14),
+				(unsigned long long)get64(p + 18), (unsigned long long)get64(p + 26));
+	}
+	append(t, "]");
+	return 1;
+}
+
+static uint8_t appendCounters(struct StatsText *t, const uint8_t *p, uint16_t length) {
+	const uint8_t *end = p + length;
+	append(t, ",\"counters\":{");
+	for (; p < end; p += 9 + p[0]) {
+		if (end - p < 9 + p[0]) return 0;
+		if (p != end - length) append(t, ",");
+		appendName(t, p + 1, p[0]);
+		append(t, ":%llu", (unsigned long long)get64(p + 1 + p[0]));
+	}
+	append(t, "}");
+	return 1;
+}
+
+static const char *kindName(uint8_t kind) {
+	return kind < sizeof(kinds) / sizeof(kinds[0]) ? kinds[kind] : kinds[0];
+}
+
+/**
+ * The sections from p up to end, as members of an object that is opened already. Process
+ * sections are not looked for in a process section.
+ */
+static uint8_t appendSections(struct StatsText *t, const uint8_t *p, const uint8_t *end,
+		uint8_t nested) {
+	const uint8_t *body;
+	uint8_t type, ok = 1, processes = 0;
+	uint16_t length;
+	for (; p < end; p = body + length) {
+		if ((body = section(p, end, &type, &length)) == NULL) return 0;
+		if (processes && (type != LINDA_STATS_PROCESS)) {
+			append(t, "]");
+			processes = 0;
+		}
+		switch (type) {
+		case LINDA_STATS_ABBEY: ok = appendAbbey(t, body, length); break;
+		case LINDA_STATS_TASKS: ok = appendTasks(t, body, length); break;
+		case LINDA_STATS_CHANNELS: ok = appendChannels(t, body, length); break;
+		case LINDA_STATS_COUNTERS: ok = appendCounters(t, body, length); break;
+		case LINDA_STATS_PROCESS:
+			if (nested || (length < STATS_PROCESS_SIZE)) break;
+			append(t, processes ? "," : ",\"processes\":[");
+			processes = 1;
+			append(t, "{\"id\":%u,\"kind\":\"%s\",\"cpu_ms\":%u", body[0], kindName(body[1]),
+					get32(body + 2));
+			ok = appendSections(t, body + STATS_PROCESS_SIZE, body + length, 1);
+			append(t, "}");
+			break;
+		}
+		if (!ok) return 0;
+	}
+	if (processes) append(t, "]");
+	return 1;
+}
+
+int linda_stats_json(const struct TcpipMessage *reply, char *text, int length) {
+	struct StatsText t = { text, length, 0, 0 };
+	if (!validReply(reply) || (length < 1)) return -1;
+	append(&t, "{\"source\":%u,\"tag\":%u,\"more\":%u,\"kind\":\"%s\",\"cpu_ms\":%u",
+			reply->payload[2], reply->payload[5], reply->payload[6] & LINDA_STATS_MORE,
+			kindName(reply->payload[7]), get32(&reply->payload[8]));
+	if (!appendSections(&t, reply->payload + LINDA_STATS_HEADER, reply->payload + reply->size,
+			0)) return -1;
+	append(&t, "}");
+	return t.full ? -1 : t.used;
+}
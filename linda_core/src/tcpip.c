@@ -16,16 +16,23 @@
  * The syntax of the messages send over the TCP/IP connection is not defined over here, but
  * the responsibility of individual controllers and components.
  *
+ * Incoming messages are not read by tasks, but by a single reactor thread that watches all
+ * connected sockets with epoll. It reads without blocking, keeps the frames that arrived only
+ * partially, and puts every complete frame in the inbox of its socket before callbackIn is
+ * dispatched. So an open socket does not occupy a monk. A server also waits for its client
+ * in the reactor instead of in accept.
+ *
  * Check the TCP/IP packets by e.g.: sudo tcpdump -X -i lo portrange 3333-41000
  *
  * @date_created    Jan 28, 2009
- * @date_modified   Apr 14, 2009
+ * @date_modified   Oct 14, 2026
  * @author          Anne C. van Rossum
  * @project         Replicator, ALwEN, CHAP
  * @company         Almende B.V.
  * @license         open-source
  */
 
+#define _GNU_SOURCE  //for memfd_create and sendmmsg
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -34,16 +41,27 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <sys/wait.h>
 #include <signal.h>
 #include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <stddef.h>
 
 #include <tcpip.h>
 #include <bits.h>
 #include <ptreaty.h>
 #include <log.h>
 #include <abbey.h>
+#include <trace.h>
+#include <slab.h>
+#include <buffer.h>
 
 /************************************************************************************************
  *                      Defines
@@ -51,6 +69,89 @@
 
 #define BACKLOG				1
 #define VERBOSE
+//! The amount of events handled per epoll_wait by the reactor
+#define REACTOR_EVENTS		64
+//! The read buffer of a socket holds at least one frame of the maximum size
+#define READ_BUFFER_SIZE	(2 * (MAX_FRAME_SIZE + 3))
+//! Partial frames from this size on are not kept in the read buffer, see tcpip_parse
+#define READ_DIRECT_SIZE	1024
+//! The amount of messages written by one sendmsg
+#define TCPIP_FLUSH_BATCH	64
+//! Size of each of the two rings of a local channel, a power of two
+#define SHM_RING_SIZE		(256 * 1024)
+//! Size of the socket buffer of a multicast receiver
+#define MULTICAST_RECEIVE_BUFFER	(1024 * 1024)
+
+/************************************************************************************************
+ *                      Data Structures
+ ***********************************************************************************************/
+
+/**
+ * The reading state of a socket. A server socket is listening until its client connects.
+ * The bytes that are received are kept in buffer from start to end, every complete frame in
+ * it is handed over, and a frame that arrived only partially is moved to the front. The
+ * header of a version 1 frame is the command and size byte, which are the start of the
+ * message as well. The header of a version 2 frame is the marker and a two-byte size, the
+ * message follows it. A large frame of which only the start has arrived, is received
+ * further into msg directly, got is the amount of bytes of it that is there. The messages
+ * that did not fit in the outgoing ring of a local channel wait in stalled, in order, until
+ * the receiver has made room. Only the flush uses them.
+ */
+struct TcpipReader {
+	uint8_t listening;
+	uint8_t watched;
+	unsigned char *buffer;
+	int start;
+	int end;
+	struct TcpipMessage *msg;
+	int got;
+	struct ShmSegment *segment;
+	struct ShmRing *in, *out;
+	struct TcpipMessage *stalled;
+};
+
+/**
+ * A ring of bytes in shared memory, written by one process and read by the other. Head and
+ * tail only increase, the position in data is taken modulo SHM_RING_SIZE. They are in
+ * separate cache lines, because each is written by another process. The sender raises
+ * waiting when a frame does not fit, the receiver clears it and wakes the sender up when it
+ * has taken frames out.
+ */
+struct ShmRing {
+	volatile uint32_t head;
+	char pad0[60];
+	volatile uint32_t tail;
+	volatile uint32_t waiting;
+	char pad1[56];
+	unsigned char data[SHM_RING_SIZE];
+};
+
+/**
+ * The shared memory of a local channel, the server writes the first ring, the client the
+ * second. The frames in the rings are version 2 frames.
+ */
+struct ShmSegment {
+	struct ShmRing ring[2];
+};
+
+/**
+ * A request of another thread to the reactor to stop watching a socket, it waits until done
+ * is set.
+ */
+struct ReactorRequest {
+	struct TcpipSocket *tcpSocket;
+	volatile uint8_t done;
+	struct ReactorRequest *next;
+};
+
+static int reactorFd = -1;
+static pthread_t reactorThread;
+static pthread_once_t reactorOnce = PTHREAD_ONCE_INIT;
+//! Wakes up the reactor for the requests, it is watched with a NULL pointer
+static int reactorWakeFd = -1;
+static struct ReactorRequest *reactorRequests = NULL;
+static pthread_mutex_t reactorMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reactorCond = PTHREAD_COND_INITIALIZER;
 
 /************************************************************************************************
  *                      Function declarations
@@ -59,6 +160,19 @@
 void *tcpip_start_client(void *context);
 void *tcpip_start_server(void *context);
 
+static void *tcpip_start_local(void *context);
+static void tcpip_accept_local(struct TcpipSocket *tcpSocket);
+static int tcpip_read_local(struct TcpipSocket *tcpSocket);
+static int tcpip_write_local(struct TcpipSocket *tcpSocket, struct iovec *iov, int iovcnt);
+static void tcpip_close_local(struct TcpipSocket *tcpSocket);
+
+static void *tcpip_start_multicast(void *context);
+static int tcpip_read_datagrams(struct TcpipSocket *tcpSocket);
+static int tcpip_write_datagrams(int fd, struct iovec *iov, int iovcnt);
+
+static int tcpip_watch(struct TcpipSocket *tcpSocket, int fd);
+static void tcpip_unwatch(struct TcpipSocket *tcpSocket);
+
 void sprintmsg(struct TcpipMessage *msg, char* text);
 
 /************************************************************************************************
@@ -69,6 +183,48 @@ void sprintmsg(struct TcpipMessage *msg, char* text);
  *
  ***********************************************************************************************/
 
+/**
+ * Allocates a message with a payload of size bytes, the payload is not cleared.
+ */
+static struct TcpipMessage *tcpip_new_msg(int size) {
+	struct TcpipMessage *m = linda_ctx_alloc(sizeof(struct TcpipMessage));
+	if (m == NULL) return NULL;
+	m->buffer = linda_buffer_alloc(size);
+	if (m->buffer == NULL) {
+		linda_ctx_free(m);
+		return NULL;
+	}
+	m->payload = m->buffer->data;
+	m->size = size;
+	m->next = NULL;
+	return m;
+}
+
+/**
+ * Allocates a message with a cleared payload of size bytes.
+ */
+struct TcpipMessage *tcpip_alloc_msg(int size) {
+	struct TcpipMessage *m = tcpip_new_msg(size);
+	if (m != NULL) memset(m->payload, 0, size);
+	return m;
+}
+
+/**
+ * Creates a message of size bytes, that starts at offset in the payload of msg. The payload
+ * is shared, not copied, so the slice should only be read. With offset 0 and the size of
+ * msg, the same message can be pushed in several outboxes. The slice is freed by freemsg
+ * as usual, the payload is given back when msg and all its slices are freed.
+ */
+struct TcpipMessage *tcpip_slice_msg(struct TcpipMessage *msg, int offset, int size) {
+	struct TcpipMessage *m = linda_ctx_alloc(sizeof(struct TcpipMessage));
+	if (m == NULL) return NULL;
+	m->buffer = linda_buffer_ref(msg->buffer);
+	m->payload = msg->payload + offset;
+	m->size = size;
+	m->next = NULL;
+	return m;
+}
+
 /**
  * Frees the message and its content. Be aware that the return pointer is not a NULL pointer in
  * the C99 standard. So, if used to check on like "if(msg == NULL)" make sure, "msg = NULL;" is
@@ -76,43 +232,88 @@ void sprintmsg(struct TcpipMessage *msg, char* text);
  */
 void freemsg(struct TcpipMessage *m) {
 	if (m == NULL) return;
-	free(m->payload);
-	free(m);
+	linda_buffer_unref(m->buffer);
+	linda_ctx_free(m);
 }
 
 /**
- * Adds a message to the mailbox. It will be added as the newest (last) item and it's next
- * item will be NULL (it is not a linked list).
+ * Initializes an empty mailbox.
  */
-void push(struct TcpipMailbox *M, struct TcpipMessage *m) {
-	pthread_mutex_lock(M->lock);
-	if (M->first == NULL) {
-		//		tprintf(LOG_VERBOSE, __func__, "Put as first");
-		M->first = m;
-	} else {
-		//		if (M->last == NULL) tprintf(LOG_ERR, __func__, "Last should never be NULL");
-		//assumption: if M->first != NULL then M->last != NULL
-		M->last->next = m;
+void tcpip_init_mailbox(struct TcpipMailbox *M) {
+	memset(&M->stub, 0, sizeof(M->stub));
+	M->first = M->last = &M->stub;
+	M->depth = 0;
+	M->lock = malloc(sizeof(pthread_mutex_t));
+	pthread_mutex_init(M->lock, NULL);
+}
+
+/**
+ * Links a message behind the last one. Between the exchange and setting the next field of
+ * the previous message, the queue is cut, a consumer that gets there waits in next_msg.
+ */
+static void link_msg(struct TcpipMailbox *M, struct TcpipMessage *m) {
+	m->next = NULL;
+	__sync_synchronize();
+	struct TcpipMessage *prev = __sync_lock_test_and_set(&M->last, m);
+	*(struct TcpipMessage *volatile*)&prev->next = m;
+}
+
+/**
+ * The message after m, which is known to be pushed, but may not be linked yet.
+ */
+static struct TcpipMessage *next_msg(struct TcpipMessage *m) {
+	struct TcpipMessage *next;
+	while ((next = *(struct TcpipMessage *volatile*)&m->next) == NULL) sched_yield();
+	__sync_synchronize();
+	return next;
+}
+
+/**
+ * Takes the first message out of the mailbox, must be called with the lock. The last
+ * message can only be taken out when there is one behind it, so then the stub is pushed.
+ */
+static struct TcpipMessage *take_msg(struct TcpipMailbox *M) {
+	struct TcpipMessage *m = M->first, *next;
+	if (m == &M->stub) {
+		if (M->last == &M->stub) return NULL;
+		M->first = m = next_msg(m);
+	}
+	next = *(struct TcpipMessage *volatile*)&m->next;
+	if (next == NULL) {
+		if (m == M->last) link_msg(M, &M->stub);
+		next = next_msg(m);
 	}
-	M->last = m;
+	__sync_synchronize();
+	M->first = next;
 	m->next = NULL;
-	pthread_mutex_unlock(M->lock);
+	__sync_sub_and_fetch(&M->depth, 1);
+	return m;
+}
+
+/**
+ * Adds a message to the mailbox. It will be added as the newest (last) item and it's next
+ * item will be NULL (it is not a linked list). Any thread can push at any time, without
+ * waiting for a lock.
+ */
+void push(struct TcpipMailbox *M, struct TcpipMessage *m) {
+	__sync_add_and_fetch(&M->depth, 1);
+	link_msg(M, m);
 }
 
 /**
  * Does advance to the next message, but does not deallocate the previous message. The caller
  * should take care of deallocate the previous message. The retrieved message does not
- * refer anymore to the next message, this is already set to NULL.
+ * refer anymore to the next message, this is already set to NULL. The retrieved message is
+ * the first message in the mailbox afterwards, it is not taken out.
  */
 struct TcpipMessage *advance(struct TcpipMailbox *M) {
+	struct TcpipMessage *m = NULL;
 	pthread_mutex_lock(M->lock);
-	if (M->first == NULL) {
-		pthread_mutex_unlock(M->lock);
-		return NULL;
+	if (take_msg(M) != NULL) {
+		m = M->first;
+		if (m == &M->stub) m = (M->last == &M->stub) ? NULL : next_msg(m);
+		if (m != NULL) M->first = m;
 	}
-	struct TcpipMessage *m = M->first->next;
-	M->first->next = NULL;
-	M->first = m;
 	pthread_mutex_unlock(M->lock);
 	return m;
 }
@@ -121,62 +322,32 @@ struct TcpipMessage *advance(struct TcpipMailbox *M) {
  * Pops the message, doesn't free anything.
  */
 struct TcpipMessage *pop(struct TcpipMailbox *M) {
+	if (!M->depth) return NULL;
 	pthread_mutex_lock(M->lock);
-	if (M->first == NULL) {
-		pthread_mutex_unlock(M->lock);
-		return NULL;
-	}
-	struct TcpipMessage *m = M->first;
-	M->first = M->first->next;
-	m->next = NULL;
+	struct TcpipMessage *m = take_msg(M);
 	pthread_mutex_unlock(M->lock);
 	return m;
 }
 
 /**
- * A message is moved from the head of the source to the bottom of the destination mailbox. It
- * could call advance and push, but then the move cannot be executed as an atomic action. During
- * the move process it is not possible to add or remove items from either mailbox.
+ * A message is moved from the head of the source to the bottom of the destination mailbox.
+ * Other threads can push to the destination, and to the source, during the move.
  */
 void move(struct TcpipMailbox *Msrc, struct TcpipMailbox *Mdest) {
-	pthread_mutex_lock(Msrc->lock);
-	pthread_mutex_lock(Mdest->lock);
-
-	if (Msrc->first == NULL) {
+	struct TcpipMessage *m = pop(Msrc);
+	if (m == NULL) {
 		tprintf(LOG_WARNING, __func__, "No message in source mailbox");
-		pthread_mutex_unlock(Mdest->lock);
-		pthread_mutex_unlock(Msrc->lock);
 		return;
 	}
-	struct TcpipMessage *m = Msrc->first;
-	if (Mdest->first == NULL) {
-		Mdest->first = m;
-	} else {
-		Mdest->last->next = m;
-	}
-	Mdest->last = m;
-
-	m = Msrc->first->next;
-	Msrc->first->next = NULL;
-	Msrc->first = m;
-
-	pthread_mutex_unlock(Mdest->lock);
-	pthread_mutex_unlock(Msrc->lock);
+	push(Mdest, m);
 }
 
 /**
- * Counts the amount of messages in a mailbox.
+ * Counts the amount of messages in a mailbox, this does not walk the mailbox, it just reads
+ * the depth.
  */
 int count(struct TcpipMailbox *M) {
-	pthread_mutex_lock(M->lock);
-	int result = 0;
-	struct TcpipMessage *m = M->first;
-	while (m != NULL) {
-		result++;
-		m = m->next;
-	}
-	pthread_mutex_unlock(M->lock);
-	return result;
+	return M->depth;
 }
 
 /************************************************************************************************
@@ -204,37 +375,122 @@ struct TcpipSocket *tcpip_get(unsigned char server) {
 	struct TcpipSocket *tcpSocket = malloc(sizeof(struct TcpipSocket));
 	tcpSocket->port_nr = 3333;
 	tcpSocket->status = 0;
-	if (server) RAISE(tcpSocket->status, TCP_SERVER);
+	if (server & ~(TCPIP_CHANNEL_LOCAL | TCPIP_CHANNEL_MULTICAST | TCPIP_CHANNEL_HELLO))
+		RAISE(tcpSocket->status, TCP_SERVER);
 	else RAISE(tcpSocket->status, TCP_CLIENT);
+	if (server & TCPIP_CHANNEL_LOCAL) RAISE(tcpSocket->status, TCP_LOCAL);
+	if (server & TCPIP_CHANNEL_MULTICAST) RAISE(tcpSocket->status, TCP_MULTICAST);
+	if (server & TCPIP_CHANNEL_HELLO) RAISE(tcpSocket->status, TCP_HELLO);
 
 	tcpSocket->inbox = malloc(sizeof(struct TcpipMailbox));
 	tcpSocket->outbox = malloc(sizeof(struct TcpipMailbox));
-	tcpSocket->inbox->lock = malloc(sizeof(pthread_mutex_t));
-	tcpSocket->outbox->lock = malloc(sizeof(pthread_mutex_t));
-	tcpSocket->inbox->first = NULL;
-	tcpSocket->inbox->last = NULL;
-	tcpSocket->outbox->first = NULL;
-	tcpSocket->outbox->last = NULL;
-	pthread_mutex_init (tcpSocket->inbox->lock, NULL);
-	pthread_mutex_init (tcpSocket->outbox->lock, NULL);
+	tcpip_init_mailbox(tcpSocket->inbox);
+	tcpip_init_mailbox(tcpSocket->outbox);
 	tcpSocket->tcpThread = malloc(sizeof(pthread_t));
 	tcpSocket->sync = malloc(sizeof(struct SyncThreads));
 	ptreaty_init(tcpSocket->sync);
 	tcpSocket->callbackIn = NULL;
 	tcpSocket->callbackOut = NULL;
 	tcpSocket->callbackConnect = NULL;
+	tcpSocket->callbackLost = NULL;
 	tcpSocket->trials = 3;
+	tcpSocket->reader = calloc(1, sizeof(struct TcpipReader));
+	tcpSocket->peer_version = 1;
+	tcpSocket->hello_sent = 0;
+	tcpSocket->flush_scheduled = 0;
+	tcpSocket->messages_in = tcpSocket->messages_out = 0;
+	tcpSocket->bytes_in = tcpSocket->bytes_out = 0;
+	tcpSocket->refs = 1;
+	tcpSocket->closed = 0;
 	
 	tprintf(LOG_VERBOSE, __func__, "TCP/IP Connection initialized");
 	return tcpSocket;
 }
 
+/**
+ * A new connection. Until the hello of the peer comes in, it is assumed to know only
+ * version 1. Only a channel made with TCPIP_CHANNEL_HELLO tells the peer which protocol
+ * version is understood here right away, the others wait for the hello of the peer.
+ */
+static void tcpip_hello(struct TcpipSocket *tcpSocket) {
+	unsigned char hello[4] = { TCPIP_HELLO_MSG, 2, TCPIP_VERSION, 0 };
+	int yes = 1;
+	tcpSocket->peer_version = 1;
+	tcpSocket->hello_sent = 0;
+	//the outbox is flushed in bursts already, Nagle would only delay the last frame
+	setsockopt(tcpSocket->write_sockfd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+	if (!RAISED(tcpSocket->status, TCP_HELLO)) return;
+	tcpSocket->hello_sent = 1;
+	if (send(tcpSocket->write_sockfd, hello, sizeof(hello), MSG_NOSIGNAL) != sizeof(hello)) {
+		tprintf(LOG_WARNING, __func__, "Hello could not be sent");
+	}
+}
+
+/**
+ * The largest message that can be sent over this socket, it depends on the protocol version
+ * of the peer, or for a multicast channel on the size of a datagram.
+ */
+int tcpip_max_message_size(struct TcpipSocket *tcpSocket) {
+	if (RAISED(tcpSocket->status, TCP_MULTICAST)) return TCPIP_DATAGRAM_MAX_SIZE;
+	return tcpSocket->peer_version >= 2 ? MAX_FRAME_SIZE : TCPIP_V1_MAX_SIZE;
+}
+
+/**
+ * A reference for a task that is dispatched with the socket, see tcpip_hold.
+ */
+void tcpip_hold(struct TcpipSocket *tcpSocket) {
+	__sync_add_and_fetch(&tcpSocket->refs, 1);
+}
+
+void tcpip_release(struct TcpipSocket *tcpSocket) {
+	if (!__sync_sub_and_fetch(&tcpSocket->refs, 1)) tcpip_free(tcpSocket);
+}
+
+/**
+ * Dispatches a task with the socket as context, which holds the socket until it is done and
+ * releases it. Without a delay the task is dispatched right away.
+ */
+static void tcpip_dispatch(void *(*func)(void*), struct TcpipSocket *tcpSocket,
+		char *taskDesc, int priority, long delay_us) {
+	tcpip_hold(tcpSocket);
+	if ((delay_us ? dispatch_delayed_prioritized_task(func, (void*)tcpSocket, taskDesc,
+			priority, delay_us) : dispatch_prioritized_task(func, (void*)tcpSocket, taskDesc,
+			priority))) tcpip_release(tcpSocket);
+}
+
+static void *tcpip_call_in(void *context) {
+	struct TcpipSocket *tcpSocket = (struct TcpipSocket*)context;
+	tcpSocket->callbackIn(context);
+	tcpip_release(tcpSocket);
+	return NULL;
+}
+
+static void *tcpip_call_out(void *context) {
+	struct TcpipSocket *tcpSocket = (struct TcpipSocket*)context;
+	tcpSocket->callbackOut(context);
+	tcpip_release(tcpSocket);
+	return NULL;
+}
+
+static void *tcpip_call_connect(void *context) {
+	struct TcpipSocket *tcpSocket = (struct TcpipSocket*)context;
+	tcpSocket->callbackConnect(context);
+	tcpip_release(tcpSocket);
+	return NULL;
+}
+
+static void *tcpip_restart(void *context) {
+	tcpip_start(context);
+	tcpip_release((struct TcpipSocket*)context);
+	return NULL;
+}
+
 /**
  * Starts tcp/ip, and is the same as tcpip_start, but using this routine, the user
- * doesn't need to know how tasks are dispatched.
+ * doesn't need to know how tasks are dispatched, and the socket is held until it is started.
  */
 void tcpip_run(struct TcpipSocket *sock) {
-	dispatch_described_task(tcpip_start, (void*)sock, "start client or server");
+	tcpip_dispatch(tcpip_restart, sock, "start client or server", ABBEY_PRIORITY_NORMAL, 0);
 }
 
 /**
@@ -242,15 +498,21 @@ void tcpip_run(struct TcpipSocket *sock) {
  * which can be done with default values using tcpip_get(). The routine calls a task
  * that starts a TCP server or client, depending on tcpSocket->status. Over there a
  * server/client mode bit exists. It can be set by executing tcpip_get(SERVER) or
- * tcpip_get(CLIENT).
+ * tcpip_get(CLIENT). The client or server is started in the same task, the caller should
+ * hold the socket while it runs, see tcpip_run. A socket that is closed is not started.
  */
 void *tcpip_start(void* context) {
 	struct TcpipSocket *tcpSocket = (struct TcpipSocket*)context;
+	if (tcpSocket->closed) return NULL;
 
-	if (CLEARED(tcpSocket->status, TCP_SERVER)) {
-		dispatch_described_task(tcpip_start_client, context, "start client");
+	if (RAISED(tcpSocket->status, TCP_LOCAL)) {
+		tcpip_start_local(context);
+	} else if (RAISED(tcpSocket->status, TCP_MULTICAST)) {
+		tcpip_start_multicast(context);
+	} else if (CLEARED(tcpSocket->status, TCP_SERVER)) {
+		tcpip_start_client(context);
 	} else {
-		dispatch_described_task(tcpip_start_server, context, "start server");
+		tcpip_start_server(context);
 	}
 	return NULL;
 }
@@ -283,9 +545,10 @@ void *tcpip_start_client(void *context) {
 	tcpSocket->write_sockfd = tcpSocket->serv_sockfd;
 	tcpSocket->read_sockfd = tcpSocket->serv_sockfd;
 
-	dispatch_described_task(tcpip_retrieve_packets, context, "retrieve packets");
+	tcpip_hello(tcpSocket);
+	tcpip_retrieve_packets(context);
 	if (tcpSocket->callbackConnect != NULL)
-		dispatch_described_task(tcpSocket->callbackConnect, context, "client started");
+		tcpip_dispatch(tcpip_call_connect, tcpSocket, "client started", ABBEY_PRIORITY_NORMAL, 0);
 	return NULL;
 }
 
@@ -341,158 +604,958 @@ void *tcpip_start_server(void* context) {
 	}
 
 	tprintf(LOG_VERBOSE, __func__, "Waiting for client to connect...");
+	tcpSocket->reader->listening = 1;
+	if (tcpip_watch(tcpSocket, tcpSocket->serv_sockfd)) {
+		tprintf(LOG_ERR, __func__, "Can not wait for a client...");
+	}
+	return NULL;
+}
+
+/**
+ * Called by the reactor when a client connects to a listening server socket. From then on
+ * the client socket is watched instead.
+ */
+static void tcpip_accept(struct TcpipSocket *tcpSocket) {
+	tcpip_unwatch(tcpSocket);
+	tcpSocket->reader->listening = 0;
+	if (RAISED(tcpSocket->status, TCP_LOCAL)) {
+		tcpip_accept_local(tcpSocket);
+		return;
+	}
 	unsigned int sin_size = sizeof(tcpSocket->cli_addr);
 	if ((tcpSocket->cli_sockfd = accept(tcpSocket->serv_sockfd,
 			(struct sockaddr *)&tcpSocket->cli_addr, &sin_size)) == -1) {
 		tprintf(LOG_ERR, __func__, "At accept(sockfd) there was an error...");
 	}
-	char text[64];
-	sprintf(text, "Connected to client %s", inet_ntoa(tcpSocket->cli_addr.sin_addr));
-	tprintf(LOG_VERBOSE, __func__, text);
+	TPRINTF(LOG_VERBOSE, "Connected to client %s", inet_ntoa(tcpSocket->cli_addr.sin_addr));
 
 	tcpSocket->write_sockfd = tcpSocket->cli_sockfd;
 	tcpSocket->read_sockfd = tcpSocket->cli_sockfd;
 
-	dispatch_described_task(tcpip_retrieve_packets, (void*)tcpSocket, "retrieve packets");
+	tcpip_hello(tcpSocket);
+	tcpip_retrieve_packets((void*)tcpSocket);
 	if (tcpSocket->callbackConnect != NULL)
-		dispatch_described_task(tcpSocket->callbackConnect, context, "server started");
-	return NULL;
+		tcpip_dispatch(tcpip_call_connect, tcpSocket, "server started", ABBEY_PRIORITY_NORMAL, 0);
 }
 
-/**
- * This method starts listening to a socket, each time a command is received it is placed in the
- * inbox and the thread continues to listen for messages on the socket. The size of each command
- * is predefined and has to be adjusted over here if the protocol changes. There is no
- * end-of-command construction. Sending random bytes at times, or sending more or less bytes
- * than expected will corrupt this listener.
+/************************************************************************************************
+ *                      Function implementations
+ ************************************************************************************************
  *
- * @todo reformulate in task format, should call itself recursively, put write_sockfd in
- * tcpSocket struct and "calculate" only once beforehand
+ *  For the reactor
+ *
+ ***********************************************************************************************/
+
+static void *tcpip_reactor(void *arg);
+
+static void tcpip_start_reactor() {
+	struct epoll_event event;
+	reactorFd = epoll_create1(EPOLL_CLOEXEC);
+	if (reactorFd == -1) {
+		tprintf(LOG_CRIT, __func__, "Can not create the reactor!");
+		return;
+	}
+	reactorWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;
+	if (reactorWakeFd == -1 ||
+			epoll_ctl(reactorFd, EPOLL_CTL_ADD, reactorWakeFd, &event) == -1 ||
+			pthread_create(&reactorThread, NULL, tcpip_reactor, NULL)) {
+		tprintf(LOG_CRIT, __func__, "Can not start the reactor!");
+		if (reactorWakeFd != -1) close(reactorWakeFd);
+		close(reactorFd);
+		reactorFd = reactorWakeFd = -1;
+		return;
+	}
+	pthread_detach(reactorThread);
+}
+
+/**
+ * Lets the reactor watch the file descriptor of a socket, a socket is watched on one file
+ * descriptor at a time.
  */
-void* tcpip_retrieve_packets(void* context) {
-	struct TcpipSocket *tcpSocket = (struct TcpipSocket*)context;
-	char text[128];
-	sprintf(text, "Listen for packets on fd %i", tcpSocket->read_sockfd);
-	tprintf(LOG_VV, __func__, text);
-	unsigned char command, size, i;
-	int nofbytes;
-	unsigned char result[MAX_PACKET_SIZE-1];
-	struct TcpipMessage *msg;
+static int tcpip_watch(struct TcpipSocket *tcpSocket, int fd) {
+	struct epoll_event event;
+	pthread_once(&reactorOnce, tcpip_start_reactor);
+	if (reactorFd == -1) return -1;
+	event.events = EPOLLIN | EPOLLRDHUP;
+	event.data.ptr = tcpSocket;
+	if (epoll_ctl(reactorFd, EPOLL_CTL_ADD, fd, &event) == -1) return -1;
+	tcpSocket->reader->watched = 1;
+	return 0;
+}
 
-	nofbytes = recv(tcpSocket->read_sockfd, &command, sizeof(unsigned char), 0);
-	char errormsg[64];
-	switch(nofbytes) {
-	case -1: 
-		sprintf(errormsg, "Error with error code %i!", errno);
-		tprintf(LOG_ERR, __func__, errormsg);
-		if (errno != 107) return NULL;
-		tcpSocket->trials--;
-		if (!tcpSocket->trials) {
-			tprintf(LOG_CRIT, __func__, "Can not get a connection!");
-			return NULL;
-		}
-		sleep(3);
-		tprintf(LOG_WARNING, __func__, "Try again in 3 seconds!");
-		close(tcpSocket->cli_sockfd);
-		close(tcpSocket->serv_sockfd);
-		dispatch_described_task(tcpip_start, context, "restart tcp/ip");
-		return NULL;
-	case 0:
-		tprintf(LOG_WARNING, __func__, "Other side disconnected, restart!");
-		close(tcpSocket->cli_sockfd);
-		close(tcpSocket->serv_sockfd);
-		dispatch_described_task(tcpip_start, context, "restart tcp/ip");
-		return NULL;
-	default:
-		;
+/**
+ * Stops watching the socket and forgets a frame that is partially received. Only the reactor
+ * calls this, so it is never in the middle of reading the socket.
+ */
+static void tcpip_forget(struct TcpipSocket *tcpSocket) {
+	struct TcpipReader *reader = tcpSocket->reader;
+	if (!reader->watched) return;
+	int fd = reader->listening ? tcpSocket->serv_sockfd : tcpSocket->read_sockfd;
+	epoll_ctl(reactorFd, EPOLL_CTL_DEL, fd, NULL);
+	reader->watched = 0;
+	reader->start = reader->end = 0;
+	reader->got = 0;
+	freemsg(reader->msg);
+	reader->msg = NULL;
+}
+
+/**
+ * The reactor stops watching the socket. Another thread asks the reactor to do so, and waits
+ * until it did, so afterwards the socket can be closed and freed.
+ */
+static void tcpip_unwatch(struct TcpipSocket *tcpSocket) {
+	struct ReactorRequest request = { tcpSocket, 0, NULL };
+	uint64_t one = 1;
+	//only the reactor clears watched, a socket that is not watched stays so
+	if (reactorFd == -1 || !tcpSocket->reader->watched) return;
+	if (pthread_equal(pthread_self(), reactorThread)) {
+		tcpip_forget(tcpSocket);
+		return;
 	}
-	
-	sprintf(text, "Command packet received... %i", command);
-	tprintf(LOG_VVVV, __func__, text);
-	if (nofbytes <= 0) goto loop;
-	nofbytes = recv(tcpSocket->read_sockfd, &size, sizeof(unsigned char), 0);
-	sprintf(text, "Size packet received... %i", size);
-	tprintf(LOG_VVVV, __func__, text);
-	if (nofbytes <= 0) goto loop;
-	if (size == 0) goto loop;
-	nofbytes = recv(tcpSocket->read_sockfd, result, size, 0);
-	sprintf(text, "The rest of packet received... %i", nofbytes);
-	tprintf(LOG_VVVV, __func__, text);
-
-	msg = malloc(sizeof(struct TcpipMessage));
-	msg->payload = calloc(MAX_PACKET_SIZE-1, sizeof(unsigned char));
-	msg->size = size+2;
-
-	msg->payload[0] = command;
-	msg->payload[1] = size;
-	for (i=0;i<nofbytes;i++) {
-		msg->payload[i+2] = result[i];
+	pthread_mutex_lock(&reactorMutex);
+	request.next = reactorRequests;
+	reactorRequests = &request;
+	pthread_mutex_unlock(&reactorMutex);
+	while (write(reactorWakeFd, &one, sizeof(one)) == -1 && errno == EINTR);
+	pthread_mutex_lock(&reactorMutex);
+	while (!request.done) pthread_cond_wait(&reactorCond, &reactorMutex);
+	pthread_mutex_unlock(&reactorMutex);
+}
+
+/**
+ * Carries out the requests of other threads, after the events that were reported with them
+ * are handled, so none of those refers to a socket that is forgotten.
+ */
+static void tcpip_serve_requests() {
+	struct ReactorRequest *request;
+	uint64_t events;
+	while (read(reactorWakeFd, &events, sizeof(events)) == -1 && errno == EINTR);
+	pthread_mutex_lock(&reactorMutex);
+	for (request = reactorRequests; request != NULL; request = request->next) {
+		tcpip_forget(request->tcpSocket);
+		request->done = 1;
 	}
+	reactorRequests = NULL;
+	pthread_cond_broadcast(&reactorCond);
+	pthread_mutex_unlock(&reactorMutex);
+}
+
+/**
+ * A complete frame is put in the inbox, after which callbackIn is dispatched. Only the reactor
+ * delivers, so the counters need no atomic additions.
+ */
+static void tcpip_deliver(struct TcpipSocket *tcpSocket, struct TcpipMessage *msg) {
 	tprintmsg(msg, LOG_VVV);
-	//	tcpSocket->messageCount++;
+	tcpSocket->messages_in++;
+	tcpSocket->bytes_in += msg->size;
+	if (lindaTraceEnabled) linda_trace_message(LINDA_TRACE_RECEIVE, msg->payload, msg->size);
 	push(tcpSocket->inbox, msg);
 
 	//not nice, this construct
 	if (tcpSocket->callbackIn != NULL)
-		dispatch_task(tcpSocket->callbackIn, context);
+		tcpip_dispatch(tcpip_call_in, tcpSocket, "", ABBEY_PRIORITY_IO, 0);
+}
+
+/**
+ * The connection is lost or could not be set up. A socket that is not connected is tried
+ * again after 3 seconds, as long as there are trials left. If the other side disconnected,
+ * the connection is restarted right away. After any other error the socket is left alone.
+ * Either way callbackLost is told first.
+ */
+static void tcpip_lost(struct TcpipSocket *tcpSocket, int error) {
+	tcpip_unwatch(tcpSocket);
+	if (tcpSocket->callbackLost != NULL) tcpSocket->callbackLost(tcpSocket);
+	if (error == 0) {
+		tprintf(LOG_WARNING, __func__, "Other side disconnected, restart!");
+		close(tcpSocket->cli_sockfd);
+		close(tcpSocket->serv_sockfd);
+		tcpip_dispatch(tcpip_restart, tcpSocket, "restart tcp/ip", ABBEY_PRIORITY_NORMAL, 0);
+		return;
+	}
+	TPRINTF(LOG_ERR, "Error with error code %i!", error);
+	if (error != ENOTCONN && error != ECONNREFUSED) return;
+	tcpSocket->trials--;
+	if (!tcpSocket->trials) {
+		tprintf(LOG_CRIT, __func__, "Can not get a connection!");
+		return;
+	}
+	tprintf(LOG_WARNING, __func__, "Try again in 3 seconds!");
+	close(tcpSocket->cli_sockfd);
+	close(tcpSocket->serv_sockfd);
+	tcpip_dispatch(tcpip_restart, tcpSocket, "restart tcp/ip", ABBEY_PRIORITY_IO, 3000000);
+}
+
+/**
+ * Allocates a message with room for length bytes, of which the first part bytes are copied
+ * from data.
+ */
+static struct TcpipMessage *tcpip_frame_message(const unsigned char *data, int part,
+		int length) {
+	struct TcpipMessage *msg = tcpip_new_msg(length);
+	if (msg != NULL) memcpy(msg->payload, data, part);
+	return msg;
+}
 
-	loop:
-	//	if (tcpSocket->messageCount > 20) return NULL;
+/**
+ * A complete frame is received. The hello of the peer is not delivered, it only sets its
+ * version, and is answered with the own hello if that is not sent yet. The answer goes
+ * through the outbox, so it is not written in the middle of a flush.
+ */
+static void tcpip_frame_received(struct TcpipSocket *tcpSocket, struct TcpipMessage *msg) {
+	if (msg == NULL) {
+		tprintf(LOG_ERR, __func__, "No memory for the frame, it is dropped");
+		return;
+	}
+	TPRINTF(LOG_VVVV, "Command %i with size %i received", msg->payload[0], msg->size);
+	if (msg->payload[0] == TCPIP_HELLO_MSG && msg->size >= 3) {
+		tcpSocket->peer_version = msg->payload[2];
+		TPRINTF(LOG_VERBOSE, "Peer speaks protocol version %i", tcpSocket->peer_version);
+		freemsg(msg);
+		if (tcpSocket->hello_sent) return;
+		unsigned char hello[4] = { TCPIP_HELLO_MSG, 2, TCPIP_VERSION, 0 };
+		if ((msg = tcpip_frame_message(hello, sizeof(hello), sizeof(hello))) == NULL) return;
+		tcpSocket->hello_sent = 1;
+		push(tcpSocket->outbox, msg);
+		tcpip_flush(tcpSocket);
+		return;
+	}
+	tcpip_deliver(tcpSocket, msg);
+}
+
+/**
+ * Hands over every complete frame in the read buffer. A version 1 frame is a command byte,
+ * a size byte and size bytes, version 1 frames with size 0 carry nothing and are skipped.
+ * If the last frame is incomplete and large, its message is allocated already, so the rest
+ * of it is received into the message and not copied again. Otherwise the incomplete frame is
+ * moved to the front of the buffer. Returns -1 if the size of a frame can not be right.
+ */
+static int tcpip_parse(struct TcpipSocket *tcpSocket) {
+	struct TcpipReader *reader = tcpSocket->reader;
+	int available, header, length;
+	while ((available = reader->end - reader->start) > 0) {
+		unsigned char *frame = reader->buffer + reader->start;
+		if (frame[0] == TCPIP_FRAME_MARKER) {
+			if (available < 3) break;
+			header = 3;
+			length = (frame[1] << 8) | frame[2];
+			if (length < 2 || length > MAX_FRAME_SIZE) return -1;
+		} else {
+			if (available < 2) break;
+			if (frame[1] == 0) {
+				reader->start += 2;
+				continue;
+			}
+			header = 0;
+			length = frame[1] + 2;
+		}
+		if (available < header + length) {
+			if (length < READ_DIRECT_SIZE) break;
+			reader->msg = tcpip_frame_message(frame + header, available - header, length);
+			if (reader->msg == NULL) break;
+			reader->got = available - header;
+			reader->start = reader->end;
+			break;
+		}
+		reader->start += header + length;
+		tcpip_frame_received(tcpSocket, tcpip_frame_message(frame + header, length, length));
+	}
+	available = reader->end - reader->start;
+	if (available && reader->start) memmove(reader->buffer, reader->buffer + reader->start, available);
+	reader->start = 0;
+	reader->end = available;
+	return 0;
+}
 
-	dispatch_described_task(tcpip_retrieve_packets, context, "retrieve packets");
+/**
+ * Reads what is available on a socket without blocking, as much as fits at once, so many
+ * small frames cost one system call. If recv returns less than there is room for, the kernel
+ * had nothing more, and the reactor will report the socket again when there is. Returns -1
+ * if the connection is lost, then the socket is not watched anymore.
+ */
+static int tcpip_read(struct TcpipSocket *tcpSocket) {
+	struct TcpipReader *reader = tcpSocket->reader;
+	int fd = tcpSocket->read_sockfd, nofbytes, room;
+	if (reader->in != NULL) return tcpip_read_local(tcpSocket);
+	if (RAISED(tcpSocket->status, TCP_MULTICAST)) return tcpip_read_datagrams(tcpSocket);
+	if (reader->buffer == NULL) {
+		reader->buffer = malloc(READ_BUFFER_SIZE);
+		if (reader->buffer == NULL) return 0;
+	}
+	while (1) {
+		struct TcpipMessage *msg = reader->msg;
+		if (msg != NULL) {
+			room = msg->size - reader->got;
+			nofbytes = recv(fd, msg->payload + reader->got, room, MSG_DONTWAIT);
+		} else {
+			room = READ_BUFFER_SIZE - reader->end;
+			nofbytes = recv(fd, reader->buffer + reader->end, room, MSG_DONTWAIT);
+		}
+		if (nofbytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+		if (nofbytes == -1 && errno == EINTR) continue;
+		if (nofbytes <= 0) {
+			tcpip_lost(tcpSocket, nofbytes ? errno : 0);
+			return -1;
+		}
+		if (msg != NULL) {
+			reader->got += nofbytes;
+			if (reader->got < msg->size) return 0;
+			reader->msg = NULL;
+			reader->got = 0;
+			tcpip_frame_received(tcpSocket, msg);
+			continue;
+		}
+		reader->end += nofbytes;
+		if (tcpip_parse(tcpSocket)) {
+			tcpip_lost(tcpSocket, EPROTO);
+			return -1;
+		}
+		if (nofbytes < room) return 0;
+	}
+}
+
+/**
+ * The reactor thread. Sockets are read or accepted in the order epoll reports them, all
+ * further work is dispatched to the abbey. The requests of other threads come last.
+ */
+static void *tcpip_reactor(void *arg) {
+	struct epoll_event events[REACTOR_EVENTS];
+	int i, n, requested;
+	ptreaty_set_thread_name("Reactor");
+	while (1) {
+		n = epoll_wait(reactorFd, events, REACTOR_EVENTS, -1);
+		if (n == -1) {
+			if (errno == EINTR) continue;
+			tprintf(LOG_CRIT, __func__, "Reactor stopped!");
+			return NULL;
+		}
+		for (i = requested = 0; i < n; i++) {
+			struct TcpipSocket *tcpSocket = (struct TcpipSocket*)events[i].data.ptr;
+			if (tcpSocket == NULL) requested = 1;
+			else if (tcpSocket->reader->listening) tcpip_accept(tcpSocket);
+			else tcpip_read(tcpSocket);
+		}
+		if (requested) tcpip_serve_requests();
+	}
 	return NULL;
 }
 
 /**
- * Each time something is pushed in an outbox, call tcpip_send to assure delivery.
+ * Starts listening to a connected socket, each time a command is received it is placed in
+ * the inbox and callbackIn is dispatched. The socket is handed to the reactor thread, so
+ * this routine returns immediately, it is kept for code that dispatched it as a task.
+ */
+void* tcpip_retrieve_packets(void* context) {
+	struct TcpipSocket *tcpSocket = (struct TcpipSocket*)context;
+	TPRINTF(LOG_VV, "Listen for packets on fd %i", tcpSocket->read_sockfd);
+	if (tcpip_watch(tcpSocket, tcpSocket->read_sockfd)) {
+		TPRINTF(LOG_ERR, "Can not watch fd %i!", tcpSocket->read_sockfd);
+	}
+	return NULL;
+}
+
+/**
+ * Each time something is pushed in an outbox, call tcpip_flush to assure delivery. Only
+ * one flush is scheduled at a time, so a burst of pushes costs one task, and messages that
+ * are pushed while the flush runs are sent by that same flush.
+ */
+void tcpip_flush(struct TcpipSocket *tcpSocket) {
+	if (__sync_lock_test_and_set(&tcpSocket->flush_scheduled, 1)) return;
+	tcpip_hold(tcpSocket);
+	if (dispatch_prioritized_task(tcpip_send_packets, (void*)tcpSocket, "send packets",
+			ABBEY_PRIORITY_IO)) {
+		__sync_lock_release(&tcpSocket->flush_scheduled);
+		tcpip_release(tcpSocket);
+	}
+}
+
+/**
+ * The former name of tcpip_flush.
  */
 void tcpip_send(struct TcpipSocket *sock) {
-	dispatch_described_task(tcpip_send_packets, (void*)sock, "send packets");
+	tcpip_flush(sock);
 }
 
 /**
- * This routine sends immediately a message over a TCP/IP socket by the system call
- * "send". To ensure asynchronous execution, this function can be executed as a task
- * in a thread pool. It can send a bunch of messages that are waiting in the outbox
- * of the current tcpSocket struct. It will not execute itself in the end.
- *
- * @todo there might be a periodic task that executes this task regularly
+ * Takes all messages out of the mailbox at once, in the order they were pushed, as a chain.
+ */
+static struct TcpipMessage *tcpip_take_all(struct TcpipMailbox *M) {
+	struct TcpipMessage *first = NULL, *last = NULL, *m;
+	pthread_mutex_lock(M->lock);
+	while ((m = take_msg(M)) != NULL) {
+		if (last == NULL) first = m; else last->next = m;
+		last = m;
+	}
+	pthread_mutex_unlock(M->lock);
+	return first;
+}
+
+/**
+ * Writes the entire vector, also if the kernel takes only part of it at a time. Returns
+ * the result of the sendmsg that failed, or 1 if everything is written.
+ */
+static int tcpip_write_all(int fd, struct iovec *iov, int iovcnt) {
+	struct msghdr mh;
+	ssize_t retval;
+	memset(&mh, 0, sizeof(mh));
+	while (iovcnt > 0) {
+		mh.msg_iov = iov;
+		mh.msg_iovlen = iovcnt;
+		retval = sendmsg(fd, &mh, MSG_NOSIGNAL);
+		if (retval == -1 && errno == EINTR) continue;
+		if (retval <= 0) return retval;
+		while (iovcnt > 0 && (size_t)retval >= iov->iov_len) {
+			retval -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (unsigned char*)iov->iov_base + retval;
+			iov->iov_len -= retval;
+		}
+	}
+	return 1;
+}
+
+/**
+ * Sends all messages that are waiting in the outbox of the socket. They are written with
+ * one sendmsg per TCPIP_FLUSH_BATCH messages, a version 2 peer gets the frame header of
+ * each message in a separate vector element, so nothing is copied. This task should only
+ * be dispatched by tcpip_flush, which assures that one flush runs at a time and that the
+ * frames of different messages are not interleaved. When the outbox turns out to be
+ * empty right before the flush ends, the flush is done. Messages that can not be sent
+ * are dropped, except those that do not fit in the ring of a local channel, they are kept
+ * for the flush that follows when the receiver has made room. Afterwards callbackOut is
+ * dispatched once. The flush releases the socket that tcpip_flush held for it.
  */
 void *tcpip_send_packets(void* context) {
+	struct TcpipSocket *tcpSocket = (struct TcpipSocket*)context;
+	struct TcpipMessage *msg, *next, *batch[TCPIP_FLUSH_BATCH];
+	struct iovec iov[2 * TCPIP_FLUSH_BATCH];
+	unsigned char header[TCPIP_FLUSH_BATCH][3];
+	int i, n, iovcnt, retval, sent = 0, failed = 0, stalled = 0;
 	tprintf(LOG_VV, __func__, "Send TCP/IP packets...");
+	do {
+		msg = tcpip_take_all(tcpSocket->outbox);
+		if (tcpSocket->reader->stalled != NULL) {
+			for (next = tcpSocket->reader->stalled; next->next != NULL; next = next->next);
+			next->next = msg;
+			msg = tcpSocket->reader->stalled;
+			tcpSocket->reader->stalled = NULL;
+		}
+		stalled = 0;
+		while (msg != NULL) {
+			for (n = iovcnt = 0; msg != NULL && n < TCPIP_FLUSH_BATCH; msg = next) {
+				next = msg->next;
+				if (msg->size > tcpip_max_message_size(tcpSocket)) {
+					TPRINTF(LOG_ERR, "Message of size %i is too large for the peer", msg->size);
+					freemsg(msg);
+					continue;
+				}
+				tprintmsg(msg, LOG_VVV);
+				if (tcpSocket->peer_version >= 2) {
+					header[n][0] = TCPIP_FRAME_MARKER;
+					header[n][1] = msg->size >> 8;
+					header[n][2] = msg->size & 0xFF;
+					iov[iovcnt].iov_base = header[n];
+					iov[iovcnt++].iov_len = 3;
+				}
+				iov[iovcnt].iov_base = msg->payload;
+				iov[iovcnt++].iov_len = msg->size;
+				batch[n++] = msg;
+			}
+			if (n && !failed) {
+				TPRINTF(LOG_VVVV, "Send %i messages now!", n);
+				if (tcpSocket->reader->out != NULL) {
+					retval = tcpip_write_local(tcpSocket, iov, iovcnt);
+					//the rest waits for the receiver, it is sent again by the next flush
+					for (i = n - 1; i >= retval; i--) {
+						batch[i]->next = msg;
+						msg = batch[i];
+					}
+					if (retval < n) {
+						tcpSocket->reader->stalled = msg;
+						msg = NULL;
+						n = retval;
+						stalled = 1;
+					}
+					retval = 1;
+				} else if (RAISED(tcpSocket->status, TCP_MULTICAST))
+					retval = tcpip_write_datagrams(tcpSocket->write_sockfd, iov, iovcnt);
+				else
+					retval = tcpip_write_all(tcpSocket->write_sockfd, iov, iovcnt);
+				if (retval == -1) {
+					TPRINTF(LOG_ERR, "Error with error code %i!", errno);
+					failed = 1;
+				} else if (retval == 0) {
+					tprintf(LOG_WARNING, __func__, "Other side disconnected, restart!");
+					failed = 1;
+				}
+			}
+			for (i = 0; i < n; i++) {
+				if (lindaTraceEnabled && !failed)
+					linda_trace_message(LINDA_TRACE_SEND, batch[i]->payload, batch[i]->size);
+				if (!failed) tcpSocket->bytes_out += batch[i]->size;
+				freemsg(batch[i]);
+			}
+			if (!failed) {
+				sent += n;
+				tcpSocket->messages_out += n;
+			}
+		}
+		__sync_lock_release(&tcpSocket->flush_scheduled);
+		//a stalled flush goes on only if the receiver has made room in the meantime
+		__sync_synchronize();
+	} while ((stalled ? !tcpSocket->reader->out->waiting : count(tcpSocket->outbox)) &&
+			!__sync_lock_test_and_set(&tcpSocket->flush_scheduled, 1));
+	if (sent && tcpSocket->callbackOut != NULL) {
+		tprintf(LOG_VERBOSE, __func__, "Callback");
+		tcpip_dispatch(tcpip_call_out, tcpSocket, "tcp/ip callback", ABBEY_PRIORITY_NORMAL, 0);
+	}
+	tcpip_release(tcpSocket);
+	return NULL;
+}
+
+/**
+ * Closes sockets. The reactor stops watching the socket first, it may be reading it right
+ * now, so this waits for the reactor.
+ */
+void tcpip_close_all(struct TcpipSocket *tcpSocket) {
+	tcpSocket->closed = 1;
+	tcpip_unwatch(tcpSocket);
+	close(tcpSocket->cli_sockfd);
+	close(tcpSocket->serv_sockfd);
+	tcpip_close_local(tcpSocket);
+}
+
+static void tcpip_free_mailbox(struct TcpipMailbox *M) {
+	struct TcpipMessage *m;
+	while ((m = pop(M)) != NULL) freemsg(m);
+	pthread_mutex_destroy(M->lock);
+	free(M->lock);
+	free(M);
+}
+
+/**
+ * Frees a socket that is closed by tcpip_close_all, together with the messages that are
+ * still in its mailboxes. No task should use the socket anymore, it is called by the last
+ * tcpip_release, or for a socket that was never dispatched with.
+ */
+void tcpip_free(struct TcpipSocket *tcpSocket) {
+	struct TcpipMessage *msg, *next;
+	tcpip_free_mailbox(tcpSocket->inbox);
+	tcpip_free_mailbox(tcpSocket->outbox);
+	freemsg(tcpSocket->reader->msg);
+	for (msg = tcpSocket->reader->stalled; msg != NULL; msg = next) {
+		next = msg->next;
+		freemsg(msg);
+	}
+	free(tcpSocket->reader->buffer);
+	free(tcpSocket->reader);
+	ptreaty_free(tcpSocket->sync);
+	free(tcpSocket->sync);
+	free(tcpSocket->tcpThread);
+	free(tcpSocket);
+}
+
+/************************************************************************************************
+ *                      Function implementations
+ ************************************************************************************************
+ *
+ *  For local channels
+ *
+ * A local channel carries the same frames as a TCP/IP connection, but through two rings in
+ * a memfd. The server listens on an abstract Unix socket named after its port. When the
+ * client connects, the server creates the memfd and two eventfds, and hands them to the
+ * client over the Unix socket, which is closed afterwards. The sender writes frames into
+ * its ring and then writes the eventfd of the receiver, which is watched by the reactor of
+ * the receiving process. So sending a burst costs one system call, and nothing is copied
+ * through the kernel. When the ring is full, the messages that are left stay with the
+ * sender, and the receiver writes the eventfd of the sender when it has made room, so the
+ * reactor of the sender flushes them. A peer that stops is not noticed.
+ *
+ ***********************************************************************************************/
+
+static void tcpip_local_address(struct TcpipSocket *tcpSocket, struct sockaddr_un *addr,
+		socklen_t *length) {
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	int n = snprintf(addr->sun_path + 1, sizeof(addr->sun_path) - 1, "linda-%i",
+			tcpSocket->port_nr);
+	*length = offsetof(struct sockaddr_un, sun_path) + 1 + n;
+}
+
+/**
+ * The channel is set up, the reactor watches the eventfd of the incoming ring. The server
+ * writes the first ring.
+ */
+static void tcpip_local_connected(struct TcpipSocket *tcpSocket, struct ShmSegment *segment,
+		int readFd, int writeFd) {
+	struct TcpipReader *reader = tcpSocket->reader;
+	int server = RAISED(tcpSocket->status, TCP_SERVER) != 0;
+	reader->segment = segment;
+	reader->out = &segment->ring[server ? 0 : 1];
+	reader->in = &segment->ring[server ? 1 : 0];
+	tcpSocket->read_sockfd = readFd;
+	tcpSocket->write_sockfd = writeFd;
+	tcpSocket->peer_version = TCPIP_VERSION;
+	TPRINTF(LOG_VERBOSE, "Local channel on port %i connected", tcpSocket->port_nr);
+	tcpip_retrieve_packets((void*)tcpSocket);
+	if (tcpSocket->callbackConnect != NULL)
+		tcpip_dispatch(tcpip_call_connect, tcpSocket, server ? "server started" :
+				"client started", ABBEY_PRIORITY_NORMAL, 0);
+}
+
+/**
+ * Starts a local channel, a server waits in the reactor for its client, a client connects
+ * to the server and receives the shared memory.
+ */
+static void *tcpip_start_local(void *context) {
 	struct TcpipSocket *tcpSocket = (struct TcpipSocket*)context;
-	struct TcpipMessage *msg;
-	int retval;
-	msg = pop(tcpSocket->outbox);
-	if (msg == NULL) {
-		tprintf(LOG_WARNING, __func__, "Nothing to send");
+	struct sockaddr_un addr;
+	socklen_t length;
+	tcpip_local_address(tcpSocket, &addr, &length);
+	if ((tcpSocket->serv_sockfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1) {
+		tprintf(LOG_ERR, __func__, "At socket(AF_UNIX) there was an error...");
+		return NULL;
 	}
-	tprintmsg(msg, LOG_VVV);
-	tprintf(LOG_VVVV, __func__, "Send now!");
-	retval = send(tcpSocket->write_sockfd, msg->payload, msg->size, 0);
-	if (retval == -1) {
-		char errormsg[64]; sprintf(errormsg, "Error with error code %i!", errno);
-		tprintf(LOG_ERR, __func__, errormsg);
+	tcpSocket->cli_sockfd = -1;
+	if (RAISED(tcpSocket->status, TCP_SERVER)) {
+		if (bind(tcpSocket->serv_sockfd, (struct sockaddr*)&addr, length) == -1 ||
+				listen(tcpSocket->serv_sockfd, BACKLOG) == -1) {
+			TPRINTF(LOG_ERR, "Can not listen on local channel %i", tcpSocket->port_nr);
+			close(tcpSocket->serv_sockfd);
+			return NULL;
+		}
+		tcpSocket->reader->listening = 1;
+		if (tcpip_watch(tcpSocket, tcpSocket->serv_sockfd)) {
+			tprintf(LOG_ERR, __func__, "Can not wait for a client...");
+		}
 		return NULL;
-	} else if (retval == 0) {
-		tprintf(LOG_WARNING, __func__, "Other side disconnected, restart!");
+	}
+
+	if (connect(tcpSocket->serv_sockfd, (struct sockaddr*)&addr, length) == -1) {
+		tcpip_lost(tcpSocket, errno == ENOENT ? ECONNREFUSED : errno);
 		return NULL;
 	}
-	tprintf(LOG_VVVV, __func__, "Free msg");
-	freemsg(msg);
-	if (tcpSocket->callbackOut != NULL) {
-		tprintf(LOG_VERBOSE, __func__, "Callback");
-		dispatch_described_task(tcpSocket->callbackOut, context, "tcp/ip callback");
+	char byte;
+	int fds[3];
+	char control[CMSG_SPACE(sizeof(fds))];
+	struct iovec iov = { &byte, 1 };
+	struct msghdr mh;
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = control;
+	mh.msg_controllen = sizeof(control);
+	ssize_t retval;
+	do {
+		retval = recvmsg(tcpSocket->serv_sockfd, &mh, MSG_CMSG_CLOEXEC);
+	} while (retval == -1 && errno == EINTR);
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&mh);
+	if (retval != 1 || cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS ||
+			cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+		tcpip_lost(tcpSocket, EPROTO);
+		return NULL;
 	}
+	memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+	close(tcpSocket->serv_sockfd);
+	tcpSocket->serv_sockfd = -1;
+	struct ShmSegment *segment = mmap(NULL, sizeof(struct ShmSegment), PROT_READ | PROT_WRITE,
+			MAP_SHARED, fds[0], 0);
+	close(fds[0]);
+	if (segment == MAP_FAILED) {
+		tprintf(LOG_ERR, __func__, "Can not map the local channel");
+		close(fds[1]);
+		close(fds[2]);
+		return NULL;
+	}
+	//the server writes the first ring and wakes up the client with the first eventfd
+	tcpip_local_connected(tcpSocket, segment, fds[1], fds[2]);
 	return NULL;
 }
 
 /**
- * Closes sockets.
+ * Called by the reactor when a client connects to a local server. The shared memory and
+ * the eventfds are created and sent to the client.
  */
-void tcpip_close_all(struct TcpipSocket *tcpSocket) {
-	close(tcpSocket->cli_sockfd);
+static void tcpip_accept_local(struct TcpipSocket *tcpSocket) {
+	int client = accept4(tcpSocket->serv_sockfd, NULL, NULL, SOCK_CLOEXEC);
+	if (client == -1) {
+		tprintf(LOG_ERR, __func__, "At accept(sockfd) there was an error...");
+		return;
+	}
+	int fds[3] = { -1, -1, -1 };
+	struct ShmSegment *segment = MAP_FAILED;
+	fds[0] = memfd_create("linda-channel", MFD_CLOEXEC);
+	fds[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	fds[2] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (fds[0] != -1 && ftruncate(fds[0], sizeof(struct ShmSegment)) == 0) {
+		segment = mmap(NULL, sizeof(struct ShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED,
+				fds[0], 0);
+	}
+	if (segment == MAP_FAILED || fds[1] == -1 || fds[2] == -1) {
+		tprintf(LOG_ERR, __func__, "Can not create the local channel");
+		goto accept_local_failed;
+	}
+
+	char byte = TCPIP_VERSION;
+	char control[CMSG_SPACE(sizeof(fds))];
+	struct iovec iov = { &byte, 1 };
+	struct msghdr mh;
+	memset(&mh, 0, sizeof(mh));
+	memset(control, 0, sizeof(control));
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = control;
+	mh.msg_controllen = sizeof(control);
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&mh);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+	if (sendmsg(client, &mh, MSG_NOSIGNAL) != 1) {
+		tprintf(LOG_ERR, __func__, "Can not hand over the local channel");
+		goto accept_local_failed;
+	}
+	close(client);
+	close(fds[0]);
 	close(tcpSocket->serv_sockfd);
+	tcpSocket->serv_sockfd = -1;
+	//the client wakes up the server with the second eventfd
+	tcpip_local_connected(tcpSocket, segment, fds[2], fds[1]);
+	return;
+
+accept_local_failed:
+	if (segment != MAP_FAILED) munmap(segment, sizeof(struct ShmSegment));
+	int i;
+	for (i = 0; i < 3; i++) if (fds[i] != -1) close(fds[i]);
+	close(client);
+}
+
+/**
+ * Copies n bytes from the ring, starting at position from.
+ */
+static void shm_ring_copy(struct ShmRing *ring, uint32_t from, unsigned char *to, uint32_t n) {
+	uint32_t offset = from & (SHM_RING_SIZE - 1), first = SHM_RING_SIZE - offset;
+	if (first > n) first = n;
+	memcpy(to, ring->data + offset, first);
+	memcpy(to + first, ring->data, n - first);
+}
+
+/**
+ * Copies n bytes into the ring, starting at position to.
+ */
+static void shm_ring_put(struct ShmRing *ring, uint32_t to, const unsigned char *from,
+		uint32_t n) {
+	uint32_t offset = to & (SHM_RING_SIZE - 1), first = SHM_RING_SIZE - offset;
+	if (first > n) first = n;
+	memcpy(ring->data + offset, from, first);
+	memcpy(ring->data, from + first, n - first);
+}
+
+static void shm_notify(struct TcpipSocket *tcpSocket) {
+	uint64_t one = 1;
+	while (write(tcpSocket->write_sockfd, &one, sizeof(one)) == -1 && errno == EINTR);
+}
+
+/**
+ * Takes the frames out of the incoming ring. The eventfd is cleared before the ring is
+ * read, so a frame that is written in the meantime wakes the reactor up again. The eventfd
+ * is also written by the peer when it has made room in the outgoing ring, then the stalled
+ * messages are flushed.
+ */
+static int tcpip_read_local(struct TcpipSocket *tcpSocket) {
+	struct ShmRing *ring = tcpSocket->reader->in;
+	uint64_t events;
+	unsigned char header[3];
+	while (read(tcpSocket->read_sockfd, &events, sizeof(events)) == -1 && errno == EINTR);
+	if (tcpSocket->reader->stalled != NULL) tcpip_flush(tcpSocket);
+	uint32_t tail = ring->tail;
+	while (1) {
+		uint32_t available = ring->head - tail;
+		__sync_synchronize();
+		if (available < 3) break;
+		shm_ring_copy(ring, tail, header, 3);
+		int length = (header[1] << 8) | header[2];
+		if (header[0] != TCPIP_FRAME_MARKER || length < 2 || length > MAX_FRAME_SIZE) {
+			tcpip_lost(tcpSocket, EPROTO);
+			return -1;
+		}
+		if (available < 3 + (uint32_t)length) break;
+		struct TcpipMessage *msg = tcpip_new_msg(length);
+		if (msg != NULL) shm_ring_copy(ring, tail + 3, msg->payload, length);
+		tail += 3 + length;
+		__sync_synchronize();
+		ring->tail = tail;
+		tcpip_frame_received(tcpSocket, msg);
+	}
+	__sync_synchronize();
+	if (ring->waiting) {
+		ring->waiting = 0;
+		shm_notify(tcpSocket);
+	}
+	return 0;
+}
+
+/**
+ * Writes whole frames into the outgoing ring and wakes up the receiver, a frame is its
+ * header and its message, two elements of the vector. When a frame does not fit, the ring
+ * is marked as waiting and the frames from there on are left for the next flush. Returns
+ * the amount of frames that are written.
+ */
+static int tcpip_write_local(struct TcpipSocket *tcpSocket, struct iovec *iov, int iovcnt) {
+	struct ShmRing *ring = tcpSocket->reader->out;
+	uint32_t head = ring->head, size;
+	int frames = 0;
+	for (; iovcnt >= 2; iov += 2, iovcnt -= 2) {
+		size = iov[0].iov_len + iov[1].iov_len;
+		if (SHM_RING_SIZE - (head - ring->tail) < size) {
+			ring->waiting = 1;
+			__sync_synchronize();
+			//the receiver may have made room before it could see the mark
+			if (SHM_RING_SIZE - (head - ring->tail) < size) break;
+		}
+		__sync_synchronize();
+		shm_ring_put(ring, head, (unsigned char*)iov[0].iov_base, iov[0].iov_len);
+		shm_ring_put(ring, head + iov[0].iov_len, (unsigned char*)iov[1].iov_base,
+				iov[1].iov_len);
+		head += size;
+		__sync_synchronize();
+		ring->head = head;
+		frames++;
+	}
+	if (frames) shm_notify(tcpSocket);
+	return frames;
+}
+
+static void tcpip_close_local(struct TcpipSocket *tcpSocket) {
+	struct TcpipReader *reader = tcpSocket->reader;
+	if (reader->segment == NULL) return;
+	close(tcpSocket->read_sockfd);
+	close(tcpSocket->write_sockfd);
+	munmap(reader->segment, sizeof(struct ShmSegment));
+	reader->segment = NULL;
+	reader->in = reader->out = NULL;
+}
+
+/************************************************************************************************
+ *                      Function implementations
+ ************************************************************************************************
+ *
+ *  For multicast channels
+ *
+ * A multicast channel has no connection and no frames, a datagram is one message. The sender
+ * connects its socket to the group, so a flush writes its messages with one sendmmsg. A
+ * receiver binds the port, with SO_REUSEADDR, so that all processes on one machine can join
+ * the same group. Nothing is repaired over here, that is up to the protocol on top.
+ *
+ ***********************************************************************************************/
+
+/**
+ * Joins the group in cli_addr for a receiver, or connects to the group in serv_addr for a
+ * sender. Only a receiver is watched by the reactor.
+ */
+static void *tcpip_start_multicast(void *context) {
+	struct TcpipSocket *tcpSocket = (struct TcpipSocket*)context;
+	int server = RAISED(tcpSocket->status, TCP_SERVER) != 0, yes = 1;
+	int room = MULTICAST_RECEIVE_BUFFER;
+	unsigned char ttl = 1;
+	struct sockaddr_in addr;
+	struct ip_mreq mreq;
+	int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (fd == -1) {
+		tprintf(LOG_ERR, __func__, "At socket(SOCK_DGRAM) there was an error...");
+		return NULL;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(tcpSocket->port_nr);
+	if (server) {
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+		mreq.imr_multiaddr = tcpSocket->cli_addr.sin_addr;
+		mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+		//a burst of datagrams that does not fit is lost, the kernel may allow less though
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &room, sizeof(room));
+		if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) == -1 ||
+				bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 ||
+				setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) == -1)
+			goto multicast_error;
+	} else {
+		addr.sin_addr = tcpSocket->serv_addr.sin_addr;
+		//the group is not meant to leave the local network
+		setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+		if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+			goto multicast_error;
+	}
+	tcpSocket->serv_sockfd = fd;
+	tcpSocket->cli_sockfd = -1;
+	tcpSocket->read_sockfd = fd;
+	tcpSocket->write_sockfd = fd;
+	TPRINTF(LOG_VERBOSE, "Multicast channel to %s on port %i", inet_ntoa(server ?
+			tcpSocket->cli_addr.sin_addr : tcpSocket->serv_addr.sin_addr), tcpSocket->port_nr);
+	if (server) tcpip_retrieve_packets((void*)tcpSocket);
+	if (tcpSocket->callbackConnect != NULL)
+		tcpip_dispatch(tcpip_call_connect, tcpSocket, "multicast started",
+				ABBEY_PRIORITY_NORMAL, 0);
+	return NULL;
+
+multicast_error:
+	TPRINTF(LOG_ERR, "Can not set up multicast on port %i, error code %i!",
+			tcpSocket->port_nr, errno);
+	close(fd);
+	return NULL;
+}
+
+/**
+ * Delivers the datagrams that are available. Datagrams that can not be a message are
+ * dropped. An error does not stop the channel, there is no connection to lose.
+ */
+static int tcpip_read_datagrams(struct TcpipSocket *tcpSocket) {
+	struct TcpipReader *reader = tcpSocket->reader;
+	int nofbytes;
+	if (reader->buffer == NULL) {
+		reader->buffer = malloc(READ_BUFFER_SIZE);
+		if (reader->buffer == NULL) return 0;
+	}
+	while (1) {
+		nofbytes = recv(tcpSocket->read_sockfd, reader->buffer, TCPIP_DATAGRAM_MAX_SIZE + 1,
+				MSG_DONTWAIT);
+		if (nofbytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+		if (nofbytes == -1 && errno == EINTR) continue;
+		if (nofbytes == -1) {
+			TPRINTF(LOG_ERR, "Error with error code %i!", errno);
+			return 0;
+		}
+		if (nofbytes < 2 || nofbytes > TCPIP_DATAGRAM_MAX_SIZE) {
+			TPRINTF(LOG_WARNING, "Datagram of size %i is dropped", nofbytes);
+			continue;
+		}
+		tcpip_frame_received(tcpSocket, tcpip_frame_message(reader->buffer, nofbytes,
+				nofbytes));
+	}
+}
+
+/**
+ * Sends every element of the vector as a datagram of its own. Returns -1 if sendmmsg
+ * fails, or 1 if everything is sent.
+ */
+static int tcpip_write_datagrams(int fd, struct iovec *iov, int iovcnt) {
+	struct mmsghdr mm[TCPIP_FLUSH_BATCH];
+	int i, retval;
+	if (iovcnt > TCPIP_FLUSH_BATCH) return -1;
+	memset(mm, 0, iovcnt * sizeof(struct mmsghdr));
+	for (i = 0; i < iovcnt; i++) {
+		mm[i].msg_hdr.msg_iov = &iov[i];
+		mm[i].msg_hdr.msg_iovlen = 1;
+	}
+	for (i = 0; i < iovcnt; i += retval) {
+		retval = sendmmsg(fd, mm + i, iovcnt - i, 0);
+		if (retval == -1 && errno == EINTR) retval = 0;
+		else if (retval <= 0) return -1;
+	}
+	return 1;
 }
 
 /************************************************************************************************
@@ -538,9 +1601,7 @@ void tprintmsg(struct TcpipMessage *msg, uint8_t verbosity) {
  * Create some message
  */
 struct TcpipMessage *templateMsg() {
-	struct TcpipMessage *msg = malloc(sizeof (struct TcpipMessage *));
-	msg->payload = calloc(MAX_PACKET_SIZE-1, sizeof(unsigned char));
-	msg->size = 5;
+	struct TcpipMessage *msg = tcpip_alloc_msg(5);
 	int i;
 	for (i=0;i<msg->size;i++) {
 		msg->payload[i] = i * 10;
@@ -4,56 +4,116 @@
  * connection is stored in a TcpipSocket struct, nothing in local variables. If every monk
  * does have its own socket to handle, that struct can be stored in thread-specific data keys.
  * The compiler is called with the "-qtls" flag to obtain this thread-local storage possibility.
+ *
+ * The bank is a table of socket pointers indexed by channel id, in pages of 256 entries.
+ * The first page, for the ids that fit in a byte, is always there, the others are allocated
+ * when an id in them is added. Pages are never freed. So a lookup is a load of the page and
+ * a load of the entry, without a lock, while channels are added and deleted by any monk.
+ * The bank holds a reference to every socket in it, a deleted socket is freed when the last
+ * task that holds it releases it, see tcpip.h. Taking a reference from the bank and deleting
+ * a channel take the lock, so a socket that is found in the bank is not freed meanwhile.
  * 
  * @see http://people.redhat.com/drepper/tls.pdf
  */
 
 #include <tcpipbank.h>
+#include <log.h>
 #include <stdlib.h>
+#include <pthread.h>
+
+#define TCPIPBANK_PAGE_SIZE		256
+#define TCPIPBANK_PAGE_COUNT	(TCPIPBANK_MAX_ID / TCPIPBANK_PAGE_SIZE)
+
+typedef struct TcpipSocket *volatile TcpipbankEntry;
+
+static TcpipbankEntry firstPage[TCPIPBANK_PAGE_SIZE];
+static TcpipbankEntry *volatile pages[TCPIPBANK_PAGE_COUNT] = { firstPage };
+static pthread_mutex_t bankMutex = PTHREAD_MUTEX_INITIALIZER;
 
 /**
  * This routine is called by a separate thread. It initializes a TcpipSocket struct, which 
  * will be thread specific (using the __thread keyword). The bucket brigade from incoming
- * to outgoing mailboxes needs to cross thread boundaries.  
+ * to outgoing mailboxes needs to cross thread boundaries. The bank itself needs no
+ * initialization anymore.
  */
 void initSockets() {
-	sockets.first = sockets.last = NULL;
 }
 
-void tcpipbank_add(struct TcpipSocket *sock, uint8_t id) {
-	struct TcpipSocket_LI* lisock = sockets.last;
-	if (lisock == NULL) {
-		sockets.first = sockets.last = lisock = malloc(sizeof(struct TcpipSocket_LI));
-	} else {
-		sockets.last = sockets.last->next = lisock = malloc(sizeof(struct TcpipSocket_LI));
+/**
+ * Returns the entry of an id, the page is allocated if create is set.
+ */
+static TcpipbankEntry *tcpipbank_entry(unsigned int id, int create) {
+	TcpipbankEntry *page;
+	if (id >= TCPIPBANK_MAX_ID) return NULL;
+	page = pages[id / TCPIPBANK_PAGE_SIZE];
+	if (page == NULL && create) {
+		TcpipbankEntry *fresh = calloc(TCPIPBANK_PAGE_SIZE, sizeof(TcpipbankEntry));
+		if (fresh == NULL) return NULL;
+		if (__sync_bool_compare_and_swap(&pages[id / TCPIPBANK_PAGE_SIZE], NULL, fresh)) {
+			page = fresh;
+		} else {
+			free((void*)fresh);
+			page = pages[id / TCPIPBANK_PAGE_SIZE];
+		}
 	}
-	lisock->id = id;
-	lisock->item = sock;
-	lisock->next = NULL;
+	return page == NULL ? NULL : &page[id % TCPIPBANK_PAGE_SIZE];
 }
 
-void tcpipbank_del(uint8_t id) {
-	struct TcpipSocket_LI* lsock = sockets.first;
-
-	while (lsock != NULL) {
-		if (lsock->id == id) {
-			//do a lot beforehand
-			free (lsock->item);
-		}
-		lsock = lsock->next;
+/**
+ * Adds a socket under the given id. Returns -1 if there is a socket with that id already,
+ * then nothing is changed, so of two monks adding the same channel only one succeeds.
+ */
+int tcpipbank_add(struct TcpipSocket *sock, unsigned int id) {
+	TcpipbankEntry *entry = tcpipbank_entry(id, 1);
+	if (entry == NULL || !__sync_bool_compare_and_swap(entry, NULL, sock)) {
+		TPRINTF(LOG_WARNING, "Channel %u can not be added", id);
+		return -1;
 	}
+	return 0;
 }
 
-struct TcpipSocket* tcpipbank_get(uint8_t id) {
-	struct TcpipSocket_LI* lsock = sockets.first;
+/**
+ * Removes the socket with the given id from the bank, closes it and releases the reference
+ * of the bank. Tasks that still hold the socket can use it until they release it, but their
+ * messages will not arrive.
+ */
+void tcpipbank_del(unsigned int id) {
+	TcpipbankEntry *entry = tcpipbank_entry(id, 0);
+	if (entry == NULL) return;
+	pthread_mutex_lock(&bankMutex);
+	struct TcpipSocket *sock = __sync_lock_test_and_set(entry, NULL);
+	pthread_mutex_unlock(&bankMutex);
+	if (sock == NULL) return;
+	tcpip_close_all(sock);
+	tcpip_release(sock);
+}
 
-	while (lsock != NULL) {
-		if (lsock->id == id) {
-			return lsock->item;
-		}
-		lsock = lsock->next;
-	}
-	return NULL;
+struct TcpipSocket* tcpipbank_hold(unsigned int id) {
+	TcpipbankEntry *entry = tcpipbank_entry(id, 0);
+	struct TcpipSocket *sock;
+	if (entry == NULL) return NULL;
+	pthread_mutex_lock(&bankMutex);
+	sock = *entry;
+	if (sock != NULL) tcpip_hold(sock);
+	pthread_mutex_unlock(&bankMutex);
+	return sock;
 }
 
+struct TcpipSocket* tcpipbank_get(unsigned int id) {
+	TcpipbankEntry *page;
+	if (id >= TCPIPBANK_MAX_ID) return NULL;
+	page = pages[id / TCPIPBANK_PAGE_SIZE];
+	return page == NULL ? NULL : page[id % TCPIPBANK_PAGE_SIZE];
+}
 
+unsigned int tcpipbank_ids(unsigned int *ids, unsigned int max) {
+	unsigned int i, j, n = 0;
+	for (i = 0; i < TCPIPBANK_PAGE_COUNT && n < max; i++) {
+		TcpipbankEntry *page = pages[i];
+		if (page == NULL) continue;
+		for (j = 0; j < TCPIPBANK_PAGE_SIZE && n < max; j++) {
+			if (page[j] != NULL) ids[n++] = i * TCPIPBANK_PAGE_SIZE + j;
+		}
+	}
+	return n;
+}
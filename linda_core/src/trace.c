@@ -0,0 +1,270 @@
+/**
+ * @file trace.c
+ *
+ * The tracer records events into a buffer of the calling thread, without a lock. A full
+ * buffer is formatted and appended to the trace file by the thread that owns it, under
+ * the file lock. The buffer of a thread that exits is flushed by that thread, the others
+ * are flushed by linda_trace_stop, which is also called at exit.
+ *
+ * The file is in the JSON array format of the Chrome trace viewer. It starts with "[" and
+ * every event is followed by a comma, in that format the closing bracket is optional, so
+ * the trace of a process that crashed can still be loaded.
+ *
+ * @date_created    Oct 14, 2026
+ * @date_modified   Oct 14, 2026
+ * @author          Anne C. van Rossum
+ * @project         Replicator
+ * @company         Almende B.V.
+ * @license         open-source, GNU Lesser General Public License
+ */
+
+#include <trace.h>
+#include <ptreaty.h>
+#include <log.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+//! Amount of events in the buffer of a thread
+#define TRACE_BUFFER_SIZE	4096
+
+#define TRACE_SPAN		0
+#define TRACE_MESSAGE	1
+
+/***********************************************************************************************
+ *
+ * @name trace_structs
+ *
+ ***********************************************************************************************/
+
+struct TraceEvent {
+	unsigned long long ts;
+	unsigned long long dur;
+	const char *name;
+	const char *category;
+	uint8_t kind;
+	uint8_t direction;
+	uint8_t type;
+	uint8_t from;
+	uint8_t to;
+	int size;
+};
+
+struct TraceBuffer {
+	struct TraceEvent event[TRACE_BUFFER_SIZE];
+	int count;
+	long tid;
+	struct TraceBuffer *next;
+};
+
+volatile uint8_t lindaTraceEnabled = 0;
+
+static FILE *traceFile;
+static int tracePid;
+static struct TraceBuffer *buffers;
+static pthread_mutex_t traceMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t traceKey;
+static pthread_once_t traceOnce = PTHREAD_ONCE_INIT;
+static __thread struct TraceBuffer *buffer;
+
+/***********************************************************************************************
+ *
+ * @name trace_internals
+ *
+ ***********************************************************************************************/
+
+/**
+ * Writes a string in JSON, only quotes and backslashes are escaped, control characters are
+ * left out.
+ */
+static void write_string(const char *s) {
+	fputc('"', traceFile);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\') fputc('\\', traceFile);
+		if ((unsigned char)*s >= ' ') fputc(*s, traceFile);
+	}
+	fputc('"', traceFile);
+}
+
+/**
+ * Formats the events in the buffer into the trace file. Must be called with the trace lock.
+ */
+static void flush_buffer(struct TraceBuffer *b) {
+	int i;
+	if (traceFile == NULL) return;
+	for (i = 0; i < b->count; i++) {
+		struct TraceEvent *e = &b->event[i];
+		switch (e->kind) {
+		case TRACE_SPAN:
+			fprintf(traceFile, "{\"name\":");
+			write_string(e->name);
+			fprintf(traceFile, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+					"\"pid\":%i,\"tid\":%li},\n", e->category, e->ts / 1000.0, e->dur / 1000.0,
+					tracePid, b->tid);
+			break;
+		case TRACE_MESSAGE:
+			fprintf(traceFile, "{\"name\":\"%s %i\",\"cat\":\"message\",\"ph\":\"i\",\"s\":\"t\","
+					"\"ts\":%.3f,\"pid\":%i,\"tid\":%li,\"args\":{\"type\":%i,\"from\":%i,"
+					"\"to\":%i,\"size\":%i}},\n",
+					e->direction == LINDA_TRACE_SEND ? "send" : "receive", e->type,
+					e->ts / 1000.0, tracePid, b->tid, e->type, e->from, e->to, e->size);
+			break;
+		}
+	}
+	b->count = 0;
+	fflush(traceFile);
+}
+
+/**
+ * A thread that exits flushes its own buffer.
+ */
+static void release_buffer(void *arg) {
+	struct TraceBuffer *b = (struct TraceBuffer*)arg, **prev;
+	pthread_mutex_lock(&traceMutex);
+	flush_buffer(b);
+	for (prev = &buffers; *prev != NULL; prev = &(*prev)->next) {
+		if (*prev == b) {
+			*prev = b->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&traceMutex);
+	free(b);
+}
+
+static void trace_init_key() {
+	pthread_key_create(&traceKey, release_buffer);
+}
+
+/**
+ * Returns a free event in the buffer of this thread. The first event of a thread
+ * announces its name.
+ */
+static struct TraceEvent *next_event() {
+	if (buffer == NULL) {
+		buffer = malloc(sizeof(struct TraceBuffer));
+		if (buffer == NULL) return NULL;
+		buffer->count = 0;
+		buffer->tid = syscall(SYS_gettid);
+		pthread_setspecific(traceKey, buffer);
+		pthread_mutex_lock(&traceMutex);
+		buffer->next = buffers;
+		buffers = buffer;
+		if (traceFile != NULL) {
+			fprintf(traceFile, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%i,\"tid\":%li,"
+					"\"args\":{\"name\":", tracePid, buffer->tid);
+			write_string(ptreaty_thread_name());
+			fprintf(traceFile, "}},\n");
+		}
+		pthread_mutex_unlock(&traceMutex);
+	}
+	if (buffer->count == TRACE_BUFFER_SIZE) {
+		pthread_mutex_lock(&traceMutex);
+		flush_buffer(buffer);
+		pthread_mutex_unlock(&traceMutex);
+	}
+	return &buffer->event[buffer->count++];
+}
+
+/***********************************************************************************************
+ *
+ * @name trace_functions
+ *
+ ***********************************************************************************************/
+
+/**
+ * Starts tracing if the LINDA_TRACE environment variable is set, with the directory to
+ * write the trace file to. Returns 0 if tracing is not requested.
+ */
+int linda_trace_init(const char *process) {
+	const char *directory = getenv("LINDA_TRACE");
+	if (directory == NULL || directory[0] == 0) return 0;
+	return linda_trace_start(directory, process);
+}
+
+/**
+ * Starts tracing into the given directory, the process name is used for the file name and
+ * shown in the timeline.
+ */
+int linda_trace_start(const char *directory, const char *process) {
+	char path[256], text[320];
+	if (lindaTraceEnabled) return 0;
+	pthread_once(&traceOnce, trace_init_key);
+	tracePid = getpid();
+	snprintf(path, sizeof(path), "%s/trace-%s-%i.json", directory, process, tracePid);
+	pthread_mutex_lock(&traceMutex);
+	traceFile = fopen(path, "w");
+	if (traceFile == NULL) {
+		pthread_mutex_unlock(&traceMutex);
+		sprintf(text, "Can not open trace file %s", path);
+		tprintf(LOG_ERR, __func__, text);
+		return -1;
+	}
+	fprintf(traceFile, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%i,\"args\":{\"name\":",
+			tracePid);
+	write_string(process);
+	fprintf(traceFile, "}},\n");
+	pthread_mutex_unlock(&traceMutex);
+	lindaTraceEnabled = 1;
+	atexit(linda_trace_stop);
+	sprintf(text, "Trace to %s", path);
+	tprintf(LOG_INFO, __func__, text);
+	return 0;
+}
+
+/**
+ * Stops tracing, flushes the buffers of all threads and closes the file. Events that are
+ * recorded by other threads at this very moment may be lost.
+ */
+void linda_trace_stop() {
+	struct TraceBuffer *b;
+	if (!lindaTraceEnabled) return;
+	lindaTraceEnabled = 0;
+	pthread_mutex_lock(&traceMutex);
+	for (b = buffers; b != NULL; b = b->next) {
+		flush_buffer(b);
+	}
+	if (traceFile != NULL) {
+		fprintf(traceFile, "{\"name\":\"trace_end\",\"ph\":\"i\",\"s\":\"p\",\"ts\":%.3f,"
+				"\"pid\":%i}\n]\n", linda_trace_clock_ns() / 1000.0, tracePid);
+		fclose(traceFile);
+		traceFile = NULL;
+	}
+	pthread_mutex_unlock(&traceMutex);
+}
+
+/**
+ * The clock of the trace, the same as the one of the abbey statistics.
+ */
+unsigned long long linda_trace_clock_ns() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void linda_trace_span(const char *name, const char *category, unsigned long long start_ns,
+		unsigned long long end_ns) {
+	struct TraceEvent *e = next_event();
+	if (e == NULL) return;
+	e->kind = TRACE_SPAN;
+	e->name = (name == NULL || name[0] == 0) ? "(task)" : name;
+	e->category = category;
+	e->ts = start_ns;
+	e->dur = end_ns > start_ns ? end_ns - start_ns : 0;
+}
+
+void linda_trace_message(uint8_t direction, const unsigned char *payload, int size) {
+	struct TraceEvent *e = next_event();
+	if (e == NULL) return;
+	e->kind = TRACE_MESSAGE;
+	e->ts = linda_trace_clock_ns();
+	e->direction = direction;
+	e->type = size > 0 ? payload[0] : 0;
+	e->from = size > 2 ? payload[2] : 0;
+	e->to = size > 3 ? payload[3] : 0;
+	e->size = size;
+}
@@ -0,0 +1,578 @@
+/**
+ * @file benchLinda.c
+ * @brief Microbenchmarks of the abbey and the colinda engine
+ * @author Anne C. van Rossum
+ *
+ * Every benchmark runs BENCH_WARMUP times untimed and then BENCH_REPEATS times, and the
+ * median of the timed runs is reported, so one run that is preempted does not count. All
+ * random input is drawn from LindaRandom streams, see prng.h, seeded by LINDA_BENCH_SEED (1
+ * by default) and a stream per benchmark, and rand() is seeded by it as well, so two versions
+ * of the engine get the same genomes, networks and spikes and their results can be compared.
+ *
+ * The benchmarks are:
+ *  - abbey_dispatch: tasks from the main thread that are run by 1 up to BENCH_MONKS monks,
+ *    the other monks are reserved for realtime tasks, so they stand by
+ *  - abbey_latency: the time from the dispatch of a task until a monk picks it up, with one
+ *    task at a time
+ *  - mailbox: a push and a pop of a message
+ *  - extract_genes: extraction of the genes of a genome of BENCH_GENOME_SIZE codons
+ *  - update_grid: one step of the concentrations, on several grid sizes and product counts
+ *  - develop_network: developNeuralNetwork of random genomes, with embryogeny
+ *  - run_network: ticks of networks built from frames, see netframe.h, with a given amount
+ *    of neurons and synapses, compiled and over the pointers, as the reference
+ *  - count_spikes, fill_spikes, interpret_spikes: reading an AER buffer of spikes, the
+ *    buffer has to be filled again before every interpretation, which is fill_spikes
+ *
+ * The results go to stdout, as JSON, or as CSV with LINDA_BENCH_FORMAT set to "csv". Every
+ * result has the parameters of the benchmark, the amount of operations of a run, the median
+ * nanoseconds of a run and the figure that is tracked, in its unit. The log goes to syslog.
+ */
+
+//#define BENCH_LINDA
+
+#ifdef BENCH_LINDA
+
+#include <lindaconfig.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <pthread.h>
+#include <time.h>
+#include <genome.h>
+#include <grid.h>
+#include <embryogeny.h>
+#include <topology.h>
+#include <neuron.h>
+#include <sensorimotor.h>
+#include <netframe.h>
+#include <colinda.h>
+
+#include <linda/log.h>
+#include <linda/ptreaty.h>
+#include <linda/abbey.h>
+#include <linda/tcpip.h>
+#include <linda/prng.h>
+
+#define BENCH_WARMUP		1
+#define BENCH_REPEATS		5
+#define BENCH_MAX_RESULTS	128
+#define BENCH_MONKS			8
+#define BENCH_TASKS			200000
+#define BENCH_PINGS			2000
+#define BENCH_MESSAGES		4096
+#define BENCH_GENOME_SIZE	60000
+#define BENCH_GENOMES		20
+#define BENCH_DEVELOP_SIZE	3000
+#define BENCH_GRID_STEPS	200
+#define BENCH_TICKS			1000
+#define BENCH_READS			2000
+
+struct BenchResult {
+	const char *name;
+	//! Pairs of a key and a number, separated by spaces
+	char params[64];
+	uint32_t ops;
+	uint64_t ns;
+	double value;
+	const char *unit;
+};
+
+static struct BenchResult results[BENCH_MAX_RESULTS];
+static uint16_t result_count = 0;
+static uint64_t seed = 1;
+
+/**
+ * A benchmark run, which returns the amount of nanoseconds it took.
+ */
+typedef uint64_t (*bench_run)(void *context);
+
+static uint64_t now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int compare_ns(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * The median of the timed runs, after the warmup.
+ */
+static uint64_t measure(bench_run run, void *context) {
+	uint64_t ns[BENCH_REPEATS];
+	uint8_t i;
+	for (i = 0; i < BENCH_WARMUP; i++) run(context);
+	for (i = 0; i < BENCH_REPEATS; i++) ns[i] = run(context);
+	qsort(ns, BENCH_REPEATS, sizeof(uint64_t), compare_ns);
+	return ns[BENCH_REPEATS / 2];
+}
+
+/**
+ * Keeps a result, the value is the operations per second, or with per_op the nanoseconds per
+ * operation, times the given scale.
+ */
+static void report(const char *name, const char *params, uint32_t ops,
+		uint64_t ns, uint8_t per_op, double scale, const char *unit) {
+	if (result_count == BENCH_MAX_RESULTS) return;
+	struct BenchResult *r = &results[result_count++];
+	r->name = name;
+	snprintf(r->params, sizeof(r->params), "%s", params);
+	r->ops = ops;
+	r->ns = ns;
+	if (!ns) ns = 1;
+	r->value = scale * (per_op ? (double)ns / ops : ops * 1e9 / ns);
+	r->unit = unit;
+}
+
+/**
+ * The parameters as the members of a JSON object, "neurons=25 synapses=100" becomes
+ * "neurons":25,"synapses":100.
+ */
+static void printJsonParams(const char *params) {
+	char key[32], value[32];
+	int used;
+	uint8_t first = 1;
+	while (sscanf(params, " %31[^=]=%31s%n", key, value, &used) == 2) {
+		printf("%s\"%s\":%s", first ? "" : ",", key, value);
+		first = 0;
+		params += used;
+	}
+}
+
+static void printResults(uint8_t csv) {
+	uint16_t i;
+	if (csv) {
+		printf("bench,params,ops,ns,value,unit\n");
+		for (i = 0; i < result_count; i++) {
+			struct BenchResult *r = &results[i];
+			printf("%s,%s,%u,%llu,%.3f,%s\n", r->name, r->params, r->ops,
+					(unsigned long long)r->ns, r->value, r->unit);
+		}
+		return;
+	}
+	printf("{\"seed\":%llu,\"warmup\":%i,\"repeats\":%i,\"results\":[\n",
+			(unsigned long long)seed, BENCH_WARMUP, BENCH_REPEATS);
+	for (i = 0; i < result_count; i++) {
+		struct BenchResult *r = &results[i];
+		printf("{\"bench\":\"%s\",\"params\":{", r->name);
+		printJsonParams(r->params);
+		printf("},\"ops\":%u,\"ns\":%llu,\"value\":%.3f,\"unit\":\"%s\"}%s\n", r->ops,
+				(unsigned long long)r->ns, r->value, r->unit, i + 1 < result_count ? "," : "");
+	}
+	printf("]}\n");
+}
+
+/****************************************************************************************************
+ *  		Abbey
+ ***************************************************************************************************/
+
+static const struct AbbeyTaskDescriptor *count_descriptor;
+static volatile long tasks_done;
+static volatile uint64_t picked_at;
+
+void *count_task(void *context) {
+	__sync_add_and_fetch(&tasks_done, 1);
+	return NULL;
+}
+
+void *ping_task(void *context) {
+	picked_at = now_ns();
+	return NULL;
+}
+
+static uint64_t runDispatch(void *context) {
+	long i;
+	tasks_done = 0;
+	uint64_t start = now_ns();
+	for (i = 0; i < BENCH_TASKS; i++) {
+		dispatch_descriptor_task(count_descriptor, NULL);
+	}
+	while (tasks_done < BENCH_TASKS) sched_yield();
+	return now_ns() - start;
+}
+
+/**
+ * Sums the latencies of the pings, instead of the time of the run.
+ */
+static uint64_t runLatency(void *context) {
+	uint64_t latency = 0, dispatched;
+	uint16_t i;
+	for (i = 0; i < BENCH_PINGS; i++) {
+		picked_at = 0;
+		dispatched = now_ns();
+		dispatch_task(ping_task, NULL);
+		while (!picked_at) sched_yield();
+		latency += picked_at - dispatched;
+	}
+	return latency;
+}
+
+static void benchAbbey() {
+	char params[64];
+	uint8_t monks;
+	initialize_abbey(BENCH_MONKS, 10);
+	count_descriptor = abbey_register_task(count_task, "count", ABBEY_PRIORITY_NORMAL);
+	for (monks = 1; monks <= BENCH_MONKS; monks *= 2) {
+		abbey_reserve_monks(BENCH_MONKS - monks, ABBEY_PRIORITY_REALTIME);
+		snprintf(params, sizeof(params), "monks=%i", monks);
+		report("abbey_dispatch", params, BENCH_TASKS, measure(runDispatch, NULL), 0, 1,
+				"tasks/s");
+		report("abbey_latency", params, BENCH_PINGS, measure(runLatency, NULL), 1, 1,
+				"ns/task");
+	}
+	abbey_reserve_monks(0, ABBEY_PRIORITY_REALTIME);
+}
+
+/****************************************************************************************************
+ *  		Mailbox
+ ***************************************************************************************************/
+
+static struct TcpipMessage *messages[BENCH_MESSAGES];
+
+static uint64_t runMailbox(void *context) {
+	struct TcpipMailbox *mailbox = context;
+	uint16_t i;
+	uint64_t start = now_ns();
+	for (i = 0; i < BENCH_MESSAGES; i++) push(mailbox, messages[i]);
+	for (i = 0; i < BENCH_MESSAGES; i++) pop(mailbox);
+	return now_ns() - start;
+}
+
+static void benchMailbox() {
+	struct TcpipMailbox mailbox;
+	uint16_t i;
+	tcpip_init_mailbox(&mailbox);
+	for (i = 0; i < BENCH_MESSAGES; i++) messages[i] = tcpip_alloc_msg(16);
+	report("mailbox", "messages=4096", BENCH_MESSAGES, measure(runMailbox, &mailbox), 1, 1,
+			"ns/message");
+	for (i = 0; i < BENCH_MESSAGES; i++) freemsg(messages[i]);
+}
+
+/****************************************************************************************************
+ *  		Colinda
+ ***************************************************************************************************/
+
+static void randomGenome(Codon *content, uint16_t size, uint64_t stream) {
+	struct LindaRandom random;
+	uint16_t i;
+	linda_random_seed(&random, seed, stream);
+	for (i = 0; i < size; i++) content[i] = linda_random_next(&random);
+}
+
+/**
+ * The extraction writes in the genome, so it is copied from the original first, which is
+ * not timed.
+ */
+static uint64_t runExtraction(void *context) {
+	uint64_t start;
+	memcpy(clctx->dna->content, context, BENCH_GENOME_SIZE * sizeof(Codon));
+	start = now_ns();
+	if (clctx->eg->genes != NULL) freeGenes();
+	initGeneExtraction();
+	extractGenes(BENCH_GENOME_SIZE);
+	return now_ns() - start;
+}
+
+static void benchExtraction() {
+	Codon *genome = malloc(BENCH_GENOME_SIZE * sizeof(Codon));
+	randomGenome(genome, BENCH_GENOME_SIZE, 1);
+	char params[64];
+	snprintf(params, sizeof(params), "codons=%i", BENCH_GENOME_SIZE);
+	report("extract_genes", params, BENCH_GENOME_SIZE * sizeof(Codon),
+			measure(runExtraction, genome), 0, 1e-6, "MB/s");
+	free(genome);
+}
+
+/**
+ * Extracts and develops the random genome of the given stream.
+ */
+static void developGenome(uint32_t stream) {
+	randomGenome(clctx->dna->content, BENCH_DEVELOP_SIZE, stream);
+	srand(seed + stream);
+	if (clctx->eg->genes != NULL) freeGenes();
+	initGeneExtraction();
+	extractGenes(BENCH_DEVELOP_SIZE);
+	developNeuralNetwork();
+}
+
+static uint64_t runGrid(void *context) {
+	uint16_t i;
+	initConcentrations();
+	uint64_t start = now_ns();
+	for (i = 0; i < BENCH_GRID_STEPS; i++) updateGrid();
+	return now_ns() - start;
+}
+
+/**
+ * The grid of a developed genome, with more products than the genes use for the larger
+ * product counts, those only decay and diffuse.
+ */
+static void benchGrid() {
+	static const char *sizes[] = { "5x5", "10x10", "20x20", "40x40" };
+	static const uint8_t products[] = { 25, 64, 128 };
+	char params[64];
+	uint8_t i, j;
+	for (i = 0; i < 4; i++) {
+		setenv("LINDA_GRID", sizes[i], 1);
+		developGenome(2);
+		for (j = 0; j < 3; j++) {
+			clctx->gconf->phenotypicFactors = products[j] - clctx->gconf->regulatingFactors;
+			snprintf(params, sizeof(params), "rows=%i columns=%i products=%i", clctx->s->rows,
+					clctx->s->columns, products[j]);
+			report("update_grid", params, BENCH_GRID_STEPS, measure(runGrid, NULL), 1, 1e-3,
+					"us/step");
+		}
+	}
+	unsetenv("LINDA_GRID");
+}
+
+static uint64_t runDevelopment(void *context) {
+	uint32_t *neurons = context;
+	uint16_t i;
+	uint64_t ns = 0, start;
+	*neurons = 0;
+	for (i = 0; i < BENCH_GENOMES; i++) {
+		randomGenome(clctx->dna->content, BENCH_DEVELOP_SIZE, 100 + i);
+		srand(seed + 100 + i);
+		if (clctx->eg->genes != NULL) freeGenes();
+		initGeneExtraction();
+		extractGenes(BENCH_DEVELOP_SIZE);
+		start = now_ns();
+		developNeuralNetwork();
+		ns += now_ns() - start;
+		*neurons += clctx->cn->neuron_count;
+	}
+	return ns;
+}
+
+static void benchDevelopment() {
+	char params[64];
+	uint32_t neurons;
+	uint64_t ns = measure(runDevelopment, &neurons);
+	snprintf(params, sizeof(params), "codons=%i neurons=%.1f", BENCH_DEVELOP_SIZE,
+			(float)neurons / BENCH_GENOMES);
+	report("develop_network", params, BENCH_GENOMES, ns, 1, 1e-6, "ms/network");
+}
+
+static uint8_t *put16(uint8_t *p, uint16_t value) {
+	p[0] = value >> 8; p[1] = value;
+	return p + 2;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t value) {
+	p[0] = value >> 24; p[1] = value >> 16; p[2] = value >> 8; p[3] = value;
+	return p + 4;
+}
+
+static uint8_t *putFloat(uint8_t *p, float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, 4);
+	return put32(p, bits);
+}
+
+/**
+ * A frame of regular spiking neurons on the first cells of the grid, every one with the given
+ * amount of synapses to random neurons. A fifth of the neurons are outputs.
+ */
+static uint8_t *randomFrame(uint8_t rows, uint8_t columns, uint16_t neurons,
+		uint16_t synapses, uint32_t *size) {
+	struct LindaRandom random;
+	uint16_t i, j;
+	linda_random_seed(&random, seed, 3);
+	*size = NETFRAME_HEADER + (uint32_t)neurons * NETFRAME_NEURON +
+			(uint32_t)neurons * synapses * NETFRAME_SYNAPSE;
+	uint8_t *frame = malloc(*size), *p = put32(frame, NETFRAME_MAGIC);
+	*p++ = rows;
+	*p++ = columns;
+	p = put16(p, neurons);
+	p = put32(p, (uint32_t)neurons * synapses);
+	for (i = 0; i < neurons; i++) {
+		p = put16(p, i);
+		*p++ = NEURONTYPE_TONIC_SPIKING | (i % 5 ? HIDDEN_NEURON : OUTPUT_NEURON);
+		p = put16(p, 0);
+		p = putFloat(p, -65);
+		p = putFloat(p, 0.2 * -65);
+		p = putFloat(p, 0.02);
+		p = putFloat(p, 0.2);
+		p = putFloat(p, -65);
+		p = putFloat(p, 8);
+		p = putFloat(p, 0);
+		p = put16(p, synapses);
+	}
+	for (i = 0; i < neurons; i++) {
+		for (j = 0; j < synapses; j++) {
+			p = put16(p, linda_random_below(&random, neurons));
+			*p++ = 1;
+			p = putFloat(p, 10 + linda_random_below(&random, 40));
+		}
+	}
+	return frame;
+}
+
+/**
+ * The same input spikes for all networks, on the cells with neurons.
+ */
+static union AER inputs[BENCH_TICKS][8];
+static uint8_t input_counts[BENCH_TICKS];
+
+static void randomInputs(uint8_t columns, uint16_t neurons) {
+	struct LindaRandom random;
+	uint16_t t, k;
+	linda_random_seed(&random, seed, 4);
+	for (t = 0; t < BENCH_TICKS; t++) {
+		input_counts[t] = linda_random_below(&random, 8);
+		for (k = 0; k < input_counts[t]; k++) {
+			uint16_t cell = linda_random_below(&random, neurons);
+			inputs[t][k].coordinate.x = cell % columns;
+			inputs[t][k].coordinate.y = cell / columns;
+			inputs[t][k].event = t;
+		}
+	}
+}
+
+static uint64_t runNetwork(void *context) {
+	struct AERBuffer in, out;
+	uint16_t t, k;
+	uint64_t start = now_ns();
+	for (t = 0; t < BENCH_TICKS; t++) {
+		initAER(&in); initAER(&out);
+		for (k = 0; k < input_counts[t]; k++) pushAER(&in, &inputs[t][k]);
+		while (runNeuralNetwork(&in, &out));
+	}
+	return now_ns() - start;
+}
+
+static void benchNetwork() {
+	static const uint8_t grids[] = { 10, 20, 40 };
+	static const uint16_t synapses[] = { 4, 16 };
+	char params[64];
+	uint32_t size;
+	uint8_t i, j;
+	for (i = 0; i < 3; i++) {
+		char grid[16];
+		uint16_t neurons = grids[i] * grids[i] / 2;
+		snprintf(grid, sizeof(grid), "%ix%i", grids[i], grids[i]);
+		setenv("LINDA_GRID", grid, 1);
+		randomInputs(grids[i], neurons);
+		for (j = 0; j < 2; j++) {
+			uint8_t *frame = randomFrame(grids[i], grids[i], neurons, synapses[j], &size);
+			if (!installNeuralNetwork(frame, size)) {
+				tprintf(LOG_ERR, __func__, "Frame does not fit");
+				free(frame);
+				continue;
+			}
+			free(frame);
+			snprintf(params, sizeof(params), "neurons=%i synapses=%u compiled=1", neurons,
+					(uint32_t)neurons * synapses[j]);
+			report("run_network", params, BENCH_TICKS, measure(runNetwork, NULL), 0, 1,
+					"ticks/s");
+			struct CompiledNetwork *lcn = clctx->cn;
+			clctx->cn = NULL;
+			snprintf(params, sizeof(params), "neurons=%i synapses=%u compiled=0", neurons,
+					(uint32_t)neurons * synapses[j]);
+			report("run_network", params, BENCH_TICKS, measure(runNetwork, NULL), 0, 1,
+					"ticks/s");
+			clctx->cn = lcn;
+		}
+	}
+	unsetenv("LINDA_GRID");
+}
+
+static union AER spikes[MAX_AER_TUPLES - 1];
+
+static void fillSpikes(struct AERBuffer *b) {
+	uint8_t i;
+	initAER(b);
+	for (i = 0; i < MAX_AER_TUPLES - 1; i++) pushAER(b, &spikes[i]);
+}
+
+/**
+ * Counts the spikes of every cell of a 5x5 grid.
+ */
+static uint64_t runCount(void *context) {
+	struct AERBuffer b;
+	uint16_t i;
+	uint8_t x, y;
+	volatile uint32_t total = 0;
+	fillSpikes(&b);
+	uint64_t start = now_ns();
+	for (i = 0; i < BENCH_READS; i++) {
+		for (y = 0; y < 5; y++) {
+			for (x = 0; x < 5; x++) total += count_spikes(&b, x, y);
+		}
+	}
+	return now_ns() - start;
+}
+
+static uint64_t runFill(void *context) {
+	struct AERBuffer b;
+	uint16_t i;
+	uint64_t start = now_ns();
+	for (i = 0; i < BENCH_READS; i++) fillSpikes(&b);
+	return now_ns() - start;
+}
+
+static uint64_t runInterpret(void *context) {
+	struct AERBuffer b;
+	int16_t output[16];
+	uint16_t i;
+	uint64_t start = now_ns();
+	for (i = 0; i < BENCH_READS; i++) {
+		fillSpikes(&b);
+		interpretSpikes(&b, output);
+	}
+	return now_ns() - start;
+}
+
+static void benchSpikes() {
+	struct LindaRandom random;
+	uint8_t i;
+	char params[64];
+	linda_random_seed(&random, seed, 5);
+	for (i = 0; i < MAX_AER_TUPLES - 1; i++) {
+		spikes[i].coordinate.x = linda_random_below(&random, 5);
+		spikes[i].coordinate.y = linda_random_below(&random, 5);
+		spikes[i].event = i;
+	}
+	snprintf(params, sizeof(params), "spikes=%i cells=25", MAX_AER_TUPLES - 1);
+	report("count_spikes", params, BENCH_READS * 25, measure(runCount, NULL), 1, 1, "ns/cell");
+	report("fill_spikes", params, BENCH_READS, measure(runFill, NULL), 1, 1, "ns/buffer");
+	report("interpret_spikes", params, BENCH_READS, measure(runInterpret, NULL), 1, 1,
+			"ns/buffer");
+}
+
+int main() {
+	openlog ("tlinda", LOG_CONS, LOG_LOCAL0);
+	initLog(LOG_WARNING);
+	pthread_t this = pthread_self();
+	ptreaty_add_thread(&this, "Main");
+
+	const char *text = getenv("LINDA_BENCH_SEED");
+	unsigned long long value;
+	if ((text != NULL) && (sscanf(text, "%llu", &value) == 1)) seed = value;
+	text = getenv("LINDA_BENCH_FORMAT");
+	uint8_t csv = (text != NULL) && !strcmp(text, "csv");
+	srand(seed);
+
+	benchAbbey();
+	benchMailbox();
+
+	clctx->clconf = calloc(1, sizeof(struct ColindaConfig));
+	clctx->dna = malloc(sizeof(struct Genome));
+	clctx->dna->content = malloc(BENCH_GENOME_SIZE * sizeof(Codon));
+	initGeneExtraction();
+	benchExtraction();
+	benchGrid();
+	benchDevelopment();
+	benchNetwork();
+	benchSpikes();
+
+	printResults(csv);
+	closelog();
+	return 0;
+}
+
+#endif //BENCH_LINDA
@@ -0,0 +1,558 @@
+/**
+ * @file mockMbus.c
+ * @brief An m-bus with a simulator behind it, to load the engines without Symbricator3D
+ * @author Anne C. van Rossum
+ *
+ * Elinda, the Colinda controllers and Flinda talk to each other over the m-bus, and the
+ * robots get their sensor values from the Symbricator3D simulator, see run_simulator.sh. This
+ * mock speaks the same protocol. It listens for Elinda on mbus_elinda_port, opens the channels
+ * Elinda asks for with MBUS_ADD_CHANNEL, starts the processes of MBUS_NEW_PROCESS, and passes
+ * every other message on to the channel of the id in its fourth byte.
+ *
+ * The messages to the simulator, sym3d_id, are taken by the mock itself. A robot that is sent
+ * a LINDA_RUNROBOT_MSG starts a trial with its first LINDA_ACTUATOR_MSG. From then on it gets
+ * a LINDA_SENSOR_MSG with LINDA_MOCK_SENSORS random values at LINDA_MOCK_RATE per second,
+ * and after LINDA_MOCK_TICKS of them the trial ends. The mock then sends Elinda the average
+ * speed of the two wheels as the fitness of the robot. With LINDA_MOCK_FLINDA set, the
+ * channel Elinda opens to the simulator is opened to Flinda instead, the topologies go there,
+ * and the last actuator message of a trial is passed on to Flinda, which then judges the
+ * topology of the robot. The sensor values are drawn from a LindaRandom stream of the robot
+ * and the trial, seeded by LINDA_MOCK_SEED, so every run sends the same values.
+ *
+ * The processes are started with their command after LINDA_MOCK_PATH, if that is set to the
+ * directory of the binaries with a slash at the end. With LINDA_MOCK_SPAWN=0 they are not
+ * started at all, because they are started by other means, on other machines for example.
+ * They log to stderr, so that stdout only has the results.
+ * The ids of the controllers are one byte, so up to 250 or so can be driven at the same time.
+ *
+ * The mock measures:
+ *  - the time from the dispatch of a genome to a robot until it is acknowledged, the
+ *    insemination, with any of the messages that carry one
+ *  - the time from the start of a process until it tells it is alive
+ *  - the time from a sensor message until the next actuator message of the robot
+ *  - the trials per second, and the generations per second if LINDA_POPULATION is set
+ *  - the messages and bytes that are passed on
+ *
+ * The run ends after LINDA_MOCK_TRIALS trials, if set, or after LINDA_MOCK_DURATION seconds
+ * (60 by default). Then Elinda and Flinda get a LINDA_END_ELINDA_MSG, the processes that are
+ * started are stopped, and the results go to stdout as JSON, or as CSV with
+ * LINDA_BENCH_FORMAT set to "csv", like benchLinda.c does.
+ *
+ * With LINDA_MOCK_STATS set to a file, the mock asks Elinda every second for the statistics
+ * of all processes, see linda/stats.h, and appends every message of the reply to the file as
+ * a line of JSON, which a dashboard can follow with "tail -f".
+ */
+
+//#define MOCK_MBUS
+
+#ifdef MOCK_MBUS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <syslog.h>
+#include <pthread.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <tcpipmsg.h>
+
+#include <linda/log.h>
+#include <linda/ptreaty.h>
+#include <linda/abbey.h>
+#include <linda/tcpip.h>
+#include <linda/tcpipbank.h>
+#include <linda/infocontainer.h>
+#include <linda/prng.h>
+#include <linda/stats.h>
+
+#define MOCK_MAX_ROBOTS		256
+#define MOCK_MAX_PROCESSES	1024
+#define MOCK_SENSOR_HEADER	6
+
+#define MOCK_ROBOT_IDLE		0x00
+#define MOCK_ROBOT_ARMED	0x01
+#define MOCK_ROBOT_TRIAL	0x02
+
+struct MockConfig {
+	unsigned int rate;
+	unsigned int ticks;
+	unsigned int sensors;
+	unsigned int trials;
+	unsigned int duration;
+	unsigned int population;
+	unsigned int spawn;
+	uint8_t flinda;
+	uint8_t channel_type;
+	unsigned long long seed;
+	const char *path;
+	const char *stats;
+};
+
+/**
+ * What the simulator knows of a robot. The times are 0 when nothing is awaited.
+ */
+struct MockRobot {
+	uint8_t state;
+	uint16_t ticks;
+	uint32_t trial;
+	uint64_t sensor_at;
+	uint64_t genome_at;
+	uint64_t spawned_at;
+	uint32_t speed;
+	uint16_t actuators;
+	struct LindaRandom random;
+	//! The last actuator message of the trial, for Flinda
+	struct TcpipMessage *last;
+};
+
+struct MockStats {
+	uint64_t started_at;
+	uint64_t first_trial_at;
+	uint32_t trials;
+	uint32_t processes;
+	uint64_t sensor_msgs;
+	uint64_t actuator_msgs;
+	uint64_t routed_msgs;
+	uint64_t routed_bytes;
+	unsigned int latency[ABBEY_STATS_BUCKETS];
+	unsigned int insemination[ABBEY_STATS_BUCKETS];
+	unsigned int startup[ABBEY_STATS_BUCKETS];
+};
+
+static struct MockConfig mconf;
+static struct MockRobot robots[MOCK_MAX_ROBOTS];
+static struct MockStats mstats;
+static pid_t processes[MOCK_MAX_PROCESSES];
+static pthread_mutex_t mockMutex = PTHREAD_MUTEX_INITIALIZER;
+static volatile uint8_t ended = 0;
+static FILE *statsFile = NULL;
+static pthread_mutex_t statsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void *mock_hostess(void *context);
+
+static uint64_t now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned int envValue(const char *name, unsigned int value) {
+	const char *text = getenv(name);
+	unsigned int result;
+	if ((text != NULL) && (sscanf(text, "%u", &result) == 1)) return result;
+	return value;
+}
+
+static void initMock() {
+	tmconf = malloc(sizeof(struct TcpipMessageConfig));
+	tmconf->mbus_elinda_port = 3333;
+	tmconf->mbus_sym3d_port = 4444;
+	tmconf->elinda_id = 255;
+	tmconf->mbus_id = 254;
+	tmconf->sym3d_id = 253;
+
+	mconf.rate = envValue("LINDA_MOCK_RATE", 20);
+	if (!mconf.rate) mconf.rate = 1;
+	mconf.ticks = envValue("LINDA_MOCK_TICKS", 100);
+	mconf.sensors = envValue("LINDA_MOCK_SENSORS", 8);
+	if (mconf.sensors > 200) mconf.sensors = 200;
+	mconf.trials = envValue("LINDA_MOCK_TRIALS", 0);
+	mconf.duration = envValue("LINDA_MOCK_DURATION", 60);
+	mconf.population = envValue("LINDA_POPULATION", 0);
+	mconf.spawn = envValue("LINDA_MOCK_SPAWN", 1);
+	mconf.seed = envValue("LINDA_MOCK_SEED", 1);
+	mconf.flinda = (getenv("LINDA_MOCK_FLINDA") != NULL);
+	mconf.channel_type = (getenv("LINDA_LOCAL") != NULL) ? TCPIP_CHANNEL_LOCAL : 0;
+	mconf.path = getenv("LINDA_MOCK_PATH");
+	if (mconf.path == NULL) mconf.path = "";
+	mconf.stats = getenv("LINDA_MOCK_STATS");
+	memset(robots, 0, sizeof(robots));
+	memset(&mstats, 0, sizeof(mstats));
+	mstats.started_at = now_ns();
+}
+
+/**
+ * Opens a channel like the engines do, see ic2sock in elinda.c, with the mock as hostess. The
+ * type is 1 for a server and 0 for a client. The engines speak version 2 of the protocol, so
+ * the mock greets them with a hello, see tcpip.h.
+ */
+static void addChannel(uint8_t type, struct in_addr host, int port, uint8_t id) {
+	if (tcpipbank_get(id) != NULL) {
+		TPRINTF(LOG_WARNING, "Channel with id %i already exists", id);
+		return;
+	}
+	struct TcpipSocket *lsock = tcpip_get(type | mconf.channel_type | TCPIP_CHANNEL_HELLO);
+	lsock->port_nr = port;
+	if (!type) lsock->serv_addr.sin_addr = host;
+	else lsock->cli_addr.sin_addr = host;
+	lsock->callbackIn = mock_hostess;
+	if (tcpipbank_add(lsock, id)) {
+		tcpip_free(lsock);
+		return;
+	}
+	dispatch_described_task(tcpip_start, (void*)lsock, "start tcp/ip");
+}
+
+/**
+ * The channel Elinda asks for, see createConnectColindaMessage. The one to the simulator is
+ * only opened to Flinda.
+ */
+static void addRequestedChannel(struct TcpipMessage *msg) {
+	if (msg->size < 10) return;
+	struct in_addr host;
+	host.s_addr = ((uint32_t)msg->payload[3] << 24) | (msg->payload[4] << 16) |
+			(msg->payload[5] << 8) | msg->payload[6];
+	uint8_t id = msg->payload[9];
+	if ((id == tmconf->sym3d_id) && !mconf.flinda) return;
+	addChannel(msg->payload[2] ? 1 : 0, host,
+			(msg->payload[7] << 8) | msg->payload[8], id);
+}
+
+/**
+ * Starts the process of the command, as "colinda 3", in a shell. The sockets of the tcpip
+ * servers reap the processes that end, see sigchld_handler.
+ */
+static void spawn(struct TcpipMessage *msg) {
+	char name[256], command[512];
+	unsigned int id;
+	int length = msg->size - 2;
+	if (length <= 0) return;
+	memcpy(name, &msg->payload[2], length);
+	name[length] = 0;
+	pthread_mutex_lock(&mockMutex);
+	if ((sscanf(name, "%*s %u", &id) == 1) && (id < MOCK_MAX_ROBOTS)) {
+		robots[id].spawned_at = now_ns();
+	}
+	pthread_mutex_unlock(&mockMutex);
+	if (!mconf.spawn) return;
+	snprintf(command, sizeof(command), "exec %s%s", mconf.path, name);
+	pid_t pid = fork();
+	if (!pid) {
+		//the sockets of the mock should not stay open in the process
+		int fd;
+		for (fd = 3; fd < sysconf(_SC_OPEN_MAX); fd++) close(fd);
+		dup2(2, 1);
+		execl("/bin/sh", "sh", "-c", command, (char*)NULL);
+		_exit(127);
+	}
+	if (pid < 0) {
+		TPRINTF(LOG_ERR, "Could not start %s", name);
+		return;
+	}
+	pthread_mutex_lock(&mockMutex);
+	if (mstats.processes < MOCK_MAX_PROCESSES) processes[mstats.processes++] = pid;
+	pthread_mutex_unlock(&mockMutex);
+	TPRINTF(LOG_INFO, "Started %s", command);
+}
+
+static void record(unsigned int *histogram, uint64_t *since) {
+	if (!*since) return;
+	histogram[abbey_stats_bucket(now_ns() - *since)]++;
+	*since = 0;
+}
+
+static void endTrial() {
+	mstats.trials++;
+	if (mconf.trials && (mstats.trials >= mconf.trials)) ended = 1;
+}
+
+/**
+ * Looks at a message that is passed on, for the times of insemination and startup, and for
+ * the start of trials. Must be called with the mock lock.
+ */
+static void observe(struct TcpipMessage *msg) {
+	uint8_t source = msg->payload[2], dest = msg->payload[3];
+	mstats.routed_msgs++;
+	mstats.routed_bytes += msg->size;
+	switch (msg->payload[0]) {
+	case LINDA_GENOME_MSG: case LINDA_GENOME_ANNOUNCE: case LINDA_GENOME_DELTA_MSG:
+	case LINDA_NETWORK_MSG:
+		if (!robots[dest].genome_at) robots[dest].genome_at = now_ns();
+		break;
+	case LINDA_GENOME_ACK:
+		record(mstats.insemination, &robots[source].genome_at);
+		break;
+	case LINDA_NEW_PROCESS_ACK:
+		record(mstats.startup, &robots[source].spawned_at);
+		break;
+	case LINDA_RUNROBOT_MSG:
+		robots[dest].state = MOCK_ROBOT_ARMED;
+		break;
+	case LINDA_FITNESS_MSG:
+		if (mconf.flinda) endTrial();
+		break;
+	}
+}
+
+/**
+ * The first actuator message of a robot that is sent to run starts its trial, the ones after
+ * that answer the last sensor message. Must be called with the mock lock.
+ */
+static void actuate(struct TcpipMessage *msg) {
+	struct MockRobot *r = &robots[msg->payload[2]];
+	mstats.actuator_msgs++;
+	if (r->state == MOCK_ROBOT_ARMED) {
+		r->state = MOCK_ROBOT_TRIAL;
+		r->ticks = r->actuators = 0;
+		r->speed = 0;
+		r->sensor_at = 0;
+		linda_random_seed(&r->random, mconf.seed, ((uint64_t)r->trial++ << 8) | msg->payload[2]);
+		if (!mstats.first_trial_at) mstats.first_trial_at = now_ns();
+	}
+	if (r->state != MOCK_ROBOT_TRIAL || msg->size < 8) {
+		freemsg(msg);
+		return;
+	}
+	record(mstats.latency, &r->sensor_at);
+	r->speed += (msg->payload[6] + msg->payload[7]) / 2;
+	r->actuators++;
+	if (r->last != NULL) freemsg(r->last);
+	r->last = msg;
+}
+
+static struct TcpipMessage *createSensorMessage(uint8_t robotId, struct LindaRandom *random) {
+	uint16_t i;
+	struct TcpipMessage *lm = tcpip_alloc_msg(MOCK_SENSOR_HEADER + mconf.sensors);
+	lm->payload[0] = LINDA_SENSOR_MSG;
+	lm->payload[1] = lm->size - 2;
+	lm->payload[2] = tmconf->sym3d_id;
+	lm->payload[3] = robotId;
+	lm->payload[4] = robotId;
+	lm->payload[5] = 0;
+	for (i = 0; i < mconf.sensors; i++) {
+		lm->payload[MOCK_SENSOR_HEADER + i] = linda_random_below(random, 256);
+	}
+	return lm;
+}
+
+static struct TcpipMessage *createFitnessMessage(uint8_t robotId, uint8_t fitness) {
+	struct TcpipMessage *lm = tcpip_alloc_msg(6);
+	lm->payload[0] = LINDA_FITNESS_MSG;
+	lm->payload[1] = lm->size - 2;
+	lm->payload[2] = tmconf->sym3d_id;
+	lm->payload[3] = tmconf->elinda_id;
+	lm->payload[4] = robotId;
+	lm->payload[5] = fitness;
+	return lm;
+}
+
+static struct TcpipMessage *createEndMessage(uint8_t destId) {
+	struct TcpipMessage *lm = tcpip_alloc_msg(4);
+	lm->payload[0] = LINDA_END_ELINDA_MSG;
+	lm->payload[1] = lm->size - 2;
+	lm->payload[2] = tmconf->mbus_id;
+	lm->payload[3] = destId;
+	return lm;
+}
+
+static void deliver(uint8_t dest, struct TcpipMessage *msg) {
+	struct TcpipSocket *lsock_dest = tcpipbank_get(dest);
+	if (lsock_dest == NULL) {
+		TPRINTF(LOG_VERBOSE, "No channel to %i", dest);
+		freemsg(msg);
+		return;
+	}
+	push(lsock_dest->outbox, msg);
+	tcpip_flush(lsock_dest);
+}
+
+/**
+ * Ends the trial of the robot with its fitness, or with its last actuator message to Flinda.
+ * Returns the message and sets the destination. Must be called with the mock lock.
+ */
+static struct TcpipMessage *judge(uint8_t robotId, uint8_t *dest) {
+	struct MockRobot *r = &robots[robotId];
+	struct TcpipMessage *msg = r->last;
+	r->state = MOCK_ROBOT_IDLE;
+	r->sensor_at = 0;
+	r->last = NULL;
+	if (mconf.flinda) {
+		*dest = tmconf->sym3d_id;
+		return msg;
+	}
+	if (msg != NULL) freemsg(msg);
+	*dest = tmconf->elinda_id;
+	endTrial();
+	return createFitnessMessage(robotId, r->actuators ? r->speed / r->actuators : 0);
+}
+
+/**
+ * Every tick of the simulator, the robots in a trial get their sensor values, or their
+ * fitness at the end of the trial. The messages are sent after the lock is released.
+ */
+static void *mock_tick(void *context) {
+	static struct TcpipMessage *out[MOCK_MAX_ROBOTS];
+	static uint8_t dests[MOCK_MAX_ROBOTS];
+	static pthread_mutex_t tickMutex = PTHREAD_MUTEX_INITIALIZER;
+	uint16_t i, n = 0;
+	//a tick that runs late is not overtaken by the next one
+	if (pthread_mutex_trylock(&tickMutex)) return NULL;
+	pthread_mutex_lock(&mockMutex);
+	for (i = 0; i < MOCK_MAX_ROBOTS; i++) {
+		struct MockRobot *r = &robots[i];
+		if (r->state != MOCK_ROBOT_TRIAL) continue;
+		if (r->ticks == mconf.ticks) {
+			out[n] = judge(i, &dests[n]);
+			if (out[n] != NULL) n++;
+			continue;
+		}
+		out[n] = createSensorMessage(i, &r->random);
+		dests[n++] = i;
+		if (!r->sensor_at) r->sensor_at = now_ns();
+		r->ticks++;
+		mstats.sensor_msgs++;
+	}
+	pthread_mutex_unlock(&mockMutex);
+	for (i = 0; i < n; i++) deliver(dests[i], out[i]);
+	pthread_mutex_unlock(&tickMutex);
+	return NULL;
+}
+
+/**
+ * Asks Elinda for the statistics of all processes, with the amount of requests as tag.
+ */
+static void *mock_stats(void *context) {
+	static uint8_t tag = 0;
+	struct TcpipMessage *msg = linda_stats_request(tmconf->mbus_id, tmconf->elinda_id,
+			LINDA_STATS_AGGREGATE, tag++);
+	if (msg != NULL) deliver(tmconf->elinda_id, msg);
+	return NULL;
+}
+
+static void writeStats(struct TcpipMessage *msg) {
+	static char text[65536];
+	pthread_mutex_lock(&statsMutex);
+	if (statsFile != NULL) {
+		if (linda_stats_json(msg, text, sizeof(text)) < 0) {
+			TPRINTF(LOG_WARNING, "Statistics of %i are damaged", msg->payload[2]);
+		} else {
+			fprintf(statsFile, "%s\n", text);
+			fflush(statsFile);
+		}
+	}
+	pthread_mutex_unlock(&statsMutex);
+	freemsg(msg);
+}
+
+/**
+ * The hostess of all channels. The messages for the m-bus are handled, the ones for the
+ * simulator are taken, and all others are passed on.
+ */
+static void *mock_hostess(void *context) {
+	struct TcpipSocket *tcpSocket = (struct TcpipSocket*)context;
+	struct TcpipMessage *msg = pop(tcpSocket->inbox);
+	if (msg == NULL) return NULL;
+	switch (msg->payload[0]) {
+	case MBUS_ADD_CHANNEL:
+		addRequestedChannel(msg);
+		freemsg(msg);
+		return NULL;
+	case MBUS_NEW_PROCESS:
+		spawn(msg);
+		freemsg(msg);
+		return NULL;
+	}
+	if (msg->size < 4) {
+		freemsg(msg);
+		return NULL;
+	}
+	uint8_t dest = msg->payload[3];
+	if ((dest == tmconf->mbus_id) && (msg->payload[0] == LINDA_STATS_MSG)) {
+		writeStats(msg);
+		return NULL;
+	}
+	pthread_mutex_lock(&mockMutex);
+	observe(msg);
+	if ((dest == tmconf->sym3d_id) && (msg->payload[0] == LINDA_ACTUATOR_MSG)) {
+		actuate(msg);
+		pthread_mutex_unlock(&mockMutex);
+		return NULL;
+	}
+	pthread_mutex_unlock(&mockMutex);
+	deliver(dest, msg);
+	return NULL;
+}
+
+static double perSecond(uint64_t count, uint64_t since, uint64_t until) {
+	if (!since || until <= since) return 0;
+	return count * 1e9 / (until - since);
+}
+
+static void printResults(uint8_t csv) {
+	uint64_t now = now_ns();
+	struct { const char *name; double value; } figures[] = {
+		{ "duration_s", (now - mstats.started_at) / 1e9 },
+		{ "controllers", mstats.processes },
+		{ "trials", mstats.trials },
+		{ "trials_per_s", perSecond(mstats.trials, mstats.first_trial_at, now) },
+		{ "generations_per_s", mconf.population ?
+				perSecond(mstats.trials, mstats.first_trial_at, now) / mconf.population : 0 },
+		{ "sensor_msgs_per_s", perSecond(mstats.sensor_msgs, mstats.first_trial_at, now) },
+		{ "actuator_msgs", mstats.actuator_msgs },
+		{ "routed_msgs", mstats.routed_msgs },
+		{ "routed_bytes", mstats.routed_bytes },
+		{ "latency_p50_us", abbey_stats_percentile(mstats.latency, 0.5) / 1e3 },
+		{ "latency_p99_us", abbey_stats_percentile(mstats.latency, 0.99) / 1e3 },
+		{ "insemination_p50_us", abbey_stats_percentile(mstats.insemination, 0.5) / 1e3 },
+		{ "insemination_p99_us", abbey_stats_percentile(mstats.insemination, 0.99) / 1e3 },
+		{ "startup_p50_us", abbey_stats_percentile(mstats.startup, 0.5) / 1e3 },
+		{ "startup_p99_us", abbey_stats_percentile(mstats.startup, 0.99) / 1e3 },
+	};
+	uint8_t i, count = sizeof(figures) / sizeof(figures[0]);
+	if (csv) printf("metric,value\n");
+	else printf("{\"rate\":%u,\"ticks\":%u,\"sensors\":%u,\"seed\":%llu,\"flinda\":%i",
+			mconf.rate, mconf.ticks, mconf.sensors, mconf.seed, mconf.flinda);
+	for (i = 0; i < count; i++) {
+		if (csv) printf("%s,%.3f\n", figures[i].name, figures[i].value);
+		else printf(",\"%s\":%.3f", figures[i].name, figures[i].value);
+	}
+	if (!csv) printf("}\n");
+}
+
+int main() {
+	openlog ("tlinda", LOG_CONS, LOG_LOCAL0);
+	initLog(LOG_WARNING);
+	pthread_t this = pthread_self();
+	ptreaty_add_thread(&this, "Main");
+	tprintf(LOG_NOTICE, __func__, "Start Tlinda - Mock m-bus");
+
+	initMock();
+	initSockets();
+	initialize_abbey(8, 16);
+	struct in_addr any;
+	any.s_addr = INADDR_ANY;
+	addChannel(1, any, tmconf->mbus_elinda_port, tmconf->elinda_id);
+	struct AbbeyTimer *timer = dispatch_periodic_task(mock_tick, NULL, "mock tick",
+			1000000 / mconf.rate);
+	struct AbbeyTimer *statsTimer = NULL;
+	if (mconf.stats != NULL) {
+		statsFile = fopen(mconf.stats, "a");
+		if (statsFile == NULL) TPRINTF(LOG_WARNING, "Could not open %s", mconf.stats);
+		else statsTimer = dispatch_periodic_task(mock_stats, NULL, "mock stats", 1000000);
+	}
+
+	uint64_t until = now_ns() + (uint64_t)mconf.duration * 1000000000ULL;
+	while (!ended && (!mconf.duration || now_ns() < until)) usleep(100000);
+	abbey_cancel_timer(timer);
+	if (statsTimer != NULL) abbey_cancel_timer(statsTimer);
+
+	deliver(tmconf->elinda_id, createEndMessage(tmconf->elinda_id));
+	if (mconf.flinda) deliver(tmconf->sym3d_id, createEndMessage(tmconf->sym3d_id));
+	usleep(500000);
+	uint32_t i;
+	pthread_mutex_lock(&mockMutex);
+	for (i = 0; i < mstats.processes; i++) kill(processes[i], SIGTERM);
+	printResults((getenv("LINDA_BENCH_FORMAT") != NULL) &&
+			!strcmp(getenv("LINDA_BENCH_FORMAT"), "csv"));
+	pthread_mutex_unlock(&mockMutex);
+	pthread_mutex_lock(&statsMutex);
+	if (statsFile != NULL) fclose(statsFile);
+	statsFile = NULL;
+	pthread_mutex_unlock(&statsMutex);
+	closelog();
+	return 0;
+}
+
+#endif //MOCK_MBUS
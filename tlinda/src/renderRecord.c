@@ -0,0 +1,287 @@
+/**
+ * @file renderRecord.c
+ * @brief Renders the record of the development of networks, see colinda/inc/recorder.h
+ * @author Anne C. van Rossum
+ *
+ * Usage: renderRecord <file> [<directory> [<scale>]]
+ *
+ * With the file only, every development in it is summed up: the robot, the grid, the steps
+ * that are recorded, the neurons and synapses that came out, and how often every
+ * morphological operation is applied. With a directory, every recorded step becomes an image,
+ * frame-<development>-<step>.ppm, with "-" as directory the images go to stdout one after the
+ * other, which ffmpeg turns into an animation with "-f image2pipe -c:v ppm -i -".
+ *
+ * An image has the planes of all products next to each other, row by row, with a cell as a
+ * square of scale pixels, 8 by default. A concentration is a grey from black at 0 to white
+ * at 100. The cells of a phenotypic product at or above the threshold are yellow. A neuron is
+ * a dot in its cell, green if it is excitatory, red if it is inhibitory, on every plane. A
+ * cell in which an operation is applied since the step before gets a blue border on the
+ * plane of the product of that operation.
+ *
+ * The images are plain netpbm, so this needs nothing but the C library.
+ */
+
+//#define RENDER_RECORD
+
+#ifdef RENDER_RECORD
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <recorder.h>
+#include <neuron.h>
+
+/****************************************************************************************************
+ *  		Declarations
+ ***************************************************************************************************/
+
+#define RENDER_OPERATIONS		256
+
+struct Development {
+	uint32_t number;
+	uint8_t robot, rows, columns, products, phenotypic, threshold;
+	uint32_t cells;
+	uint8_t *planes;
+	//the neurons of the step as the type plus one in their cell, 0 for none
+	uint16_t *neurons;
+	//the operations of the step as a bit per product in a cell
+	uint8_t *operations;
+	uint32_t steps, last_step, neuron_count, synapse_count;
+	uint32_t distribution[RENDER_OPERATIONS];
+	uint64_t bytes;
+};
+
+static struct Development d;
+static const char *directory = NULL;
+static uint32_t scale = 8;
+
+/****************************************************************************************************
+ *  		Implementations
+ ***************************************************************************************************/
+
+static uint16_t get16(const uint8_t *p) {
+	return (p[0] << 8) | p[1];
+}
+
+static uint32_t get32(const uint8_t *p) {
+	return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static void summarize() {
+	uint32_t i;
+	if (!d.number || directory != NULL) return;
+	printf("development %u: robot %u, grid %ux%u, %u products (%u phenotypic), %u steps "
+			"recorded up to step %u, %u neurons, %u synapses, %llu bytes\n", d.number, d.robot,
+			d.rows, d.columns, d.products, d.phenotypic, d.steps, d.last_step, d.neuron_count,
+			d.synapse_count, (unsigned long long)d.bytes);
+	for (i = 0; i < RENDER_OPERATIONS; i++) {
+		if (d.distribution[i]) printf("  operation %u: %u times\n", i, d.distribution[i]);
+	}
+}
+
+static uint8_t startDevelopment(const uint8_t *p, uint32_t length) {
+	if (length < 6) return 0;
+	summarize();
+	free(d.planes); free(d.neurons); free(d.operations);
+	uint32_t number = d.number + 1;
+	memset(&d, 0, sizeof(d));
+	d.number = number;
+	d.robot = p[0]; d.rows = p[1]; d.columns = p[2];
+	d.products = p[3]; d.phenotypic = p[4]; d.threshold = p[5];
+	d.cells = d.rows * d.columns;
+	d.planes = calloc((uint32_t)d.products * d.cells + 1, 1);
+	d.neurons = calloc(d.cells + 1, sizeof(uint16_t));
+	d.operations = calloc((uint32_t)d.products * d.cells + 1, 1);
+	return (d.planes != NULL) && (d.neurons != NULL) && (d.operations != NULL);
+}
+
+/**
+ * Unpacks the planes in p up to end, see recorder.h, onto the planes before.
+ */
+static uint8_t unpackPlanes(const uint8_t *p, const uint8_t *end) {
+	uint32_t i, j, size = (uint32_t)d.products * d.cells;
+	for (i = 0; i < size; i += 8) {
+		if (p >= end) return 0;
+		uint8_t mask = *p++;
+		for (j = 0; (j < 8) && (i + j < size); j++) {
+			if (!(mask & (1 << j))) continue;
+			if (p >= end) return 0;
+			d.planes[i + j] ^= *p++;
+		}
+	}
+	return p == end;
+}
+
+static void pixel(uint8_t *image, uint32_t width, uint32_t x, uint32_t y, uint8_t r, uint8_t g,
+		uint8_t b) {
+	uint8_t *lp = image + 3 * ((uint64_t)y * width + x);
+	lp[0] = r; lp[1] = g; lp[2] = b;
+}
+
+/**
+ * Draws the cell of the plane with its left top at x, y.
+ */
+static void drawCell(uint8_t *image, uint32_t width, uint8_t product, uint32_t cell, uint32_t x,
+		uint32_t y) {
+	uint32_t i, j, dot = scale / 4;
+	uint8_t value = d.planes[(uint32_t)product * d.cells + cell];
+	uint8_t grey = value >= 100 ? 255 : value * 255 / 100;
+	uint8_t on = (product < d.phenotypic) && (value >= d.threshold);
+	uint8_t border = (d.operations[(uint32_t)product * d.cells + cell]) && (scale > 2);
+	uint16_t neuron = d.neurons[cell];
+	for (j = 0; j < scale; j++) {
+		for (i = 0; i < scale; i++) {
+			if (border && (!i || !j || (i == scale - 1) || (j == scale - 1))) {
+				pixel(image, width, x + i, y + j, 0, 96, 255);
+			} else if (neuron && (i >= dot) && (j >= dot) && (i < scale - dot) &&
+					(j < scale - dot)) {
+				if (((neuron - 1) & NEURONSIGN_MASK) == NEURONSIGN_EXCITATORY) {
+					pixel(image, width, x + i, y + j, 0, 200, 0);
+				} else {
+					pixel(image, width, x + i, y + j, 220, 0, 0);
+				}
+			} else if (on) {
+				pixel(image, width, x + i, y + j, 255, 220, 0);
+			} else {
+				pixel(image, width, x + i, y + j, grey, grey, grey);
+			}
+		}
+	}
+}
+
+static uint8_t render(uint16_t step) {
+	uint32_t per_row = 1, rows, width, height, cell;
+	uint8_t product;
+	while (per_row * per_row < d.products) per_row++;
+	rows = (d.products + per_row - 1) / per_row;
+	width = per_row * (d.columns * scale + 1) + 1;
+	height = rows * (d.rows * scale + 1) + 1;
+	uint8_t *image = malloc((uint64_t)width * height * 3);
+	if (image == NULL) return 0;
+	//a dark blue background between the planes
+	for (cell = 0; cell < width * height; cell++) {
+		image[3 * cell] = 0; image[3 * cell + 1] = 0; image[3 * cell + 2] = 64;
+	}
+	for (product = 0; product < d.products; product++) {
+		uint32_t left = 1 + (product % per_row) * (d.columns * scale + 1);
+		uint32_t top = 1 + (product / per_row) * (d.rows * scale + 1);
+		for (cell = 0; cell < d.cells; cell++) {
+			drawCell(image, width, product, cell, left + (cell % d.columns) * scale,
+					top + (cell / d.columns) * scale);
+		}
+	}
+	FILE *out = stdout;
+	if (strcmp(directory, "-")) {
+		char path[512];
+		snprintf(path, sizeof(path), "%s/frame-%04u-%04u.ppm", directory, d.number, step);
+		out = fopen(path, "wb");
+		if (out == NULL) {
+			fprintf(stderr, "Could not open %s\n", path);
+			free(image);
+			return 0;
+		}
+	}
+	fprintf(out, "P6\n%u %u\n255\n", width, height);
+	fwrite(image, 1, (size_t)width * height * 3, out);
+	if (out != stdout) fclose(out);
+	free(image);
+	return 1;
+}
+
+static uint8_t readStep(const uint8_t *p, uint32_t length) {
+	const uint8_t *end = p + length;
+	uint32_t i, cell, count;
+	if (!d.number || (length < 5)) return 0;
+	uint16_t step = get16(p);
+	uint8_t flags = p[2];
+	count = get16(p + 3);
+	p += 5;
+	if (p + count * 3 + 2 > end) return 0;
+	memset(d.neurons, 0, d.cells * sizeof(uint16_t));
+	for (i = 0; i < count; i++, p += 3) {
+		cell = get16(p);
+		if (cell < d.cells) d.neurons[cell] = p[2] + 1;
+	}
+	d.neuron_count = count;
+	count = get16(p);
+	p += 2;
+	if (p + count * 3 > end) return 0;
+	memset(d.operations, 0, (uint32_t)d.products * d.cells);
+	for (i = 0; i < count; i++, p += 3) {
+		cell = get16(p);
+		d.distribution[p[2]]++;
+		if ((cell < d.cells) && (p[2] < d.products)) d.operations[p[2] * d.cells + cell] = 1;
+	}
+	if (flags & RECORD_DELTA) {
+		if (!unpackPlanes(p, end)) return 0;
+	} else {
+		if (end - p != (uint32_t)d.products * d.cells) return 0;
+		memcpy(d.planes, p, end - p);
+	}
+	d.steps++;
+	d.last_step = step;
+	if (directory != NULL) return render(step);
+	return 1;
+}
+
+static uint8_t readTopology(const uint8_t *p, uint32_t length) {
+	if (!d.number || (length < 6)) return 0;
+	d.last_step = get16(p);
+	d.synapse_count = get32(p + 2);
+	return length == 6 + d.synapse_count * 9;
+}
+
+int main(int argc, const char* argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <file> [<directory> [<scale>]]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 2) directory = argv[2];
+	if ((argc > 3) && (atoi(argv[3]) > 0)) scale = atoi(argv[3]);
+	FILE *in = fopen(argv[1], "rb");
+	if (in == NULL) {
+		fprintf(stderr, "Could not open %s\n", argv[1]);
+		return 1;
+	}
+	uint8_t head[5];
+	uint8_t *body = NULL;
+	uint32_t capacity = 0, length, records = 0;
+	if ((fread(head, 1, 4, in) != 4) || (get32(head) != RECORDER_MAGIC)) {
+		fprintf(stderr, "%s is not a record of development\n", argv[1]);
+		return 1;
+	}
+	memset(&d, 0, sizeof(d));
+	while (fread(head, 1, 5, in) == 5) {
+		length = get32(head);
+		if (length > capacity) {
+			uint8_t *lbody = realloc(body, length);
+			if (lbody == NULL) break;
+			body = lbody;
+			capacity = length;
+		}
+		if (fread(body, 1, length, in) != length) {
+			fprintf(stderr, "The record ends halfway record %u\n", records);
+			break;
+		}
+		uint8_t ok = 0;
+		switch (head[4]) {
+		case RECORD_DEVELOPMENT: ok = startDevelopment(body, length); break;
+		case RECORD_STEP: ok = readStep(body, length); break;
+		case RECORD_TOPOLOGY: ok = readTopology(body, length); break;
+		default: ok = 1; //of a later version, skipped
+		}
+		if (!ok) {
+			fprintf(stderr, "Record %u of type %u is damaged\n", records, head[4]);
+			break;
+		}
+		d.bytes += 5 + length;
+		records++;
+	}
+	summarize();
+	free(body);
+	fclose(in);
+	return 0;
+}
+
+#endif //RENDER_RECORD
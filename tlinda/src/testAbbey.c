@@ -0,0 +1,208 @@
+/**
+ * @file testAbbey.c
+ * @brief Stress test for the task ring and deques of the abbey.
+ * @author Anne C. van Rossum
+ *
+ * Millions of tiny tasks are dispatched to the abbey, from the main thread (which ends up
+ * in the shared ring) as well as from within tasks (which ends up in the deques of the
+ * monks). The shared ring starts small on purpose, so it has to grow several times while
+ * monks are taking tasks out of it. Every task increments a counter, at the end the counter
+ * should equal the amount of dispatched tasks exactly. A lost or duplicated task shows up
+ * as a difference. The leaf tasks are dispatched by a registered descriptor, the root tasks
+ * by their description.
+ *
+ * The second test dispatches delayed and periodic tasks. The delayed task should not run
+ * before its delay, and a periodic task should stop running after it has been cancelled.
+ *
+ * The third test checks that the statistics of the abbey counted all root tasks.
+ */
+
+//#define TEST_ABBEY
+
+#ifdef TEST_ABBEY
+
+#include <stdio.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <linda/log.h>
+#include <linda/ptreaty.h>
+#include <linda/abbey.h>
+
+/**
+ * The amount of tasks dispatched from the main thread, each of these dispatches again
+ * FANOUT_COUNT leaf tasks from within the abbey.
+ */
+#define ROOT_COUNT		100000
+#define FANOUT_COUNT	20
+
+static const struct AbbeyTaskDescriptor *leaf_descriptor;
+static volatile long leafs_done = 0;
+static volatile long roots_done = 0;
+
+void *leaf_task(void *context) {
+	__sync_add_and_fetch(&leafs_done, 1);
+	return NULL;
+}
+
+void *root_task(void *context) {
+	uint8_t i;
+	for (i = 0; i < FANOUT_COUNT; i++) {
+		dispatch_descriptor_task(leaf_descriptor, NULL);
+	}
+	__sync_add_and_fetch(&roots_done, 1);
+	return NULL;
+}
+
+/**
+ * Tasks that join a child while they hold a lock, and dispatch a task after the child that
+ * takes the same lock. A join that ran that task on its own stack would deadlock.
+ */
+#define JOIN_COUNT		1000
+
+static pthread_mutex_t joinMutex = PTHREAD_MUTEX_INITIALIZER;
+static volatile long children_done = 0;
+static volatile long locked_done = 0;
+
+void *child_task(void *context) {
+	__sync_add_and_fetch(&children_done, 1);
+	return context;
+}
+
+void *locked_task(void *context) {
+	pthread_mutex_lock(&joinMutex);
+	__sync_add_and_fetch(&locked_done, 1);
+	pthread_mutex_unlock(&joinMutex);
+	return NULL;
+}
+
+void *joining_task(void *context) {
+	pthread_mutex_lock(&joinMutex);
+	struct AbbeyHandle *h = dispatch_joinable_task(child_task, context, "child",
+			ABBEY_PRIORITY_NORMAL);
+	dispatch_described_task(locked_task, NULL, "locked");
+	if (h != NULL) {
+		if (abbey_join(h) == context) __sync_add_and_fetch(&locked_done, 1);
+		abbey_release_handle(h);
+	}
+	pthread_mutex_unlock(&joinMutex);
+	return NULL;
+}
+
+static volatile long delayed_at = -1;
+static volatile long ticks = 0;
+static struct timeval start;
+
+long elapsed_ms(struct timeval *start);
+
+void *delayed_task(void *context) {
+	delayed_at = elapsed_ms(&start);
+	return NULL;
+}
+
+void *periodic_task(void *context) {
+	__sync_add_and_fetch(&ticks, 1);
+	return NULL;
+}
+
+long elapsed_ms(struct timeval *start) {
+	struct timeval end;
+	gettimeofday(&end, NULL);
+	return (end.tv_sec - start->tv_sec) * 1000 + (end.tv_usec - start->tv_usec) / 1000;
+}
+
+int main() {
+	openlog ("tlinda", LOG_CONS, LOG_LOCAL0);
+	initLog(LOG_INFO);
+	pthread_t this = pthread_self();
+	ptreaty_add_thread(&this, "Main");
+	tprintf(LOG_NOTICE, __func__, "Start Tlinda - Test Abbey");
+
+	initialize_abbey(8, 4);
+	leaf_descriptor = abbey_register_task(leaf_task, "leaf", ABBEY_PRIORITY_NORMAL);
+
+	gettimeofday(&start, NULL);
+	long i, expected = (long)ROOT_COUNT * (FANOUT_COUNT + 1);
+	for (i = 0; i < ROOT_COUNT; i++) {
+		if (dispatch_described_task(root_task, NULL, "root")) {
+			tprintf(LOG_ERR, __func__, "Dispatch failed!");
+			return 1;
+		}
+	}
+
+	char text[128];
+	long done, previous = -1, timeout = 0;
+	do {
+		usleep(10000);
+		done = roots_done + leafs_done;
+		if (done == previous) timeout++; else timeout = 0;
+		previous = done;
+	} while ((done < expected) && (timeout < 500));
+
+	sprintf(text, "%li of %li tasks executed in %li ms", done, expected, elapsed_ms(&start));
+	tprintf(LOG_INFO, __func__, text);
+	if (done != expected) {
+		tprintf(LOG_ERR, __func__, "Test [0]: Error!");
+		return 1;
+	}
+	tprintf(LOG_INFO, __func__, "Test [0]: Correct!");
+
+	gettimeofday(&start, NULL);
+	dispatch_delayed_task(delayed_task, NULL, 200000);
+	struct AbbeyTimer *timer = dispatch_periodic_task(periodic_task, NULL, "tick", 10000);
+	usleep(500000);
+	abbey_cancel_timer(timer);
+	long cancelled_ticks = ticks;
+	usleep(100000);
+	sprintf(text, "Delayed task after %li ms, %li periodic ticks", delayed_at, cancelled_ticks);
+	tprintf(LOG_INFO, __func__, text);
+	if ((delayed_at < 200) || (delayed_at > 400) || (cancelled_ticks < 25) ||
+			(ticks > cancelled_ticks + 1)) {
+		tprintf(LOG_ERR, __func__, "Test [1]: Error!");
+		return 1;
+	}
+	tprintf(LOG_INFO, __func__, "Test [1]: Correct!");
+
+	struct AbbeyStats *stats = malloc(sizeof(struct AbbeyStats));
+	abbey_stats_snapshot(stats);
+	abbey_stats_dump();
+	for (i = 0; i < stats->kind_count; i++) {
+		if (!strcmp(stats->kind[i].description, "root")) break;
+	}
+	if ((i == stats->kind_count) || (stats->kind[i].count != ROOT_COUNT)) {
+		tprintf(LOG_ERR, __func__, "Test [2]: Error!");
+		return 1;
+	}
+	free(stats);
+	tprintf(LOG_INFO, __func__, "Test [2]: Correct!");
+
+	for (i = 0; i < JOIN_COUNT; i++) {
+		dispatch_described_task(joining_task, (void*)(i + 1), "joining");
+	}
+	previous = -1;
+	timeout = 0;
+	do {
+		usleep(10000);
+		done = locked_done;
+		if (done == previous) timeout++; else timeout = 0;
+		previous = done;
+	} while ((done < 2 * JOIN_COUNT) && (timeout < 500));
+	sprintf(text, "%li of %i joining and locked tasks done, %li children", done,
+			2 * JOIN_COUNT, children_done);
+	tprintf(LOG_INFO, __func__, text);
+	if ((done != 2 * JOIN_COUNT) || (children_done != JOIN_COUNT)) {
+		tprintf(LOG_ERR, __func__, "Test [3]: Error!");
+		return 1;
+	}
+	tprintf(LOG_INFO, __func__, "Test [3]: Correct!");
+
+	printf("\n== End of tests ==\n");
+	closelog();
+	return 0;
+}
+
+#endif
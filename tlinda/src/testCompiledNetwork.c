@@ -0,0 +1,218 @@
+/**
+ * @file testCompiledNetwork.c
+ * @brief Test file for the compiled network against the pointer form
+ * @author Anne C. van Rossum
+ *
+ * Networks are developed from random genomes and run twice on the same random spikes, once
+ * compiled, and then over the pointers, with the floats of neuron.c, which are the reference.
+ * The compiled network copies the state of the neurons, so the second run starts from the
+ * same state. The spike trains of the output neurons are compared: a spike matches when the
+ * other run has a spike of the same neuron at most SPIKE_WINDOW ticks before or after it,
+ * and the amount of spikes of every output neuron is compared.
+ *
+ * Compiled with floats the trains are expected to be the same, to the bit, as long as no
+ * synapse has a delay above 1. With WITH_FIXED_POINT the spikes drift apart in time, and
+ * the ratio of matched spikes tells how far, but the rates should stay close: the test fails
+ * when the sum of the differences in the amounts of spikes is above MAX_RATE_ERROR of the
+ * spikes. Do not run this test with WITH_NETWORK_CHECK, that check changes the state of the
+ * neurons the second run starts from.
+ */
+
+//#define TEST_COMPILED_NETWORK
+
+#ifdef TEST_COMPILED_NETWORK
+
+#include <lindaconfig.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <genome.h>
+#include <grid.h>
+#include <embryogeny.h>
+#include <topology.h>
+#include <neuron.h>
+#include <sensorimotor.h>
+#include <colinda.h>
+
+#include <linda/log.h>
+#include <linda/ptreaty.h>
+
+#define GENOMES			40
+#define GENOME_SIZE		3000
+#define TICKS			2000
+#define MAX_TRAIN		8192
+#define SPIKE_WINDOW	2
+#define MAX_RATE_ERROR	0.10
+
+/**
+ * A spike of an output neuron, identified by its cell.
+ */
+struct TrainSpike {
+	uint16_t tick;
+	uint16_t cell;
+	uint8_t matched;
+};
+
+struct Train {
+	struct TrainSpike spikes[MAX_TRAIN];
+	uint16_t length;
+};
+
+static struct Train compiled, reference;
+
+/**
+ * Runs the network for TICKS ticks on spikes from the given seed, on random cells, and
+ * keeps the output spikes in the train.
+ */
+void runTrain(uint32_t seed, struct Train *train) {
+	struct AERBuffer in, out;
+	union AER tuple, *aer;
+	uint16_t t, k;
+	srand(seed);
+	train->length = 0;
+	for (t = 0; t < TICKS; t++) {
+		initAER(&in); initAER(&out);
+		for (k = rand() % 30; k > 0; k--) {
+			tuple.coordinate.x = rand() % clctx->s->columns;
+			tuple.coordinate.y = rand() % clctx->s->rows;
+			tuple.event = t;
+			pushAER(&in, &tuple);
+		}
+		while (runNeuralNetwork(&in, &out));
+		while ((aer = popAER(&out)) != NULL) {
+			if (train->length == MAX_TRAIN) continue;
+			struct TrainSpike *ts = &train->spikes[train->length++];
+			ts->tick = t;
+			ts->cell = aer->coordinate.y * clctx->s->columns + aer->coordinate.x;
+			ts->matched = 0;
+		}
+	}
+}
+
+/**
+ * Matches the spikes of one train with the not yet matched ones of the other, and returns
+ * the amount of matches.
+ */
+uint16_t matchTrains(struct Train *a, struct Train *b) {
+	uint16_t i, j, matches = 0, from = 0;
+	for (i = 0; i < a->length; i++) {
+		struct TrainSpike *sa = &a->spikes[i];
+		while ((from < b->length) && (b->spikes[from].tick + SPIKE_WINDOW < sa->tick)) from++;
+		for (j = from; (j < b->length) && (b->spikes[j].tick <= sa->tick + SPIKE_WINDOW); j++) {
+			struct TrainSpike *sb = &b->spikes[j];
+			if (!sb->matched && (sb->cell == sa->cell)) {
+				sb->matched = sa->matched = 1;
+				matches++;
+				break;
+			}
+		}
+	}
+	return matches;
+}
+
+/**
+ * The sum over all cells of the difference in the amount of spikes of the two trains.
+ */
+uint32_t rateDifference(struct Train *a, struct Train *b) {
+	uint16_t i, cells = clctx->s->rows * clctx->s->columns;
+	int32_t *count = calloc(cells, sizeof(int32_t));
+	uint32_t difference = 0;
+	for (i = 0; i < a->length; i++) count[a->spikes[i].cell]++;
+	for (i = 0; i < b->length; i++) count[b->spikes[i].cell]--;
+	for (i = 0; i < cells; i++) difference += abs(count[i]);
+	free(count);
+	return difference;
+}
+
+uint8_t sameTrains(struct Train *a, struct Train *b) {
+	uint16_t i;
+	if (a->length != b->length) return 0;
+	for (i = 0; i < a->length; i++) {
+		if ((a->spikes[i].tick != b->spikes[i].tick) || (a->spikes[i].cell != b->spikes[i].cell))
+			return 0;
+	}
+	return 1;
+}
+
+/**
+ * Develops a network from a random genome, with the given seed. Random genomes give small
+ * networks that hardly spike, and the default weights and types of development, so the
+ * weights, the Izhikevich types and the roles of the neurons are drawn again. Integrators
+ * are left out, at these inputs they are chaotic, any rounding changes their trains.
+ */
+void developRandomNetwork(uint32_t seed) {
+	static const uint8_t types[] = { NEURONTYPE_TONIC_SPIKING, NEURONTYPE_PHASIC_SPIKING,
+			NEURONTYPE_CLASS1_EXC, NEURONTYPE_SPIKE_LATENCY, NEURONTYPE_CLASS1_EXC | 0x01 };
+	static const uint8_t roles[] = { INPUT_NEURON, HIDDEN_NEURON, OUTPUT_NEURON };
+	struct Port *lp;
+	uint16_t i;
+	srand(seed);
+	for (i = 0; i < GENOME_SIZE; i++) clctx->dna->content[i] = rand();
+	freeGenes();
+	initGeneExtraction();
+	extractGenes(GENOME_SIZE);
+	developNeuralNetwork();
+	for (clctx->n = clctx->nn->neurons; clctx->n != NULL; clctx->n = clctx->n->next) {
+		clctx->n->type = types[rand() % 5] | roles[rand() % 3];
+		init_neuron();
+		clctx->n->I = 0;
+		clctx->n->history->spike_bitseq = 0;
+		for (lp = clctx->n->ports_out; lp != NULL; lp = lp->next) {
+			lp->synapse->weight = 10 + rand() % 40;
+			lp->synapse->delay = 1;
+		}
+	}
+	finalizeNeuralNetwork();
+}
+
+int main() {
+	openlog ("tlinda", LOG_CONS, LOG_LOCAL0);
+	initLog(LOG_NOTICE);
+	pthread_t this = pthread_self();
+	ptreaty_add_thread(&this, "Main");
+	tprintf(LOG_NOTICE, __func__, "Start Tlinda - Test Compiled Network");
+
+	clctx->clconf = calloc(1, sizeof(struct ColindaConfig));
+	clctx->dna = malloc(sizeof(struct Genome));
+	clctx->dna->content = malloc(GENOME_SIZE * sizeof(Codon));
+	initGeneExtraction();
+
+	uint32_t seed, spikes = 0, matches = 0, difference = 0, identical = 0;
+	char text[128];
+	for (seed = 1; seed <= GENOMES; seed++) {
+		developRandomNetwork(seed);
+		runTrain(seed, &compiled);
+		struct CompiledNetwork *lcn = clctx->cn;
+		clctx->cn = NULL;
+		runTrain(seed, &reference);
+		clctx->cn = lcn;
+
+		uint16_t m = matchTrains(&reference, &compiled);
+		spikes += reference.length + compiled.length;
+		matches += 2 * m;
+		difference += rateDifference(&reference, &compiled);
+		if (sameTrains(&reference, &compiled)) identical++;
+		sprintf(text, "Genome %i: %i neurons, %i reference and %i compiled spikes, %i matched",
+				seed, clctx->cn->neuron_count, reference.length, compiled.length, m);
+		tprintf(LOG_VERBOSE, __func__, text);
+	}
+
+	float agreement = spikes ? (float)matches / spikes : 1;
+	float error = spikes ? (float)difference / spikes : 0;
+	sprintf(text, "%i of %i spike trains the same, %i%% of %i spikes matched, rates off by %i%%",
+			identical, GENOMES, (int)(100 * agreement), spikes, (int)(100 * error));
+	tprintf(LOG_NOTICE, __func__, text);
+#ifndef WITH_FIXED_POINT
+	if (identical != GENOMES) {
+		tprintf(LOG_ALERT, __func__, "The compiled network differs from the pointer form");
+		return 1;
+	}
+#endif
+	if (error > MAX_RATE_ERROR) {
+		tprintf(LOG_ALERT, __func__, "The spike rates of the compiled network are off");
+		return 1;
+	}
+	tprintf(LOG_NOTICE, __func__, "End compiled network test");
+	return 0;
+}
+
+#endif //TEST_COMPILED_NETWORK
@@ -30,6 +30,7 @@
 #include <grid.h>
 #include <embryogeny.h>
 #include <topology.h>
+#include <archive.h>
 
 #include <linda/log.h>
 #include <linda/ptreaty.h>
@@ -57,12 +58,38 @@ void storeGenome() {
 	FILE* f1 = fopen ("genome.text", "wt");
 	for (i = 0; i < gsconf->genomeSize; i++) {
 		//fprintf(f1, "%i\n", dna->content[i]);
-		fputc(dna->content[i], f1);
+		fputc(clctx->dna->content[i], f1);
 		//		write(f1, line, strlen(line));
 	}
 	fclose(f1);
 }
 
+/**
+ * With LINDA_ARCHIVE set, the genome is the one of an agent in a generation in that archive,
+ * by default the first agent of the last generation, or as given in LINDA_ARCHIVE_GENOME as
+ * "record:agent", and the genome size becomes the one of the archive. The genome is not
+ * copied, it is the one in the mapped archive.
+ */
+uint8_t readArchivedGenome() {
+	const char *path = getenv("LINDA_ARCHIVE");
+	const char *text = getenv("LINDA_ARCHIVE_GENOME");
+	unsigned int index, agent = 0;
+	if (path == NULL) return 0;
+	struct Archive *archive = openArchive(path, 0, 0, 0);
+	if (archive == NULL) return 0;
+	gsconf->genomeSize = archive->header->genome_size;
+	index = archive->header->record_count - 1;
+	if (text != NULL) sscanf(text, "%u:%u", &index, &agent);
+	const struct ArchiveRecord *record = getArchiveRecord(archive, index);
+	if (record == NULL || agent >= archive->header->population_size) {
+		printf("No genome %u:%u in archive.\n", index, agent);
+		exit(1);
+	}
+	clctx->dna = malloc(sizeof(struct Genome));
+	clctx->dna->content = (Codon*)getArchiveGenome(archive, record, agent);
+	return 1;
+}
+
 /**
  * This routine reads the genome from a text-file that is stored previously by using
  * storeGenome. It is expected to be of the size defined in gconf. There are no checks on the
@@ -70,17 +97,18 @@ void storeGenome() {
  */
 void readGenome() {
 	uint16_t i = 0; uint8_t value; FILE* f1;
+	if (readArchivedGenome()) return;
 	if((f1 = fopen("genome.text", "r"))==NULL) {
 		printf("Cannot open file.\n");
 		exit(1);
 	}
-	dna = malloc(sizeof(struct Genome));
-	dna->content = calloc(gsconf->genomeSize, sizeof(Codon));
+	clctx->dna = malloc(sizeof(struct Genome));
+	clctx->dna->content = calloc(gsconf->genomeSize, sizeof(Codon));
 
 	for(i = 0; i < gsconf->genomeSize; i++) {
 		value = fgetc(f1);
 		//@todo		if(value == EOF) break;
-		dna->content[i] = value;
+		clctx->dna->content[i] = value;
 	}
 	fclose(f1);
 
@@ -110,7 +138,7 @@ void newcycle() {
 	printGenesPerProductDistribution();
 
 #ifdef TEST_SEPARATE_INSTRUCTIONS 
-	gc = getGridCell(1,1);
+	clctx->gc = getGridCell(1,1);
 	tprintf(LOG_NOTICE, __func__, "Print for change");
 	printNeurons(LOG_DEBUG);
 	tprintf(LOG_NOTICE, __func__, "Split full");
@@ -120,7 +148,7 @@ void newcycle() {
 	applyMorphologicalChange(17);
 	printNeurons(LOG_NOTICE);
 	tprintf(LOG_NOTICE, __func__, "And split/copy sparse");
-	gc = getGridCell(2,1);
+	clctx->gc = getGridCell(2,1);
 	applyMorphologicalChange(10);
 	//	printNeurons(LOG_NOTICE);
 	//	tprintf(LOG_NOTICE, __func__, "And split/copy full");
@@ -131,20 +159,19 @@ void newcycle() {
 	applyMorphologicalChange(17);
 	printNeurons(LOG_NOTICE);
 	tprintf(LOG_NOTICE, __func__, "And remove again");
-	gc = getGridCell(3,1);
+	clctx->gc = getGridCell(3,1);
 	applyMorphologicalChange(17);
 	printNeurons(LOG_NOTICE);
 #else
 	//	setVerbosity(LOG_NOTICE);
 	tprintf(LOG_NOTICE, __func__, "Run GRN");
-	uint16_t t = 0;
+	uint16_t t = 0; uint8_t developing;
 	do {
-		updateGrid();
 		//		tprintf(LOG_VVV, __func__, "Print concentrations");
 		//		printAllConcentrationsMultiplePerRow();
 
-		tprintf(LOG_VVV, __func__, "Apply morphological changes");
-		applyEmbryogenesis();
+		tprintf(LOG_VVV, __func__, "Update grid and apply morphological changes");
+		developing = stepEmbryology();
 
 		tprintf(LOG_VVV, __func__, "Draws figures (in file)");
 		//		drawAllConcentrations(t);
@@ -157,7 +184,7 @@ void newcycle() {
 		if (!(t % 100)) {
 			printDistribution(LOG_VERBOSE);
 		}
-	} while(t < 1000);
+	} while(developing);
 	if (!isPrinted(LOG_VVV)) printf("\n");
 
 #endif
@@ -172,10 +199,10 @@ void newcycle() {
  * from the freecycle() routine.
  */
 void initcycle() {
-	if (dna != NULL) {
+	if (clctx->dna != NULL) {
 		tprintf(LOG_VERBOSE, __func__, "Deallocate");
-		free(dna->content);
-		free(dna);
+		free(clctx->dna->content);
+		free(clctx->dna);
 		receiveNewGenome();
 	}
 
@@ -184,16 +211,16 @@ void initcycle() {
 	configGenome();
 
 	tprintf(LOG_VERBOSE, __func__, "Set # of factors");
-	gconf->regulatingFactors = 11; //20
-	gconf->phenotypicFactors = 14; //23;
+	clctx->gconf->regulatingFactors = 11; //20
+	clctx->gconf->phenotypicFactors = 14; //23;
 
 #ifdef OVERWRITE_GENOME
 	tprintf(LOG_VERBOSE, __func__, "Generate genome");
 	struct RawGenome *rawdna = generateGenome();
 	tprintf(LOG_VERBOSE, __func__, "Copy to colinda genome");
-	dna->content = rawdna->content;
+	clctx->dna->content = flattenGenome(rawdna, malloc(gsconf->genomeSize * sizeof(Codon)));
 	//	generateGenome();
-	free(rawdna);
+	freeGenome(rawdna);
 	storeGenome();
 #else
 	tprintf(LOG_VERBOSE, __func__, "Read genome from file");
@@ -227,7 +254,7 @@ int main() {
 	tprintf(LOG_INFO, __func__, "Initialize genomes.h");
 	initGenomes();
 	gsconf->genomeSize = 20000;
-	dna = NULL;
+	clctx->dna = NULL;
 	initGeneExtraction();
 		
 	uint8_t i;
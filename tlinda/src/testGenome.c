@@ -40,39 +40,39 @@ uint16_t overwriteGenome(uint8_t test) {
 		//test if genes are not mixed up when there are two markers in one gene 
 		//should result in 1 gene, with values [0, 43-1, 23-1, 5-1, 5-1, 100, 100, 0]. 
 		for (i = 0; i < gsconf->genomeSize; i++) {
-			dna->content[i] = 0xFF;
-			if (i == 0) dna->content[i] = 0;
-			if (i == 7) dna->content[i] = 0;
+			clctx->dna->content[i] = 0xFF;
+			if (i == 0) clctx->dna->content[i] = 0;
+			if (i == 7) clctx->dna->content[i] = 0;
 		}
 		return 1;
 	case 1:
 		//should result in 2 genes, with values [0, 43-1, 23-1, 5-1, 5-1, 100, 100, 100].
 		for (i = 0; i < gsconf->genomeSize; i++) {
-			dna->content[i] = 0xFF;
-			if (i == 0) dna->content[i] = 0;
-			if (i == 8) dna->content[i] = 0;
+			clctx->dna->content[i] = 0xFF;
+			if (i == 0) clctx->dna->content[i] = 0;
+			if (i == 8) clctx->dna->content[i] = 0;
 		}
 		return 2;
 	case 2:
 		//should result in gconf->genomeSize/8 genes, with values [0, 23, 0, 0, 0, 0, 0, 0].
 		for (i = 0; i < gsconf->genomeSize; i++) {
-			dna->content[i] = 0x0;
+			clctx->dna->content[i] = 0x0;
 		}
 		return ((uint16_t)gsconf->genomeSize) / 8;
 	case 3:
 		//test if data beyond genome is not read as if it were a gene
 		//should result in 0 genes
 		for (i = 0; i < gsconf->genomeSize; i++) {
-			dna->content[i] = 0xFF;
-			if (i == gsconf->genomeSize - 7) dna->content[i] = 0;
+			clctx->dna->content[i] = 0xFF;
+			if (i == gsconf->genomeSize - 7) clctx->dna->content[i] = 0;
 		}
 		return 0;
 	case 4:
 		//test if data right at the end of genome is properly read as a gene
 		//should result in 1 gene 
 		for (i = 0; i < gsconf->genomeSize; i++) {
-			dna->content[i] = 0xFF;
-			if (i == gsconf->genomeSize - 8) dna->content[i] = 0;
+			clctx->dna->content[i] = 0xFF;
+			if (i == gsconf->genomeSize - 8) clctx->dna->content[i] = 0;
 		}
 		return 1;
 	}	
@@ -80,10 +80,10 @@ uint16_t overwriteGenome(uint8_t test) {
 }
 
 uint16_t countGenes() {
-	g = eg->genes; uint16_t result = 0; 
-	while (g != NULL) {
+	clctx->g = clctx->eg->genes; uint16_t result = 0; 
+	while (clctx->g != NULL) {
 		result++;
-		g = g->next;
+		clctx->g = clctx->g->next;
 	}
 	return result;
 }
@@ -113,10 +113,11 @@ int main() {
 	struct RawGenome *rawdna = generateGenome();
 	
 	tprintf(LOG_VERBOSE, __func__, "Copy to colinda genome");
-	dna->content = rawdna->content;
+	clctx->dna->content = flattenGenome(rawdna, malloc(gsconf->genomeSize * sizeof(Codon)));
+	freeGenome(rawdna);
 
 	tprintf(LOG_VERBOSE, __func__, "Print genome in sets of chars");
-	printGenome(dna);
+	printGenome(clctx->dna);
 
 	printf("\n\nA gene occupies a total of 8 characters. The amount of chars in total is %i.\n", gsconf->genomeSize);
 	printf("The amount of genes is defined later on by the extraction mechanism.\n");
@@ -152,7 +153,7 @@ int main() {
 			char errmsg[128]; sprintf(errmsg, "Gene count differs: %i vs %i genes found!!\n", geneCountA, geneCountB);
 			tprintf(LOG_ERR, __func__, errmsg); 
 			printf("The genome:");
-			printGenome(dna);
+			printGenome(clctx->dna);
 			printf("\nThe (wrong) extraction of genes");
 			printGenes();
 			printf("\n");